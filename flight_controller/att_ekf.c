@@ -0,0 +1,351 @@
+//*****************************************************************************
+//
+// att_ekf.c - Error-state extended Kalman filter of the attitude and the
+//             gyro bias.
+//
+// The caller keeps the attitude as a DCM and the gyro bias estimate, and
+// integrates the bias free rates into the DCM as before. The filter keeps the
+// covariance of the errors of both, the rotation from the estimated to the
+// true attitude in the body frame and the bias error:
+//
+//   d/dt dtheta = -[w]x dtheta - dbias
+//   d/dt dbias  = 0
+//
+// The accelerometer is taken as the direction of gravity in the body frame,
+// which is the last row of the DCM, and the magnetometer as the error of the
+// heading about the world Z axis. Every reading corrects both errors, with
+// a gain that follows from the covariance instead of a fixed blend, so the
+// bias is learned faster while the estimate is uncertain and the correction
+// is turned down as the filter settles.
+//
+// All matrices are of fixed size. The transition matrix and the measurement
+// matrix are sparse, so the products are written out by blocks of 3x3
+// instead of multiplying 6x6 matrices.
+//
+// The module uses no TivaWare headers.
+//
+//*****************************************************************************
+
+#include <math.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "att_ekf.h"
+
+//*****************************************************************************
+//
+// Initializes the filter with the default noise and resets it.
+//
+//*****************************************************************************
+void
+AttEKFInit(tAttEKF *psEKF)
+{
+    psEKF->fGyroNoise = ATT_EKF_GYRO_NOISE;
+    psEKF->fBiasNoise = ATT_EKF_BIAS_NOISE;
+    psEKF->fAccelNoise = ATT_EKF_ACCEL_NOISE;
+    psEKF->fHeadingNoise = ATT_EKF_HEADING_NOISE;
+    psEKF->ui32Rejected = 0;
+    AttEKFReset(psEKF);
+}
+
+//*****************************************************************************
+//
+// Resets the covariance to the uncertainty of a new start, for when the
+// attitude was started from the accelerometer and the bias estimate zeroed.
+//
+//*****************************************************************************
+void
+AttEKFReset(tAttEKF *psEKF)
+{
+    int i, j;
+
+    for (i = 0; i < ATT_EKF_STATES; i++)
+    {
+        for (j = 0; j < ATT_EKF_STATES; j++)
+        {
+            psEKF->ppfP[i][j] = 0.0f;
+        }
+    }
+    for (i = 0; i < 3; i++)
+    {
+        psEKF->ppfP[i][i] = ATT_EKF_INIT_ATTITUDE * ATT_EKF_INIT_ATTITUDE;
+        psEKF->ppfP[i + 3][i + 3] = ATT_EKF_INIT_BIAS * ATT_EKF_INIT_BIAS;
+    }
+    psEKF->fNIS = 0.0f;
+}
+
+//*****************************************************************************
+//
+// Propagates the covariance over fDeltaT with the bias free rates pfRate in
+// rad/s, after the caller rotated the DCM by them. With the blocks
+//
+//   P = | A  B |      Phi = | M  -dt I |     M = I - [w]x dt
+//       | B' C |            | 0    I   |
+//
+// Phi P Phi' + Q is
+//
+//   A <- M A M' - dt (M B + (M B)') + dt^2 C + Qa
+//   B <- M B - dt C
+//   C <- C + Qc
+//
+//*****************************************************************************
+void
+AttEKFPredict(tAttEKF *psEKF, const float pfRate[3], float fDeltaT)
+{
+    float ppfM[3][3], ppfMA[3][3], ppfMB[3][3];
+    float fQa, fQc;
+    int i, j;
+
+    ppfM[0][0] = 1.0f;
+    ppfM[0][1] = pfRate[2] * fDeltaT;
+    ppfM[0][2] = -pfRate[1] * fDeltaT;
+    ppfM[1][0] = -pfRate[2] * fDeltaT;
+    ppfM[1][1] = 1.0f;
+    ppfM[1][2] = pfRate[0] * fDeltaT;
+    ppfM[2][0] = pfRate[1] * fDeltaT;
+    ppfM[2][1] = -pfRate[0] * fDeltaT;
+    ppfM[2][2] = 1.0f;
+
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            ppfMA[i][j] = (ppfM[i][0] * psEKF->ppfP[0][j] +
+                           ppfM[i][1] * psEKF->ppfP[1][j] +
+                           ppfM[i][2] * psEKF->ppfP[2][j]);
+            ppfMB[i][j] = (ppfM[i][0] * psEKF->ppfP[0][j + 3] +
+                           ppfM[i][1] * psEKF->ppfP[1][j + 3] +
+                           ppfM[i][2] * psEKF->ppfP[2][j + 3]);
+        }
+    }
+
+    fQa = psEKF->fGyroNoise * psEKF->fGyroNoise * fDeltaT;
+    fQc = psEKF->fBiasNoise * psEKF->fBiasNoise * fDeltaT;
+
+    for (i = 0; i < 3; i++)
+    {
+        for (j = i; j < 3; j++)
+        {
+            float fA = (ppfMA[i][0] * ppfM[j][0] + ppfMA[i][1] * ppfM[j][1] +
+                        ppfMA[i][2] * ppfM[j][2] -
+                        fDeltaT * (ppfMB[i][j] + ppfMB[j][i]) +
+                        fDeltaT * fDeltaT * psEKF->ppfP[i + 3][j + 3]);
+            if (i == j)
+            {
+                fA += fQa;
+            }
+            psEKF->ppfP[i][j] = fA;
+            psEKF->ppfP[j][i] = fA;
+        }
+    }
+
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            float fB = ppfMB[i][j] - fDeltaT * psEKF->ppfP[i + 3][j + 3];
+            psEKF->ppfP[i][j + 3] = fB;
+            psEKF->ppfP[j + 3][i] = fB;
+        }
+        psEKF->ppfP[i + 3][i + 3] += fQc;
+    }
+}
+
+//*****************************************************************************
+//
+// Corrects with an accelerometer reading pfAccel, in any unit. pfGravity is
+// the predicted direction of gravity in the body frame, the last row of the
+// DCM. With the attitude error the prediction becomes
+//
+//   g + [g]x dtheta
+//
+// so the measurement matrix is H = | [g]x  0 |.
+//
+// fTrust, between 0 and 1, is how far the reading is taken as gravity alone.
+// The noise of the reading is divided by it, a trust of 0 ignores it.
+//
+// Returns false if the reading was ignored or rejected by the gate.
+// Otherwise the covariance is updated and pfCorrection receives the
+// estimated errors: the rotation in rad to apply to the DCM in the body frame
+// and the correction in rad/s to add to the bias estimate.
+//
+//*****************************************************************************
+bool
+AttEKFAccelUpdate(tAttEKF *psEKF, const float pfGravity[3],
+                  const float pfAccel[3], float fTrust,
+                  float pfCorrection[ATT_EKF_STATES])
+{
+    float ppfPHt[ATT_EKF_STATES][3], ppfK[ATT_EKF_STATES][3];
+    float ppfS[3][3], ppfSInv[3][3];
+    float pfInnov[3], pfSInvInnov[3];
+    float fDet, fNorm, fR;
+    int i, j;
+
+    fNorm = sqrtf(pfAccel[0] * pfAccel[0] + pfAccel[1] * pfAccel[1] +
+                  pfAccel[2] * pfAccel[2]);
+    if (!(fNorm > 0.0f) || !(fTrust > 0.0f))
+    {
+        return false;
+    }
+
+    //
+    // P H' has the rows [g]x P[k][0..2], the cross products of the gravity
+    // with the first three columns of P.
+    //
+    for (i = 0; i < ATT_EKF_STATES; i++)
+    {
+        const float *pfRow = psEKF->ppfP[i];
+        ppfPHt[i][0] = pfGravity[1] * pfRow[2] - pfGravity[2] * pfRow[1];
+        ppfPHt[i][1] = pfGravity[2] * pfRow[0] - pfGravity[0] * pfRow[2];
+        ppfPHt[i][2] = pfGravity[0] * pfRow[1] - pfGravity[1] * pfRow[0];
+    }
+
+    //
+    // S = H P H' + R, the columns of H P H' are [g]x times the columns of
+    // the top block of P H'.
+    //
+    fR = psEKF->fAccelNoise * psEKF->fAccelNoise / (fTrust * fTrust);
+    for (j = 0; j < 3; j++)
+    {
+        ppfS[0][j] = (pfGravity[1] * ppfPHt[2][j] -
+                      pfGravity[2] * ppfPHt[1][j]);
+        ppfS[1][j] = (pfGravity[2] * ppfPHt[0][j] -
+                      pfGravity[0] * ppfPHt[2][j]);
+        ppfS[2][j] = (pfGravity[0] * ppfPHt[1][j] -
+                      pfGravity[1] * ppfPHt[0][j]);
+        ppfS[j][j] += fR;
+    }
+
+    //
+    // S is symmetric positive definite, invert it by its cofactors.
+    //
+    ppfSInv[0][0] = ppfS[1][1] * ppfS[2][2] - ppfS[1][2] * ppfS[2][1];
+    ppfSInv[0][1] = ppfS[0][2] * ppfS[2][1] - ppfS[0][1] * ppfS[2][2];
+    ppfSInv[0][2] = ppfS[0][1] * ppfS[1][2] - ppfS[0][2] * ppfS[1][1];
+    ppfSInv[1][1] = ppfS[0][0] * ppfS[2][2] - ppfS[0][2] * ppfS[2][0];
+    ppfSInv[1][2] = ppfS[0][2] * ppfS[1][0] - ppfS[0][0] * ppfS[1][2];
+    ppfSInv[2][2] = ppfS[0][0] * ppfS[1][1] - ppfS[0][1] * ppfS[1][0];
+    fDet = (ppfS[0][0] * ppfSInv[0][0] + ppfS[0][1] * ppfSInv[0][1] +
+            ppfS[0][2] * ppfSInv[0][2]);
+    if (!(fDet > 0.0f))
+    {
+        return false;
+    }
+    fDet = 1.0f / fDet;
+    for (i = 0; i < 3; i++)
+    {
+        for (j = i; j < 3; j++)
+        {
+            ppfSInv[i][j] *= fDet;
+            ppfSInv[j][i] = ppfSInv[i][j];
+        }
+    }
+
+    //
+    // Innovation and its normalized square.
+    //
+    fNorm = 1.0f / fNorm;
+    for (i = 0; i < 3; i++)
+    {
+        pfInnov[i] = pfAccel[i] * fNorm - pfGravity[i];
+    }
+    for (i = 0; i < 3; i++)
+    {
+        pfSInvInnov[i] = (ppfSInv[i][0] * pfInnov[0] +
+                          ppfSInv[i][1] * pfInnov[1] +
+                          ppfSInv[i][2] * pfInnov[2]);
+    }
+    psEKF->fNIS = (pfInnov[0] * pfSInvInnov[0] + pfInnov[1] * pfSInvInnov[1] +
+                   pfInnov[2] * pfSInvInnov[2]);
+    if (!(psEKF->fNIS < ATT_EKF_GATE))
+    {
+        psEKF->ui32Rejected++;
+        return false;
+    }
+
+    //
+    // Gain K = P H' S^-1, the correction K y and P <- P - K (P H')'.
+    //
+    for (i = 0; i < ATT_EKF_STATES; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            ppfK[i][j] = (ppfPHt[i][0] * ppfSInv[0][j] +
+                          ppfPHt[i][1] * ppfSInv[1][j] +
+                          ppfPHt[i][2] * ppfSInv[2][j]);
+        }
+        pfCorrection[i] = (ppfPHt[i][0] * pfSInvInnov[0] +
+                           ppfPHt[i][1] * pfSInvInnov[1] +
+                           ppfPHt[i][2] * pfSInvInnov[2]);
+    }
+    for (i = 0; i < ATT_EKF_STATES; i++)
+    {
+        for (j = i; j < ATT_EKF_STATES; j++)
+        {
+            float fP = psEKF->ppfP[i][j] - (ppfK[i][0] * ppfPHt[j][0] +
+                                            ppfK[i][1] * ppfPHt[j][1] +
+                                            ppfK[i][2] * ppfPHt[j][2]);
+            psEKF->ppfP[i][j] = fP;
+            psEKF->ppfP[j][i] = fP;
+        }
+    }
+
+    return true;
+}
+
+//*****************************************************************************
+//
+// Corrects with a heading error fError in rad, the rotation about the world Z
+// axis that takes the estimated heading to the measured one. pfGravity is
+// the last row of the DCM, the world Z axis in the body frame, so the
+// measurement matrix is H = | g'  0 |.
+//
+// Returns false if the reading was rejected by the gate, otherwise updates
+// the covariance and fills pfCorrection as AttEKFAccelUpdate() does.
+//
+//*****************************************************************************
+bool
+AttEKFHeadingUpdate(tAttEKF *psEKF, const float pfGravity[3], float fError,
+                    float pfCorrection[ATT_EKF_STATES])
+{
+    float pfPHt[ATT_EKF_STATES];
+    float fS, fNIS;
+    int i, j;
+
+    for (i = 0; i < ATT_EKF_STATES; i++)
+    {
+        pfPHt[i] = (psEKF->ppfP[i][0] * pfGravity[0] +
+                    psEKF->ppfP[i][1] * pfGravity[1] +
+                    psEKF->ppfP[i][2] * pfGravity[2]);
+    }
+    fS = (pfGravity[0] * pfPHt[0] + pfGravity[1] * pfPHt[1] +
+          pfGravity[2] * pfPHt[2] +
+          psEKF->fHeadingNoise * psEKF->fHeadingNoise);
+    if (!(fS > 0.0f))
+    {
+        return false;
+    }
+
+    fNIS = fError * fError / fS;
+    if (!(fNIS < ATT_EKF_HEADING_GATE))
+    {
+        psEKF->ui32Rejected++;
+        return false;
+    }
+
+    fS = 1.0f / fS;
+    for (i = 0; i < ATT_EKF_STATES; i++)
+    {
+        pfCorrection[i] = pfPHt[i] * fS * fError;
+    }
+    for (i = 0; i < ATT_EKF_STATES; i++)
+    {
+        for (j = i; j < ATT_EKF_STATES; j++)
+        {
+            float fP = psEKF->ppfP[i][j] - pfPHt[i] * fS * pfPHt[j];
+            psEKF->ppfP[i][j] = fP;
+            psEKF->ppfP[j][i] = fP;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,120 @@
+//*****************************************************************************
+//
+// att_ekf.h - Error-state extended Kalman filter of the attitude and the
+//             gyro bias.
+//
+//*****************************************************************************
+
+#ifndef _ATT_EKF_H_
+#define _ATT_EKF_H_
+
+//*****************************************************************************
+//
+// If building with a C++ compiler, make all of the definitions in this header
+// have a C binding.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//*****************************************************************************
+//
+// Number of error states: the attitude error in the body frame, in rad, and
+// the gyro bias error, in rad/s.
+//
+//*****************************************************************************
+#define ATT_EKF_STATES              6
+
+//*****************************************************************************
+//
+// Default noise of the model: the gyro noise in rad/s/sqrt(Hz), the random
+// walk of the gyro bias in rad/s^2/sqrt(Hz), the noise of the direction
+// of the accelerometer reading and of the magnetometer heading in rad, per
+// sample.
+//
+//*****************************************************************************
+#define ATT_EKF_GYRO_NOISE          0.005f
+#define ATT_EKF_BIAS_NOISE          0.0003f
+#define ATT_EKF_ACCEL_NOISE         0.05f
+#define ATT_EKF_HEADING_NOISE       0.05f
+
+//*****************************************************************************
+//
+// Standard deviations of the initial attitude error in rad and of the
+// initial bias error in rad/s.
+//
+//*****************************************************************************
+#define ATT_EKF_INIT_ATTITUDE       0.1f
+#define ATT_EKF_INIT_BIAS           0.02f
+
+//*****************************************************************************
+//
+// Readings whose normalized innovation squared is above the gate are
+// rejected, 99.9 % of the chi-square distribution with 3 degrees of freedom
+// for the accelerometer and with 1 for the heading.
+//
+//*****************************************************************************
+#define ATT_EKF_GATE                16.27f
+#define ATT_EKF_HEADING_GATE        10.83f
+
+//*****************************************************************************
+//
+// Filter state. The attitude and the bias themselves are kept by the caller,
+// the filter only keeps the covariance of their errors.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // Covariance of the error states.
+    //
+    float ppfP[ATT_EKF_STATES][ATT_EKF_STATES];
+
+    //
+    // Noise of the model, see the ATT_EKF_*_NOISE defaults.
+    //
+    float fGyroNoise;
+    float fBiasNoise;
+    float fAccelNoise;
+    float fHeadingNoise;
+
+    //
+    // Normalized innovation squared of the last accelerometer reading, and
+    // the number of readings rejected by the gate.
+    //
+    float fNIS;
+    uint32_t ui32Rejected;
+}
+tAttEKF;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern void AttEKFInit(tAttEKF *psEKF);
+extern void AttEKFReset(tAttEKF *psEKF);
+extern void AttEKFPredict(tAttEKF *psEKF, const float pfRate[3],
+                          float fDeltaT);
+extern bool AttEKFAccelUpdate(tAttEKF *psEKF, const float pfGravity[3],
+                              const float pfAccel[3], float fTrust,
+                              float pfCorrection[ATT_EKF_STATES]);
+extern bool AttEKFHeadingUpdate(tAttEKF *psEKF, const float pfGravity[3],
+                                float fError,
+                                float pfCorrection[ATT_EKF_STATES]);
+
+//*****************************************************************************
+//
+// Mark the end of the C bindings section for C++ compilers.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ATT_EKF_H_
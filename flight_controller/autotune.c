@@ -0,0 +1,254 @@
+//*****************************************************************************
+//
+// autotune.c - Relay feedback auto-tune of the PD attitude gains.
+//
+// While the quadrotor hovers, the D term of one axis is replaced by a relay
+// on the filtered body rate. The rate loop then oscillates at the frequency
+// w where it lags by 180 deg, with an amplitude a that gives its gain there
+// (Astrom and Hagglund). For a relay of amplitude d and hysteresis e the
+// describing function puts the loop at
+//
+//   |G(jw)| = pi a / (4 d),   arg G(jw) = -180 deg + asin(e / a)
+//
+// The rate of the axis is fitted to an integrator with a dead time,
+// G(s) = b exp(-s theta) / s, which is what the airframe, the lagging
+// motors and the gyro filters look like below w. The D gain then puts the
+// crossover of the rate loop at the phase margin AUTOTUNE_PHASE_MARGIN and
+// the P gain makes s^2 + b Kd s + b Kp critically damped.
+//
+// Roll and pitch are tuned one after the other. The PD gains are shared by
+// all axes, so the gains of the axis with the smaller D gain are kept.
+//
+// The relay experiment uses no flight controller state, simul/autotune runs
+// it over recorded rates. The module uses no TivaWare headers.
+//
+//*****************************************************************************
+
+#include <math.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "autotune.h"
+
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+//*****************************************************************************
+//
+// Starts a relay experiment, with a positive output.
+//
+//*****************************************************************************
+void
+AutotuneRelayInit(tRelayId *psRelay, float fRelay, float fHysteresis,
+                  float fDeltaT)
+{
+    psRelay->fRelay = fRelay;
+    psRelay->fHysteresis = fHysteresis;
+    psRelay->fDeltaT = fDeltaT;
+    psRelay->fOutput = fRelay;
+    psRelay->ui32Ticks = 0;
+    psRelay->fMax = -INFINITY;
+    psRelay->fMin = INFINITY;
+    psRelay->ui32Cycles = 0;
+    psRelay->fPeriodSum = 0.0f;
+    psRelay->fAmplitudeSum = 0.0f;
+}
+
+//*****************************************************************************
+//
+// Feeds one filtered body rate in rad/s and switches the relay, whose output
+// is in psRelay->fOutput. A cycle ends with every switch to a positive
+// output. Returns true once AUTOTUNE_CYCLES cycles were measured.
+//
+//*****************************************************************************
+bool
+AutotuneRelayUpdate(tRelayId *psRelay, float fRate)
+{
+    psRelay->ui32Ticks++;
+    if (fRate > psRelay->fMax)
+    {
+        psRelay->fMax = fRate;
+    }
+    if (fRate < psRelay->fMin)
+    {
+        psRelay->fMin = fRate;
+    }
+
+    if ((psRelay->fOutput > 0.0f) && (fRate > psRelay->fHysteresis))
+    {
+        psRelay->fOutput = -psRelay->fRelay;
+    }
+    else if ((psRelay->fOutput < 0.0f) && (fRate < -psRelay->fHysteresis))
+    {
+        psRelay->fOutput = psRelay->fRelay;
+        if (psRelay->ui32Cycles >= AUTOTUNE_SKIP_CYCLES)
+        {
+            psRelay->fPeriodSum += psRelay->ui32Ticks * psRelay->fDeltaT;
+            psRelay->fAmplitudeSum += 0.5f * (psRelay->fMax - psRelay->fMin);
+        }
+        psRelay->ui32Cycles++;
+        psRelay->ui32Ticks = 0;
+        psRelay->fMax = -INFINITY;
+        psRelay->fMin = INFINITY;
+    }
+
+    return psRelay->ui32Cycles >= AUTOTUNE_SKIP_CYCLES + AUTOTUNE_CYCLES;
+}
+
+//*****************************************************************************
+//
+// Fits the measured cycles to b exp(-s theta) / s. Returns false if no cycle
+// was measured or the oscillation stayed within the hysteresis.
+//
+//*****************************************************************************
+bool
+AutotuneRelayModel(tRelayId *psRelay, float *pfGain, float *pfDelay)
+{
+    if (psRelay->ui32Cycles <= AUTOTUNE_SKIP_CYCLES)
+    {
+        return false;
+    }
+
+    float fCycles = (float)(psRelay->ui32Cycles - AUTOTUNE_SKIP_CYCLES);
+    float fPeriod = psRelay->fPeriodSum / fCycles;
+    float fAmplitude = psRelay->fAmplitudeSum / fCycles;
+    if ((fPeriod <= 0.0f) || (fAmplitude <= psRelay->fHysteresis))
+    {
+        return false;
+    }
+
+    float fW = 2.0f * M_PI / fPeriod;
+    *pfGain = fW * M_PI * fAmplitude / (4.0f * psRelay->fRelay);
+    *pfDelay = (0.5f * M_PI - asinf(psRelay->fHysteresis / fAmplitude)) / fW;
+    return true;
+}
+
+//*****************************************************************************
+//
+// PD gains for the model b exp(-s theta) / s of the rate.
+//
+//*****************************************************************************
+void
+AutotuneGains(float fGain, float fDelay, float *pfKp, float *pfKd)
+{
+    float fCrossover = (0.5f * M_PI - AUTOTUNE_PHASE_MARGIN) / fDelay;
+    float fKd = fCrossover / fGain;
+    float fKp = fGain * fKd * fKd / (4.0f * AUTOTUNE_DAMPING *
+                                     AUTOTUNE_DAMPING);
+
+    *pfKp = (fKp < AUTOTUNE_MAX_KP) ? fKp : AUTOTUNE_MAX_KP;
+    *pfKd = (fKd < AUTOTUNE_MAX_KD) ? fKd : AUTOTUNE_MAX_KD;
+}
+
+//*****************************************************************************
+//
+// Initializes the tuner, idle.
+//
+//*****************************************************************************
+void
+AutotuneInit(tAutotune *psTune)
+{
+    int i;
+
+    psTune->ui8State = AUTOTUNE_IDLE;
+    psTune->ui8Axis = 0;
+    for (i = 0; i < AUTOTUNE_AXES; i++)
+    {
+        psTune->pfGain[i] = 0.0f;
+        psTune->pfDelay[i] = 0.0f;
+    }
+    psTune->fKp = 0.0f;
+    psTune->fKd = 0.0f;
+}
+
+//*****************************************************************************
+//
+// Starts the tune with the roll axis. Must only be called while hovering.
+//
+//*****************************************************************************
+void
+AutotuneStart(tAutotune *psTune, float fDeltaT)
+{
+    AutotuneInit(psTune);
+    AutotuneRelayInit(&psTune->sRelay, AUTOTUNE_RELAY, AUTOTUNE_HYSTERESIS,
+                      fDeltaT);
+    psTune->ui8State = AUTOTUNE_RUNNING;
+}
+
+//*****************************************************************************
+//
+// Stops a running tune, the controller keeps its gains.
+//
+//*****************************************************************************
+void
+AutotuneStop(tAutotune *psTune)
+{
+    if (psTune->ui8State == AUTOTUNE_RUNNING)
+    {
+        psTune->ui8State = AUTOTUNE_IDLE;
+    }
+}
+
+//*****************************************************************************
+//
+// One update of the axis psTune->ui8Axis, with its angle error in rad and
+// its D term rate in rad/s. Returns the relay output in rad/s^2, which takes
+// the place of the D term of the axis, and moves on to the next axis once
+// the relay experiment is complete. Returns 0 once the tune is over.
+//
+//*****************************************************************************
+float
+AutotuneUpdate(tAutotune *psTune, float fError, float fRate)
+{
+    tRelayId *psRelay = &psTune->sRelay;
+    int i;
+
+    if (psTune->ui8State != AUTOTUNE_RUNNING)
+    {
+        return 0.0f;
+    }
+
+    if ((fabsf(fError) > AUTOTUNE_MAX_ANGLE) ||
+        (psRelay->ui32Ticks * psRelay->fDeltaT > AUTOTUNE_TIMEOUT))
+    {
+        psTune->ui8State = AUTOTUNE_FAILED;
+        return 0.0f;
+    }
+
+    if (!AutotuneRelayUpdate(psRelay, fRate))
+    {
+        return psRelay->fOutput;
+    }
+
+    i = psTune->ui8Axis;
+    if (!AutotuneRelayModel(psRelay, &psTune->pfGain[i], &psTune->pfDelay[i]))
+    {
+        psTune->ui8State = AUTOTUNE_FAILED;
+        return 0.0f;
+    }
+
+    psTune->ui8Axis++;
+    if (psTune->ui8Axis < AUTOTUNE_AXES)
+    {
+        AutotuneRelayInit(psRelay, AUTOTUNE_RELAY, AUTOTUNE_HYSTERESIS,
+                          psRelay->fDeltaT);
+        return 0.0f;
+    }
+
+    //
+    // Keeps the gains of the axis that needs the smaller D gain.
+    //
+    for (i = 0; i < AUTOTUNE_AXES; i++)
+    {
+        float fKp, fKd;
+
+        AutotuneGains(psTune->pfGain[i], psTune->pfDelay[i], &fKp, &fKd);
+        if ((i == 0) || (fKd < psTune->fKd))
+        {
+            psTune->fKp = fKp;
+            psTune->fKd = fKd;
+        }
+    }
+    psTune->ui8State = AUTOTUNE_DONE;
+    return 0.0f;
+}
@@ -0,0 +1,171 @@
+//*****************************************************************************
+//
+// autotune.h - Relay feedback auto-tune of the PD attitude gains.
+//
+//*****************************************************************************
+
+#ifndef _AUTOTUNE_H_
+#define _AUTOTUNE_H_
+
+//*****************************************************************************
+//
+// If building with a C++ compiler, make all of the definitions in this header
+// have a C binding.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//*****************************************************************************
+//
+// Relay experiment. The relay adds +-AUTOTUNE_RELAY rad/s^2 to the angular
+// acceleration of the axis and switches when the filtered body rate leaves
+// +-AUTOTUNE_HYSTERESIS rad/s. The first AUTOTUNE_SKIP_CYCLES cycles settle
+// the oscillation, the next AUTOTUNE_CYCLES are measured.
+//
+//*****************************************************************************
+#define AUTOTUNE_RELAY              20.0f
+#define AUTOTUNE_HYSTERESIS         0.05f
+#define AUTOTUNE_SKIP_CYCLES        2
+#define AUTOTUNE_CYCLES             6
+
+//*****************************************************************************
+//
+// The tune is abandoned when the relay does not switch for AUTOTUNE_TIMEOUT s
+// or the angle error of the axis grows beyond AUTOTUNE_MAX_ANGLE rad.
+//
+//*****************************************************************************
+#define AUTOTUNE_TIMEOUT            2.0f
+#define AUTOTUNE_MAX_ANGLE          0.35f
+
+//*****************************************************************************
+//
+// Design of the gains: the phase margin of the rate loop in rad, the
+// damping of the angle loop and the largest gains that are returned.
+//
+//*****************************************************************************
+#define AUTOTUNE_PHASE_MARGIN       0.785f
+#define AUTOTUNE_DAMPING            1.0f
+#define AUTOTUNE_MAX_KP             1000.0f
+#define AUTOTUNE_MAX_KD             200.0f
+
+//*****************************************************************************
+//
+// Tuner states.
+//
+//*****************************************************************************
+#define AUTOTUNE_IDLE               0
+#define AUTOTUNE_RUNNING            1
+#define AUTOTUNE_DONE               2
+#define AUTOTUNE_FAILED             3
+
+//*****************************************************************************
+//
+// Number of axes that are tuned, roll and pitch.
+//
+//*****************************************************************************
+#define AUTOTUNE_AXES               2
+
+//*****************************************************************************
+//
+// A relay experiment on one axis: the relay and the cycles that it caused.
+// Holds no flight controller state, simul/autotune runs it over logs.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // Relay amplitude in rad/s^2, hysteresis in rad/s and sample period in s.
+    //
+    float fRelay;
+    float fHysteresis;
+    float fDeltaT;
+
+    //
+    // Current output of the relay, +-fRelay.
+    //
+    float fOutput;
+
+    //
+    // Samples since the last switch to a positive output, and the extremes
+    // of the rate over them.
+    //
+    uint32_t ui32Ticks;
+    float fMax;
+    float fMin;
+
+    //
+    // Number of completed cycles, and the sums of the period in s and of the
+    // amplitude in rad/s of the measured ones.
+    //
+    uint32_t ui32Cycles;
+    float fPeriodSum;
+    float fAmplitudeSum;
+}
+tRelayId;
+
+//*****************************************************************************
+//
+// Tuner state.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // One of AUTOTUNE_*, and the axis whose relay runs.
+    //
+    uint8_t ui8State;
+    uint8_t ui8Axis;
+
+    //
+    // Relay experiment of the axis.
+    //
+    tRelayId sRelay;
+
+    //
+    // Identified model of each axis, the gain in rad/s^2 per commanded
+    // rad/s^2 and the dead time in s.
+    //
+    float pfGain[AUTOTUNE_AXES];
+    float pfDelay[AUTOTUNE_AXES];
+
+    //
+    // Tuned gains, valid once the state is AUTOTUNE_DONE.
+    //
+    float fKp;
+    float fKd;
+}
+tAutotune;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern void AutotuneRelayInit(tRelayId *psRelay, float fRelay,
+                              float fHysteresis, float fDeltaT);
+extern bool AutotuneRelayUpdate(tRelayId *psRelay, float fRate);
+extern bool AutotuneRelayModel(tRelayId *psRelay, float *pfGain,
+                               float *pfDelay);
+extern void AutotuneGains(float fGain, float fDelay, float *pfKp,
+                          float *pfKd);
+extern void AutotuneInit(tAutotune *psTune);
+extern void AutotuneStart(tAutotune *psTune, float fDeltaT);
+extern void AutotuneStop(tAutotune *psTune);
+extern float AutotuneUpdate(tAutotune *psTune, float fError, float fRate);
+
+//*****************************************************************************
+//
+// Mark the end of the C bindings section for C++ compilers.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _AUTOTUNE_H_
@@ -0,0 +1,203 @@
+//*****************************************************************************
+//
+// biquad.c - Second order IIR filters (low-pass and notch) for the gyro and
+//            the D term.
+//
+// The coefficients follow the bilinear transform designs of R. Bristow-
+// Johnson's audio EQ cookbook and are computed once, when a filter is
+// configured. Filtering is done in transposed direct form II, which needs
+// two state variables per channel and behaves well in single precision.
+//
+// The module uses no TivaWare headers so the same code builds on the host,
+// see simul/biquad/biquad_host.c.
+//
+//*****************************************************************************
+
+#include <math.h>
+#include <stdint.h>
+#include "biquad.h"
+
+//*****************************************************************************
+//
+// If M_PI has not been defined by the system headers, define it here.
+//
+//*****************************************************************************
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+//*****************************************************************************
+//
+// Quality factor of the low-pass sections, a Butterworth response.
+//
+//*****************************************************************************
+#define BIQUAD_LPF_Q            0.70710678f
+
+//*****************************************************************************
+//
+// Sets the normalized coefficients of a section.
+//
+//*****************************************************************************
+static void
+BiquadCoeffsSet(tBiquad *psBiquad, float fB0, float fB1, float fB2, float fA0,
+                float fA1, float fA2)
+{
+    psBiquad->fB0 = fB0 / fA0;
+    psBiquad->fB1 = fB1 / fA0;
+    psBiquad->fB2 = fB2 / fA0;
+    psBiquad->fA1 = fA1 / fA0;
+    psBiquad->fA2 = fA2 / fA0;
+}
+
+//*****************************************************************************
+//
+// Configures a section that passes the signal unchanged. Used for disabled
+// filters.
+//
+//*****************************************************************************
+void
+BiquadPassThroughInit(tBiquad *psBiquad)
+{
+    BiquadCoeffsSet(psBiquad, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f);
+}
+
+//*****************************************************************************
+//
+// Configures a second order Butterworth low-pass with the -3 dB frequency
+// fCutoff. A cutoff that is not positive or not below the Nyquist frequency
+// disables the section. The delay line is kept so the gains can be changed
+// while filtering.
+//
+//*****************************************************************************
+void
+BiquadLowPassInit(tBiquad *psBiquad, float fCutoff, float fSampleRate)
+{
+    if (!(fCutoff > 0.0f) || !(fCutoff < 0.5f * fSampleRate))
+    {
+        BiquadPassThroughInit(psBiquad);
+        return;
+    }
+
+    float fOmega = 2.0f * (float)M_PI * fCutoff / fSampleRate;
+    float fCos = cosf(fOmega);
+    float fAlpha = sinf(fOmega) / (2.0f * BIQUAD_LPF_Q);
+
+    BiquadCoeffsSet(psBiquad, (1.0f - fCos) / 2.0f, 1.0f - fCos,
+                    (1.0f - fCos) / 2.0f, 1.0f + fAlpha, -2.0f * fCos,
+                    1.0f - fAlpha);
+}
+
+//*****************************************************************************
+//
+// Configures a notch at fCenter with the quality factor fQ (center frequency
+// over -3 dB bandwidth). A center that is not positive or not below the
+// Nyquist frequency, or a Q that is not positive, disables the section.
+//
+//*****************************************************************************
+void
+BiquadNotchInit(tBiquad *psBiquad, float fCenter, float fQ, float fSampleRate)
+{
+    if (!(fCenter > 0.0f) || !(fCenter < 0.5f * fSampleRate) || !(fQ > 0.0f))
+    {
+        BiquadPassThroughInit(psBiquad);
+        return;
+    }
+
+    float fOmega = 2.0f * (float)M_PI * fCenter / fSampleRate;
+    float fCos = cosf(fOmega);
+    float fAlpha = sinf(fOmega) / (2.0f * fQ);
+
+    BiquadCoeffsSet(psBiquad, 1.0f, -2.0f * fCos, 1.0f, 1.0f + fAlpha,
+                    -2.0f * fCos, 1.0f - fAlpha);
+}
+
+//*****************************************************************************
+//
+// Clears the delay line of a section.
+//
+//*****************************************************************************
+void
+BiquadReset(tBiquad *psBiquad)
+{
+    int i;
+    for (i = 0; i < BIQUAD_CHANNELS; i++)
+    {
+        psBiquad->pfZ1[i] = 0.0f;
+        psBiquad->pfZ2[i] = 0.0f;
+    }
+}
+
+//*****************************************************************************
+//
+// Initializes a chain of ui8Count pass-through sections. The sections are
+// then configured in place through psChain->psStages.
+//
+//*****************************************************************************
+void
+BiquadChainInit(tBiquadChain *psChain, uint8_t ui8Count)
+{
+    if (ui8Count > BIQUAD_MAX_STAGES)
+    {
+        ui8Count = BIQUAD_MAX_STAGES;
+    }
+    psChain->ui8Count = ui8Count;
+
+    int i;
+    for (i = 0; i < BIQUAD_MAX_STAGES; i++)
+    {
+        BiquadPassThroughInit(&psChain->psStages[i]);
+        BiquadReset(&psChain->psStages[i]);
+    }
+}
+
+//*****************************************************************************
+//
+// Clears the delay lines of all sections of a chain.
+//
+//*****************************************************************************
+void
+BiquadChainReset(tBiquadChain *psChain)
+{
+    int i;
+    for (i = 0; i < psChain->ui8Count; i++)
+    {
+        BiquadReset(&psChain->psStages[i]);
+    }
+}
+
+//*****************************************************************************
+//
+// Filters one sample of every channel through all sections of a chain.
+// pfIn and pfOut may point to the same array.
+//
+//*****************************************************************************
+void
+BiquadChainApply(tBiquadChain *psChain, const float pfIn[BIQUAD_CHANNELS],
+                 float pfOut[BIQUAD_CHANNELS])
+{
+    float pfX[BIQUAD_CHANNELS];
+    int i, j;
+
+    for (j = 0; j < BIQUAD_CHANNELS; j++)
+    {
+        pfX[j] = pfIn[j];
+    }
+
+    for (i = 0; i < psChain->ui8Count; i++)
+    {
+        tBiquad *psBiquad = &psChain->psStages[i];
+        for (j = 0; j < BIQUAD_CHANNELS; j++)
+        {
+            float fY = psBiquad->fB0 * pfX[j] + psBiquad->pfZ1[j];
+            psBiquad->pfZ1[j] = psBiquad->fB1 * pfX[j] -
+                    psBiquad->fA1 * fY + psBiquad->pfZ2[j];
+            psBiquad->pfZ2[j] = psBiquad->fB2 * pfX[j] - psBiquad->fA2 * fY;
+            pfX[j] = fY;
+        }
+    }
+
+    for (j = 0; j < BIQUAD_CHANNELS; j++)
+    {
+        pfOut[j] = pfX[j];
+    }
+}
@@ -0,0 +1,96 @@
+//*****************************************************************************
+//
+// biquad.h - Second order IIR filters (low-pass and notch) for the gyro and
+//            the D term.
+//
+//*****************************************************************************
+
+#ifndef _BIQUAD_H_
+#define _BIQUAD_H_
+
+//*****************************************************************************
+//
+// If building with a C++ compiler, make all of the definitions in this header
+// have a C binding.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+//*****************************************************************************
+//
+// Maximum number of sections in a filter chain and number of channels that
+// are filtered by every section (the three body axes).
+//
+//*****************************************************************************
+#define BIQUAD_MAX_STAGES           4
+#define BIQUAD_CHANNELS             3
+
+//*****************************************************************************
+//
+// A single second order section in transposed direct form II. The
+// coefficients are normalized so that a0 = 1.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // Coefficients.
+    //
+    float fB0;
+    float fB1;
+    float fB2;
+    float fA1;
+    float fA2;
+
+    //
+    // Delay line, one pair per channel.
+    //
+    float pfZ1[BIQUAD_CHANNELS];
+    float pfZ2[BIQUAD_CHANNELS];
+}
+tBiquad;
+
+//*****************************************************************************
+//
+// A cascade of second order sections, applied in order.
+//
+//*****************************************************************************
+typedef struct
+{
+    tBiquad psStages[BIQUAD_MAX_STAGES];
+    uint8_t ui8Count;
+}
+tBiquadChain;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern void BiquadPassThroughInit(tBiquad *psBiquad);
+extern void BiquadLowPassInit(tBiquad *psBiquad, float fCutoff,
+                              float fSampleRate);
+extern void BiquadNotchInit(tBiquad *psBiquad, float fCenter, float fQ,
+                            float fSampleRate);
+extern void BiquadReset(tBiquad *psBiquad);
+extern void BiquadChainInit(tBiquadChain *psChain, uint8_t ui8Count);
+extern void BiquadChainReset(tBiquadChain *psChain);
+extern void BiquadChainApply(tBiquadChain *psChain,
+                             const float pfIn[BIQUAD_CHANNELS],
+                             float pfOut[BIQUAD_CHANNELS]);
+
+//*****************************************************************************
+//
+// Mark the end of the C bindings section for C++ compilers.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _BIQUAD_H_
@@ -0,0 +1,244 @@
+//*****************************************************************************
+//
+// blackbox.c - Flight recorder in the spare internal flash.
+//
+// The main loop adds a sample after the motor outputs are set. It is encoded
+// (flight_log.c) into a page of a small RAM ring right away, which takes a
+// few hundred cycles. Full pages are programmed into the LOG region of the
+// flash by BlackBoxFlush() a few words at a time, from the end of the main
+// loop where nothing waits for it; an interrupt would not help, the CPU
+// stalls on flash fetches while the flash is programmed anyway.
+//
+// Erasing a sector stalls the CPU for milliseconds, which the control loop
+// cannot afford in flight. The region is therefore only erased on request,
+// on the ground (BlackBoxErase()), and is filled from the first erased page
+// on. Every boot starts a new session after the previous ones, the main
+// loop records nothing while the controller idles on the ground so that the
+// region is spent on the flights, and once it is full the recorder drops
+// the samples. The host reads the region
+// with the debugger and decodes it with simul/flight_log.
+//
+//*****************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "driverlib/flash.h"
+#include "blackbox.h"
+
+//*****************************************************************************
+//
+// Flash address just past the LOG region.
+//
+//*****************************************************************************
+#define BLACKBOX_END                (BLACKBOX_BASE + BLACKBOX_SIZE)
+
+//*****************************************************************************
+//
+// Starts a session in the empty page after the full ones.
+//
+//*****************************************************************************
+static void
+BlackBoxSessionStart(tBlackBox *psBox)
+{
+    uint32_t ui32Page = (psBox->ui32Flush + psBox->ui32Full) %
+            BLACKBOX_RING_PAGES;
+
+    psBox->ui32Fill = FlightLogEncodeSession(
+            psBox->ui32Session, BLACKBOX_LOOP_PERIOD_US * psBox->ui32Every,
+            (uint8_t *)psBox->ppui32Ring[ui32Page]);
+    FlightLogCodecInit(&psBox->sCodec);
+}
+
+//*****************************************************************************
+//
+// Finds the end of the recorded sessions and starts a new one after them.
+//
+//*****************************************************************************
+void
+BlackBoxInit(tBlackBox *psBox)
+{
+    uint32_t ui32Address;
+
+    psBox->ui32Flush = 0;
+    psBox->ui32Full = 0;
+    psBox->ui32Programmed = 0;
+    psBox->ui32Session = 1;
+    psBox->ui32Every = BLACKBOX_DIVIDER;
+    psBox->ui32Divider = 0;
+    psBox->ui32Records = 0;
+    psBox->ui32Dropped = 0;
+    psBox->bErasing = false;
+    psBox->ui32ErasePage = 0;
+
+    //
+    // The pages are written in order, the first erased one ends the log.
+    // The new session number follows the highest one found.
+    //
+    for (ui32Address = BLACKBOX_BASE; ui32Address < BLACKBOX_END;
+         ui32Address += FLIGHT_LOG_PAGE)
+    {
+        const uint8_t *pui8Page = (const uint8_t *)(uintptr_t)ui32Address;
+        tFlightLogCodec sCodec;
+        int32_t pi32Fields[FLIGHT_LOG_FIELDS];
+        uint8_t ui8Tag;
+
+        if (*(const uint32_t *)pui8Page == 0xffffffff)
+        {
+            break;
+        }
+        FlightLogCodecInit(&sCodec);
+        if ((FlightLogDecode(&sCodec, pui8Page, FLIGHT_LOG_PAGE, &ui8Tag,
+                             pi32Fields) > 0) &&
+            (ui8Tag == FLIGHT_LOG_TAG_SESSION) &&
+            ((uint32_t)pi32Fields[0] >= psBox->ui32Session))
+        {
+            psBox->ui32Session = pi32Fields[0] + 1;
+        }
+    }
+    psBox->ui32Address = ui32Address;
+
+    BlackBoxSessionStart(psBox);
+}
+
+//*****************************************************************************
+//
+// Records every ui32Every-th main loop sample.
+//
+//*****************************************************************************
+void
+BlackBoxAdd(tBlackBox *psBox, const tFlightLogSample *psSample)
+{
+    int32_t pi32Fields[FLIGHT_LOG_FIELDS];
+    uint32_t ui32Page;
+
+    if (++psBox->ui32Divider < psBox->ui32Every)
+    {
+        return;
+    }
+    psBox->ui32Divider = 0;
+
+    if (psBox->bErasing)
+    {
+        psBox->ui32Dropped++;
+        return;
+    }
+
+    FlightLogQuantize(psSample, pi32Fields);
+    ui32Page = (psBox->ui32Flush + psBox->ui32Full) % BLACKBOX_RING_PAGES;
+
+    //
+    // The ring must have a page to fill, and that page must still fit into
+    // the region.
+    //
+    if ((psBox->ui32Full >= BLACKBOX_RING_PAGES) ||
+        (psBox->ui32Address + (psBox->ui32Full + 1) * FLIGHT_LOG_PAGE >
+         BLACKBOX_END))
+    {
+        psBox->ui32Dropped++;
+        return;
+    }
+
+    if (!FlightLogPageAdd(&psBox->sCodec,
+                          (uint8_t *)psBox->ppui32Ring[ui32Page],
+                          &psBox->ui32Fill, pi32Fields))
+    {
+        //
+        // The page is full and waits for the flash. The record starts the
+        // next page if the ring and the region have room for it.
+        //
+        psBox->ui32Full++;
+        psBox->ui32Fill = 0;
+        ui32Page = (ui32Page + 1) % BLACKBOX_RING_PAGES;
+        if ((psBox->ui32Full >= BLACKBOX_RING_PAGES) ||
+            (psBox->ui32Address + (psBox->ui32Full + 1) * FLIGHT_LOG_PAGE >
+             BLACKBOX_END))
+        {
+            psBox->ui32Dropped++;
+            return;
+        }
+        FlightLogPageAdd(&psBox->sCodec,
+                         (uint8_t *)psBox->ppui32Ring[ui32Page],
+                         &psBox->ui32Fill, pi32Fields);
+    }
+    psBox->ui32Records++;
+}
+
+//*****************************************************************************
+//
+// Programs BLACKBOX_FLUSH_WORDS words of the oldest full page, or erases the
+// next page while an erase runs. Called once per main loop iteration, last.
+//
+//*****************************************************************************
+void
+BlackBoxFlush(tBlackBox *psBox)
+{
+    if (psBox->bErasing)
+    {
+        FlashErase(BLACKBOX_BASE + psBox->ui32ErasePage * FLIGHT_LOG_PAGE);
+        psBox->ui32ErasePage++;
+        if (psBox->ui32ErasePage >= BLACKBOX_PAGES)
+        {
+            psBox->bErasing = false;
+            psBox->ui32Address = BLACKBOX_BASE;
+            psBox->ui32Session = 1;
+            BlackBoxSessionStart(psBox);
+        }
+        return;
+    }
+
+    if (psBox->ui32Full == 0)
+    {
+        return;
+    }
+
+    FlashProgram(psBox->ppui32Ring[psBox->ui32Flush] +
+                 psBox->ui32Programmed / 4,
+                 psBox->ui32Address + psBox->ui32Programmed,
+                 BLACKBOX_FLUSH_WORDS * 4);
+    psBox->ui32Programmed += BLACKBOX_FLUSH_WORDS * 4;
+    if (psBox->ui32Programmed >= FLIGHT_LOG_PAGE)
+    {
+        psBox->ui32Programmed = 0;
+        psBox->ui32Address += FLIGHT_LOG_PAGE;
+        psBox->ui32Flush = (psBox->ui32Flush + 1) % BLACKBOX_RING_PAGES;
+        psBox->ui32Full--;
+    }
+}
+
+//*****************************************************************************
+//
+// Erases the whole region, one page per BlackBoxFlush(), and then starts
+// session 1. Only for the ground: every page stalls the main loop.
+//
+//*****************************************************************************
+void
+BlackBoxErase(tBlackBox *psBox)
+{
+    psBox->bErasing = true;
+    psBox->ui32ErasePage = 0;
+    psBox->ui32Flush = 0;
+    psBox->ui32Full = 0;
+    psBox->ui32Fill = 0;
+    psBox->ui32Programmed = 0;
+}
+
+//*****************************************************************************
+//
+// Records every ui32Every-th main loop sample from now on, 1 to
+// BLACKBOX_MAX_DIVIDER.
+//
+//*****************************************************************************
+void
+BlackBoxDividerSet(tBlackBox *psBox, uint32_t ui32Every)
+{
+    if (ui32Every < 1)
+    {
+        ui32Every = 1;
+    }
+    if (ui32Every > BLACKBOX_MAX_DIVIDER)
+    {
+        ui32Every = BLACKBOX_MAX_DIVIDER;
+    }
+    psBox->ui32Every = ui32Every;
+    psBox->ui32Divider = 0;
+}
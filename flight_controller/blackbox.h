@@ -0,0 +1,127 @@
+//*****************************************************************************
+//
+// blackbox.h - Flight recorder in the spare internal flash.
+//
+//*****************************************************************************
+
+#ifndef _BLACKBOX_H_
+#define _BLACKBOX_H_
+
+//*****************************************************************************
+//
+// If building with a C++ compiler, make all of the definitions in this header
+// have a C binding.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "flight_log.h"
+
+//*****************************************************************************
+//
+// Flash region of the log, the LOG region of compdcm_mpu9150_ccs.cmd. Pages
+// are erase sectors of the TM4C123.
+//
+//*****************************************************************************
+#define BLACKBOX_BASE               0x00020000
+#define BLACKBOX_SIZE               0x00020000
+#define BLACKBOX_PAGES              (BLACKBOX_SIZE / FLIGHT_LOG_PAGE)
+
+//*****************************************************************************
+//
+// Pages of the RAM ring between the main loop and the flash, and the words
+// programmed per call of BlackBoxFlush(). Programming a word stalls the CPU
+// for tens of us, 8 words are well within the idle time of the loop and
+// program 8 kB/s at 250 Hz.
+//
+//*****************************************************************************
+#define BLACKBOX_RING_PAGES         2
+#define BLACKBOX_FLUSH_WORDS        8
+
+//*****************************************************************************
+//
+// By default every BLACKBOX_DIVIDER-th main loop sample is recorded, the
+// log divider parameter changes it. At 10 Hz a record takes about 20 bytes
+// and the region holds about 11 minutes of flight; nothing is recorded
+// while the controller idles on the ground (BlackBoxRecord() in main.c).
+//
+//*****************************************************************************
+#define BLACKBOX_DIVIDER            25
+#define BLACKBOX_MAX_DIVIDER        250
+#define BLACKBOX_LOOP_PERIOD_US     4000
+
+//*****************************************************************************
+//
+// Recorder state.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // RAM ring of pages. Pages are filled by BlackBoxAdd() and programmed
+    // by BlackBoxFlush(); ui32Full pages wait from ui32Flush on, the page
+    // after them is being filled with ui32Fill bytes.
+    //
+    uint32_t ppui32Ring[BLACKBOX_RING_PAGES][FLIGHT_LOG_PAGE / 4];
+    uint32_t ui32Flush;
+    uint32_t ui32Full;
+    uint32_t ui32Fill;
+
+    //
+    // Bytes of the oldest full page that are programmed, and the flash
+    // address of that page.
+    //
+    uint32_t ui32Programmed;
+    uint32_t ui32Address;
+
+    //
+    // Encoder of the page being filled.
+    //
+    tFlightLogCodec sCodec;
+
+    //
+    // Session number, the loop samples per record and until the next
+    // record, and the recorded and dropped records. Records are dropped
+    // while the ring is full or the region is. The session gives the record
+    // period at its start, the tick of every record its time.
+    //
+    uint32_t ui32Session;
+    uint32_t ui32Every;
+    uint32_t ui32Divider;
+    uint32_t ui32Records;
+    uint32_t ui32Dropped;
+
+    //
+    // Next page to erase while an erase runs.
+    //
+    bool bErasing;
+    uint32_t ui32ErasePage;
+}
+tBlackBox;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern void BlackBoxInit(tBlackBox *psBox);
+extern void BlackBoxAdd(tBlackBox *psBox, const tFlightLogSample *psSample);
+extern void BlackBoxFlush(tBlackBox *psBox);
+extern void BlackBoxErase(tBlackBox *psBox);
+extern void BlackBoxDividerSet(tBlackBox *psBox, uint32_t ui32Every);
+
+//*****************************************************************************
+//
+// Mark the end of the C bindings section for C++ compilers.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _BLACKBOX_H_
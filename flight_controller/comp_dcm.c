@@ -109,6 +109,57 @@ CompDCMInit(tCompDCM *psDCM, float fDeltaT, float fScaleA, float fScaleG,
     psDCM->fScaleA = fScaleA;
     psDCM->fScaleG = fScaleG;
     psDCM->fScaleM = fScaleM;
+
+    //
+    // Select the default filter with the default Mahony gains.
+    //
+    psDCM->fKp = COMP_DCM_MAHONY_KP;
+    psDCM->fKi = COMP_DCM_MAHONY_KI;
+    AttEKFInit(&psDCM->sEKF);
+    CompDCMModeSet(psDCM, COMP_DCM_DEFAULT_MODE);
+
+    //
+    // Gravity is taken by CompDCMStart().
+    //
+    psDCM->fGravity = 0.0f;
+    psDCM->fAccelTrust = 1.0f;
+
+    //
+    // The magnetometer heading is taken by the first fusion.
+    //
+    psDCM->fKm = COMP_DCM_MAG_KM;
+    psDCM->fMagHeading = 0.0f;
+    psDCM->bMagAligned = false;
+
+    psDCM->ui32NaNResets = 0;
+}
+
+//*****************************************************************************
+//
+//! Selects the attitude filter.
+//!
+//! \param psDCM is a pointer to the DCM state structure.
+//! \param ui8Mode is the filter, \b COMP_DCM_MODE_COMPLEMENTARY,
+//! \b COMP_DCM_MODE_MAHONY or \b COMP_DCM_MODE_EKF.
+//!
+//! This function selects the filter run by CompDCMUpdate().  It can be
+//! called at any time, the attitude estimate is kept.  The gyro bias estimate
+//! of the Mahony filter and of the EKF starts from zero, and the EKF from
+//! its initial covariance.
+//!
+//! \return None.
+//
+//*****************************************************************************
+void
+CompDCMModeSet(tCompDCM *psDCM, uint_fast8_t ui8Mode)
+{
+    psDCM->ui8Mode = ((ui8Mode == COMP_DCM_MODE_MAHONY) ||
+                      (ui8Mode == COMP_DCM_MODE_EKF)) ?
+                     ui8Mode : COMP_DCM_MODE_COMPLEMENTARY;
+    psDCM->pfBiasEst[0] = 0.0f;
+    psDCM->pfBiasEst[1] = 0.0f;
+    psDCM->pfBiasEst[2] = 0.0f;
+    AttEKFReset(&psDCM->sEKF);
 }
 
 //*****************************************************************************
@@ -180,9 +231,9 @@ CompDCMGyroUpdate(tCompDCM *psDCM, float fGyroX, float fGyroY, float fGyroZ)
     //
     // Save the new gyroscope reading.
     //
-    psDCM->pfGyro[0] = fGyroX - psDCM->fGyroBias[0];
-    psDCM->pfGyro[1] = fGyroY - psDCM->fGyroBias[1];
-    psDCM->pfGyro[2] = fGyroZ - psDCM->fGyroBias[2];
+    psDCM->pfGyro[0] = fGyroX - psDCM->fGyroBias[0] - psDCM->pfBiasEst[0];
+    psDCM->pfGyro[1] = fGyroY - psDCM->fGyroBias[1] - psDCM->pfBiasEst[1];
+    psDCM->pfGyro[2] = fGyroZ - psDCM->fGyroBias[2] - psDCM->pfBiasEst[2];
 }
 
 //*****************************************************************************
@@ -197,8 +248,8 @@ CompDCMGyroUpdate(tCompDCM *psDCM, float fGyroX, float fGyroY, float fGyroZ)
 //!
 //! This function updates the magnetometer reading used by the complementary
 //! filter DCM algorithm.  The magnetometer readings provided to this function
-//! are used by subsequent calls to CompDCMStart() and CompDCMUpdate() to
-//! compute the attitude estimate.
+//! are used by subsequent calls to CompDCMMagnetoFuse() to correct the
+//! heading of the attitude estimate.
 //!
 //! \return None.
 //
@@ -277,6 +328,296 @@ CompDCMStart(tCompDCM *psDCM)
     psDCM->ppfDCM[2][0] = r20;
     psDCM->ppfDCM[2][1] = r21;
     psDCM->ppfDCM[2][2] = r22;
+
+    //
+    // The board is at rest, the size of its reading is gravity.
+    //
+    psDCM->fGravity = g;
+    psDCM->fAccelTrust = 1.0f;
+
+    //
+    // The yaw restarts at 0, take the magnetometer heading again.
+    //
+    psDCM->bMagAligned = false;
+
+    //
+    // The EKF starts over from the uncertainty of the new attitude.
+    //
+    AttEKFReset(&psDCM->sEKF);
+}
+
+//*****************************************************************************
+//
+// Rotates a DCM by the body rates pfRate over fDeltaT, with the Rodrigues
+// formula for the rotation increment.
+//
+//*****************************************************************************
+static void
+CompDCMRotate(float ppfDCM[3][3], const float pfRate[3], float fDeltaT,
+              float ppfOut[3][3])
+{
+    float sigma = sqrtf(pfRate[0] * pfRate[0] +
+                        pfRate[1] * pfRate[1] +
+                        pfRate[2] * pfRate[2]) * fDeltaT;
+
+    //
+    // Without rotation the factors are 0/0, use their limits.
+    //
+    float bFactor = 1.0f;
+    float bSqFactor = 0.5f;
+    if(sigma > 1e-6f)
+    {
+        bFactor = sinf(sigma) / sigma;
+        bSqFactor = (1 - cosf(sigma)) / (sigma * sigma);
+    }
+
+    // B matrix.
+    float b[3][3];
+    b[0][0] = 0.0;
+    b[0][1] = -pfRate[2];
+    b[0][2] = pfRate[1];
+    b[1][0] = pfRate[2];
+    b[1][1] = 0.0;
+    b[1][2] = -pfRate[0];
+    b[2][0] = -pfRate[1];
+    b[2][1] = pfRate[0];
+    b[2][2] = 0.0;
+
+    // B^2 matrix.
+    float bSq[3][3];
+    bSq[0][0] = -pfRate[1] * pfRate[1] - pfRate[2] * pfRate[2];
+    bSq[0][1] = pfRate[0] * pfRate[1];
+    bSq[0][2] = pfRate[0] * pfRate[2];
+    bSq[1][0] = pfRate[0] * pfRate[1];
+    bSq[1][1] = -pfRate[0] * pfRate[0] - pfRate[2] * pfRate[2];
+    bSq[1][2] = pfRate[1] * pfRate[2];
+    bSq[2][0] = pfRate[0] * pfRate[2];
+    bSq[2][1] = pfRate[1] * pfRate[2];
+    bSq[2][2] = -pfRate[0] * pfRate[0] - pfRate[1] * pfRate[1];
+
+    // Incrementing matrix.
+    float inc[3][3];
+    float dt = fDeltaT;
+    inc[0][0] = 1.0 + dt * bFactor * b[0][0] + dt * dt * bSqFactor * bSq[0][0];
+    inc[0][1] = dt * bFactor * b[0][1] + dt * dt * bSqFactor * bSq[0][1];
+    inc[0][2] = dt * bFactor * b[0][2] + dt * dt * bSqFactor * bSq[0][2];
+    inc[1][0] = dt * bFactor * b[1][0] + dt * dt * bSqFactor * bSq[1][0];
+    inc[1][1] = 1.0 + dt * bFactor * b[1][1] + dt * dt * bSqFactor * bSq[1][1];
+    inc[1][2] = dt * bFactor * b[1][2] + dt * dt * bSqFactor * bSq[1][2];
+    inc[2][0] = dt * bFactor * b[2][0] + dt * dt * bSqFactor * bSq[2][0];
+    inc[2][1] = dt * bFactor * b[2][1] + dt * dt * bSqFactor * bSq[2][1];
+    inc[2][2] = 1.0 + dt * bFactor * b[2][2] + dt * dt * bSqFactor * bSq[2][2];
+
+    //
+    // Multiply DCM matrix by incrementing matrix.
+    //
+    int i,j;
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            ppfOut[i][j] = ppfDCM[i][0] * inc[0][j] +
+                ppfDCM[i][1] * inc[1][j] +
+                ppfDCM[i][2] * inc[2][j];
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// Restores the orthonormality of a DCM. The error of the first two rows
+// being orthogonal is split between them, the third row is their cross
+// product and every row is scaled back to unit length with a first order
+// approximation of the inverse square root.
+//
+//*****************************************************************************
+static void
+CompDCMNormalize(float ppfDCM[3][3])
+{
+    float fError, fScale;
+    float ppfRows[3][3];
+    int i, j;
+
+    fError = (ppfDCM[0][0] * ppfDCM[1][0] + ppfDCM[0][1] * ppfDCM[1][1] +
+              ppfDCM[0][2] * ppfDCM[1][2]);
+    for(j = 0; j < 3; j++)
+    {
+        ppfRows[0][j] = ppfDCM[0][j] - 0.5f * fError * ppfDCM[1][j];
+        ppfRows[1][j] = ppfDCM[1][j] - 0.5f * fError * ppfDCM[0][j];
+    }
+    ppfRows[2][0] = (ppfRows[0][1] * ppfRows[1][2] -
+                     ppfRows[0][2] * ppfRows[1][1]);
+    ppfRows[2][1] = (ppfRows[0][2] * ppfRows[1][0] -
+                     ppfRows[0][0] * ppfRows[1][2]);
+    ppfRows[2][2] = (ppfRows[0][0] * ppfRows[1][1] -
+                     ppfRows[0][1] * ppfRows[1][0]);
+
+    for(i = 0; i < 3; i++)
+    {
+        fScale = 0.5f * (3.0f - (ppfRows[i][0] * ppfRows[i][0] +
+                                 ppfRows[i][1] * ppfRows[i][1] +
+                                 ppfRows[i][2] * ppfRows[i][2]));
+        for(j = 0; j < 3; j++)
+        {
+            ppfDCM[i][j] = ppfRows[i][j] * fScale;
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// Computes the trust in the accelerometer reading, see
+// COMP_DCM_TRUST_ACCEL_LOW, from the deviation of its size g from gravity and
+// from the body rate. The product of both ramps is kept in fAccelTrust.
+//
+//*****************************************************************************
+static float
+CompDCMAccelTrust(tCompDCM *psDCM, float g)
+{
+    float fDeviation, fRate, fTrustA, fTrustG;
+
+    //
+    // Before CompDCMStart() took gravity only the rate counts.
+    //
+    fDeviation = 0.0f;
+    if(psDCM->fGravity > 0.0f)
+    {
+        fDeviation = fabsf(g - psDCM->fGravity) / psDCM->fGravity;
+    }
+    fTrustA = ((COMP_DCM_TRUST_ACCEL_HIGH - fDeviation) /
+               (COMP_DCM_TRUST_ACCEL_HIGH - COMP_DCM_TRUST_ACCEL_LOW));
+
+    fRate = sqrtf(psDCM->pfGyro[0] * psDCM->pfGyro[0] +
+                  psDCM->pfGyro[1] * psDCM->pfGyro[1] +
+                  psDCM->pfGyro[2] * psDCM->pfGyro[2]);
+    fTrustG = ((COMP_DCM_TRUST_RATE_HIGH - fRate) /
+               (COMP_DCM_TRUST_RATE_HIGH - COMP_DCM_TRUST_RATE_LOW));
+
+    fTrustA = fTrustA > 1.0f ? 1.0f : (fTrustA > 0.0f ? fTrustA : 0.0f);
+    fTrustG = fTrustG > 1.0f ? 1.0f : (fTrustG > 0.0f ? fTrustG : 0.0f);
+    psDCM->fAccelTrust = fTrustA * fTrustG;
+
+    return(psDCM->fAccelTrust);
+}
+
+//*****************************************************************************
+//
+// Mahony filter update. The last row of the DCM is the direction of gravity
+// in the body frame as the accelerometer sees it at rest. The cross product
+// of the measured and the estimated direction is the rotation that would
+// align them; it is fed back into the rates with the gain fKp and integrated
+// with the gain fKi into the estimate of the gyro bias. Both gains are scaled
+// by the trust in the reading.
+//
+//*****************************************************************************
+static void
+CompDCMMahonyUpdate(tCompDCM *psDCM)
+{
+    float pfRate[3], pfError[3], pfAccel[3];
+    float tempDCM[3][3];
+    float fTrust;
+    int i;
+
+    pfRate[0] = psDCM->pfGyro[0];
+    pfRate[1] = psDCM->pfGyro[1];
+    pfRate[2] = psDCM->pfGyro[2];
+
+    //
+    // Without an accelerometer reading there is nothing to correct toward.
+    //
+    float g = sqrtf(psDCM->pfAccel[0] * psDCM->pfAccel[0] +
+                    psDCM->pfAccel[1] * psDCM->pfAccel[1] +
+                    psDCM->pfAccel[2] * psDCM->pfAccel[2]);
+    if(g > 0.0f)
+    {
+        fTrust = CompDCMAccelTrust(psDCM, g);
+        pfAccel[0] = psDCM->pfAccel[0] / g;
+        pfAccel[1] = psDCM->pfAccel[1] / g;
+        pfAccel[2] = psDCM->pfAccel[2] / g;
+
+        pfError[0] = (pfAccel[1] * psDCM->ppfDCM[2][2] -
+                      pfAccel[2] * psDCM->ppfDCM[2][1]);
+        pfError[1] = (pfAccel[2] * psDCM->ppfDCM[2][0] -
+                      pfAccel[0] * psDCM->ppfDCM[2][2]);
+        pfError[2] = (pfAccel[0] * psDCM->ppfDCM[2][1] -
+                      pfAccel[1] * psDCM->ppfDCM[2][0]);
+
+        for(i = 0; i < 3; i++)
+        {
+            pfRate[i] += fTrust * psDCM->fKp * pfError[i];
+            psDCM->pfBiasEst[i] -= (fTrust * psDCM->fKi * pfError[i] *
+                                    psDCM->fDeltaT);
+        }
+    }
+
+    CompDCMRotate(psDCM->ppfDCM, pfRate, psDCM->fDeltaT, tempDCM);
+    CompDCMNormalize(tempDCM);
+
+    for(i = 0; i < 3; i++)
+    {
+        psDCM->ppfDCM[i][0] = tempDCM[i][0];
+        psDCM->ppfDCM[i][1] = tempDCM[i][1];
+        psDCM->ppfDCM[i][2] = tempDCM[i][2];
+    }
+}
+
+//*****************************************************************************
+//
+// Applies the errors estimated by the EKF: rotates the DCM by the attitude
+// error in the body frame and adds the bias error to the bias estimate.
+//
+//*****************************************************************************
+static void
+CompDCMEKFCorrect(tCompDCM *psDCM, const float pfCorrection[ATT_EKF_STATES])
+{
+    float tempDCM[3][3];
+    int i;
+
+    CompDCMRotate(psDCM->ppfDCM, pfCorrection, 1.0f, tempDCM);
+    CompDCMNormalize(tempDCM);
+
+    for(i = 0; i < 3; i++)
+    {
+        psDCM->ppfDCM[i][0] = tempDCM[i][0];
+        psDCM->ppfDCM[i][1] = tempDCM[i][1];
+        psDCM->ppfDCM[i][2] = tempDCM[i][2];
+        psDCM->pfBiasEst[i] += pfCorrection[i + 3];
+    }
+}
+
+//*****************************************************************************
+//
+// EKF update. The DCM is rotated by the bias free rates as in the other
+// filters while the EKF propagates the covariance of the errors. An
+// accelerometer reading that passes the gate of the EKF then corrects the
+// DCM and the bias estimate, with a noise that grows as the trust in it
+// drops.
+//
+//*****************************************************************************
+static void
+CompDCMEKFUpdate(tCompDCM *psDCM)
+{
+    float pfCorrection[ATT_EKF_STATES];
+    float tempDCM[3][3];
+    float g;
+    int i;
+
+    CompDCMRotate(psDCM->ppfDCM, psDCM->pfGyro, psDCM->fDeltaT, tempDCM);
+    CompDCMNormalize(tempDCM);
+    for(i = 0; i < 3; i++)
+    {
+        psDCM->ppfDCM[i][0] = tempDCM[i][0];
+        psDCM->ppfDCM[i][1] = tempDCM[i][1];
+        psDCM->ppfDCM[i][2] = tempDCM[i][2];
+    }
+    AttEKFPredict(&psDCM->sEKF, psDCM->pfGyro, psDCM->fDeltaT);
+
+    g = sqrtf(psDCM->pfAccel[0] * psDCM->pfAccel[0] +
+              psDCM->pfAccel[1] * psDCM->pfAccel[1] +
+              psDCM->pfAccel[2] * psDCM->pfAccel[2]);
+    if(AttEKFAccelUpdate(&psDCM->sEKF, psDCM->ppfDCM[2], psDCM->pfAccel,
+                         CompDCMAccelTrust(psDCM, g), pfCorrection))
+    {
+        CompDCMEKFCorrect(psDCM, pfCorrection);
+    }
 }
 
 //*****************************************************************************
@@ -337,66 +678,36 @@ CompDCMUpdate(tCompDCM *psDCM)
         psDCM->ppfDCM[2][0] = 0.0;
         psDCM->ppfDCM[2][1] = 0.0;
         psDCM->ppfDCM[2][2] = 1.0;
+        psDCM->ui32NaNResets++;
     }
 
-    float sigma = sqrtf(psDCM->pfGyro[0] * psDCM->pfGyro[0] +
-                        psDCM->pfGyro[1] * psDCM->pfGyro[1] +
-                        psDCM->pfGyro[2] * psDCM->pfGyro[2]) * psDCM->fDeltaT;
-    float bFactor = sinf(sigma) / sigma;
-    float bSqFactor = (1 - cosf(sigma)) / (sigma * sigma);
-
-    // B matrix.
-    float b[3][3];
-    b[0][0] = 0.0;
-    b[0][1] = -psDCM->pfGyro[2];
-    b[0][2] = psDCM->pfGyro[1];
-    b[1][0] = psDCM->pfGyro[2];
-    b[1][1] = 0.0;
-    b[1][2] = -psDCM->pfGyro[0];
-    b[2][0] = -psDCM->pfGyro[1];
-    b[2][1] = psDCM->pfGyro[0];
-    b[2][2] = 0.0;
-
-    // B^2 matrix.
-    float bSq[3][3];
-    bSq[0][0] = -psDCM->pfGyro[1] * psDCM->pfGyro[1] -
-                   psDCM->pfGyro[2] * psDCM->pfGyro[2];
-    bSq[0][1] = psDCM->pfGyro[0] * psDCM->pfGyro[1];
-    bSq[0][2] = psDCM->pfGyro[0] * psDCM->pfGyro[2];
-    bSq[1][0] = psDCM->pfGyro[0] * psDCM->pfGyro[1];
-    bSq[1][1] = -psDCM->pfGyro[0] * psDCM->pfGyro[0] -
-            psDCM->pfGyro[2] * psDCM->pfGyro[2];
-    bSq[1][2] = psDCM->pfGyro[1] * psDCM->pfGyro[2];
-    bSq[2][0] = psDCM->pfGyro[0] * psDCM->pfGyro[2];
-    bSq[2][1] = psDCM->pfGyro[1] * psDCM->pfGyro[2];
-    bSq[2][2] = -psDCM->pfGyro[0] * psDCM->pfGyro[0] -
-            psDCM->pfGyro[1] * psDCM->pfGyro[1];
+    //
+    // The Mahony filter replaces the blending of the Euler angles.
+    //
+    if(psDCM->ui8Mode == COMP_DCM_MODE_MAHONY)
+    {
+        CompDCMMahonyUpdate(psDCM);
+        CompDCMComputeEulers(psDCM->ppfDCM, psDCM->fEuler, psDCM->fEuler + 1,
+                             psDCM->fEuler + 2);
+        return;
+    }
 
-    // Incrementing matrix.
-    float inc[3][3];
-    float dt = psDCM->fDeltaT;
-    inc[0][0] = 1.0 + dt * bFactor * b[0][0] + dt * dt * bSqFactor * bSq[0][0];
-    inc[0][1] = dt * bFactor * b[0][1] + dt * dt * bSqFactor * bSq[0][1];
-    inc[0][2] = dt * bFactor * b[0][2] + dt * dt * bSqFactor * bSq[0][2];
-    inc[1][0] = dt * bFactor * b[1][0] + dt * dt * bSqFactor * bSq[1][0];
-    inc[1][1] = 1.0 + dt * bFactor * b[1][1] + dt * dt * bSqFactor * bSq[1][1];
-    inc[1][2] = dt * bFactor * b[1][2] + dt * dt * bSqFactor * bSq[1][2];
-    inc[2][0] = dt * bFactor * b[2][0] + dt * dt * bSqFactor * bSq[2][0];
-    inc[2][1] = dt * bFactor * b[2][1] + dt * dt * bSqFactor * bSq[2][1];
-    inc[2][2] = 1.0 + dt * bFactor * b[2][2] + dt * dt * bSqFactor * bSq[2][2];
+    //
+    // So does the EKF.
+    //
+    if(psDCM->ui8Mode == COMP_DCM_MODE_EKF)
+    {
+        CompDCMEKFUpdate(psDCM);
+        CompDCMComputeEulers(psDCM->ppfDCM, psDCM->fEuler, psDCM->fEuler + 1,
+                             psDCM->fEuler + 2);
+        return;
+    }
 
     //
-    // Multiply DCM matrix by incrementing matrix.
+    // Rotate the DCM by the gyro readings.
     //
-    int i,j;
     float tempDCM[3][3];
-    for (i = 0; i < 3; i++) {
-        for (j = 0; j < 3; j++) {
-            tempDCM[i][j] = psDCM->ppfDCM[i][0] * inc[0][j] +
-                psDCM->ppfDCM[i][1] * inc[1][j] +
-                psDCM->ppfDCM[i][2] * inc[2][j];
-        }
-    }
+    CompDCMRotate(psDCM->ppfDCM, psDCM->pfGyro, psDCM->fDeltaT, tempDCM);
 
     //
     // The size of gravity when the body is at rest.
@@ -423,10 +734,12 @@ CompDCMUpdate(tCompDCM *psDCM)
     CompDCMComputeEulers(tempDCM, &gammaDCM, &betaDCM, &alphaDCM);
 
     //
-    // Apply complementary filter.
+    // Apply complementary filter, with less of the accelerometer while the
+    // body accelerates or rotates fast.
     //
-    float betaCompFilter = (1.0 - COMP_FILTER_FACTOR) * betaDCM + COMP_FILTER_FACTOR * betaGrav;
-    float gammaCompFilter = (1.0 - COMP_FILTER_FACTOR) * gammaDCM + COMP_FILTER_FACTOR * gammaGrav;
+    float factor = COMP_FILTER_FACTOR * CompDCMAccelTrust(psDCM, g);
+    float betaCompFilter = (1.0 - factor) * betaDCM + factor * betaGrav;
+    float gammaCompFilter = (1.0 - factor) * gammaDCM + factor * gammaGrav;
 
     //
     // Recalculate DCM.
@@ -440,6 +753,128 @@ CompDCMUpdate(tCompDCM *psDCM)
                          psDCM->fEuler + 2);
 }
 
+//*****************************************************************************
+//
+//! Corrects the heading of the attitude estimate with the magnetometer.
+//!
+//! \param psDCM is a pointer to the DCM state structure.
+//! \param fDeltaT is the time since the previous call, in seconds.
+//!
+//! This function turns the most recent magnetometer reading, which must be
+//! calibrated for hard and soft iron, into the world frame with the current
+//! roll and pitch (tilt compensation) and rotates the DCM about the world Z
+//! axis toward the heading of the horizontal field.  The first call after
+//! CompDCMStart() only takes the heading of the field, so the yaw keeps the
+//! value it was started with instead of jumping to magnetic north, and the
+//! later calls hold it there against the gyro drift.  With the Mahony filter
+//! the heading error is also integrated into the gyro bias estimate, about
+//! the body axis that is vertical.  With the EKF the heading error is a
+//! measurement of the EKF, which corrects the attitude and the bias with its
+//! own gain instead of fKm.
+//!
+//! It is meant to be called after CompDCMUpdate() at the lower rate of the
+//! magnetometer.  Readings with a field that is close to vertical are
+//! ignored.
+//!
+//! \return None.
+//
+//*****************************************************************************
+void
+CompDCMMagnetoFuse(tCompDCM *psDCM, float fDeltaT)
+{
+    float fX, fY, fZ, fHeading, fError, fAngle, fC, fS, fRow;
+    int i;
+
+    //
+    // The field in the world frame.
+    //
+    fX = (psDCM->ppfDCM[0][0] * psDCM->pfMagneto[0] +
+          psDCM->ppfDCM[0][1] * psDCM->pfMagneto[1] +
+          psDCM->ppfDCM[0][2] * psDCM->pfMagneto[2]);
+    fY = (psDCM->ppfDCM[1][0] * psDCM->pfMagneto[0] +
+          psDCM->ppfDCM[1][1] * psDCM->pfMagneto[1] +
+          psDCM->ppfDCM[1][2] * psDCM->pfMagneto[2]);
+    fZ = (psDCM->ppfDCM[2][0] * psDCM->pfMagneto[0] +
+          psDCM->ppfDCM[2][1] * psDCM->pfMagneto[1] +
+          psDCM->ppfDCM[2][2] * psDCM->pfMagneto[2]);
+
+    //
+    // The heading is undefined if the horizontal field is too weak, below a
+    // quarter of the field (an inclination of 76 degrees).
+    //
+    if(16.0f * (fX * fX + fY * fY) < (fX * fX + fY * fY + fZ * fZ))
+    {
+        return;
+    }
+    fHeading = atan2f(fY, fX);
+
+    if(!psDCM->bMagAligned)
+    {
+        psDCM->fMagHeading = fHeading;
+        psDCM->bMagAligned = true;
+        return;
+    }
+
+    //
+    // The heading error, wrapped to +/- pi.
+    //
+    fError = psDCM->fMagHeading - fHeading;
+    if(fError > M_PI)
+    {
+        fError -= 2.0f * M_PI;
+    }
+    else if(fError < -M_PI)
+    {
+        fError += 2.0f * M_PI;
+    }
+
+    //
+    // The EKF weighs the heading error against its covariance instead of
+    // the fixed gain.
+    //
+    if(psDCM->ui8Mode == COMP_DCM_MODE_EKF)
+    {
+        float pfCorrection[ATT_EKF_STATES];
+
+        if(AttEKFHeadingUpdate(&psDCM->sEKF, psDCM->ppfDCM[2], fError,
+                               pfCorrection))
+        {
+            CompDCMEKFCorrect(psDCM, pfCorrection);
+            CompDCMComputeEulers(psDCM->ppfDCM, psDCM->fEuler,
+                                 psDCM->fEuler + 1, psDCM->fEuler + 2);
+        }
+        return;
+    }
+
+    //
+    // Rotate the DCM about the world Z axis, which mixes its first two rows.
+    //
+    fAngle = psDCM->fKm * fError * fDeltaT;
+    fC = cosf(fAngle);
+    fS = sinf(fAngle);
+    for(i = 0; i < 3; i++)
+    {
+        fRow = psDCM->ppfDCM[0][i];
+        psDCM->ppfDCM[0][i] = fC * fRow - fS * psDCM->ppfDCM[1][i];
+        psDCM->ppfDCM[1][i] = fS * fRow + fC * psDCM->ppfDCM[1][i];
+    }
+
+    //
+    // The last row of the DCM is the world Z axis in the body frame.
+    //
+    if(psDCM->ui8Mode == COMP_DCM_MODE_MAHONY)
+    {
+        for(i = 0; i < 3; i++)
+        {
+            psDCM->pfBiasEst[i] -= (psDCM->fKi * fError *
+                                    psDCM->ppfDCM[2][i] * fDeltaT);
+        }
+    }
+
+    CompDCMComputeEulers(psDCM->ppfDCM, psDCM->fEuler, psDCM->fEuler + 1,
+                         psDCM->fEuler + 2);
+}
+
 //*****************************************************************************
 //
 //! Returns the current DCM attitude estimation matrix.
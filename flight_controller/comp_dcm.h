@@ -37,6 +37,61 @@ extern "C"
 {
 #endif
 
+#include "att_ekf.h"
+
+//*****************************************************************************
+//
+// The attitude filters run by CompDCMUpdate(). The complementary filter
+// blends roll and pitch toward the accelerometer, the Mahony filter feeds
+// the error toward the accelerometer back into the rates through a PI
+// correction whose integral tracks the gyro bias. The EKF corrects the
+// attitude and the gyro bias with a gain that follows from the covariance
+// of their errors, see att_ekf.c.
+//
+//*****************************************************************************
+#define COMP_DCM_MODE_COMPLEMENTARY 0
+#define COMP_DCM_MODE_MAHONY        1
+#define COMP_DCM_MODE_EKF           2
+
+//*****************************************************************************
+//
+// The filter selected by CompDCMInit(), can be overridden at build time.
+//
+//*****************************************************************************
+#ifndef COMP_DCM_DEFAULT_MODE
+#define COMP_DCM_DEFAULT_MODE       COMP_DCM_MODE_COMPLEMENTARY
+#endif
+
+//*****************************************************************************
+//
+// Default gains of the Mahony filter, in rad/s and rad/s^2 per unit of the
+// cross product between measured and estimated gravity.
+//
+//*****************************************************************************
+#define COMP_DCM_MAHONY_KP          2.0f
+#define COMP_DCM_MAHONY_KI          0.1f
+
+//*****************************************************************************
+//
+// Trust in the accelerometer as a reading of gravity. It ramps down from 1 to
+// 0 as the size of the reading deviates from gravity by between the low and
+// the high fraction, since the rest is the acceleration of the body, and as
+// the body rate rises between the low and the high rate in rad/s.
+//
+//*****************************************************************************
+#define COMP_DCM_TRUST_ACCEL_LOW    0.03f
+#define COMP_DCM_TRUST_ACCEL_HIGH   0.1f
+#define COMP_DCM_TRUST_RATE_LOW     1.0f
+#define COMP_DCM_TRUST_RATE_HIGH    4.0f
+
+//*****************************************************************************
+//
+// Default gain of the magnetometer heading correction, in rad/s per rad of
+// heading error.
+//
+//*****************************************************************************
+#define COMP_DCM_MAG_KM             0.3f
+
 //*****************************************************************************
 //
 // The structure that defines the internal state of the complementary filter
@@ -100,6 +155,46 @@ typedef struct
     // The most recent magnetometer readings.
     //
     float pfMagneto[3];
+
+    //
+    // The attitude filter, one of the COMP_DCM_MODE_* values.
+    //
+    uint8_t ui8Mode;
+
+    //
+    // Gains of the Mahony filter, and its estimate of the gyro bias that is
+    // left after fGyroBias. The estimate is removed from the gyro readings
+    // together with fGyroBias, the EKF keeps its estimate here as well.
+    //
+    float fKp;
+    float fKi;
+    float pfBiasEst[3];
+
+    //
+    // Size of gravity taken by CompDCMStart(), in the unit of the
+    // accelerometer, and the trust in the last accelerometer reading.
+    //
+    float fGravity;
+    float fAccelTrust;
+
+    //
+    // Covariance and noise of the EKF.
+    //
+    tAttEKF sEKF;
+
+    //
+    // Gain of the magnetometer heading correction, and the heading of the
+    // horizontal field in the world frame that is held once it was taken
+    // by the first CompDCMMagnetoFuse() after CompDCMStart().
+    //
+    float fKm;
+    float fMagHeading;
+    bool bMagAligned;
+
+    //
+    // Number of times the DCM was reset to the identity after it went NaN.
+    //
+    uint32_t ui32NaNResets;
 }
 tCompDCM;
 
@@ -117,7 +212,9 @@ extern void CompDCMGyroUpdate(tCompDCM *psDCM, float fGyroX, float fGyroY,
 extern void CompDCMMagnetoUpdate(tCompDCM *psDCM, float fMagnetoX,
                                  float fMagnetoY, float fMagnetoZ);
 extern void CompDCMStart(tCompDCM *psDCM);
+extern void CompDCMModeSet(tCompDCM *psDCM, uint_fast8_t ui8Mode);
 extern void CompDCMUpdate(tCompDCM *psDCM);
+extern void CompDCMMagnetoFuse(tCompDCM *psDCM, float fDeltaT);
 extern void CompDCMMatrixGet(tCompDCM *psDCM, float ppfDCM[3][3]);
 extern void CompDCMComputeEulers(float dcm[3][3], float *pfRoll,
                                  float *pfPitch, float *pfYaw);
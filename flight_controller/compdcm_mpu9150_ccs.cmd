@@ -44,7 +44,9 @@
 MEMORY
 {
     /* Application stored in and executes from internal flash */
-    FLASH (RX) : origin = APP_BASE, length = 0x00040000
+    FLASH (RX) : origin = APP_BASE, length = 0x00020000
+    /* Upper half kept free for the flight recorder, see blackbox.h          */
+    LOG (R) : origin = 0x00020000, length = 0x00020000
     /* Application uses internal RAM for data */
     SRAM (RWX) : origin = 0x20000000, length = 0x00008000
 }
@@ -65,6 +67,10 @@ SECTIONS
     .bss    :   > SRAM
     .sysmem :   > SRAM
     .stack  :   > SRAM
+
+    /* Not cleared by the startup code, keeps the crash capture of          */
+    /* crash_ring.c over a warm reset                                        */
+    .noinit :   > SRAM, type = NOINIT
 }
 
 __STACK_TOP = __stack + 1024;
@@ -41,14 +41,105 @@
 #define I_ZZ                0.0165 // kg * m^2, 2*m_body*R^2/5 + 4*l^2*m_motor
 #define MAX_MOTOR_OMEGA_SQ  pow(2.0 * M_PI * 6360 / 60.0, 2) * 0.7 // max motor omega^2
 #define K                   (0.62 * 9.81) / pow(2 * M_PI * 6360 / 60, 2) // N * Hz^-2
+#define MIN_MOTOR_OMEGA_SQ  (0.1 / K) // minimal thrust, keeps the motors spinning
+#define FULL_MOTOR_OMEGA_SQ pow(2.0 * M_PI * 6360 / 60.0, 2) // at full duty
 
 //*****************************************************************************
 //
-// PD parameters.
+// Motor dynamics. The omega^2 of each motor follows its command with a first
+// order lag, identified on the thrust stand with simul/sil/motor_id.py. The
+// commands lead the motors so that they respond with MOTOR_LEAD times their
+// time constant.
+//
+//*****************************************************************************
+#define MOTOR_TAU_0         0.030 // s
+#define MOTOR_TAU_1         0.030 // s
+#define MOTOR_TAU_2         0.030 // s
+#define MOTOR_TAU_3         0.030 // s
+#define MOTOR_LEAD          0.5
+
+//*****************************************************************************
+//
+// Default PD parameters, tunable at runtime through the parameter store.
 //
 //*****************************************************************************
 #define KD                 40.0 // TODO
 #define KP                 5.0 // TODO
+#define KI                 2.0 // 1/s^3
+
+//*****************************************************************************
+//
+// Integral action. The integrators hold angular accelerations in rad/s^2.
+// While the mixer cannot produce a command, the integrator stops growing in
+// the direction of the command and the unproduced part is fed back
+// (back-calculation) with ANTIWINDUP_GAIN.
+//
+//*****************************************************************************
+#define INT_LIMIT           50.0 // rad/s^2
+#define ANTIWINDUP_GAIN     10.0 // 1/s
+
+//*****************************************************************************
+//
+// Default cascaded controller parameters. The rate loop P gain equals the PD
+// derivative gain so both modes have the same damping.
+//
+//*****************************************************************************
+#define CASCADE_ANGLE_KP        4.0 // rad/s per rad
+#define CASCADE_ANGLE_KP_YAW    2.0 // rad/s per rad
+#define CASCADE_RATE_LIMIT      3.5 // rad/s, below the 250 deg/s gyro range
+#define CASCADE_RATE_KP         40.0 // 1/s
+#define CASCADE_RATE_KI         10.0 // 1/s^2
+#define CASCADE_RATE_KD         0.0 // acts on the D term low-pass
+#define CASCADE_ACCEL_LIMIT     200.0 // rad/s^2
+#define CASCADE_OUTER_DIVIDER   2 // outer loop at 125 Hz
+
+//*****************************************************************************
+//
+// Default INDI rate loop parameters.
+//
+//*****************************************************************************
+#define INDI_LPF_HZ             30.0 // Hz
+#define INDI_RATE_KP            25.0 // 1/s
+#define INDI_GROUND_THRUST      (0.8 * m) // kg, below it on the ground
+
+//*****************************************************************************
+//
+// Cosine of the largest tilt that the geometric controller compensates the
+// thrust for, 60 deg.
+//
+//*****************************************************************************
+#define GEOMETRIC_TILT_COS      0.5
+
+//*****************************************************************************
+//
+// Default filters. The MPU9150 low-pass (DLPF_CFG_94_98) is the anti-alias
+// filter of the 250 Hz sample rate, these act on what is left below the
+// 125 Hz Nyquist frequency. The notch is off until the frame's vibration
+// frequency is known.
+//
+//*****************************************************************************
+#define GYRO_LPF_HZ             80.0 // Hz
+#define DTERM_LPF_HZ            40.0 // Hz
+#define NOTCH_HZ                0.0 // Hz, 0 disables the notch
+#define NOTCH_Q                 2.0
+#define DYN_NOTCH               1.0 // track the peaks found by gyro_fft.c
+
+//*****************************************************************************
+//
+// Default controller mode, can be overridden at build time.
+//
+//*****************************************************************************
+#ifndef CONTROLLER_DEFAULT_MODE
+#define CONTROLLER_DEFAULT_MODE CONTROLLER_MODE_PD
+#endif
+
+//*****************************************************************************
+//
+// Time between controller updates, the IMU sample period.
+//
+//*****************************************************************************
+#define CONTROLLER_DELTA_T      (1.0f / 250.0f) // s
+#define CONTROLLER_RATE_HZ      250.0f // Hz
 
 
 //*****************************************************************************
@@ -70,91 +161,791 @@ InitPDController(tPDController * psPD)
     psPD->fDesState[0] = 0.0;
     psPD->fDesState[1] = 0.0;
     psPD->fDesState[2] = 0.0;
+
+    //
+    // PD gains.
+    //
+    psPD->fKp = KP;
+    psPD->fKd = KD;
+    psPD->fKi = KI;
+    AutotuneInit(&psPD->sTune);
+
+    //
+    // Integrators and mixer state.
+    //
+    int i;
+    for (i = 0; i < 3; i++)
+    {
+        psPD->fAngleInt[i] = 0.0;
+        psPD->fAccelCmd[i] = 0.0;
+        psPD->fAccelOut[i] = 0.0;
+    }
+    psPD->ui8MixerSat = 0;
+
+    //
+    // INDI rate loop, its filters are set up by ControllerFiltersUpdate().
+    //
+    tIndi *psIndi = &psPD->sIndi;
+    psIndi->fLpfHz = INDI_LPF_HZ;
+    psIndi->fRateKp = INDI_RATE_KP;
+    for (i = 0; i < 3; i++)
+    {
+        psIndi->fLastRate[i] = 0.0;
+        psIndi->fRateDot[i] = 0.0;
+    }
+    psIndi->bHold = false;
+    BiquadChainInit(&psIndi->sRateDotFilter, 1);
+    BiquadChainInit(&psIndi->sAccelFilter, 1);
+
+    //
+    // Motor model, the motors are at rest.
+    //
+    tMotorModel *psMotor = &psPD->sMotor;
+    psMotor->fTau[0] = MOTOR_TAU_0;
+    psMotor->fTau[1] = MOTOR_TAU_1;
+    psMotor->fTau[2] = MOTOR_TAU_2;
+    psMotor->fTau[3] = MOTOR_TAU_3;
+    psMotor->fLead = MOTOR_LEAD;
+    for (i = 0; i < 4; i++)
+    {
+        psPD->fOmegaSq[i] = 0.0;
+        psMotor->fOmegaSq[i] = 0.0;
+        psMotor->fOmegaSqCmd[i] = 0.0;
+    }
+
+    //
+    // Gyro and D term filters.
+    //
+    psPD->fGyroLpfHz = GYRO_LPF_HZ;
+    psPD->fNotchHz = NOTCH_HZ;
+    psPD->fNotchQ = NOTCH_Q;
+    psPD->fDTermLpfHz = DTERM_LPF_HZ;
+    psPD->fDynNotch = DYN_NOTCH;
+    for (i = 0; i < GYRO_FILTER_DYN_NOTCHES; i++)
+    {
+        psPD->fDynNotchHz[i] = 0.0;
+    }
+    BiquadChainInit(&psPD->sGyroFilter, GYRO_FILTER_STAGES);
+    BiquadChainInit(&psPD->sDTermFilter, 1);
+    ControllerFiltersUpdate(psPD);
+    for (i = 0; i < 3; i++)
+    {
+        psPD->fRate[i] = 0.0;
+    }
+
+    //
+    // Cascaded controller.
+    //
+    psPD->ui8Mode = CONTROLLER_DEFAULT_MODE;
+    tCascade *psCas = &psPD->sCascade;
+    for (i = 0; i < 3; i++)
+    {
+        psCas->fAngleKp[i] = (i == 2) ? CASCADE_ANGLE_KP_YAW : CASCADE_ANGLE_KP;
+        psCas->fRateLimit[i] = CASCADE_RATE_LIMIT;
+        psCas->fRateKp[i] = CASCADE_RATE_KP;
+        psCas->fRateKi[i] = CASCADE_RATE_KI;
+        psCas->fRateKd[i] = CASCADE_RATE_KD;
+        psCas->fAccelLimit[i] = CASCADE_ACCEL_LIMIT;
+        psCas->fRateSetpoint[i] = 0.0;
+        psCas->fRateInt[i] = 0.0;
+        psCas->fLastRate[i] = 0.0;
+    }
+    psCas->ui8OuterDivider = CASCADE_OUTER_DIVIDER;
+
+    //
+    // Run the outer loop on the first update.
+    //
+    psCas->ui8OuterCounter = CASCADE_OUTER_DIVIDER - 1;
 }
 
 
 //*****************************************************************************
 //
-// Calculates the motor angular velocities from the PD errors.
+// Computes the coefficients of the tracking notches.
+//
+//*****************************************************************************
+static void
+DynNotchUpdate(tPDController * psPD)
+{
+    int i;
+    for (i = 0; i < GYRO_FILTER_DYN_NOTCHES; i++)
+    {
+        BiquadNotchInit(&psPD->sGyroFilter.psStages[GYRO_FILTER_DYN_NOTCH + i],
+                        (psPD->fDynNotch != 0.0f) ? psPD->fDynNotchHz[i] : 0.0f,
+                        psPD->fNotchQ, CONTROLLER_RATE_HZ);
+    }
+}
+
+
+//*****************************************************************************
+//
+// Computes the filter coefficients from the configured frequencies. The
+// delay lines are kept, so this can be called between two updates in flight.
 //
 //*****************************************************************************
 void
-ErrorToInput(tPDController * psPD, tCompDCM * psDCM)
+ControllerFiltersUpdate(tPDController * psPD)
+{
+    BiquadNotchInit(&psPD->sGyroFilter.psStages[GYRO_FILTER_NOTCH],
+                    psPD->fNotchHz, psPD->fNotchQ, CONTROLLER_RATE_HZ);
+    DynNotchUpdate(psPD);
+    BiquadLowPassInit(&psPD->sGyroFilter.psStages[GYRO_FILTER_LPF],
+                      psPD->fGyroLpfHz, CONTROLLER_RATE_HZ);
+    BiquadLowPassInit(&psPD->sDTermFilter.psStages[0], psPD->fDTermLpfHz,
+                      CONTROLLER_RATE_HZ);
+    BiquadLowPassInit(&psPD->sIndi.sRateDotFilter.psStages[0],
+                      psPD->sIndi.fLpfHz, CONTROLLER_RATE_HZ);
+    BiquadLowPassInit(&psPD->sIndi.sAccelFilter.psStages[0],
+                      psPD->sIndi.fLpfHz, CONTROLLER_RATE_HZ);
+}
+
+
+//*****************************************************************************
+//
+// Moves the tracking notches to the given vibration peaks (Hz, 0 for none).
+// Called between two updates whenever the spectrum analysis has finished.
+//
+//*****************************************************************************
+void
+ControllerNotchTrack(tPDController * psPD, const float *pfPeakHz,
+                     uint8_t ui8Count)
+{
+    int i;
+    for (i = 0; i < GYRO_FILTER_DYN_NOTCHES; i++)
+    {
+        psPD->fDynNotchHz[i] = (i < ui8Count) ? pfPeakHz[i] : 0.0f;
+    }
+    DynNotchUpdate(psPD);
+}
+
+
+//*****************************************************************************
+//
+// Total omega^2 that keeps the thrust in the z direction of the world frame
+// at fThrustZDir with the current roll and pitch.
+//
+//*****************************************************************************
+static float
+TiltCompensatedThrust(tPDController * psPD, tCompDCM * psDCM)
+{
+    return psPD->fThrustZDir * g /
+            (K * cosf(psDCM->fEuler[0]) * cosf(psDCM->fEuler[1]));
+}
+
+
+//*****************************************************************************
+//
+// Converts angular acceleration commands into omega^2 for all motors, with
+// the total omega^2 fTotalThrust.
+//
+// Attitude torque has priority over collective thrust: if a motor would leave
+// [MIN_MOTOR_OMEGA_SQ, MAX_MOTOR_OMEGA_SQ] the collective thrust is moved
+// first, and only if the torque alone does not fit all torques are scaled
+// down together, which keeps the direction of the torque vector. The
+// produced angular accelerations and the MIXER_SAT_* flags are stored for the
+// anti-windup of the integrators.
+//
+//*****************************************************************************
+static void
+MixAngularAccel(tPDController * psPD, float fTotalThrust, float pfAccel[3])
 {
     //
-    // Total thrust in the z direction in the world frame.
+    // Torques up to constants.
     //
-    float totalThrust = psPD->fThrustZDir * g /
-            (K * cosf(psDCM->fEuler[0]) * cosf(psDCM->fEuler[1]));
+    float torqGamma = I_XX * pfAccel[0] * 1.41421356237 / (ARM_LENGTH * K);
+    float torqBeta = I_YY * pfAccel[1] * 1.41421356237 / (ARM_LENGTH * K);
+    float torqAlpha = I_ZZ * pfAccel[2] / b;
 
     //
-    // PD error. The desired angular velocity is set to 0.
+    // Differential part of omega^2 for all motors.
     //
-    float eAlpha = KP * (psPD->fDesState[2] - psDCM->fEuler[2]) +
-            KD * (0.0 - psDCM->pfGyro[2]);
-    float eBeta = KP * (psPD->fDesState[1] - psDCM->fEuler[1]) +
-            KD * (0.0 - psDCM->pfGyro[1]);
-    float eGamma = KP * (psPD->fDesState[0] - psDCM->fEuler[0]) +
-            KD * (0.0 - psDCM->pfGyro[0]);
+    float diff[4];
+    diff[0] = (torqGamma - torqBeta - torqAlpha) / 4.0;
+    diff[1] = (-torqGamma - torqBeta + torqAlpha) / 4.0;
+    diff[2] = (-torqGamma + torqBeta - torqAlpha) / 4.0;
+    diff[3] = (torqGamma + torqBeta + torqAlpha) / 4.0;
+
+    float diffMin = diff[0];
+    float diffMax = diff[0];
+    int i;
+    for (i = 1; i < 4; i++)
+    {
+        if (diff[i] < diffMin)
+            diffMin = diff[i];
+        if (diff[i] > diffMax)
+            diffMax = diff[i];
+    }
 
     //
-    // Torques up to constants.
+    // Scale the torques down if they do not fit the motor range even
+    // without any collective thrust.
     //
-    float torqGamma = I_XX * eGamma * 1.41421356237 / (ARM_LENGTH * K);
-    float torqBeta = I_YY * eBeta * 1.41421356237 / (ARM_LENGTH * K);
-    float torqAlpha = I_ZZ * eAlpha / b;
+    float range = MAX_MOTOR_OMEGA_SQ - MIN_MOTOR_OMEGA_SQ;
+    float scale = 1.0;
+    psPD->ui8MixerSat = 0;
+    if ((diffMax - diffMin) > range)
+    {
+        scale = range / (diffMax - diffMin);
+        for (i = 0; i < 4; i++)
+        {
+            diff[i] *= scale;
+        }
+        diffMin *= scale;
+        diffMax *= scale;
+        psPD->ui8MixerSat |= MIXER_SAT_TORQUE;
+    }
+
+    //
+    // Move the collective thrust so that all motors are in range.
+    //
+    float collective = fTotalThrust / 4.0;
+    if ((collective + diffMax) > MAX_MOTOR_OMEGA_SQ)
+    {
+        collective = MAX_MOTOR_OMEGA_SQ - diffMax;
+        psPD->ui8MixerSat |= MIXER_SAT_THRUST;
+    }
+    if ((collective + diffMin) < MIN_MOTOR_OMEGA_SQ)
+    {
+        collective = MIN_MOTOR_OMEGA_SQ - diffMin;
+        psPD->ui8MixerSat |= MIXER_SAT_THRUST;
+    }
 
     //
     // Updates omega^2 for all motors.
     //
-    float omegaSq[4];
-    omegaSq[0] = (totalThrust + torqGamma - torqBeta - torqAlpha) / 4.0;
-    omegaSq[1] = (totalThrust - torqGamma - torqBeta + torqAlpha) / 4.0;
-    omegaSq[2] = (totalThrust - torqGamma + torqBeta - torqAlpha) / 4.0;
-    omegaSq[3] = (totalThrust + torqGamma + torqBeta + torqAlpha) / 4.0;
-
-    //
-    // Limit motor angular velocity.
-    //
-    if (omegaSq[0] > MAX_MOTOR_OMEGA_SQ)
-        omegaSq[0] = MAX_MOTOR_OMEGA_SQ;
-    if (omegaSq[1] > MAX_MOTOR_OMEGA_SQ)
-        omegaSq[1] = MAX_MOTOR_OMEGA_SQ;
-    if (omegaSq[2] > MAX_MOTOR_OMEGA_SQ)
-        omegaSq[2] = MAX_MOTOR_OMEGA_SQ;
-    if (omegaSq[3] > MAX_MOTOR_OMEGA_SQ)
-        omegaSq[3] = MAX_MOTOR_OMEGA_SQ;
-
-    // DEBUGGING
-    // set minimal thrust
-    if (omegaSq[0] < (0.1 / K))
-            omegaSq[0] = (0.1 / K);
-    if (omegaSq[1] < (0.1 / K))
-                omegaSq[1] = (0.1 / K);
-    if (omegaSq[2] < (0.1 / K))
-                omegaSq[2] = (0.1 / K);
-    if (omegaSq[3] < (0.1 / K))
-                omegaSq[3] = (0.1 / K);
-
-    psPD->fOmegaSq[0] = omegaSq[0];
-    psPD->fOmegaSq[1] = omegaSq[1];
-    psPD->fOmegaSq[2] = omegaSq[2];
-    psPD->fOmegaSq[3] = omegaSq[3];
+    for (i = 0; i < 4; i++)
+    {
+        psPD->fOmegaSq[i] = collective + diff[i];
+    }
+
+    //
+    // Angular accelerations that are actually produced.
+    //
+    for (i = 0; i < 3; i++)
+    {
+        psPD->fAccelOut[i] = scale * pfAccel[i];
+    }
+}
+
+
+//*****************************************************************************
+//
+// Limits a value to [-fLimit, fLimit].
+//
+//*****************************************************************************
+static float
+Clamp(float fValue, float fLimit)
+{
+    if (fValue > fLimit)
+    {
+        return fLimit;
+    }
+    if (fValue < -fLimit)
+    {
+        return -fLimit;
+    }
+    return fValue;
+}
+
+
+//*****************************************************************************
+//
+// Adds fIncrement to the integrator of axis i with anti-windup, based on the
+// command and the produced angular acceleration of the previous update.
+//
+//*****************************************************************************
+static float
+IntegrateAntiWindup(tPDController * psPD, int i, float fInt, float fIncrement,
+                    float fLimit)
+{
+    float fUnproduced = psPD->fAccelCmd[i] - psPD->fAccelOut[i];
+
+    //
+    // Conditional integration: do not push further into saturation.
+    //
+    if ((fUnproduced * fIncrement) > 0.0)
+    {
+        fIncrement = 0.0;
+    }
+
+    //
+    // Back-calculation: bleed off what the motors could not produce.
+    //
+    fInt += fIncrement - ANTIWINDUP_GAIN * fUnproduced * CONTROLLER_DELTA_T;
+
+    return Clamp(fInt, fLimit);
 }
 
 
 //*****************************************************************************
 //
-// Update motor PWM duty cycles.
+// Calculates the motor angular velocities from the PID errors. While the
+// auto-tune runs, its relay replaces the D term of the axis it tunes.
+//
+//*****************************************************************************
+void
+ErrorToInput(tPDController * psPD, tCompDCM * psDCM)
+{
+    tAutotune *psTune = &psPD->sTune;
+    float fAccel[3];
+    float fDRate[3];
+    int i;
+
+    //
+    // The D term is the filtered body rate, low-passed once more.
+    //
+    BiquadChainApply(&psPD->sGyroFilter, psDCM->pfGyro, psPD->fRate);
+    BiquadChainApply(&psPD->sDTermFilter, psPD->fRate, fDRate);
+
+    //
+    // PID error. The desired angular velocity is set to 0.
+    //
+    for (i = 0; i < 3; i++)
+    {
+        float fError = psPD->fDesState[i] - psDCM->fEuler[i];
+
+        psPD->fAngleInt[i] = IntegrateAntiWindup(psPD, i, psPD->fAngleInt[i],
+                                                 psPD->fKi * fError *
+                                                 CONTROLLER_DELTA_T,
+                                                 INT_LIMIT);
+
+        if ((psTune->ui8State == AUTOTUNE_RUNNING) && (psTune->ui8Axis == i))
+        {
+            fAccel[i] = psPD->fKp * fError + psPD->fAngleInt[i] +
+                    AutotuneUpdate(psTune, fError, fDRate[i]);
+        }
+        else
+        {
+            fAccel[i] = psPD->fKp * fError + psPD->fAngleInt[i] +
+                    psPD->fKd * (0.0 - fDRate[i]);
+        }
+        psPD->fAccelCmd[i] = fAccel[i];
+    }
+
+    MixAngularAccel(psPD, TiltCompensatedThrust(psPD, psDCM), fAccel);
+}
+
+
+//*****************************************************************************
+//
+// Outer angle loop of the cascaded controller, turns the angle error into a
+// body rate setpoint once every ui8OuterDivider updates.
+//
+//*****************************************************************************
+static void
+CascadeOuterLoop(tPDController * psPD, tCompDCM * psDCM)
+{
+    tCascade *psCas = &psPD->sCascade;
+    int i;
+
+    if (++psCas->ui8OuterCounter >= psCas->ui8OuterDivider)
+    {
+        psCas->ui8OuterCounter = 0;
+        for (i = 0; i < 3; i++)
+        {
+            psCas->fRateSetpoint[i] =
+                Clamp(psCas->fAngleKp[i] *
+                      (psPD->fDesState[i] - psDCM->fEuler[i]),
+                      psCas->fRateLimit[i]);
+        }
+    }
+}
+
+
+//*****************************************************************************
+//
+// Calculates the motor angular velocities with the cascaded controller. The
+// outer loop turns the angle error into a body rate setpoint at a reduced
+// rate, the inner loop runs a PID on the body rate for every gyro sample.
+//
+//*****************************************************************************
+void
+CascadeErrorToInput(tPDController * psPD, tCompDCM * psDCM)
+{
+    tCascade *psCas = &psPD->sCascade;
+    float fAccel[3];
+    float fDRate[3];
+    int i;
+
+    BiquadChainApply(&psPD->sGyroFilter, psDCM->pfGyro, psPD->fRate);
+    CascadeOuterLoop(psPD, psDCM);
+
+    //
+    // Inner rate loop. The D term acts on the measured rate only, so steps
+    // of the setpoint from the outer loop do not kick the motors. The
+    // differentiated rate is low-passed.
+    //
+    for (i = 0; i < 3; i++)
+    {
+        fDRate[i] = (psPD->fRate[i] - psCas->fLastRate[i]) / CONTROLLER_DELTA_T;
+        psCas->fLastRate[i] = psPD->fRate[i];
+    }
+    BiquadChainApply(&psPD->sDTermFilter, fDRate, fDRate);
+
+    for (i = 0; i < 3; i++)
+    {
+        float fRate = psPD->fRate[i];
+        float fError = psCas->fRateSetpoint[i] - fRate;
+
+        psCas->fRateInt[i] = IntegrateAntiWindup(psPD, i, psCas->fRateInt[i],
+                                                 psCas->fRateKi[i] * fError *
+                                                 CONTROLLER_DELTA_T,
+                                                 psCas->fAccelLimit[i]);
+
+        psPD->fAccelCmd[i] = psCas->fRateKp[i] * fError + psCas->fRateInt[i] -
+                psCas->fRateKd[i] * fDRate[i];
+        fAccel[i] = Clamp(psPD->fAccelCmd[i], psCas->fAccelLimit[i]);
+    }
+
+    MixAngularAccel(psPD, TiltCompensatedThrust(psPD, psDCM), fAccel);
+}
+
+
+//*****************************************************************************
+//
+// Calculates the motor angular velocities with the geometric controller of
+// Lee et al. (2010), which works on the DCM instead of the Euler angles. R is
+// the DCM, Rd the DCM of the desired angles. The rotation error
+//
+//   eR = vee(Rd'R - R'Rd) / sqrt(1 + tr(Rd'R))
+//
+// is the axis of the rotation from Rd to R in the body frame times twice the
+// sine of half its angle, so it equals the angle errors for small errors and
+// keeps growing up to a turn of 180 deg about any axis. It is fed to the PID
+// with the gains of ErrorToInput(), together with the gyroscopic torque
+// w x Jw.
+//
+// The thrust holds fThrustZDir in the z direction of the world frame with the
+// tilt taken from the DCM, as in the other controllers, up to a tilt of
+// acos(GEOMETRIC_TILT_COS). Beyond it the thrust fades out linearly with the
+// cosine of the tilt and is at the minimum while upside down, instead of
+// growing without bound toward 90 deg.
+//
+//*****************************************************************************
+void
+GeometricErrorToInput(tPDController * psPD, tCompDCM * psDCM)
+{
+    float ppfDes[3][3], ppfE[3][3];
+    float fAccel[3], fDRate[3], fError[3];
+    float fTrace, fTilt, fThrust;
+    int i, j;
+
+    BiquadChainApply(&psPD->sGyroFilter, psDCM->pfGyro, psPD->fRate);
+    BiquadChainApply(&psPD->sDTermFilter, psPD->fRate, fDRate);
+
+    //
+    // E = Rd'R.
+    //
+    ComputeDCMFromEulers(ppfDes, psPD->fDesState[0], psPD->fDesState[1],
+                         psPD->fDesState[2]);
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            ppfE[i][j] = (ppfDes[0][i] * psDCM->ppfDCM[0][j] +
+                          ppfDes[1][i] * psDCM->ppfDCM[1][j] +
+                          ppfDes[2][i] * psDCM->ppfDCM[2][j]);
+        }
+    }
+
+    //
+    // Rotation error. At exactly 180 deg its axis is undefined, the limit
+    // keeps the division finite there.
+    //
+    fTrace = 1.0f + ppfE[0][0] + ppfE[1][1] + ppfE[2][2];
+    if (fTrace < 1e-4f)
+    {
+        fTrace = 1e-4f;
+    }
+    fTrace = 1.0f / sqrtf(fTrace);
+    fError[0] = (ppfE[2][1] - ppfE[1][2]) * fTrace;
+    fError[1] = (ppfE[0][2] - ppfE[2][0]) * fTrace;
+    fError[2] = (ppfE[1][0] - ppfE[0][1]) * fTrace;
+
+    //
+    // PID on the rotation error, the desired body rate is 0.
+    //
+    for (i = 0; i < 3; i++)
+    {
+        psPD->fAngleInt[i] = IntegrateAntiWindup(psPD, i, psPD->fAngleInt[i],
+                                                 -psPD->fKi * fError[i] *
+                                                 CONTROLLER_DELTA_T,
+                                                 INT_LIMIT);
+
+        fAccel[i] = -psPD->fKp * fError[i] + psPD->fAngleInt[i] -
+                psPD->fKd * fDRate[i];
+    }
+
+    //
+    // Gyroscopic torque, J^-1 (w x Jw).
+    //
+    fAccel[0] += (I_ZZ - I_YY) / I_XX * psPD->fRate[1] * psPD->fRate[2];
+    fAccel[1] += (I_XX - I_ZZ) / I_YY * psPD->fRate[2] * psPD->fRate[0];
+    fAccel[2] += (I_YY - I_XX) / I_ZZ * psPD->fRate[0] * psPD->fRate[1];
+    for (i = 0; i < 3; i++)
+    {
+        psPD->fAccelCmd[i] = fAccel[i];
+    }
+
+    //
+    // Tilt compensation, the cosine of the tilt is the last element of the
+    // DCM.
+    //
+    fTilt = psDCM->ppfDCM[2][2];
+    if (fTilt >= GEOMETRIC_TILT_COS)
+    {
+        fThrust = psPD->fThrustZDir * g / (K * fTilt);
+    }
+    else if (fTilt > 0.0)
+    {
+        fThrust = (psPD->fThrustZDir * g * fTilt /
+                   (K * GEOMETRIC_TILT_COS * GEOMETRIC_TILT_COS));
+    }
+    else
+    {
+        fThrust = 0.0;
+    }
+
+    MixAngularAccel(psPD, fThrust, fAccel);
+}
+
+
+//*****************************************************************************
+//
+// Calculates the motor angular velocities with the INDI rate loop of Smeur et
+// al. (2016) behind the outer angle loop of the cascaded controller. Instead
+// of the full angular acceleration from a model of the airframe, it commands
+// the change from the angular acceleration that the motors produce now:
+//
+//   u = u0 + (nu - dw)
+//
+// nu is the angular acceleration that the rate P gain asks for, dw the
+// measured one, differenced from the filtered gyro, and u0 the one that the
+// motors produce with the omega^2 of the motor model (MotorModelUpdate()).
+// Both dw and u0 pass the same low-pass, so they are in step. Torques the
+// model misses (CG offset, wind, wrong I_XX, I_YY, I_ZZ and b) show up in dw
+// and are removed within a few updates instead of by an integrator, and
+// errors of the inertia and of b only change how fast that happens.
+//
+// u0 is an integrator all the same: whatever of nu the airframe does not
+// follow builds up in it through the mixer output. On the ground the
+// measured angular acceleration stays 0, so while ControllerIdle() and
+// until the thrust nears hover (INDI_GROUND_THRUST) the command is nu alone
+// and u0 restarts from it. The first update after the commands were held
+// (ControllerCoast()) keeps u0, since its rate difference spans the whole
+// outage.
+//
+// The rate gain is lower than the one of the cascade: nu is followed within
+// a few updates, so the loop has less phase to spare for the delay of the
+// sensor.
+//
+//*****************************************************************************
+void
+IndiErrorToInput(tPDController * psPD, tCompDCM * psDCM)
+{
+    tCascade *psCas = &psPD->sCascade;
+    tIndi *psIndi = &psPD->sIndi;
+    float fProduced[3], fRateDot[3], fAccel[3];
+    int i;
+
+    BiquadChainApply(&psPD->sGyroFilter, psDCM->pfGyro, psPD->fRate);
+    CascadeOuterLoop(psPD, psDCM);
+
+    //
+    // Measured angular acceleration.
+    //
+    for (i = 0; i < 3; i++)
+    {
+        fRateDot[i] = (psPD->fRate[i] - psIndi->fLastRate[i]) /
+                CONTROLLER_DELTA_T;
+        if (psIndi->bHold)
+        {
+            fRateDot[i] = psIndi->fRateDot[i];
+        }
+        psIndi->fLastRate[i] = psPD->fRate[i];
+    }
+    BiquadChainApply(&psIndi->sRateDotFilter, fRateDot, psIndi->fRateDot);
+
+    //
+    // The angular acceleration that the modeled motors produce is the
+    // inverse of the mixer.
+    //
+    float *pfW = psPD->sMotor.fOmegaSq;
+    fProduced[0] = ((pfW[0] - pfW[1] - pfW[2] + pfW[3]) * ARM_LENGTH * K /
+                    (1.41421356237 * I_XX));
+    fProduced[1] = ((-pfW[0] - pfW[1] + pfW[2] + pfW[3]) * ARM_LENGTH * K /
+                    (1.41421356237 * I_YY));
+    fProduced[2] = (-pfW[0] + pfW[1] - pfW[2] + pfW[3]) * b / I_ZZ;
+    BiquadChainApply(&psIndi->sAccelFilter, fProduced, fProduced);
+
+    //
+    // Incremental command. The mixer output that u0 is taken from already
+    // includes the saturation.
+    //
+    bool bGround = (ControllerIdle(psPD) ||
+                    (psPD->fThrustZDir < INDI_GROUND_THRUST));
+    for (i = 0; i < 3; i++)
+    {
+        float fNu = Clamp(psIndi->fRateKp *
+                          (psCas->fRateSetpoint[i] - psPD->fRate[i]),
+                          psCas->fAccelLimit[i]);
+
+        if (bGround)
+        {
+            psPD->fAccelCmd[i] = fNu;
+        }
+        else if (psIndi->bHold)
+        {
+            psPD->fAccelCmd[i] = fProduced[i];
+        }
+        else
+        {
+            psPD->fAccelCmd[i] = fProduced[i] + fNu - psIndi->fRateDot[i];
+        }
+        fAccel[i] = Clamp(psPD->fAccelCmd[i], psCas->fAccelLimit[i]);
+    }
+    psIndi->bHold = false;
+
+    MixAngularAccel(psPD, TiltCompensatedThrust(psPD, psDCM), fAccel);
+}
+
+
+//*****************************************************************************
+//
+// Runs the active controller.
+//
+//*****************************************************************************
+void
+ControllerUpdate(tPDController * psPD, tCompDCM * psDCM)
+{
+    switch (psPD->ui8Mode)
+    {
+    case CONTROLLER_MODE_CASCADE:
+        CascadeErrorToInput(psPD, psDCM);
+        break;
+    case CONTROLLER_MODE_GEOMETRIC:
+        GeometricErrorToInput(psPD, psDCM);
+        break;
+    case CONTROLLER_MODE_INDI:
+        IndiErrorToInput(psPD, psDCM);
+        break;
+    case CONTROLLER_MODE_PD:
+    default:
+        ErrorToInput(psPD, psDCM);
+        break;
+    }
+}
+
+//*****************************************************************************
+//
+// Without attitude feedback: puts all motors at CONTROLLER_FAILSAFE_THRUST of
+// their mean command, no torque and a bit less than the thrust they gave.
+// Called once, the commands are then held.
+//
+//*****************************************************************************
+void
+ControllerFailsafe(tPDController * psPD)
+{
+    float fMean = 0.25f * (psPD->fOmegaSq[0] + psPD->fOmegaSq[1] +
+                          psPD->fOmegaSq[2] + psPD->fOmegaSq[3]);
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        psPD->fOmegaSq[i] = CONTROLLER_FAILSAFE_THRUST * fMean;
+    }
+}
+
+//*****************************************************************************
+//
+// Returns true while the sticks hold the thrust at its minimum, the motors
+// at idle on the ground.
+//
+//*****************************************************************************
+bool
+ControllerIdle(tPDController * psPD)
+{
+    return psPD->fThrustZDir <= CONTROLLER_THRUST_MIN;
+}
+
+//*****************************************************************************
+//
+// Called instead of ControllerUpdate() while the motor commands are held
+// without samples, coasting or in the failsafe.
+//
+//*****************************************************************************
+void
+ControllerCoast(tPDController * psPD)
+{
+    psPD->sIndi.bHold = true;
+}
+
+
+//*****************************************************************************
+//
+// Leads the omega^2 of the mixer and advances the motor model by one update.
+// For a motor with the time constant tau, the command
+//
+//   c = w + (u - w) (tau + dt) / (lead * tau + dt)
+//
+// moves its modeled omega^2 w toward the mixer output u as a first order lag
+// with the time constant lead * tau would. The command is limited to what
+// the motor can do and, like the mixer, kept above MIN_MOTOR_OMEGA_SQ so
+// that a sharp drop does not stop the motor; only a mixer output below that
+// floor (before the first update, or of the failsafe) is passed as is. The
+// model follows the limited command, so it stays true while the lead
+// saturates.
+//
+//*****************************************************************************
+static void
+MotorModelUpdate(tPDController * psPD)
+{
+    tMotorModel *psMotor = &psPD->sMotor;
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        float fTau = psMotor->fTau[i];
+        float fCmd = psMotor->fOmegaSq[i] +
+                (psPD->fOmegaSq[i] - psMotor->fOmegaSq[i]) *
+                (fTau + CONTROLLER_DELTA_T) /
+                (psMotor->fLead * fTau + CONTROLLER_DELTA_T);
+        float fFloor = MIN_MOTOR_OMEGA_SQ;
+
+        if (psPD->fOmegaSq[i] < fFloor)
+        {
+            fFloor = psPD->fOmegaSq[i];
+        }
+        if (fCmd < fFloor)
+        {
+            fCmd = fFloor;
+        }
+        if (fCmd > FULL_MOTOR_OMEGA_SQ)
+        {
+            fCmd = FULL_MOTOR_OMEGA_SQ;
+        }
+        psMotor->fOmegaSqCmd[i] = fCmd;
+        psMotor->fOmegaSq[i] += (fCmd - psMotor->fOmegaSq[i]) *
+                CONTROLLER_DELTA_T / (fTau + CONTROLLER_DELTA_T);
+    }
+}
+
+
+//*****************************************************************************
+//
+// Update motor PWM duty cycles, with the lead of the motor model.
 //
 //*****************************************************************************
 void
 PDContUpdatePWM(tPDController * psPD, tPWM * psPWM)
 {
-    float dutyCycle0 = CalcDutyCycle(psPD->fBatteryV, psPD->fOmegaSq[0]);
-    float dutyCycle1 = CalcDutyCycle(psPD->fBatteryV, psPD->fOmegaSq[1]);
-    float dutyCycle2 = CalcDutyCycle(psPD->fBatteryV, psPD->fOmegaSq[2]);
-    float dutyCycle3 = CalcDutyCycle(psPD->fBatteryV, psPD->fOmegaSq[3]);
+    MotorModelUpdate(psPD);
+
+    float *pfCmd = psPD->sMotor.fOmegaSqCmd;
+    float dutyCycle0 = CalcDutyCycle(psPD->fBatteryV, pfCmd[0]);
+    float dutyCycle1 = CalcDutyCycle(psPD->fBatteryV, pfCmd[1]);
+    float dutyCycle2 = CalcDutyCycle(psPD->fBatteryV, pfCmd[2]);
+    float dutyCycle3 = CalcDutyCycle(psPD->fBatteryV, pfCmd[3]);
 
     //
     // Updates ESC signals.
@@ -213,9 +1004,9 @@ ReadDesiredState(tPDController * psPD, tPWM * psPWM)
     if(bufferCopy[1] < 10)
     {
         psPD->fThrustZDir -= delta;
-        if (psPD->fThrustZDir < 0.08)
+        if (psPD->fThrustZDir < CONTROLLER_THRUST_MIN)
         {
-            psPD->fThrustZDir = 0.08;
+            psPD->fThrustZDir = CONTROLLER_THRUST_MIN;
         }
     }
     else if(bufferCopy[1] > 240)
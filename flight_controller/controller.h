@@ -21,6 +21,182 @@ extern "C"
 
 #include "comp_dcm.h"
 #include "escpwm.h"
+#include "biquad.h"
+#include "autotune.h"
+
+//*****************************************************************************
+//
+// Controller modes.
+//
+//*****************************************************************************
+#define CONTROLLER_MODE_PD          0 // single loop angle PD
+#define CONTROLLER_MODE_CASCADE     1 // angle P loop feeding a rate PID loop
+#define CONTROLLER_MODE_GEOMETRIC   2 // PD on the rotation error on SO(3)
+#define CONTROLLER_MODE_INDI        3 // angle P loop feeding an INDI rate loop
+
+//*****************************************************************************
+//
+// Mixer saturation flags.
+//
+//*****************************************************************************
+#define MIXER_SAT_THRUST            0x01 // collective thrust was moved
+#define MIXER_SAT_TORQUE            0x02 // torques were scaled down
+
+//*****************************************************************************
+//
+// Fraction of the mean motor command that ControllerFailsafe() leaves on all
+// motors, a bit below hover so the quadrotor sinks.
+//
+//*****************************************************************************
+#define CONTROLLER_FAILSAFE_THRUST  0.9f
+
+//*****************************************************************************
+//
+// The lowest thrust the sticks set, in kg. ControllerIdle() is true there.
+//
+//*****************************************************************************
+#define CONTROLLER_THRUST_MIN       0.08f
+
+//*****************************************************************************
+//
+// Sections of the gyro filter chain.
+//
+//*****************************************************************************
+#define GYRO_FILTER_NOTCH           0
+#define GYRO_FILTER_DYN_NOTCH       1 // GYRO_FILTER_DYN_NOTCHES sections
+#define GYRO_FILTER_LPF             3
+#define GYRO_FILTER_STAGES          4
+
+//*****************************************************************************
+//
+// Number of notches that follow the vibration peaks found in flight.
+//
+//*****************************************************************************
+#define GYRO_FILTER_DYN_NOTCHES     2
+
+//*****************************************************************************
+//
+// State of the cascaded angle -> rate controller. Arrays are indexed by body
+// axis: 0 roll (gamma), 1 pitch (beta), 2 yaw (alpha).
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // Outer angle loop P gain, rad/s per rad.
+    //
+    float fAngleKp[3];
+
+    //
+    // Limit of the body rate setpoint produced by the outer loop, rad/s.
+    //
+    float fRateLimit[3];
+
+    //
+    // Inner rate loop PID gains.
+    //
+    float fRateKp[3];
+    float fRateKi[3];
+    float fRateKd[3];
+
+    //
+    // Limit of the angular acceleration command, rad/s^2.
+    //
+    float fAccelLimit[3];
+
+    //
+    // Body rate setpoint from the outer loop.
+    //
+    float fRateSetpoint[3];
+
+    //
+    // Rate error integral, in rad/s^2.
+    //
+    float fRateInt[3];
+
+    //
+    // Previous body rate for the D term.
+    //
+    float fLastRate[3];
+
+    //
+    // The outer loop runs once every ui8OuterDivider inner loop updates.
+    //
+    uint8_t ui8OuterDivider;
+    uint8_t ui8OuterCounter;
+}
+tCascade;
+
+//*****************************************************************************
+//
+// First order model of the motors, whose omega^2 follows the command with
+// the time constant fTau. PDContUpdatePWM() leads the commands so that the
+// modeled omega^2 follows the mixer with the shorter time constant
+// fLead * fTau.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // Time constant of each motor, s, and the fraction of it that is left
+    // with the lead, 1 disables the lead.
+    //
+    float fTau[4];
+    float fLead;
+
+    //
+    // Modeled omega^2 of the motors, and the commands that lead them.
+    //
+    float fOmegaSq[4];
+    float fOmegaSqCmd[4];
+}
+tMotorModel;
+
+//*****************************************************************************
+//
+// State of the incremental nonlinear dynamic inversion (INDI) rate loop. It
+// shares the outer angle loop and the acceleration limits of tCascade, and
+// takes the omega^2 of the motors from tMotorModel.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // Cutoff of the low-pass on both angular accelerations, Hz.
+    // ControllerFiltersUpdate() must be called after a change.
+    //
+    float fLpfHz;
+
+    //
+    // Gain from the rate error to the commanded angular acceleration, 1/s,
+    // for all axes.
+    //
+    float fRateKp;
+
+    //
+    // Previous filtered body rate, for the angular acceleration.
+    //
+    float fLastRate[3];
+
+    //
+    // Low-pass of the measured angular acceleration and of the one that the
+    // modeled motors produce, with the same delay.
+    //
+    tBiquadChain sRateDotFilter;
+    tBiquadChain sAccelFilter;
+
+    //
+    // Filtered measured angular acceleration of the last update, rad/s^2.
+    //
+    float fRateDot[3];
+
+    //
+    // Set by ControllerCoast() while the motor commands are held without
+    // samples. The next update then keeps the command of the motors.
+    //
+    bool bHold;
+}
+tIndi;
 
 //*****************************************************************************
 //
@@ -44,6 +220,79 @@ typedef struct
     //
     float fDesState[3];
 
+    //
+    // PID gains.
+    //
+    float fKp;
+    float fKd;
+    float fKi;
+
+    //
+    // Angle error integral, in rad/s^2. The geometric controller integrates
+    // its rotation error here as well.
+    //
+    float fAngleInt[3];
+
+    //
+    // Angular accelerations requested from the mixer and produced by it in
+    // the last update, and its MIXER_SAT_* flags.
+    //
+    float fAccelCmd[3];
+    float fAccelOut[3];
+    uint8_t ui8MixerSat;
+
+    //
+    // Filter configuration in Hz, a frequency of 0 disables a filter.
+    // ControllerFiltersUpdate() must be called after a change.
+    //
+    float fGyroLpfHz;
+    float fNotchHz;
+    float fNotchQ;
+    float fDTermLpfHz;
+
+    //
+    // Notches that track the vibration peaks, enabled while fDynNotch is
+    // not 0. Frequencies in Hz, 0 disables a notch.
+    //
+    float fDynNotch;
+    float fDynNotchHz[GYRO_FILTER_DYN_NOTCHES];
+
+    //
+    // Gyro pre-filter (notch, low-pass) and D term low-pass.
+    //
+    tBiquadChain sGyroFilter;
+    tBiquadChain sDTermFilter;
+
+    //
+    // Filtered body rates of the last update, rad/s.
+    //
+    float fRate[3];
+
+    //
+    // Active controller, one of CONTROLLER_MODE_*.
+    //
+    uint8_t ui8Mode;
+
+    //
+    // Cascaded controller state.
+    //
+    tCascade sCascade;
+
+    //
+    // INDI rate loop state.
+    //
+    tIndi sIndi;
+
+    //
+    // Motor model and lead.
+    //
+    tMotorModel sMotor;
+
+    //
+    // Relay auto-tune of the PD gains.
+    //
+    tAutotune sTune;
+
     //
     // Current battery voltage.
     //
@@ -58,7 +307,17 @@ tPDController;
 //
 //*****************************************************************************
 extern void InitPDController(tPDController * psPD);
+extern void ControllerFiltersUpdate(tPDController * psPD);
+extern void ControllerNotchTrack(tPDController * psPD, const float *pfPeakHz,
+                                 uint8_t ui8Count);
 extern void ErrorToInput(tPDController * psPD, tCompDCM * psDCM);
+extern void CascadeErrorToInput(tPDController * psPD, tCompDCM * psDCM);
+extern void GeometricErrorToInput(tPDController * psPD, tCompDCM * psDCM);
+extern void IndiErrorToInput(tPDController * psPD, tCompDCM * psDCM);
+extern void ControllerUpdate(tPDController * psPD, tCompDCM * psDCM);
+extern void ControllerFailsafe(tPDController * psPD);
+extern bool ControllerIdle(tPDController * psPD);
+extern void ControllerCoast(tPDController * psPD);
 extern void PDContUpdatePWM(tPDController * psPD, tPWM * psPWM);
 extern float CalcDutyCycle(float battV, float reqOmegaSq);
 extern void ReadDesiredState(tPDController * psPD, tPWM * psPWM);
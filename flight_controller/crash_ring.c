@@ -0,0 +1,153 @@
+//*****************************************************************************
+//
+// crash_ring.c - Pre-trigger capture of the last samples before a fault.
+//
+// Every main loop iteration adds the raw MPU9150 registers and the motor
+// commands to a ring. A trigger (a NaN reset of the DCM, an I2C error, a
+// large attitude error) records CRASH_RING_POST more samples and then
+// freezes the ring. The ring is placed in a no-init RAM section by main.c,
+// so a frozen capture survives a warm reset (the reset button, the
+// debugger, a watchdog) and is printed on UART0 at the next boot. It stays
+// frozen until it is armed again.
+//
+// The module uses no TivaWare headers.
+//
+//*****************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "crash_ring.h"
+
+//*****************************************************************************
+//
+// Checks the header of a ring that survived a reset. RAM holds garbage after
+// a power-on reset, which the magic and the ranges reject.
+//
+//*****************************************************************************
+static bool
+CrashRingValid(const tCrashRing *psRing)
+{
+    return ((psRing->ui32Magic == CRASH_RING_MAGIC) &&
+            (psRing->ui32Next < CRASH_RING_SAMPLES) &&
+            (psRing->ui32Count <= CRASH_RING_SAMPLES) &&
+            (psRing->ui32Post <= CRASH_RING_POST) &&
+            (psRing->ui32Trigger < CRASH_RING_SAMPLES) &&
+            ((psRing->ui32Cause & ~CRASH_TRIGGER_ALL) == 0));
+}
+
+//*****************************************************************************
+//
+// Keeps a capture that survived the reset, or arms the ring. Returns true
+// if there is a capture.
+//
+//*****************************************************************************
+bool
+CrashRingInit(tCrashRing *psRing)
+{
+    if (CrashRingValid(psRing) && psRing->ui32Cause)
+    {
+        //
+        // The samples after the trigger end with the reset.
+        //
+        psRing->ui32Post = 0;
+        return true;
+    }
+
+    CrashRingArm(psRing);
+    return false;
+}
+
+//*****************************************************************************
+//
+// Drops the capture and starts recording.
+//
+//*****************************************************************************
+void
+CrashRingArm(tCrashRing *psRing)
+{
+    psRing->ui32Magic = CRASH_RING_MAGIC;
+    psRing->ui32Next = 0;
+    psRing->ui32Count = 0;
+    psRing->ui32Cause = 0;
+    psRing->ui32Post = 0;
+    psRing->ui32Trigger = 0;
+    psRing->ui8GyroFsSel = 0;
+    psRing->ui8AccelAfsSel = 0;
+}
+
+//*****************************************************************************
+//
+// Adds a sample, unless the ring is frozen.
+//
+//*****************************************************************************
+void
+CrashRingAdd(tCrashRing *psRing, const uint8_t *pui8Raw,
+             const float *pfOmegaSq, uint32_t ui32Tick)
+{
+    tCrashSample *psSample;
+    int i;
+
+    if (psRing->ui32Cause)
+    {
+        if (psRing->ui32Post == 0)
+        {
+            return;
+        }
+        psRing->ui32Post--;
+    }
+
+    psSample = &psRing->psSamples[psRing->ui32Next];
+    memcpy(psSample->pui8Raw, pui8Raw, CRASH_RING_RAW_BYTES);
+    psSample->ui16Tick = (uint16_t)ui32Tick;
+    for (i = 0; i < 4; i++)
+    {
+        float fValue = pfOmegaSq[i] * (1.0f / CRASH_RING_OMEGA_SQ_LSB);
+
+        psSample->pui16OmegaSq[i] = (fValue <= 0.0f) ? 0 :
+                (fValue >= 65535.0f) ? 65535 : (uint16_t)(fValue + 0.5f);
+    }
+
+    psRing->ui32Next = (psRing->ui32Next + 1) % CRASH_RING_SAMPLES;
+    if (psRing->ui32Count < CRASH_RING_SAMPLES)
+    {
+        psRing->ui32Count++;
+    }
+}
+
+//*****************************************************************************
+//
+// Freezes the ring after CRASH_RING_POST more samples. Only the first
+// trigger counts, the capture shows how the fault started.
+//
+//*****************************************************************************
+void
+CrashRingTrigger(tCrashRing *psRing, uint32_t ui32Cause,
+                 uint8_t ui8GyroFsSel, uint8_t ui8AccelAfsSel)
+{
+    if (psRing->ui32Cause || !ui32Cause)
+    {
+        return;
+    }
+
+    psRing->ui32Cause = ui32Cause;
+    psRing->ui32Post = CRASH_RING_POST;
+    psRing->ui32Trigger = (psRing->ui32Next + CRASH_RING_SAMPLES - 1) %
+            CRASH_RING_SAMPLES;
+    psRing->ui8GyroFsSel = ui8GyroFsSel;
+    psRing->ui8AccelAfsSel = ui8AccelAfsSel;
+}
+
+//*****************************************************************************
+//
+// Returns the ui32Index-th of the valid samples, oldest first.
+//
+//*****************************************************************************
+const tCrashSample *
+CrashRingSample(const tCrashRing *psRing, uint32_t ui32Index)
+{
+    uint32_t ui32First = (psRing->ui32Next + CRASH_RING_SAMPLES -
+                          psRing->ui32Count) % CRASH_RING_SAMPLES;
+
+    return &psRing->psSamples[(ui32First + ui32Index) % CRASH_RING_SAMPLES];
+}
@@ -0,0 +1,135 @@
+//*****************************************************************************
+//
+// crash_ring.h - Pre-trigger capture of the last samples before a fault.
+//
+//*****************************************************************************
+
+#ifndef _CRASH_RING_H_
+#define _CRASH_RING_H_
+
+//*****************************************************************************
+//
+// If building with a C++ compiler, make all of the definitions in this header
+// have a C binding.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//*****************************************************************************
+//
+// Samples of the ring, about a second at 250 Hz; 8 kB is what the SRAM has
+// left. CRASH_RING_POST of them are still recorded after the trigger, the
+// rest shows what led to it.
+//
+//*****************************************************************************
+#define CRASH_RING_SAMPLES          256
+#define CRASH_RING_POST             32
+
+//*****************************************************************************
+//
+// Raw bytes of a sample, the MPU9150 registers from ACCEL_XOUT_H on, and the
+// unit of the stored motor commands in rad^2/s^2.
+//
+//*****************************************************************************
+#define CRASH_RING_RAW_BYTES        22
+#define CRASH_RING_OMEGA_SQ_LSB     8.0f
+
+//*****************************************************************************
+//
+// Marks a ring whose header survived a reset.
+//
+//*****************************************************************************
+#define CRASH_RING_MAGIC            0x43524153
+
+//*****************************************************************************
+//
+// Trigger causes, also the bits of the mask of enabled triggers.
+//
+//*****************************************************************************
+#define CRASH_TRIGGER_DCM_NAN       0x01
+#define CRASH_TRIGGER_I2C_ERROR     0x02
+#define CRASH_TRIGGER_ATTITUDE      0x04
+#define CRASH_TRIGGER_ALL           0x07
+
+//*****************************************************************************
+//
+// One sample, 32 bytes: the raw sensor registers, the low bits of the main
+// loop tick and the four motor commands in CRASH_RING_OMEGA_SQ_LSB.
+//
+//*****************************************************************************
+typedef struct
+{
+    uint8_t pui8Raw[CRASH_RING_RAW_BYTES];
+    uint16_t ui16Tick;
+    uint16_t pui16OmegaSq[4];
+}
+tCrashSample;
+
+//*****************************************************************************
+//
+// The ring. It lives in RAM that the startup code does not clear, so a
+// capture survives a warm reset until it is read out and the ring is armed
+// again.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // CRASH_RING_MAGIC once initialized.
+    //
+    uint32_t ui32Magic;
+
+    //
+    // Index of the next sample to write and the number of valid samples.
+    //
+    uint32_t ui32Next;
+    uint32_t ui32Count;
+
+    //
+    // Cause of the capture, 0 while armed, the samples still recorded after
+    // the trigger and the index of the last sample before it.
+    //
+    uint32_t ui32Cause;
+    uint32_t ui32Post;
+    uint32_t ui32Trigger;
+
+    //
+    // Sensor ranges at the trigger, needed to scale the raw samples.
+    //
+    uint8_t ui8GyroFsSel;
+    uint8_t ui8AccelAfsSel;
+
+    tCrashSample psSamples[CRASH_RING_SAMPLES];
+}
+tCrashRing;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern bool CrashRingInit(tCrashRing *psRing);
+extern void CrashRingArm(tCrashRing *psRing);
+extern void CrashRingAdd(tCrashRing *psRing, const uint8_t *pui8Raw,
+                         const float *pfOmegaSq, uint32_t ui32Tick);
+extern void CrashRingTrigger(tCrashRing *psRing, uint32_t ui32Cause,
+                             uint8_t ui8GyroFsSel, uint8_t ui8AccelAfsSel);
+extern const tCrashSample *CrashRingSample(const tCrashRing *psRing,
+                                           uint32_t ui32Index);
+
+//*****************************************************************************
+//
+// Mark the end of the C bindings section for C++ compilers.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _CRASH_RING_H_
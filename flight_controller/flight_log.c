@@ -0,0 +1,391 @@
+//*****************************************************************************
+//
+// flight_log.c - Compact binary format of the flight recorder.
+//
+// Every sample of the main loop is quantized to integers and stored as the
+// difference to the previous record. Most fields change by a few counts
+// between samples, so a zigzag varint keeps them in one byte, and the fields
+// that did not change at all (setpoints, flags, battery) cost a single bit
+// of the mask. A page of FLIGHT_LOG_PAGE bytes always starts with a
+// keyframe and a record never crosses a page, so a damaged page only loses
+// itself.
+//
+// The encoder runs in the flight controller (blackbox.c), the decoder in
+// simul/flight_log. The module uses no TivaWare headers.
+//
+//*****************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "flight_log.h"
+
+//*****************************************************************************
+//
+// Decimal exponent of every field: a field holds the value times
+// 10^exponent, so the host can print it without floating point.
+//
+//*****************************************************************************
+const int8_t g_pi8FlightLogExponent[FLIGHT_LOG_FIELDS] =
+{
+    0, 0, 0,                    // tick, loop and controller cycles
+    3, 3, 3,                    // gyro, mrad/s
+    2, 2, 2,                    // accelerometer, cm/s^2
+    4, 4, 4,                    // Euler angles, 0.1 mrad
+    4, 4, 4,                    // desired Euler angles, 0.1 mrad
+    4,                          // thrust
+    -2, -2, -2, -2,             // motor omega^2, 100 rad^2/s^2
+    3,                          // battery, mV
+    0                           // flags
+};
+
+//*****************************************************************************
+//
+// Scale of every field, 10^exponent.
+//
+//*****************************************************************************
+static const float g_pfScale[FLIGHT_LOG_FIELDS] =
+{
+    1.0f, 1.0f, 1.0f,
+    1e3f, 1e3f, 1e3f,
+    1e2f, 1e2f, 1e2f,
+    1e4f, 1e4f, 1e4f,
+    1e4f, 1e4f, 1e4f,
+    1e4f,
+    1e-2f, 1e-2f, 1e-2f, 1e-2f,
+    1e3f,
+    1.0f
+};
+
+//*****************************************************************************
+//
+// Rounds a scaled value to the nearest integer.
+//
+//*****************************************************************************
+static int32_t
+Round(float fValue)
+{
+    return (int32_t)(fValue < 0.0f ? fValue - 0.5f : fValue + 0.5f);
+}
+
+//*****************************************************************************
+//
+// Quantizes a sample to the fields of a record.
+//
+//*****************************************************************************
+void
+FlightLogQuantize(const tFlightLogSample *psSample, int32_t *pi32Fields)
+{
+    int i;
+
+    pi32Fields[FLIGHT_LOG_TICK] = (int32_t)psSample->ui32Tick;
+    pi32Fields[FLIGHT_LOG_LOOP_CYCLES] = (int32_t)psSample->ui32LoopCycles;
+    pi32Fields[FLIGHT_LOG_CTRL_CYCLES] = (int32_t)psSample->ui32CtrlCycles;
+    for (i = 0; i < 3; i++)
+    {
+        pi32Fields[FLIGHT_LOG_GYRO + i] =
+                Round(psSample->pfGyro[i] * g_pfScale[FLIGHT_LOG_GYRO + i]);
+        pi32Fields[FLIGHT_LOG_ACCEL + i] =
+                Round(psSample->pfAccel[i] * g_pfScale[FLIGHT_LOG_ACCEL + i]);
+        pi32Fields[FLIGHT_LOG_EULER + i] =
+                Round(psSample->pfEuler[i] * g_pfScale[FLIGHT_LOG_EULER + i]);
+        pi32Fields[FLIGHT_LOG_DES_STATE + i] =
+                Round(psSample->pfDesState[i] *
+                      g_pfScale[FLIGHT_LOG_DES_STATE + i]);
+    }
+    pi32Fields[FLIGHT_LOG_THRUST] = Round(psSample->fThrustZDir *
+                                          g_pfScale[FLIGHT_LOG_THRUST]);
+    for (i = 0; i < 4; i++)
+    {
+        pi32Fields[FLIGHT_LOG_OMEGA_SQ + i] =
+                Round(psSample->pfOmegaSq[i] *
+                      g_pfScale[FLIGHT_LOG_OMEGA_SQ + i]);
+    }
+    pi32Fields[FLIGHT_LOG_BATTERY] = Round(psSample->fBatteryV *
+                                           g_pfScale[FLIGHT_LOG_BATTERY]);
+    pi32Fields[FLIGHT_LOG_FLAGS] = (int32_t)psSample->ui32Flags;
+}
+
+//*****************************************************************************
+//
+// Converts the fields of a record back to a sample.
+//
+//*****************************************************************************
+void
+FlightLogDequantize(const int32_t *pi32Fields, tFlightLogSample *psSample)
+{
+    int i;
+
+    psSample->ui32Tick = (uint32_t)pi32Fields[FLIGHT_LOG_TICK];
+    psSample->ui32LoopCycles = (uint32_t)pi32Fields[FLIGHT_LOG_LOOP_CYCLES];
+    psSample->ui32CtrlCycles = (uint32_t)pi32Fields[FLIGHT_LOG_CTRL_CYCLES];
+    for (i = 0; i < 3; i++)
+    {
+        psSample->pfGyro[i] = pi32Fields[FLIGHT_LOG_GYRO + i] /
+                g_pfScale[FLIGHT_LOG_GYRO + i];
+        psSample->pfAccel[i] = pi32Fields[FLIGHT_LOG_ACCEL + i] /
+                g_pfScale[FLIGHT_LOG_ACCEL + i];
+        psSample->pfEuler[i] = pi32Fields[FLIGHT_LOG_EULER + i] /
+                g_pfScale[FLIGHT_LOG_EULER + i];
+        psSample->pfDesState[i] = pi32Fields[FLIGHT_LOG_DES_STATE + i] /
+                g_pfScale[FLIGHT_LOG_DES_STATE + i];
+    }
+    psSample->fThrustZDir = pi32Fields[FLIGHT_LOG_THRUST] /
+            g_pfScale[FLIGHT_LOG_THRUST];
+    for (i = 0; i < 4; i++)
+    {
+        psSample->pfOmegaSq[i] = pi32Fields[FLIGHT_LOG_OMEGA_SQ + i] /
+                g_pfScale[FLIGHT_LOG_OMEGA_SQ + i];
+    }
+    psSample->fBatteryV = pi32Fields[FLIGHT_LOG_BATTERY] /
+            g_pfScale[FLIGHT_LOG_BATTERY];
+    psSample->ui32Flags = (uint32_t)pi32Fields[FLIGHT_LOG_FLAGS];
+}
+
+//*****************************************************************************
+//
+// Writes a zigzag varint, returns its length.
+//
+//*****************************************************************************
+static uint32_t
+VarintPut(int32_t i32Value, uint8_t *pui8Out)
+{
+    uint32_t ui32Zigzag = ((uint32_t)i32Value << 1) ^
+            (uint32_t)(i32Value >> 31);
+    uint32_t ui32Length = 0;
+
+    while (ui32Zigzag >= 0x80)
+    {
+        pui8Out[ui32Length++] = (uint8_t)(ui32Zigzag | 0x80);
+        ui32Zigzag >>= 7;
+    }
+    pui8Out[ui32Length++] = (uint8_t)ui32Zigzag;
+    return ui32Length;
+}
+
+//*****************************************************************************
+//
+// Reads a zigzag varint of at most 5 bytes, returns its length or 0 if it
+// runs past the end of the input.
+//
+//*****************************************************************************
+static uint32_t
+VarintGet(const uint8_t *pui8In, uint32_t ui32Length, int32_t *pi32Value)
+{
+    uint32_t ui32Zigzag = 0;
+    uint32_t ui32Shift = 0;
+    uint32_t i;
+
+    for (i = 0; (i < ui32Length) && (i < 5); i++)
+    {
+        ui32Zigzag |= (uint32_t)(pui8In[i] & 0x7f) << ui32Shift;
+        if (!(pui8In[i] & 0x80))
+        {
+            *pi32Value = (int32_t)(ui32Zigzag >> 1) ^
+                    -(int32_t)(ui32Zigzag & 1);
+            return i + 1;
+        }
+        ui32Shift += 7;
+    }
+    return 0;
+}
+
+//*****************************************************************************
+//
+// Initializes the codec, the next record is a keyframe.
+//
+//*****************************************************************************
+void
+FlightLogCodecInit(tFlightLogCodec *psCodec)
+{
+    memset(psCodec->pi32Last, 0, sizeof(psCodec->pi32Last));
+    psCodec->bKey = true;
+}
+
+//*****************************************************************************
+//
+// Encodes the start of a session, returns its length.
+//
+//*****************************************************************************
+uint32_t
+FlightLogEncodeSession(uint32_t ui32Session, uint32_t ui32PeriodUs,
+                       uint8_t *pui8Out)
+{
+    uint32_t ui32Length = 0;
+
+    pui8Out[ui32Length++] = FLIGHT_LOG_TAG_SESSION;
+    ui32Length += VarintPut((int32_t)ui32Session, pui8Out + ui32Length);
+    ui32Length += VarintPut((int32_t)ui32PeriodUs, pui8Out + ui32Length);
+    return ui32Length;
+}
+
+//*****************************************************************************
+//
+// Encodes a keyframe or a delta record of the quantized fields into at most
+// FLIGHT_LOG_MAX_RECORD bytes, returns its length.
+//
+//*****************************************************************************
+uint32_t
+FlightLogEncode(tFlightLogCodec *psCodec, const int32_t *pi32Fields,
+                uint8_t *pui8Out)
+{
+    uint32_t ui32Length;
+    uint32_t ui32Mask = 0;
+    int i;
+
+    if (psCodec->bKey)
+    {
+        pui8Out[0] = FLIGHT_LOG_TAG_KEY;
+        ui32Length = 1;
+        for (i = 0; i < FLIGHT_LOG_FIELDS; i++)
+        {
+            ui32Length += VarintPut(pi32Fields[i], pui8Out + ui32Length);
+        }
+    }
+    else
+    {
+        pui8Out[0] = FLIGHT_LOG_TAG_DELTA;
+        ui32Length = 4;
+        for (i = 0; i < FLIGHT_LOG_FIELDS; i++)
+        {
+            int32_t i32Delta = pi32Fields[i] - psCodec->pi32Last[i];
+            if (i32Delta != 0)
+            {
+                ui32Mask |= 1 << i;
+                ui32Length += VarintPut(i32Delta, pui8Out + ui32Length);
+            }
+        }
+        pui8Out[1] = (uint8_t)ui32Mask;
+        pui8Out[2] = (uint8_t)(ui32Mask >> 8);
+        pui8Out[3] = (uint8_t)(ui32Mask >> 16);
+    }
+
+    memcpy(psCodec->pi32Last, pi32Fields, sizeof(psCodec->pi32Last));
+    psCodec->bKey = false;
+    return ui32Length;
+}
+
+//*****************************************************************************
+//
+// Appends a record to a page that holds *pui32Fill bytes. The first record
+// of a page is a keyframe, and so is the first after FlightLogCodecInit(),
+// which follows a session record. If the record does not fit, pads the rest
+// of the page and returns false; the record then goes to the next page.
+//
+//*****************************************************************************
+bool
+FlightLogPageAdd(tFlightLogCodec *psCodec, uint8_t *pui8Page,
+                 uint32_t *pui32Fill, const int32_t *pi32Fields)
+{
+    uint8_t pui8Record[FLIGHT_LOG_MAX_RECORD];
+    tFlightLogCodec sLast;
+    uint32_t ui32Length;
+
+    if (*pui32Fill == 0)
+    {
+        psCodec->bKey = true;
+    }
+    sLast = *psCodec;
+    ui32Length = FlightLogEncode(psCodec, pi32Fields, pui8Record);
+
+    if (*pui32Fill + ui32Length > FLIGHT_LOG_PAGE)
+    {
+        *psCodec = sLast;
+        memset(pui8Page + *pui32Fill, FLIGHT_LOG_TAG_PAD,
+               FLIGHT_LOG_PAGE - *pui32Fill);
+        *pui32Fill = FLIGHT_LOG_PAGE;
+        return false;
+    }
+
+    memcpy(pui8Page + *pui32Fill, pui8Record, ui32Length);
+    *pui32Fill += ui32Length;
+    return true;
+}
+
+//*****************************************************************************
+//
+// Decodes the record at pui8In. Returns its length, 0 at the end of the page
+// or of the log (tag PAD or ERASED), or -1 if the record is damaged. The
+// fields of a session record are the session number and the period in us.
+//
+//*****************************************************************************
+int32_t
+FlightLogDecode(tFlightLogCodec *psCodec, const uint8_t *pui8In,
+                uint32_t ui32Length, uint8_t *pui8Tag, int32_t *pi32Fields)
+{
+    uint32_t ui32Pos = 1;
+    uint32_t ui32Used;
+    uint32_t ui32Mask;
+    int i;
+
+    if (ui32Length == 0)
+    {
+        return 0;
+    }
+    *pui8Tag = pui8In[0];
+
+    switch (*pui8Tag)
+    {
+    case FLIGHT_LOG_TAG_PAD:
+    case FLIGHT_LOG_TAG_ERASED:
+        return 0;
+
+    case FLIGHT_LOG_TAG_SESSION:
+        for (i = 0; i < 2; i++)
+        {
+            ui32Used = VarintGet(pui8In + ui32Pos, ui32Length - ui32Pos,
+                                 &pi32Fields[i]);
+            if (!ui32Used)
+            {
+                return -1;
+            }
+            ui32Pos += ui32Used;
+        }
+        return ui32Pos;
+
+    case FLIGHT_LOG_TAG_KEY:
+        for (i = 0; i < FLIGHT_LOG_FIELDS; i++)
+        {
+            ui32Used = VarintGet(pui8In + ui32Pos, ui32Length - ui32Pos,
+                                 &pi32Fields[i]);
+            if (!ui32Used)
+            {
+                return -1;
+            }
+            ui32Pos += ui32Used;
+        }
+        break;
+
+    case FLIGHT_LOG_TAG_DELTA:
+        if (ui32Length < 4)
+        {
+            return -1;
+        }
+        ui32Mask = pui8In[1] | (pui8In[2] << 8) | (pui8In[3] << 16);
+        ui32Pos = 4;
+        for (i = 0; i < FLIGHT_LOG_FIELDS; i++)
+        {
+            pi32Fields[i] = psCodec->pi32Last[i];
+            if (ui32Mask & (1 << i))
+            {
+                int32_t i32Delta;
+
+                ui32Used = VarintGet(pui8In + ui32Pos, ui32Length - ui32Pos,
+                                     &i32Delta);
+                if (!ui32Used)
+                {
+                    return -1;
+                }
+                pi32Fields[i] += i32Delta;
+                ui32Pos += ui32Used;
+            }
+        }
+        break;
+
+    default:
+        return -1;
+    }
+
+    memcpy(psCodec->pi32Last, pi32Fields, sizeof(psCodec->pi32Last));
+    return ui32Pos;
+}
@@ -0,0 +1,171 @@
+//*****************************************************************************
+//
+// flight_log.h - Compact binary format of the flight recorder.
+//
+//*****************************************************************************
+
+#ifndef _FLIGHT_LOG_H_
+#define _FLIGHT_LOG_H_
+
+//*****************************************************************************
+//
+// If building with a C++ compiler, make all of the definitions in this header
+// have a C binding.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//*****************************************************************************
+//
+// The log is written in pages of the size of a flash erase sector. Every
+// page starts with a keyframe, so a page decodes on its own.
+//
+//*****************************************************************************
+#define FLIGHT_LOG_PAGE             1024
+
+//*****************************************************************************
+//
+// Record tags, the first byte of every record.
+//
+// - PAD: the rest of the page is unused.
+// - SESSION: start of a recording, followed by the session number and the
+//   sample period in us as varints.
+// - KEY: all fields, absolute.
+// - DELTA: a 24 bit little-endian mask of the fields that changed since the
+//   last record, then their differences for the set bits.
+// - ERASED: the byte of erased flash, the end of the log.
+//
+// Values are zigzag encoded varints of 7 bits per byte, least significant
+// group first.
+//
+//*****************************************************************************
+#define FLIGHT_LOG_TAG_PAD          0x00
+#define FLIGHT_LOG_TAG_SESSION      0x53
+#define FLIGHT_LOG_TAG_KEY          0x4b
+#define FLIGHT_LOG_TAG_DELTA        0x44
+#define FLIGHT_LOG_TAG_ERASED       0xff
+
+//*****************************************************************************
+//
+// Fields of a record, quantized to integers of 10^-exponent of the unit, see
+// g_pi8FlightLogExponent.
+//
+//*****************************************************************************
+#define FLIGHT_LOG_TICK             0   // main loop iterations
+#define FLIGHT_LOG_LOOP_CYCLES      1   // CPU cycles since the last iteration
+#define FLIGHT_LOG_CTRL_CYCLES      2   // CPU cycles of ControllerUpdate()
+#define FLIGHT_LOG_GYRO             3   // 3 fields, rad/s
+#define FLIGHT_LOG_ACCEL            6   // 3 fields, m/s^2
+#define FLIGHT_LOG_EULER            9   // 3 fields, rad
+#define FLIGHT_LOG_DES_STATE        12  // 3 fields, rad
+#define FLIGHT_LOG_THRUST           15  // omega^2 fraction
+#define FLIGHT_LOG_OMEGA_SQ         16  // 4 fields, rad^2/s^2
+#define FLIGHT_LOG_BATTERY          20  // V
+#define FLIGHT_LOG_FLAGS            21  // see BlackBoxRecord() in main.c
+#define FLIGHT_LOG_FIELDS           22
+
+//*****************************************************************************
+//
+// Longest record: a keyframe of 5 byte varints.
+//
+//*****************************************************************************
+#define FLIGHT_LOG_MAX_RECORD       (1 + 5 * FLIGHT_LOG_FIELDS)
+
+//*****************************************************************************
+//
+// One sample of the main loop.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // Main loop iteration, the cycles since the previous one and the cycles
+    // of the controller update.
+    //
+    uint32_t ui32Tick;
+    uint32_t ui32LoopCycles;
+    uint32_t ui32CtrlCycles;
+
+    //
+    // Sensor samples: bias free gyro in rad/s, accelerometer in m/s^2.
+    //
+    float pfGyro[3];
+    float pfAccel[3];
+
+    //
+    // Estimated and desired Euler angles in rad.
+    //
+    float pfEuler[3];
+    float pfDesState[3];
+
+    //
+    // Desired thrust and the motor commands in omega^2.
+    //
+    float fThrustZDir;
+    float pfOmegaSq[4];
+
+    //
+    // Battery voltage and the status flags.
+    //
+    float fBatteryV;
+    uint32_t ui32Flags;
+}
+tFlightLogSample;
+
+//*****************************************************************************
+//
+// Encoder and decoder state, the fields of the last record and whether the
+// encoder writes a keyframe next.
+//
+//*****************************************************************************
+typedef struct
+{
+    int32_t pi32Last[FLIGHT_LOG_FIELDS];
+    bool bKey;
+}
+tFlightLogCodec;
+
+//*****************************************************************************
+//
+// Decimal exponent of every field.
+//
+//*****************************************************************************
+extern const int8_t g_pi8FlightLogExponent[FLIGHT_LOG_FIELDS];
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern void FlightLogQuantize(const tFlightLogSample *psSample,
+                              int32_t *pi32Fields);
+extern void FlightLogDequantize(const int32_t *pi32Fields,
+                                tFlightLogSample *psSample);
+extern void FlightLogCodecInit(tFlightLogCodec *psCodec);
+extern uint32_t FlightLogEncodeSession(uint32_t ui32Session,
+                                       uint32_t ui32PeriodUs,
+                                       uint8_t *pui8Out);
+extern uint32_t FlightLogEncode(tFlightLogCodec *psCodec,
+                                const int32_t *pi32Fields, uint8_t *pui8Out);
+extern bool FlightLogPageAdd(tFlightLogCodec *psCodec, uint8_t *pui8Page,
+                             uint32_t *pui32Fill, const int32_t *pi32Fields);
+extern int32_t FlightLogDecode(tFlightLogCodec *psCodec,
+                               const uint8_t *pui8In, uint32_t ui32Length,
+                               uint8_t *pui8Tag, int32_t *pi32Fields);
+
+//*****************************************************************************
+//
+// Mark the end of the C bindings section for C++ compilers.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _FLIGHT_LOG_H_
@@ -0,0 +1,400 @@
+//*****************************************************************************
+//
+// gyro_fft.c - Incremental spectrum analysis of the gyro for vibration peaks.
+//
+// The gyro samples of roll and pitch are kept in a ring. An analysis removes
+// the mean, applies a Hann window and runs an in-place radix-2 FFT, adds the
+// power spectra of both axes to a moving average and searches its strongest
+// peaks in a band.
+//
+// The work is split into steps of bounded length, GyroFFTUpdate() runs one
+// of them per control loop iteration: for every axis one copy, one step per
+// butterfly stage and one power step, then the peak search. With 128 points
+// and the idle step that is 20 iterations per analysis.
+//
+// The module uses no TivaWare headers so the same code runs over recorded
+// logs on the host, see simul/gyro_fft/gyro_fft_host.c.
+//
+//*****************************************************************************
+
+#include <math.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "gyro_fft.h"
+
+//*****************************************************************************
+//
+// If M_PI has not been defined by the system headers, define it here.
+//
+//*****************************************************************************
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+//*****************************************************************************
+//
+// Default peak detection, see tGyroFFT.
+//
+//*****************************************************************************
+#define GYRO_FFT_THRESHOLD      4.0f // peak power over the band mean
+#define GYRO_FFT_AVERAGING      0.25f
+#define GYRO_FFT_SMOOTHING      0.5f
+
+//*****************************************************************************
+//
+// Reverses the GYRO_FFT_LOG2_SIZE low bits of an index.
+//
+//*****************************************************************************
+static uint16_t
+BitReverse(uint16_t ui16Index)
+{
+    uint16_t ui16Result = 0;
+    int i;
+    for (i = 0; i < GYRO_FFT_LOG2_SIZE; i++)
+    {
+        ui16Result = (ui16Result << 1) | (ui16Index & 1);
+        ui16Index >>= 1;
+    }
+    return ui16Result;
+}
+
+//*****************************************************************************
+//
+// Copies the ring of one axis into the work buffer, in chronological and
+// bit reversed order, without its mean and windowed.
+//
+//*****************************************************************************
+static void
+GyroFFTCopy(tGyroFFT *psFFT)
+{
+    float *pfRing = psFFT->ppfRing[psFFT->ui8Axis];
+    float fMean = 0.0f;
+    int i;
+
+    for (i = 0; i < GYRO_FFT_SIZE; i++)
+    {
+        fMean += pfRing[i];
+    }
+    fMean /= GYRO_FFT_SIZE;
+
+    //
+    // The oldest sample is the one that is overwritten next.
+    //
+    uint16_t ui16Index = psFFT->ui16RingIndex;
+    for (i = 0; i < GYRO_FFT_SIZE; i++)
+    {
+        uint16_t ui16Rev = BitReverse(i);
+        psFFT->pfRe[ui16Rev] = (pfRing[ui16Index] - fMean) *
+                psFFT->pfWindow[i];
+        psFFT->pfIm[ui16Rev] = 0.0f;
+        ui16Index = (ui16Index + 1) % GYRO_FFT_SIZE;
+    }
+}
+
+//*****************************************************************************
+//
+// Runs the radix-2 decimation in time stage ui8Stage on the work buffer.
+//
+//*****************************************************************************
+static void
+GyroFFTButterfly(tGyroFFT *psFFT, uint8_t ui8Stage)
+{
+    int iHalf = 1 << ui8Stage;
+    int iTwiddleStep = GYRO_FFT_SIZE / (2 * iHalf);
+    int i, j;
+
+    for (i = 0; i < GYRO_FFT_SIZE; i += 2 * iHalf)
+    {
+        for (j = 0; j < iHalf; j++)
+        {
+            float fWr = psFFT->pfCos[j * iTwiddleStep];
+            float fWi = -psFFT->pfSin[j * iTwiddleStep];
+            int iTop = i + j;
+            int iBottom = iTop + iHalf;
+
+            float fTr = fWr * psFFT->pfRe[iBottom] - fWi * psFFT->pfIm[iBottom];
+            float fTi = fWr * psFFT->pfIm[iBottom] + fWi * psFFT->pfRe[iBottom];
+
+            psFFT->pfRe[iBottom] = psFFT->pfRe[iTop] - fTr;
+            psFFT->pfIm[iBottom] = psFFT->pfIm[iTop] - fTi;
+            psFFT->pfRe[iTop] += fTr;
+            psFFT->pfIm[iTop] += fTi;
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// Stores a peak frequency in the slot of the nearest tracked peak, or in an
+// empty slot if it is closer to none of them than the width of the band.
+//
+//*****************************************************************************
+static void
+GyroFFTTrackPeak(tGyroFFT *psFFT, float fHz)
+{
+    int iSlot = 0;
+    float fBest = 0.0f;
+    int i;
+
+    for (i = 0; i < GYRO_FFT_MAX_PEAKS; i++)
+    {
+        float fDistance = (psFFT->pfPeakHz[i] > 0.0f) ?
+                fabsf(psFFT->pfPeakHz[i] - fHz) :
+                (psFFT->fMaxHz - psFFT->fMinHz);
+        if ((i == 0) || (fDistance < fBest))
+        {
+            fBest = fDistance;
+            iSlot = i;
+        }
+    }
+
+    if (psFFT->pfPeakHz[iSlot] > 0.0f)
+    {
+        psFFT->pfPeakHz[iSlot] += psFFT->fSmoothing *
+                (fHz - psFFT->pfPeakHz[iSlot]);
+    }
+    else
+    {
+        psFFT->pfPeakHz[iSlot] = fHz;
+    }
+}
+
+//*****************************************************************************
+//
+// Searches the strongest local maxima of the spectrum in the band and
+// updates the tracked peaks.
+//
+//*****************************************************************************
+static void
+GyroFFTPeaks(tGyroFFT *psFFT)
+{
+    float fBinHz = psFFT->fSampleRate / GYRO_FFT_SIZE;
+    int iMin = (int)ceilf(psFFT->fMinHz / fBinHz);
+    int iMax = (int)(psFFT->fMaxHz / fBinHz);
+    float *pfP = psFFT->pfSpectrum;
+    int i, j;
+
+    if (iMin < 1)
+    {
+        iMin = 1;
+    }
+    if (iMax > GYRO_FFT_BINS - 2)
+    {
+        iMax = GYRO_FFT_BINS - 2;
+    }
+    if (iMax < iMin)
+    {
+        return;
+    }
+
+    float fMean = 0.0f;
+    for (i = iMin; i <= iMax; i++)
+    {
+        fMean += pfP[i];
+    }
+    fMean /= (iMax - iMin + 1);
+
+    //
+    // The strongest maxima over the threshold, by descending power.
+    //
+    int piBins[GYRO_FFT_MAX_PEAKS];
+    int iCount = 0;
+    for (i = iMin; i <= iMax; i++)
+    {
+        if ((pfP[i] <= psFFT->fThreshold * fMean) || (pfP[i] <= pfP[i - 1]) ||
+            (pfP[i] < pfP[i + 1]))
+        {
+            continue;
+        }
+
+        for (j = iCount; (j > 0) && (pfP[piBins[j - 1]] < pfP[i]); j--)
+        {
+            if (j < GYRO_FFT_MAX_PEAKS)
+            {
+                piBins[j] = piBins[j - 1];
+            }
+        }
+        if (j < GYRO_FFT_MAX_PEAKS)
+        {
+            piBins[j] = i;
+            if (iCount < GYRO_FFT_MAX_PEAKS)
+            {
+                iCount++;
+            }
+        }
+    }
+
+    //
+    // Parabolic interpolation between the bins around every maximum.
+    //
+    for (i = 0; i < iCount; i++)
+    {
+        int k = piBins[i];
+        float fDen = pfP[k - 1] - 2.0f * pfP[k] + pfP[k + 1];
+        float fOffset = (fDen < 0.0f) ?
+                0.5f * (pfP[k - 1] - pfP[k + 1]) / fDen : 0.0f;
+        GyroFFTTrackPeak(psFFT, ((float)k + fOffset) * fBinHz);
+    }
+
+    //
+    // Keep the tracked peaks ascending with the empty slots last.
+    //
+    for (i = 1; i < GYRO_FFT_MAX_PEAKS; i++)
+    {
+        float fHz = psFFT->pfPeakHz[i];
+        for (j = i; (j > 0) && (fHz > 0.0f) &&
+             ((psFFT->pfPeakHz[j - 1] == 0.0f) ||
+              (psFFT->pfPeakHz[j - 1] > fHz)); j--)
+        {
+            psFFT->pfPeakHz[j] = psFFT->pfPeakHz[j - 1];
+        }
+        psFFT->pfPeakHz[j] = fHz;
+    }
+}
+
+//*****************************************************************************
+//
+// Initializes the analyser for the given sample rate and searched band.
+//
+//*****************************************************************************
+void
+GyroFFTInit(tGyroFFT *psFFT, float fSampleRate, float fMinHz, float fMaxHz)
+{
+    int i, j;
+
+    for (i = 0; i < GYRO_FFT_SIZE; i++)
+    {
+        psFFT->pfWindow[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i /
+                                                 GYRO_FFT_SIZE);
+        for (j = 0; j < GYRO_FFT_AXES; j++)
+        {
+            psFFT->ppfRing[j][i] = 0.0f;
+        }
+    }
+    for (i = 0; i < GYRO_FFT_SIZE / 2; i++)
+    {
+        psFFT->pfCos[i] = cosf(2.0f * (float)M_PI * i / GYRO_FFT_SIZE);
+        psFFT->pfSin[i] = sinf(2.0f * (float)M_PI * i / GYRO_FFT_SIZE);
+    }
+    for (i = 0; i < GYRO_FFT_BINS; i++)
+    {
+        psFFT->pfPower[i] = 0.0f;
+        psFFT->pfSpectrum[i] = 0.0f;
+    }
+    for (i = 0; i < GYRO_FFT_MAX_PEAKS; i++)
+    {
+        psFFT->pfPeakHz[i] = 0.0f;
+    }
+
+    psFFT->ui16RingIndex = 0;
+    psFFT->ui16RingCount = 0;
+    psFFT->ui8State = GYRO_FFT_STATE_IDLE;
+    psFFT->ui8Axis = 0;
+    psFFT->ui8Stage = 0;
+    psFFT->fSampleRate = fSampleRate;
+    psFFT->fMinHz = fMinHz;
+    psFFT->fMaxHz = fMaxHz;
+    psFFT->fThreshold = GYRO_FFT_THRESHOLD;
+    psFFT->fAveraging = GYRO_FFT_AVERAGING;
+    psFFT->fSmoothing = GYRO_FFT_SMOOTHING;
+    psFFT->ui32Count = 0;
+}
+
+//*****************************************************************************
+//
+// Adds a gyro sample (rad/s, body axes) to the ring.
+//
+//*****************************************************************************
+void
+GyroFFTAddSample(tGyroFFT *psFFT, const float pfGyro[3])
+{
+    int i;
+    for (i = 0; i < GYRO_FFT_AXES; i++)
+    {
+        psFFT->ppfRing[i][psFFT->ui16RingIndex] = pfGyro[i];
+    }
+
+    psFFT->ui16RingIndex = (psFFT->ui16RingIndex + 1) % GYRO_FFT_SIZE;
+    if (psFFT->ui16RingCount < GYRO_FFT_SIZE)
+    {
+        psFFT->ui16RingCount++;
+    }
+}
+
+//*****************************************************************************
+//
+// Runs the next step of the analysis. Returns true when an analysis was
+// completed and pfSpectrum and pfPeakHz were updated.
+//
+//*****************************************************************************
+bool
+GyroFFTUpdate(tGyroFFT *psFFT)
+{
+    int i;
+
+    switch (psFFT->ui8State)
+    {
+    case GYRO_FFT_STATE_IDLE:
+        if (psFFT->ui16RingCount == GYRO_FFT_SIZE)
+        {
+            psFFT->ui8Axis = 0;
+            psFFT->ui8State = GYRO_FFT_STATE_COPY;
+        }
+        break;
+
+    case GYRO_FFT_STATE_COPY:
+        GyroFFTCopy(psFFT);
+        psFFT->ui8Stage = 0;
+        psFFT->ui8State = GYRO_FFT_STATE_BUTTERFLY;
+        break;
+
+    case GYRO_FFT_STATE_BUTTERFLY:
+        GyroFFTButterfly(psFFT, psFFT->ui8Stage);
+        if (++psFFT->ui8Stage >= GYRO_FFT_LOG2_SIZE)
+        {
+            psFFT->ui8State = GYRO_FFT_STATE_POWER;
+        }
+        break;
+
+    case GYRO_FFT_STATE_POWER:
+        for (i = 0; i < GYRO_FFT_BINS; i++)
+        {
+            psFFT->pfPower[i] += psFFT->pfRe[i] * psFFT->pfRe[i] +
+                    psFFT->pfIm[i] * psFFT->pfIm[i];
+        }
+        if (++psFFT->ui8Axis < GYRO_FFT_AXES)
+        {
+            psFFT->ui8State = GYRO_FFT_STATE_COPY;
+        }
+        else
+        {
+            psFFT->ui8State = GYRO_FFT_STATE_PEAKS;
+        }
+        break;
+
+    case GYRO_FFT_STATE_PEAKS:
+    default:
+        //
+        // The average keeps single noisy spectra from producing peaks.
+        //
+        for (i = 0; i < GYRO_FFT_BINS; i++)
+        {
+            if (psFFT->ui32Count == 0)
+            {
+                psFFT->pfSpectrum[i] = psFFT->pfPower[i];
+            }
+            else
+            {
+                psFFT->pfSpectrum[i] += psFFT->fAveraging *
+                        (psFFT->pfPower[i] - psFFT->pfSpectrum[i]);
+            }
+            psFFT->pfPower[i] = 0.0f;
+        }
+        GyroFFTPeaks(psFFT);
+        psFFT->ui32Count++;
+        psFFT->ui8State = GYRO_FFT_STATE_IDLE;
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,136 @@
+//*****************************************************************************
+//
+// gyro_fft.h - Incremental spectrum analysis of the gyro for vibration peaks.
+//
+//*****************************************************************************
+
+#ifndef _GYRO_FFT_H_
+#define _GYRO_FFT_H_
+
+//*****************************************************************************
+//
+// If building with a C++ compiler, make all of the definitions in this header
+// have a C binding.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//*****************************************************************************
+//
+// Transform size, number of frequency bins and number of analysed axes. Roll
+// and pitch are analysed, the yaw rate carries little of the frame
+// vibration.
+//
+//*****************************************************************************
+#define GYRO_FFT_SIZE               128
+#define GYRO_FFT_LOG2_SIZE          7
+#define GYRO_FFT_BINS               (GYRO_FFT_SIZE / 2)
+#define GYRO_FFT_AXES               2
+
+//*****************************************************************************
+//
+// Maximum number of tracked peaks.
+//
+//*****************************************************************************
+#define GYRO_FFT_MAX_PEAKS          2
+
+//*****************************************************************************
+//
+// Steps of the analysis, one is run per call of GyroFFTUpdate().
+//
+//*****************************************************************************
+#define GYRO_FFT_STATE_IDLE         0 // waiting for a full ring
+#define GYRO_FFT_STATE_COPY         1 // window and bit reverse one axis
+#define GYRO_FFT_STATE_BUTTERFLY    2 // one radix-2 stage
+#define GYRO_FFT_STATE_POWER        3 // add the power spectrum of the axis
+#define GYRO_FFT_STATE_PEAKS        4 // peak search
+
+//*****************************************************************************
+//
+// Analyser state.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // The last GYRO_FFT_SIZE samples of every analysed axis.
+    //
+    float ppfRing[GYRO_FFT_AXES][GYRO_FFT_SIZE];
+    uint16_t ui16RingIndex;
+    uint16_t ui16RingCount;
+
+    //
+    // Hann window and twiddle factors, computed once.
+    //
+    float pfWindow[GYRO_FFT_SIZE];
+    float pfCos[GYRO_FFT_SIZE / 2];
+    float pfSin[GYRO_FFT_SIZE / 2];
+
+    //
+    // Transform in progress.
+    //
+    float pfRe[GYRO_FFT_SIZE];
+    float pfIm[GYRO_FFT_SIZE];
+    uint8_t ui8State;
+    uint8_t ui8Axis;
+    uint8_t ui8Stage;
+
+    //
+    // Power spectrum summed over the axes being accumulated, and the moving
+    // average of the completed ones that is searched for peaks.
+    //
+    float pfPower[GYRO_FFT_BINS];
+    float pfSpectrum[GYRO_FFT_BINS];
+
+    //
+    // Configuration: sample rate and searched band in Hz, the power a peak
+    // needs relative to the mean of the band, and the weights of a new
+    // spectrum in the average and of a new peak frequency in the tracked
+    // one.
+    //
+    float fSampleRate;
+    float fMinHz;
+    float fMaxHz;
+    float fThreshold;
+    float fAveraging;
+    float fSmoothing;
+
+    //
+    // Smoothed peak frequencies in Hz, ascending. 0 means no peak was found
+    // yet.
+    //
+    float pfPeakHz[GYRO_FFT_MAX_PEAKS];
+
+    //
+    // Number of completed analyses.
+    //
+    uint32_t ui32Count;
+}
+tGyroFFT;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern void GyroFFTInit(tGyroFFT *psFFT, float fSampleRate, float fMinHz,
+                        float fMaxHz);
+extern void GyroFFTAddSample(tGyroFFT *psFFT, const float pfGyro[3]);
+extern bool GyroFFTUpdate(tGyroFFT *psFFT);
+
+//*****************************************************************************
+//
+// Mark the end of the C bindings section for C++ compilers.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _GYRO_FFT_H_
@@ -0,0 +1,342 @@
+//*****************************************************************************
+//
+// gyro_temp.c - Temperature model of the gyro bias, fitted while stationary.
+//
+// The MEMS gyro bias moves with the die temperature, which rises by tens of
+// degrees while the board warms up during a flight. The boot calibration
+// only holds at the temperature it was taken at, so the bias is modelled as
+// a piecewise linear function of the temperature with a node every
+// GYRO_TEMP_STEP_C.
+//
+// Whenever the board rests for a second (no rotation noise and 1 g on the
+// accelerometer) the mean gyro of that second is a measurement of the bias
+// at the mean temperature. It is blended into the two neighbouring nodes,
+// weighted by the interpolation weights and with a gain that drops as the
+// nodes collect measurements. Nodes that were never fitted follow the
+// nearest fitted one.
+//
+// The module uses no TivaWare headers.
+//
+//*****************************************************************************
+
+#include <math.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "gyro_temp.h"
+
+//*****************************************************************************
+//
+// Stationary detection. A window of GYRO_TEMP_WINDOW samples is fitted if
+// every sample is within GYRO_TEMP_STILL_RATE of the model and
+// GYRO_TEMP_STILL_ACCEL of 1 g, and the standard deviation of every gyro axis
+// over the window is below GYRO_TEMP_STILL_NOISE. The fitted bias may move
+// by at most GYRO_TEMP_MAX_STEP per window, so a slow steady rotation is not
+// taken for bias.
+//
+//*****************************************************************************
+#define GYRO_TEMP_WINDOW        250         // 1 s at 250 Hz
+#define GYRO_TEMP_STILL_RATE    0.1f        // rad/s
+#define GYRO_TEMP_STILL_ACCEL   0.5f        // m/s^2
+#define GYRO_TEMP_STILL_NOISE   0.005f      // rad/s
+#define GYRO_TEMP_MAX_STEP      0.035f      // rad/s
+#define GYRO_TEMP_GRAVITY       9.81f
+
+//*****************************************************************************
+//
+// Lowest weight of a new measurement in a node, so the model keeps following
+// a sensor that ages.
+//
+//*****************************************************************************
+#define GYRO_TEMP_MIN_GAIN      0.05f
+
+//*****************************************************************************
+//
+// Finds the node below fTemperature and the interpolation weight of the node
+// above it.
+//
+//*****************************************************************************
+static void
+GyroTempNodes(float fTemperature, int *piNode, float *pfFrac)
+{
+    float fPos = (fTemperature - GYRO_TEMP_MIN_C) / GYRO_TEMP_STEP_C;
+
+    if (!(fPos > 0.0f))
+    {
+        *piNode = 0;
+        *pfFrac = 0.0f;
+    }
+    else if (fPos >= (float)(GYRO_TEMP_POINTS - 1))
+    {
+        *piNode = GYRO_TEMP_POINTS - 2;
+        *pfFrac = 1.0f;
+    }
+    else
+    {
+        *piNode = (int)fPos;
+        *pfFrac = fPos - (float)*piNode;
+    }
+}
+
+//*****************************************************************************
+//
+// Interpolates the modelled bias at fTemperature.
+//
+//*****************************************************************************
+static void
+GyroTempBiasGet(tGyroTemp *psModel, float fTemperature, float pfBias[3])
+{
+    int iNode, i;
+    float fFrac;
+
+    GyroTempNodes(fTemperature, &iNode, &fFrac);
+    for (i = 0; i < 3; i++)
+    {
+        pfBias[i] = psModel->ppfBias[iNode][i] + fFrac *
+                (psModel->ppfBias[iNode + 1][i] - psModel->ppfBias[iNode][i]);
+    }
+}
+
+//*****************************************************************************
+//
+// Blends a bias measurement at fTemperature into the model.
+//
+//*****************************************************************************
+static void
+GyroTempFit(tGyroTemp *psModel, float fTemperature, const float pfBias[3])
+{
+    float pfPredicted[3], pfWeight[2];
+    int iNode, i, j;
+    float fFrac;
+
+    GyroTempBiasGet(psModel, fTemperature, pfPredicted);
+    GyroTempNodes(fTemperature, &iNode, &fFrac);
+    pfWeight[0] = 1.0f - fFrac;
+    pfWeight[1] = fFrac;
+
+    for (j = 0; j < 2; j++)
+    {
+        if (pfWeight[j] <= 0.0f)
+        {
+            continue;
+        }
+
+        float fGain = 1.0f / (psModel->pfCount[iNode + j] + 1.0f);
+        if (fGain < GYRO_TEMP_MIN_GAIN)
+        {
+            fGain = GYRO_TEMP_MIN_GAIN;
+        }
+        for (i = 0; i < 3; i++)
+        {
+            psModel->ppfBias[iNode + j][i] += fGain * pfWeight[j] *
+                    (pfBias[i] - pfPredicted[i]);
+        }
+        psModel->pfCount[iNode + j] += pfWeight[j];
+    }
+
+    //
+    // Nodes without measurements take the value of the nearest fitted node,
+    // the nodes below it first.
+    //
+    for (j = 0; j < GYRO_TEMP_POINTS; j++)
+    {
+        if (psModel->pfCount[j] > 0.0f)
+        {
+            continue;
+        }
+
+        int iNearest = -1;
+        int iDistance;
+        for (iDistance = 1; iDistance < GYRO_TEMP_POINTS; iDistance++)
+        {
+            if ((j - iDistance >= 0) &&
+                (psModel->pfCount[j - iDistance] > 0.0f))
+            {
+                iNearest = j - iDistance;
+                break;
+            }
+            if ((j + iDistance < GYRO_TEMP_POINTS) &&
+                (psModel->pfCount[j + iDistance] > 0.0f))
+            {
+                iNearest = j + iDistance;
+                break;
+            }
+        }
+        if (iNearest >= 0)
+        {
+            for (i = 0; i < 3; i++)
+            {
+                psModel->ppfBias[j][i] = psModel->ppfBias[iNearest][i];
+            }
+        }
+    }
+
+    psModel->ui32Fits++;
+}
+
+//*****************************************************************************
+//
+// Initializes an empty model with zero bias.
+//
+//*****************************************************************************
+void
+GyroTempInit(tGyroTemp *psModel)
+{
+    int i, j;
+    for (j = 0; j < GYRO_TEMP_POINTS; j++)
+    {
+        for (i = 0; i < 3; i++)
+        {
+            psModel->ppfBias[j][i] = 0.0f;
+        }
+        psModel->pfCount[j] = 0.0f;
+    }
+
+    for (i = 0; i < 3; i++)
+    {
+        psModel->pfBase[i] = 0.0f;
+        psModel->pfGyroSum[i] = 0.0f;
+        psModel->pfGyroSqSum[i] = 0.0f;
+    }
+    psModel->ui16Samples = 0;
+    psModel->fTempSum = 0.0f;
+    psModel->ui32Fits = 0;
+}
+
+//*****************************************************************************
+//
+// Sets the bias that the sensor driver removes, measured by the boot
+// calibration at fTemperature. The calibration is also the first fit of the
+// model, nodes that were never fitted start from it.
+//
+//*****************************************************************************
+void
+GyroTempBaseSet(tGyroTemp *psModel, float fTemperature, const float pfBias[3])
+{
+    int i, j;
+    for (j = 0; j < GYRO_TEMP_POINTS; j++)
+    {
+        if (psModel->pfCount[j] > 0.0f)
+        {
+            continue;
+        }
+        for (i = 0; i < 3; i++)
+        {
+            psModel->ppfBias[j][i] = pfBias[i];
+        }
+    }
+
+    for (i = 0; i < 3; i++)
+    {
+        psModel->pfBase[i] = pfBias[i];
+    }
+
+    GyroTempFit(psModel, fTemperature, pfBias);
+}
+
+//*****************************************************************************
+//
+// Returns the bias at fTemperature that is left in the samples after the
+// driver removed the boot calibration.
+//
+//*****************************************************************************
+void
+GyroTempCorrectionGet(tGyroTemp *psModel, float fTemperature, float pfBias[3])
+{
+    int i;
+
+    GyroTempBiasGet(psModel, fTemperature, pfBias);
+    for (i = 0; i < 3; i++)
+    {
+        pfBias[i] -= psModel->pfBase[i];
+    }
+}
+
+//*****************************************************************************
+//
+// Adds a sample to the stationary window. pfGyro is the gyro in rad/s with
+// the boot calibration removed, pfAccel the accelerometer in m/s^2. Returns
+// true when a completed window was fitted into the model.
+//
+//*****************************************************************************
+bool
+GyroTempUpdate(tGyroTemp *psModel, const float pfGyro[3],
+               const float pfAccel[3], float fTemperature)
+{
+    float pfCorrection[3];
+    int i;
+
+    //
+    // Any rotation or acceleration restarts the window.
+    //
+    float fAccel = sqrtf(pfAccel[0] * pfAccel[0] + pfAccel[1] * pfAccel[1] +
+                         pfAccel[2] * pfAccel[2]);
+    bool bStill = fabsf(fAccel - GYRO_TEMP_GRAVITY) < GYRO_TEMP_STILL_ACCEL;
+
+    GyroTempCorrectionGet(psModel, fTemperature, pfCorrection);
+    for (i = 0; i < 3; i++)
+    {
+        if (!(fabsf(pfGyro[i] - pfCorrection[i]) < GYRO_TEMP_STILL_RATE))
+        {
+            bStill = false;
+        }
+    }
+
+    if (!bStill)
+    {
+        psModel->ui16Samples = 0;
+        return false;
+    }
+
+    //
+    // The window keeps the sums and the sums of squares of the gyro around
+    // the model, which keeps the variance free of cancellation.
+    //
+    if (psModel->ui16Samples == 0)
+    {
+        for (i = 0; i < 3; i++)
+        {
+            psModel->pfGyroSum[i] = 0.0f;
+            psModel->pfGyroSqSum[i] = 0.0f;
+        }
+        psModel->fTempSum = 0.0f;
+    }
+
+    for (i = 0; i < 3; i++)
+    {
+        float fDelta = pfGyro[i] - pfCorrection[i];
+        psModel->pfGyroSum[i] += fDelta;
+        psModel->pfGyroSqSum[i] += fDelta * fDelta;
+    }
+    psModel->fTempSum += fTemperature;
+
+    if (++psModel->ui16Samples < GYRO_TEMP_WINDOW)
+    {
+        return false;
+    }
+    psModel->ui16Samples = 0;
+
+    //
+    // The window is complete. Fit it if the gyro was quiet and close to the
+    // model.
+    //
+    float fTemp = psModel->fTempSum / GYRO_TEMP_WINDOW;
+    float pfBias[3];
+
+    GyroTempCorrectionGet(psModel, fTemp, pfCorrection);
+    for (i = 0; i < 3; i++)
+    {
+        float fMean = psModel->pfGyroSum[i] / GYRO_TEMP_WINDOW;
+        float fVariance = psModel->pfGyroSqSum[i] / GYRO_TEMP_WINDOW -
+                fMean * fMean;
+
+        if (!(fVariance < GYRO_TEMP_STILL_NOISE * GYRO_TEMP_STILL_NOISE) ||
+            !(fabsf(fMean) < GYRO_TEMP_MAX_STEP))
+        {
+            return false;
+        }
+        pfBias[i] = psModel->pfBase[i] + pfCorrection[i] + fMean;
+    }
+
+    GyroTempFit(psModel, fTemp, pfBias);
+    return true;
+}
@@ -0,0 +1,95 @@
+//*****************************************************************************
+//
+// gyro_temp.h - Temperature model of the gyro bias, fitted while stationary.
+//
+//*****************************************************************************
+
+#ifndef _GYRO_TEMP_H_
+#define _GYRO_TEMP_H_
+
+//*****************************************************************************
+//
+// If building with a C++ compiler, make all of the definitions in this header
+// have a C binding.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//*****************************************************************************
+//
+// Nodes of the bias table, GYRO_TEMP_STEP_C apart from GYRO_TEMP_MIN_C on.
+// The bias is interpolated linearly between the nodes and held constant
+// outside of the table.
+//
+//*****************************************************************************
+#define GYRO_TEMP_POINTS            8
+#define GYRO_TEMP_MIN_C             15.0f
+#define GYRO_TEMP_STEP_C            5.0f
+
+//*****************************************************************************
+//
+// Bias model state.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // Gyro bias in rad/s at every node, and the number of stationary
+    // windows each node was fitted with. A node with a count of 0 holds the
+    // boot calibration.
+    //
+    float ppfBias[GYRO_TEMP_POINTS][3];
+    float pfCount[GYRO_TEMP_POINTS];
+
+    //
+    // Bias in rad/s that is already removed from the samples, by the sensor
+    // driver.
+    //
+    float pfBase[3];
+
+    //
+    // Stationary window in progress: number of samples, sums and sums of
+    // squares of the gyro relative to the model, and sum of the
+    // temperature.
+    //
+    uint16_t ui16Samples;
+    float pfGyroSum[3];
+    float pfGyroSqSum[3];
+    float fTempSum;
+
+    //
+    // Number of completed fits.
+    //
+    uint32_t ui32Fits;
+}
+tGyroTemp;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern void GyroTempInit(tGyroTemp *psModel);
+extern void GyroTempBaseSet(tGyroTemp *psModel, float fTemperature,
+                            const float pfBias[3]);
+extern void GyroTempCorrectionGet(tGyroTemp *psModel, float fTemperature,
+                                  float pfBias[3]);
+extern bool GyroTempUpdate(tGyroTemp *psModel, const float pfGyro[3],
+                           const float pfAccel[3], float fTemperature);
+
+//*****************************************************************************
+//
+// Mark the end of the C bindings section for C++ compilers.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _GYRO_TEMP_H_
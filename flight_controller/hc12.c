@@ -61,5 +61,21 @@ InitHC12UART()
 }
 
 
-
-
+//*****************************************************************************
+//
+// Queues bytes for transmission to the remote. Never blocks: the UART FIFO
+// holds 16 bytes and bytes that do not fit are dropped.
+//
+//*****************************************************************************
+void
+HC12Send(const uint8_t *pui8Data, uint32_t ui32Length)
+{
+    uint32_t i;
+    for (i = 0; i < ui32Length; i++)
+    {
+        if (!UARTCharPutNonBlocking(UART2_BASE, pui8Data[i]))
+        {
+            break;
+        }
+    }
+}
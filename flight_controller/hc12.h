@@ -2,5 +2,6 @@
 #define __HC12_H__
 
 extern void InitHC12UART(void);
+extern void HC12Send(const uint8_t *pui8Data, uint32_t ui32Length);
 
 #endif
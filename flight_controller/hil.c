@@ -0,0 +1,304 @@
+//*****************************************************************************
+//
+// hil.c - Frames of the hardware-in-the-loop bridge.
+//
+// With HIL_BRIDGE defined, main.c takes its sensor samples from frames that a
+// host simulator sends over UART0 instead of reading the MPU9150, and answers
+// every frame with the ESC pulses it produced. The host stamps each sensor
+// frame with its clock and the board echoes the stamp, so the host measures
+// the round trip of the bridge without a common clock, and the board adds how
+// long it took itself.
+//
+// A frame is a sync byte, its type, a fixed payload and a CRC-8. The receiver
+// drops a frame with a bad CRC and looks for the next sync byte, so a lost
+// byte costs a frame or two. The encoders and the receiver run in the flight
+// controller and in simul/hil. The module uses no TivaWare headers.
+//
+//*****************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hil.h"
+
+//*****************************************************************************
+//
+// Scale of the values of a sensor frame: the units are 1 / scale.
+//
+//*****************************************************************************
+#define HIL_ACCEL_SCALE             100.0f
+#define HIL_GYRO_SCALE              1000.0f
+#define HIL_MAGNETO_SCALE           1e8f
+#define HIL_TEMP_SCALE              100.0f
+#define HIL_PULSE_SCALE             65535.0f
+
+//*****************************************************************************
+//
+// CRC-8 with the polynomial x^8 + x^2 + x + 1 of the bytes between the sync
+// byte and the CRC.
+//
+//*****************************************************************************
+static uint8_t
+Crc8(const uint8_t *pui8Data, uint32_t ui32Length)
+{
+    uint8_t ui8Crc = 0;
+    uint32_t i;
+    int j;
+
+    for (i = 0; i < ui32Length; i++)
+    {
+        ui8Crc ^= pui8Data[i];
+        for (j = 0; j < 8; j++)
+        {
+            ui8Crc = (ui8Crc & 0x80) ? ((ui8Crc << 1) ^ 0x07) : (ui8Crc << 1);
+        }
+    }
+    return ui8Crc;
+}
+
+//*****************************************************************************
+//
+// Stores a value scaled and rounded to an integer that saturates at the
+// limits of the field.
+//
+//*****************************************************************************
+static void
+PutInt16(uint8_t *pui8Out, float fValue, float fScale)
+{
+    int32_t i32Value;
+
+    fValue *= fScale;
+    if (fValue > 32767.0f)
+    {
+        fValue = 32767.0f;
+    }
+    if (fValue < -32768.0f)
+    {
+        fValue = -32768.0f;
+    }
+    i32Value = (int32_t)(fValue < 0.0f ? fValue - 0.5f : fValue + 0.5f);
+    pui8Out[0] = (uint8_t)i32Value;
+    pui8Out[1] = (uint8_t)(i32Value >> 8);
+}
+
+static void
+PutUint16(uint8_t *pui8Out, float fValue, float fScale)
+{
+    uint32_t ui32Value;
+
+    fValue *= fScale;
+    if (fValue > 65535.0f)
+    {
+        fValue = 65535.0f;
+    }
+    if (fValue < 0.0f)
+    {
+        fValue = 0.0f;
+    }
+    ui32Value = (uint32_t)(fValue + 0.5f);
+    pui8Out[0] = (uint8_t)ui32Value;
+    pui8Out[1] = (uint8_t)(ui32Value >> 8);
+}
+
+static void
+PutUint32(uint8_t *pui8Out, uint32_t ui32Value)
+{
+    pui8Out[0] = (uint8_t)ui32Value;
+    pui8Out[1] = (uint8_t)(ui32Value >> 8);
+    pui8Out[2] = (uint8_t)(ui32Value >> 16);
+    pui8Out[3] = (uint8_t)(ui32Value >> 24);
+}
+
+static float
+GetInt16(const uint8_t *pui8In, float fScale)
+{
+    return (float)(int16_t)(pui8In[0] | (pui8In[1] << 8)) / fScale;
+}
+
+static uint16_t
+GetUint16(const uint8_t *pui8In)
+{
+    return (uint16_t)(pui8In[0] | (pui8In[1] << 8));
+}
+
+static uint32_t
+GetUint32(const uint8_t *pui8In)
+{
+    return ((uint32_t)pui8In[0] | ((uint32_t)pui8In[1] << 8) |
+            ((uint32_t)pui8In[2] << 16) | ((uint32_t)pui8In[3] << 24));
+}
+
+//*****************************************************************************
+//
+// Writes a sensor frame, HIL_SENSOR_LENGTH bytes, and returns its length.
+//
+//*****************************************************************************
+uint32_t
+HilSensorEncode(const tHilSensor *psSensor, uint8_t *pui8Frame)
+{
+    int i;
+
+    pui8Frame[0] = HIL_SYNC;
+    pui8Frame[1] = HIL_TYPE_SENSOR;
+    pui8Frame[2] = psSensor->ui8Seq;
+    PutUint32(pui8Frame + 3, psSensor->ui32HostTime);
+    for (i = 0; i < 3; i++)
+    {
+        PutInt16(pui8Frame + 7 + 2 * i, psSensor->pfAccel[i],
+                 HIL_ACCEL_SCALE);
+        PutInt16(pui8Frame + 13 + 2 * i, psSensor->pfGyro[i],
+                 HIL_GYRO_SCALE);
+        PutInt16(pui8Frame + 19 + 2 * i, psSensor->pfMagneto[i],
+                 HIL_MAGNETO_SCALE);
+    }
+    PutInt16(pui8Frame + 25, psSensor->fTemperature, HIL_TEMP_SCALE);
+    pui8Frame[27] = psSensor->bMagnetoValid ? HIL_SENSOR_MAGNETO_VALID : 0;
+    pui8Frame[28] = Crc8(pui8Frame + 1, HIL_SENSOR_LENGTH - 2);
+    return HIL_SENSOR_LENGTH;
+}
+
+//*****************************************************************************
+//
+// Reads a sensor frame that HilParse() accepted.
+//
+//*****************************************************************************
+void
+HilSensorDecode(const uint8_t *pui8Frame, tHilSensor *psSensor)
+{
+    int i;
+
+    psSensor->ui8Seq = pui8Frame[2];
+    psSensor->ui32HostTime = GetUint32(pui8Frame + 3);
+    for (i = 0; i < 3; i++)
+    {
+        psSensor->pfAccel[i] = GetInt16(pui8Frame + 7 + 2 * i,
+                                        HIL_ACCEL_SCALE);
+        psSensor->pfGyro[i] = GetInt16(pui8Frame + 13 + 2 * i,
+                                       HIL_GYRO_SCALE);
+        psSensor->pfMagneto[i] = GetInt16(pui8Frame + 19 + 2 * i,
+                                          HIL_MAGNETO_SCALE);
+    }
+    psSensor->fTemperature = GetInt16(pui8Frame + 25, HIL_TEMP_SCALE);
+    psSensor->bMagnetoValid =
+        (pui8Frame[27] & HIL_SENSOR_MAGNETO_VALID) != 0;
+}
+
+//*****************************************************************************
+//
+// Writes a motor frame, HIL_MOTOR_LENGTH bytes, and returns its length.
+//
+//*****************************************************************************
+uint32_t
+HilMotorEncode(const tHilMotor *psMotor, uint8_t *pui8Frame)
+{
+    int i;
+
+    pui8Frame[0] = HIL_SYNC;
+    pui8Frame[1] = HIL_TYPE_MOTOR;
+    pui8Frame[2] = psMotor->ui8Seq;
+    PutUint32(pui8Frame + 3, psMotor->ui32HostTime);
+    PutUint32(pui8Frame + 7, psMotor->ui32BoardCycles);
+    pui8Frame[11] = (uint8_t)psMotor->ui16ProcessUs;
+    pui8Frame[12] = (uint8_t)(psMotor->ui16ProcessUs >> 8);
+    for (i = 0; i < 4; i++)
+    {
+        PutUint16(pui8Frame + 13 + 2 * i, psMotor->pfPulse[i],
+                  HIL_PULSE_SCALE);
+    }
+    pui8Frame[21] = Crc8(pui8Frame + 1, HIL_MOTOR_LENGTH - 2);
+    return HIL_MOTOR_LENGTH;
+}
+
+//*****************************************************************************
+//
+// Reads a motor frame that HilParse() accepted.
+//
+//*****************************************************************************
+void
+HilMotorDecode(const uint8_t *pui8Frame, tHilMotor *psMotor)
+{
+    int i;
+
+    psMotor->ui8Seq = pui8Frame[2];
+    psMotor->ui32HostTime = GetUint32(pui8Frame + 3);
+    psMotor->ui32BoardCycles = GetUint32(pui8Frame + 7);
+    psMotor->ui16ProcessUs = GetUint16(pui8Frame + 11);
+    for (i = 0; i < 4; i++)
+    {
+        psMotor->pfPulse[i] = (float)GetUint16(pui8Frame + 13 + 2 * i) /
+                              HIL_PULSE_SCALE;
+    }
+}
+
+//*****************************************************************************
+//
+// Starts looking for a sync byte.
+//
+//*****************************************************************************
+void
+HilParserInit(tHilParser *psParser)
+{
+    psParser->ui32Count = 0;
+    psParser->ui32Length = 0;
+    psParser->ui32Frames = 0;
+    psParser->ui32Errors = 0;
+}
+
+//*****************************************************************************
+//
+// Adds a received byte. Returns the type of the frame it completed, which is
+// then in pui8Frame, or 0.
+//
+//*****************************************************************************
+uint8_t
+HilParse(tHilParser *psParser, uint8_t ui8Byte)
+{
+    //
+    // Waits for the sync byte, then the type gives the length.
+    //
+    if (psParser->ui32Count == 0)
+    {
+        if (ui8Byte == HIL_SYNC)
+        {
+            psParser->pui8Frame[0] = ui8Byte;
+            psParser->ui32Count = 1;
+        }
+        return 0;
+    }
+    if (psParser->ui32Count == 1)
+    {
+        if (ui8Byte == HIL_TYPE_SENSOR)
+        {
+            psParser->ui32Length = HIL_SENSOR_LENGTH;
+        }
+        else if (ui8Byte == HIL_TYPE_MOTOR)
+        {
+            psParser->ui32Length = HIL_MOTOR_LENGTH;
+        }
+        else
+        {
+            //
+            // Not a frame. The byte may be the sync byte of the next one.
+            //
+            psParser->ui32Count = (ui8Byte == HIL_SYNC) ? 1 : 0;
+            return 0;
+        }
+    }
+    psParser->pui8Frame[psParser->ui32Count++] = ui8Byte;
+    if (psParser->ui32Count < psParser->ui32Length)
+    {
+        return 0;
+    }
+
+    //
+    // A complete frame, accepted if its CRC matches.
+    //
+    psParser->ui32Count = 0;
+    if (Crc8(psParser->pui8Frame + 1, psParser->ui32Length - 2) !=
+        psParser->pui8Frame[psParser->ui32Length - 1])
+    {
+        psParser->ui32Errors++;
+        return 0;
+    }
+    psParser->ui32Frames++;
+    return psParser->pui8Frame[1];
+}
@@ -0,0 +1,134 @@
+//*****************************************************************************
+//
+// hil.h - Frames of the hardware-in-the-loop bridge.
+//
+//*****************************************************************************
+
+#ifndef _HIL_H_
+#define _HIL_H_
+
+//*****************************************************************************
+//
+// If building with a C++ compiler, make all of the definitions in this header
+// have a C binding.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//*****************************************************************************
+//
+// Baud rate of the bridge on UART0, the virtual serial port of the debugger.
+// A sensor frame takes 2.5 ms on the wire at this rate, a faster serial
+// adapter shortens the latency.
+//
+//*****************************************************************************
+#define HIL_BAUD                    115200
+
+//*****************************************************************************
+//
+// Every frame starts with HIL_SYNC and its type, and ends with a CRC-8
+// (polynomial 0x07) of all bytes between the sync byte and the CRC. Values
+// are little-endian.
+//
+// - SENSOR, host to board: the sequence number, the host time in us, the
+//   accelerometer in cm/s^2, the gyroscope in mrad/s, the magnetometer in
+//   10 nT, all int16 in the body axes with the biases of the sensor, the
+//   die temperature in 0.01 C and the flags.
+// - MOTOR, board to host, answers a sensor frame: its sequence number and
+//   host time, the cycle counter of the board when the frame was received,
+//   the us from then to this answer and the four ESC pulses as a fraction of
+//   the PWM period times 65535.
+//
+//*****************************************************************************
+#define HIL_SYNC                    0xa5
+#define HIL_TYPE_SENSOR             0x53
+#define HIL_TYPE_MOTOR              0x4d
+#define HIL_SENSOR_LENGTH           29
+#define HIL_MOTOR_LENGTH            22
+#define HIL_MAX_FRAME               HIL_SENSOR_LENGTH
+
+//*****************************************************************************
+//
+// Flags of a sensor frame: the magnetometer value is a new measurement.
+//
+//*****************************************************************************
+#define HIL_SENSOR_MAGNETO_VALID    0x01
+
+//*****************************************************************************
+//
+// A sensor frame, the values MPU9150DataSampleGet() would return before the
+// biases are removed.
+//
+//*****************************************************************************
+typedef struct
+{
+    uint8_t ui8Seq;
+    uint32_t ui32HostTime;
+    float pfAccel[3];
+    float pfGyro[3];
+    float pfMagneto[3];
+    float fTemperature;
+    bool bMagnetoValid;
+}
+tHilSensor;
+
+//*****************************************************************************
+//
+// A motor frame.
+//
+//*****************************************************************************
+typedef struct
+{
+    uint8_t ui8Seq;
+    uint32_t ui32HostTime;
+    uint32_t ui32BoardCycles;
+    uint16_t ui16ProcessUs;
+    float pfPulse[4];
+}
+tHilMotor;
+
+//*****************************************************************************
+//
+// Receiver state: the bytes of the frame so far and its length once the type
+// is known, the frames received and those with a bad CRC.
+//
+//*****************************************************************************
+typedef struct
+{
+    uint8_t pui8Frame[HIL_MAX_FRAME];
+    uint32_t ui32Count;
+    uint32_t ui32Length;
+    uint32_t ui32Frames;
+    uint32_t ui32Errors;
+}
+tHilParser;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern uint32_t HilSensorEncode(const tHilSensor *psSensor,
+                                uint8_t *pui8Frame);
+extern void HilSensorDecode(const uint8_t *pui8Frame, tHilSensor *psSensor);
+extern uint32_t HilMotorEncode(const tHilMotor *psMotor, uint8_t *pui8Frame);
+extern void HilMotorDecode(const uint8_t *pui8Frame, tHilMotor *psMotor);
+extern void HilParserInit(tHilParser *psParser);
+extern uint8_t HilParse(tHilParser *psParser, uint8_t ui8Byte);
+
+//*****************************************************************************
+//
+// Mark the end of the C bindings section for C++ compilers.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HIL_H_
@@ -0,0 +1,289 @@
+//*****************************************************************************
+//
+// i2c_recover.c - Recovery of the sensor I2C bus after an error in flight.
+//
+// An I2C error, or a sensor that stops sending samples, no longer ends in
+// the endless loop of the error handler. The main loop reports it with
+// I2CRecoverFault() and keeps running on its own clock, calling
+// I2CRecoverUpdate() once per sample period. The update clears the bus:
+// with the I2C peripheral stopped, nine SCL pulses finish the byte of a
+// slave that holds SDA low in the middle of it, followed by a STOP. Then the
+// application restarts the driver and writes the device configuration
+// again, one transaction per update, and the recovery ends with the first
+// sample. A transaction that fails or hangs starts over after a short wait.
+//
+// The module uses no TivaWare headers; the bus lines and the device
+// configuration are callbacks of the application, and simul/i2c_recover
+// runs the sequence against a simulated bus and device.
+//
+//*****************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "i2c_recover.h"
+
+//*****************************************************************************
+//
+// Clocks out a slave that holds SDA low and sends a STOP. Returns the SCL
+// pulses until SDA was released, or I2C_RECOVER_STUCK if SDA stayed low.
+//
+//*****************************************************************************
+uint32_t
+I2CBusClear(const tI2CBusPins *psPins)
+{
+    uint32_t ui32Clocks, ui32Pulse;
+
+    psPins->pfnAcquire();
+    psPins->pfnSdaSet(true);
+    psPins->pfnSclSet(true);
+    psPins->pfnDelay();
+
+    //
+    // A slave that holds SDA low is sending a 0 or acknowledging. Every
+    // pulse shifts out one more bit. SDA going high only means the slave
+    // sends a 1, the next bit may pull it low again, so all pulses are sent:
+    // they end the byte, and the released SDA in the acknowledge slot is a
+    // NACK that stops the slave.
+    //
+    ui32Clocks = psPins->pfnSdaGet() ? 0 : I2C_RECOVER_STUCK;
+    for (ui32Pulse = 1; ui32Pulse <= I2C_RECOVER_CLOCKS; ui32Pulse++)
+    {
+        psPins->pfnSclSet(false);
+        psPins->pfnDelay();
+        psPins->pfnSclSet(true);
+        psPins->pfnDelay();
+        if ((ui32Clocks == I2C_RECOVER_STUCK) && psPins->pfnSdaGet())
+        {
+            ui32Clocks = ui32Pulse;
+        }
+    }
+    if (!psPins->pfnSdaGet())
+    {
+        return I2C_RECOVER_STUCK;
+    }
+
+    //
+    // SDA rising while SCL is high is a STOP, it resets the bus logic of
+    // every slave.
+    //
+    psPins->pfnSclSet(false);
+    psPins->pfnDelay();
+    psPins->pfnSdaSet(false);
+    psPins->pfnDelay();
+    psPins->pfnSclSet(true);
+    psPins->pfnDelay();
+    psPins->pfnSdaSet(true);
+    psPins->pfnDelay();
+
+    return ui32Clocks;
+}
+
+//*****************************************************************************
+//
+// Initializes the recovery, the bus works.
+//
+//*****************************************************************************
+void
+I2CRecoverInit(tI2CRecover *psRec, const tI2CBusPins *psPins,
+               tI2CRecoverStep *pfnStep, void *pvData, uint32_t ui32Steps,
+               uint32_t ui32CyclesPerMs)
+{
+    psRec->psPins = psPins;
+    psRec->pfnStep = pfnStep;
+    psRec->pvData = pvData;
+    psRec->ui32Steps = ui32Steps;
+    psRec->ui32CyclesPerMs = ui32CyclesPerMs;
+
+    psRec->ui8State = I2C_RECOVER_IDLE;
+    psRec->ui32Step = 0;
+    psRec->ui8Done = I2C_RECOVER_PENDING;
+    psRec->ui32OutageStart = 0;
+    psRec->ui32StateStart = 0;
+    psRec->ui32Backoff = 0;
+
+    psRec->ui32Outages = 0;
+    psRec->ui32Attempts = 0;
+    psRec->ui32Clocks = 0;
+    psRec->ui32LastMs = 0;
+    psRec->ui32MaxMs = 0;
+}
+
+//*****************************************************************************
+//
+// Enters ui8State at ui32Now.
+//
+//*****************************************************************************
+static void
+I2CRecoverEnter(tI2CRecover *psRec, uint8_t ui8State, uint32_t ui32Now)
+{
+    psRec->ui8State = ui8State;
+    psRec->ui32StateStart = ui32Now;
+}
+
+//*****************************************************************************
+//
+// Starts over from the bus clear after I2C_RECOVER_RETRY_MS.
+//
+//*****************************************************************************
+static void
+I2CRecoverRetry(tI2CRecover *psRec, uint32_t ui32Now)
+{
+    psRec->ui32Backoff = I2C_RECOVER_RETRY_MS;
+    I2CRecoverEnter(psRec, I2C_RECOVER_CLEAR, ui32Now);
+}
+
+//*****************************************************************************
+//
+// Starts the configuration transaction psRec->ui32Step.
+//
+//*****************************************************************************
+static void
+I2CRecoverStepStart(tI2CRecover *psRec, uint32_t ui32Now)
+{
+    psRec->ui8Done = I2C_RECOVER_PENDING;
+    I2CRecoverEnter(psRec, I2C_RECOVER_CONFIG, ui32Now);
+    if (!psRec->pfnStep(psRec->pvData, psRec->ui32Step))
+    {
+        I2CRecoverRetry(psRec, ui32Now);
+    }
+}
+
+//*****************************************************************************
+//
+// Reports an I2C error or a silent sensor. Faults during a recovery are
+// handled by the recovery itself.
+//
+//*****************************************************************************
+void
+I2CRecoverFault(tI2CRecover *psRec, uint32_t ui32Now)
+{
+    if (psRec->ui8State != I2C_RECOVER_IDLE)
+    {
+        return;
+    }
+
+    psRec->ui32Outages++;
+    psRec->ui32OutageStart = ui32Now;
+    psRec->ui32Backoff = 0;
+    I2CRecoverEnter(psRec, I2C_RECOVER_CLEAR, ui32Now);
+}
+
+//*****************************************************************************
+//
+// Advances the recovery, once per sample period while it is active.
+//
+//*****************************************************************************
+void
+I2CRecoverUpdate(tI2CRecover *psRec, uint32_t ui32Now)
+{
+    uint32_t ui32Ms = (ui32Now - psRec->ui32StateStart) /
+            psRec->ui32CyclesPerMs;
+
+    switch (psRec->ui8State)
+    {
+    case I2C_RECOVER_CLEAR:
+        if (ui32Ms < psRec->ui32Backoff)
+        {
+            break;
+        }
+        psRec->ui32Attempts++;
+        psRec->ui32Clocks = I2CBusClear(psRec->psPins);
+        psRec->ui32Step = 0;
+        I2CRecoverStepStart(psRec, ui32Now);
+        break;
+
+    case I2C_RECOVER_CONFIG:
+        if (psRec->ui8Done == I2C_RECOVER_DONE)
+        {
+            if (++psRec->ui32Step < psRec->ui32Steps)
+            {
+                I2CRecoverStepStart(psRec, ui32Now);
+            }
+            else
+            {
+                I2CRecoverEnter(psRec, I2C_RECOVER_RESUME, ui32Now);
+            }
+        }
+        else if ((psRec->ui8Done == I2C_RECOVER_FAILED) ||
+                 (ui32Ms > I2C_RECOVER_STEP_TIMEOUT_MS))
+        {
+            I2CRecoverRetry(psRec, ui32Now);
+        }
+        break;
+
+    case I2C_RECOVER_RESUME:
+        if (ui32Ms > I2C_RECOVER_STEP_TIMEOUT_MS)
+        {
+            I2CRecoverRetry(psRec, ui32Now);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+//*****************************************************************************
+//
+// Completes the running configuration transaction, from the callback of the
+// driver.
+//
+//*****************************************************************************
+void
+I2CRecoverDone(tI2CRecover *psRec, bool bSuccess)
+{
+    psRec->ui8Done = bSuccess ? I2C_RECOVER_DONE : I2C_RECOVER_FAILED;
+}
+
+//*****************************************************************************
+//
+// Reports a sample. Returns true if it ends a recovery, whose duration is
+// then in ui32LastMs. The samples resume as soon as the last configuration
+// transaction is done, which can be before I2CRecoverUpdate() sees it.
+//
+//*****************************************************************************
+bool
+I2CRecoverSample(tI2CRecover *psRec, uint32_t ui32Now)
+{
+    if ((psRec->ui8State != I2C_RECOVER_RESUME) &&
+        ((psRec->ui8State != I2C_RECOVER_CONFIG) ||
+         (psRec->ui8Done != I2C_RECOVER_DONE) ||
+         ((psRec->ui32Step + 1) < psRec->ui32Steps)))
+    {
+        return false;
+    }
+
+    psRec->ui32LastMs = I2CRecoverOutageMs(psRec, ui32Now);
+    if (psRec->ui32LastMs > psRec->ui32MaxMs)
+    {
+        psRec->ui32MaxMs = psRec->ui32LastMs;
+    }
+    I2CRecoverEnter(psRec, I2C_RECOVER_IDLE, ui32Now);
+    return true;
+}
+
+//*****************************************************************************
+//
+// Returns true while a recovery runs.
+//
+//*****************************************************************************
+bool
+I2CRecoverActive(const tI2CRecover *psRec)
+{
+    return psRec->ui8State != I2C_RECOVER_IDLE;
+}
+
+//*****************************************************************************
+//
+// Returns the duration of the running outage in ms.
+//
+//*****************************************************************************
+uint32_t
+I2CRecoverOutageMs(const tI2CRecover *psRec, uint32_t ui32Now)
+{
+    if (psRec->ui8State == I2C_RECOVER_IDLE)
+    {
+        return 0;
+    }
+    return (ui32Now - psRec->ui32OutageStart) / psRec->ui32CyclesPerMs;
+}
@@ -0,0 +1,173 @@
+//*****************************************************************************
+//
+// i2c_recover.h - Recovery of the sensor I2C bus after an error in flight.
+//
+//*****************************************************************************
+
+#ifndef _I2C_RECOVER_H_
+#define _I2C_RECOVER_H_
+
+//*****************************************************************************
+//
+// If building with a C++ compiler, make all of the definitions in this header
+// have a C binding.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//*****************************************************************************
+//
+// SCL pulses that clock out a byte and its acknowledge from a slave that
+// holds SDA low. I2CBusClear() returns I2C_RECOVER_STUCK if SDA is still low
+// after them.
+//
+//*****************************************************************************
+#define I2C_RECOVER_CLOCKS          9
+#define I2C_RECOVER_STUCK           (I2C_RECOVER_CLOCKS + 1)
+
+//*****************************************************************************
+//
+// Timing in ms: the sensor counts as silent after I2C_RECOVER_SILENT_MS
+// without a sample (three samples at 250 Hz), a configuration transaction
+// or the first sample after it that takes longer than
+// I2C_RECOVER_STEP_TIMEOUT_MS restarts the recovery, after
+// I2C_RECOVER_RETRY_MS. The device reset of the MPU9150 takes most of a
+// recovery. Past I2C_RECOVER_FAILSAFE_MS of outage the application stops
+// coasting and goes into its failsafe.
+//
+//*****************************************************************************
+#define I2C_RECOVER_SILENT_MS       12
+#define I2C_RECOVER_STEP_TIMEOUT_MS 200
+#define I2C_RECOVER_RETRY_MS        20
+#define I2C_RECOVER_FAILSAFE_MS     300
+
+//*****************************************************************************
+//
+// Recovery states.
+//
+// - IDLE: the bus works, no recovery.
+// - CLEAR: the next update clears the bus and restarts the driver.
+// - CONFIG: configuration transaction ui32Step runs.
+// - RESUME: the device is configured, waiting for its first sample.
+//
+//*****************************************************************************
+#define I2C_RECOVER_IDLE            0
+#define I2C_RECOVER_CLEAR           1
+#define I2C_RECOVER_CONFIG          2
+#define I2C_RECOVER_RESUME          3
+
+//*****************************************************************************
+//
+// Completion of the running configuration transaction.
+//
+//*****************************************************************************
+#define I2C_RECOVER_PENDING         0
+#define I2C_RECOVER_DONE            1
+#define I2C_RECOVER_FAILED          2
+
+//*****************************************************************************
+//
+// The bus lines driven as GPIOs. pfnAcquire() stops the I2C peripheral and
+// turns both lines into open-drain GPIOs, the set functions release a line
+// for true and pull it low for false, and pfnDelay() waits half an SCL
+// period.
+//
+//*****************************************************************************
+typedef struct
+{
+    void (*pfnAcquire)(void);
+    void (*pfnSclSet)(bool bHigh);
+    void (*pfnSdaSet)(bool bHigh);
+    bool (*pfnSdaGet)(void);
+    void (*pfnDelay)(void);
+}
+tI2CBusPins;
+
+//*****************************************************************************
+//
+// Starts configuration transaction ui32Step of the device, the first one
+// gives the pins back to the I2C peripheral and restarts the driver. The
+// transaction completes by I2CRecoverDone(). Returns false if it could not
+// be started.
+//
+//*****************************************************************************
+typedef bool (tI2CRecoverStep)(void *pvData, uint32_t ui32Step);
+
+//*****************************************************************************
+//
+// Recovery state.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // The bus lines, the configuration of the device and its number of
+    // transactions, and the cycle counter frequency in kHz.
+    //
+    const tI2CBusPins *psPins;
+    tI2CRecoverStep *pfnStep;
+    void *pvData;
+    uint32_t ui32Steps;
+    uint32_t ui32CyclesPerMs;
+
+    //
+    // State, the running transaction and its completion, set by the
+    // transaction callback.
+    //
+    uint8_t ui8State;
+    uint32_t ui32Step;
+    volatile uint8_t ui8Done;
+
+    //
+    // Cycle counts at the start of the outage and of the current state, and
+    // the wait before the next attempt in ms.
+    //
+    uint32_t ui32OutageStart;
+    uint32_t ui32StateStart;
+    uint32_t ui32Backoff;
+
+    //
+    // Statistics: outages, attempts to recover, SCL pulses of the last bus
+    // clear, and the last and longest outage in ms.
+    //
+    uint32_t ui32Outages;
+    uint32_t ui32Attempts;
+    uint32_t ui32Clocks;
+    uint32_t ui32LastMs;
+    uint32_t ui32MaxMs;
+}
+tI2CRecover;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern uint32_t I2CBusClear(const tI2CBusPins *psPins);
+extern void I2CRecoverInit(tI2CRecover *psRec, const tI2CBusPins *psPins,
+                           tI2CRecoverStep *pfnStep, void *pvData,
+                           uint32_t ui32Steps, uint32_t ui32CyclesPerMs);
+extern void I2CRecoverFault(tI2CRecover *psRec, uint32_t ui32Now);
+extern void I2CRecoverUpdate(tI2CRecover *psRec, uint32_t ui32Now);
+extern void I2CRecoverDone(tI2CRecover *psRec, bool bSuccess);
+extern bool I2CRecoverSample(tI2CRecover *psRec, uint32_t ui32Now);
+extern bool I2CRecoverActive(const tI2CRecover *psRec);
+extern uint32_t I2CRecoverOutageMs(const tI2CRecover *psRec,
+                                   uint32_t ui32Now);
+
+//*****************************************************************************
+//
+// Mark the end of the C bindings section for C++ compilers.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _I2C_RECOVER_H_
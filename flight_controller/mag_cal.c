@@ -0,0 +1,495 @@
+//*****************************************************************************
+//
+// mag_cal.c - Online hard and soft iron calibration of the magnetometer.
+//
+// Iron on the frame shifts the field the magnetometer sees (hard iron) and
+// distorts the sphere its readings lie on into an ellipsoid (soft iron). The
+// general quadric
+//
+//   x^T A x + 2 v^T x + d = 0
+//
+// is fitted by least squares to the readings collected while the quadrotor
+// is turned around, with the trace of A fixed to -3 so the fit does not
+// degenerate when the hard iron offset is as large as the field itself.
+// Only the 9x9 normal equations of the fit are kept, so the memory does not
+// grow with the number of samples; they decay with every new sample so the
+// fit follows changes of the frame. A sample is only added once the field
+// turned away from the last added one, which keeps long periods on one
+// heading from dominating the fit.
+//
+// The center of the ellipsoid is the hard iron offset. The symmetric square
+// root of A, scaled to the mean radius, maps the ellipsoid back onto a
+// sphere. A fit is rejected if the ellipsoid is degenerate, too elongated or
+// its radius is not a plausible strength of the earth field.
+//
+// The module uses no TivaWare headers.
+//
+//*****************************************************************************
+
+#include <math.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mag_cal.h"
+
+//*****************************************************************************
+//
+// Readings are fitted in units of 50 uT, close to the strength of the earth
+// field, which keeps the normal equations well scaled in single precision.
+//
+//*****************************************************************************
+#define MAG_CAL_SCALE           20000.0f    // 1 / 50 uT
+
+//*****************************************************************************
+//
+// Collection of samples. MAG_CAL_MIN_STEP is the change of the scaled field
+// needed to add a sample (about 3 degrees of rotation), MAG_CAL_FORGET the
+// decay of the normal equations per added sample.
+//
+//*****************************************************************************
+#define MAG_CAL_MIN_STEP        0.05f
+#define MAG_CAL_FORGET          0.998f
+
+//*****************************************************************************
+//
+// A fit is attempted once the normal equations hold MAG_CAL_MIN_WEIGHT
+// samples, and then every MAG_CAL_SOLVE_SAMPLES new samples.
+//
+//*****************************************************************************
+#define MAG_CAL_MIN_WEIGHT      100.0f
+#define MAG_CAL_SOLVE_SAMPLES   25
+
+//*****************************************************************************
+//
+// Acceptance of a fit: smallest pivot of the elimination relative to the
+// weight, largest ratio of the longest to the shortest axis of the
+// ellipsoid, and range of the field strength in scaled units (20 to 70 uT).
+//
+//*****************************************************************************
+#define MAG_CAL_MIN_PIVOT       1e-5f
+#define MAG_CAL_MAX_AXIS_RATIO  2.0f
+#define MAG_CAL_MIN_FIELD       0.4f
+#define MAG_CAL_MAX_FIELD       1.4f
+
+//*****************************************************************************
+//
+// Relative deviation of the calibrated field strength from the fitted one
+// above which a reading is taken as disturbed, see MagCalApply().
+//
+//*****************************************************************************
+#define MAG_CAL_FIELD_TOLERANCE 0.3f
+
+//*****************************************************************************
+//
+// Number of Jacobi sweeps of the eigen decomposition.
+//
+//*****************************************************************************
+#define MAG_CAL_JACOBI_SWEEPS   8
+
+//*****************************************************************************
+//
+// Solves the normal equations by Gaussian elimination with partial pivoting.
+// Returns false if they are close to singular, that is the readings do not
+// cover enough orientations yet.
+//
+//*****************************************************************************
+static bool
+MagCalLinearSolve(tMagCal *psCal, float pfCoeffs[MAG_CAL_COEFFS])
+{
+    float ppfA[MAG_CAL_COEFFS][MAG_CAL_COEFFS + 1];
+    int i, j, k;
+
+    for (i = 0; i < MAG_CAL_COEFFS; i++)
+    {
+        for (j = 0; j < MAG_CAL_COEFFS; j++)
+        {
+            ppfA[i][j] = psCal->ppfNormal[i][j];
+        }
+        ppfA[i][MAG_CAL_COEFFS] = psCal->pfRhs[i];
+    }
+
+    for (k = 0; k < MAG_CAL_COEFFS; k++)
+    {
+        int iPivot = k;
+        for (i = k + 1; i < MAG_CAL_COEFFS; i++)
+        {
+            if (fabsf(ppfA[i][k]) > fabsf(ppfA[iPivot][k]))
+            {
+                iPivot = i;
+            }
+        }
+        if (!(fabsf(ppfA[iPivot][k]) > MAG_CAL_MIN_PIVOT * psCal->fWeight))
+        {
+            return false;
+        }
+        if (iPivot != k)
+        {
+            for (j = k; j <= MAG_CAL_COEFFS; j++)
+            {
+                float fTemp = ppfA[k][j];
+                ppfA[k][j] = ppfA[iPivot][j];
+                ppfA[iPivot][j] = fTemp;
+            }
+        }
+        for (i = k + 1; i < MAG_CAL_COEFFS; i++)
+        {
+            float fFactor = ppfA[i][k] / ppfA[k][k];
+            for (j = k; j <= MAG_CAL_COEFFS; j++)
+            {
+                ppfA[i][j] -= fFactor * ppfA[k][j];
+            }
+        }
+    }
+
+    for (i = MAG_CAL_COEFFS - 1; i >= 0; i--)
+    {
+        float fSum = ppfA[i][MAG_CAL_COEFFS];
+        for (j = i + 1; j < MAG_CAL_COEFFS; j++)
+        {
+            fSum -= ppfA[i][j] * pfCoeffs[j];
+        }
+        pfCoeffs[i] = fSum / ppfA[i][i];
+    }
+
+    return true;
+}
+
+//*****************************************************************************
+//
+// Eigen decomposition of a symmetric 3x3 matrix by cyclic Jacobi rotations.
+// ppfA is destroyed, its eigenvalues are returned in pfValues and the
+// eigenvectors in the columns of ppfVectors.
+//
+//*****************************************************************************
+static void
+MagCalEigen(float ppfA[3][3], float pfValues[3], float ppfVectors[3][3])
+{
+    static const uint8_t pui8Pairs[3][2] = {{0, 1}, {0, 2}, {1, 2}};
+    int iSweep, iPair, i, j;
+
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            ppfVectors[i][j] = (i == j) ? 1.0f : 0.0f;
+        }
+    }
+
+    for (iSweep = 0; iSweep < MAG_CAL_JACOBI_SWEEPS; iSweep++)
+    {
+        for (iPair = 0; iPair < 3; iPair++)
+        {
+            int p = pui8Pairs[iPair][0];
+            int q = pui8Pairs[iPair][1];
+            if (fabsf(ppfA[p][q]) < 1e-9f)
+            {
+                continue;
+            }
+
+            //
+            // Rotation that zeroes ppfA[p][q].
+            //
+            float fTheta = (ppfA[q][q] - ppfA[p][p]) / (2.0f * ppfA[p][q]);
+            float fT = 1.0f / (fabsf(fTheta) + sqrtf(fTheta * fTheta + 1.0f));
+            if (fTheta < 0.0f)
+            {
+                fT = -fT;
+            }
+            float fC = 1.0f / sqrtf(fT * fT + 1.0f);
+            float fS = fT * fC;
+
+            for (i = 0; i < 3; i++)
+            {
+                float fP = ppfA[i][p];
+                float fQ = ppfA[i][q];
+                ppfA[i][p] = fC * fP - fS * fQ;
+                ppfA[i][q] = fS * fP + fC * fQ;
+            }
+            for (i = 0; i < 3; i++)
+            {
+                float fP = ppfA[p][i];
+                float fQ = ppfA[q][i];
+                ppfA[p][i] = fC * fP - fS * fQ;
+                ppfA[q][i] = fS * fP + fC * fQ;
+            }
+            for (i = 0; i < 3; i++)
+            {
+                float fP = ppfVectors[i][p];
+                float fQ = ppfVectors[i][q];
+                ppfVectors[i][p] = fC * fP - fS * fQ;
+                ppfVectors[i][q] = fS * fP + fC * fQ;
+            }
+        }
+    }
+
+    for (i = 0; i < 3; i++)
+    {
+        pfValues[i] = ppfA[i][i];
+    }
+}
+
+//*****************************************************************************
+//
+// Initializes the calibrator without a calibration.
+//
+//*****************************************************************************
+void
+MagCalInit(tMagCal *psCal)
+{
+    int i, j;
+    for (i = 0; i < MAG_CAL_COEFFS; i++)
+    {
+        for (j = 0; j < MAG_CAL_COEFFS; j++)
+        {
+            psCal->ppfNormal[i][j] = 0.0f;
+        }
+        psCal->pfRhs[i] = 0.0f;
+    }
+    psCal->fWeight = 0.0f;
+
+    for (i = 0; i < 3; i++)
+    {
+        psCal->pfLast[i] = 0.0f;
+        psCal->pfOffset[i] = 0.0f;
+        for (j = 0; j < 3; j++)
+        {
+            psCal->ppfSoft[i][j] = (i == j) ? 1.0f : 0.0f;
+        }
+    }
+    psCal->ui16NewSamples = 0;
+    psCal->fField = 0.0f;
+    psCal->bValid = false;
+    psCal->ui32Fits = 0;
+}
+
+//*****************************************************************************
+//
+// Adds a raw reading in tesla to the fit. Returns false if the field did not
+// change enough since the last added reading and it was skipped.
+//
+//*****************************************************************************
+bool
+MagCalAddSample(tMagCal *psCal, const float pfMag[3])
+{
+    float fX = pfMag[0] * MAG_CAL_SCALE;
+    float fY = pfMag[1] * MAG_CAL_SCALE;
+    float fZ = pfMag[2] * MAG_CAL_SCALE;
+    float fDX = fX - psCal->pfLast[0];
+    float fDY = fY - psCal->pfLast[1];
+    float fDZ = fZ - psCal->pfLast[2];
+    int i, j;
+
+    if (!(fDX * fDX + fDY * fDY + fDZ * fDZ >
+          MAG_CAL_MIN_STEP * MAG_CAL_MIN_STEP))
+    {
+        return false;
+    }
+    psCal->pfLast[0] = fX;
+    psCal->pfLast[1] = fY;
+    psCal->pfLast[2] = fZ;
+
+    //
+    // One row of the fit, the right hand side is the squared field.
+    //
+    float fSquare = fX * fX + fY * fY + fZ * fZ;
+    float pfRow[MAG_CAL_COEFFS] =
+    {
+        fX * fX + fY * fY - 2.0f * fZ * fZ,
+        fX * fX + fZ * fZ - 2.0f * fY * fY,
+        2.0f * fX * fY, 2.0f * fX * fZ, 2.0f * fY * fZ,
+        2.0f * fX, 2.0f * fY, 2.0f * fZ, 1.0f
+    };
+
+    for (i = 0; i < MAG_CAL_COEFFS; i++)
+    {
+        for (j = i; j < MAG_CAL_COEFFS; j++)
+        {
+            psCal->ppfNormal[i][j] = (MAG_CAL_FORGET * psCal->ppfNormal[i][j] +
+                                      pfRow[i] * pfRow[j]);
+            psCal->ppfNormal[j][i] = psCal->ppfNormal[i][j];
+        }
+        psCal->pfRhs[i] = (MAG_CAL_FORGET * psCal->pfRhs[i] +
+                           pfRow[i] * fSquare);
+    }
+    psCal->fWeight = MAG_CAL_FORGET * psCal->fWeight + 1.0f;
+    psCal->ui16NewSamples++;
+
+    return true;
+}
+
+//*****************************************************************************
+//
+// Fits the ellipsoid if enough new readings were added since the last fit.
+// Returns true if a new calibration was accepted. Meant to be called at a
+// low rate, a fit takes a few thousand cycles.
+//
+//*****************************************************************************
+bool
+MagCalSolve(tMagCal *psCal)
+{
+    float pfCoeffs[MAG_CAL_COEFFS];
+    float ppfA[3][3], ppfInv[3][3], ppfVectors[3][3];
+    float pfValues[3], pfCenter[3], pfScale[3];
+    int i, j, k;
+
+    if ((psCal->ui16NewSamples < MAG_CAL_SOLVE_SAMPLES) ||
+        (psCal->fWeight < MAG_CAL_MIN_WEIGHT))
+    {
+        return false;
+    }
+    psCal->ui16NewSamples = 0;
+
+    if (!MagCalLinearSolve(psCal, pfCoeffs))
+    {
+        return false;
+    }
+
+    //
+    // Coefficients of the quadric, v is in pfCoeffs[5..7] and d in
+    // pfCoeffs[8].
+    //
+    ppfA[0][0] = pfCoeffs[0] + pfCoeffs[1] - 1.0f;
+    ppfA[1][1] = pfCoeffs[0] - 2.0f * pfCoeffs[1] - 1.0f;
+    ppfA[2][2] = pfCoeffs[1] - 2.0f * pfCoeffs[0] - 1.0f;
+    ppfA[0][1] = ppfA[1][0] = pfCoeffs[2];
+    ppfA[0][2] = ppfA[2][0] = pfCoeffs[3];
+    ppfA[1][2] = ppfA[2][1] = pfCoeffs[4];
+
+    //
+    // The center solves A c = -v.
+    //
+    ppfInv[0][0] = ppfA[1][1] * ppfA[2][2] - ppfA[1][2] * ppfA[2][1];
+    ppfInv[0][1] = ppfA[0][2] * ppfA[2][1] - ppfA[0][1] * ppfA[2][2];
+    ppfInv[0][2] = ppfA[0][1] * ppfA[1][2] - ppfA[0][2] * ppfA[1][1];
+    ppfInv[1][0] = ppfA[1][2] * ppfA[2][0] - ppfA[1][0] * ppfA[2][2];
+    ppfInv[1][1] = ppfA[0][0] * ppfA[2][2] - ppfA[0][2] * ppfA[2][0];
+    ppfInv[1][2] = ppfA[0][2] * ppfA[1][0] - ppfA[0][0] * ppfA[1][2];
+    ppfInv[2][0] = ppfA[1][0] * ppfA[2][1] - ppfA[1][1] * ppfA[2][0];
+    ppfInv[2][1] = ppfA[0][1] * ppfA[2][0] - ppfA[0][0] * ppfA[2][1];
+    ppfInv[2][2] = ppfA[0][0] * ppfA[1][1] - ppfA[0][1] * ppfA[1][0];
+    float fDet = (ppfA[0][0] * ppfInv[0][0] + ppfA[0][1] * ppfInv[1][0] +
+                  ppfA[0][2] * ppfInv[2][0]);
+    if (!(fabsf(fDet) > 0.0f))
+    {
+        return false;
+    }
+    for (i = 0; i < 3; i++)
+    {
+        pfCenter[i] = -(ppfInv[i][0] * pfCoeffs[5] +
+                        ppfInv[i][1] * pfCoeffs[6] +
+                        ppfInv[i][2] * pfCoeffs[7]) / fDet;
+    }
+
+    //
+    // Around the center the quadric is y^T A y = c^T A c - d.
+    //
+    float fLevel = -pfCoeffs[8];
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            fLevel += pfCenter[i] * ppfA[i][j] * pfCenter[j];
+        }
+    }
+    if (!(fabsf(fLevel) > 0.0f))
+    {
+        return false;
+    }
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            ppfA[i][j] /= fLevel;
+        }
+    }
+
+    //
+    // The eigenvalues are the inverse squares of the semi-axes, they are
+    // all positive for an ellipsoid.
+    //
+    MagCalEigen(ppfA, pfValues, ppfVectors);
+    float fMin = pfValues[0];
+    float fMax = pfValues[0];
+    for (i = 1; i < 3; i++)
+    {
+        fMin = (pfValues[i] < fMin) ? pfValues[i] : fMin;
+        fMax = (pfValues[i] > fMax) ? pfValues[i] : fMax;
+    }
+    if (!(fMin > 0.0f) ||
+        !(fMax < MAG_CAL_MAX_AXIS_RATIO * MAG_CAL_MAX_AXIS_RATIO * fMin))
+    {
+        return false;
+    }
+
+    //
+    // Mean radius, the geometric mean of the semi-axes.
+    //
+    float fRadius = powf(pfValues[0] * pfValues[1] * pfValues[2],
+                         -1.0f / 6.0f);
+    if (!(fRadius > MAG_CAL_MIN_FIELD) || !(fRadius < MAG_CAL_MAX_FIELD))
+    {
+        return false;
+    }
+
+    //
+    // The soft iron correction V diag(sqrt(l) r) V^T.
+    //
+    for (i = 0; i < 3; i++)
+    {
+        pfScale[i] = sqrtf(pfValues[i]) * fRadius;
+    }
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            float fSum = 0.0f;
+            for (k = 0; k < 3; k++)
+            {
+                fSum += ppfVectors[i][k] * pfScale[k] * ppfVectors[j][k];
+            }
+            psCal->ppfSoft[i][j] = fSum;
+        }
+        psCal->pfOffset[i] = pfCenter[i] / MAG_CAL_SCALE;
+    }
+    psCal->fField = fRadius / MAG_CAL_SCALE;
+    psCal->bValid = true;
+    psCal->ui32Fits++;
+
+    return true;
+}
+
+//*****************************************************************************
+//
+// Calibrates a raw reading in tesla. Returns false if there is no
+// calibration yet or the strength of the calibrated field is off by more
+// than MAG_CAL_FIELD_TOLERANCE, as near motors or other iron.
+//
+//*****************************************************************************
+bool
+MagCalApply(tMagCal *psCal, const float pfMag[3], float pfCalibrated[3])
+{
+    float pfDelta[3];
+    int i;
+
+    if (!psCal->bValid)
+    {
+        return false;
+    }
+
+    for (i = 0; i < 3; i++)
+    {
+        pfDelta[i] = pfMag[i] - psCal->pfOffset[i];
+    }
+
+    float fSquare = 0.0f;
+    for (i = 0; i < 3; i++)
+    {
+        pfCalibrated[i] = (psCal->ppfSoft[i][0] * pfDelta[0] +
+                           psCal->ppfSoft[i][1] * pfDelta[1] +
+                           psCal->ppfSoft[i][2] * pfDelta[2]);
+        fSquare += pfCalibrated[i] * pfCalibrated[i];
+    }
+
+    float fRatio = sqrtf(fSquare) / psCal->fField;
+    return ((fRatio > 1.0f - MAG_CAL_FIELD_TOLERANCE) &&
+            (fRatio < 1.0f + MAG_CAL_FIELD_TOLERANCE));
+}
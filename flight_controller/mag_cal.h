@@ -0,0 +1,89 @@
+//*****************************************************************************
+//
+// mag_cal.h - Online hard and soft iron calibration of the magnetometer.
+//
+//*****************************************************************************
+
+#ifndef _MAG_CAL_H_
+#define _MAG_CAL_H_
+
+//*****************************************************************************
+//
+// If building with a C++ compiler, make all of the definitions in this header
+// have a C binding.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//*****************************************************************************
+//
+// Number of coefficients of the ellipsoid that is fitted.
+//
+//*****************************************************************************
+#define MAG_CAL_COEFFS              9
+
+//*****************************************************************************
+//
+// Calibrator state.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // Normal equations of the least squares ellipsoid fit, decayed with
+    // every added sample, and their total weight.
+    //
+    float ppfNormal[MAG_CAL_COEFFS][MAG_CAL_COEFFS];
+    float pfRhs[MAG_CAL_COEFFS];
+    float fWeight;
+
+    //
+    // The last sample that was added, scaled, and the number of samples
+    // added since the last fit.
+    //
+    float pfLast[3];
+    uint16_t ui16NewSamples;
+
+    //
+    // Calibration: the calibrated field is ppfSoft * (raw - pfOffset), in
+    // tesla. fField is the strength of the field.
+    //
+    float pfOffset[3];
+    float ppfSoft[3][3];
+    float fField;
+    bool bValid;
+
+    //
+    // Number of accepted fits.
+    //
+    uint32_t ui32Fits;
+}
+tMagCal;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern void MagCalInit(tMagCal *psCal);
+extern bool MagCalAddSample(tMagCal *psCal, const float pfMag[3]);
+extern bool MagCalSolve(tMagCal *psCal);
+extern bool MagCalApply(tMagCal *psCal, const float pfMag[3],
+                        float pfCalibrated[3]);
+
+//*****************************************************************************
+//
+// Mark the end of the C bindings section for C++ compilers.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _MAG_CAL_H_
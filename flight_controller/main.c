@@ -16,6 +16,7 @@
 #include "driverlib/pin_map.h"
 #include "driverlib/rom.h"
 #include "driverlib/sysctl.h"
+#include "driverlib/systick.h"
 #include "driverlib/uart.h"
 #include "utils/uartstdio.h"
 #include "sensorlib/hw_mpu9150.h"
@@ -31,6 +32,15 @@
 #include "escpwm.h"
 #include "controller.h"
 #include "battery_adc.h"
+#include "params.h"
+#include "perf.h"
+#include "gyro_fft.h"
+#include "gyro_temp.h"
+#include "mag_cal.h"
+#include "blackbox.h"
+#include "crash_ring.h"
+#include "i2c_recover.h"
+#include "hil.h"
 
 
 //*****************************************************************************
@@ -40,6 +50,20 @@
 //*****************************************************************************
 #define MPU9150_I2C_ADDRESS     0x68
 
+#ifdef HIL_BRIDGE
+//*****************************************************************************
+//
+// The bridge takes UART0, the console output is dropped.
+//
+//*****************************************************************************
+static void
+ConsoleDrop(const char *pcString, ...)
+{
+}
+#define UARTprintf ConsoleDrop
+#define UARTFlushTx(bDiscard)
+#endif
+
 //*****************************************************************************
 //
 // Global array for holding the color values for the RGB.
@@ -61,6 +85,13 @@ tI2CMInstance g_sI2CInst;
 //*****************************************************************************
 tMPU9150 g_sMPU9150Inst;
 
+//*****************************************************************************
+//
+// Global decoded sample of the most recent MPU9150 data read.
+//
+//*****************************************************************************
+tMPU9150Sample g_sMPU9150Sample;
+
 //*****************************************************************************
 //
 // Global Instance structure to manage the DCM state.
@@ -68,6 +99,37 @@ tMPU9150 g_sMPU9150Inst;
 //*****************************************************************************
 tCompDCM g_sCompDCMInst;
 
+//*****************************************************************************
+//
+// Global attitude filter selection, one of the COMP_DCM_MODE_* values. Kept
+// as a float so it can be set over the radio.
+//
+//*****************************************************************************
+float g_fAttitudeFilter = COMP_DCM_DEFAULT_MODE;
+
+//*****************************************************************************
+//
+// Global auto-tune request, set to 1 over the radio while hovering to tune
+// the PD gains. Back to 0 once the tune is over.
+//
+//*****************************************************************************
+float g_fAutotune = 0.0f;
+
+//*****************************************************************************
+//
+// Global erase request of the flight recorder, set to 1 over the radio on
+// the ground to erase the recorded sessions. Back to 0 once it started.
+//
+//*****************************************************************************
+float g_fLogErase = 0.0f;
+
+//*****************************************************************************
+//
+// Global divider of the flight recorder, main loop samples per record.
+//
+//*****************************************************************************
+float g_fLogDivider = BLACKBOX_DIVIDER;
+
 //*****************************************************************************
 //
 // Global Instance structure to manage the PWM state.
@@ -82,6 +144,100 @@ tPWM g_sPWMInst;
 //*****************************************************************************
 tPDController g_sPDControllerInst;
 
+//*****************************************************************************
+//
+// Global Instance structure for the runtime tunable parameters.
+//
+//*****************************************************************************
+tParamStore g_sParamInst;
+
+//*****************************************************************************
+//
+// Global cycle count statistics of the controller update.
+//
+//*****************************************************************************
+tPerfStat g_sControllerPerf;
+
+//*****************************************************************************
+//
+// Global instance structure for the gyro vibration analysis and the cycle
+// count statistics of its steps.
+//
+//*****************************************************************************
+tGyroFFT g_sGyroFFTInst;
+tPerfStat g_sGyroFFTPerf;
+
+//*****************************************************************************
+//
+// Global instance structure for the temperature model of the gyro bias.
+//
+//*****************************************************************************
+tGyroTemp g_sGyroTempInst;
+
+//*****************************************************************************
+//
+// Global instance structure for the magnetometer calibration, and the number
+// of samples since the last magnetometer reading.
+//
+//*****************************************************************************
+tMagCal g_sMagCalInst;
+uint32_t g_ui32MagTicks;
+
+//*****************************************************************************
+//
+// Global instance structure for the flight recorder, the main loop
+// iterations and the cycle count at the start of the last one.
+//
+//*****************************************************************************
+tBlackBox g_sBlackBoxInst;
+uint32_t g_ui32LoopTick;
+uint32_t g_ui32LoopStart;
+
+//*****************************************************************************
+//
+// Global pre-trigger capture ring, in RAM that the startup code does not
+// clear, and whether it held a capture at boot.
+//
+//*****************************************************************************
+#pragma DATA_SECTION(g_sCrashRing, ".noinit")
+tCrashRing g_sCrashRing;
+bool g_bCrashCaptured;
+
+//*****************************************************************************
+//
+// Global crash capture settings, set over the radio: the mask of enabled
+// CRASH_TRIGGER_* causes, the roll or pitch error in rad that triggers, and
+// the request to drop the capture and record again. Also the NaN resets of
+// the DCM that were seen.
+//
+//*****************************************************************************
+float g_fCrashTriggers = CRASH_TRIGGER_ALL;
+float g_fCrashAttError = 0.8f;
+float g_fCrashArm = 0.0f;
+uint32_t g_ui32CrashNaNResets;
+
+//*****************************************************************************
+//
+// Global instance structure for the recovery of the I2C bus, the cycle count
+// of the last sample or coasting step, the cycles per ms, whether the
+// failsafe took over during the outage, and a copy of the driver state whose
+// calibration is restored after the device reset.
+//
+//*****************************************************************************
+tI2CRecover g_sI2CRecoverInst;
+uint32_t g_ui32SampleStart;
+uint32_t g_ui32CyclesPerMs;
+bool g_bI2CFailsafe;
+tMPU9150 g_sMPU9150Saved;
+
+//*****************************************************************************
+//
+// Configuration transactions of the MPU9150 after its reset, see
+// MPU9150ConfigStep().
+//
+//*****************************************************************************
+#define MPU9150_CONFIG_STEPS        2
+
 //*****************************************************************************
 //
 // Global flags to alert main that MPU9150 I2C transaction is complete
@@ -96,6 +252,23 @@ volatile uint_fast8_t g_vui8I2CDoneFlag;
 //*****************************************************************************
 volatile uint_fast8_t g_vui8ErrorFlag;
 
+#ifdef HIL_BRIDGE
+//*****************************************************************************
+//
+// Hardware-in-the-loop bridge: the receiver of the sensor frames, the last
+// frame and the cycle counter when it arrived, the biases removed from its
+// samples, and the motor frame being sent with its next byte.
+//
+//*****************************************************************************
+tHilParser g_sHilParser;
+tHilSensor g_sHilSensor;
+uint32_t g_ui32HilRxCycles;
+float g_pfHilAccelBias[3];
+float g_pfHilGyroBias[3];
+uint8_t g_pui8HilTx[HIL_MOTOR_LENGTH];
+volatile uint32_t g_vui32HilTxNext = HIL_MOTOR_LENGTH;
+#endif
+
 //*****************************************************************************
 //
 // Global flags to alert main that MPU9150 data is ready to be retrieved.
@@ -112,6 +285,15 @@ volatile uint_fast8_t g_vui8DataFlag;
 
 uint32_t g_ui32PrintSkipCounter;
 
+//*****************************************************************************
+//
+// Global counter of the status row printed next, of PRINT_ROWS.
+//
+//*****************************************************************************
+#define PRINT_ROWS              10
+
+uint32_t g_ui32PrintRow;
+
 //*****************************************************************************
 //
 // Global variables for UART printing.
@@ -129,6 +311,15 @@ float *pfAccel, *pfGyro, *pfMag, *pfEulers, *pfQuaternion;
 //*****************************************************************************
 #define GYRO_BIAS_SAMPLES           2000
 
+//*****************************************************************************
+//
+// Band searched for vibration peaks by the gyro analysis, in Hz. The upper
+// end is the Nyquist frequency of the 250 Hz sample rate.
+//
+//*****************************************************************************
+#define DYN_NOTCH_MIN_HZ            20.0f
+#define DYN_NOTCH_MAX_HZ            125.0f
+
 //*****************************************************************************
 //
 // The error routine that is called if the driver library encounters an error.
@@ -141,6 +332,96 @@ __error__(char *pcFilename, uint32_t ui32Line)
 }
 #endif
 
+//*****************************************************************************
+//
+// Freezes the crash capture if the trigger ui32Cause is enabled.
+//
+//*****************************************************************************
+void
+CrashTrigger(uint32_t ui32Cause)
+{
+    if(ui32Cause & (uint32_t)g_fCrashTriggers)
+    {
+        CrashRingTrigger(&g_sCrashRing, ui32Cause,
+                         g_sMPU9150Inst.ui8GyroFsSel,
+                         g_sMPU9150Inst.ui8AccelAfsSel);
+    }
+}
+
+//*****************************************************************************
+//
+// Adds the raw sample and the motor commands of this main loop iteration to
+// the crash capture, and checks the triggers of the main loop.
+//
+//*****************************************************************************
+void
+CrashRecord(void)
+{
+    int i;
+
+    CrashRingAdd(&g_sCrashRing, g_sMPU9150Inst.pui8Data,
+                 g_sPDControllerInst.sMotor.fOmegaSqCmd, g_ui32LoopTick);
+
+    if(g_sCompDCMInst.ui32NaNResets != g_ui32CrashNaNResets)
+    {
+        g_ui32CrashNaNResets = g_sCompDCMInst.ui32NaNResets;
+        CrashTrigger(CRASH_TRIGGER_DCM_NAN);
+    }
+    for(i = 0; i < 2; i++)
+    {
+        if(fabsf(g_sPDControllerInst.fDesState[i] -
+                 g_sCompDCMInst.fEuler[i]) > g_fCrashAttError)
+        {
+            CrashTrigger(CRASH_TRIGGER_ATTITUDE);
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// Prints the crash capture on the console, oldest sample first. A line per
+// sample: the 22 raw bytes in hex, the loop tick and the motor commands in
+// CRASH_RING_OMEGA_SQ_LSB. simul/sil/crash_capture.py decodes it. The
+// capture is about 18 kB and the transmit buffer of UARTStdio 1 kB, which
+// discards what does not fit, so every line waits until it is sent.
+//
+//*****************************************************************************
+void
+CrashCaptureDump(void)
+{
+    static const char pcHex[] = "0123456789abcdef";
+    char pcRaw[2 * CRASH_RING_RAW_BYTES + 1];
+    const tCrashSample *psSample;
+    uint32_t ui32Index, ui32Byte, ui32Trigger;
+
+    ui32Trigger = (g_sCrashRing.ui32Trigger + CRASH_RING_SAMPLES -
+                   g_sCrashRing.ui32Next + g_sCrashRing.ui32Count) %
+            CRASH_RING_SAMPLES;
+    UARTprintf("Crash capture: cause %d, %d samples, trigger at %d, "
+               "gyro fs %d, accel afs %d\n", g_sCrashRing.ui32Cause,
+               g_sCrashRing.ui32Count, ui32Trigger,
+               g_sCrashRing.ui8GyroFsSel, g_sCrashRing.ui8AccelAfsSel);
+    UARTFlushTx(false);
+
+    for(ui32Index = 0; ui32Index < g_sCrashRing.ui32Count; ui32Index++)
+    {
+        psSample = CrashRingSample(&g_sCrashRing, ui32Index);
+        for(ui32Byte = 0; ui32Byte < CRASH_RING_RAW_BYTES; ui32Byte++)
+        {
+            pcRaw[2 * ui32Byte] = pcHex[psSample->pui8Raw[ui32Byte] >> 4];
+            pcRaw[2 * ui32Byte + 1] = pcHex[psSample->pui8Raw[ui32Byte] & 15];
+        }
+        pcRaw[2 * CRASH_RING_RAW_BYTES] = 0;
+        UARTprintf("C %s %d %d %d %d %d\n", pcRaw, psSample->ui16Tick,
+                   psSample->pui16OmegaSq[0], psSample->pui16OmegaSq[1],
+                   psSample->pui16OmegaSq[2], psSample->pui16OmegaSq[3]);
+        UARTFlushTx(false);
+    }
+    UARTprintf("Crash capture end, set the crash arm parameter to record "
+               "again\n");
+    UARTFlushTx(false);
+}
+
 //*****************************************************************************
 //
 // MPU9150 Sensor callback function.  Called at the end of MPU9150 sensor
@@ -193,6 +474,116 @@ IntGPIOb(void)
     }
 }
 
+#ifdef HIL_BRIDGE
+//*****************************************************************************
+//
+// Called by the NVIC as a result of UART0 interrupt. A complete sensor frame
+// stands in for a finished MPU9150 read, and the motor frame is fed to the
+// transmit FIFO as it drains.
+//
+//*****************************************************************************
+void
+HilUARTIntHandler(void)
+{
+    UARTIntClear(UART0_BASE, UARTIntStatus(UART0_BASE, true));
+
+    while(UARTCharsAvail(UART0_BASE))
+    {
+        if(HilParse(&g_sHilParser, UARTCharGetNonBlocking(UART0_BASE)) ==
+           HIL_TYPE_SENSOR)
+        {
+            HilSensorDecode(g_sHilParser.pui8Frame, &g_sHilSensor);
+            g_ui32HilRxCycles = CycleCounterGet();
+            g_vui8I2CDoneFlag = 1;
+        }
+    }
+
+    while((g_vui32HilTxNext < HIL_MOTOR_LENGTH) &&
+          UARTCharPutNonBlocking(UART0_BASE, g_pui8HilTx[g_vui32HilTxNext]))
+    {
+        g_vui32HilTxNext++;
+    }
+}
+
+//*****************************************************************************
+//
+// Answers the last sensor frame with the ESC pulses. The answer is dropped
+// if the previous one is still being sent, the host counts it as lost.
+//
+//*****************************************************************************
+void
+HilMotorSend(tPWM *psPWM)
+{
+    tHilMotor sMotor;
+    uint32_t ui32Motor;
+
+    if(g_vui32HilTxNext < HIL_MOTOR_LENGTH)
+    {
+        return;
+    }
+
+    sMotor.ui8Seq = g_sHilSensor.ui8Seq;
+    sMotor.ui32HostTime = g_sHilSensor.ui32HostTime;
+    sMotor.ui32BoardCycles = g_ui32HilRxCycles;
+    sMotor.ui16ProcessUs = (uint16_t)((CycleCounterGet() - g_ui32HilRxCycles) /
+                                      (g_ui32CyclesPerMs / 1000));
+
+    //
+    // The PWM outputs are inverted, see PDContUpdatePWM().
+    //
+    for(ui32Motor = 0; ui32Motor < 4; ui32Motor++)
+    {
+        sMotor.pfPulse[ui32Motor] = 1.0f - psPWM->dutyCycles[ui32Motor];
+    }
+    HilMotorEncode(&sMotor, g_pui8HilTx);
+
+    //
+    // The first bytes go to the FIFO here, the interrupt sends the rest.
+    //
+    IntDisable(INT_UART0);
+    g_vui32HilTxNext = 0;
+    while((g_vui32HilTxNext < HIL_MOTOR_LENGTH) &&
+          UARTCharPutNonBlocking(UART0_BASE, g_pui8HilTx[g_vui32HilTxNext]))
+    {
+        g_vui32HilTxNext++;
+    }
+    IntEnable(INT_UART0);
+}
+#endif
+
+//*****************************************************************************
+//
+// Decodes the last sample in the body axes with the biases removed, from the
+// MPU9150 or from a sensor frame of the bridge. Returns false if the sample
+// is in the scale of a range the sensor just left.
+//
+//*****************************************************************************
+bool
+SampleGet(void)
+{
+#ifdef HIL_BRIDGE
+    uint32_t ui32Axis;
+
+    for(ui32Axis = 0; ui32Axis < 3; ui32Axis++)
+    {
+        g_sMPU9150Sample.pfAccel[ui32Axis] =
+            g_sHilSensor.pfAccel[ui32Axis] - g_pfHilAccelBias[ui32Axis];
+        g_sMPU9150Sample.pfGyro[ui32Axis] =
+            g_sHilSensor.pfGyro[ui32Axis] - g_pfHilGyroBias[ui32Axis];
+        g_sMPU9150Sample.pfMagneto[ui32Axis] =
+            g_sHilSensor.pfMagneto[ui32Axis];
+    }
+    g_sMPU9150Sample.bMagnetoValid = g_sHilSensor.bMagnetoValid;
+    g_sMPU9150Sample.fTemperature = g_sHilSensor.fTemperature;
+    g_sMPU9150Sample.i16Temperature =
+        (int16_t)((g_sHilSensor.fTemperature - 35.0f) * 340.0f);
+    return true;
+#else
+    MPU9150DataSampleGet(&g_sMPU9150Inst, &g_sMPU9150Sample);
+    return MPU9150DataValid(&g_sMPU9150Inst);
+#endif
+}
+
 //*****************************************************************************
 //
 // Called by the NVIC as a result of I2C3 Interrupt. I2C3 is the I2C connection
@@ -219,6 +610,12 @@ MPU9150I2CIntHandler(void)
 void
 MPU9150AppErrorHandler(char *pcFilename, uint_fast32_t ui32Line)
 {
+    //
+    // Freezes the crash capture; the samples before the error are kept
+    // until the next boot prints them.
+    //
+    CrashTrigger(CRASH_TRIGGER_I2C_ERROR);
+
     //
     // Set terminal color to red and print error status and locations
     //
@@ -246,8 +643,8 @@ MPU9150AppErrorHandler(char *pcFilename, uint_fast32_t ui32Line)
     RGBBlinkRateSet(10.0f);
 
     //
-    // Go to sleep wait for interventions.  A more robust application could
-    // attempt corrective actions here.
+    // Go to sleep wait for interventions. Only the configuration at boot
+    // gets here, in flight the bus recovery handles the errors.
     //
     while(1)
     {
@@ -293,56 +690,269 @@ MPU9150AppI2CWait(char *pcFilename, uint_fast32_t ui32Line)
 
 //*****************************************************************************
 //
-// This function sets up UART0 to be used for a console to display information
-// as the example is running.
+// Starts configuration transaction ui32Step of the MPU9150, at boot and
+// after a bus recovery.
 //
 //*****************************************************************************
-void
-InitConsole(void)
+uint_fast8_t
+MPU9150ConfigStep(uint32_t ui32Step, tSensorCallback *pfnCallback,
+                  void *pvCallbackData)
 {
-    //
-    // Enable GPIO port A which is used for UART0 pins.
-    // TODO: change this to whichever GPIO port you are using.
-    //
-    SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOA);
+    if(ui32Step == 0)
+    {
+        //
+        // Write application specific sensor configuration such as filter
+        // settings and sensor range settings.
+        //
+        g_sMPU9150Inst.pui8Data[0] = MPU9150_CONFIG_DLPF_CFG_94_98;
+        g_sMPU9150Inst.pui8Data[1] = MPU9150_GYRO_CONFIG_FS_SEL_250;
+        g_sMPU9150Inst.pui8Data[2] = (MPU9150_ACCEL_CONFIG_ACCEL_HPF_5HZ |
+                MPU9150_ACCEL_CONFIG_AFS_SEL_2G);
+        return(MPU9150Write(&g_sMPU9150Inst, MPU9150_O_CONFIG,
+                            g_sMPU9150Inst.pui8Data, 3, pfnCallback,
+                            pvCallbackData));
+    }
 
     //
-    // Configure the pin muxing for UART0 functions on port A0 and A1.
-    // This step is not necessary if your part does not support pin muxing.
-    // TODO: change this to select the port/pin you are using.
+    // Configure the data ready interrupt pin output of the MPU9150.
     //
-    GPIOPinConfigure(GPIO_PA0_U0RX);
-    GPIOPinConfigure(GPIO_PA1_U0TX);
+    g_sMPU9150Inst.pui8Data[0] = MPU9150_INT_PIN_CFG_INT_LEVEL |
+            MPU9150_INT_PIN_CFG_INT_RD_CLEAR |
+            MPU9150_INT_PIN_CFG_LATCH_INT_EN;
+    g_sMPU9150Inst.pui8Data[1] = MPU9150_INT_ENABLE_DATA_RDY_EN;
+    return(MPU9150Write(&g_sMPU9150Inst, MPU9150_O_INT_PIN_CFG,
+                        g_sMPU9150Inst.pui8Data, 2, pfnCallback,
+                        pvCallbackData));
+}
 
+//*****************************************************************************
+//
+// Bus lines of the I2C recovery, PA6 is SCL and PA7 is SDA. SDA is released
+// by making it an input, the pull-ups of the bus raise it.
+//
+//*****************************************************************************
+void
+I2CPinsAcquire(void)
+{
     //
-    // Enable UART0 so that we can configure the clock.
+    // No sample reads while the bus is down.
     //
-    SysCtlPeripheralEnable(SYSCTL_PERIPH_UART0);
+    GPIOIntDisable(GPIO_PORTB_BASE, GPIO_PIN_2);
+    IntDisable(INT_I2C1);
+    SysCtlPeripheralReset(SYSCTL_PERIPH_I2C1);
 
-    //
-    // Use the internal 16MHz oscillator as the UART clock source.
-    //
-    UARTClockSourceSet(UART0_BASE, UART_CLOCK_PIOSC);
+    GPIOPinTypeGPIOOutputOD(GPIO_PORTA_BASE, GPIO_PIN_6);
+    GPIOPinWrite(GPIO_PORTA_BASE, GPIO_PIN_6, GPIO_PIN_6);
+    ROM_GPIOPinTypeGPIOInput(GPIO_PORTA_BASE, GPIO_PIN_7);
+}
 
-    //
-    // Select the alternate (UART) function for these pins.
-    // TODO: change this to select the port/pin you are using.
-    //
-    GPIOPinTypeUART(GPIO_PORTA_BASE, GPIO_PIN_0 | GPIO_PIN_1);
+void
+I2CPinsSclSet(bool bHigh)
+{
+    GPIOPinWrite(GPIO_PORTA_BASE, GPIO_PIN_6, bHigh ? GPIO_PIN_6 : 0);
+}
+
+void
+I2CPinsSdaSet(bool bHigh)
+{
+    if(bHigh)
+    {
+        ROM_GPIOPinTypeGPIOInput(GPIO_PORTA_BASE, GPIO_PIN_7);
+    }
+    else
+    {
+        GPIOPinTypeGPIOOutputOD(GPIO_PORTA_BASE, GPIO_PIN_7);
+        GPIOPinWrite(GPIO_PORTA_BASE, GPIO_PIN_7, 0);
+    }
+}
+
+bool
+I2CPinsSdaGet(void)
+{
+    return(GPIOPinRead(GPIO_PORTA_BASE, GPIO_PIN_7) != 0);
+}
 
+void
+I2CPinsDelay(void)
+{
     //
-    // Initialize the UART for console I/O.
+    // Half a period of 100 kHz, SysCtlDelay() takes 3 cycles per count.
     //
-    UARTStdioConfig(0, 115200, 16000000);
+    ROM_SysCtlDelay(g_ui32CyclesPerMs / (3 * 200));
 }
 
+const tI2CBusPins g_sI2CBusPins =
+{
+    I2CPinsAcquire,
+    I2CPinsSclSet,
+    I2CPinsSdaSet,
+    I2CPinsSdaGet,
+    I2CPinsDelay
+};
+
 //*****************************************************************************
 //
-// Configure the UART and its pins.  This must be called before UARTprintf().
+// Callback of the recovery transactions.
 //
 //*****************************************************************************
 void
-ConfigureUART(void)
+MPU9150RecoverCallback(void *pvCallbackData, uint_fast8_t ui8Status)
+{
+    I2CRecoverDone((tI2CRecover *)pvCallbackData,
+                   ui8Status == I2CM_STATUS_SUCCESS);
+}
+
+//*****************************************************************************
+//
+// Recovery transactions: gives the pins back to the I2C peripheral and
+// resets the MPU9150, then writes its configuration again. The reset drops
+// the calibration of the driver, which is restored before the configuration.
+//
+//*****************************************************************************
+bool
+MPU9150RecoverStep(void *pvData, uint32_t ui32Step)
+{
+    uint_fast8_t ui8Axis;
+
+    if(ui32Step == 0)
+    {
+        GPIOPinTypeI2CSCL(GPIO_PORTA_BASE, GPIO_PIN_6);
+        ROM_GPIOPinTypeI2C(GPIO_PORTA_BASE, GPIO_PIN_7);
+        I2CMInit(&g_sI2CInst, I2C1_BASE, INT_I2C1, 0xff, 0xff,
+                 ROM_SysCtlClockGet());
+
+        g_sMPU9150Saved = g_sMPU9150Inst;
+        return(MPU9150Init(&g_sMPU9150Inst, &g_sI2CInst, MPU9150_I2C_ADDRESS,
+                           MPU9150RecoverCallback, pvData) != 0);
+    }
+
+    if(ui32Step == 1)
+    {
+        for(ui8Axis = 0; ui8Axis < 3; ui8Axis++)
+        {
+            g_sMPU9150Inst.pi32AccelBias[ui8Axis] =
+                g_sMPU9150Saved.pi32AccelBias[ui8Axis];
+            g_sMPU9150Inst.pi32GyroBias[ui8Axis] =
+                g_sMPU9150Saved.pi32GyroBias[ui8Axis];
+            g_sMPU9150Inst.pui8AxisMap[ui8Axis] =
+                g_sMPU9150Saved.pui8AxisMap[ui8Axis];
+            g_sMPU9150Inst.pi8AxisSign[ui8Axis] =
+                g_sMPU9150Saved.pi8AxisSign[ui8Axis];
+        }
+        g_sMPU9150Inst.ui32GyroSatCount = g_sMPU9150Saved.ui32GyroSatCount;
+        g_sMPU9150Inst.ui32AccelSatCount = g_sMPU9150Saved.ui32AccelSatCount;
+        g_sMPU9150Inst.ui32RangeChanges = g_sMPU9150Saved.ui32RangeChanges;
+        MPU9150AutoRangeSet(&g_sMPU9150Inst, g_sMPU9150Saved.ui8AutoRange);
+    }
+    else
+    {
+        //
+        // The data ready interrupt follows the last transaction.
+        //
+        GPIOIntClear(GPIO_PORTB_BASE, GPIO_PIN_2);
+        GPIOIntEnable(GPIO_PORTB_BASE, GPIO_PIN_2);
+    }
+
+    return(MPU9150ConfigStep(ui32Step - 1, MPU9150RecoverCallback,
+                             pvData) != 0);
+}
+
+//*****************************************************************************
+//
+// Watches the I2C bus while the main loop waits for a sample. An I2C error
+// or MPU9150 that stays silent starts a recovery. During the recovery the
+// main loop coasts at the sample rate; returns true when it is time for a
+// coasting step, which also advances the recovery.
+//
+//*****************************************************************************
+bool
+I2CWatch(void)
+{
+    uint32_t ui32Now = CycleCounterGet();
+
+    if(!I2CRecoverActive(&g_sI2CRecoverInst))
+    {
+        if(g_vui8ErrorFlag || ((ui32Now - g_ui32SampleStart) >
+                               I2C_RECOVER_SILENT_MS * g_ui32CyclesPerMs))
+        {
+            g_vui8ErrorFlag = 0;
+            CrashTrigger(CRASH_TRIGGER_I2C_ERROR);
+            I2CRecoverFault(&g_sI2CRecoverInst, ui32Now);
+        }
+        return(false);
+    }
+
+    if((ui32Now - g_ui32SampleStart) < 4 * g_ui32CyclesPerMs)
+    {
+        return(false);
+    }
+    g_ui32SampleStart = ui32Now;
+    I2CRecoverUpdate(&g_sI2CRecoverInst, ui32Now);
+    return(true);
+}
+
+//*****************************************************************************
+//
+// SysTick interrupt, it only wakes the main loop to watch the I2C bus.
+//
+//*****************************************************************************
+void
+SysTickIntHandler(void)
+{
+}
+
+//*****************************************************************************
+//
+// This function sets up UART0 to be used for a console to display information
+// as the example is running.
+//
+//*****************************************************************************
+void
+InitConsole(void)
+{
+    //
+    // Enable GPIO port A which is used for UART0 pins.
+    // TODO: change this to whichever GPIO port you are using.
+    //
+    SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOA);
+
+    //
+    // Configure the pin muxing for UART0 functions on port A0 and A1.
+    // This step is not necessary if your part does not support pin muxing.
+    // TODO: change this to select the port/pin you are using.
+    //
+    GPIOPinConfigure(GPIO_PA0_U0RX);
+    GPIOPinConfigure(GPIO_PA1_U0TX);
+
+    //
+    // Enable UART0 so that we can configure the clock.
+    //
+    SysCtlPeripheralEnable(SYSCTL_PERIPH_UART0);
+
+    //
+    // Use the internal 16MHz oscillator as the UART clock source.
+    //
+    UARTClockSourceSet(UART0_BASE, UART_CLOCK_PIOSC);
+
+    //
+    // Select the alternate (UART) function for these pins.
+    // TODO: change this to select the port/pin you are using.
+    //
+    GPIOPinTypeUART(GPIO_PORTA_BASE, GPIO_PIN_0 | GPIO_PIN_1);
+
+    //
+    // Initialize the UART for console I/O.
+    //
+    UARTStdioConfig(0, 115200, 16000000);
+}
+
+//*****************************************************************************
+//
+// Configure the UART and its pins.  This must be called before UARTprintf().
+//
+//*****************************************************************************
+void
+ConfigureUART(void)
 {
     //
     // Enable the GPIO Peripheral used by the UART.
@@ -366,10 +976,24 @@ ConfigureUART(void)
     //
     UARTClockSourceSet(UART0_BASE, UART_CLOCK_PIOSC);
 
+#ifdef HIL_BRIDGE
+    //
+    // Initialize the UART for the frames of the bridge. The receive timeout
+    // interrupt delivers the last bytes of a frame. main() enables the
+    // interrupt once the MPU9150 is configured.
+    //
+    UARTConfigSetExpClk(UART0_BASE, 16000000, HIL_BAUD,
+                        (UART_CONFIG_WLEN_8 | UART_CONFIG_STOP_ONE |
+                         UART_CONFIG_PAR_NONE));
+    UARTFIFOLevelSet(UART0_BASE, UART_FIFO_TX1_8, UART_FIFO_RX4_8);
+    HilParserInit(&g_sHilParser);
+    UARTIntEnable(UART0_BASE, UART_INT_RX | UART_INT_RT | UART_INT_TX);
+#else
     //
     // Initialize the UART for console I/O.
     //
     UARTStdioConfig(0, 115200, 16000000);
+#endif
 }
 
 //*****************************************************************************
@@ -380,6 +1004,8 @@ ConfigureUART(void)
 void
 ConfigureMPU6050()
 {
+    uint32_t ui32Step;
+
     //
     // Initialize convenience pointers that clean up and clarify the code
     // meaning. We want all the data in a single contiguous array so that
@@ -406,6 +1032,15 @@ ConfigureMPU6050()
     //
     UARTprintf("\033[2JMPU9150 Raw Example\n");
 
+    //
+    // Prints a crash capture that survived the reset, before the telemetry
+    // screen clears the terminal.
+    //
+    if(g_bCrashCaptured)
+    {
+        CrashCaptureDump();
+    }
+
     //
     // Set the color to a purple approximation.
     //
@@ -449,7 +1084,9 @@ ConfigureMPU6050()
     ROM_GPIOPinTypeGPIOInput(GPIO_PORTB_BASE, GPIO_PIN_2);
     GPIOIntEnable(GPIO_PORTB_BASE, GPIO_PIN_2);
     ROM_GPIOIntTypeSet(GPIO_PORTB_BASE, GPIO_PIN_2, GPIO_FALLING_EDGE);
+#ifndef HIL_BRIDGE
     ROM_IntEnable(INT_GPIOB);
+#endif
 
     //
     // Keep only some parts of the systems running while in sleep mode.
@@ -489,36 +1126,14 @@ ConfigureMPU6050()
     MPU9150AppI2CWait(__FILE__, __LINE__);
 
     //
-    // Write application specific sensor configuration such as filter settings
-    // and sensor range settings.
-    //
-    g_sMPU9150Inst.pui8Data[0] = MPU9150_CONFIG_DLPF_CFG_94_98;
-    g_sMPU9150Inst.pui8Data[1] = MPU9150_GYRO_CONFIG_FS_SEL_250;
-    g_sMPU9150Inst.pui8Data[2] = (MPU9150_ACCEL_CONFIG_ACCEL_HPF_5HZ |
-            MPU9150_ACCEL_CONFIG_AFS_SEL_2G);
-    MPU9150Write(&g_sMPU9150Inst, MPU9150_O_CONFIG, g_sMPU9150Inst.pui8Data, 3,
-                 MPU9150AppCallback, &g_sMPU9150Inst);
-
-    //
-    // Wait for transaction to complete
+    // Write the sensor configuration and wait for each transaction to
+    // complete.
     //
-    MPU9150AppI2CWait(__FILE__, __LINE__);
-
-    //
-    // Configure the data ready interrupt pin output of the MPU9150.
-    //
-    g_sMPU9150Inst.pui8Data[0] = MPU9150_INT_PIN_CFG_INT_LEVEL |
-            MPU9150_INT_PIN_CFG_INT_RD_CLEAR |
-            MPU9150_INT_PIN_CFG_LATCH_INT_EN;
-    g_sMPU9150Inst.pui8Data[1] = MPU9150_INT_ENABLE_DATA_RDY_EN;
-    MPU9150Write(&g_sMPU9150Inst, MPU9150_O_INT_PIN_CFG,
-                 g_sMPU9150Inst.pui8Data, 2, MPU9150AppCallback,
-                 &g_sMPU9150Inst);
-
-    //
-    // Wait for transaction to complete
-    //
-    MPU9150AppI2CWait(__FILE__, __LINE__);
+    for(ui32Step = 0; ui32Step < MPU9150_CONFIG_STEPS; ui32Step++)
+    {
+        MPU9150ConfigStep(ui32Step, MPU9150AppCallback, &g_sMPU9150Inst);
+        MPU9150AppI2CWait(__FILE__, __LINE__);
+    }
 
     //
     // Initialize the DCM system. 250 hz sample rate.
@@ -538,6 +1153,42 @@ ConfigureMPU6050()
             "\033[71GQ4\n\n");
     UARTprintf("Q\033[8G|\033[26G|\033[44G|\033[62G|\n\n");
 
+    //
+    // The screen is longer than the 1 kB transmit buffer of UARTStdio,
+    // which discards what does not fit, so its halves are sent in turn.
+    //
+    UARTFlushTx(false);
+    UARTprintf("\n\033[17GAck\033[26G|\033[35GID\033[44G|\033[53GSeq\033[62G|"
+            "\033[71GValue\n\n");
+    UARTprintf("Param\033[8G|\033[26G|\033[44G|\033[62G|\n\n");
+    UARTprintf("\n\033[20GLast\033[31G|\033[43GMax\033[54G|\033[66GMean\n\n");
+    UARTprintf("Cycles\033[8G|\033[31G|\033[54G|\n\n");
+    UARTprintf("\n\033[20GPeak 1\033[31G|\033[43GPeak 2\033[54G|"
+            "\033[66GMax cyc.\n\n");
+    UARTprintf("FFT\033[8G|\033[31G|\033[54G|\n\n");
+    UARTprintf("\n\033[20GGyro sat.\033[31G|\033[43GAccel sat.\033[54G|"
+            "\033[66GRange\n\n");
+    UARTprintf("IMU\033[8G|\033[31G|\033[54G|\n\n");
+    UARTprintf("\n\033[20GTemp. C\033[31G|\033[43GYaw drift\033[54G|"
+            "\033[66GFits\n\n");
+    UARTprintf("Bias\033[8G|\033[31G|\033[54G|\n\n");
+    UARTprintf("\n\033[20GField uT\033[31G|\033[43GHeading\033[54G|"
+            "\033[66GFits\n\n");
+    UARTprintf("Mag cal\033[8G|\033[31G|\033[54G|\n\n");
+    UARTprintf("\n\033[20GState\033[31G|\033[43GKp\033[54G|"
+            "\033[66GKd\n\n");
+    UARTprintf("Tune\033[8G|\033[31G|\033[54G|\n\n");
+    UARTprintf("\n\033[20GUsed kB\033[31G|\033[43GRecords\033[54G|"
+            "\033[66GDropped\n\n");
+    UARTprintf("Log\033[8G|\033[31G|\033[54G|\n\n");
+    UARTprintf("\n\033[20GCause\033[31G|\033[43GSamples\033[54G|"
+            "\033[66GPost\n\n");
+    UARTprintf("Crash\033[8G|\033[31G|\033[54G|\n\n");
+    UARTprintf("\n\033[20GOutages\033[31G|\033[43GLast ms\033[54G|"
+            "\033[66GMax ms\n\n");
+    UARTprintf("I2C\033[8G|\033[31G|\033[54G|\n\n");
+    UARTFlushTx(false);
+
     //
     // Enable blinking indicates config finished successfully
     //
@@ -552,14 +1203,18 @@ ConfigureMPU6050()
 //
 //*****************************************************************************
 void
-CalibrateIMU(float * biasWx, float * biasWy, float * biasWz,
-             float * biasAx, float * biasAy, float * biasAz)
+CalibrateIMU(void)
 {
-    float gyro[3];
-    float accel[3];
     float gyroBias[3] = {};
     float accelBias[3] = {};
+    float temperature = 0.0f;
     int i;
+
+    //
+    // Measure without any bias applied by the driver.
+    //
+    MPU9150BiasSet(&g_sMPU9150Inst, accelBias, gyroBias);
+
     for (i = 0; i < GYRO_BIAS_SAMPLES; i++)
     {
         while(!g_vui8I2CDoneFlag)
@@ -573,33 +1228,468 @@ CalibrateIMU(float * biasWx, float * biasWy, float * biasWz,
         g_vui8I2CDoneFlag = 0;
 
         //
-        // Get floating point version of angular velocities in rad/sec
+        // Get angular velocities in rad/sec and acceleration in m/sec^2
         //
-        MPU9150DataGyroGetFloat(&g_sMPU9150Inst, gyro, gyro + 1,
-                                gyro + 2);
+        SampleGet();
 
-        //
-        // Get floating point version of acceleration in m/sec^2
-        //
-        MPU9150DataAccelGetFloat(&g_sMPU9150Inst, accel, accel + 1,
-                                accel + 2);
+        gyroBias[0] += g_sMPU9150Sample.pfGyro[0];
+        gyroBias[1] += g_sMPU9150Sample.pfGyro[1];
+        gyroBias[2] += g_sMPU9150Sample.pfGyro[2];
+        temperature += g_sMPU9150Sample.fTemperature;
+    }
 
-        gyroBias[0] += gyro[0];
-        gyroBias[1] += gyro[1];
-        gyroBias[2] += gyro[2];
-        accelBias[0] += accel[0];
-        accelBias[1] += accel[1];
-        accelBias[2] += accel[2];
+    gyroBias[0] /= GYRO_BIAS_SAMPLES;
+    gyroBias[1] /= GYRO_BIAS_SAMPLES;
+    gyroBias[2] /= GYRO_BIAS_SAMPLES;
+    temperature /= GYRO_BIAS_SAMPLES;
+
+    //
+    // The driver removes the biases from every sample from now on, in the
+    // integer domain. The DCM biases stay at zero.
+    //
+    // DEBUGGING: no accelerometer bias.
+    //
+    MPU9150BiasSet(&g_sMPU9150Inst, accelBias, gyroBias);
+#ifdef HIL_BRIDGE
+    for(i = 0; i < 3; i++)
+    {
+        g_pfHilAccelBias[i] = accelBias[i];
+        g_pfHilGyroBias[i] = gyroBias[i];
     }
+#endif
 
-    *biasWx = gyroBias[0] / GYRO_BIAS_SAMPLES;
-    *biasWy = gyroBias[1] / GYRO_BIAS_SAMPLES;
-    *biasWz = gyroBias[2] / GYRO_BIAS_SAMPLES;
+    //
+    // The bias model starts from the calibration and supplies the drift
+    // away from it as the board warms up.
+    //
+    GyroTempBaseSet(&g_sGyroTempInst, temperature, gyroBias);
+}
 
-    // DEBUGGING
-    *biasAx = 0.0;
-    *biasAy = 0.0;
-    *biasAz = 0.0;
+#ifdef PERF_BENCHMARKS
+//*****************************************************************************
+//
+// Number of conversions or updates timed by the benchmarks.
+//
+//*****************************************************************************
+#define BENCHMARK_CONVERSIONS       1000
+
+//*****************************************************************************
+//
+// Times the conversion of the last data read, the three calls of the
+// accelerometer, gyroscope and magnetometer against the single pass decoding,
+// and prints the mean cycle counts per sample.
+//
+//*****************************************************************************
+void
+BenchmarkSensorConversion(void)
+{
+    uint32_t ui32Start, ui32Calls, ui32Fused;
+    int i;
+
+    ui32Start = CycleCounterGet();
+    for (i = 0; i < BENCHMARK_CONVERSIONS; i++)
+    {
+        MPU9150DataAccelGetFloat(&g_sMPU9150Inst, pfAccel, pfAccel + 1,
+                                 pfAccel + 2);
+        MPU9150DataGyroGetFloat(&g_sMPU9150Inst, pfGyro, pfGyro + 1,
+                                pfGyro + 2);
+        MPU9150DataMagnetoGetFloat(&g_sMPU9150Inst, pfMag, pfMag + 1,
+                                   pfMag + 2);
+    }
+    ui32Calls = CycleCounterGet() - ui32Start;
+
+    ui32Start = CycleCounterGet();
+    for (i = 0; i < BENCHMARK_CONVERSIONS; i++)
+    {
+        MPU9150DataSampleGet(&g_sMPU9150Inst, &g_sMPU9150Sample);
+    }
+    ui32Fused = CycleCounterGet() - ui32Start;
+
+    UARTprintf("\033[54;1HConversion cycles per sample: three calls %d, "
+               "single pass %d\n", ui32Calls / BENCHMARK_CONVERSIONS,
+               ui32Fused / BENCHMARK_CONVERSIONS);
+}
+
+//*****************************************************************************
+//
+// Times CompDCMUpdate() with each attitude filter on the last sample, on a
+// copy of the DCM state, and prints the mean cycle counts per update.
+//
+//*****************************************************************************
+void
+BenchmarkAttitudeFilters(void)
+{
+    static tCompDCM sDCM;
+    uint32_t pui32Cycles[3], ui32Start;
+    uint_fast8_t ui8Mode;
+    int i;
+
+    for (ui8Mode = COMP_DCM_MODE_COMPLEMENTARY; ui8Mode <= COMP_DCM_MODE_EKF;
+         ui8Mode++)
+    {
+        CompDCMInit(&sDCM, 1.0f / 250.0f, 0.0f, 0.0f, 0.0f);
+        CompDCMModeSet(&sDCM, ui8Mode);
+        CompDCMAccelUpdate(&sDCM, g_sMPU9150Sample.pfAccel[0],
+                           g_sMPU9150Sample.pfAccel[1],
+                           g_sMPU9150Sample.pfAccel[2]);
+        CompDCMGyroUpdate(&sDCM, g_sMPU9150Sample.pfGyro[0],
+                          g_sMPU9150Sample.pfGyro[1],
+                          g_sMPU9150Sample.pfGyro[2]);
+        CompDCMStart(&sDCM);
+
+        ui32Start = CycleCounterGet();
+        for (i = 0; i < BENCHMARK_CONVERSIONS; i++)
+        {
+            CompDCMUpdate(&sDCM);
+        }
+        pui32Cycles[ui8Mode] = ((CycleCounterGet() - ui32Start) /
+                                BENCHMARK_CONVERSIONS);
+    }
+
+    UARTprintf("\033[55;1HAttitude filter cycles per update: complementary "
+               "%d, Mahony %d, EKF %d\n", pui32Cycles[0], pui32Cycles[1],
+               pui32Cycles[2]);
+}
+
+//*****************************************************************************
+//
+// Times ControllerUpdate() with each controller on the last sample, 0.1 rad
+// away from the setpoint on every axis, and prints the mean cycle counts per
+// update.
+//
+//*****************************************************************************
+void
+BenchmarkControllers(void)
+{
+    static tPDController sPD;
+    static tCompDCM sDCM;
+    uint32_t pui32Cycles[4], ui32Start;
+    uint8_t ui8Mode;
+    int i;
+
+    CompDCMInit(&sDCM, 1.0f / 250.0f, 0.0f, 0.0f, 0.0f);
+    CompDCMAccelUpdate(&sDCM, g_sMPU9150Sample.pfAccel[0],
+                       g_sMPU9150Sample.pfAccel[1],
+                       g_sMPU9150Sample.pfAccel[2]);
+    CompDCMGyroUpdate(&sDCM, g_sMPU9150Sample.pfGyro[0],
+                      g_sMPU9150Sample.pfGyro[1],
+                      g_sMPU9150Sample.pfGyro[2]);
+    CompDCMStart(&sDCM);
+
+    for (ui8Mode = CONTROLLER_MODE_PD; ui8Mode <= CONTROLLER_MODE_INDI;
+         ui8Mode++)
+    {
+        InitPDController(&sPD);
+        sPD.ui8Mode = ui8Mode;
+        for (i = 0; i < 3; i++)
+        {
+            sPD.fDesState[i] = sDCM.fEuler[i] + 0.1f;
+        }
+
+        ui32Start = CycleCounterGet();
+        for (i = 0; i < BENCHMARK_CONVERSIONS; i++)
+        {
+            ControllerUpdate(&sPD, &sDCM);
+        }
+        pui32Cycles[ui8Mode] = ((CycleCounterGet() - ui32Start) /
+                                BENCHMARK_CONVERSIONS);
+    }
+
+    UARTprintf("\033[56;1HController cycles per update: PD %d, cascade %d, "
+               "geometric %d, INDI %d\n", pui32Cycles[0], pui32Cycles[1],
+               pui32Cycles[2], pui32Cycles[3]);
+}
+#endif
+
+//*****************************************************************************
+//
+// Parameter callback, recomputes the filters after a cutoff was changed.
+//
+//*****************************************************************************
+bool
+ParamFiltersChanged(void *pvCallbackData)
+{
+    ControllerFiltersUpdate((tPDController *)pvCallbackData);
+    return true;
+}
+
+//*****************************************************************************
+//
+// Parameter callback, switches the attitude filter.
+//
+//*****************************************************************************
+bool
+ParamAttitudeFilterChanged(void *pvCallbackData)
+{
+    CompDCMModeSet((tCompDCM *)pvCallbackData,
+                   (uint_fast8_t)g_fAttitudeFilter);
+    return true;
+}
+
+//*****************************************************************************
+//
+// Parameter callback, starts or stops the auto-tune. The tuner only runs in
+// the PD controller, whose gains it tunes.
+//
+//*****************************************************************************
+bool
+ParamAutotuneChanged(void *pvCallbackData)
+{
+    tPDController *psPD = (tPDController *)pvCallbackData;
+
+    if((g_fAutotune >= 1.0f) && (psPD->ui8Mode == CONTROLLER_MODE_PD))
+    {
+        AutotuneStart(&psPD->sTune, 1.0f / 250.0f);
+    }
+    else
+    {
+        AutotuneStop(&psPD->sTune);
+        g_fAutotune = 0.0f;
+    }
+    return true;
+}
+
+//*****************************************************************************
+//
+// Stores the gains of a completed auto-tune through the parameter store, so
+// they are range checked like gains set over the radio.
+//
+//*****************************************************************************
+void
+AutotuneStore(void)
+{
+    tAutotune *psTune = &g_sPDControllerInst.sTune;
+
+    if(psTune->ui8State == AUTOTUNE_DONE)
+    {
+        ParamSet(&g_sParamInst, PARAM_ID_KP, psTune->fKp);
+        ParamSet(&g_sParamInst, PARAM_ID_KD, psTune->fKd);
+        psTune->ui8State = AUTOTUNE_IDLE;
+        g_fAutotune = 0.0f;
+    }
+    else if(psTune->ui8State == AUTOTUNE_FAILED)
+    {
+        g_fAutotune = 0.0f;
+    }
+}
+
+//*****************************************************************************
+//
+// Parameter callback, erases the flight recorder. The erase stalls the main
+// loop for every page, so it is refused unless the thrust is at its minimum.
+//
+//*****************************************************************************
+bool
+ParamLogEraseChanged(void *pvCallbackData)
+{
+    if(g_fLogErase < 1.0f)
+    {
+        return true;
+    }
+    if(!ControllerIdle(&g_sPDControllerInst))
+    {
+        return false;
+    }
+    BlackBoxErase((tBlackBox *)pvCallbackData);
+    g_fLogErase = 0.0f;
+    return true;
+}
+
+//*****************************************************************************
+//
+// Parameter callback, records every g_fLogDivider-th main loop sample.
+//
+//*****************************************************************************
+bool
+ParamLogDividerChanged(void *pvCallbackData)
+{
+    BlackBoxDividerSet((tBlackBox *)pvCallbackData,
+                       (uint32_t)(g_fLogDivider + 0.5f));
+    return true;
+}
+
+//*****************************************************************************
+//
+// Parameter callback, drops the crash capture and records again.
+//
+//*****************************************************************************
+bool
+ParamCrashArmChanged(void *pvCallbackData)
+{
+    if(g_fCrashArm >= 1.0f)
+    {
+        CrashRingArm((tCrashRing *)pvCallbackData);
+    }
+    g_fCrashArm = 0.0f;
+    return true;
+}
+
+//*****************************************************************************
+//
+// Adds the state of this main loop iteration to the flight recorder. The
+// flags are the MIXER_SAT_* bits, the auto-tune state in bits 4 and 5 and
+// the I2C outage in bit 8. Nothing is recorded while the controller idles
+// on the ground, the tick keeps counting so the decoder sees the gap.
+//
+//*****************************************************************************
+void
+BlackBoxRecord(void)
+{
+    tFlightLogSample sSample;
+    uint32_t ui32Now = CycleCounterGet();
+    int i;
+
+    sSample.ui32Tick = g_ui32LoopTick++;
+    sSample.ui32LoopCycles = ui32Now - g_ui32LoopStart;
+    sSample.ui32CtrlCycles = g_sControllerPerf.ui32Last;
+    g_ui32LoopStart = ui32Now;
+
+    if(ControllerIdle(&g_sPDControllerInst))
+    {
+        return;
+    }
+
+    for(i = 0; i < 3; i++)
+    {
+        sSample.pfGyro[i] = g_sCompDCMInst.pfGyro[i];
+        sSample.pfAccel[i] = g_sCompDCMInst.pfAccel[i];
+        sSample.pfEuler[i] = g_sCompDCMInst.fEuler[i];
+        sSample.pfDesState[i] = g_sPDControllerInst.fDesState[i];
+    }
+    sSample.fThrustZDir = g_sPDControllerInst.fThrustZDir;
+    for(i = 0; i < 4; i++)
+    {
+        sSample.pfOmegaSq[i] = g_sPDControllerInst.sMotor.fOmegaSqCmd[i];
+    }
+    sSample.fBatteryV = g_sPDControllerInst.fBatteryV;
+    sSample.ui32Flags = g_sPDControllerInst.ui8MixerSat |
+            (g_sPDControllerInst.sTune.ui8State << 4) |
+            (I2CRecoverActive(&g_sI2CRecoverInst) << 8);
+
+    BlackBoxAdd(&g_sBlackBoxInst, &sSample);
+}
+
+//*****************************************************************************
+//
+// Parameter callback, a node of the gyro bias model that was set over the
+// radio counts as fitted.
+//
+//*****************************************************************************
+bool
+ParamGyroTempChanged(void *pvCallbackData)
+{
+    float *pfCount = (float *)pvCallbackData;
+    if(*pfCount < 1.0f)
+    {
+        *pfCount = 1.0f;
+    }
+    return true;
+}
+
+//*****************************************************************************
+//
+// Registers the parameters that can be tuned over the radio.
+//
+//*****************************************************************************
+void
+ConfigureParams(void)
+{
+    InitParamStore(&g_sParamInst);
+
+    ParamRegister(&g_sParamInst, PARAM_ID_KP, &g_sPDControllerInst.fKp,
+                  0.0f, AUTOTUNE_MAX_KP);
+    ParamRegister(&g_sParamInst, PARAM_ID_KD, &g_sPDControllerInst.fKd,
+                  0.0f, AUTOTUNE_MAX_KD);
+    ParamRegister(&g_sParamInst, PARAM_ID_KI, &g_sPDControllerInst.fKi,
+                  0.0f, 100.0f);
+    ParamRegister(&g_sParamInst, PARAM_ID_AUTOTUNE, &g_fAutotune,
+                  0.0f, 1.0f);
+    ParamCallbackSet(&g_sParamInst, PARAM_ID_AUTOTUNE, ParamAutotuneChanged,
+                     &g_sPDControllerInst);
+    ParamRegister(&g_sParamInst, PARAM_ID_LOG_ERASE, &g_fLogErase,
+                  0.0f, 1.0f);
+    ParamCallbackSet(&g_sParamInst, PARAM_ID_LOG_ERASE, ParamLogEraseChanged,
+                     &g_sBlackBoxInst);
+    ParamRegister(&g_sParamInst, PARAM_ID_LOG_DIVIDER, &g_fLogDivider,
+                  1.0f, BLACKBOX_MAX_DIVIDER);
+    ParamCallbackSet(&g_sParamInst, PARAM_ID_LOG_DIVIDER,
+                     ParamLogDividerChanged, &g_sBlackBoxInst);
+    ParamRegister(&g_sParamInst, PARAM_ID_CRASH_TRIGGERS, &g_fCrashTriggers,
+                  0.0f, CRASH_TRIGGER_ALL);
+    ParamRegister(&g_sParamInst, PARAM_ID_CRASH_ATT_ERROR, &g_fCrashAttError,
+                  0.1f, 3.2f);
+    ParamRegister(&g_sParamInst, PARAM_ID_CRASH_ARM, &g_fCrashArm,
+                  0.0f, 1.0f);
+    ParamCallbackSet(&g_sParamInst, PARAM_ID_CRASH_ARM, ParamCrashArmChanged,
+                     &g_sCrashRing);
+
+    //
+    // Cascaded controller gains, one set per axis.
+    //
+    tCascade *psCas = &g_sPDControllerInst.sCascade;
+    int i;
+    for (i = 0; i < 3; i++)
+    {
+        ParamRegister(&g_sParamInst, PARAM_ID_ANGLE_KP_ROLL + i,
+                      &psCas->fAngleKp[i], 0.0f, 20.0f);
+        ParamRegister(&g_sParamInst, PARAM_ID_RATE_KP_ROLL + i,
+                      &psCas->fRateKp[i], 0.0f, 200.0f);
+        ParamRegister(&g_sParamInst, PARAM_ID_RATE_KI_ROLL + i,
+                      &psCas->fRateKi[i], 0.0f, 200.0f);
+        ParamRegister(&g_sParamInst, PARAM_ID_RATE_KD_ROLL + i,
+                      &psCas->fRateKd[i], 0.0f, 10.0f);
+    }
+    ParamRegister(&g_sParamInst, PARAM_ID_INDI_RATE_KP,
+                  &g_sPDControllerInst.sIndi.fRateKp, 0.0f, 200.0f);
+
+    //
+    // Gyro and D term filters, limited to below the 125 Hz Nyquist
+    // frequency. A frequency of 0 disables a filter.
+    //
+    ParamRegister(&g_sParamInst, PARAM_ID_GYRO_LPF_HZ,
+                  &g_sPDControllerInst.fGyroLpfHz, 0.0f, 120.0f);
+    ParamRegister(&g_sParamInst, PARAM_ID_DTERM_LPF_HZ,
+                  &g_sPDControllerInst.fDTermLpfHz, 0.0f, 120.0f);
+    ParamRegister(&g_sParamInst, PARAM_ID_NOTCH_HZ,
+                  &g_sPDControllerInst.fNotchHz, 0.0f, 120.0f);
+    ParamRegister(&g_sParamInst, PARAM_ID_NOTCH_Q,
+                  &g_sPDControllerInst.fNotchQ, 0.5f, 20.0f);
+    ParamRegister(&g_sParamInst, PARAM_ID_DYN_NOTCH,
+                  &g_sPDControllerInst.fDynNotch, 0.0f, 1.0f);
+    for (i = PARAM_ID_GYRO_LPF_HZ; i <= PARAM_ID_DYN_NOTCH; i++)
+    {
+        ParamCallbackSet(&g_sParamInst, i, ParamFiltersChanged,
+                         &g_sPDControllerInst);
+    }
+
+    //
+    // Attitude filter, the gains of the Mahony filter and of the
+    // magnetometer heading correction.
+    //
+    ParamRegister(&g_sParamInst, PARAM_ID_ATT_FILTER, &g_fAttitudeFilter,
+                  COMP_DCM_MODE_COMPLEMENTARY, COMP_DCM_MODE_EKF);
+    ParamCallbackSet(&g_sParamInst, PARAM_ID_ATT_FILTER,
+                     ParamAttitudeFilterChanged, &g_sCompDCMInst);
+    ParamRegister(&g_sParamInst, PARAM_ID_MAHONY_KP, &g_sCompDCMInst.fKp,
+                  0.0f, 20.0f);
+    ParamRegister(&g_sParamInst, PARAM_ID_MAHONY_KI, &g_sCompDCMInst.fKi,
+                  0.0f, 2.0f);
+    ParamRegister(&g_sParamInst, PARAM_ID_MAG_KM, &g_sCompDCMInst.fKm,
+                  0.0f, 2.0f);
+
+    //
+    // Gyro bias model, three axes per temperature node. The ground station
+    // reads the table back with NaN requests and restores the fitted, non
+    // zero nodes after a power cycle; a node that is set counts as fitted.
+    //
+    for (i = 0; i < GYRO_TEMP_POINTS * 3; i++)
+    {
+        ParamRegister(&g_sParamInst, PARAM_ID_GYRO_TEMP_BIAS + i,
+                      &g_sGyroTempInst.ppfBias[i / 3][i % 3], -0.5f, 0.5f);
+        ParamCallbackSet(&g_sParamInst, PARAM_ID_GYRO_TEMP_BIAS + i,
+                         ParamGyroTempChanged,
+                         &g_sGyroTempInst.pfCount[i / 3]);
+    }
 }
 
 //*****************************************************************************
@@ -617,6 +1707,17 @@ main(void)
                        SYSCTL_OSC_MAIN);
     ROM_SysCtlPWMClockSet(SYSCTL_PWMDIV_64);
 
+    //
+    // Enables the cycle counter used for profiling.
+    //
+    InitCycleCounter();
+    PerfStatReset(&g_sControllerPerf);
+
+    //
+    // Keeps a crash capture of before the reset, or starts recording one.
+    //
+    g_bCrashCaptured = CrashRingInit(&g_sCrashRing);
+
     //
     // Initialize PWM.
     //
@@ -637,17 +1738,73 @@ main(void)
     //
     ConfigureMPU6050();
 
+#ifdef HIL_BRIDGE
+    //
+    // Sensor frames stand in for the MPU9150 reads from now on. Until here
+    // the done flag belonged to the configuration of the MPU9150.
+    //
+    IntEnable(INT_UART0);
+#endif
+
     //
     // Measures gyroscope bias.
     //
-    CalibrateIMU(g_sCompDCMInst.fGyroBias, g_sCompDCMInst.fGyroBias + 1, g_sCompDCMInst.fGyroBias + 2,
-                 g_sCompDCMInst.fAccelBias, g_sCompDCMInst.fAccelBias + 1, g_sCompDCMInst.fAccelBias + 2);
+    GyroTempInit(&g_sGyroTempInst);
+    MagCalInit(&g_sMagCalInst);
+    CalibrateIMU();
+
+#ifdef PERF_BENCHMARKS
+    //
+    // Compares the sensor conversion paths, the attitude filters and the
+    // controllers on the calibration data.
+    //
+    BenchmarkSensorConversion();
+    BenchmarkAttitudeFilters();
+    BenchmarkControllers();
+#endif
+
+    //
+    // From now on the driver moves to a larger range when the gyro or the
+    // accelerometer saturates, and back once the motion is over.
+    //
+    MPU9150AutoRangeSet(&g_sMPU9150Inst, MPU9150_AUTO_RANGE_GYRO |
+                        MPU9150_AUTO_RANGE_ACCEL);
 
     //
     // Initialize PD controller for hovering.
     //
     InitPDController(&g_sPDControllerInst);
 
+    //
+    // Registers the runtime tunable parameters.
+    //
+    ConfigureParams();
+
+    //
+    // Starts a new session of the flight recorder after the recorded ones.
+    //
+    BlackBoxInit(&g_sBlackBoxInst);
+    g_ui32LoopStart = CycleCounterGet();
+
+    //
+    // Watches the I2C bus from the main loop. SysTick wakes the loop every
+    // ms while it waits for a sample.
+    //
+    g_ui32CyclesPerMs = ROM_SysCtlClockGet() / 1000;
+    I2CRecoverInit(&g_sI2CRecoverInst, &g_sI2CBusPins, MPU9150RecoverStep,
+                   &g_sI2CRecoverInst, MPU9150_CONFIG_STEPS + 1,
+                   g_ui32CyclesPerMs);
+    ROM_SysTickPeriodSet(g_ui32CyclesPerMs);
+    ROM_SysTickIntEnable();
+    ROM_SysTickEnable();
+    g_ui32SampleStart = CycleCounterGet();
+
+    //
+    // Initialize the gyro vibration analysis.
+    //
+    GyroFFTInit(&g_sGyroFFTInst, 250.0f, DYN_NOTCH_MIN_HZ, DYN_NOTCH_MAX_HZ);
+    PerfStatReset(&g_sGyroFFTPerf);
+
     // DEBUGGING
     SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOC);
     GPIOPinTypeGPIOOutput(GPIO_PORTC_BASE, GPIO_PIN_4);
@@ -662,71 +1819,134 @@ main(void)
         //
 
         //
-        // Go to sleep mode while waiting for data ready.
+        // Go to sleep mode while waiting for data ready. SysTick wakes the
+        // loop every ms to watch the I2C bus; while the bus recovers the
+        // loop coasts without samples.
         //
+        bool bCoast = false;
+        bool bSampleValid = false;
         while(!g_vui8I2CDoneFlag)
         {
+            if(I2CWatch())
+            {
+                bCoast = true;
+                break;
+            }
             ROM_SysCtlSleep();
         }
 
-        // DEBUGGING
-        GPIOPinWrite(GPIO_PORTC_BASE, GPIO_PIN_4, 0x10);
-        SysCtlDelay(0.0001 * SysCtlClockGet() / 3);
-        GPIOPinWrite(GPIO_PORTC_BASE, GPIO_PIN_4, 0x0);
-
         //
-        // Clears the flag.
+        // Without a sample the attitude estimate and the motor commands
+        // are held, see the controller below.
         //
-        g_vui8I2CDoneFlag = 0;
+        if(!bCoast)
+        {
+            // DEBUGGING
+            GPIOPinWrite(GPIO_PORTC_BASE, GPIO_PIN_4, 0x10);
+            SysCtlDelay(0.0001 * SysCtlClockGet() / 3);
+            GPIOPinWrite(GPIO_PORTC_BASE, GPIO_PIN_4, 0x0);
 
-        //
-        // Get floating point version of the Accel Data in m/s^2.
-        //
-        MPU9150DataAccelGetFloat(&g_sMPU9150Inst, pfAccel, pfAccel + 1,
-                                 pfAccel + 2);
+            //
+            // Clears the flag. A sample ends a recovery of the bus.
+            //
+            g_vui8I2CDoneFlag = 0;
+            g_ui32SampleStart = CycleCounterGet();
+            if(I2CRecoverSample(&g_sI2CRecoverInst, g_ui32SampleStart))
+            {
+                g_bI2CFailsafe = false;
+            }
 
-        //
-        // Get floating point version of angular velocities in rad/sec
-        //
-        MPU9150DataGyroGetFloat(&g_sMPU9150Inst, pfGyro, pfGyro + 1,
-                                pfGyro + 2);
+            //
+            // Decode the accel data in m/s^2, the bias free angular velocities
+            // in rad/sec and the magnetic field strength in tesla.
+            //
+            bSampleValid = SampleGet();
 
-        //
-        // Get floating point version of magnetic fields strength in tesla
-        //
-        MPU9150DataMagnetoGetFloat(&g_sMPU9150Inst, pfMag, pfMag + 1,
-                                   pfMag + 2);
+            //
+            // Fits the gyro bias model while the board rests, and lets the DCM
+            // remove the drift of the bias since the boot calibration.
+            //
+            if(bSampleValid)
+            {
+                GyroTempUpdate(&g_sGyroTempInst, g_sMPU9150Sample.pfGyro,
+                               g_sMPU9150Sample.pfAccel,
+                               g_sMPU9150Sample.fTemperature);
+            }
+            GyroTempCorrectionGet(&g_sGyroTempInst,
+                                  g_sMPU9150Sample.fTemperature,
+                                  g_sCompDCMInst.fGyroBias);
 
-        //
-        // Check if this is our first data ever.
-        //
-        if(ui32CompDCMStarted == 0)
-        {
             //
-            // Set flag indicating that DCM is started.
-            // Perform the seeding of the DCM with the first data set.
-            //
-            ui32CompDCMStarted = 1;
-            CompDCMMagnetoUpdate(&g_sCompDCMInst, pfMag[0], pfMag[1],
-                                 pfMag[2]);
-            CompDCMAccelUpdate(&g_sCompDCMInst, pfAccel[0], pfAccel[1],
-                               pfAccel[2]);
-            CompDCMGyroUpdate(&g_sCompDCMInst, pfGyro[0], pfGyro[1],
-                              pfGyro[2]);
-            CompDCMStart(&g_sCompDCMInst);
-        }
-        else
-        {
+            // Check if this is our first data ever.
+            //
+            if(ui32CompDCMStarted == 0)
+            {
+                //
+                // Set flag indicating that DCM is started.
+                // Perform the seeding of the DCM with the first data set.
+                //
+                ui32CompDCMStarted = 1;
+                CompDCMMagnetoUpdate(&g_sCompDCMInst,
+                                     g_sMPU9150Sample.pfMagneto[0],
+                                     g_sMPU9150Sample.pfMagneto[1],
+                                     g_sMPU9150Sample.pfMagneto[2]);
+                CompDCMAccelUpdate(&g_sCompDCMInst, g_sMPU9150Sample.pfAccel[0],
+                                   g_sMPU9150Sample.pfAccel[1],
+                                   g_sMPU9150Sample.pfAccel[2]);
+                CompDCMGyroUpdate(&g_sCompDCMInst, g_sMPU9150Sample.pfGyro[0],
+                                  g_sMPU9150Sample.pfGyro[1],
+                                  g_sMPU9150Sample.pfGyro[2]);
+                CompDCMStart(&g_sCompDCMInst);
+            }
+            else
+            {
+                //
+                // DCM Is already started.  Perform the incremental update.
+                //
+                // Right after a range change the sensor data may still be in
+                // the old scale. The DCM keeps its previous accel and gyro data
+                // until the sensor settled.
+                //
+                if(bSampleValid)
+                {
+                    CompDCMAccelUpdate(&g_sCompDCMInst,
+                                       g_sMPU9150Sample.pfAccel[0],
+                                       g_sMPU9150Sample.pfAccel[1],
+                                       g_sMPU9150Sample.pfAccel[2]);
+                    CompDCMGyroUpdate(&g_sCompDCMInst,
+                                      g_sMPU9150Sample.pfGyro[0],
+                                      g_sMPU9150Sample.pfGyro[1],
+                                      g_sMPU9150Sample.pfGyro[2]);
+                }
+                CompDCMUpdate(&g_sCompDCMInst);
+
+                //
+                // The magnetometer path runs only when the AK8975 delivered a
+                // new reading. The reading feeds the calibration and, once
+                // calibrated and of a plausible strength, corrects the heading.
+                //
+                g_ui32MagTicks++;
+                if(g_sMPU9150Sample.bMagnetoValid)
+                {
+                    float pfMagCal[3];
+
+                    MagCalAddSample(&g_sMagCalInst, g_sMPU9150Sample.pfMagneto);
+                    if(MagCalApply(&g_sMagCalInst, g_sMPU9150Sample.pfMagneto,
+                                   pfMagCal))
+                    {
+                        CompDCMMagnetoUpdate(&g_sCompDCMInst, pfMagCal[0],
+                                             pfMagCal[1], pfMagCal[2]);
+                        CompDCMMagnetoFuse(&g_sCompDCMInst,
+                                           g_ui32MagTicks * (1.0f / 250.0f));
+                    }
+                    g_ui32MagTicks = 0;
+                }
+            }
+
             //
-            // DCM Is already started.  Perform the incremental update.
+            // Feeds the unfiltered, bias free gyro to the vibration analysis.
             //
-            CompDCMMagnetoUpdate(&g_sCompDCMInst, pfMag[0], pfMag[1],
-                                 pfMag[2]);
-            CompDCMAccelUpdate(&g_sCompDCMInst, pfAccel[0], pfAccel[1],
-                               pfAccel[2]);
-            CompDCMGyroUpdate(&g_sCompDCMInst, pfGyro[0], pfGyro[1],
-                              pfGyro[2]);
-            CompDCMUpdate(&g_sCompDCMInst);
+            GyroFFTAddSample(&g_sGyroFFTInst, g_sCompDCMInst.pfGyro);
         }
 
         //
@@ -752,12 +1972,19 @@ main(void)
             //
             CompDCMComputeQuaternion(&g_sCompDCMInst, pfQuaternion);
 
+            //
+            // Bias free angular velocities.
+            //
+            pfGyro[0] = g_sMPU9150Sample.pfGyro[0];
+            pfGyro[1] = g_sMPU9150Sample.pfGyro[1];
+            pfGyro[2] = g_sMPU9150Sample.pfGyro[2];
+
             //
             // convert mag data to micro-tesla for better human interpretation.
             //
-            pfMag[0] *= 1e6;
-            pfMag[1] *= 1e6;
-            pfMag[2] *= 1e6;
+            pfMag[0] = g_sMPU9150Sample.pfMagneto[0] * 1e6;
+            pfMag[1] = g_sMPU9150Sample.pfMagneto[1] * 1e6;
+            pfMag[2] = g_sMPU9150Sample.pfMagneto[2] * 1e6;
 
             //
             // Convert Eulers to degrees. 180/PI = 57.29...
@@ -847,6 +2074,144 @@ main(void)
             UARTprintf("\033[19;32H%3d.%03d", i32IPart[13], i32FPart[13]);
             UARTprintf("\033[19;50H%3d.%03d", i32IPart[14], i32FPart[14]);
             UARTprintf("\033[19;68H%3d.%03d", i32IPart[15], i32FPart[15]);
+
+            //
+            // The status rows below the tables are printed one per refresh,
+            // in turn, so that a refresh fits the 460 bytes that UART0 sends
+            // at 115200 baud in the 40 ms until the next one.
+            //
+            switch(g_ui32PrintRow)
+            {
+            case 0:
+            {
+                //
+                // Print the last parameter acknowledgement.
+                //
+                int32_t i32ParamIPart = (int32_t)g_sParamInst.fAckValue;
+                int32_t i32ParamFPart =
+                        (int32_t)(g_sParamInst.fAckValue * 1000.0f) -
+                        i32ParamIPart * 1000;
+                if(i32ParamFPart < 0)
+                {
+                    i32ParamFPart *= -1;
+                }
+                UARTprintf("\033[24;14H%3c", g_sParamInst.ui8AckStatus ?
+                           g_sParamInst.ui8AckStatus : '-');
+                UARTprintf("\033[24;32H%3d", g_sParamInst.ui8AckId);
+                UARTprintf("\033[24;50H%3d", g_sParamInst.ui8AckSeq);
+                UARTprintf("\033[24;68H%3d.%03d", i32ParamIPart,
+                           i32ParamFPart);
+                break;
+            }
+
+            case 1:
+                //
+                // Print the cycle counts of the controller update.
+                //
+                UARTprintf("\033[29;17H%6d", g_sControllerPerf.ui32Last);
+                UARTprintf("\033[29;40H%6d", g_sControllerPerf.ui32Max);
+                UARTprintf("\033[29;63H%6d",
+                           (int32_t)g_sControllerPerf.fMean);
+                break;
+
+            case 2:
+                //
+                // Print the tracked vibration peaks in Hz.
+                //
+                UARTprintf("\033[34;17H%6d",
+                           (int32_t)g_sGyroFFTInst.pfPeakHz[0]);
+                UARTprintf("\033[34;40H%6d",
+                           (int32_t)g_sGyroFFTInst.pfPeakHz[1]);
+                UARTprintf("\033[34;63H%6d", g_sGyroFFTPerf.ui32Max);
+                break;
+
+            case 3:
+                //
+                // Print the saturated sample counts and the ranges in use, in
+                // deg/s and g.
+                //
+                UARTprintf("\033[39;17H%6d",
+                           g_sMPU9150Inst.ui32GyroSatCount);
+                UARTprintf("\033[39;40H%6d",
+                           g_sMPU9150Inst.ui32AccelSatCount);
+                UARTprintf("\033[39;63H%4d/%2d",
+                           250 << g_sMPU9150Inst.ui8GyroFsSel,
+                           2 << g_sMPU9150Inst.ui8AccelAfsSel);
+                break;
+
+            case 4:
+                //
+                // Print the die temperature, the modelled yaw bias drift
+                // since the boot calibration in mdeg/s and the number of
+                // fits.
+                //
+                UARTprintf("\033[44;17H%6d",
+                           (int32_t)g_sMPU9150Sample.fTemperature);
+                UARTprintf("\033[44;40H%6d",
+                           (int32_t)(g_sCompDCMInst.fGyroBias[2] * 57295.78f));
+                UARTprintf("\033[44;63H%6d", g_sGyroTempInst.ui32Fits);
+                break;
+
+            case 5:
+                //
+                // Print the fitted field strength, the held heading of the
+                // field in degrees and the number of calibration fits.
+                //
+                UARTprintf("\033[49;17H%6d",
+                           (int32_t)(g_sMagCalInst.fField * 1e6f));
+                UARTprintf("\033[49;40H%6d",
+                           (int32_t)(g_sCompDCMInst.fMagHeading * 57.29578f));
+                UARTprintf("\033[49;63H%6d", g_sMagCalInst.ui32Fits);
+                break;
+
+            case 6:
+                //
+                // Print the auto-tune state, the axis it tunes and the tuned
+                // gains.
+                //
+                UARTprintf("\033[54;17H%4d/%d",
+                           g_sPDControllerInst.sTune.ui8State,
+                           g_sPDControllerInst.sTune.ui8Axis);
+                UARTprintf("\033[54;40H%6d",
+                           (int32_t)g_sPDControllerInst.sTune.fKp);
+                UARTprintf("\033[54;63H%6d",
+                           (int32_t)g_sPDControllerInst.sTune.fKd);
+                break;
+
+            case 7:
+                //
+                // Print the flight recorder's programmed flash in kB and the
+                // recorded and dropped samples.
+                //
+                UARTprintf("\033[59;17H%6d",
+                           (g_sBlackBoxInst.ui32Address - BLACKBOX_BASE) /
+                           1024);
+                UARTprintf("\033[59;40H%6d", g_sBlackBoxInst.ui32Records);
+                UARTprintf("\033[59;63H%6d", g_sBlackBoxInst.ui32Dropped);
+                break;
+
+            case 8:
+                //
+                // Print the cause of the crash capture, 0 while it records,
+                // its samples and the samples it still records after the
+                // trigger.
+                //
+                UARTprintf("\033[64;17H%6d", g_sCrashRing.ui32Cause);
+                UARTprintf("\033[64;40H%6d", g_sCrashRing.ui32Count);
+                UARTprintf("\033[64;63H%6d", g_sCrashRing.ui32Post);
+                break;
+
+            case 9:
+                //
+                // Print the I2C outages, the duration of the last and the
+                // longest one in ms.
+                //
+                UARTprintf("\033[69;17H%6d", g_sI2CRecoverInst.ui32Outages);
+                UARTprintf("\033[69;40H%6d", g_sI2CRecoverInst.ui32LastMs);
+                UARTprintf("\033[69;63H%6d", g_sI2CRecoverInst.ui32MaxMs);
+                break;
+            }
+            g_ui32PrintRow = (g_ui32PrintRow + 1) % PRINT_ROWS;
         }
 
         //
@@ -855,10 +2220,94 @@ main(void)
         ReadDesiredState(&g_sPDControllerInst, &g_sPWMInst);
 
         //
-        // PD controller.
+        // Latches a parameter request from the spare bytes of the packet.
+        //
+        ParamReadRequest(&g_sParamInst);
+
+        //
+        // Attitude controller. Coasting keeps the motor commands of the last
+        // sample, past I2C_RECOVER_FAILSAFE_MS of outage the failsafe levels
+        // them below hover.
         //
-        ErrorToInput(&g_sPDControllerInst, &g_sCompDCMInst);
+        uint32_t ui32Start = CycleCounterGet();
+        if(!bCoast)
+        {
+            ControllerUpdate(&g_sPDControllerInst, &g_sCompDCMInst);
+            PerfStatUpdate(&g_sControllerPerf, ui32Start);
+        }
+        else
+        {
+            ControllerCoast(&g_sPDControllerInst);
+            if(!g_bI2CFailsafe &&
+               (I2CRecoverOutageMs(&g_sI2CRecoverInst, ui32Start) >
+                I2C_RECOVER_FAILSAFE_MS))
+            {
+                g_bI2CFailsafe = true;
+                ControllerFailsafe(&g_sPDControllerInst);
+            }
+        }
         PDContUpdatePWM(&g_sPDControllerInst, &g_sPWMInst);
+
+#ifdef HIL_BRIDGE
+        //
+        // Answers the sensor frame of the bridge. A lost link looks like a
+        // bus outage to I2CWatch(): the loop coasts and fails safe.
+        //
+        if(!bCoast)
+        {
+            HilMotorSend(&g_sPWMInst);
+        }
+#endif
+
+        //
+        // Adds the sample and its motor commands to the crash capture.
+        //
+        CrashRecord();
+
+        //
+        // The motor outputs for this sample are set, so it is safe to change
+        // parameters now. Applies a pending request and acknowledges it.
+        //
+        ParamApplyPending(&g_sParamInst);
+
+        //
+        // Stores the gains of a completed auto-tune, at the same point.
+        //
+        AutotuneStore();
+
+        //
+        // Records the sample with the outputs it produced.
+        //
+        BlackBoxRecord();
+
+        //
+        // One step of the vibration analysis. When it completes, the
+        // tracking notches are moved to the peaks it found.
+        //
+        ui32Start = CycleCounterGet();
+        if(GyroFFTUpdate(&g_sGyroFFTInst))
+        {
+            ControllerNotchTrack(&g_sPDControllerInst, g_sGyroFFTInst.pfPeakHz,
+                                 GYRO_FFT_MAX_PEAKS);
+        }
+        PerfStatUpdate(&g_sGyroFFTPerf, ui32Start);
+
+        //
+        // Refits the magnetometer calibration once enough new readings were
+        // collected, after the motor outputs like the vibration analysis.
+        //
+        MagCalSolve(&g_sMagCalInst);
+
+        //
+        // Programs a few words of the flight recorder into the flash, last
+        // since the CPU stalls while the flash is busy. An erase only goes
+        // on in iterations with the thrust at its minimum, so raising the
+        // thrust pauses it.
+        //
+        if(!g_sBlackBoxInst.bErasing || ControllerIdle(&g_sPDControllerInst))
+        {
+            BlackBoxFlush(&g_sBlackBoxInst);
+        }
     }
 
     return 0;
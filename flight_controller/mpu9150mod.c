@@ -62,6 +62,25 @@
 #define MPU9150_STATE_INIT_I2C_SLAVE_0                                        \
                                 11          // config ak8975 automatic read
 #define MPU9150_STATE_RD_DATA   12          // Waiting for data read
+#define MPU9150_STATE_RANGE     13          // Waiting for a range change
+
+//*****************************************************************************
+//
+// Automatic range selection. A range is left for the next higher one as soon
+// as an axis reaches MPU9150_RANGE_UP_LSB, and for the next lower one once
+// all axes stayed below MPU9150_RANGE_DOWN_LSB (40% of the full scale of the
+// lower range) for MPU9150_RANGE_DOWN_SAMPLES samples. After a change the
+// next MPU9150_RANGE_SETTLE_SAMPLES samples may still be in the old scale
+// and are marked as not valid.
+//
+//*****************************************************************************
+#define MPU9150_RANGE_UP_LSB    30000       // 92% of the full scale
+#define MPU9150_RANGE_DOWN_LSB  6553
+#define MPU9150_RANGE_DOWN_SAMPLES                                            \
+                                500         // 2 s at 250 Hz
+#define MPU9150_RANGE_SETTLE_SAMPLES                                          \
+                                2
+#define MPU9150_RANGE_MAX_SEL   3           // 2000 deg/s, 16 g
 
 //*****************************************************************************
 //
@@ -105,6 +124,172 @@ static const float g_fMPU9150GyroFactors[] =
 //*****************************************************************************
 #define CONVERT_TO_TESLA        0.0000003
 
+//*****************************************************************************
+//
+// The axes of the AK8975 in the MPU9150 package: its X axis is the Y axis of
+// the accelerometer and gyroscope, its Y axis their X axis and its Z axis
+// points the other way.
+//
+//*****************************************************************************
+static const uint8_t g_pui8MPU9150MagnetoAxes[3] = { 1, 0, 2 };
+static const int8_t g_pi8MPU9150MagnetoSigns[3] = { 1, 1, -1 };
+
+//*****************************************************************************
+//
+// Converting the TEMP_OUT word to degrees C (340 LSB per degree, 0 LSB at
+// 35 degrees C)
+//
+//*****************************************************************************
+#define MPU9150_TEMP_SENSITIVITY 340.0f
+#define MPU9150_TEMP_OFFSET     35.0f
+
+static void MPU9150Callback(void *pvCallbackData, uint_fast8_t ui8Status);
+
+//*****************************************************************************
+//
+// Checks the three big-endian axes at pui8Data against the range ui8Sel.
+// Counts saturated samples and returns the range that should be used.
+//
+//*****************************************************************************
+static uint_fast8_t
+MPU9150RangeNext(const uint8_t *pui8Data, uint_fast8_t ui8Sel,
+                 uint_fast8_t ui8MinSel, uint16_t *pui16LowCount,
+                 uint32_t *pui32SatCount)
+{
+    int32_t i32Max, i32Value;
+    uint_fast8_t ui8Saturated, ui8Idx;
+
+    //
+    // Find the largest magnitude of the three axes.
+    //
+    i32Max = 0;
+    ui8Saturated = 0;
+    for(ui8Idx = 0; ui8Idx < 3; ui8Idx++)
+    {
+        i32Value = (int16_t)((pui8Data[2 * ui8Idx] << 8) |
+                             pui8Data[2 * ui8Idx + 1]);
+        if((i32Value == INT16_MAX) || (i32Value == INT16_MIN))
+        {
+            ui8Saturated = 1;
+        }
+        if(i32Value < 0)
+        {
+            i32Value = -i32Value;
+        }
+        if(i32Value > i32Max)
+        {
+            i32Max = i32Value;
+        }
+    }
+
+    if(ui8Saturated)
+    {
+        (*pui32SatCount)++;
+    }
+
+    //
+    // Move up immediately, move down only after a quiet period.
+    //
+    if(i32Max >= MPU9150_RANGE_UP_LSB)
+    {
+        *pui16LowCount = 0;
+        return((ui8Sel < MPU9150_RANGE_MAX_SEL) ? (ui8Sel + 1) : ui8Sel);
+    }
+    if((ui8Sel > ui8MinSel) && (i32Max < MPU9150_RANGE_DOWN_LSB))
+    {
+        if(++(*pui16LowCount) >= MPU9150_RANGE_DOWN_SAMPLES)
+        {
+            *pui16LowCount = 0;
+            return(ui8Sel - 1);
+        }
+    }
+    else
+    {
+        *pui16LowCount = 0;
+    }
+
+    return(ui8Sel);
+}
+
+//*****************************************************************************
+//
+// Called after a data read. Counts saturated samples, handles the samples
+// after a range change and starts a range change if one is needed. Returns 1
+// if a range change was started.
+//
+//*****************************************************************************
+static uint_fast8_t
+MPU9150RangeCheck(tMPU9150 *psInst)
+{
+    uint_fast8_t ui8GyroSel, ui8AccelSel, ui8Reg, ui8Mask, ui8Value;
+
+    //
+    // Gyro data starts at byte 8 and accelerometer data at byte 0 of the
+    // data burst.
+    //
+    ui8GyroSel = MPU9150RangeNext(psInst->pui8Data + 8, psInst->ui8GyroFsSel,
+                                  psInst->ui8GyroMinFsSel,
+                                  &psInst->ui16GyroLowCount,
+                                  &psInst->ui32GyroSatCount);
+    ui8AccelSel = MPU9150RangeNext(psInst->pui8Data, psInst->ui8AccelAfsSel,
+                                   psInst->ui8AccelMinAfsSel,
+                                   &psInst->ui16AccelLowCount,
+                                   &psInst->ui32AccelSatCount);
+
+    //
+    // Samples right after a range change are discarded. The scale of the new
+    // range is used from the last of them on.
+    //
+    if(psInst->ui8SettleCount)
+    {
+        if(--psInst->ui8SettleCount == 0)
+        {
+            psInst->ui8GyroFsSel = psInst->ui8NewGyroFsSel;
+            psInst->ui8AccelAfsSel = psInst->ui8NewAccelAfsSel;
+        }
+        psInst->ui8DataValid = 0;
+        return(0);
+    }
+    psInst->ui8DataValid = 1;
+
+    //
+    // Change one range at a time, the gyro first.
+    //
+    if((psInst->ui8AutoRange & MPU9150_AUTO_RANGE_GYRO) &&
+       (ui8GyroSel != psInst->ui8GyroFsSel))
+    {
+        ui8Reg = MPU9150_O_GYRO_CONFIG;
+        ui8Mask = (uint8_t)~MPU9150_GYRO_CONFIG_FS_SEL_M;
+        ui8Value = ui8GyroSel << MPU9150_GYRO_CONFIG_FS_SEL_S;
+    }
+    else if((psInst->ui8AutoRange & MPU9150_AUTO_RANGE_ACCEL) &&
+            (ui8AccelSel != psInst->ui8AccelAfsSel))
+    {
+        ui8Reg = MPU9150_O_ACCEL_CONFIG;
+        ui8Mask = (uint8_t)~MPU9150_ACCEL_CONFIG_AFS_SEL_M;
+        ui8Value = ui8AccelSel << MPU9150_ACCEL_CONFIG_AFS_SEL_S;
+    }
+    else
+    {
+        return(0);
+    }
+
+    //
+    // The data of this read stays in pui8Data and in the current scale,
+    // the read-modify-write uses its own buffer.
+    //
+    psInst->ui8State = MPU9150_STATE_RANGE;
+    if(I2CMReadModifyWrite8(&(psInst->uCommand.sReadModifyWriteState),
+                            psInst->psI2CInst, psInst->ui8Addr, ui8Reg,
+                            ui8Mask, ui8Value, MPU9150Callback, psInst) == 0)
+    {
+        psInst->ui8State = MPU9150_STATE_IDLE;
+        return(0);
+    }
+
+    return(1);
+}
+
 //*****************************************************************************
 //
 // The callback function that is called when I2C transations to/from the
@@ -146,7 +331,6 @@ MPU9150Callback(void *pvCallbackData, uint_fast8_t ui8Status)
         //
         case MPU9150_STATE_READ:
         case MPU9150_STATE_LAST:
-        case MPU9150_STATE_RD_DATA:
         default:
         {
             //
@@ -160,6 +344,61 @@ MPU9150Callback(void *pvCallbackData, uint_fast8_t ui8Status)
             break;
         }
 
+        //
+        // A data read just completed.
+        //
+        case MPU9150_STATE_RD_DATA:
+        {
+            //
+            // The state machine is idle unless a range change was started,
+            // then the callback follows once the range is written.
+            //
+            psInst->ui8State = MPU9150_STATE_IDLE;
+            MPU9150RangeCheck(psInst);
+
+            //
+            // Done.
+            //
+            break;
+        }
+
+        //
+        // An automatic range change just completed.
+        //
+        case MPU9150_STATE_RANGE:
+        {
+            //
+            // The new range is used once the following samples settled.
+            //
+            if(psInst->uCommand.sReadModifyWriteState.pui8Buffer[0] ==
+               MPU9150_O_GYRO_CONFIG)
+            {
+                psInst->ui8NewGyroFsSel =
+                    ((psInst->uCommand.sReadModifyWriteState.pui8Buffer[1] &
+                      MPU9150_GYRO_CONFIG_FS_SEL_M) >>
+                     MPU9150_GYRO_CONFIG_FS_SEL_S);
+            }
+            else
+            {
+                psInst->ui8NewAccelAfsSel =
+                    ((psInst->uCommand.sReadModifyWriteState.pui8Buffer[1] &
+                      MPU9150_ACCEL_CONFIG_AFS_SEL_M) >>
+                     MPU9150_ACCEL_CONFIG_AFS_SEL_S);
+            }
+            psInst->ui8SettleCount = MPU9150_RANGE_SETTLE_SAMPLES;
+            psInst->ui32RangeChanges++;
+
+            //
+            // The state machine is now idle.
+            //
+            psInst->ui8State = MPU9150_STATE_IDLE;
+
+            //
+            // Done.
+            //
+            break;
+        }
+
         //
         // MPU9150 Device reset was issued
         //
@@ -491,6 +730,8 @@ MPU9150Init(tMPU9150 *psInst, tI2CMInstance *psI2CInst,
             uint_fast8_t ui8I2CAddr, tSensorCallback *pfnCallback,
             void *pvCallbackData)
 {
+    uint_fast8_t ui8Axis;
+
     //
     // Initialize the MPU9150 instance structure.
     //
@@ -519,6 +760,32 @@ MPU9150Init(tMPU9150 *psInst, tI2CMInstance *psI2CInst,
     psInst->ui8NewGyroFsSel = (MPU9150_GYRO_CONFIG_FS_SEL_250 >>
                                MPU9150_GYRO_CONFIG_FS_SEL_S);
 
+    //
+    // Automatic range selection is off until enabled by the application.
+    //
+    psInst->ui8AutoRange = 0;
+    psInst->ui8GyroMinFsSel = psInst->ui8GyroFsSel;
+    psInst->ui8AccelMinAfsSel = psInst->ui8AccelAfsSel;
+    psInst->ui16GyroLowCount = 0;
+    psInst->ui16AccelLowCount = 0;
+    psInst->ui8SettleCount = 0;
+    psInst->ui8DataValid = 0;
+    psInst->ui32GyroSatCount = 0;
+    psInst->ui32AccelSatCount = 0;
+    psInst->ui32RangeChanges = 0;
+
+    //
+    // No bias and the body axes are the sensor axes until calibrated by the
+    // application.
+    //
+    for(ui8Axis = 0; ui8Axis < 3; ui8Axis++)
+    {
+        psInst->pi32AccelBias[ui8Axis] = 0;
+        psInst->pi32GyroBias[ui8Axis] = 0;
+        psInst->pui8AxisMap[ui8Axis] = ui8Axis;
+        psInst->pi8AxisSign[ui8Axis] = 1;
+    }
+
     //
     // Set the state to show we are initiating a reset.
     //
@@ -890,6 +1157,228 @@ MPU9150DataRead(tMPU9150 *psInst, tSensorCallback *pfnCallback,
     return(1);
 }
 
+//*****************************************************************************
+//
+//! Enables or disables the automatic range selection.
+//!
+//! \param psInst is a pointer to the MPU9150 instance data.
+//! \param ui8AutoRange is a combination of \b MPU9150_AUTO_RANGE_GYRO and
+//! \b MPU9150_AUTO_RANGE_ACCEL, or 0 to disable it.
+//!
+//! This function enables the automatic range selection for the gyroscope
+//! and/or the accelerometer.  The ranges in use when it is called are the
+//! lowest ones that are selected.  After every data read the driver counts
+//! samples with a saturated axis and, if a range is too small or has been
+//! too large for a while, changes it with a read-modify-write of the
+//! configuration register before the application callback is called.  The
+//! samples read while the sensor settles on the new range are marked as not
+//! valid, see MPU9150DataValid().
+//!
+//! \return None.
+//
+//*****************************************************************************
+void
+MPU9150AutoRangeSet(tMPU9150 *psInst, uint_fast8_t ui8AutoRange)
+{
+    psInst->ui8GyroMinFsSel = psInst->ui8GyroFsSel;
+    psInst->ui8AccelMinAfsSel = psInst->ui8AccelAfsSel;
+    psInst->ui16GyroLowCount = 0;
+    psInst->ui16AccelLowCount = 0;
+    psInst->ui8AutoRange = ui8AutoRange;
+}
+
+//*****************************************************************************
+//
+//! Returns whether the data of the most recent data read is valid.
+//!
+//! \param psInst is a pointer to the MPU9150 instance data.
+//!
+//! After an automatic range change the next samples may still be in the
+//! old scale.  The application should keep using its previous accelerometer
+//! and gyroscope values while this function returns 0.
+//!
+//! \return Returns 1 if the data is valid and 0 if it is not.
+//
+//*****************************************************************************
+uint_fast8_t
+MPU9150DataValid(tMPU9150 *psInst)
+{
+    return(psInst->ui8DataValid);
+}
+
+//*****************************************************************************
+//
+//! Sets the orientation of the sensor on the body.
+//!
+//! \param psInst is a pointer to the MPU9150 instance data.
+//! \param pui8AxisMap is a pointer to three values, the body axis (0 to 2)
+//! that each accelerometer and gyroscope axis is written to.
+//! \param pi8AxisSign is a pointer to three values, 1 or -1, the sign of each
+//! axis in the body frame.
+//!
+//! This function sets the axis remapping applied by MPU9150DataSampleGet().
+//! The biases passed to MPU9150BiasSet() are in the body axes, so this
+//! function must be called first.
+//!
+//! \return None.
+//
+//*****************************************************************************
+void
+MPU9150AxisRemapSet(tMPU9150 *psInst, const uint8_t *pui8AxisMap,
+                    const int8_t *pi8AxisSign)
+{
+    uint_fast8_t ui8Axis;
+
+    for(ui8Axis = 0; ui8Axis < 3; ui8Axis++)
+    {
+        psInst->pui8AxisMap[ui8Axis] = pui8AxisMap[ui8Axis];
+        psInst->pi8AxisSign[ui8Axis] = (pi8AxisSign[ui8Axis] < 0) ? -1 : 1;
+    }
+}
+
+//*****************************************************************************
+//
+//! Sets the accelerometer and gyroscope biases.
+//!
+//! \param psInst is a pointer to the MPU9150 instance data.
+//! \param pfAccelBias is a pointer to the accelerometer bias in m/s^2, in the
+//! body axes.
+//! \param pfGyroBias is a pointer to the gyroscope bias in rad/s, in the body
+//! axes.
+//!
+//! This function sets the biases removed by MPU9150DataSampleGet().  They are
+//! stored per sensor axis in LSB of the lowest range, so they stay correct
+//! when the range is changed.
+//!
+//! \return None.
+//
+//*****************************************************************************
+void
+MPU9150BiasSet(tMPU9150 *psInst, const float *pfAccelBias,
+               const float *pfGyroBias)
+{
+    uint_fast8_t ui8Axis;
+    float fAccel, fGyro;
+
+    for(ui8Axis = 0; ui8Axis < 3; ui8Axis++)
+    {
+        //
+        // Move the bias back into the sensor axis and convert it to LSB.
+        //
+        fAccel = (pfAccelBias[psInst->pui8AxisMap[ui8Axis]] *
+                  psInst->pi8AxisSign[ui8Axis] *
+                  (float)(1 << MPU9150_BIAS_FRAC_BITS) /
+                  g_fMPU9150AccelFactors[0]);
+        fGyro = (pfGyroBias[psInst->pui8AxisMap[ui8Axis]] *
+                 psInst->pi8AxisSign[ui8Axis] *
+                 (float)(1 << MPU9150_BIAS_FRAC_BITS) /
+                 g_fMPU9150GyroFactors[0]);
+
+        //
+        // Round to the nearest integer.
+        //
+        psInst->pi32AccelBias[ui8Axis] = (int32_t)((fAccel < 0.0f) ?
+                                                   (fAccel - 0.5f) :
+                                                   (fAccel + 0.5f));
+        psInst->pi32GyroBias[ui8Axis] = (int32_t)((fGyro < 0.0f) ?
+                                                  (fGyro - 0.5f) :
+                                                  (fGyro + 0.5f));
+    }
+}
+
+//*****************************************************************************
+//
+//! Decodes the most recent data read.
+//!
+//! \param psInst is a pointer to the MPU9150 instance data.
+//! \param psSample is a pointer to the sample that is filled in.
+//!
+//! This function converts the whole data read in a single pass: the
+//! accelerometer in m/s^2 and the gyroscope in rad/s with the biases removed
+//! and remapped to the body axes, the magnetometer in tesla aligned to the
+//! same body axes and the die temperature in degrees C.  The biases are
+//! subtracted in the integer domain, so each axis takes a single floating
+//! point multiply.  It replaces calls to MPU9150DataAccelGetFloat(),
+//! MPU9150DataGyroGetFloat() and MPU9150DataMagnetoGetFloat() in the sample
+//! loop.
+//!
+//! \return None.
+//
+//*****************************************************************************
+void
+MPU9150DataSampleGet(tMPU9150 *psInst, tMPU9150Sample *psSample)
+{
+    const uint8_t *pui8Data;
+    uint_fast8_t ui8Axis, ui8AccelSel, ui8GyroSel;
+    uint_fast8_t ui8MagAxis;
+    int32_t i32Value;
+    float fAccelFactor, fGyroFactor;
+
+    pui8Data = psInst->pui8Data;
+
+    //
+    // Get the conversion factors for the current ranges, including the
+    // scaling of the bias fraction bits.
+    //
+    ui8AccelSel = psInst->ui8AccelAfsSel;
+    ui8GyroSel = psInst->ui8GyroFsSel;
+    fAccelFactor = (g_fMPU9150AccelFactors[ui8AccelSel] *
+                    (1.0f / (float)(1 << MPU9150_BIAS_FRAC_BITS)));
+    fGyroFactor = (g_fMPU9150GyroFactors[ui8GyroSel] *
+                   (1.0f / (float)(1 << MPU9150_BIAS_FRAC_BITS)));
+
+    for(ui8Axis = 0; ui8Axis < 3; ui8Axis++)
+    {
+        //
+        // Accelerometer, big-endian words at offset 0.  The bias is in LSB
+        // of the lowest range, each range above halves its weight.
+        //
+        i32Value = (int16_t)((pui8Data[2 * ui8Axis] << 8) |
+                             pui8Data[2 * ui8Axis + 1]);
+        i32Value = ((i32Value << MPU9150_BIAS_FRAC_BITS) -
+                    (psInst->pi32AccelBias[ui8Axis] >> ui8AccelSel));
+        psSample->pfAccel[psInst->pui8AxisMap[ui8Axis]] =
+            (float)(i32Value * psInst->pi8AxisSign[ui8Axis]) * fAccelFactor;
+
+        //
+        // Gyroscope, big-endian words at offset 8.
+        //
+        i32Value = (int16_t)((pui8Data[8 + 2 * ui8Axis] << 8) |
+                             pui8Data[9 + 2 * ui8Axis]);
+        i32Value = ((i32Value << MPU9150_BIAS_FRAC_BITS) -
+                    (psInst->pi32GyroBias[ui8Axis] >> ui8GyroSel));
+        psSample->pfGyro[psInst->pui8AxisMap[ui8Axis]] =
+            (float)(i32Value * psInst->pi8AxisSign[ui8Axis]) * fGyroFactor;
+
+        //
+        // Magnetometer, little-endian words at offset 15 after the AK8975
+        // status byte, turned into the accelerometer axes first.
+        //
+        i32Value = (int16_t)((pui8Data[16 + 2 * ui8Axis] << 8) |
+                             pui8Data[15 + 2 * ui8Axis]);
+        ui8MagAxis = g_pui8MPU9150MagnetoAxes[ui8Axis];
+        psSample->pfMagneto[psInst->pui8AxisMap[ui8MagAxis]] =
+            ((float)(i32Value * g_pi8MPU9150MagnetoSigns[ui8Axis] *
+                     psInst->pi8AxisSign[ui8MagAxis]) *
+             (float)CONVERT_TO_TESLA);
+    }
+
+    //
+    // AK8975 status, ST1 at offset 14 and ST2 at offset 21.
+    //
+    psSample->bMagnetoValid = (((pui8Data[14] & AK8975_ST1_DRDY) != 0) &&
+                               ((pui8Data[21] & (AK8975_ST2_HOFL |
+                                                 AK8975_ST2_DERR)) == 0));
+
+    //
+    // Die temperature, big-endian word at offset 6.
+    //
+    psSample->i16Temperature = (int16_t)((pui8Data[6] << 8) | pui8Data[7]);
+    psSample->fTemperature = ((float)psSample->i16Temperature *
+                              (1.0f / MPU9150_TEMP_SENSITIVITY) +
+                              MPU9150_TEMP_OFFSET);
+}
+
 //*****************************************************************************
 //
 //! Gets the raw accelerometer data from the most recent data read.
@@ -37,6 +37,53 @@ extern "C"
 {
 #endif
 
+//*****************************************************************************
+//
+// Flags that enable the automatic range selection, see MPU9150AutoRangeSet().
+//
+//*****************************************************************************
+#define MPU9150_AUTO_RANGE_GYRO     0x01
+#define MPU9150_AUTO_RANGE_ACCEL    0x02
+
+//*****************************************************************************
+//
+// Number of fraction bits of the accelerometer and gyroscope biases, which
+// are kept in LSB of the lowest range.
+//
+//*****************************************************************************
+#define MPU9150_BIAS_FRAC_BITS      4
+
+//*****************************************************************************
+//
+// A decoded sample of the most recent data read, see MPU9150DataSampleGet().
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // Acceleration in m/s^2 and angular velocity in rad/s, with the bias
+    // removed and in the body axes.
+    //
+    float pfAccel[3];
+    float pfGyro[3];
+
+    //
+    // Magnetic field in tesla, in the body axes.  bMagnetoValid is set if
+    // the AK8975 finished a new measurement without overflow since the
+    // previous read.
+    //
+    float pfMagneto[3];
+    bool bMagnetoValid;
+
+    //
+    // Die temperature in degrees C and the raw TEMP_OUT word it was computed
+    // from.
+    //
+    float fTemperature;
+    int16_t i16Temperature;
+}
+tMPU9150Sample;
+
 //*****************************************************************************
 //
 // The structure that defines the internal state of the MPU9150 driver.
@@ -87,6 +134,47 @@ typedef struct
     //
     uint8_t ui8NewGyroFsSel;
 
+    //
+    // The automatic range selection, a combination of MPU9150_AUTO_RANGE_*
+    // flags, and the lowest ranges it may select.
+    //
+    uint8_t ui8AutoRange;
+    uint8_t ui8GyroMinFsSel;
+    uint8_t ui8AccelMinAfsSel;
+
+    //
+    // Number of consecutive samples that would fit into the next lower
+    // range.
+    //
+    uint16_t ui16GyroLowCount;
+    uint16_t ui16AccelLowCount;
+
+    //
+    // Number of samples that are still discarded after a range change, and
+    // whether the data of the most recent read is valid.
+    //
+    uint8_t ui8SettleCount;
+    uint8_t ui8DataValid;
+
+    //
+    // Number of samples with a saturated axis and number of automatic range
+    // changes.
+    //
+    uint32_t ui32GyroSatCount;
+    uint32_t ui32AccelSatCount;
+    uint32_t ui32RangeChanges;
+
+    //
+    // Calibration applied by MPU9150DataSampleGet(). The biases are per
+    // sensor axis, in LSB of the lowest range with MPU9150_BIAS_FRAC_BITS
+    // fraction bits. Sensor axis i is written to body axis pui8AxisMap[i]
+    // with the sign pi8AxisSign[i].
+    //
+    int32_t pi32AccelBias[3];
+    int32_t pi32GyroBias[3];
+    uint8_t pui8AxisMap[3];
+    int8_t pi8AxisSign[3];
+
     //
     // The data buffer used for sending/receiving data to/from the MPU9150.
     //
@@ -157,6 +245,13 @@ extern uint_fast8_t MPU9150ReadModifyWrite(tMPU9150 *psInst,
 extern uint_fast8_t MPU9150DataRead(tMPU9150 *psInst,
                                     tSensorCallback *pfnCallback,
                                     void *pvCallbackData);
+extern void MPU9150AutoRangeSet(tMPU9150 *psInst, uint_fast8_t ui8AutoRange);
+extern uint_fast8_t MPU9150DataValid(tMPU9150 *psInst);
+extern void MPU9150AxisRemapSet(tMPU9150 *psInst, const uint8_t *pui8AxisMap,
+                                const int8_t *pi8AxisSign);
+extern void MPU9150BiasSet(tMPU9150 *psInst, const float *pfAccelBias,
+                           const float *pfGyroBias);
+extern void MPU9150DataSampleGet(tMPU9150 *psInst, tMPU9150Sample *psSample);
 extern void MPU9150DataAccelGetRaw(tMPU9150 *psInst,
                                    uint_fast16_t *pui16AccelX,
                                    uint_fast16_t *pui16AccelY,
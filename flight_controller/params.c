@@ -0,0 +1,281 @@
+
+//*****************************************************************************
+//
+// params.c - Runtime tunable parameters set over the radio link.
+//
+// Requests are multiplexed through the spare bytes of the radio packet,
+// latched while parsing and only written to the parameters at a safe point
+// of the main loop. Every handled request is acknowledged over the radio.
+//
+//*****************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "driverlib/interrupt.h"
+#include "params.h"
+#include "buffer.h"
+#include "hc12.h"
+
+//*****************************************************************************
+//
+// Finds a registered parameter by ID. Returns NULL if it is unknown.
+//
+//*****************************************************************************
+static tParam *
+ParamFind(tParamStore *psStore, uint8_t ui8Id)
+{
+    int i;
+    for (i = 0; i < psStore->ui8Count; i++)
+    {
+        if (psStore->psParams[i].ui8Id == ui8Id)
+        {
+            return &psStore->psParams[i];
+        }
+    }
+
+    return 0;
+}
+
+//*****************************************************************************
+//
+// Sends an acknowledgement for the request with the given sequence number.
+//
+//*****************************************************************************
+static void
+ParamSendAck(tParamStore *psStore, uint8_t ui8Status, uint8_t ui8Seq,
+             uint8_t ui8Id, float fValue)
+{
+    uint8_t pui8Ack[PARAM_ACK_LENGTH];
+
+    psStore->ui8AckStatus = ui8Status;
+    psStore->ui8AckSeq = ui8Seq;
+    psStore->ui8AckId = ui8Id;
+    psStore->fAckValue = fValue;
+
+    pui8Ack[0] = ui8Status;
+    pui8Ack[1] = ui8Id;
+    pui8Ack[2] = ui8Seq;
+    memcpy(pui8Ack + 3, &fValue, sizeof(float));
+    pui8Ack[7] = 'e';
+
+    HC12Send(pui8Ack, PARAM_ACK_LENGTH);
+}
+
+//*****************************************************************************
+//
+// Initializes an empty parameter store.
+//
+//*****************************************************************************
+void
+InitParamStore(tParamStore *psStore)
+{
+    psStore->ui8Count = 0;
+    psStore->ui8LastCounter = 0;
+    psStore->ui8LastSeq = 0;
+    psStore->bPending = false;
+    psStore->ui8AckStatus = 0;
+    psStore->ui8AckSeq = 0;
+    psStore->ui8AckId = PARAM_ID_NONE;
+    psStore->fAckValue = 0.0f;
+}
+
+//*****************************************************************************
+//
+// Registers a parameter. Returns false if the store is full or the ID is
+// already taken.
+//
+//*****************************************************************************
+bool
+ParamRegister(tParamStore *psStore, uint8_t ui8Id, float *pfValue,
+              float fMin, float fMax)
+{
+    if ((ui8Id == PARAM_ID_NONE) || (psStore->ui8Count >= PARAM_MAX_COUNT) ||
+        ParamFind(psStore, ui8Id))
+    {
+        return false;
+    }
+
+    tParam *psParam = &psStore->psParams[psStore->ui8Count++];
+    psParam->ui8Id = ui8Id;
+    psParam->pfValue = pfValue;
+    psParam->fMin = fMin;
+    psParam->fMax = fMax;
+    psParam->pfnCallback = 0;
+    psParam->pvCallbackData = 0;
+
+    return true;
+}
+
+//*****************************************************************************
+//
+// Sets the function that is called after a parameter was changed by
+// ParamSet().
+//
+//*****************************************************************************
+bool
+ParamCallbackSet(tParamStore *psStore, uint8_t ui8Id,
+                 tParamCallback *pfnCallback, void *pvCallbackData)
+{
+    tParam *psParam = ParamFind(psStore, ui8Id);
+    if (!psParam)
+    {
+        return false;
+    }
+
+    psParam->pfnCallback = pfnCallback;
+    psParam->pvCallbackData = pvCallbackData;
+    return true;
+}
+
+//*****************************************************************************
+//
+// Reads the current value of a parameter.
+//
+//*****************************************************************************
+bool
+ParamGet(tParamStore *psStore, uint8_t ui8Id, float *pfValue)
+{
+    tParam *psParam = ParamFind(psStore, ui8Id);
+    if (!psParam)
+    {
+        return false;
+    }
+
+    *pfValue = *psParam->pfValue;
+    return true;
+}
+
+//*****************************************************************************
+//
+// Sets a parameter. Values outside of the registered range, or that the
+// callback of the parameter refuses, are rejected.
+// Must only be called at a point of the main loop where no computation
+// depends on the parameter.
+//
+//*****************************************************************************
+bool
+ParamSet(tParamStore *psStore, uint8_t ui8Id, float fValue)
+{
+    tParam *psParam = ParamFind(psStore, ui8Id);
+
+    //
+    // The comparisons also reject NaN.
+    //
+    if (!psParam || !(fValue >= psParam->fMin) || !(fValue <= psParam->fMax))
+    {
+        return false;
+    }
+
+    float fOld = *psParam->pfValue;
+    *psParam->pfValue = fValue;
+    if (psParam->pfnCallback && !psParam->pfnCallback(psParam->pvCallbackData))
+    {
+        *psParam->pfValue = fOld;
+        return false;
+    }
+    return true;
+}
+
+//*****************************************************************************
+//
+// Parses a parameter request from the last radio packet. The request is only
+// latched here, ParamApplyPending() writes it.
+//
+//*****************************************************************************
+void
+ParamReadRequest(tParamStore *psStore)
+{
+    //
+    // Copies UART2 buffer inside a simple critical section.
+    //
+    IntMasterDisable();
+    uint8_t pui8Packet[PACKET_LENGTH];
+    int i;
+    for (i = 0; i < PACKET_LENGTH; i++) {
+        pui8Packet[i] = buff[i];
+    }
+    IntMasterEnable();
+
+    //
+    // The main loop runs faster than packets arrive, so parse every packet
+    // only once.
+    //
+    if ((pui8Packet[0] != 's') || (pui8Packet[PACKET_LENGTH - 1] != 'e') ||
+        (pui8Packet[PARAM_PACKET_COUNTER] == psStore->ui8LastCounter))
+    {
+        return;
+    }
+    psStore->ui8LastCounter = pui8Packet[PARAM_PACKET_COUNTER];
+
+    uint8_t ui8Seq = pui8Packet[PARAM_PACKET_SEQ];
+    if ((ui8Seq == 0) || psStore->bPending)
+    {
+        return;
+    }
+
+    uint8_t ui8Checksum = 0;
+    for (i = PARAM_PACKET_SEQ; i < PARAM_PACKET_CHECKSUM; i++)
+    {
+        ui8Checksum ^= pui8Packet[i];
+    }
+    if (ui8Checksum != pui8Packet[PARAM_PACKET_CHECKSUM])
+    {
+        return;
+    }
+
+    //
+    // The remote keeps repeating a request until it sees the ack. Repeat
+    // the ack in case it was lost.
+    //
+    if (ui8Seq == psStore->ui8LastSeq)
+    {
+        ParamSendAck(psStore, psStore->ui8AckStatus, psStore->ui8AckSeq,
+                     psStore->ui8AckId, psStore->fAckValue);
+        return;
+    }
+
+    psStore->ui8PendingSeq = ui8Seq;
+    psStore->ui8PendingId = pui8Packet[PARAM_PACKET_ID];
+    memcpy(&psStore->fPendingValue, pui8Packet + PARAM_PACKET_VALUE,
+           sizeof(float));
+    psStore->bPending = true;
+}
+
+//*****************************************************************************
+//
+// Applies a latched request and acknowledges it. Called from the main loop
+// once the motor outputs are updated, so a control update never sees a
+// partially changed set of gains.
+//
+//*****************************************************************************
+void
+ParamApplyPending(tParamStore *psStore)
+{
+    if (!psStore->bPending)
+    {
+        return;
+    }
+
+    uint8_t ui8Status = PARAM_ACK_APPLIED;
+    float fValue = psStore->fPendingValue;
+
+    //
+    // A NaN value, which fails the comparison, is a read.
+    //
+    if ((fValue == fValue) &&
+        !ParamSet(psStore, psStore->ui8PendingId, fValue))
+    {
+        ui8Status = PARAM_ACK_REJECTED;
+    }
+    fValue = 0.0f;
+    if (!ParamGet(psStore, psStore->ui8PendingId, &fValue))
+    {
+        ui8Status = PARAM_ACK_REJECTED;
+    }
+
+    psStore->ui8LastSeq = psStore->ui8PendingSeq;
+    psStore->bPending = false;
+    ParamSendAck(psStore, ui8Status, psStore->ui8PendingSeq,
+                 psStore->ui8PendingId, fValue);
+}
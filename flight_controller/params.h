@@ -0,0 +1,215 @@
+
+//*****************************************************************************
+//
+// params.h - Runtime tunable parameters set over the radio link.
+//
+//*****************************************************************************
+
+#ifndef _PARAMS_H_
+#define _PARAMS_H_
+
+//*****************************************************************************
+//
+// If building with a C++ compiler, make all of the definitions in this header
+// have a C binding.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//*****************************************************************************
+//
+// Maximum number of parameters that can be registered.
+//
+//*****************************************************************************
+#define PARAM_MAX_COUNT             64
+
+//*****************************************************************************
+//
+// Parameter IDs. ID 0 is reserved and marks a packet without a request.
+//
+//*****************************************************************************
+#define PARAM_ID_NONE               0
+#define PARAM_ID_KP                 1
+#define PARAM_ID_KD                 2
+#define PARAM_ID_ANGLE_KP_ROLL      3
+#define PARAM_ID_ANGLE_KP_PITCH     4
+#define PARAM_ID_ANGLE_KP_YAW       5
+#define PARAM_ID_RATE_KP_ROLL       6
+#define PARAM_ID_RATE_KP_PITCH      7
+#define PARAM_ID_RATE_KP_YAW        8
+#define PARAM_ID_RATE_KI_ROLL       9
+#define PARAM_ID_RATE_KI_PITCH      10
+#define PARAM_ID_RATE_KI_YAW        11
+#define PARAM_ID_RATE_KD_ROLL       12
+#define PARAM_ID_RATE_KD_PITCH      13
+#define PARAM_ID_RATE_KD_YAW        14
+#define PARAM_ID_KI                 15
+#define PARAM_ID_GYRO_LPF_HZ        16
+#define PARAM_ID_DTERM_LPF_HZ       17
+#define PARAM_ID_NOTCH_HZ           18
+#define PARAM_ID_NOTCH_Q            19
+#define PARAM_ID_DYN_NOTCH          20
+#define PARAM_ID_ATT_FILTER         21
+#define PARAM_ID_MAHONY_KP          22
+#define PARAM_ID_MAHONY_KI          23
+#define PARAM_ID_MAG_KM             24
+#define PARAM_ID_AUTOTUNE           25
+#define PARAM_ID_LOG_ERASE          26
+#define PARAM_ID_CRASH_TRIGGERS     27
+#define PARAM_ID_CRASH_ATT_ERROR    28
+#define PARAM_ID_CRASH_ARM          29
+#define PARAM_ID_INDI_RATE_KP       30
+#define PARAM_ID_LOG_DIVIDER        31
+
+//*****************************************************************************
+//
+// Nodes of the gyro bias temperature model, IDs PARAM_ID_GYRO_TEMP_BIAS to
+// PARAM_ID_GYRO_TEMP_BIAS + 3 * GYRO_TEMP_POINTS - 1, the three axes of the
+// coldest node first.
+//
+//*****************************************************************************
+#define PARAM_ID_GYRO_TEMP_BIAS     32
+
+//*****************************************************************************
+//
+// Layout of the parameter request in the spare bytes of the radio packet.
+//
+// 's', thrust, yaw, pitch, roll, seq, id, v0, v1, v2, v3, chk, counter, 'e'
+//
+// v0..v3 are the little-endian bytes of an IEEE-754 float and chk is the XOR
+// of the bytes seq..v3. A sequence number of 0 means no request. A NaN value
+// reads the parameter, which is left unchanged and acknowledged.
+//
+//*****************************************************************************
+#define PARAM_PACKET_SEQ            5
+#define PARAM_PACKET_ID             6
+#define PARAM_PACKET_VALUE          7
+#define PARAM_PACKET_CHECKSUM       11
+#define PARAM_PACKET_COUNTER        12
+
+//*****************************************************************************
+//
+// Acknowledgement sent back over the radio once a request was handled.
+//
+// 'a' (applied) or 'n' (rejected), id, seq, v0, v1, v2, v3, 'e'
+//
+// The value is the one in effect after the request.
+//
+//*****************************************************************************
+#define PARAM_ACK_LENGTH            8
+#define PARAM_ACK_APPLIED           'a'
+#define PARAM_ACK_REJECTED          'n'
+
+//*****************************************************************************
+//
+// Called after a parameter was changed, for values that need derived state
+// (such as filter coefficients) to be recomputed. Returns false to refuse
+// the new value, which is then restored and the request rejected.
+//
+//*****************************************************************************
+typedef bool (tParamCallback)(void *pvCallbackData);
+
+//*****************************************************************************
+//
+// A single registered parameter.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // The ID used on the radio link.
+    //
+    uint8_t ui8Id;
+
+    //
+    // The value that is modified.
+    //
+    float *pfValue;
+
+    //
+    // Accepted range.
+    //
+    float fMin;
+    float fMax;
+
+    //
+    // Optional function called after the value was changed.
+    //
+    tParamCallback *pfnCallback;
+    void *pvCallbackData;
+}
+tParam;
+
+//*****************************************************************************
+//
+// Parameter store state.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // Registered parameters.
+    //
+    tParam psParams[PARAM_MAX_COUNT];
+    uint8_t ui8Count;
+
+    //
+    // Message counter of the last radio packet that was parsed.
+    //
+    uint8_t ui8LastCounter;
+
+    //
+    // Sequence number of the last handled request.
+    //
+    uint8_t ui8LastSeq;
+
+    //
+    // Request received but not yet applied.
+    //
+    bool bPending;
+    uint8_t ui8PendingSeq;
+    uint8_t ui8PendingId;
+    float fPendingValue;
+
+    //
+    // The last acknowledgement, kept for the telemetry screen.
+    //
+    uint8_t ui8AckStatus;
+    uint8_t ui8AckSeq;
+    uint8_t ui8AckId;
+    float fAckValue;
+}
+tParamStore;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern void InitParamStore(tParamStore *psStore);
+extern bool ParamRegister(tParamStore *psStore, uint8_t ui8Id, float *pfValue,
+                          float fMin, float fMax);
+extern bool ParamCallbackSet(tParamStore *psStore, uint8_t ui8Id,
+                             tParamCallback *pfnCallback,
+                             void *pvCallbackData);
+extern bool ParamGet(tParamStore *psStore, uint8_t ui8Id, float *pfValue);
+extern bool ParamSet(tParamStore *psStore, uint8_t ui8Id, float fValue);
+extern void ParamReadRequest(tParamStore *psStore);
+extern void ParamApplyPending(tParamStore *psStore);
+
+//*****************************************************************************
+//
+// Mark the end of the C bindings section for C++ compilers.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _PARAMS_H_
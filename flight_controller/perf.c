@@ -0,0 +1,69 @@
+
+//*****************************************************************************
+//
+// perf.c - Cycle counting for profiling the main loop.
+//
+//*****************************************************************************
+
+#include <stdint.h>
+#include "perf.h"
+
+//*****************************************************************************
+//
+// Weight of a new measurement in the moving average.
+//
+//*****************************************************************************
+#define PERF_MEAN_FACTOR            0.01f
+
+//*****************************************************************************
+//
+// Enables the DWT cycle counter.
+//
+//*****************************************************************************
+void
+InitCycleCounter(void)
+{
+    HWREG(PERF_DEMCR) |= PERF_DEMCR_TRCENA;
+    HWREG(PERF_DWT_CYCCNT) = 0;
+    HWREG(PERF_DWT_CTRL) |= PERF_DWT_CTRL_CYCCNTENA;
+}
+
+//*****************************************************************************
+//
+// Clears the statistics of a code section.
+//
+//*****************************************************************************
+void
+PerfStatReset(tPerfStat *psStat)
+{
+    psStat->ui32Last = 0;
+    psStat->ui32Max = 0;
+    psStat->fMean = 0.0f;
+}
+
+//*****************************************************************************
+//
+// Adds a measurement that started at the cycle count ui32Start. The unsigned
+// difference handles the wrap of the counter.
+//
+//*****************************************************************************
+void
+PerfStatUpdate(tPerfStat *psStat, uint32_t ui32Start)
+{
+    uint32_t ui32Cycles = CycleCounterGet() - ui32Start;
+
+    psStat->ui32Last = ui32Cycles;
+    if (ui32Cycles > psStat->ui32Max)
+    {
+        psStat->ui32Max = ui32Cycles;
+    }
+
+    if (psStat->fMean == 0.0f)
+    {
+        psStat->fMean = (float)ui32Cycles;
+    }
+    else
+    {
+        psStat->fMean += PERF_MEAN_FACTOR * ((float)ui32Cycles - psStat->fMean);
+    }
+}
@@ -0,0 +1,85 @@
+
+//*****************************************************************************
+//
+// perf.h - Cycle counting for profiling the main loop.
+//
+//*****************************************************************************
+
+#ifndef _PERF_H_
+#define _PERF_H_
+
+//*****************************************************************************
+//
+// If building with a C++ compiler, make all of the definitions in this header
+// have a C binding.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include "inc/hw_types.h"
+
+//*****************************************************************************
+//
+// Cortex-M4 data watchpoint and trace unit registers.
+//
+//*****************************************************************************
+#define PERF_DEMCR                  0xE000EDFC
+#define PERF_DEMCR_TRCENA           0x01000000
+#define PERF_DWT_CTRL               0xE0001000
+#define PERF_DWT_CTRL_CYCCNTENA     0x00000001
+#define PERF_DWT_CYCCNT             0xE0001004
+
+//*****************************************************************************
+//
+// Reads the free running cycle counter.
+//
+//*****************************************************************************
+#define CycleCounterGet()           HWREG(PERF_DWT_CYCCNT)
+
+//*****************************************************************************
+//
+// Statistics of a measured code section, in CPU cycles.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // Most recent measurement.
+    //
+    uint32_t ui32Last;
+
+    //
+    // Largest measurement since the last reset.
+    //
+    uint32_t ui32Max;
+
+    //
+    // Exponential moving average of the measurements.
+    //
+    float fMean;
+}
+tPerfStat;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern void InitCycleCounter(void);
+extern void PerfStatReset(tPerfStat *psStat);
+extern void PerfStatUpdate(tPerfStat *psStat, uint32_t ui32Start);
+
+//*****************************************************************************
+//
+// Mark the end of the C bindings section for C++ compilers.
+//
+//*****************************************************************************
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _PERF_H_
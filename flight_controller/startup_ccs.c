@@ -62,6 +62,8 @@ extern void MPU9150I2CIntHandler(void);
 extern void UARTStdioIntHandler(void);
 extern void RGBBlinkIntHandler(void);
 extern void UART2IntHandler(void);
+extern void SysTickIntHandler(void);
+extern void HilUARTIntHandler(void);
 
 
 //*****************************************************************************
@@ -90,13 +92,17 @@ void (* const g_pfnVectors[])(void) =
     IntDefaultHandler,                      // Debug monitor handler
     0,                                      // Reserved
     IntDefaultHandler,                      // The PendSV handler
-    IntDefaultHandler,                      // The SysTick handler
+    SysTickIntHandler,                      // The SysTick handler
     IntDefaultHandler,                      // GPIO Port A
     IntGPIOb,                               // GPIO Port B
     IntDefaultHandler,                      // GPIO Port C
     IntDefaultHandler,                      // GPIO Port D
     IntDefaultHandler,                      // GPIO Port E
+#ifdef HIL_BRIDGE
+    HilUARTIntHandler,                      // UART0 Rx and Tx
+#else
     UARTStdioIntHandler,                    // UART0 Rx and Tx
+#endif
     IntDefaultHandler,                      // UART1 Rx and Tx
     IntDefaultHandler,                      // SSI0 Rx and Tx
     IntDefaultHandler,                      // I2C0 Master and Slave
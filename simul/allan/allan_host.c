@@ -0,0 +1,774 @@
+//*****************************************************************************
+//
+// allan_host.c - Allan deviation and noise density of the gyroscope from a
+// static capture.
+//
+// The capture, text as in simul/mpu6050_integration or a log of
+// simul/replay/imu_log.h, is integrated into the angle of each axis once.
+// The overlapping Allan variance of a cluster of m samples is then a single
+// pass over the angles,
+//
+//   AVAR(m T) = sum (theta[k + 2m] - 2 theta[k + m] + theta[k])^2 /
+//               (2 (m T)^2 (N - 2m)),
+//
+// for CLUSTERS_PER_DECADE cluster sizes per decade up to a third of the
+// capture, O(N log N) in all, split over threads. The one-sided power
+// spectral density is Welch's average of Hann windowed periodograms of
+// WELCH_SIZE samples overlapping by half.
+//
+// From the Allan deviation sigma(tau):
+//
+// - the angle random walk N, in rad/s/sqrt(Hz), is sigma(1 s) of the part of
+//   the curve with a slope of -1/2,
+// - the bias instability B, in rad/s, is the minimum of the curve divided
+//   by sqrt(2 ln 2 / pi) = 0.664,
+// - the rate random walk K, in rad/s^2/sqrt(Hz), is sigma(3 s) of the part
+//   with a slope of +1/2. When the capture is too short to reach it, the
+//   last point bounds it from above.
+//
+// The white floor of the spectrum, between PSD_LOW_HZ and PSD_HIGH_HZ, is
+// 2 N^2 and cross-checks N. The parameters are written as the defines of
+// the gyroscope noise of simul/sensor_model/sensor_model.c and of
+// att_ekf.h, ready to replace the defaults.
+//
+// Build and run from this directory (the compile command is one line):
+//
+//   cc -O2 -pthread -I../replay -o allan_host allan_host.c
+//      ../replay/imu_log.c -lm
+//   ./allan_host [-r rate_hz] [-j threads] [-a allan.csv] [-p psd.csv]
+//      [-o noise.h] static.txt|static.imu
+//   ./allan_host
+//
+// The rate defaults to the 266.7 Hz of the captures, the threads to the
+// processors of the host. -a and -p write the curves, -o the defines,
+// which are printed as well.
+//
+// Without arguments a synthetic capture with a known angle random walk and
+// rate random walk is analyzed first, then gyro_data_static.txt. Returns 1
+// if N of the synthetic capture is off by more than SYNTH_TOLERANCE or K by
+// more than SYNTH_RRW_TOLERANCE, as the few long clusters of K scatter more,
+// or if the spectrum of a capture disagrees with its Allan deviation about N
+// by more than SYNTH_TOLERANCE.
+//
+//*****************************************************************************
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "imu_log.h"
+
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+#define RAD_TO_DEG              (180.0 / M_PI)
+#define DEFAULT_RATE            (1.0f / 0.00375f) // Hz, rate of the captures
+#define CLUSTERS_PER_DECADE     10
+#define MAX_CLUSTERS            128
+#define MAX_THREADS             16
+#define WELCH_SIZE              1024
+#define PSD_LOW_HZ              1.0
+#define PSD_HIGH_HZ             10.0
+#define BIAS_INSTABILITY_FACTOR 0.664
+
+#define SYNTH_SAMPLES           400000
+#define SYNTH_ARW               0.0003   // rad/s/sqrt(Hz)
+#define SYNTH_RRW               0.00005  // rad/s^2/sqrt(Hz)
+#define SYNTH_TOLERANCE         0.15
+#define SYNTH_RRW_TOLERANCE     0.3
+
+#define STATIC_CAPTURE          "../mpu6050_integration/gyro_data_static.txt"
+
+//*****************************************************************************
+//
+// The analysis of one capture: the Allan deviation per cluster size and
+// axis, the spectrum and the noise parameters per axis.
+//
+//*****************************************************************************
+typedef struct
+{
+    const double *pdAngle[3];
+    uint32_t ui32Samples;
+    double dPeriod;
+    uint32_t pui32Cluster[MAX_CLUSTERS];
+    uint32_t ui32Clusters;
+    double ppdSigma[MAX_CLUSTERS][3];
+    double ppdPsd[WELCH_SIZE / 2 + 1][3];
+    double pdArw[3];
+    double pdBias[3];
+    double pdBiasTau[3];
+    double pdRrw[3];
+    bool pbRrwBound[3];
+    double pdPsdArw[3];
+}
+tAnalysis;
+
+//*****************************************************************************
+//
+// The share of the cluster sizes of one thread: every ui32Step-th from
+// ui32First.
+//
+//*****************************************************************************
+typedef struct
+{
+    tAnalysis *psAnalysis;
+    uint32_t ui32First;
+    uint32_t ui32Step;
+}
+tWorker;
+
+//*****************************************************************************
+//
+// Gaussian noise by the Box-Muller transform.
+//
+//*****************************************************************************
+static double
+Gaussian(void)
+{
+    double dU = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double dV = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2.0 * log(dU)) * cos(2.0 * M_PI * dV);
+}
+
+//*****************************************************************************
+//
+// The Allan deviation of the cluster sizes of one thread.
+//
+//*****************************************************************************
+static void *
+AllanWorker(void *pvWorker)
+{
+    tWorker *psWorker = pvWorker;
+    tAnalysis *psAnalysis = psWorker->psAnalysis;
+    uint32_t c, k;
+    int i;
+
+    for (c = psWorker->ui32First; c < psAnalysis->ui32Clusters;
+         c += psWorker->ui32Step)
+    {
+        uint32_t m = psAnalysis->pui32Cluster[c];
+        uint32_t ui32Terms = psAnalysis->ui32Samples + 1 - 2 * m;
+        double dTau = m * psAnalysis->dPeriod;
+
+        for (i = 0; i < 3; i++)
+        {
+            const double *pdAngle = psAnalysis->pdAngle[i];
+            double dSum = 0.0;
+
+            for (k = 0; k < ui32Terms; k++)
+            {
+                double dDiff = (pdAngle[k + 2 * m] - 2.0 * pdAngle[k + m] +
+                                pdAngle[k]);
+                dSum += dDiff * dDiff;
+            }
+            psAnalysis->ppdSigma[c][i] = sqrt(dSum /
+                                              (2.0 * dTau * dTau * ui32Terms));
+        }
+    }
+    return NULL;
+}
+
+//*****************************************************************************
+//
+// In place radix-2 FFT of WELCH_SIZE complex values.
+//
+//*****************************************************************************
+static void
+FFT(double *pdRe, double *pdIm)
+{
+    uint32_t i, j, ui32Len;
+
+    for (i = 0, j = 0; i < WELCH_SIZE; i++)
+    {
+        if (i < j)
+        {
+            double dT = pdRe[i];
+            pdRe[i] = pdRe[j];
+            pdRe[j] = dT;
+            dT = pdIm[i];
+            pdIm[i] = pdIm[j];
+            pdIm[j] = dT;
+        }
+        uint32_t ui32Bit = WELCH_SIZE >> 1;
+        while (j & ui32Bit)
+        {
+            j ^= ui32Bit;
+            ui32Bit >>= 1;
+        }
+        j |= ui32Bit;
+    }
+    for (ui32Len = 2; ui32Len <= WELCH_SIZE; ui32Len <<= 1)
+    {
+        double dAngle = -2.0 * M_PI / ui32Len;
+        for (i = 0; i < WELCH_SIZE; i += ui32Len)
+        {
+            for (j = 0; j < ui32Len / 2; j++)
+            {
+                double dC = cos(dAngle * j), dS = sin(dAngle * j);
+                uint32_t a = i + j, b = i + j + ui32Len / 2;
+                double dRe = pdRe[b] * dC - pdIm[b] * dS;
+                double dIm = pdRe[b] * dS + pdIm[b] * dC;
+                pdRe[b] = pdRe[a] - dRe;
+                pdIm[b] = pdIm[a] - dIm;
+                pdRe[a] += dRe;
+                pdIm[a] += dIm;
+            }
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// Welch's estimate of the one-sided PSD of the rates, in (rad/s)^2/Hz.
+//
+//*****************************************************************************
+static void
+Spectrum(tAnalysis *psAnalysis)
+{
+    static double pdRe[WELCH_SIZE], pdIm[WELCH_SIZE], pdWindow[WELCH_SIZE];
+    double dWindowPower = 0.0;
+    uint32_t ui32Start, ui32Segments = 0, j;
+    int i;
+
+    for (j = 0; j < WELCH_SIZE; j++)
+    {
+        pdWindow[j] = 0.5 - 0.5 * cos(2.0 * M_PI * j / WELCH_SIZE);
+        dWindowPower += pdWindow[j] * pdWindow[j];
+    }
+    memset(psAnalysis->ppdPsd, 0, sizeof(psAnalysis->ppdPsd));
+    for (ui32Start = 0; ui32Start + WELCH_SIZE <= psAnalysis->ui32Samples;
+         ui32Start += WELCH_SIZE / 2)
+    {
+        for (i = 0; i < 3; i++)
+        {
+            const double *pdAngle = psAnalysis->pdAngle[i] + ui32Start;
+            double dMean = ((pdAngle[WELCH_SIZE] - pdAngle[0]) /
+                            (WELCH_SIZE * psAnalysis->dPeriod));
+
+            for (j = 0; j < WELCH_SIZE; j++)
+            {
+                pdRe[j] = (((pdAngle[j + 1] - pdAngle[j]) /
+                            psAnalysis->dPeriod - dMean) * pdWindow[j]);
+                pdIm[j] = 0.0;
+            }
+            FFT(pdRe, pdIm);
+            for (j = 0; j <= WELCH_SIZE / 2; j++)
+            {
+                double dPower = (pdRe[j] * pdRe[j] + pdIm[j] * pdIm[j]) *
+                                psAnalysis->dPeriod / dWindowPower;
+                if ((j != 0) && (j != WELCH_SIZE / 2))
+                {
+                    dPower *= 2.0;
+                }
+                psAnalysis->ppdPsd[j][i] += dPower;
+            }
+        }
+        ui32Segments++;
+    }
+    for (j = 0; j <= WELCH_SIZE / 2; j++)
+    {
+        for (i = 0; i < 3; i++)
+        {
+            psAnalysis->ppdPsd[j][i] /= ui32Segments ? ui32Segments : 1;
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// N, B and K per axis from the Allan deviation, and N from the white floor
+// of the spectrum. The slope of the curve at a point is taken from its
+// neighbors.
+//
+//*****************************************************************************
+static void
+Parameters(tAnalysis *psAnalysis)
+{
+    double dBinHz = 1.0 / (WELCH_SIZE * psAnalysis->dPeriod);
+    uint32_t c, j;
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        double dArwLog = 0.0, dRrwLog = 0.0, dPsd = 0.0;
+        uint32_t ui32Arw = 0, ui32Rrw = 0, ui32Bins = 0;
+        uint32_t ui32Min = 0;
+
+        for (c = 0; c < psAnalysis->ui32Clusters; c++)
+        {
+            double dTau = psAnalysis->pui32Cluster[c] * psAnalysis->dPeriod;
+            double dSigma = psAnalysis->ppdSigma[c][i];
+            uint32_t ui32Lo = c ? c - 1 : 0;
+            uint32_t ui32Hi = (c + 1 < psAnalysis->ui32Clusters) ? c + 1 : c;
+            double dSlope = ((log(psAnalysis->ppdSigma[ui32Hi][i]) -
+                              log(psAnalysis->ppdSigma[ui32Lo][i])) /
+                             log((double)psAnalysis->pui32Cluster[ui32Hi] /
+                                 psAnalysis->pui32Cluster[ui32Lo]));
+
+            if (dSigma < psAnalysis->ppdSigma[ui32Min][i])
+            {
+                ui32Min = c;
+            }
+            if ((dSlope > -0.75) && (dSlope < -0.25))
+            {
+                dArwLog += log(dSigma) + 0.5 * log(dTau);
+                ui32Arw++;
+            }
+            if ((dSlope > 0.25) && (dSlope < 0.75))
+            {
+                dRrwLog += log(dSigma) - 0.5 * log(dTau / 3.0);
+                ui32Rrw++;
+            }
+        }
+
+        psAnalysis->pdArw[i] = ui32Arw ? exp(dArwLog / ui32Arw) : 0.0;
+        psAnalysis->pdBias[i] = (psAnalysis->ppdSigma[ui32Min][i] /
+                                 BIAS_INSTABILITY_FACTOR);
+        psAnalysis->pdBiasTau[i] = (psAnalysis->pui32Cluster[ui32Min] *
+                                    psAnalysis->dPeriod);
+        psAnalysis->pbRrwBound[i] = ui32Rrw == 0;
+        if (ui32Rrw)
+        {
+            psAnalysis->pdRrw[i] = exp(dRrwLog / ui32Rrw);
+        }
+        else
+        {
+            c = psAnalysis->ui32Clusters - 1;
+            double dTau = psAnalysis->pui32Cluster[c] * psAnalysis->dPeriod;
+            psAnalysis->pdRrw[i] = (psAnalysis->ppdSigma[c][i] *
+                                    sqrt(3.0 / dTau));
+        }
+
+        for (j = 1; j < WELCH_SIZE / 2; j++)
+        {
+            if ((j * dBinHz >= PSD_LOW_HZ) && (j * dBinHz <= PSD_HIGH_HZ))
+            {
+                dPsd += psAnalysis->ppdPsd[j][i];
+                ui32Bins++;
+            }
+        }
+        psAnalysis->pdPsdArw[i] = ui32Bins ? sqrt(dPsd / ui32Bins / 2.0) : 0.0;
+    }
+}
+
+//*****************************************************************************
+//
+// Analyzes the angles of a capture with ui32Threads threads.
+//
+//*****************************************************************************
+static void
+Analyze(tAnalysis *psAnalysis, uint32_t ui32Threads)
+{
+    pthread_t psThreads[MAX_THREADS];
+    bool pbStarted[MAX_THREADS];
+    tWorker psWorkers[MAX_THREADS];
+    uint32_t ui32Max = psAnalysis->ui32Samples / 3;
+    uint32_t t;
+    int d;
+
+    //
+    // Cluster sizes evenly spaced in log, without repeats.
+    //
+    psAnalysis->ui32Clusters = 0;
+    for (d = 0; psAnalysis->ui32Clusters < MAX_CLUSTERS; d++)
+    {
+        uint32_t m = (uint32_t)floor(pow(10.0, (double)d /
+                                         CLUSTERS_PER_DECADE) + 0.5);
+        if (m > ui32Max)
+        {
+            break;
+        }
+        if (psAnalysis->ui32Clusters &&
+            (m == psAnalysis->pui32Cluster[psAnalysis->ui32Clusters - 1]))
+        {
+            continue;
+        }
+        psAnalysis->pui32Cluster[psAnalysis->ui32Clusters++] = m;
+    }
+
+    for (t = 0; t < ui32Threads; t++)
+    {
+        psWorkers[t].psAnalysis = psAnalysis;
+        psWorkers[t].ui32First = t;
+        psWorkers[t].ui32Step = ui32Threads;
+        pbStarted[t] = !pthread_create(psThreads + t, NULL, AllanWorker,
+                                       psWorkers + t);
+        if (!pbStarted[t])
+        {
+            AllanWorker(psWorkers + t);
+        }
+    }
+    Spectrum(psAnalysis);
+    for (t = 0; t < ui32Threads; t++)
+    {
+        if (pbStarted[t])
+        {
+            pthread_join(psThreads[t], NULL);
+        }
+    }
+    Parameters(psAnalysis);
+}
+
+//*****************************************************************************
+//
+// The angles of the gyroscope columns of a log, in rad, ui32Samples + 1 per
+// axis starting at 0.
+//
+//*****************************************************************************
+static bool
+Integrate(const tImuLog *psLog, double *ppdAngle[3])
+{
+    uint32_t ui32Samples = psLog->psHeader->ui32Samples;
+    double dPeriod = 1.0 / psLog->psHeader->fRate;
+    const char *ppcNames[3] = {"gyro_x", "gyro_y", "gyro_z"};
+    uint32_t n;
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        int iColumn = ImuLogColumnFind(psLog, ppcNames[i]);
+
+        if (iColumn < 0)
+        {
+            fprintf(stderr, "%s: no %s column\n", psLog->psHeader->pcSource,
+                    ppcNames[i]);
+            return false;
+        }
+        ppdAngle[i] = malloc((ui32Samples + 1) * sizeof(double));
+        if (!ppdAngle[i])
+        {
+            return false;
+        }
+        ppdAngle[i][0] = 0.0;
+        for (n = 0; n < ui32Samples; n++)
+        {
+            ppdAngle[i][n + 1] = (ppdAngle[i][n] +
+                                  ImuLogValue(psLog, iColumn, n) /
+                                  RAD_TO_DEG * dPeriod);
+        }
+    }
+    return true;
+}
+
+//*****************************************************************************
+//
+// Prints the Allan deviation and the parameters, and writes the curves and
+// the defines if asked to.
+//
+//*****************************************************************************
+static void
+Report(const tAnalysis *psAnalysis, const char *pcSource, const char *pcAllan,
+       const char *pcPsd, const char *pcOut)
+{
+    double dBinHz = 1.0 / (WELCH_SIZE * psAnalysis->dPeriod);
+    double dArw = 0.0, dRrw = 0.0;
+    FILE *psFile;
+    uint32_t c, j;
+    int i;
+
+    printf("%s: %u samples at %.1f Hz, %.1f s\n", pcSource,
+           psAnalysis->ui32Samples, 1.0 / psAnalysis->dPeriod,
+           psAnalysis->ui32Samples * psAnalysis->dPeriod);
+    printf("  %10s  %12s %12s %12s  (Allan deviation, deg/s)\n", "tau (s)",
+           "x", "y", "z");
+    for (c = 0; c < psAnalysis->ui32Clusters; c += 2)
+    {
+        printf("  %10.4f  %12.6f %12.6f %12.6f\n",
+               psAnalysis->pui32Cluster[c] * psAnalysis->dPeriod,
+               psAnalysis->ppdSigma[c][0] * RAD_TO_DEG,
+               psAnalysis->ppdSigma[c][1] * RAD_TO_DEG,
+               psAnalysis->ppdSigma[c][2] * RAD_TO_DEG);
+    }
+    for (i = 0; i < 3; i++)
+    {
+        printf("  %c: ARW %.3g rad/s/sqrt(Hz) (%.3f deg/sqrt(h), spectrum "
+               "%.3g), bias instability %.3g rad/s (%.2f deg/h at %.1f s), "
+               "RRW %s%.3g rad/s^2/sqrt(Hz)\n", 'x' + i,
+               psAnalysis->pdArw[i], psAnalysis->pdArw[i] * RAD_TO_DEG * 60.0,
+               psAnalysis->pdPsdArw[i], psAnalysis->pdBias[i],
+               psAnalysis->pdBias[i] * RAD_TO_DEG * 3600.0,
+               psAnalysis->pdBiasTau[i],
+               psAnalysis->pbRrwBound[i] ? "below " : "",
+               psAnalysis->pdRrw[i]);
+        dArw = psAnalysis->pdArw[i] > dArw ? psAnalysis->pdArw[i] : dArw;
+        dRrw = psAnalysis->pdRrw[i] > dRrw ? psAnalysis->pdRrw[i] : dRrw;
+    }
+
+    if (pcAllan && (psFile = fopen(pcAllan, "w")))
+    {
+        fprintf(psFile, "tau_s,sigma_x,sigma_y,sigma_z\n");
+        for (c = 0; c < psAnalysis->ui32Clusters; c++)
+        {
+            fprintf(psFile, "%.6g,%.6g,%.6g,%.6g\n",
+                    psAnalysis->pui32Cluster[c] * psAnalysis->dPeriod,
+                    psAnalysis->ppdSigma[c][0], psAnalysis->ppdSigma[c][1],
+                    psAnalysis->ppdSigma[c][2]);
+        }
+        fclose(psFile);
+    }
+    if (pcPsd && (psFile = fopen(pcPsd, "w")))
+    {
+        fprintf(psFile, "hz,psd_x,psd_y,psd_z\n");
+        for (j = 0; j <= WELCH_SIZE / 2; j++)
+        {
+            fprintf(psFile, "%.6g,%.6g,%.6g,%.6g\n", j * dBinHz,
+                    psAnalysis->ppdPsd[j][0], psAnalysis->ppdPsd[j][1],
+                    psAnalysis->ppdPsd[j][2]);
+        }
+        fclose(psFile);
+    }
+
+    //
+    // The defines, per axis for the sensor model and for the noisiest axis
+    // for the EKF.
+    //
+    for (psFile = stdout; psFile; psFile = (psFile == stdout && pcOut) ?
+                                           fopen(pcOut, "w") : NULL)
+    {
+        fprintf(psFile, "//\n// Gyroscope noise of %s, by allan_host.c.\n"
+                "//\n", pcSource);
+        fprintf(psFile, "#define GYRO_NOISE_ARW          {%.4g, %.4g, %.4g}"
+                " // rad/s/sqrt(Hz)\n", psAnalysis->pdArw[0],
+                psAnalysis->pdArw[1], psAnalysis->pdArw[2]);
+        fprintf(psFile, "#define GYRO_NOISE_BIAS         {%.4g, %.4g, %.4g}"
+                " // rad/s\n", psAnalysis->pdBias[0], psAnalysis->pdBias[1],
+                psAnalysis->pdBias[2]);
+        fprintf(psFile, "#define GYRO_NOISE_RRW          {%.4g, %.4g, %.4g}"
+                " // rad/s^2/sqrt(Hz)%s\n", psAnalysis->pdRrw[0],
+                psAnalysis->pdRrw[1], psAnalysis->pdRrw[2],
+                (psAnalysis->pbRrwBound[0] || psAnalysis->pbRrwBound[1] ||
+                 psAnalysis->pbRrwBound[2]) ? ", upper bound" : "");
+        fprintf(psFile, "#define ATT_EKF_GYRO_NOISE      %.4gf\n", dArw);
+        fprintf(psFile, "#define ATT_EKF_BIAS_NOISE      %.4gf\n", dRrw);
+        if (psFile != stdout)
+        {
+            fclose(psFile);
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// Analyzes a synthetic capture of white noise and a random walk of the
+// bias of known density, then the static capture. The synthetic one is
+// stored as float32 to keep the small values.
+//
+//*****************************************************************************
+static int
+SelfCheck(uint32_t ui32Threads)
+{
+    static tAnalysis sAnalysis;
+    double dPeriod = 1.0 / DEFAULT_RATE;
+    double *ppdAngle[3];
+    bool bOk = true;
+    uint32_t n;
+    int i;
+
+    srand(1);
+    for (i = 0; i < 3; i++)
+    {
+        double dBias = 0.0;
+
+        ppdAngle[i] = malloc((SYNTH_SAMPLES + 1) * sizeof(double));
+        if (!ppdAngle[i])
+        {
+            return 1;
+        }
+        ppdAngle[i][0] = 0.0;
+        for (n = 0; n < SYNTH_SAMPLES; n++)
+        {
+            double dRate = dBias + SYNTH_ARW / sqrt(dPeriod) * Gaussian();
+            ppdAngle[i][n + 1] = ppdAngle[i][n] + dRate * dPeriod;
+            dBias += SYNTH_RRW * sqrt(dPeriod) * Gaussian();
+        }
+        sAnalysis.pdAngle[i] = ppdAngle[i];
+    }
+    sAnalysis.ui32Samples = SYNTH_SAMPLES;
+    sAnalysis.dPeriod = dPeriod;
+    Analyze(&sAnalysis, ui32Threads);
+    Report(&sAnalysis, "synthetic", NULL, NULL, NULL);
+    for (i = 0; i < 3; i++)
+    {
+        if ((fabs(sAnalysis.pdArw[i] / SYNTH_ARW - 1.0) > SYNTH_TOLERANCE) ||
+            (fabs(sAnalysis.pdPsdArw[i] / SYNTH_ARW - 1.0) >
+             SYNTH_TOLERANCE) ||
+            sAnalysis.pbRrwBound[i] ||
+            (fabs(sAnalysis.pdRrw[i] / SYNTH_RRW - 1.0) >
+             SYNTH_RRW_TOLERANCE))
+        {
+            printf("  %c: ARW %.3g and %.3g, RRW %.3g instead of %.3g and "
+                   "%.3g\n", 'x' + i, sAnalysis.pdArw[i],
+                   sAnalysis.pdPsdArw[i], sAnalysis.pdRrw[i], SYNTH_ARW,
+                   SYNTH_RRW);
+            bOk = false;
+        }
+        free(ppdAngle[i]);
+    }
+
+    //
+    // The static capture. Its noise is not white above the low pass filter
+    // of the sensor, so only the agreement of the two estimates of N is
+    // checked.
+    //
+    {
+        FILE *psText = fopen(STATIC_CAPTURE, "r");
+        uint8_t *pui8Image;
+        size_t sSize;
+        tImuLog sLog;
+
+        if (!psText)
+        {
+            perror(STATIC_CAPTURE);
+            return 1;
+        }
+        if (!ImuLogConvert(psText, STATIC_CAPTURE, DEFAULT_RATE, &pui8Image,
+                           &sSize) ||
+            !ImuLogAttach(&sLog, pui8Image, sSize) ||
+            !Integrate(&sLog, ppdAngle))
+        {
+            fclose(psText);
+            return 1;
+        }
+        fclose(psText);
+        for (i = 0; i < 3; i++)
+        {
+            sAnalysis.pdAngle[i] = ppdAngle[i];
+        }
+        sAnalysis.ui32Samples = sLog.psHeader->ui32Samples;
+        sAnalysis.dPeriod = 1.0 / sLog.psHeader->fRate;
+        Analyze(&sAnalysis, ui32Threads);
+        Report(&sAnalysis, sLog.psHeader->pcSource, NULL, NULL, NULL);
+        for (i = 0; i < 3; i++)
+        {
+            if (fabs(sAnalysis.pdPsdArw[i] / sAnalysis.pdArw[i] - 1.0) >
+                SYNTH_TOLERANCE)
+            {
+                printf("  %c: ARW %.3g from the spectrum, %.3g from the "
+                       "Allan deviation\n", 'x' + i, sAnalysis.pdPsdArw[i],
+                       sAnalysis.pdArw[i]);
+                bOk = false;
+            }
+            free(ppdAngle[i]);
+        }
+        free(pui8Image);
+    }
+
+    printf(bOk ? "allan all passed\n" : "allan FAILED\n");
+    return bOk ? 0 : 1;
+}
+
+int
+main(int argc, char **argv)
+{
+    static tAnalysis sAnalysis;
+    const char *pcAllan = NULL, *pcPsd = NULL, *pcOut = NULL;
+    float fRate = DEFAULT_RATE;
+    long lThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint8_t *pui8Image = NULL;
+    double *ppdAngle[3] = {NULL, NULL, NULL};
+    bool bOk;
+    tImuLog sLog;
+    int iOpt, i;
+
+    while ((iOpt = getopt(argc, argv, "r:j:a:p:o:")) != -1)
+    {
+        switch (iOpt)
+        {
+            case 'r':
+                fRate = atof(optarg);
+                break;
+            case 'j':
+                lThreads = atol(optarg);
+                break;
+            case 'a':
+                pcAllan = optarg;
+                break;
+            case 'p':
+                pcPsd = optarg;
+                break;
+            case 'o':
+                pcOut = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-r rate_hz] [-j threads] "
+                        "[-a allan.csv] [-p psd.csv] [-o noise.h] "
+                        "static.txt|static.imu\n", argv[0]);
+                return 2;
+        }
+    }
+    lThreads = lThreads < 1 ? 1 : (lThreads > MAX_THREADS ? MAX_THREADS :
+                                   lThreads);
+    if (optind == argc)
+    {
+        return SelfCheck((uint32_t)lThreads);
+    }
+
+    //
+    // A log is mapped, a capture converted in memory.
+    //
+    {
+        FILE *psFile = fopen(argv[optind], "rb");
+        char pcMagic[4] = {0};
+        size_t sSize;
+
+        if (!psFile)
+        {
+            perror(argv[optind]);
+            return 1;
+        }
+        if (fread(pcMagic, 1, 4, psFile) != 4)
+        {
+            pcMagic[0] = 0;
+        }
+        if (!memcmp(pcMagic, IMU_LOG_MAGIC, 4))
+        {
+            fclose(psFile);
+            if (!ImuLogOpen(&sLog, argv[optind]))
+            {
+                return 1;
+            }
+        }
+        else
+        {
+            rewind(psFile);
+            bOk = (ImuLogConvert(psFile, argv[optind], fRate, &pui8Image,
+                                 &sSize) &&
+                   ImuLogAttach(&sLog, pui8Image, sSize));
+            fclose(psFile);
+            if (!bOk)
+            {
+                free(pui8Image);
+                return 1;
+            }
+        }
+    }
+    if (sLog.psHeader->ui32Samples < 2 * WELCH_SIZE)
+    {
+        fprintf(stderr, "%s: shorter than %d samples\n", argv[optind],
+                2 * WELCH_SIZE);
+        return 1;
+    }
+
+    bOk = Integrate(&sLog, ppdAngle);
+    if (bOk)
+    {
+        for (i = 0; i < 3; i++)
+        {
+            sAnalysis.pdAngle[i] = ppdAngle[i];
+        }
+        sAnalysis.ui32Samples = sLog.psHeader->ui32Samples;
+        sAnalysis.dPeriod = 1.0 / sLog.psHeader->fRate;
+        Analyze(&sAnalysis, (uint32_t)lThreads);
+        Report(&sAnalysis, sLog.psHeader->pcSource, pcAllan, pcPsd, pcOut);
+    }
+    for (i = 0; i < 3; i++)
+    {
+        free(ppdAngle[i]);
+    }
+    ImuLogClose(&sLog);
+    free(pui8Image);
+    return bOk ? 0 : 1;
+}
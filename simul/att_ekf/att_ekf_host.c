@@ -0,0 +1,450 @@
+//*****************************************************************************
+//
+// att_ekf_host.c - Consistency check and benchmark of
+//                  flight_controller/att_ekf.c.
+//
+// Replays a gyro log through the EKF attitude filter, the same way
+// CompDCMUpdate() runs it with COMP_DCM_MODE_EKF. The log has one sample per
+// line with the x, y and z rates in deg/s, as the captures in
+// simul/mpu6050_integration. As in simul/sil/attitude_drift.py the capture
+// without the bias of its first BIAS_SAMPLES samples is taken as the true
+// rates and integrated into the true attitude, and the filter gets
+//
+// - the rates with a constant bias drift and white noise of the density the
+//   filter assumes,
+// - the accelerometer as gravity in the body frame with white noise of the
+//   assumed size,
+// - every few samples the magnetometer heading of a field with an
+//   inclination of MAG_INCLINATION, with noise of the assumed size. Without
+//   it the yaw is not observable and its error grows until the linearization
+//   no longer holds during fast rotations.
+//
+// A consistent filter has errors that its covariance explains. The normalized
+// estimation error squared (NEES, attitude and bias errors weighted by the
+// inverse covariance) then has a mean of 6 and stays below the 95 % bound of
+// the chi-square distribution about 95 % of the time. The normalized
+// innovation squared (NIS) of the accelerometer has a mean of 2, not 3, as
+// the reading is normalized and has no noise along gravity. A mean well
+// above that means the filter is overconfident, one well below that it is
+// too cautious.
+//
+// Then the predict and update steps are timed.
+//
+// Build and run from this directory (the compile command is one line):
+//
+//   cc -O2 -I../../flight_controller -o att_ekf_host att_ekf_host.c
+//      ../../flight_controller/att_ekf.c -lm
+//   ./att_ekf_host log.txt [drift_deg_s] [sample_period_s] [heading_every]
+//
+// The drift defaults to 0.5 deg/s on every axis, the period to the 3.75 ms of
+// the captures and the heading to every 5th sample, as the AK8975 delivers
+// them in the flight controller; 0 turns the heading off. Returns 1 if the
+// mean NEES is not within a factor of 2 of its expected value.
+//
+//*****************************************************************************
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "att_ekf.h"
+
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+#define DEFAULT_PERIOD          0.00375f // s, period of the captures
+#define DEFAULT_DRIFT           0.5f     // deg/s
+#define DEFAULT_HEADING_EVERY   5
+#define MAG_INCLINATION         1.05f    // rad
+#define BIAS_SAMPLES            500
+#define MAX_SAMPLES             100000
+#define BENCH_UPDATES           1000000
+#define CHI2_6_95               12.59
+#define CHI2_3_95               7.81
+
+//*****************************************************************************
+//
+// Gaussian noise by the Box-Muller transform.
+//
+//*****************************************************************************
+static double
+Gaussian(void)
+{
+    double dU = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double dV = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2.0 * log(dU)) * cos(2.0 * M_PI * dV);
+}
+
+//*****************************************************************************
+//
+// Rotates ppfDCM by the body rates pfRate over fDeltaT, the same Rodrigues
+// increment as CompDCMRotate().
+//
+//*****************************************************************************
+static void
+Rotate(float ppfDCM[3][3], const float pfRate[3], float fDeltaT)
+{
+    float ppfInc[3][3], ppfOut[3][3];
+    float fX = pfRate[0] * fDeltaT;
+    float fY = pfRate[1] * fDeltaT;
+    float fZ = pfRate[2] * fDeltaT;
+    float fSigma = sqrtf(fX * fX + fY * fY + fZ * fZ);
+    float fA = 1.0f, fB = 0.5f;
+    int i, j;
+
+    if (fSigma > 1e-6f)
+    {
+        fA = sinf(fSigma) / fSigma;
+        fB = (1.0f - cosf(fSigma)) / (fSigma * fSigma);
+    }
+    ppfInc[0][0] = 1.0f - fB * (fY * fY + fZ * fZ);
+    ppfInc[0][1] = -fA * fZ + fB * fX * fY;
+    ppfInc[0][2] = fA * fY + fB * fX * fZ;
+    ppfInc[1][0] = fA * fZ + fB * fX * fY;
+    ppfInc[1][1] = 1.0f - fB * (fX * fX + fZ * fZ);
+    ppfInc[1][2] = -fA * fX + fB * fY * fZ;
+    ppfInc[2][0] = -fA * fY + fB * fX * fZ;
+    ppfInc[2][1] = fA * fX + fB * fY * fZ;
+    ppfInc[2][2] = 1.0f - fB * (fX * fX + fY * fY);
+
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            ppfOut[i][j] = (ppfDCM[i][0] * ppfInc[0][j] +
+                            ppfDCM[i][1] * ppfInc[1][j] +
+                            ppfDCM[i][2] * ppfInc[2][j]);
+        }
+    }
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            ppfDCM[i][j] = ppfOut[i][j];
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// Same as CompDCMNormalize().
+//
+//*****************************************************************************
+static void
+Normalize(float ppfDCM[3][3])
+{
+    float fError = (ppfDCM[0][0] * ppfDCM[1][0] + ppfDCM[0][1] * ppfDCM[1][1] +
+                    ppfDCM[0][2] * ppfDCM[1][2]);
+    float ppfRows[3][3];
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        ppfRows[0][i] = ppfDCM[0][i] - 0.5f * fError * ppfDCM[1][i];
+        ppfRows[1][i] = ppfDCM[1][i] - 0.5f * fError * ppfDCM[0][i];
+    }
+    ppfRows[2][0] = ppfRows[0][1] * ppfRows[1][2] - ppfRows[0][2] * ppfRows[1][1];
+    ppfRows[2][1] = ppfRows[0][2] * ppfRows[1][0] - ppfRows[0][0] * ppfRows[1][2];
+    ppfRows[2][2] = ppfRows[0][0] * ppfRows[1][1] - ppfRows[0][1] * ppfRows[1][0];
+    for (i = 0; i < 3; i++)
+    {
+        float fScale = 0.5f * (3.0f - (ppfRows[i][0] * ppfRows[i][0] +
+                                       ppfRows[i][1] * ppfRows[i][1] +
+                                       ppfRows[i][2] * ppfRows[i][2]));
+        ppfDCM[i][0] = fScale * ppfRows[i][0];
+        ppfDCM[i][1] = fScale * ppfRows[i][1];
+        ppfDCM[i][2] = fScale * ppfRows[i][2];
+    }
+}
+
+//*****************************************************************************
+//
+// Same as CompDCMEKFCorrect().
+//
+//*****************************************************************************
+static void
+Correct(float ppfDCM[3][3], float pfBias[3],
+        const float pfCorrection[ATT_EKF_STATES])
+{
+    int i;
+
+    Rotate(ppfDCM, pfCorrection, 1.0f);
+    Normalize(ppfDCM);
+    for (i = 0; i < 3; i++)
+    {
+        pfBias[i] += pfCorrection[i + 3];
+    }
+}
+
+//*****************************************************************************
+//
+// Heading of the field in the world frame of the estimate, as
+// CompDCMMagnetoFuse() computes it from a reading taken at the true
+// attitude.
+//
+//*****************************************************************************
+static float
+Heading(float ppfEst[3][3], float ppfTrue[3][3])
+{
+    float pfWorld[3] = {cosf(MAG_INCLINATION), 0.0f, sinf(MAG_INCLINATION)};
+    float pfBody[3];
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        pfBody[i] = (ppfTrue[0][i] * pfWorld[0] + ppfTrue[1][i] * pfWorld[1] +
+                     ppfTrue[2][i] * pfWorld[2]);
+    }
+    return atan2f(ppfEst[1][0] * pfBody[0] + ppfEst[1][1] * pfBody[1] +
+                  ppfEst[1][2] * pfBody[2],
+                  ppfEst[0][0] * pfBody[0] + ppfEst[0][1] * pfBody[1] +
+                  ppfEst[0][2] * pfBody[2]);
+}
+
+//*****************************************************************************
+//
+// The rotation vector of the attitude error in the body frame, the log of
+// ppfEst' ppfTrue.
+//
+//*****************************************************************************
+static void
+AttitudeError(float ppfEst[3][3], float ppfTrue[3][3], double pdError[3])
+{
+    double ppdE[3][3];
+    int i, j;
+
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            ppdE[i][j] = ((double)ppfEst[0][i] * ppfTrue[0][j] +
+                          (double)ppfEst[1][i] * ppfTrue[1][j] +
+                          (double)ppfEst[2][i] * ppfTrue[2][j]);
+        }
+    }
+    double dCos = 0.5 * (ppdE[0][0] + ppdE[1][1] + ppdE[2][2] - 1.0);
+    dCos = dCos > 1.0 ? 1.0 : (dCos < -1.0 ? -1.0 : dCos);
+    double dAngle = acos(dCos);
+    double dScale = dAngle > 1e-9 ? 0.5 * dAngle / sin(dAngle) : 0.5;
+    pdError[0] = dScale * (ppdE[2][1] - ppdE[1][2]);
+    pdError[1] = dScale * (ppdE[0][2] - ppdE[2][0]);
+    pdError[2] = dScale * (ppdE[1][0] - ppdE[0][1]);
+}
+
+//*****************************************************************************
+//
+// pdError' P^-1 pdError by Gauss-Jordan elimination of the covariance.
+//
+//*****************************************************************************
+static double
+Nees(tAttEKF *psEKF, const double pdError[ATT_EKF_STATES])
+{
+    double ppdA[ATT_EKF_STATES][ATT_EKF_STATES + 1];
+    int i, j, k;
+
+    for (i = 0; i < ATT_EKF_STATES; i++)
+    {
+        for (j = 0; j < ATT_EKF_STATES; j++)
+        {
+            ppdA[i][j] = psEKF->ppfP[i][j];
+        }
+        ppdA[i][ATT_EKF_STATES] = pdError[i];
+    }
+    for (k = 0; k < ATT_EKF_STATES; k++)
+    {
+        for (i = 0; i < ATT_EKF_STATES; i++)
+        {
+            if (i == k)
+            {
+                continue;
+            }
+            double dFactor = ppdA[i][k] / ppdA[k][k];
+            for (j = k; j <= ATT_EKF_STATES; j++)
+            {
+                ppdA[i][j] -= dFactor * ppdA[k][j];
+            }
+        }
+    }
+
+    double dNees = 0.0;
+    for (i = 0; i < ATT_EKF_STATES; i++)
+    {
+        dNees += pdError[i] * ppdA[i][ATT_EKF_STATES] / ppdA[i][i];
+    }
+    return dNees;
+}
+
+int
+main(int argc, char **argv)
+{
+    static float ppfRates[MAX_SAMPLES][3];
+    float ppfTrue[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    float ppfEst[3][3];
+    float pfBias[3] = {0.0f, 0.0f, 0.0f};
+    float pfGyro[3], pfAccel[3], pfCorrection[ATT_EKF_STATES];
+    double pdBias[3], pdMean[3] = {0.0, 0.0, 0.0};
+    double pdError[ATT_EKF_STATES], pdSqError[3] = {0.0, 0.0, 0.0};
+    double dNeesSum = 0.0, dNisSum = 0.0;
+    uint32_t ui32Samples = 0, ui32NeesIn = 0, ui32NisIn = 0, ui32Updates = 0;
+    float fPeriod, fDrift, fHeading0;
+    uint32_t ui32HeadingEvery;
+    tAttEKF sEKF;
+    int i, j;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s log.txt [drift_deg_s] "
+                "[sample_period_s] [heading_every]\n", argv[0]);
+        return 2;
+    }
+    FILE *psFile = fopen(argv[1], "r");
+    if (!psFile)
+    {
+        perror(argv[1]);
+        return 2;
+    }
+    fDrift = (argc > 2 ? atof(argv[2]) : DEFAULT_DRIFT) * (float)M_PI / 180.0f;
+    fPeriod = argc > 3 ? atof(argv[3]) : DEFAULT_PERIOD;
+    ui32HeadingEvery = argc > 4 ? atoi(argv[4]) : DEFAULT_HEADING_EVERY;
+
+    while ((ui32Samples < MAX_SAMPLES) &&
+           (fscanf(psFile, "%f %f %f", ppfRates[ui32Samples],
+                   ppfRates[ui32Samples] + 1, ppfRates[ui32Samples] + 2) == 3))
+    {
+        for (i = 0; i < 3; i++)
+        {
+            ppfRates[ui32Samples][i] *= (float)M_PI / 180.0f;
+            if (ui32Samples < BIAS_SAMPLES)
+            {
+                pdMean[i] += ppfRates[ui32Samples][i] / BIAS_SAMPLES;
+            }
+        }
+        ui32Samples++;
+    }
+    fclose(psFile);
+    if (ui32Samples <= BIAS_SAMPLES)
+    {
+        printf("log shorter than %d samples\n", BIAS_SAMPLES);
+        return 1;
+    }
+
+    //
+    // Starts level with the true attitude, as CompDCMStart() would from a
+    // noise free accelerometer.
+    //
+    srand(1);
+    AttEKFInit(&sEKF);
+    for (i = 0; i < 3; i++)
+    {
+        pdBias[i] = fDrift;
+        for (j = 0; j < 3; j++)
+        {
+            ppfEst[i][j] = ppfTrue[i][j];
+        }
+    }
+
+    //
+    // The heading that CompDCMMagnetoFuse() holds. It is taken at the true
+    // attitude, as it defines the true yaw of 0.
+    //
+    fHeading0 = Heading(ppfTrue, ppfTrue);
+
+    for (uint32_t n = 0; n < ui32Samples; n++)
+    {
+        float pfTrueRate[3];
+        for (i = 0; i < 3; i++)
+        {
+            pfTrueRate[i] = ppfRates[n][i] - (float)pdMean[i];
+            pfGyro[i] = (pfTrueRate[i] + (float)pdBias[i] +
+                         sEKF.fGyroNoise / sqrtf(fPeriod) * Gaussian() -
+                         pfBias[i]);
+        }
+        Rotate(ppfTrue, pfTrueRate, fPeriod);
+        Normalize(ppfTrue);
+        for (i = 0; i < 3; i++)
+        {
+            pfAccel[i] = 9.81f * (ppfTrue[2][i] +
+                                  sEKF.fAccelNoise * Gaussian());
+        }
+
+        //
+        // The steps of CompDCMUpdate() with COMP_DCM_MODE_EKF.
+        //
+        Rotate(ppfEst, pfGyro, fPeriod);
+        Normalize(ppfEst);
+        AttEKFPredict(&sEKF, pfGyro, fPeriod);
+        if (AttEKFAccelUpdate(&sEKF, ppfEst[2], pfAccel, 1.0f,
+                              pfCorrection))
+        {
+            Correct(ppfEst, pfBias, pfCorrection);
+            dNisSum += sEKF.fNIS;
+            ui32NisIn += sEKF.fNIS < CHI2_3_95;
+            ui32Updates++;
+        }
+
+        //
+        // The steps of CompDCMMagnetoFuse() with COMP_DCM_MODE_EKF.
+        //
+        if (ui32HeadingEvery && ((n % ui32HeadingEvery) == 0))
+        {
+            float fError = (fHeading0 - Heading(ppfEst, ppfTrue) -
+                            sEKF.fHeadingNoise * Gaussian());
+            fError -= 2.0f * (float)M_PI * floorf(fError / (2.0f * M_PI) +
+                                                  0.5f);
+            if (AttEKFHeadingUpdate(&sEKF, ppfEst[2], fError, pfCorrection))
+            {
+                Correct(ppfEst, pfBias, pfCorrection);
+            }
+        }
+
+        AttitudeError(ppfEst, ppfTrue, pdError);
+        for (i = 0; i < 3; i++)
+        {
+            pdError[i + 3] = pdBias[i] - pfBias[i];
+            pdSqError[i] += pdError[i] * pdError[i];
+        }
+        double dNees = Nees(&sEKF, pdError);
+        dNeesSum += dNees;
+        ui32NeesIn += dNees < CHI2_6_95;
+    }
+
+    double dMeanNees = dNeesSum / ui32Samples;
+    printf("%s: %u samples, %u accelerometer updates, %u rejected\n",
+           argv[1], ui32Samples, ui32Updates, sEKF.ui32Rejected);
+    printf("rms attitude error [deg]  %8.3f%8.3f%8.3f\n",
+           sqrt(pdSqError[0] / ui32Samples) * 180.0 / M_PI,
+           sqrt(pdSqError[1] / ui32Samples) * 180.0 / M_PI,
+           sqrt(pdSqError[2] / ui32Samples) * 180.0 / M_PI);
+    printf("final bias error [deg/s]  %8.3f%8.3f%8.3f\n",
+           pdError[3] * 180.0 / M_PI, pdError[4] * 180.0 / M_PI,
+           pdError[5] * 180.0 / M_PI);
+    printf("final 1-sigma [deg, deg/s]%8.3f%8.3f%8.3f%8.3f%8.3f%8.3f\n",
+           sqrt(sEKF.ppfP[0][0]) * 180.0 / M_PI,
+           sqrt(sEKF.ppfP[1][1]) * 180.0 / M_PI,
+           sqrt(sEKF.ppfP[2][2]) * 180.0 / M_PI,
+           sqrt(sEKF.ppfP[3][3]) * 180.0 / M_PI,
+           sqrt(sEKF.ppfP[4][4]) * 180.0 / M_PI,
+           sqrt(sEKF.ppfP[5][5]) * 180.0 / M_PI);
+    printf("NEES mean %.2f (expected 6), %.1f %% below %.2f\n", dMeanNees,
+           100.0 * ui32NeesIn / ui32Samples, CHI2_6_95);
+    printf("NIS mean %.2f (expected 2), %.1f %% below %.2f\n",
+           ui32Updates ? dNisSum / ui32Updates : 0.0,
+           ui32Updates ? 100.0 * ui32NisIn / ui32Updates : 0.0, CHI2_3_95);
+
+    //
+    // Time the steps of a sample on the last readings.
+    //
+    clock_t sStart = clock();
+    for (i = 0; i < BENCH_UPDATES; i++)
+    {
+        AttEKFPredict(&sEKF, pfGyro, fPeriod);
+        AttEKFAccelUpdate(&sEKF, ppfEst[2], pfAccel, 1.0f, pfCorrection);
+    }
+    double dSeconds = (double)(clock() - sStart) / CLOCKS_PER_SEC;
+    printf("predict + update: %.1f ns per sample\n",
+           dSeconds * 1e9 / BENCH_UPDATES);
+
+    return ((dMeanNees > 2.0 * ATT_EKF_STATES) ||
+            (dMeanNees < 0.5 * ATT_EKF_STATES)) ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+//*****************************************************************************
+//
+// autotune_host.c - Runs the relay identification of
+// flight_controller/autotune.c over a recorded log.
+//
+// The log has one sample per line, the D term rate in rad/s of the axis the
+// relay ran on, from the start of the relay experiment; simul/sil/autotune.py
+// --log writes one from the simulation. The samples are fed to the same relay
+// as in flight, whose switches match the recorded ones, and the cycles,
+// the fitted model and the PD gains are printed. The sample period defaults
+// to the 4 ms of the controller.
+//
+// Build and run from this directory (the compile command is one line):
+//
+//   cc -O2 -I../../flight_controller -o autotune_host autotune_host.c
+//      ../../flight_controller/autotune.c -lm
+//   ./autotune_host log.txt [period_s]
+//
+//*****************************************************************************
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "autotune.h"
+
+#define DEFAULT_PERIOD          (1.0f / 250.0f) // s
+
+int
+main(int argc, char **argv)
+{
+    tRelayId sRelay;
+    float fPeriod, fRate, fGain, fDelay, fKp, fKd;
+    uint32_t ui32Samples = 0;
+    uint32_t ui32Cycles = 0;
+    bool bDone = false;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s log.txt [period_s]\n", argv[0]);
+        return 2;
+    }
+    FILE *psFile = fopen(argv[1], "r");
+    if (!psFile)
+    {
+        perror(argv[1]);
+        return 2;
+    }
+    fPeriod = argc > 2 ? atof(argv[2]) : DEFAULT_PERIOD;
+
+    AutotuneRelayInit(&sRelay, AUTOTUNE_RELAY, AUTOTUNE_HYSTERESIS, fPeriod);
+    printf("cycle    period [s]   amplitude [rad/s]\n");
+    while (!bDone && (fscanf(psFile, "%f", &fRate) == 1))
+    {
+        float fMax = sRelay.fMax;
+        float fMin = sRelay.fMin;
+        uint32_t ui32Ticks = sRelay.ui32Ticks + 1;
+
+        ui32Samples++;
+        bDone = AutotuneRelayUpdate(&sRelay, fRate);
+        if (sRelay.ui32Cycles != ui32Cycles)
+        {
+            ui32Cycles = sRelay.ui32Cycles;
+            fMax = fRate > fMax ? fRate : fMax;
+            fMin = fRate < fMin ? fRate : fMin;
+            printf("%5u%14.4f%20.4f%s\n", ui32Cycles, ui32Ticks * fPeriod,
+                   0.5f * (fMax - fMin),
+                   ui32Cycles <= AUTOTUNE_SKIP_CYCLES ? "  (settling)" : "");
+        }
+    }
+    fclose(psFile);
+
+    if (!bDone)
+    {
+        fprintf(stderr, "%u samples, only %u of %u cycles\n", ui32Samples,
+                ui32Cycles, AUTOTUNE_SKIP_CYCLES + AUTOTUNE_CYCLES);
+    }
+    if (!AutotuneRelayModel(&sRelay, &fGain, &fDelay))
+    {
+        fprintf(stderr, "no oscillation above the hysteresis\n");
+        return 1;
+    }
+    AutotuneGains(fGain, fDelay, &fKp, &fKd);
+    printf("model b %.3f, theta %.1f ms\n", fGain, fDelay * 1e3f);
+    printf("gains kp %.1f, kd %.1f\n", fKp, fKd);
+
+    return 0;
+}
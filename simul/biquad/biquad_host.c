@@ -0,0 +1,203 @@
+//*****************************************************************************
+//
+// biquad_host.c - Host check and benchmark of flight_controller/biquad.c.
+//
+// Drives sine waves through the same filter code that runs on the flight
+// controller and compares the measured gain with the analytic response of
+// the coefficients, then times the gyro filter chain.
+//
+// Build and run from this directory (the compile command is one line):
+//
+//   cc -O2 -I../../flight_controller -o biquad_host biquad_host.c
+//      ../../flight_controller/biquad.c -lm
+//   ./biquad_host [lpf_hz] [notch_hz] [notch_q] [dterm_lpf_hz]
+//
+// Returns 1 if a measured gain is off by more than GAIN_TOLERANCE_DB.
+//
+//*****************************************************************************
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "biquad.h"
+
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+#define SAMPLE_RATE             250.0f // Hz, the IMU and controller rate
+#define SETTLE_SAMPLES          2500
+#define MEASURE_SAMPLES         5000
+#define BENCH_SAMPLES           10000000
+#define GAIN_TOLERANCE_DB       0.05
+
+//*****************************************************************************
+//
+// Analytic response of a chain at fFreq, gain in dB and phase in rad.
+//
+//*****************************************************************************
+static void
+ChainResponse(tBiquadChain *psChain, double dFreq, double *pdGainDb,
+              double *pdPhase)
+{
+    double dW = 2.0 * M_PI * dFreq / SAMPLE_RATE;
+    double dGain = 1.0;
+    double dPhase = 0.0;
+    int i;
+
+    for (i = 0; i < psChain->ui8Count; i++)
+    {
+        tBiquad *psB = &psChain->psStages[i];
+
+        //
+        // H(z) at z = e^jw, numerator and denominator as re + j im.
+        //
+        double dNumRe = psB->fB0 + psB->fB1 * cos(dW) + psB->fB2 * cos(2 * dW);
+        double dNumIm = -psB->fB1 * sin(dW) - psB->fB2 * sin(2 * dW);
+        double dDenRe = 1.0 + psB->fA1 * cos(dW) + psB->fA2 * cos(2 * dW);
+        double dDenIm = -psB->fA1 * sin(dW) - psB->fA2 * sin(2 * dW);
+
+        dGain *= hypot(dNumRe, dNumIm) / hypot(dDenRe, dDenIm);
+        dPhase += atan2(dNumIm, dNumRe) - atan2(dDenIm, dDenRe);
+    }
+
+    *pdGainDb = 20.0 * log10(dGain > 1e-12 ? dGain : 1e-12);
+    *pdPhase = dPhase;
+}
+
+//*****************************************************************************
+//
+// Measured gain of a chain at fFreq in dB, the same sine on all channels.
+//
+//*****************************************************************************
+static double
+ChainMeasure(tBiquadChain *psChain, double dFreq)
+{
+    double dIn = 0.0, dOut = 0.0;
+    float pfX[BIQUAD_CHANNELS], pfY[BIQUAD_CHANNELS];
+    int i, j;
+
+    BiquadChainReset(psChain);
+    for (i = 0; i < SETTLE_SAMPLES + MEASURE_SAMPLES; i++)
+    {
+        float fX = (float)sin(2.0 * M_PI * dFreq * i / SAMPLE_RATE);
+        for (j = 0; j < BIQUAD_CHANNELS; j++)
+        {
+            pfX[j] = fX;
+        }
+        BiquadChainApply(psChain, pfX, pfY);
+        if (i >= SETTLE_SAMPLES)
+        {
+            dIn += (double)fX * fX;
+            dOut += (double)pfY[BIQUAD_CHANNELS - 1] * pfY[BIQUAD_CHANNELS - 1];
+        }
+    }
+
+    return 10.0 * log10((dOut > 1e-24 ? dOut : 1e-24) / dIn);
+}
+
+//*****************************************************************************
+//
+// Prints the response table of a chain. Returns the number of frequencies
+// where the measurement disagrees with the coefficients.
+//
+//*****************************************************************************
+static int
+ChainReport(const char *pcName, tBiquadChain *psChain)
+{
+    static const double pdFreqs[] = {1, 5, 10, 20, 30, 40, 55, 70, 80, 100,
+                                     110, 120};
+    int i, iFailed = 0;
+
+    printf("%s\n%8s%12s%12s%12s\n", pcName, "f [Hz]", "gain [dB]",
+           "meas. [dB]", "delay [ms]");
+    for (i = 0; i < (int)(sizeof(pdFreqs) / sizeof(pdFreqs[0])); i++)
+    {
+        double dGain, dPhase;
+        ChainResponse(psChain, pdFreqs[i], &dGain, &dPhase);
+        double dMeas = ChainMeasure(psChain, pdFreqs[i]);
+
+        //
+        // Phase delay; unwrap the phase into (-2 pi, 0].
+        //
+        while (dPhase > 0.0)
+        {
+            dPhase -= 2.0 * M_PI;
+        }
+        while (dPhase <= -2.0 * M_PI)
+        {
+            dPhase += 2.0 * M_PI;
+        }
+        double dDelay = -dPhase / (2.0 * M_PI * pdFreqs[i]) * 1000.0;
+
+        int bBad = (dGain > -60.0) && (fabs(dMeas - dGain) > GAIN_TOLERANCE_DB);
+        iFailed += bBad;
+        printf("%8.0f%12.2f%12.2f%12.2f%s\n", pdFreqs[i], dGain, dMeas, dDelay,
+               bBad ? "  MISMATCH" : "");
+    }
+    printf("\n");
+
+    return iFailed;
+}
+
+int
+main(int argc, char **argv)
+{
+    float fLpf = argc > 1 ? atof(argv[1]) : 80.0f;
+    float fNotch = argc > 2 ? atof(argv[2]) : 55.0f;
+    float fNotchQ = argc > 3 ? atof(argv[3]) : 2.0f;
+    float fDTerm = argc > 4 ? atof(argv[4]) : 40.0f;
+    tBiquadChain sGyro, sDTerm;
+    int iFailed = 0;
+
+    //
+    // Same layout as the controller: notch, then low-pass.
+    //
+    BiquadChainInit(&sGyro, 2);
+    BiquadNotchInit(&sGyro.psStages[0], fNotch, fNotchQ, SAMPLE_RATE);
+    BiquadLowPassInit(&sGyro.psStages[1], fLpf, SAMPLE_RATE);
+    BiquadChainInit(&sDTerm, 1);
+    BiquadLowPassInit(&sDTerm.psStages[0], fDTerm, SAMPLE_RATE);
+
+    char pcName[80];
+    snprintf(pcName, sizeof(pcName), "gyro: notch %.1f Hz Q %.1f, "
+             "low-pass %.1f Hz", fNotch, fNotchQ, fLpf);
+    iFailed += ChainReport(pcName, &sGyro);
+    snprintf(pcName, sizeof(pcName), "D term: low-pass %.1f Hz", fDTerm);
+    iFailed += ChainReport(pcName, &sDTerm);
+
+    //
+    // Benchmark of the gyro chain, three channels per call.
+    //
+    float pfX[BIQUAD_CHANNELS], pfY[BIQUAD_CHANNELS];
+    float fSum = 0.0f;
+    unsigned int uiSeed = 1;
+    int i, j;
+    clock_t sStart = clock();
+    for (i = 0; i < BENCH_SAMPLES; i++)
+    {
+        //
+        // Noise input, keeps the states out of the denormal range.
+        //
+        for (j = 0; j < BIQUAD_CHANNELS; j++)
+        {
+            uiSeed = uiSeed * 1103515245u + 12345u;
+            pfX[j] = (float)(uiSeed >> 16) * (1.0f / 32768.0f) - 1.0f;
+        }
+        BiquadChainApply(&sGyro, pfX, pfY);
+        fSum += pfY[2];
+    }
+    double dSeconds = (double)(clock() - sStart) / CLOCKS_PER_SEC;
+    printf("gyro chain: %.1f ns per call (%d sections x %d channels, "
+           "including the input generation), checksum %g\n",
+           dSeconds * 1e9 / BENCH_SAMPLES, sGyro.ui8Count, BIQUAD_CHANNELS,
+           fSum);
+
+    if (iFailed)
+    {
+        printf("%d mismatches\n", iFailed);
+        return 1;
+    }
+    return 0;
+}
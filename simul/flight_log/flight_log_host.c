@@ -0,0 +1,366 @@
+//*****************************************************************************
+//
+// flight_log_host.c - Decodes the flight recorder of
+// flight_controller/blackbox.c on the host.
+//
+// With a file, the file is a dump of the LOG flash region read with the
+// debugger (or any run of its pages). Every page is decoded on its own and
+// the records are written to stdout as CSV, one line per sample, with a
+// session column. The fields are printed from their integers in fixed point,
+// so the output is exact and needs no float formatting.
+//
+// Without a file, a synthetic flight of random-walk sensor and control
+// values is encoded into pages like the firmware does, decoded back and
+// compared. The encoded size per record and the decode rate are printed.
+//
+// Build and run from this directory (the compile command is one line):
+//
+//   cc -O2 -I../../flight_controller -o flight_log_host flight_log_host.c
+//      ../../flight_controller/flight_log.c -lm
+//   ./flight_log_host dump.bin > log.csv
+//   ./flight_log_host
+//
+//*****************************************************************************
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "flight_log.h"
+
+#define BENCH_RECORDS           1000000
+#define BENCH_PERIOD_US         8000
+
+static const char *g_ppcNames[FLIGHT_LOG_FIELDS] =
+{
+    "tick", "loop_cycles", "ctrl_cycles",
+    "gyro_x", "gyro_y", "gyro_z",
+    "accel_x", "accel_y", "accel_z",
+    "roll", "pitch", "yaw",
+    "des_roll", "des_pitch", "des_yaw",
+    "thrust",
+    "omega_sq_0", "omega_sq_1", "omega_sq_2", "omega_sq_3",
+    "battery", "flags"
+};
+
+//*****************************************************************************
+//
+// Output buffer of the CSV writer.
+//
+//*****************************************************************************
+static char g_pcOut[1 << 16];
+static uint32_t g_ui32Out;
+
+static void
+OutFlush(void)
+{
+    fwrite(g_pcOut, 1, g_ui32Out, stdout);
+    g_ui32Out = 0;
+}
+
+//*****************************************************************************
+//
+// Appends i32Value * 10^-i8Exponent in fixed point, with i8Exponent
+// decimals for a positive exponent.
+//
+//*****************************************************************************
+static void
+OutFixed(int32_t i32Value, int8_t i8Exponent)
+{
+    char pcDigits[16];
+    uint32_t ui32Value;
+    int i32Count = 0;
+
+    if (i32Value < 0)
+    {
+        g_pcOut[g_ui32Out++] = '-';
+        ui32Value = -(uint32_t)i32Value;
+    }
+    else
+    {
+        ui32Value = i32Value;
+    }
+
+    do
+    {
+        pcDigits[i32Count++] = '0' + ui32Value % 10;
+        ui32Value /= 10;
+    }
+    while (ui32Value || (i32Count <= i8Exponent));
+
+    while (i32Count > 0)
+    {
+        if (i32Count == i8Exponent)
+        {
+            g_pcOut[g_ui32Out++] = '.';
+        }
+        g_pcOut[g_ui32Out++] = pcDigits[--i32Count];
+    }
+    for (i32Count = i8Exponent; i32Value && (i32Count < 0); i32Count++)
+    {
+        g_pcOut[g_ui32Out++] = '0';
+    }
+}
+
+//*****************************************************************************
+//
+// Decodes the dump to CSV. Pages with damaged records keep their records up
+// to the damage.
+//
+//*****************************************************************************
+static int
+Decode(const char *pcName)
+{
+    static uint8_t pui8Page[FLIGHT_LOG_PAGE];
+    tFlightLogCodec sCodec;
+    int32_t pi32Fields[FLIGHT_LOG_FIELDS];
+    uint32_t ui32Records = 0;
+    uint32_t ui32Pages = 0;
+    uint32_t ui32Damaged = 0;
+    int32_t i32Session = 0;
+    clock_t sStart;
+    double dSeconds;
+    size_t sRead;
+    int i;
+
+    FILE *psFile = fopen(pcName, "rb");
+    if (!psFile)
+    {
+        perror(pcName);
+        return 2;
+    }
+
+    printf("session");
+    for (i = 0; i < FLIGHT_LOG_FIELDS; i++)
+    {
+        printf(",%s", g_ppcNames[i]);
+    }
+    printf("\n");
+
+    sStart = clock();
+    while ((sRead = fread(pui8Page, 1, FLIGHT_LOG_PAGE, psFile)) > 0)
+    {
+        uint32_t ui32Pos = 0;
+
+        if (pui8Page[0] == FLIGHT_LOG_TAG_ERASED)
+        {
+            break;
+        }
+        ui32Pages++;
+        FlightLogCodecInit(&sCodec);
+        while (ui32Pos < sRead)
+        {
+            uint8_t ui8Tag;
+            int32_t i32Length = FlightLogDecode(&sCodec, pui8Page + ui32Pos,
+                                                sRead - ui32Pos, &ui8Tag,
+                                                pi32Fields);
+
+            if (i32Length < 0)
+            {
+                ui32Damaged++;
+                break;
+            }
+            if (i32Length == 0)
+            {
+                break;
+            }
+            ui32Pos += i32Length;
+
+            if (ui8Tag == FLIGHT_LOG_TAG_SESSION)
+            {
+                i32Session = pi32Fields[0];
+                continue;
+            }
+
+            OutFixed(i32Session, 0);
+            for (i = 0; i < FLIGHT_LOG_FIELDS; i++)
+            {
+                g_pcOut[g_ui32Out++] = ',';
+                OutFixed(pi32Fields[i], g_pi8FlightLogExponent[i]);
+            }
+            g_pcOut[g_ui32Out++] = '\n';
+            if (g_ui32Out > sizeof(g_pcOut) - 512)
+            {
+                OutFlush();
+            }
+            ui32Records++;
+        }
+    }
+    OutFlush();
+    dSeconds = (double)(clock() - sStart) / CLOCKS_PER_SEC;
+    fclose(psFile);
+
+    fprintf(stderr, "%u records in %u pages, %u damaged, %.1f M records/s\n",
+            ui32Records, ui32Pages, ui32Damaged,
+            ui32Records / (dSeconds > 0.0 ? dSeconds : 1e-9) * 1e-6);
+    return 0;
+}
+
+//*****************************************************************************
+//
+// A random walk step of standard deviation fSigma.
+//
+//*****************************************************************************
+static float
+Walk(float fValue, float fSigma)
+{
+    float fNoise = ((float)rand() / RAND_MAX - 0.5f) * 3.46f * fSigma;
+    return 0.99f * fValue + fNoise;
+}
+
+//*****************************************************************************
+//
+// Encodes a synthetic flight into pages, decodes it and compares.
+//
+//*****************************************************************************
+static int
+Benchmark(void)
+{
+    tFlightLogSample sSample;
+    tFlightLogCodec sCodec;
+    uint32_t ui32Pages, ui32Fill, ui32Record, ui32Page, ui32Decoded;
+    uint8_t *pui8Log;
+    int32_t (*ppi32Fields)[FLIGHT_LOG_FIELDS];
+    clock_t sStart;
+    double dEncode, dDecode;
+    int i;
+
+    ppi32Fields = malloc(BENCH_RECORDS * sizeof(*ppi32Fields));
+    ui32Pages = BENCH_RECORDS / 16;
+    pui8Log = malloc(ui32Pages * FLIGHT_LOG_PAGE);
+    if (!ppi32Fields || !pui8Log)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+
+    //
+    // The flight, quantized like in the firmware.
+    //
+    memset(&sSample, 0, sizeof(sSample));
+    srand(1);
+    for (ui32Record = 0; ui32Record < BENCH_RECORDS; ui32Record++)
+    {
+        sSample.ui32Tick = 2 * ui32Record;
+        sSample.ui32LoopCycles = 320000 + rand() % 64;
+        sSample.ui32CtrlCycles = 9000 + rand() % 400;
+        for (i = 0; i < 3; i++)
+        {
+            sSample.pfGyro[i] = Walk(sSample.pfGyro[i], 0.05f);
+            sSample.pfAccel[i] = Walk(sSample.pfAccel[i], 0.3f);
+            sSample.pfEuler[i] += 0.008f * sSample.pfGyro[i];
+            sSample.pfDesState[i] = (ui32Record / 250 % 2) ? 0.1f : 0.0f;
+        }
+        sSample.pfAccel[2] += 9.81f;
+        sSample.fThrustZDir = 0.5f + 0.1f * sSample.pfAccel[0];
+        for (i = 0; i < 4; i++)
+        {
+            sSample.pfOmegaSq[i] = 4e5f + 1e5f * sSample.pfGyro[i % 3];
+        }
+        sSample.fBatteryV = 12.6f - 1e-6f * ui32Record;
+        sSample.ui32Flags = (ui32Record % 97) == 0;
+        FlightLogQuantize(&sSample, ppi32Fields[ui32Record]);
+        sSample.pfAccel[2] -= 9.81f;
+    }
+
+    //
+    // Encode page after page.
+    //
+    sStart = clock();
+    ui32Page = 0;
+    ui32Fill = FlightLogEncodeSession(1, BENCH_PERIOD_US, pui8Log);
+    FlightLogCodecInit(&sCodec);
+    for (ui32Record = 0; ui32Record < BENCH_RECORDS; ui32Record++)
+    {
+        if (!FlightLogPageAdd(&sCodec, pui8Log + ui32Page * FLIGHT_LOG_PAGE,
+                              &ui32Fill, ppi32Fields[ui32Record]))
+        {
+            if (++ui32Page >= ui32Pages)
+            {
+                fprintf(stderr, "log too small\n");
+                return 2;
+            }
+            ui32Fill = 0;
+            FlightLogPageAdd(&sCodec, pui8Log + ui32Page * FLIGHT_LOG_PAGE,
+                             &ui32Fill, ppi32Fields[ui32Record]);
+        }
+    }
+    memset(pui8Log + ui32Page * FLIGHT_LOG_PAGE + ui32Fill,
+           FLIGHT_LOG_TAG_ERASED, FLIGHT_LOG_PAGE - ui32Fill);
+    ui32Pages = ui32Page + 1;
+    dEncode = (double)(clock() - sStart) / CLOCKS_PER_SEC;
+
+    //
+    // Decode and compare.
+    //
+    sStart = clock();
+    ui32Decoded = 0;
+    for (ui32Page = 0; ui32Page < ui32Pages; ui32Page++)
+    {
+        const uint8_t *pui8Page = pui8Log + ui32Page * FLIGHT_LOG_PAGE;
+        uint32_t ui32Pos = 0;
+
+        FlightLogCodecInit(&sCodec);
+        while (ui32Pos < FLIGHT_LOG_PAGE)
+        {
+            int32_t pi32Fields[FLIGHT_LOG_FIELDS];
+            uint8_t ui8Tag;
+            int32_t i32Length = FlightLogDecode(&sCodec, pui8Page + ui32Pos,
+                                                FLIGHT_LOG_PAGE - ui32Pos,
+                                                &ui8Tag, pi32Fields);
+
+            if (i32Length <= 0)
+            {
+                break;
+            }
+            ui32Pos += i32Length;
+            if (ui8Tag == FLIGHT_LOG_TAG_SESSION)
+            {
+                continue;
+            }
+            if ((ui32Decoded >= BENCH_RECORDS) ||
+                memcmp(pi32Fields, ppi32Fields[ui32Decoded],
+                       sizeof(pi32Fields)))
+            {
+                fprintf(stderr, "record %u differs\n", ui32Decoded);
+                return 1;
+            }
+            ui32Decoded++;
+        }
+    }
+    dDecode = (double)(clock() - sStart) / CLOCKS_PER_SEC;
+
+    if (ui32Decoded != BENCH_RECORDS)
+    {
+        fprintf(stderr, "%u of %u records decoded\n", ui32Decoded,
+                BENCH_RECORDS);
+        return 1;
+    }
+
+    printf("records          %u, all decode to the encoded fields\n",
+           BENCH_RECORDS);
+    printf("pages            %u of %d bytes\n", ui32Pages, FLIGHT_LOG_PAGE);
+    printf("bytes per record %.1f (raw sample %d)\n",
+           (double)ui32Pages * FLIGHT_LOG_PAGE / BENCH_RECORDS,
+           (int)sizeof(tFlightLogSample));
+    printf("encode           %.1f M records/s\n",
+           BENCH_RECORDS / (dEncode > 0.0 ? dEncode : 1e-9) * 1e-6);
+    printf("decode           %.1f M records/s\n",
+           BENCH_RECORDS / (dDecode > 0.0 ? dDecode : 1e-9) * 1e-6);
+    printf("Host rates; only the size carries over to the target.\n");
+
+    free(pui8Log);
+    free(ppi32Fields);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        return Decode(argv[1]);
+    }
+    return Benchmark();
+}
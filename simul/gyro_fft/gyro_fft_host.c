@@ -0,0 +1,121 @@
+//*****************************************************************************
+//
+// gyro_fft_host.c - Runs flight_controller/gyro_fft.c over a recorded log.
+//
+// The log has one sample per line with the x, y and z rates in deg/s, as
+// the captures in simul/mpu6050_integration. Samples are fed and the
+// analysis is stepped once per sample, as in the main loop of the flight
+// controller. Prints the tracked peaks once per second and the mean
+// spectrum of the whole log.
+//
+// Build and run from this directory (the compile command is one line):
+//
+//   cc -O2 -I../../flight_controller -o gyro_fft_host gyro_fft_host.c
+//      ../../flight_controller/gyro_fft.c -lm
+//   ./gyro_fft_host log.txt [sample_rate_hz] [min_hz] [max_hz]
+//
+// The sample rate defaults to the 3.75 ms period of the captures.
+//
+//*****************************************************************************
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "gyro_fft.h"
+
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+#define DEFAULT_SAMPLE_RATE     (1.0f / 0.00375f) // Hz
+#define BAR_WIDTH               50
+
+int
+main(int argc, char **argv)
+{
+    static tGyroFFT sFFT;
+    static double pdMean[GYRO_FFT_BINS];
+    float fSampleRate, fMinHz, fMaxHz;
+    float pfGyro[3];
+    uint32_t ui32Samples = 0;
+    int i;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s log.txt [sample_rate_hz] [min_hz] "
+                "[max_hz]\n", argv[0]);
+        return 2;
+    }
+    FILE *psFile = fopen(argv[1], "r");
+    if (!psFile)
+    {
+        perror(argv[1]);
+        return 2;
+    }
+    fSampleRate = argc > 2 ? atof(argv[2]) : DEFAULT_SAMPLE_RATE;
+    fMinHz = argc > 3 ? atof(argv[3]) : 20.0f;
+    fMaxHz = argc > 4 ? atof(argv[4]) : 0.5f * fSampleRate;
+
+    GyroFFTInit(&sFFT, fSampleRate, fMinHz, fMaxHz);
+
+    printf("%10s%12s%12s\n", "t [s]", "peak 1 [Hz]", "peak 2 [Hz]");
+    while (fscanf(psFile, "%f %f %f", pfGyro, pfGyro + 1, pfGyro + 2) == 3)
+    {
+        for (i = 0; i < 3; i++)
+        {
+            pfGyro[i] *= (float)M_PI / 180.0f;
+        }
+        GyroFFTAddSample(&sFFT, pfGyro);
+        ui32Samples++;
+
+        if (GyroFFTUpdate(&sFFT))
+        {
+            for (i = 0; i < GYRO_FFT_BINS; i++)
+            {
+                pdMean[i] += sFFT.pfSpectrum[i];
+            }
+        }
+
+        if ((ui32Samples % (uint32_t)fSampleRate) == 0)
+        {
+            printf("%10.1f%12.2f%12.2f\n", ui32Samples / fSampleRate,
+                   sFFT.pfPeakHz[0], GYRO_FFT_MAX_PEAKS > 1 ?
+                   sFFT.pfPeakHz[1] : 0.0f);
+        }
+    }
+    fclose(psFile);
+
+    if (!sFFT.ui32Count)
+    {
+        printf("log shorter than %d samples\n", GYRO_FFT_SIZE);
+        return 1;
+    }
+
+    //
+    // Mean spectrum in dB relative to its largest bin.
+    //
+    double dMax = 0.0;
+    for (i = 1; i < GYRO_FFT_BINS; i++)
+    {
+        pdMean[i] /= sFFT.ui32Count;
+        if (pdMean[i] > dMax)
+        {
+            dMax = pdMean[i];
+        }
+    }
+    printf("\n%u samples, %u analyses\n%10s%10s\n", ui32Samples,
+           sFFT.ui32Count, "f [Hz]", "[dB]");
+    for (i = 1; i < GYRO_FFT_BINS; i++)
+    {
+        double dDb = 10.0 * log10(pdMean[i] / dMax + 1e-12);
+        int iBar = (int)(BAR_WIDTH * (1.0 + dDb / 40.0));
+        printf("%10.2f%10.1f  ", i * fSampleRate / GYRO_FFT_SIZE, dDb);
+        for (; iBar > 0; iBar--)
+        {
+            putchar('#');
+        }
+        putchar('\n');
+    }
+
+    return 0;
+}
@@ -0,0 +1,900 @@
+//*****************************************************************************
+//
+// hil_host.c - Closes the loop of a flight controller on the bench through
+// the hardware-in-the-loop bridge, in real time.
+//
+// Firmware built with HIL_BRIDGE takes its sensor samples from the frames
+// of flight_controller/hil.c on UART0 instead of the MPU9150, and answers
+// every frame with its four ESC pulses. This program is the other end: it
+// flies the airframe of simul/sitl/sitl_quad.c, sends the sensor truth of
+// the airframe at 250 Hz and applies the pulses of every answer from the
+// moment it arrives. The radio stays with the board, the pilot flies with
+// the remote as usual.
+//
+// Every sensor frame carries the host time and the board echoes it, with the
+// time it took itself from the frame to the answer. The round trip is thus
+// measured on the host clock alone; the round trip less the board's time is
+// the delay the bridge adds to the loop, which the board flying on its own
+// MPU9150 does not have. HIL results are to be corrected by it, and the
+// report at the end gives its mean, percentiles and maximum.
+//
+// The device is a serial port of the board, or "pty" for a pseudo-terminal
+// whose name is printed, for a board simulator or a bridge to a remote
+// bench. Without a device the program checks itself: the codec on all
+// fields and on every single bit error, and the bridge over a
+// pseudo-terminal with a child process that answers like a board. Every
+// 50th frame is corrupted on the way and must not be answered, all others
+// must be, with the pulses the child computed from the sensor values.
+//
+// Build and run from this directory (the compile command is one line):
+//
+//   cc -O2 -Wall -I../sitl -I../mpu9150_model -I../sensor_model
+//      -I../../flight_controller -o hil_host hil_host.c ../sitl/sitl_quad.c
+//      ../sensor_model/sensor_model.c ../../flight_controller/hil.c -lm
+//   ./hil_host [-b baud] [-d s] [-s seed] [-t trace.csv] [device]
+//
+// -b sets the baud rate of a serial port, HIL_BAUD by default, -d the
+// duration, 60 s with a board and 5 s for the self check, and -t writes the
+// round trip, the pulses and the attitude of every answer.
+//
+//*****************************************************************************
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "hil.h"
+#include "sitl_quad.h"
+
+//*****************************************************************************
+//
+// Times in us: the sensor frames, the physics, the progress lines, and how
+// long the answers to the last frames are waited for at the end.
+//
+//*****************************************************************************
+#define US_PER_S                1000000ULL
+#define FRAME_US                4000ULL
+#define PHYSICS_US              250ULL
+#define REPORT_US               5000000ULL
+#define DRAIN_US                200000ULL
+
+//*****************************************************************************
+//
+// A new magnetometer value on every MAG_DIVIDER-th frame, 50 Hz.
+//
+//*****************************************************************************
+#define MAG_DIVIDER             5
+
+//*****************************************************************************
+//
+// The self check: the time the child takes per frame in us, the frames that
+// are corrupted, and the clock of the board the child reports its cycles in.
+//
+//*****************************************************************************
+#define ECHO_PROCESS_US         300
+#define CORRUPT_EVERY           50
+#define ECHO_CLOCK_MHZ          40
+
+#define RAD_TO_DEG              57.2957795f
+
+//*****************************************************************************
+//
+// The host side of the bridge: the link, the airframe with the pulses it
+// flies on, the frames in flight by sequence number and the measurements.
+//
+//*****************************************************************************
+static struct
+{
+    int iFd;
+    bool bSelfCheck;
+    struct timespec sStart;
+    tHilParser sParser;
+    FILE *psTrace;
+
+    //
+    // The airframe, its time in us and the pulses of the last answer.
+    //
+    tSitlQuad sQuad;
+    uint64_t ui64PhysicsUs;
+    float pfPulse[4];
+
+    //
+    // The frames sent and not answered yet: their host time and, in the
+    // self check, the pulses the child has to answer with.
+    //
+    uint8_t ui8Seq;
+    bool pbPending[256];
+    uint32_t pui32SentTime[256];
+    float ppfExpected[256][4];
+
+    //
+    // Frames sent, corrupted on purpose and answered, answers that do not
+    // match their frame and answers faster than the board says it was.
+    //
+    uint32_t ui32Sent;
+    uint32_t ui32Corrupted;
+    uint32_t ui32Answered;
+    uint32_t ui32Mismatched;
+    uint32_t ui32Impossible;
+
+    //
+    // Round trip and board time of every answer in us, and the sums of the
+    // last progress line.
+    //
+    uint32_t *pui32RoundTrip;
+    uint32_t *pui32Process;
+    uint32_t ui32MaxSamples;
+    uint64_t ui64IntervalSum;
+    uint32_t ui32IntervalMax;
+    uint32_t ui32IntervalCount;
+
+    //
+    // The flight.
+    //
+    float fMaxAltitude;
+    float fMaxTilt;
+}
+g_sHost;
+
+//*****************************************************************************
+//
+// Returns the us since the start of the program.
+//
+//*****************************************************************************
+static uint64_t
+NowUs(void)
+{
+    struct timespec sNow;
+
+    clock_gettime(CLOCK_MONOTONIC, &sNow);
+    return ((uint64_t)(sNow.tv_sec - g_sHost.sStart.tv_sec) * US_PER_S +
+            (sNow.tv_nsec - g_sHost.sStart.tv_nsec) / 1000);
+}
+
+//*****************************************************************************
+//
+// Sets a terminal to raw bytes, and the baud rate if it is not 0. Returns
+// false if the terminal does not take them.
+//
+//*****************************************************************************
+static bool
+TermRaw(int iFd, uint32_t ui32Baud)
+{
+    static const struct
+    {
+        uint32_t ui32Baud;
+        speed_t sSpeed;
+    }
+    psSpeeds[] =
+    {
+        { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 },
+        { 57600, B57600 }, { 115200, B115200 }, { 230400, B230400 },
+        { 460800, B460800 }, { 921600, B921600 }
+    };
+    struct termios sTerm;
+    uint32_t i;
+
+    if (tcgetattr(iFd, &sTerm) != 0)
+    {
+        return false;
+    }
+    cfmakeraw(&sTerm);
+    sTerm.c_cflag |= CLOCAL | CREAD;
+    sTerm.c_cc[VMIN] = 1;
+    sTerm.c_cc[VTIME] = 0;
+    if (ui32Baud)
+    {
+        for (i = 0; i < sizeof(psSpeeds) / sizeof(psSpeeds[0]); i++)
+        {
+            if (psSpeeds[i].ui32Baud == ui32Baud)
+            {
+                break;
+            }
+        }
+        if (i == sizeof(psSpeeds) / sizeof(psSpeeds[0]))
+        {
+            return false;
+        }
+        cfsetispeed(&sTerm, psSpeeds[i].sSpeed);
+        cfsetospeed(&sTerm, psSpeeds[i].sSpeed);
+    }
+    return tcsetattr(iFd, TCSANOW, &sTerm) == 0;
+}
+
+//*****************************************************************************
+//
+// Opens a pseudo-terminal. Returns the master, and in *piSlave the slave,
+// which stays open so that the settings hold until the other end opens it.
+//
+//*****************************************************************************
+static int
+PtyOpen(int *piSlave)
+{
+    int iMaster = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if ((iMaster < 0) || (grantpt(iMaster) != 0) ||
+        (unlockpt(iMaster) != 0))
+    {
+        return -1;
+    }
+    *piSlave = open(ptsname(iMaster), O_RDWR | O_NOCTTY);
+    if ((*piSlave < 0) || !TermRaw(*piSlave, 0) || !TermRaw(iMaster, 0))
+    {
+        return -1;
+    }
+    return iMaster;
+}
+
+//*****************************************************************************
+//
+// The pulses the child of the self check answers a sensor frame with.
+//
+//*****************************************************************************
+static void
+EchoPulses(const tHilSensor *psSensor, float pfPulse[4])
+{
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        pfPulse[i] = 0.5f + 0.02f * psSensor->pfAccel[i];
+    }
+    pfPulse[3] = 0.5f + 0.1f * psSensor->pfGyro[2];
+    for (i = 0; i < 4; i++)
+    {
+        pfPulse[i] = (pfPulse[i] < 0.0f) ? 0.0f :
+                     ((pfPulse[i] > 1.0f) ? 1.0f : pfPulse[i]);
+    }
+}
+
+//*****************************************************************************
+//
+// The child of the self check: answers every sensor frame like a board,
+// ECHO_PROCESS_US after it arrived. Exits with the frames it dropped for a
+// bad CRC when the host closes the link.
+//
+//*****************************************************************************
+static void
+EchoBoard(int iFd)
+{
+    tHilParser sParser;
+    tHilSensor sSensor;
+    tHilMotor sMotor;
+    uint8_t pui8Buffer[256], pui8Frame[HIL_MAX_FRAME];
+    uint64_t ui64Received;
+    ssize_t iCount, i;
+
+    HilParserInit(&sParser);
+    while ((iCount = read(iFd, pui8Buffer, sizeof(pui8Buffer))) > 0)
+    {
+        for (i = 0; i < iCount; i++)
+        {
+            if (HilParse(&sParser, pui8Buffer[i]) != HIL_TYPE_SENSOR)
+            {
+                continue;
+            }
+            ui64Received = NowUs();
+            HilSensorDecode(sParser.pui8Frame, &sSensor);
+            EchoPulses(&sSensor, sMotor.pfPulse);
+            while (NowUs() < ui64Received + ECHO_PROCESS_US)
+            {
+            }
+            sMotor.ui8Seq = sSensor.ui8Seq;
+            sMotor.ui32HostTime = sSensor.ui32HostTime;
+            sMotor.ui32BoardCycles = (uint32_t)(ui64Received *
+                                                ECHO_CLOCK_MHZ);
+            sMotor.ui16ProcessUs = (uint16_t)(NowUs() - ui64Received);
+            if (write(iFd, pui8Frame, HilMotorEncode(&sMotor, pui8Frame)) !=
+                HIL_MOTOR_LENGTH)
+            {
+                _exit(255);
+            }
+        }
+    }
+    _exit(sParser.ui32Errors > 254 ? 254 : (int)sParser.ui32Errors);
+}
+
+//*****************************************************************************
+//
+// Advances the airframe to ui64Now with the pulses of the last answer.
+//
+//*****************************************************************************
+static void
+PhysicsRun(uint64_t ui64Now)
+{
+    while (g_sHost.ui64PhysicsUs + PHYSICS_US <= ui64Now)
+    {
+        SitlQuadStep(&g_sHost.sQuad, g_sHost.pfPulse, PHYSICS_US * 1e-6f);
+        g_sHost.ui64PhysicsUs += PHYSICS_US;
+        if (g_sHost.sQuad.pfPos[2] > g_sHost.fMaxAltitude)
+        {
+            g_sHost.fMaxAltitude = g_sHost.sQuad.pfPos[2];
+        }
+        if (SitlQuadTilt(&g_sHost.sQuad) > g_sHost.fMaxTilt)
+        {
+            g_sHost.fMaxTilt = SitlQuadTilt(&g_sHost.sQuad);
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// Sends the sensor truth of the airframe at ui64Now. Returns false if the
+// link is gone.
+//
+//*****************************************************************************
+static bool
+SensorSend(uint64_t ui64Now)
+{
+    tMPU9150Truth sTruth;
+    tHilSensor sSensor;
+    uint8_t pui8Frame[HIL_SENSOR_LENGTH];
+    uint8_t ui8Seq = g_sHost.ui8Seq++;
+
+    PhysicsRun(ui64Now);
+    SitlQuadTruth(&g_sHost.sQuad, ui64Now * 1e-6f, &sTruth);
+
+    sSensor.ui8Seq = ui8Seq;
+    sSensor.ui32HostTime = (uint32_t)ui64Now;
+    memcpy(sSensor.pfAccel, sTruth.pfAccel, sizeof(sSensor.pfAccel));
+    memcpy(sSensor.pfGyro, sTruth.pfGyro, sizeof(sSensor.pfGyro));
+    memcpy(sSensor.pfMagneto, sTruth.pfMagneto, sizeof(sSensor.pfMagneto));
+    sSensor.fTemperature = sTruth.fTemperature;
+    sSensor.bMagnetoValid = (g_sHost.ui32Sent % MAG_DIVIDER) == 0;
+    HilSensorEncode(&sSensor, pui8Frame);
+
+    g_sHost.pbPending[ui8Seq] = true;
+    g_sHost.pui32SentTime[ui8Seq] = sSensor.ui32HostTime;
+    if (g_sHost.bSelfCheck)
+    {
+        //
+        // The child answers with the pulses of the values as it decodes
+        // them, or not at all if the frame is corrupted.
+        //
+        HilSensorDecode(pui8Frame, &sSensor);
+        EchoPulses(&sSensor, g_sHost.ppfExpected[ui8Seq]);
+        if ((g_sHost.ui32Sent % CORRUPT_EVERY) == CORRUPT_EVERY - 1)
+        {
+            pui8Frame[10] ^= 0x10;
+            g_sHost.pbPending[ui8Seq] = false;
+            g_sHost.ui32Corrupted++;
+        }
+    }
+    g_sHost.ui32Sent++;
+
+    return write(g_sHost.iFd, pui8Frame, HIL_SENSOR_LENGTH) ==
+           HIL_SENSOR_LENGTH;
+}
+
+//*****************************************************************************
+//
+// Takes a motor frame that arrived at ui64Now.
+//
+//*****************************************************************************
+static void
+MotorReceive(uint64_t ui64Now)
+{
+    tHilMotor sMotor;
+    uint32_t ui32RoundTrip;
+    float pfEulers[3];
+    int i;
+
+    HilMotorDecode(g_sHost.sParser.pui8Frame, &sMotor);
+    if (!g_sHost.pbPending[sMotor.ui8Seq] ||
+        (g_sHost.pui32SentTime[sMotor.ui8Seq] != sMotor.ui32HostTime))
+    {
+        g_sHost.ui32Mismatched++;
+        return;
+    }
+    g_sHost.pbPending[sMotor.ui8Seq] = false;
+
+    //
+    // The old pulses held until now.
+    //
+    PhysicsRun(ui64Now);
+    memcpy(g_sHost.pfPulse, sMotor.pfPulse, sizeof(g_sHost.pfPulse));
+
+    ui32RoundTrip = (uint32_t)ui64Now - sMotor.ui32HostTime;
+    if (ui32RoundTrip < sMotor.ui16ProcessUs)
+    {
+        g_sHost.ui32Impossible++;
+    }
+    if (g_sHost.bSelfCheck)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            if (fabsf(sMotor.pfPulse[i] -
+                      g_sHost.ppfExpected[sMotor.ui8Seq][i]) > 1e-4f)
+            {
+                g_sHost.ui32Mismatched++;
+                break;
+            }
+        }
+    }
+    if (g_sHost.ui32Answered < g_sHost.ui32MaxSamples)
+    {
+        g_sHost.pui32RoundTrip[g_sHost.ui32Answered] = ui32RoundTrip;
+        g_sHost.pui32Process[g_sHost.ui32Answered] = sMotor.ui16ProcessUs;
+    }
+    g_sHost.ui32Answered++;
+    g_sHost.ui64IntervalSum += ui32RoundTrip;
+    g_sHost.ui32IntervalCount++;
+    if (ui32RoundTrip > g_sHost.ui32IntervalMax)
+    {
+        g_sHost.ui32IntervalMax = ui32RoundTrip;
+    }
+
+    if (g_sHost.psTrace)
+    {
+        SitlQuadEulers(&g_sHost.sQuad, pfEulers);
+        fprintf(g_sHost.psTrace, "%.4f,%u,%u,%u,%.4f,%.4f,%.4f,%.4f,%.3f,"
+                "%.2f,%.2f,%.2f\n", ui64Now * 1e-6, sMotor.ui8Seq,
+                ui32RoundTrip, sMotor.ui16ProcessUs, sMotor.pfPulse[0],
+                sMotor.pfPulse[1], sMotor.pfPulse[2], sMotor.pfPulse[3],
+                g_sHost.sQuad.pfPos[2], pfEulers[0] * RAD_TO_DEG,
+                pfEulers[1] * RAD_TO_DEG, pfEulers[2] * RAD_TO_DEG);
+    }
+}
+
+//*****************************************************************************
+//
+// Reads what arrived. Returns false if the link is gone.
+//
+//*****************************************************************************
+static bool
+LinkRead(void)
+{
+    uint8_t pui8Buffer[256];
+    uint64_t ui64Now;
+    ssize_t iCount, i;
+
+    iCount = read(g_sHost.iFd, pui8Buffer, sizeof(pui8Buffer));
+    if (iCount <= 0)
+    {
+        return false;
+    }
+    ui64Now = NowUs();
+    for (i = 0; i < iCount; i++)
+    {
+        if (HilParse(&g_sHost.sParser, pui8Buffer[i]) == HIL_TYPE_MOTOR)
+        {
+            MotorReceive(ui64Now);
+        }
+    }
+    return true;
+}
+
+//*****************************************************************************
+//
+// Sends the sensor frames and takes the answers until ui64End, then waits
+// DRAIN_US for the last answers. Prints a progress line every REPORT_US
+// with a board. Returns false if the link is gone.
+//
+//*****************************************************************************
+static bool
+BridgeRun(uint64_t ui64End)
+{
+    struct pollfd sPoll;
+    struct timespec sTimeout;
+    uint64_t ui64Now, ui64Wake, ui64Next = 0, ui64Report = REPORT_US;
+
+    sPoll.fd = g_sHost.iFd;
+    sPoll.events = POLLIN;
+    while ((ui64Now = NowUs()) < ui64End + DRAIN_US)
+    {
+        if ((ui64Now >= ui64Next) && (ui64Now < ui64End))
+        {
+            if (!SensorSend(ui64Now))
+            {
+                return false;
+            }
+            ui64Next += FRAME_US;
+            if (ui64Next <= ui64Now)
+            {
+                ui64Next = ui64Now + FRAME_US;
+            }
+        }
+        if (!g_sHost.bSelfCheck && (ui64Now >= ui64Report))
+        {
+            printf("%6.0f s  round trip mean %6.2f ms, max %6.2f ms, "
+                   "%u of %u answered\n", ui64Now * 1e-6,
+                   g_sHost.ui32IntervalCount ?
+                   g_sHost.ui64IntervalSum * 1e-3 /
+                   g_sHost.ui32IntervalCount : 0.0,
+                   g_sHost.ui32IntervalMax * 1e-3, g_sHost.ui32Answered,
+                   g_sHost.ui32Sent);
+            fflush(stdout);
+            g_sHost.ui64IntervalSum = 0;
+            g_sHost.ui32IntervalMax = 0;
+            g_sHost.ui32IntervalCount = 0;
+            ui64Report += REPORT_US;
+        }
+
+        //
+        // Waits for an answer until the next frame, or the end.
+        //
+        ui64Wake = (ui64Next < ui64End) ? ui64Next : ui64End + DRAIN_US;
+        ui64Now = NowUs();
+        ui64Wake = (ui64Wake > ui64Now) ? ui64Wake - ui64Now : 0;
+        sTimeout.tv_sec = ui64Wake / US_PER_S;
+        sTimeout.tv_nsec = (ui64Wake % US_PER_S) * 1000;
+        if (ppoll(&sPoll, 1, &sTimeout, NULL) < 0)
+        {
+            return false;
+        }
+        if ((sPoll.revents & POLLIN) && !LinkRead())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//*****************************************************************************
+//
+// Sorts the measurements for the percentiles.
+//
+//*****************************************************************************
+static int
+Compare(const void *pvA, const void *pvB)
+{
+    uint32_t ui32A = *(const uint32_t *)pvA;
+    uint32_t ui32B = *(const uint32_t *)pvB;
+
+    return (ui32A > ui32B) - (ui32A < ui32B);
+}
+
+//*****************************************************************************
+//
+// Prints the mean, the median, the 99th percentile and the maximum of
+// ui32Count measurements in us, as ms. Sorts them.
+//
+//*****************************************************************************
+static double
+LatencyPrint(const char *pcName, uint32_t *pui32Us, uint32_t ui32Count)
+{
+    double dSum = 0.0;
+    uint32_t i;
+
+    if (!ui32Count)
+    {
+        printf("%-20s     none\n", pcName);
+        return 0.0;
+    }
+    for (i = 0; i < ui32Count; i++)
+    {
+        dSum += pui32Us[i];
+    }
+    qsort(pui32Us, ui32Count, sizeof(uint32_t), Compare);
+    printf("%-20s %8.3f %8.3f %8.3f %8.3f ms\n", pcName,
+           dSum * 1e-3 / ui32Count, pui32Us[ui32Count / 2] * 1e-3,
+           pui32Us[(uint32_t)(ui32Count * 0.99)] * 1e-3,
+           pui32Us[ui32Count - 1] * 1e-3);
+    return dSum * 1e-3 / ui32Count;
+}
+
+//*****************************************************************************
+//
+// Checks that the codec keeps every field to half of its unit, saturates out
+// of range values and finds every single bit error of a frame.
+//
+//*****************************************************************************
+static bool
+CodecCheck(void)
+{
+    static const float pfLimit[4] = { 0.005f, 0.0005f, 0.5e-8f, 0.005f };
+    tHilSensor sIn, sOut;
+    tHilMotor sMotor, sMotorOut;
+    tHilParser sParser;
+    uint8_t pui8Frame[HIL_MAX_FRAME];
+    uint32_t ui32Bit, ui32Byte, ui32Missed = 0, ui32Wrong = 0;
+    int i;
+
+    sIn.ui8Seq = 0xa5;
+    sIn.ui32HostTime = 0xdeadbeef;
+    for (i = 0; i < 3; i++)
+    {
+        sIn.pfAccel[i] = 9.8123f * (i - 1) + 0.0037f;
+        sIn.pfGyro[i] = -1.23456f * (i + 1);
+        sIn.pfMagneto[i] = 31.4159e-6f * (1 - i);
+    }
+    sIn.fTemperature = 31.337f;
+    sIn.bMagnetoValid = true;
+    HilSensorEncode(&sIn, pui8Frame);
+    HilSensorDecode(pui8Frame, &sOut);
+    for (i = 0; i < 3; i++)
+    {
+        ui32Wrong += (fabsf(sOut.pfAccel[i] - sIn.pfAccel[i]) > pfLimit[0]) +
+                     (fabsf(sOut.pfGyro[i] - sIn.pfGyro[i]) > pfLimit[1]) +
+                     (fabsf(sOut.pfMagneto[i] - sIn.pfMagneto[i]) >
+                      pfLimit[2]);
+    }
+    ui32Wrong += (fabsf(sOut.fTemperature - sIn.fTemperature) > pfLimit[3]) +
+                 (sOut.ui8Seq != sIn.ui8Seq) +
+                 (sOut.ui32HostTime != sIn.ui32HostTime) +
+                 (sOut.bMagnetoValid != sIn.bMagnetoValid);
+
+    //
+    // Out of range values stop at the limits of the field.
+    //
+    sIn.pfAccel[0] = 1000.0f;
+    sIn.pfGyro[0] = -100.0f;
+    HilSensorEncode(&sIn, pui8Frame);
+    HilSensorDecode(pui8Frame, &sOut);
+    ui32Wrong += (sOut.pfAccel[0] != 327.67f) + (sOut.pfGyro[0] != -32.768f);
+
+    sMotor.ui8Seq = 7;
+    sMotor.ui32HostTime = 123456789;
+    sMotor.ui32BoardCycles = 0xfedcba98;
+    sMotor.ui16ProcessUs = 1234;
+    for (i = 0; i < 4; i++)
+    {
+        sMotor.pfPulse[i] = 0.3f * i - 0.1f;
+    }
+    HilMotorEncode(&sMotor, pui8Frame);
+    HilMotorDecode(pui8Frame, &sMotorOut);
+    ui32Wrong += (sMotorOut.ui8Seq != sMotor.ui8Seq) +
+                 (sMotorOut.ui32HostTime != sMotor.ui32HostTime) +
+                 (sMotorOut.ui32BoardCycles != sMotor.ui32BoardCycles) +
+                 (sMotorOut.ui16ProcessUs != sMotor.ui16ProcessUs) +
+                 (sMotorOut.pfPulse[0] != 0.0f) +
+                 (fabsf(sMotorOut.pfPulse[1] - 0.2f) > 1e-5f) +
+                 (fabsf(sMotorOut.pfPulse[2] - 0.5f) > 1e-5f) +
+                 (fabsf(sMotorOut.pfPulse[3] - 0.8f) > 1e-5f);
+
+    //
+    // Every single bit error of a sensor frame after the sync byte is
+    // dropped, and one of the next three good frames is taken: the receiver
+    // may have locked on a sync value in the payload, as the sequence number
+    // here is.
+    //
+    HilSensorEncode(&sIn, pui8Frame);
+    for (ui32Byte = 1; ui32Byte < HIL_SENSOR_LENGTH; ui32Byte++)
+    {
+        for (ui32Bit = 0; ui32Bit < 8; ui32Bit++)
+        {
+            uint32_t ui32Bad = 0, ui32Good = 0, ui32Frame;
+
+            HilParserInit(&sParser);
+            pui8Frame[ui32Byte] ^= 1 << ui32Bit;
+            for (i = 0; i < HIL_SENSOR_LENGTH; i++)
+            {
+                ui32Bad += (HilParse(&sParser, pui8Frame[i]) != 0);
+            }
+            pui8Frame[ui32Byte] ^= 1 << ui32Bit;
+            for (ui32Frame = 0; ui32Frame < 3; ui32Frame++)
+            {
+                for (i = 0; i < HIL_SENSOR_LENGTH; i++)
+                {
+                    ui32Good += (HilParse(&sParser, pui8Frame[i]) ==
+                                 HIL_TYPE_SENSOR);
+                }
+            }
+            if (ui32Bad || !ui32Good)
+            {
+                ui32Missed++;
+            }
+        }
+    }
+
+    printf("codec                %8u wrong fields, %u of %u bit errors "
+           "missed\n", ui32Wrong, ui32Missed, (HIL_SENSOR_LENGTH - 1) * 8);
+    return (ui32Wrong == 0) && (ui32Missed == 0);
+}
+
+//*****************************************************************************
+//
+// Runs the bridge and reports.
+//
+//*****************************************************************************
+int
+main(int argc, char **argv)
+{
+    const char *pcDevice = NULL, *pcTrace = NULL;
+    uint32_t ui32Baud = HIL_BAUD, ui32Seed = 1, ui32Lost, ui32Count, ui32Idx;
+    uint32_t *pui32Link;
+    double dDuration = 0.0, dWall, dRoundTrip, dProcess;
+    bool bOk = true, bLink;
+    pid_t iChild = -1;
+    int iSlave = -1, iStatus = 0, i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if ((argv[i][0] == '-') && (i + 1 < argc))
+        {
+            switch (argv[i][1])
+            {
+            case 'b':
+                ui32Baud = (uint32_t)strtoul(argv[++i], NULL, 0);
+                continue;
+            case 'd':
+                dDuration = atof(argv[++i]);
+                continue;
+            case 's':
+                ui32Seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+                continue;
+            case 't':
+                pcTrace = argv[++i];
+                continue;
+            }
+        }
+        if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "usage: %s [-b baud] [-d s] [-s seed] "
+                    "[-t trace.csv] [device]\n", argv[0]);
+            return 2;
+        }
+        pcDevice = argv[i];
+    }
+
+    //
+    // The link: the self check with its child, a pseudo-terminal, or the
+    // serial port of a board.
+    //
+    g_sHost.bSelfCheck = !pcDevice;
+    if (g_sHost.bSelfCheck)
+    {
+        bOk = CodecCheck();
+        g_sHost.iFd = PtyOpen(&iSlave);
+        if (g_sHost.iFd >= 0)
+        {
+            iChild = fork();
+            if (iChild == 0)
+            {
+                close(g_sHost.iFd);
+                EchoBoard(iSlave);
+            }
+            close(iSlave);
+        }
+    }
+    else if (!strcmp(pcDevice, "pty"))
+    {
+        g_sHost.iFd = PtyOpen(&iSlave);
+        if (g_sHost.iFd >= 0)
+        {
+            printf("pseudo-terminal      %s\n", ptsname(g_sHost.iFd));
+        }
+    }
+    else
+    {
+        g_sHost.iFd = open(pcDevice, O_RDWR | O_NOCTTY);
+        if ((g_sHost.iFd >= 0) && !TermRaw(g_sHost.iFd, ui32Baud))
+        {
+            fprintf(stderr, "%s: cannot set %u baud\n", pcDevice, ui32Baud);
+            return 2;
+        }
+    }
+    if ((g_sHost.iFd < 0) || (g_sHost.bSelfCheck && (iChild < 0)))
+    {
+        fprintf(stderr, "cannot open %s\n", pcDevice ? pcDevice : "a pty");
+        return 2;
+    }
+    if (dDuration <= 0.0)
+    {
+        dDuration = g_sHost.bSelfCheck ? 5.0 : 60.0;
+    }
+
+    //
+    // The ESCs of the bench went through their calibration when the board
+    // booted, the airframe starts armed.
+    //
+    SitlQuadInit(&g_sHost.sQuad, ui32Seed);
+    for (i = 0; i < 4; i++)
+    {
+        g_sHost.sQuad.pbEscArmed[i] = true;
+    }
+    HilParserInit(&g_sHost.sParser);
+    g_sHost.ui32MaxSamples = (uint32_t)(dDuration * US_PER_S / FRAME_US) + 16;
+    g_sHost.pui32RoundTrip = malloc(g_sHost.ui32MaxSamples *
+                                    sizeof(uint32_t));
+    g_sHost.pui32Process = malloc(g_sHost.ui32MaxSamples * sizeof(uint32_t));
+    pui32Link = malloc(g_sHost.ui32MaxSamples * sizeof(uint32_t));
+    if (!g_sHost.pui32RoundTrip || !g_sHost.pui32Process || !pui32Link)
+    {
+        return 2;
+    }
+    if (pcTrace)
+    {
+        g_sHost.psTrace = fopen(pcTrace, "w");
+        if (g_sHost.psTrace)
+        {
+            fprintf(g_sHost.psTrace, "t,seq,round_trip_us,board_us,p0,p1,"
+                    "p2,p3,z,roll,pitch,yaw\n");
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &g_sHost.sStart);
+    bLink = BridgeRun((uint64_t)(dDuration * US_PER_S));
+    dWall = NowUs() * 1e-6;
+    close(g_sHost.iFd);
+    if ((iSlave >= 0) && !g_sHost.bSelfCheck)
+    {
+        close(iSlave);
+    }
+    if (iChild > 0)
+    {
+        waitpid(iChild, &iStatus, 0);
+    }
+    if (g_sHost.psTrace)
+    {
+        fclose(g_sHost.psTrace);
+    }
+
+    //
+    // The report. The bridge adds the round trip less the time of the
+    // board to the loop.
+    //
+    ui32Count = (g_sHost.ui32Answered < g_sHost.ui32MaxSamples) ?
+                g_sHost.ui32Answered : g_sHost.ui32MaxSamples;
+    for (ui32Idx = 0; ui32Idx < ui32Count; ui32Idx++)
+    {
+        pui32Link[ui32Idx] = g_sHost.pui32RoundTrip[ui32Idx] -
+                             g_sHost.pui32Process[ui32Idx];
+    }
+    ui32Lost = g_sHost.ui32Sent - g_sHost.ui32Corrupted -
+               g_sHost.ui32Answered;
+
+    printf("sensor frames        %8u sent, %u corrupted\n", g_sHost.ui32Sent,
+           g_sHost.ui32Corrupted);
+    printf("motor frames         %8u answered, %u lost, %u mismatched, "
+           "%u bad CRC\n", g_sHost.ui32Answered, ui32Lost,
+           g_sHost.ui32Mismatched, g_sHost.sParser.ui32Errors);
+    printf("\n                         mean   median      p99      max\n");
+    dRoundTrip = LatencyPrint("round trip", g_sHost.pui32RoundTrip,
+                              ui32Count);
+    dProcess = LatencyPrint("board", g_sHost.pui32Process, ui32Count);
+    LatencyPrint("added by the bridge", pui32Link, ui32Count);
+    if (!g_sHost.bSelfCheck && strcmp(pcDevice, "pty"))
+    {
+        printf("on the wire          %8.3f ms at %u baud\n",
+               (HIL_SENSOR_LENGTH + HIL_MOTOR_LENGTH) * 10e3 / ui32Baud,
+               ui32Baud);
+    }
+    printf("\ncorrect HIL results for a delay of %.3f ms from the sensor to "
+           "the motors\n", dRoundTrip - dProcess);
+
+    if (g_sHost.bSelfCheck)
+    {
+        printf("answers too fast     %8u\n", g_sHost.ui32Impossible);
+        printf("dropped by the board %8d\n",
+               WIFEXITED(iStatus) ? WEXITSTATUS(iStatus) : -1);
+        bOk = bOk && bLink && (ui32Lost == 0) &&
+              (g_sHost.ui32Mismatched == 0) &&
+              (g_sHost.sParser.ui32Errors == 0) &&
+              (g_sHost.ui32Impossible == 0) && WIFEXITED(iStatus) &&
+              (WEXITSTATUS(iStatus) == (int)g_sHost.ui32Corrupted) &&
+              (g_sHost.ui32Answered > 0);
+    }
+    else
+    {
+        printf("max. altitude        %8.2f m\n", g_sHost.fMaxAltitude);
+        printf("max. tilt            %8.1f deg\n",
+               g_sHost.fMaxTilt * RAD_TO_DEG);
+        if (g_sHost.sQuad.bCrashed)
+        {
+            printf("crash                %8.2f m/s %.0f deg\n",
+                   g_sHost.sQuad.fCrashSpeed,
+                   g_sHost.sQuad.fCrashTilt * RAD_TO_DEG);
+        }
+        if (!bLink)
+        {
+            printf("link                     lost\n");
+        }
+        bOk = bLink && (g_sHost.ui32Answered > 0);
+    }
+
+    printf("\n%.0f s in %.2f s of real time\n", dDuration, dWall);
+    printf("%s\n", bOk ? (g_sHost.bSelfCheck ? "all passed" : "passed") :
+           "FAILED");
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,359 @@
+//*****************************************************************************
+//
+// i2c_recover_host.c - Runs the I2C bus recovery of
+// flight_controller/i2c_recover.c against a simulated bus and device.
+//
+// The bus model has a slave that was interrupted in the middle of a byte it
+// sends: it holds SDA low for its 0 bits, moves to the next bit on every
+// falling SCL edge and lets SDA go after the byte, and it resets on a STOP.
+// The bus clear is checked for every bit position and every byte, and for a
+// line that stays low.
+//
+// The device model completes the configuration transactions of the
+// recovery after a latency, the first one (the device reset) takes the
+// longest. Scenarios add a NACK, a transaction that never completes and a
+// bus that stays stuck for a few attempts. The main loop is simulated like
+// I2CWatch() in main.c, in steps of 1 ms (SysTick) and a coasting step every
+// 4 ms. The outage and the attempts of every scenario are printed and
+// checked.
+//
+// Build and run from this directory (the compile command is one line):
+//
+//   cc -O2 -I../../flight_controller -o i2c_recover_host i2c_recover_host.c
+//      ../../flight_controller/i2c_recover.c
+//   ./i2c_recover_host
+//
+//*****************************************************************************
+
+#include <stdio.h>
+#include "i2c_recover.h"
+
+#define CYCLES_PER_MS           40000
+#define SAMPLE_MS               4
+#define CONFIG_STEPS            3
+#define RESET_MS                100
+#define WRITE_MS                1
+
+//*****************************************************************************
+//
+// The bus: the line levels the master drives and the slave.
+//
+//*****************************************************************************
+static struct
+{
+    bool bScl;
+    bool bSda;
+    uint8_t ui8Byte;
+    uint32_t ui32BitsLeft;
+    bool bHeld;
+    uint32_t ui32Stops;
+}
+g_sBus;
+
+static bool
+SlaveSda(void)
+{
+    if (g_sBus.bHeld)
+    {
+        return false;
+    }
+    if (g_sBus.ui32BitsLeft == 0)
+    {
+        return true;
+    }
+    return (g_sBus.ui8Byte >> (g_sBus.ui32BitsLeft - 1)) & 1;
+}
+
+static void
+BusAcquire(void)
+{
+}
+
+static void
+BusSclSet(bool bHigh)
+{
+    if (g_sBus.bScl && !bHigh && g_sBus.ui32BitsLeft)
+    {
+        g_sBus.ui32BitsLeft--;
+    }
+    g_sBus.bScl = bHigh;
+}
+
+static void
+BusSdaSet(bool bHigh)
+{
+    bool bLine = g_sBus.bSda && SlaveSda();
+
+    g_sBus.bSda = bHigh;
+    if (g_sBus.bScl && !bLine && g_sBus.bSda && SlaveSda())
+    {
+        g_sBus.ui32Stops++;
+        g_sBus.ui32BitsLeft = 0;
+    }
+}
+
+static bool
+BusSdaGet(void)
+{
+    return g_sBus.bSda && SlaveSda();
+}
+
+static void
+BusDelay(void)
+{
+}
+
+static const tI2CBusPins g_sPins =
+{
+    BusAcquire, BusSclSet, BusSdaSet, BusSdaGet, BusDelay
+};
+
+//*****************************************************************************
+//
+// The device: the running transaction completes at ui32DoneMs. Scenario
+// faults: NACK the step ui32NackStep once, never complete step ui32HangStep
+// once, keep SDA held for ui32StuckAttempts bus clears.
+//
+//*****************************************************************************
+static struct
+{
+    tI2CRecover *psRec;
+    uint32_t ui32Ms;
+    bool bBusy;
+    bool bFail;
+    uint32_t ui32DoneMs;
+    bool bConfigured;
+    int32_t i32NackStep;
+    int32_t i32HangStep;
+    uint32_t ui32StuckAttempts;
+}
+g_sDev;
+
+static bool
+DeviceStep(void *pvData, uint32_t ui32Step)
+{
+    (void)pvData;
+    g_sDev.bConfigured = false;
+    if (ui32Step == 0)
+    {
+        if (g_sDev.ui32StuckAttempts)
+        {
+            //
+            // The bus stays stuck, the reset of the device is not
+            // acknowledged.
+            //
+            g_sDev.ui32StuckAttempts--;
+            g_sBus.bHeld = g_sDev.ui32StuckAttempts != 0;
+            g_sDev.bBusy = true;
+            g_sDev.bFail = true;
+            g_sDev.ui32DoneMs = g_sDev.ui32Ms + WRITE_MS;
+            return true;
+        }
+    }
+    g_sDev.bBusy = true;
+    g_sDev.bFail = false;
+    g_sDev.ui32DoneMs = g_sDev.ui32Ms + (ui32Step == 0 ? RESET_MS : WRITE_MS);
+    if ((int32_t)ui32Step == g_sDev.i32NackStep)
+    {
+        g_sDev.i32NackStep = -1;
+        g_sDev.bFail = true;
+    }
+    if ((int32_t)ui32Step == g_sDev.i32HangStep)
+    {
+        g_sDev.i32HangStep = -1;
+        g_sDev.ui32DoneMs = 0xffffffff;
+    }
+    if (ui32Step == CONFIG_STEPS - 1)
+    {
+        g_sDev.bConfigured = true;
+    }
+    return true;
+}
+
+static void
+DeviceTick(void)
+{
+    if (g_sDev.bBusy && (g_sDev.ui32Ms >= g_sDev.ui32DoneMs))
+    {
+        g_sDev.bBusy = false;
+        I2CRecoverDone(g_sDev.psRec, !g_sDev.bFail);
+    }
+}
+
+//*****************************************************************************
+//
+// Clears the bus of a slave that sends ui8Byte and was stopped with
+// ui32BitsLeft bits to go. Returns the pulses, checks the released SDA and
+// the STOP.
+//
+//*****************************************************************************
+static uint32_t
+ClearCase(uint8_t ui8Byte, uint32_t ui32BitsLeft, bool bHeld, bool *pbOk)
+{
+    uint32_t ui32Clocks;
+
+    g_sBus.bScl = true;
+    g_sBus.bSda = true;
+    g_sBus.ui8Byte = ui8Byte;
+    g_sBus.ui32BitsLeft = ui32BitsLeft;
+    g_sBus.bHeld = bHeld;
+    g_sBus.ui32Stops = 0;
+
+    ui32Clocks = I2CBusClear(&g_sPins);
+    *pbOk = bHeld ? (ui32Clocks == I2C_RECOVER_STUCK) :
+            ((ui32Clocks <= I2C_RECOVER_CLOCKS) && BusSdaGet() &&
+             (g_sBus.ui32Stops == 1));
+    return ui32Clocks;
+}
+
+//*****************************************************************************
+//
+// Runs a recovery from an error at 100 ms. Returns the outage in ms, or 0
+// if the device is not back within 2 s.
+//
+//*****************************************************************************
+static uint32_t
+RecoverCase(int32_t i32NackStep, int32_t i32HangStep,
+            uint32_t ui32StuckAttempts, uint32_t *pui32Attempts,
+            bool *pbFailsafe)
+{
+    tI2CRecover sRec;
+    uint32_t ui32LastStep = 0;
+    uint32_t ui32ResumeMs = 0;
+
+    I2CRecoverInit(&sRec, &g_sPins, DeviceStep, 0, CONFIG_STEPS,
+                   CYCLES_PER_MS);
+    g_sDev.psRec = &sRec;
+    g_sDev.bBusy = false;
+    g_sDev.bConfigured = false;
+    g_sDev.i32NackStep = i32NackStep;
+    g_sDev.i32HangStep = i32HangStep;
+    g_sDev.ui32StuckAttempts = ui32StuckAttempts;
+    g_sBus.bHeld = ui32StuckAttempts != 0;
+    *pbFailsafe = false;
+
+    for (g_sDev.ui32Ms = 0; g_sDev.ui32Ms < 2100; g_sDev.ui32Ms++)
+    {
+        uint32_t ui32Now = g_sDev.ui32Ms * CYCLES_PER_MS;
+
+        DeviceTick();
+        if (g_sDev.ui32Ms == 100)
+        {
+            I2CRecoverFault(&sRec, ui32Now);
+            ui32LastStep = g_sDev.ui32Ms;
+        }
+        if (!I2CRecoverActive(&sRec))
+        {
+            if (g_sDev.ui32Ms > 100)
+            {
+                break;
+            }
+            continue;
+        }
+
+        //
+        // The sample clock of the device runs on its own, so the first
+        // sample of the configured device can come before the next update
+        // of the recovery. A sample restarts the sample period of the
+        // updates, as in main.c.
+        //
+        if (g_sDev.bConfigured && !g_sDev.bBusy && !g_sDev.bFail)
+        {
+            if (!ui32ResumeMs)
+            {
+                ui32ResumeMs = g_sDev.ui32Ms + 1;
+            }
+            if (g_sDev.ui32Ms >= ui32ResumeMs)
+            {
+                ui32LastStep = g_sDev.ui32Ms;
+                ui32ResumeMs = g_sDev.ui32Ms + SAMPLE_MS;
+                I2CRecoverSample(&sRec, ui32Now);
+                continue;
+            }
+        }
+        else
+        {
+            ui32ResumeMs = 0;
+        }
+
+        if (g_sDev.ui32Ms - ui32LastStep >= SAMPLE_MS)
+        {
+            ui32LastStep = g_sDev.ui32Ms;
+            I2CRecoverUpdate(&sRec, ui32Now);
+            if (I2CRecoverOutageMs(&sRec, ui32Now) > I2C_RECOVER_FAILSAFE_MS)
+            {
+                *pbFailsafe = true;
+            }
+        }
+    }
+
+    *pui32Attempts = sRec.ui32Attempts;
+    return I2CRecoverActive(&sRec) ? 0 : sRec.ui32LastMs;
+}
+
+int
+main(void)
+{
+    static const struct
+    {
+        const char *pcName;
+        int32_t i32NackStep;
+        int32_t i32HangStep;
+        uint32_t ui32Stuck;
+        uint32_t ui32Attempts;
+    }
+    psCases[] =
+    {
+        { "clean",                 -1, -1, 0, 1 },
+        { "NACK of the config",     1, -1, 0, 2 },
+        { "reset never completes", -1,  0, 0, 2 },
+        { "bus stuck twice",       -1, -1, 2, 3 },
+    };
+    uint32_t ui32Byte, ui32Bits, ui32Max = 0, ui32Case;
+    bool bOk, bAllOk = true;
+
+    //
+    // Every byte and bit position of a slave stopped mid-byte.
+    //
+    for (ui32Byte = 0; ui32Byte < 256; ui32Byte++)
+    {
+        for (ui32Bits = 0; ui32Bits <= 8; ui32Bits++)
+        {
+            uint32_t ui32Clocks = ClearCase(ui32Byte, ui32Bits, false, &bOk);
+
+            if (!bOk)
+            {
+                printf("byte 0x%02x, %u bits left: bus not cleared\n",
+                       ui32Byte, ui32Bits);
+                bAllOk = false;
+            }
+            ui32Max = ui32Clocks > ui32Max ? ui32Clocks : ui32Max;
+        }
+    }
+    printf("bus clear: 256 bytes x 9 bit positions, at most %u SCL pulses\n",
+           ui32Max);
+    ClearCase(0, 0, true, &bOk);
+    printf("bus clear: SDA held low is reported stuck: %s\n",
+           bOk ? "yes" : "no");
+    bAllOk = bAllOk && bOk;
+
+    printf("\nscenario                 outage ms  attempts  failsafe\n");
+    for (ui32Case = 0; ui32Case < sizeof(psCases) / sizeof(psCases[0]);
+         ui32Case++)
+    {
+        uint32_t ui32Attempts;
+        bool bFailsafe;
+        uint32_t ui32Ms = RecoverCase(psCases[ui32Case].i32NackStep,
+                                      psCases[ui32Case].i32HangStep,
+                                      psCases[ui32Case].ui32Stuck,
+                                      &ui32Attempts, &bFailsafe);
+
+        printf("%-24s %9u %9u %9s\n", psCases[ui32Case].pcName, ui32Ms,
+               ui32Attempts, bFailsafe ? "yes" : "no");
+        bAllOk = bAllOk && ui32Ms &&
+            (ui32Attempts == psCases[ui32Case].ui32Attempts);
+    }
+
+    printf("\n%s\n", bAllOk ? "all passed" : "FAILED");
+    return bAllOk ? 0 : 1;
+}
@@ -0,0 +1,467 @@
+//*****************************************************************************
+//
+// i2cm_fake.c - A simulated I2C bus behind the API of the TivaWare I2C
+// master driver.
+//
+// One bus with up to I2C_FAKE_DEVICES devices. Time is virtual and owned by
+// the host: I2CMFakeAdvance() moves the bus to a time and reports whether the
+// completion interrupt of the running command is due, then the host calls
+// I2CMIntHandler() as the NVIC would. A read is carried out on its device
+// when it reaches the bus, so it sees the registers at the start of the
+// transaction, a write takes effect when its last byte has been clocked,
+// and the callback runs from I2CMIntHandler() at that time. Faults are drawn
+// per command from tI2CMFakeConfig.
+//
+//*****************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sensorlib/i2cm_drv.h"
+
+#define I2C_FAKE_DEVICES        4
+
+//*****************************************************************************
+//
+// The bus: its configuration, devices, virtual time and statistics.
+//
+//*****************************************************************************
+static struct
+{
+    tI2CMFakeConfig sConfig;
+    tI2CMFakeDevice psDevices[I2C_FAKE_DEVICES];
+    uint32_t ui32Devices;
+    uint32_t ui32Random;
+    uint64_t ui64Now;
+    tI2CMFakeStats sStats;
+    void (*pfnIntEnable)(uint32_t ui32Interrupt);
+}
+g_sBus;
+
+//*****************************************************************************
+//
+// Returns a pseudo random number, xorshift32.
+//
+//*****************************************************************************
+static uint32_t
+I2CMFakeRandom(void)
+{
+    g_sBus.ui32Random ^= g_sBus.ui32Random << 13;
+    g_sBus.ui32Random ^= g_sBus.ui32Random >> 17;
+    g_sBus.ui32Random ^= g_sBus.ui32Random << 5;
+    return g_sBus.ui32Random;
+}
+
+//*****************************************************************************
+//
+// Returns the device at ui8Addr, or 0 if none answers there.
+//
+//*****************************************************************************
+static const tI2CMFakeDevice *
+I2CMFakeDeviceGet(uint8_t ui8Addr)
+{
+    uint32_t i;
+
+    for (i = 0; i < g_sBus.ui32Devices; i++)
+    {
+        if (g_sBus.psDevices[i].ui8Addr == ui8Addr)
+        {
+            return &g_sBus.psDevices[i];
+        }
+    }
+    return 0;
+}
+
+//*****************************************************************************
+//
+// Puts the command at the head of the queue on the bus at ui64Start: draws
+// its fault, carries it out on the device and computes its completion.
+//
+//*****************************************************************************
+static void
+I2CMFakeStart(tI2CMInstance *psInst, uint64_t ui64Start)
+{
+    const tI2CMCommand *psCommand = &psInst->pCommands[psInst->ui8ReadPtr];
+    const tI2CMFakeConfig *psConfig = &g_sBus.sConfig;
+    const tI2CMFakeDevice *psDevice = I2CMFakeDeviceGet(psCommand->ui8Addr);
+    uint32_t ui32Draw, ui32Bytes;
+    bool bAck;
+
+    //
+    // The device is brought to the time of the transaction before the
+    // address goes out, whether it acknowledges or not.
+    //
+    bAck = psDevice && psDevice->pfnStart(psDevice->pvDevice, ui64Start);
+
+    ui32Draw = I2CMFakeRandom() % 1000000;
+    ui32Bytes = 1;
+    psInst->ui8Status = I2CM_STATUS_SUCCESS;
+    if (!bAck || (ui32Draw < psConfig->ui32AddrNackPpm))
+    {
+        psInst->ui8Status = I2CM_STATUS_ADDR_NACK;
+        g_sBus.sStats.ui32AddrNacks++;
+    }
+    else if ((ui32Draw -= psConfig->ui32AddrNackPpm) <
+             psConfig->ui32DataNackPpm)
+    {
+        psInst->ui8Status = I2CM_STATUS_DATA_NACK;
+        g_sBus.sStats.ui32DataNacks++;
+        ui32Bytes += psCommand->ui16WriteCount ? 1 : 0;
+    }
+    else if ((ui32Draw -= psConfig->ui32DataNackPpm) <
+             psConfig->ui32BusErrorPpm)
+    {
+        //
+        // A glitch on the bus shows up as a lost arbitration.
+        //
+        psInst->ui8Status = I2CM_STATUS_ARB_LOST;
+        g_sBus.sStats.ui32BusErrors++;
+    }
+    else if (psCommand->ui16ReadCount)
+    {
+        //
+        // The register address of a read goes out right before the read.
+        //
+        if (psCommand->ui16WriteCount)
+        {
+            psDevice->pfnWrite(psDevice->pvDevice, psCommand->pui8WriteData,
+                               psCommand->ui16WriteCount);
+        }
+        psDevice->pfnRead(psDevice->pvDevice, psCommand->pui8ReadData,
+                          psCommand->ui16ReadCount);
+        ui32Bytes += (psCommand->ui16WriteCount + psCommand->ui16ReadCount +
+                      (psCommand->ui16WriteCount ? 1 : 0));
+    }
+    else
+    {
+        ui32Bytes += psCommand->ui16WriteCount;
+    }
+
+    psInst->bBusy = true;
+    psInst->ui64Done = (ui64Start + psConfig->ui32LatencyNs +
+                        (uint64_t)ui32Bytes * psConfig->ui32ByteNs);
+    if (psConfig->ui32JitterNs)
+    {
+        psInst->ui64Done += I2CMFakeRandom() % psConfig->ui32JitterNs;
+    }
+    g_sBus.sStats.ui32Transactions++;
+    g_sBus.sStats.ui32Bytes += ui32Bytes;
+    g_sBus.sStats.ui64BusyNs += psInst->ui64Done - ui64Start;
+
+    //
+    // Only a device that acknowledged its address can hold the bus.
+    //
+    ui32Draw = I2CMFakeRandom() % 1000000;
+    if ((psInst->ui8Status != I2CM_STATUS_ADDR_NACK) &&
+        (ui32Draw < psConfig->ui32HangPpm))
+    {
+        psInst->ui64Done = UINT64_MAX;
+        g_sBus.sStats.ui32Hangs++;
+    }
+}
+
+//*****************************************************************************
+//
+// Sets up the bus with no devices at time 0.
+//
+//*****************************************************************************
+void
+I2CMFakeReset(const tI2CMFakeConfig *psConfig)
+{
+    memset(&g_sBus, 0, sizeof(g_sBus));
+    I2CMFakeConfigSet(psConfig);
+}
+
+//*****************************************************************************
+//
+// Changes the timing and the faults of the bus, the devices and the time are
+// kept.
+//
+//*****************************************************************************
+void
+I2CMFakeConfigSet(const tI2CMFakeConfig *psConfig)
+{
+    g_sBus.sConfig = *psConfig;
+    g_sBus.ui32Random = psConfig->ui32Seed ? psConfig->ui32Seed : 1;
+}
+
+//*****************************************************************************
+//
+// Connects a device to the bus.
+//
+//*****************************************************************************
+void
+I2CMFakeDeviceAdd(const tI2CMFakeDevice *psDevice)
+{
+    if (g_sBus.ui32Devices < I2C_FAKE_DEVICES)
+    {
+        g_sBus.psDevices[g_sBus.ui32Devices++] = *psDevice;
+    }
+}
+
+//*****************************************************************************
+//
+// Sets the function I2CMInit() enables the interrupt of the peripheral with,
+// as the driver of TivaWare does. Without one the host takes the interrupt.
+//
+//*****************************************************************************
+void
+I2CMFakeIntHookSet(void (*pfnIntEnable)(uint32_t ui32Interrupt))
+{
+    g_sBus.pfnIntEnable = pfnIntEnable;
+}
+
+//*****************************************************************************
+//
+// Moves the bus to ui64Now. Returns true if the completion interrupt of the
+// running command is due.
+//
+//*****************************************************************************
+bool
+I2CMFakeAdvance(tI2CMInstance *psInst, uint64_t ui64Now)
+{
+    if (ui64Now > g_sBus.ui64Now)
+    {
+        g_sBus.ui64Now = ui64Now;
+    }
+    return psInst->bBusy && (psInst->ui64Done <= g_sBus.ui64Now);
+}
+
+//*****************************************************************************
+//
+// Returns the time of the next completion interrupt, UINT64_MAX if none is
+// coming.
+//
+//*****************************************************************************
+uint64_t
+I2CMFakeNext(const tI2CMInstance *psInst)
+{
+    return psInst->bBusy ? psInst->ui64Done : UINT64_MAX;
+}
+
+//*****************************************************************************
+//
+// Returns the statistics of the bus.
+//
+//*****************************************************************************
+const tI2CMFakeStats *
+I2CMFakeStatsGet(void)
+{
+    return &g_sBus.sStats;
+}
+
+//*****************************************************************************
+//
+// Initializes the driver instance. A command that hangs is dropped.
+//
+//*****************************************************************************
+void
+I2CMInit(tI2CMInstance *psInst, uint32_t ui32Base, uint_fast8_t ui8Int,
+         uint_fast8_t ui8TxDMA, uint_fast8_t ui8RxDMA,
+         uint_fast32_t ui32Clock)
+{
+    (void)ui8TxDMA;
+    (void)ui8RxDMA;
+
+    memset(psInst, 0, sizeof(*psInst));
+    psInst->ui32Base = ui32Base;
+    psInst->ui8Int = ui8Int;
+    psInst->ui32Clock = ui32Clock;
+    if (g_sBus.pfnIntEnable)
+    {
+        g_sBus.pfnIntEnable(ui8Int);
+    }
+}
+
+//*****************************************************************************
+//
+// Completes the running command and starts the next one, from the interrupt
+// of the I2C peripheral.
+//
+//*****************************************************************************
+void
+I2CMIntHandler(tI2CMInstance *psInst)
+{
+    tI2CMCommand sCommand;
+    uint64_t ui64Done;
+
+    if (!I2CMFakeAdvance(psInst, 0))
+    {
+        return;
+    }
+
+    sCommand = psInst->pCommands[psInst->ui8ReadPtr];
+    psInst->ui8ReadPtr = (psInst->ui8ReadPtr + 1) % NUM_I2CM_COMMANDS;
+    psInst->bBusy = false;
+    ui64Done = psInst->ui64Done;
+
+    //
+    // A write takes effect with its last byte.
+    //
+    if ((psInst->ui8Status == I2CM_STATUS_SUCCESS) && !sCommand.ui16ReadCount)
+    {
+        const tI2CMFakeDevice *psDevice = I2CMFakeDeviceGet(sCommand.ui8Addr);
+
+        psDevice->pfnStart(psDevice->pvDevice, ui64Done);
+        psDevice->pfnWrite(psDevice->pvDevice, sCommand.pui8WriteData,
+                           sCommand.ui16WriteCount);
+    }
+
+    if (sCommand.pfnCallback)
+    {
+        sCommand.pfnCallback(sCommand.pvCallbackData, psInst->ui8Status);
+    }
+
+    //
+    // A command queued by the callback may have started already.
+    //
+    if (!psInst->bBusy && (psInst->ui8ReadPtr != psInst->ui8WritePtr))
+    {
+        I2CMFakeStart(psInst, ui64Done);
+    }
+}
+
+//*****************************************************************************
+//
+// Queues a command. Returns 0 if the queue is full.
+//
+//*****************************************************************************
+uint_fast8_t
+I2CMCommand(tI2CMInstance *psInst, uint_fast8_t ui8Addr,
+            const uint8_t *pui8WriteData, uint_fast16_t ui16WriteCount,
+            uint_fast16_t ui16WriteBatchSize, uint8_t *pui8ReadData,
+            uint_fast16_t ui16ReadCount, uint_fast16_t ui16ReadBatchSize,
+            tSensorCallback *pfnCallback, void *pvCallbackData)
+{
+    tI2CMCommand *psCommand;
+    uint8_t ui8Next = (psInst->ui8WritePtr + 1) % NUM_I2CM_COMMANDS;
+
+    (void)ui16WriteBatchSize;
+    (void)ui16ReadBatchSize;
+
+    if (ui8Next == psInst->ui8ReadPtr)
+    {
+        g_sBus.sStats.ui32Rejected++;
+        return 0;
+    }
+
+    psCommand = &psInst->pCommands[psInst->ui8WritePtr];
+    psCommand->ui8Addr = ui8Addr;
+    psCommand->pui8WriteData = pui8WriteData;
+    psCommand->ui16WriteCount = ui16WriteCount;
+    psCommand->pui8ReadData = pui8ReadData;
+    psCommand->ui16ReadCount = ui16ReadCount;
+    psCommand->pfnCallback = pfnCallback;
+    psCommand->pvCallbackData = pvCallbackData;
+    psInst->ui8WritePtr = ui8Next;
+
+    if (!psInst->bBusy)
+    {
+        I2CMFakeStart(psInst, g_sBus.ui64Now);
+    }
+    return 1;
+}
+
+//*****************************************************************************
+//
+// Forwards the completion of a register write.
+//
+//*****************************************************************************
+static void
+I2CMWrite8Callback(void *pvData, uint_fast8_t ui8Status)
+{
+    tI2CMWrite8 *psInst = pvData;
+
+    if (psInst->pfnCallback)
+    {
+        psInst->pfnCallback(psInst->pvCallbackData, ui8Status);
+    }
+}
+
+//*****************************************************************************
+//
+// Writes ui16Count bytes to the registers from ui8Reg on.
+//
+//*****************************************************************************
+uint_fast8_t
+I2CMWrite8(tI2CMWrite8 *psInst, tI2CMInstance *psI2CInst,
+           uint_fast8_t ui8Addr, uint_fast8_t ui8Reg,
+           const uint8_t *pui8Data, uint_fast16_t ui16Count,
+           tSensorCallback *pfnCallback, void *pvCallbackData)
+{
+    if (ui16Count >= I2CM_WRITE8_MAX)
+    {
+        return 0;
+    }
+
+    psInst->psI2CInst = psI2CInst;
+    psInst->pui8Buffer[0] = ui8Reg;
+    memcpy(psInst->pui8Buffer + 1, pui8Data, ui16Count);
+    psInst->pfnCallback = pfnCallback;
+    psInst->pvCallbackData = pvCallbackData;
+    return I2CMWrite(psI2CInst, ui8Addr, psInst->pui8Buffer, ui16Count + 1,
+                     I2CMWrite8Callback, psInst);
+}
+
+//*****************************************************************************
+//
+// The steps of a read-modify-write.
+//
+//*****************************************************************************
+#define I2CM_RMW_STATE_READ     0
+#define I2CM_RMW_STATE_WRITE    1
+
+//*****************************************************************************
+//
+// Advances a read-modify-write, the read is followed by the write of the
+// modified value.
+//
+//*****************************************************************************
+static void
+I2CMReadModifyWrite8Callback(void *pvData, uint_fast8_t ui8Status)
+{
+    tI2CMReadModifyWrite8 *psInst = pvData;
+
+    if ((ui8Status == I2CM_STATUS_SUCCESS) &&
+        (psInst->ui8State == I2CM_RMW_STATE_READ))
+    {
+        psInst->pui8Buffer[1] = ((psInst->pui8Buffer[1] & psInst->ui8Mask) |
+                                 psInst->ui8Value);
+        psInst->ui8State = I2CM_RMW_STATE_WRITE;
+        if (I2CMWrite(psInst->psI2CInst, psInst->ui8Addr, psInst->pui8Buffer,
+                      2, I2CMReadModifyWrite8Callback, psInst))
+        {
+            return;
+        }
+        ui8Status = I2CM_STATUS_ERROR;
+    }
+
+    if (psInst->pfnCallback)
+    {
+        psInst->pfnCallback(psInst->pvCallbackData, ui8Status);
+    }
+}
+
+//*****************************************************************************
+//
+// Sets the register ui8Reg to its value AND ui8Mask OR ui8Value.
+//
+//*****************************************************************************
+uint_fast8_t
+I2CMReadModifyWrite8(tI2CMReadModifyWrite8 *psInst, tI2CMInstance *psI2CInst,
+                     uint_fast8_t ui8Addr, uint_fast8_t ui8Reg,
+                     uint_fast8_t ui8Mask, uint_fast8_t ui8Value,
+                     tSensorCallback *pfnCallback, void *pvCallbackData)
+{
+    psInst->psI2CInst = psI2CInst;
+    psInst->ui8Addr = ui8Addr;
+    psInst->ui8State = I2CM_RMW_STATE_READ;
+    psInst->ui8Mask = ui8Mask;
+    psInst->ui8Value = ui8Value;
+    psInst->pui8Buffer[0] = ui8Reg;
+    psInst->pfnCallback = pfnCallback;
+    psInst->pvCallbackData = pvCallbackData;
+    return I2CMRead(psI2CInst, ui8Addr, psInst->pui8Buffer, 1,
+                    psInst->pui8Buffer + 1, 1, I2CMReadModifyWrite8Callback,
+                    psInst);
+}
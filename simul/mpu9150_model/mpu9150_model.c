@@ -0,0 +1,530 @@
+//*****************************************************************************
+//
+// mpu9150_model.c - Register level model of the MPU9150 and its AK8975.
+//
+// The model answers on the simulated bus of i2cm_fake.c as the device does
+// on the I2C bus of the flight controller. Registers are read and written
+// through an auto-incrementing register pointer. A device reset returns
+// the registers to their reset values and the device NACKs its address
+// while it runs; it comes back asleep. Once awake, it samples at the rate of
+// SMPLRT_DIV and the DLPF: the truth callback is scaled by the selected
+// ranges into the data registers, with saturation, DATA_RDY is set in
+// INT_STATUS and drives the interrupt pin as configured in INT_PIN_CFG and
+// INT_ENABLE. The auxiliary I2C master runs the slave 0 read and the slave 4
+// write to the AK8975 on the samples selected by I2C_MST_DELAY_CTRL, and a
+// single measurement of the AK8975 is ready MPU9150_MODEL_MAG_NS after it
+// was started.
+//
+//*****************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sensorlib/hw_ak8975.h"
+#include "sensorlib/hw_mpu9150.h"
+#include "mpu9150_model.h"
+
+//*****************************************************************************
+//
+// Sensitivities of the ranges, LSB per g and LSB per deg/s, and the
+// temperature sensor.
+//
+//*****************************************************************************
+static const float g_pfAccelLsb[4] = { 16384.0f, 8192.0f, 4096.0f, 2048.0f };
+static const float g_pfGyroLsb[4] = { 131.0f, 65.5f, 32.8f, 16.4f };
+#define MODEL_G                 9.80665f
+#define MODEL_RAD_TO_DEG        57.2957795f
+#define MODEL_TEMP_LSB          340.0f
+#define MODEL_TEMP_OFFSET       35.0f
+
+//*****************************************************************************
+//
+// The AK8975: its address on the auxiliary bus, its identity, and the range
+// and sensitivity of its measurements.
+//
+//*****************************************************************************
+#define MODEL_AK8975_ADDR       0x0C
+#define MODEL_AK8975_WIA        0x48
+#define MODEL_MAG_MAX           4095
+#define MODEL_MAG_TESLA         3.0e-7f
+
+//*****************************************************************************
+//
+// The range of read-only registers, from the interrupt status to the last
+// external sensor data register, and the identity of the MPU9150.
+//
+//*****************************************************************************
+#define MODEL_RO_FIRST          MPU9150_O_INT_STATUS
+#define MODEL_RO_LAST           0x60
+#define MODEL_WHO_AM_I          0x68
+
+//*****************************************************************************
+//
+// Rounds and saturates a reading to 16 bits. Counts the saturation in
+// *pbSaturated.
+//
+//*****************************************************************************
+static int16_t
+ModelLsb(float fValue, bool *pbSaturated)
+{
+    fValue += (fValue < 0.0f) ? -0.5f : 0.5f;
+    if (fValue >= 32767.0f)
+    {
+        *pbSaturated = true;
+        return INT16_MAX;
+    }
+    if (fValue <= -32768.0f)
+    {
+        *pbSaturated = true;
+        return INT16_MIN;
+    }
+    return (int16_t)fValue;
+}
+
+//*****************************************************************************
+//
+// Stores a big-endian word at register ui8Reg.
+//
+//*****************************************************************************
+static void
+ModelWordSet(tMPU9150Model *psModel, uint8_t ui8Reg, int16_t i16Value)
+{
+    psModel->pui8Regs[ui8Reg] = (uint16_t)i16Value >> 8;
+    psModel->pui8Regs[ui8Reg + 1] = (uint16_t)i16Value & 0xff;
+}
+
+//*****************************************************************************
+//
+// Returns the sample period in ns.
+//
+//*****************************************************************************
+static uint64_t
+ModelPeriod(const tMPU9150Model *psModel)
+{
+    uint8_t ui8Dlpf = (psModel->pui8Regs[MPU9150_O_CONFIG] &
+                       MPU9150_CONFIG_DLPF_CFG_M);
+    uint64_t ui64Base = ((ui8Dlpf == 0) || (ui8Dlpf == 7)) ? 125000 : 1000000;
+
+    return ui64Base * (1 + psModel->pui8Regs[MPU9150_O_SMPLRT_DIV]);
+}
+
+//*****************************************************************************
+//
+// Returns true if the device samples.
+//
+//*****************************************************************************
+static bool
+ModelAwake(const tMPU9150Model *psModel)
+{
+    return (!(psModel->pui8Regs[MPU9150_O_PWR_MGMT_1] &
+              MPU9150_PWR_MGMT_1_SLEEP) &&
+            (psModel->ui64Now >= psModel->ui64ResetEnd));
+}
+
+//*****************************************************************************
+//
+// Returns the registers of both chips to their reset values.
+//
+//*****************************************************************************
+static void
+ModelReset(tMPU9150Model *psModel)
+{
+    memset(psModel->pui8Regs, 0, sizeof(psModel->pui8Regs));
+    psModel->pui8Regs[MPU9150_O_PWR_MGMT_1] = MPU9150_PWR_MGMT_1_SLEEP;
+    psModel->pui8Regs[MPU9150_O_WHO_AM_I] = MODEL_WHO_AM_I;
+    psModel->ui8Ptr = 0;
+
+    memset(psModel->pui8Mag, 0, sizeof(psModel->pui8Mag));
+    psModel->pui8Mag[AK8975_O_WIA] = MODEL_AK8975_WIA;
+    psModel->ui64MagDone = 0;
+
+    psModel->ui64PulseEnd = 0;
+    psModel->bUnread = false;
+}
+
+//*****************************************************************************
+//
+// Completes the running AK8975 measurement.
+//
+//*****************************************************************************
+static void
+ModelMagMeasure(tMPU9150Model *psModel)
+{
+    static const uint8_t pui8Axes[3] = { 1, 0, 2 };
+    static const float pfSigns[3] = { 1.0f, 1.0f, -1.0f };
+    tMPU9150Truth sTruth;
+    uint8_t ui8Status = 0;
+    int i;
+
+    psModel->pfnTruth(psModel->pvTruthData, psModel->ui64MagDone, &sTruth);
+    for (i = 0; i < 3; i++)
+    {
+        //
+        // The axes of the AK8975 in the package, see mpu9150mod.c.
+        //
+        float fValue = (sTruth.pfMagneto[pui8Axes[i]] * pfSigns[i] /
+                        MODEL_MAG_TESLA);
+        int32_t i32Value = (int32_t)(fValue + ((fValue < 0.0f) ? -0.5f :
+                                               0.5f));
+
+        if ((i32Value > MODEL_MAG_MAX) || (i32Value < -MODEL_MAG_MAX))
+        {
+            i32Value = (i32Value > 0) ? MODEL_MAG_MAX : -MODEL_MAG_MAX;
+            ui8Status = AK8975_ST2_HOFL;
+        }
+        psModel->pui8Mag[AK8975_O_HXL + 2 * i] = (uint16_t)i32Value & 0xff;
+        psModel->pui8Mag[AK8975_O_HXL + 2 * i + 1] = (uint16_t)i32Value >> 8;
+    }
+    psModel->pui8Mag[AK8975_O_ST1] = AK8975_ST1_DRDY;
+    psModel->pui8Mag[AK8975_O_ST2] = ui8Status;
+    psModel->pui8Mag[AK8975_O_CNTL] = AK8975_CNTL_MODE_POWER_DOWN;
+    psModel->ui64MagDone = 0;
+}
+
+//*****************************************************************************
+//
+// Runs the slave transactions of the auxiliary I2C master after a sample.
+// Slaves with their delay enabled run on every I2C_MST_DLY + 1-th sample.
+//
+//*****************************************************************************
+static void
+ModelAuxMaster(tMPU9150Model *psModel, uint64_t ui64Time)
+{
+    uint8_t *pui8Regs = psModel->pui8Regs;
+    uint8_t ui8Delay = pui8Regs[MPU9150_O_I2C_MST_DELAY_CTRL];
+    bool bDelayed = ((psModel->ui32Samples %
+                      ((pui8Regs[MPU9150_O_I2C_SLV4_CTRL] &
+                        MPU9150_I2C_SLV4_CTRL_I2C_MST_DLY_M) + 1)) != 0);
+    uint8_t ui8Reg, ui8Count, i;
+
+    if (!(pui8Regs[MPU9150_O_USER_CTRL] & MPU9150_USER_CTRL_I2C_MST_EN))
+    {
+        return;
+    }
+
+    //
+    // Slave 0 reads the AK8975 into the external sensor data. Reading ST2
+    // ends the data ready state of the AK8975.
+    //
+    if ((pui8Regs[MPU9150_O_I2C_SLV0_CTRL] & MPU9150_I2C_SLV0_CTRL_EN) &&
+        !(bDelayed &&
+          (ui8Delay & MPU9150_I2C_MST_DELAY_CTRL_I2C_SLV0_DLY_EN)) &&
+        (pui8Regs[MPU9150_O_I2C_SLV0_ADDR] ==
+         (MPU9150_I2C_SLV0_ADDR_RW | MODEL_AK8975_ADDR)))
+    {
+        ui8Reg = pui8Regs[MPU9150_O_I2C_SLV0_REG];
+        ui8Count = pui8Regs[MPU9150_O_I2C_SLV0_CTRL] & 0x0f;
+        for (i = 0; i < ui8Count; i++)
+        {
+            pui8Regs[MPU9150_O_EXT_SENS_DATA_00 + i] =
+                psModel->pui8Mag[(ui8Reg + i) & 0x0f];
+            if (((ui8Reg + i) & 0x0f) == AK8975_O_ST2)
+            {
+                psModel->pui8Mag[AK8975_O_ST1] = 0;
+            }
+        }
+    }
+
+    //
+    // Slave 4 writes a register of the AK8975, a single measurement mode
+    // starts a measurement.
+    //
+    if ((pui8Regs[MPU9150_O_I2C_SLV4_CTRL] & MPU9150_I2C_SLV4_CTRL_EN) &&
+        !(bDelayed &&
+          (ui8Delay & MPU9150_I2C_MST_DELAY_CTRL_I2C_SLV4_DLY_EN)) &&
+        (pui8Regs[MPU9150_O_I2C_SLV4_ADDR] == MODEL_AK8975_ADDR))
+    {
+        ui8Reg = pui8Regs[MPU9150_O_I2C_SLV4_REG] & 0x0f;
+        psModel->pui8Mag[ui8Reg] = pui8Regs[MPU9150_O_I2C_SLV4_DO];
+        if ((ui8Reg == AK8975_O_CNTL) &&
+            ((pui8Regs[MPU9150_O_I2C_SLV4_DO] & AK8975_CNTL_MODE_M) ==
+             AK8975_CNTL_MODE_SINGLE) && !psModel->ui64MagDone)
+        {
+            psModel->ui64MagDone = ui64Time + MPU9150_MODEL_MAG_NS;
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// Takes the sample due at ui64Time.
+//
+//*****************************************************************************
+static void
+ModelSample(tMPU9150Model *psModel, uint64_t ui64Time)
+{
+    uint8_t ui8Afs = ((psModel->pui8Regs[MPU9150_O_ACCEL_CONFIG] &
+                       MPU9150_ACCEL_CONFIG_AFS_SEL_M) >>
+                      MPU9150_ACCEL_CONFIG_AFS_SEL_S);
+    uint8_t ui8Fs = ((psModel->pui8Regs[MPU9150_O_GYRO_CONFIG] &
+                      MPU9150_GYRO_CONFIG_FS_SEL_M) >>
+                     MPU9150_GYRO_CONFIG_FS_SEL_S);
+    tMPU9150Truth *psTruth = &psModel->sTruth;
+    bool bSaturated = false;
+    int i;
+
+    psModel->pfnTruth(psModel->pvTruthData, ui64Time, psTruth);
+    for (i = 0; i < 3; i++)
+    {
+        ModelWordSet(psModel, MPU9150_O_ACCEL_XOUT_H + 2 * i,
+                     ModelLsb(psTruth->pfAccel[i] *
+                              (g_pfAccelLsb[ui8Afs] / MODEL_G), &bSaturated));
+        ModelWordSet(psModel, MPU9150_O_GYRO_XOUT_H + 2 * i,
+                     ModelLsb(psTruth->pfGyro[i] *
+                              (g_pfGyroLsb[ui8Fs] * MODEL_RAD_TO_DEG),
+                              &bSaturated));
+    }
+    ModelWordSet(psModel, MPU9150_O_TEMP_OUT_H,
+                 ModelLsb((psTruth->fTemperature - MODEL_TEMP_OFFSET) *
+                          MODEL_TEMP_LSB, &bSaturated));
+    if (bSaturated)
+    {
+        psModel->ui32Saturated++;
+    }
+
+    ModelAuxMaster(psModel, ui64Time);
+    psModel->ui32Samples++;
+
+    if (psModel->bUnread)
+    {
+        psModel->ui32Overruns++;
+    }
+    psModel->bUnread = true;
+    psModel->ui64SampleTime = ui64Time;
+
+    //
+    // Only an enabled interrupt is generated and shows in INT_STATUS.
+    //
+    if (psModel->pui8Regs[MPU9150_O_INT_ENABLE] &
+        MPU9150_INT_ENABLE_DATA_RDY_EN)
+    {
+        psModel->pui8Regs[MPU9150_O_INT_STATUS] |=
+            MPU9150_INT_STATUS_DATA_RDY_INT;
+        psModel->ui64PulseEnd = ui64Time + MPU9150_MODEL_PULSE_NS;
+    }
+}
+
+//*****************************************************************************
+//
+// Reads register ui8Reg with its side effects.
+//
+//*****************************************************************************
+static uint8_t
+ModelRegRead(tMPU9150Model *psModel, uint8_t ui8Reg)
+{
+    uint8_t ui8Value = psModel->pui8Regs[ui8Reg];
+
+    if ((ui8Reg == MPU9150_O_INT_STATUS) ||
+        (psModel->pui8Regs[MPU9150_O_INT_PIN_CFG] &
+         MPU9150_INT_PIN_CFG_INT_RD_CLEAR))
+    {
+        psModel->pui8Regs[MPU9150_O_INT_STATUS] = 0;
+    }
+    if (ui8Reg == MPU9150_O_ACCEL_XOUT_H)
+    {
+        psModel->bUnread = false;
+    }
+    return ui8Value;
+}
+
+//*****************************************************************************
+//
+// Writes register ui8Reg. Returns false if the write reset the device, which
+// ignores the rest of the transaction.
+//
+//*****************************************************************************
+static bool
+ModelRegWrite(tMPU9150Model *psModel, uint8_t ui8Reg, uint8_t ui8Value)
+{
+    if (ui8Reg == MPU9150_O_PWR_MGMT_1)
+    {
+        bool bAwake = ModelAwake(psModel);
+
+        if (ui8Value & MPU9150_PWR_MGMT_1_DEVICE_RESET)
+        {
+            ModelReset(psModel);
+            psModel->ui64ResetEnd = psModel->ui64Now + MPU9150_MODEL_RESET_NS;
+            return false;
+        }
+        psModel->pui8Regs[ui8Reg] = ui8Value;
+        if (!bAwake && ModelAwake(psModel))
+        {
+            psModel->ui64NextSample = psModel->ui64Now + ModelPeriod(psModel);
+        }
+        return true;
+    }
+
+    if (((ui8Reg < MODEL_RO_FIRST) || (ui8Reg > MODEL_RO_LAST)) &&
+        (ui8Reg != MPU9150_O_WHO_AM_I))
+    {
+        psModel->pui8Regs[ui8Reg] = ui8Value;
+    }
+    return true;
+}
+
+//*****************************************************************************
+//
+// The device callbacks of the simulated bus.
+//
+//*****************************************************************************
+static bool
+ModelBusStart(void *pvDevice, uint64_t ui64Now)
+{
+    tMPU9150Model *psModel = pvDevice;
+
+    MPU9150ModelAdvance(psModel, ui64Now);
+    return psModel->ui64Now >= psModel->ui64ResetEnd;
+}
+
+static void
+ModelBusWrite(void *pvDevice, const uint8_t *pui8Data, uint32_t ui32Count)
+{
+    tMPU9150Model *psModel = pvDevice;
+    uint32_t i;
+
+    psModel->ui8Ptr = pui8Data[0] & 0x7f;
+    for (i = 1; i < ui32Count; i++)
+    {
+        if (!ModelRegWrite(psModel, psModel->ui8Ptr, pui8Data[i]))
+        {
+            return;
+        }
+        psModel->ui8Ptr = (psModel->ui8Ptr + 1) & 0x7f;
+    }
+}
+
+static void
+ModelBusRead(void *pvDevice, uint8_t *pui8Data, uint32_t ui32Count)
+{
+    tMPU9150Model *psModel = pvDevice;
+    uint32_t i;
+
+    for (i = 0; i < ui32Count; i++)
+    {
+        pui8Data[i] = ModelRegRead(psModel, psModel->ui8Ptr);
+        psModel->ui8Ptr = (psModel->ui8Ptr + 1) & 0x7f;
+    }
+}
+
+//*****************************************************************************
+//
+// Initializes the model to a powered up device, asleep, at time 0. The
+// samples come from pfnTruth.
+//
+//*****************************************************************************
+void
+MPU9150ModelInit(tMPU9150Model *psModel, tMPU9150TruthGet *pfnTruth,
+                 void *pvTruthData)
+{
+    memset(psModel, 0, sizeof(*psModel));
+    psModel->pfnTruth = pfnTruth;
+    psModel->pvTruthData = pvTruthData;
+    ModelReset(psModel);
+}
+
+//*****************************************************************************
+//
+// Fills in the device of the simulated bus for the model at ui8Addr.
+//
+//*****************************************************************************
+void
+MPU9150ModelDevice(tMPU9150Model *psModel, uint8_t ui8Addr,
+                   tI2CMFakeDevice *psDevice)
+{
+    psDevice->ui8Addr = ui8Addr;
+    psDevice->pvDevice = psModel;
+    psDevice->pfnStart = ModelBusStart;
+    psDevice->pfnWrite = ModelBusWrite;
+    psDevice->pfnRead = ModelBusRead;
+}
+
+//*****************************************************************************
+//
+// Runs the model up to ui64Now, taking the samples and completing the AK8975
+// measurements that are due.
+//
+//*****************************************************************************
+void
+MPU9150ModelAdvance(tMPU9150Model *psModel, uint64_t ui64Now)
+{
+    if (ui64Now < psModel->ui64Now)
+    {
+        return;
+    }
+
+    //
+    // A device that comes out of reset is asleep, the samples start when it
+    // is woken up.
+    //
+    while (ModelAwake(psModel) && (psModel->ui64NextSample <= ui64Now))
+    {
+        if (psModel->ui64MagDone &&
+            (psModel->ui64MagDone <= psModel->ui64NextSample))
+        {
+            ModelMagMeasure(psModel);
+        }
+        psModel->ui64Now = psModel->ui64NextSample;
+        ModelSample(psModel, psModel->ui64NextSample);
+        psModel->ui64NextSample += ModelPeriod(psModel);
+    }
+    if (psModel->ui64MagDone && (psModel->ui64MagDone <= ui64Now))
+    {
+        ModelMagMeasure(psModel);
+    }
+    psModel->ui64Now = ui64Now;
+}
+
+//*****************************************************************************
+//
+// Returns the time of the next event of the model: a sample, the end of a
+// reset or a measurement, or the end of a data ready pulse.
+//
+//*****************************************************************************
+uint64_t
+MPU9150ModelNext(const tMPU9150Model *psModel)
+{
+    uint64_t ui64Next = UINT64_MAX;
+
+    if (ModelAwake(psModel))
+    {
+        ui64Next = psModel->ui64NextSample;
+    }
+    if (psModel->ui64ResetEnd > psModel->ui64Now)
+    {
+        ui64Next = psModel->ui64ResetEnd;
+    }
+    if (psModel->ui64MagDone && (psModel->ui64MagDone < ui64Next))
+    {
+        ui64Next = psModel->ui64MagDone;
+    }
+    if ((psModel->ui64PulseEnd > psModel->ui64Now) &&
+        (psModel->ui64PulseEnd < ui64Next))
+    {
+        ui64Next = psModel->ui64PulseEnd;
+    }
+    return ui64Next;
+}
+
+//*****************************************************************************
+//
+// Returns true while the interrupt pin is asserted, whatever its polarity.
+// A latched interrupt is asserted until INT_STATUS is cleared, otherwise it
+// is a pulse of MPU9150_MODEL_PULSE_NS.
+//
+//*****************************************************************************
+bool
+MPU9150ModelIntGet(const tMPU9150Model *psModel)
+{
+    const uint8_t *pui8Regs = psModel->pui8Regs;
+
+    if (!(pui8Regs[MPU9150_O_INT_ENABLE] & MPU9150_INT_ENABLE_DATA_RDY_EN))
+    {
+        return false;
+    }
+    if (pui8Regs[MPU9150_O_INT_PIN_CFG] & MPU9150_INT_PIN_CFG_LATCH_INT_EN)
+    {
+        return (pui8Regs[MPU9150_O_INT_STATUS] &
+                MPU9150_INT_STATUS_DATA_RDY_INT) != 0;
+    }
+    return psModel->ui64Now < psModel->ui64PulseEnd;
+}
@@ -0,0 +1,110 @@
+//*****************************************************************************
+//
+// mpu9150_model.h - Register level model of the MPU9150 and its AK8975.
+//
+//*****************************************************************************
+
+#ifndef _MPU9150_MODEL_H_
+#define _MPU9150_MODEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sensorlib/i2cm_drv.h"
+
+//*****************************************************************************
+//
+// Timing in ns: the device reset, the AK8975 measurement and the length of
+// the data ready pulse when the interrupt is not latched.
+//
+//*****************************************************************************
+#define MPU9150_MODEL_RESET_NS  100000000
+#define MPU9150_MODEL_MAG_NS    7300000
+#define MPU9150_MODEL_PULSE_NS  50000
+
+//*****************************************************************************
+//
+// The motion and the environment the sensor sees, in the axes of the
+// accelerometer and gyroscope: specific force in m/s^2, angular velocity in
+// rad/s, magnetic field in tesla and die temperature in degrees C.
+//
+//*****************************************************************************
+typedef struct
+{
+    float pfAccel[3];
+    float pfGyro[3];
+    float pfMagneto[3];
+    float fTemperature;
+}
+tMPU9150Truth;
+
+//*****************************************************************************
+//
+// Returns the truth at ui64Now ns, called for every sample of the device.
+//
+//*****************************************************************************
+typedef void (tMPU9150TruthGet)(void *pvData, uint64_t ui64Now,
+                                tMPU9150Truth *psTruth);
+
+//*****************************************************************************
+//
+// The state of the model.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // The registers of the MPU9150, its register pointer, and the registers
+    // of the AK8975 behind its auxiliary I2C master.
+    //
+    uint8_t pui8Regs[128];
+    uint8_t ui8Ptr;
+    uint8_t pui8Mag[16];
+
+    //
+    // The source of the samples.
+    //
+    tMPU9150TruthGet *pfnTruth;
+    void *pvTruthData;
+
+    //
+    // Times in ns: the model, the end of a reset, the next sample, the end
+    // of the running AK8975 measurement (0 if none) and the end of the data
+    // ready pulse.
+    //
+    uint64_t ui64Now;
+    uint64_t ui64ResetEnd;
+    uint64_t ui64NextSample;
+    uint64_t ui64MagDone;
+    uint64_t ui64PulseEnd;
+
+    //
+    // Samples since the reset, the truth of the last one and its time.
+    //
+    uint32_t ui32Samples;
+    tMPU9150Truth sTruth;
+    uint64_t ui64SampleTime;
+
+    //
+    // Samples that replaced one that was not read, and samples with a
+    // saturated axis.
+    //
+    uint32_t ui32Overruns;
+    uint32_t ui32Saturated;
+    bool bUnread;
+}
+tMPU9150Model;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern void MPU9150ModelInit(tMPU9150Model *psModel,
+                             tMPU9150TruthGet *pfnTruth, void *pvTruthData);
+extern void MPU9150ModelDevice(tMPU9150Model *psModel, uint8_t ui8Addr,
+                               tI2CMFakeDevice *psDevice);
+extern void MPU9150ModelAdvance(tMPU9150Model *psModel, uint64_t ui64Now);
+extern uint64_t MPU9150ModelNext(const tMPU9150Model *psModel);
+extern bool MPU9150ModelIntGet(const tMPU9150Model *psModel);
+
+#endif // _MPU9150_MODEL_H_
@@ -0,0 +1,781 @@
+//*****************************************************************************
+//
+// mpu9150_model_host.c - Runs flight_controller/mpu9150mod.c against the
+// register level model of the MPU9150 on a simulated I2C bus.
+//
+// The driver is compiled unchanged, with the host stand-ins of the sensor
+// library headers in sensorlib/. The acquisition of main.c is reproduced
+// around it: the boot configuration of ConfigureMPU6050(), IntGPIOb() on the
+// falling edge of the interrupt pin, MPU9150I2CIntHandler(), the callback
+// that sets the done and error flags, and the main loop that decodes the
+// sample with MPU9150DataSampleGet(). Errors and a silent sensor go through
+// the bus recovery of i2c_recover.c as in I2CWatch(). Everything runs on
+// one virtual clock in ns, from event to event, so the simulation is much
+// faster than real time.
+//
+// Every scenario boots on a clean bus and then samples for SCENARIO_S
+// seconds with its bus timing and faults. The decoded samples are compared
+// with the truth that the model sampled; the table shows the samples read
+// and lost, the latency from the data ready interrupt to the data in RAM,
+// the load of the bus, the outages and their recovery, and the largest
+// error of a valid sample in LSB. A correct decode is within half an LSB
+// plus the rounding of the scale factors of the driver, 4e-6 of the
+// reading or 0.13 LSB at full scale.
+//
+// The truth is a synthetic motion with a fast spin that makes the
+// automatic range selection step up and down, or a recorded log with one
+// sample per line: the x, y and z rates in deg/s as the captures in
+// simul/mpu6050_integration, optionally followed by the acceleration in g,
+// the magnetic field in uT and the temperature in degrees C.
+//
+// Build and run from this directory (the compile command is one line):
+//
+//   cc -O2 -I. -I../../flight_controller -o mpu9150_model_host
+//      mpu9150_model_host.c mpu9150_model.c i2cm_fake.c
+//      ../../flight_controller/mpu9150mod.c
+//      ../../flight_controller/i2c_recover.c -lm
+//   ./mpu9150_model_host [log.txt] [sample_period_ms]
+//
+// The sample period of a log defaults to the 3.75 ms of the captures.
+//
+//*****************************************************************************
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sensorlib/hw_mpu9150.h"
+#include "sensorlib/i2cm_drv.h"
+#include "sensorlib/ak8975.h"
+#include "mpu9150mod.h"
+#include "i2c_recover.h"
+#include "mpu9150_model.h"
+
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+#define MPU9150_I2C_ADDRESS     0x68
+#define MPU9150_CONFIG_STEPS    2
+#define CYCLES_PER_MS           40000
+#define NS_PER_CYCLE            25
+#define NS_PER_MS               1000000ULL
+#define SCENARIO_S              20
+#define BOOT_TIMEOUT_MS         1000
+#define LATENCY_BIN_NS          10000
+#define LATENCY_BINS            1000
+#define TRACE_COLUMNS           10
+#define DEFAULT_TRACE_MS        3.75
+#define MAX_ERROR_LSB           0.63f
+
+//*****************************************************************************
+//
+// The scenarios: bus timing and faults after the boot.
+//
+//*****************************************************************************
+typedef struct
+{
+    const char *pcName;
+    tI2CMFakeConfig sBus;
+}
+tScenario;
+
+static const tScenario g_psScenarios[] =
+{
+    //
+    // Name, latency, jitter, byte, address NACK, data NACK, bus error and
+    // hang in ppm, seed. 25 us per byte is 9 bits at 400 kHz and the
+    // interrupt of the driver.
+    //
+    { "clean 400 kHz",      {   2000,       0,  25000,     0,    0,    0,
+                                0, 1 } },
+    { "100 kHz bus",        {   2000,       0,  92000,     0,    0,    0,
+                                0, 2 } },
+    { "latency 0.2-2 ms",   { 200000, 1800000,  25000,     0,    0,    0,
+                                0, 3 } },
+    { "NACK 0.5%",          {   2000,       0,  25000,  3000, 2000,    0,
+                                0, 4 } },
+    { "bus errors 0.2%",    {   2000,       0,  25000,     0,    0, 2000,
+                                0, 5 } },
+    { "hangs 0.05%",        {   2000,       0,  25000,     0,    0,    0,
+                              500, 6 } },
+};
+
+static const tI2CMFakeConfig g_sBootBus =
+{
+    2000, 0, 25000, 0, 0, 0, 0, 1
+};
+
+//*****************************************************************************
+//
+// The truth: a log of TRACE_COLUMNS values per sample, or the synthetic
+// motion if there is none.
+//
+//*****************************************************************************
+static float *g_pfTrace;
+static uint32_t g_ui32TraceRows;
+static uint64_t g_ui64TracePeriod;
+
+//*****************************************************************************
+//
+// The model, the driver and the acquisition of main.c.
+//
+//*****************************************************************************
+static tMPU9150Model g_sModel;
+static void (*g_pfnModelRead)(void *pvDevice, uint8_t *pui8Data,
+                              uint32_t ui32Count);
+static tI2CMInstance g_sI2CInst;
+static tMPU9150 g_sMPU9150Inst;
+static tMPU9150 g_sMPU9150Saved;
+static tMPU9150Sample g_sMPU9150Sample;
+static volatile uint_fast8_t g_vui8I2CDoneFlag;
+static volatile uint_fast8_t g_vui8ErrorFlag;
+static tI2CRecover g_sI2CRecoverInst;
+static uint32_t g_ui32SampleStart;
+static uint32_t g_ui32LastWatch;
+static bool g_bIntPin;
+static bool g_bIntEnabled;
+
+//*****************************************************************************
+//
+// The virtual clock in ns, and the truth of the sample that the last data
+// read returned.
+//
+//*****************************************************************************
+static uint64_t g_ui64Now;
+static tMPU9150Truth g_sReadTruth;
+static uint64_t g_ui64ReadSample;
+static uint64_t g_ui64ReadDone;
+
+//*****************************************************************************
+//
+// Statistics of a scenario.
+//
+//*****************************************************************************
+static struct
+{
+    uint32_t ui32Samples;
+    uint32_t ui32Valid;
+    uint32_t ui32MagValid;
+    uint32_t ui32Errors;
+    uint32_t ui32Refused;
+    double dLatencySum;
+    uint64_t ui64LatencyMax;
+    uint32_t pui32Latency[LATENCY_BINS];
+    float fMaxErrorLsb;
+    float fMaxMagError;
+}
+g_sStats;
+
+//*****************************************************************************
+//
+// Returns the truth at ui64Now.
+//
+//*****************************************************************************
+static void
+TruthGet(void *pvData, uint64_t ui64Now, tMPU9150Truth *psTruth)
+{
+    double dT = (double)ui64Now * 1e-9;
+    int i;
+
+    (void)pvData;
+    if (g_pfTrace)
+    {
+        const float *pfRow = (g_pfTrace + TRACE_COLUMNS *
+                              ((ui64Now / g_ui64TracePeriod) %
+                               g_ui32TraceRows));
+
+        for (i = 0; i < 3; i++)
+        {
+            psTruth->pfGyro[i] = pfRow[i] * (float)(M_PI / 180.0);
+            psTruth->pfAccel[i] = pfRow[3 + i] * 9.80665f;
+            psTruth->pfMagneto[i] = pfRow[6 + i] * 1e-6f;
+        }
+        psTruth->fTemperature = pfRow[9];
+        return;
+    }
+
+    //
+    // A slow wobble on all axes and a spin of up to 700 deg/s in roll with
+    // 5 g between 8 and 9 s of every 20.
+    //
+    for (i = 0; i < 3; i++)
+    {
+        psTruth->pfGyro[i] = (float)(0.5 * sin(2.0 * M_PI * (0.7 + 0.4 * i) *
+                                               dT + i));
+        psTruth->pfAccel[i] = (float)(1.5 * sin(2.0 * M_PI * (0.3 + 0.2 * i) *
+                                                dT));
+    }
+    psTruth->pfAccel[2] += 9.80665f;
+    dT = fmod(dT, 20.0);
+    if ((dT > 8.0) && (dT < 9.0))
+    {
+        double dSpin = sin(M_PI * (dT - 8.0));
+
+        psTruth->pfGyro[0] += (float)(700.0 * M_PI / 180.0 * dSpin * dSpin);
+        psTruth->pfAccel[1] += (float)(5.0 * 9.80665 * dSpin * dSpin);
+    }
+    psTruth->pfMagneto[0] = 20e-6f;
+    psTruth->pfMagneto[1] = -5e-6f;
+    psTruth->pfMagneto[2] = -40e-6f;
+    psTruth->fTemperature = 30.0f + (float)(0.1 * dT);
+}
+
+//*****************************************************************************
+//
+// Reads the model and keeps the truth behind a read of the data registers.
+//
+//*****************************************************************************
+static void
+HostModelRead(void *pvDevice, uint8_t *pui8Data, uint32_t ui32Count)
+{
+    if (g_sModel.ui8Ptr == MPU9150_O_ACCEL_XOUT_H)
+    {
+        g_sReadTruth = g_sModel.sTruth;
+        g_ui64ReadSample = g_sModel.ui64SampleTime;
+    }
+    g_pfnModelRead(pvDevice, pui8Data, ui32Count);
+}
+
+//*****************************************************************************
+//
+// Returns the cycle counter of the virtual clock.
+//
+//*****************************************************************************
+static uint32_t
+CycleCounterGet(void)
+{
+    return (uint32_t)(g_ui64Now / NS_PER_CYCLE);
+}
+
+//*****************************************************************************
+//
+// The callbacks and interrupt handlers of main.c.
+//
+//*****************************************************************************
+static void
+MPU9150AppCallback(void *pvCallbackData, uint_fast8_t ui8Status)
+{
+    (void)pvCallbackData;
+    if (ui8Status == I2CM_STATUS_SUCCESS)
+    {
+        g_vui8I2CDoneFlag = 1;
+        g_ui64ReadDone = g_ui64Now;
+    }
+    g_vui8ErrorFlag = ui8Status;
+}
+
+static void
+IntGPIOb(void)
+{
+    if (!MPU9150DataRead(&g_sMPU9150Inst, MPU9150AppCallback,
+                         &g_sMPU9150Inst))
+    {
+        g_sStats.ui32Refused++;
+    }
+}
+
+static void
+MPU9150I2CIntHandler(void)
+{
+    I2CMIntHandler(&g_sI2CInst);
+}
+
+static uint_fast8_t
+MPU9150ConfigStep(uint32_t ui32Step, tSensorCallback *pfnCallback,
+                  void *pvCallbackData)
+{
+    if (ui32Step == 0)
+    {
+        g_sMPU9150Inst.pui8Data[0] = MPU9150_CONFIG_DLPF_CFG_94_98;
+        g_sMPU9150Inst.pui8Data[1] = MPU9150_GYRO_CONFIG_FS_SEL_250;
+        g_sMPU9150Inst.pui8Data[2] = (MPU9150_ACCEL_CONFIG_ACCEL_HPF_5HZ |
+                MPU9150_ACCEL_CONFIG_AFS_SEL_2G);
+        return MPU9150Write(&g_sMPU9150Inst, MPU9150_O_CONFIG,
+                            g_sMPU9150Inst.pui8Data, 3, pfnCallback,
+                            pvCallbackData);
+    }
+
+    g_sMPU9150Inst.pui8Data[0] = MPU9150_INT_PIN_CFG_INT_LEVEL |
+            MPU9150_INT_PIN_CFG_INT_RD_CLEAR |
+            MPU9150_INT_PIN_CFG_LATCH_INT_EN;
+    g_sMPU9150Inst.pui8Data[1] = MPU9150_INT_ENABLE_DATA_RDY_EN;
+    return MPU9150Write(&g_sMPU9150Inst, MPU9150_O_INT_PIN_CFG,
+                        g_sMPU9150Inst.pui8Data, 2, pfnCallback,
+                        pvCallbackData);
+}
+
+//*****************************************************************************
+//
+// The bus recovery of main.c. The simulated bus has no lines to clear.
+//
+//*****************************************************************************
+static void
+PinsAcquire(void)
+{
+    g_bIntEnabled = false;
+}
+
+static void
+PinsNop(void)
+{
+}
+
+static void
+PinsSet(bool bHigh)
+{
+    (void)bHigh;
+}
+
+static bool
+PinsSdaGet(void)
+{
+    return true;
+}
+
+static const tI2CBusPins g_sI2CBusPins =
+{
+    PinsAcquire, PinsSet, PinsSet, PinsSdaGet, PinsNop
+};
+
+static void
+MPU9150RecoverCallback(void *pvCallbackData, uint_fast8_t ui8Status)
+{
+    I2CRecoverDone(pvCallbackData, ui8Status == I2CM_STATUS_SUCCESS);
+}
+
+static bool
+MPU9150RecoverStep(void *pvData, uint32_t ui32Step)
+{
+    if (ui32Step == 0)
+    {
+        I2CMInit(&g_sI2CInst, 0, 0, 0xff, 0xff, CYCLES_PER_MS * 1000);
+        g_sMPU9150Saved = g_sMPU9150Inst;
+        return MPU9150Init(&g_sMPU9150Inst, &g_sI2CInst, MPU9150_I2C_ADDRESS,
+                           MPU9150RecoverCallback, pvData);
+    }
+    if (ui32Step == 1)
+    {
+        g_sMPU9150Inst.ui32RangeChanges = g_sMPU9150Saved.ui32RangeChanges;
+        MPU9150AutoRangeSet(&g_sMPU9150Inst, g_sMPU9150Saved.ui8AutoRange);
+    }
+    else
+    {
+        g_bIntEnabled = true;
+    }
+    return MPU9150ConfigStep(ui32Step - 1, MPU9150RecoverCallback, pvData);
+}
+
+static bool
+I2CWatch(void)
+{
+    uint32_t ui32Now = CycleCounterGet();
+
+    if (!I2CRecoverActive(&g_sI2CRecoverInst))
+    {
+        if (g_vui8ErrorFlag || ((ui32Now - g_ui32SampleStart) >
+                                (I2C_RECOVER_SILENT_MS * CYCLES_PER_MS)))
+        {
+            g_vui8ErrorFlag = 0;
+            g_sStats.ui32Errors++;
+            I2CRecoverFault(&g_sI2CRecoverInst, ui32Now);
+        }
+        return false;
+    }
+    if ((ui32Now - g_ui32SampleStart) >= (4 * CYCLES_PER_MS))
+    {
+        g_ui32SampleStart = ui32Now;
+        I2CRecoverUpdate(&g_sI2CRecoverInst, ui32Now);
+        return true;
+    }
+    return false;
+}
+
+//*****************************************************************************
+//
+// Runs the next event of the virtual clock: a sample or another event of the
+// model, a completion of the bus, or the SysTick of the main loop with
+// bTicks. Returns false if nothing happens before ui64End.
+//
+//*****************************************************************************
+static bool
+HostStep(uint64_t ui64End, bool bTicks)
+{
+    uint64_t ui64Next = MPU9150ModelNext(&g_sModel);
+    bool bInt;
+
+    if (I2CMFakeNext(&g_sI2CInst) < ui64Next)
+    {
+        ui64Next = I2CMFakeNext(&g_sI2CInst);
+    }
+    if (bTicks)
+    {
+        uint64_t ui64Tick = (g_ui64Now / NS_PER_MS + 1) * NS_PER_MS;
+
+        ui64Next = (ui64Tick < ui64Next) ? ui64Tick : ui64Next;
+    }
+    if (ui64Next > ui64End)
+    {
+        g_ui64Now = ui64End;
+        return false;
+    }
+    g_ui64Now = ui64Next;
+
+    MPU9150ModelAdvance(&g_sModel, g_ui64Now);
+    if (I2CMFakeAdvance(&g_sI2CInst, g_ui64Now))
+    {
+        MPU9150I2CIntHandler();
+    }
+
+    //
+    // The pin is active low, the GPIO interrupts on the falling edge. An
+    // edge while the interrupt is disabled is cleared when it is enabled.
+    //
+    bInt = MPU9150ModelIntGet(&g_sModel);
+    if (bInt && !g_bIntPin && g_bIntEnabled)
+    {
+        IntGPIOb();
+    }
+    g_bIntPin = MPU9150ModelIntGet(&g_sModel);
+
+    if (bTicks && !(g_ui64Now % NS_PER_MS) &&
+        (g_ui64Now / NS_PER_MS != g_ui32LastWatch))
+    {
+        g_ui32LastWatch = g_ui64Now / NS_PER_MS;
+        I2CWatch();
+    }
+    return true;
+}
+
+//*****************************************************************************
+//
+// MPU9150AppI2CWait() of main.c. Returns false on an error or a timeout.
+//
+//*****************************************************************************
+static bool
+MPU9150AppI2CWait(void)
+{
+    uint64_t ui64End = g_ui64Now + BOOT_TIMEOUT_MS * NS_PER_MS;
+
+    while ((g_vui8I2CDoneFlag == 0) && (g_vui8ErrorFlag == 0))
+    {
+        if (!HostStep(ui64End, false))
+        {
+            return false;
+        }
+    }
+    g_vui8I2CDoneFlag = 0;
+    return g_vui8ErrorFlag == 0;
+}
+
+//*****************************************************************************
+//
+// The boot configuration of ConfigureMPU6050() and main().
+//
+//*****************************************************************************
+static bool
+Boot(void)
+{
+    tI2CMFakeDevice sDevice;
+    uint32_t ui32Step;
+
+    memset(&g_sStats, 0, sizeof(g_sStats));
+    g_ui64Now = 0;
+    g_bIntPin = false;
+    g_bIntEnabled = true;
+    g_vui8I2CDoneFlag = 0;
+    g_vui8ErrorFlag = 0;
+    g_ui32LastWatch = 0;
+
+    I2CMFakeReset(&g_sBootBus);
+    MPU9150ModelInit(&g_sModel, TruthGet, 0);
+    MPU9150ModelDevice(&g_sModel, MPU9150_I2C_ADDRESS, &sDevice);
+    g_pfnModelRead = sDevice.pfnRead;
+    sDevice.pfnRead = HostModelRead;
+    I2CMFakeDeviceAdd(&sDevice);
+
+    I2CMInit(&g_sI2CInst, 0, 0, 0xff, 0xff, CYCLES_PER_MS * 1000);
+    MPU9150Init(&g_sMPU9150Inst, &g_sI2CInst, MPU9150_I2C_ADDRESS,
+                MPU9150AppCallback, &g_sMPU9150Inst);
+    if (!MPU9150AppI2CWait())
+    {
+        return false;
+    }
+    for (ui32Step = 0; ui32Step < MPU9150_CONFIG_STEPS; ui32Step++)
+    {
+        MPU9150ConfigStep(ui32Step, MPU9150AppCallback, &g_sMPU9150Inst);
+        if (!MPU9150AppI2CWait())
+        {
+            return false;
+        }
+    }
+    MPU9150AutoRangeSet(&g_sMPU9150Inst, MPU9150_AUTO_RANGE_GYRO |
+                        MPU9150_AUTO_RANGE_ACCEL);
+
+    I2CRecoverInit(&g_sI2CRecoverInst, &g_sI2CBusPins, MPU9150RecoverStep,
+                   &g_sI2CRecoverInst, MPU9150_CONFIG_STEPS + 1,
+                   CYCLES_PER_MS);
+    g_ui32SampleStart = CycleCounterGet();
+    return true;
+}
+
+//*****************************************************************************
+//
+// Checks a decoded sample against the truth the model sampled, in LSB of
+// the ranges the driver decoded it with. Axes at the end of the range are
+// skipped.
+//
+//*****************************************************************************
+static void
+SampleCheck(void)
+{
+    float fAccelLsb = 9.80665f / (16384 >> g_sMPU9150Inst.ui8AccelAfsSel);
+    float fGyroLsb = ((float)(M_PI / 180.0) /
+                      (131.0f / (1 << g_sMPU9150Inst.ui8GyroFsSel)));
+    float fError;
+    int i;
+
+    //
+    // The 1000 and 2000 deg/s ranges have 32.8 and 16.4 LSB per deg/s.
+    //
+    if (g_sMPU9150Inst.ui8GyroFsSel >= 2)
+    {
+        fGyroLsb *= 131.0f / (1 << g_sMPU9150Inst.ui8GyroFsSel) /
+            (g_sMPU9150Inst.ui8GyroFsSel == 2 ? 32.8f : 16.4f);
+    }
+
+    for (i = 0; i < 3; i++)
+    {
+        if (fabsf(g_sReadTruth.pfAccel[i]) < 32000.0f * fAccelLsb)
+        {
+            fError = fabsf(g_sMPU9150Sample.pfAccel[i] -
+                           g_sReadTruth.pfAccel[i]) / fAccelLsb;
+            if (fError > g_sStats.fMaxErrorLsb)
+            {
+                g_sStats.fMaxErrorLsb = fError;
+            }
+        }
+        if (fabsf(g_sReadTruth.pfGyro[i]) < 32000.0f * fGyroLsb)
+        {
+            fError = fabsf(g_sMPU9150Sample.pfGyro[i] -
+                           g_sReadTruth.pfGyro[i]) / fGyroLsb;
+            if (fError > g_sStats.fMaxErrorLsb)
+            {
+                g_sStats.fMaxErrorLsb = fError;
+            }
+        }
+    }
+    if (g_sMPU9150Sample.bMagnetoValid)
+    {
+        g_sStats.ui32MagValid++;
+        for (i = 0; i < 3; i++)
+        {
+            fError = fabsf(g_sMPU9150Sample.pfMagneto[i] -
+                           g_sReadTruth.pfMagneto[i]);
+            if (fError > g_sStats.fMaxMagError)
+            {
+                g_sStats.fMaxMagError = fError;
+            }
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// The main loop of main.c until ui64End: wait for a sample or a coasting
+// step of the recovery, then decode and check the sample.
+//
+//*****************************************************************************
+static void
+MainLoop(uint64_t ui64End)
+{
+    uint64_t ui64Latency;
+
+    while (g_ui64Now < ui64End)
+    {
+        while (!g_vui8I2CDoneFlag && HostStep(ui64End, true))
+        {
+        }
+        if (!g_vui8I2CDoneFlag)
+        {
+            continue;
+        }
+
+        g_vui8I2CDoneFlag = 0;
+        g_ui32SampleStart = CycleCounterGet();
+        I2CRecoverSample(&g_sI2CRecoverInst, g_ui32SampleStart);
+        MPU9150DataSampleGet(&g_sMPU9150Inst, &g_sMPU9150Sample);
+
+        g_sStats.ui32Samples++;
+        ui64Latency = g_ui64ReadDone - g_ui64ReadSample;
+        g_sStats.dLatencySum += (double)ui64Latency;
+        if (ui64Latency > g_sStats.ui64LatencyMax)
+        {
+            g_sStats.ui64LatencyMax = ui64Latency;
+        }
+        g_sStats.pui32Latency[(ui64Latency / LATENCY_BIN_NS <
+                               LATENCY_BINS) ?
+                              (ui64Latency / LATENCY_BIN_NS) :
+                              (LATENCY_BINS - 1)]++;
+        if (MPU9150DataValid(&g_sMPU9150Inst))
+        {
+            g_sStats.ui32Valid++;
+            SampleCheck();
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// Returns the latency in us that uiPermille of the samples stay below.
+//
+//*****************************************************************************
+static double
+LatencyQuantile(uint32_t ui32Permille)
+{
+    uint64_t ui64Count = 0;
+    uint32_t i;
+
+    for (i = 0; i < LATENCY_BINS; i++)
+    {
+        ui64Count += g_sStats.pui32Latency[i];
+        if (ui64Count * 1000 >= (uint64_t)g_sStats.ui32Samples * ui32Permille)
+        {
+            return (i + 1) * LATENCY_BIN_NS * 1e-3;
+        }
+    }
+    return LATENCY_BINS * LATENCY_BIN_NS * 1e-3;
+}
+
+//*****************************************************************************
+//
+// Reads a log into g_pfTrace. Missing columns are a board at rest at
+// 25 degrees C.
+//
+//*****************************************************************************
+static bool
+TraceRead(const char *pcFile)
+{
+    static const float pfRest[TRACE_COLUMNS] =
+    {
+        0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 20.0f, -5.0f, -40.0f, 25.0f
+    };
+    char pcLine[512];
+    uint32_t ui32Size = 0;
+    FILE *pFile = fopen(pcFile, "r");
+
+    if (!pFile)
+    {
+        return false;
+    }
+    while (fgets(pcLine, sizeof(pcLine), pFile))
+    {
+        float *pfRow;
+        char *pcPos = pcLine, *pcEnd;
+        int i;
+
+        if (g_ui32TraceRows == ui32Size)
+        {
+            ui32Size = ui32Size ? 2 * ui32Size : 4096;
+            g_pfTrace = realloc(g_pfTrace,
+                                ui32Size * TRACE_COLUMNS * sizeof(float));
+        }
+        pfRow = g_pfTrace + TRACE_COLUMNS * g_ui32TraceRows;
+        memcpy(pfRow, pfRest, sizeof(pfRest));
+        for (i = 0; i < TRACE_COLUMNS; i++)
+        {
+            float fValue = strtof(pcPos, &pcEnd);
+
+            if (pcEnd == pcPos)
+            {
+                break;
+            }
+            pfRow[i] = fValue;
+            pcPos = pcEnd;
+        }
+        if (i >= 3)
+        {
+            g_ui32TraceRows++;
+        }
+    }
+    fclose(pFile);
+    return g_ui32TraceRows != 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    uint32_t ui32Scenario;
+    double dSimulated = 0.0, dWall;
+    clock_t sStart;
+    bool bOk = true;
+
+    if (argc > 1)
+    {
+        if (!TraceRead(argv[1]))
+        {
+            fprintf(stderr, "cannot read %s\n", argv[1]);
+            return 1;
+        }
+        g_ui64TracePeriod = (uint64_t)(((argc > 2) ? atof(argv[2]) :
+                                        DEFAULT_TRACE_MS) * 1e6);
+        printf("%s: %u samples every %.2f ms\n\n", argv[1], g_ui32TraceRows,
+               g_ui64TracePeriod * 1e-6);
+    }
+
+    printf("scenario          samples lost  mag   lat.us mean  p99   max"
+           "  bus%%  errs outages max.ms ranges err.LSB\n");
+    sStart = clock();
+    for (ui32Scenario = 0;
+         ui32Scenario < sizeof(g_psScenarios) / sizeof(g_psScenarios[0]);
+         ui32Scenario++)
+    {
+        const tScenario *psScenario = &g_psScenarios[ui32Scenario];
+        const tI2CMFakeStats *psBus = I2CMFakeStatsGet();
+        uint64_t ui64Start, ui64BusyStart;
+        uint32_t ui32ModelStart;
+        int32_t i32Lost;
+
+        if (!Boot())
+        {
+            printf("%-16s boot failed at %.1f ms\n", psScenario->pcName,
+                   g_ui64Now * 1e-6);
+            bOk = false;
+            continue;
+        }
+        I2CMFakeConfigSet(&psScenario->sBus);
+        ui64Start = g_ui64Now;
+        ui64BusyStart = psBus->ui64BusyNs;
+        ui32ModelStart = g_sModel.ui32Samples;
+        MainLoop(ui64Start + SCENARIO_S * 1000 * NS_PER_MS);
+        dSimulated += g_ui64Now * 1e-9;
+
+        i32Lost = (int32_t)(g_sModel.ui32Samples - ui32ModelStart -
+                            g_sStats.ui32Samples);
+        printf("%-16s %8u %5d %5u %11.0f %5.0f %5.0f %5.1f %5u %7u %6u "
+               "%6u %7.2f\n", psScenario->pcName, g_sStats.ui32Samples,
+               i32Lost, g_sStats.ui32MagValid,
+               g_sStats.ui32Samples ?
+               g_sStats.dLatencySum / g_sStats.ui32Samples * 1e-3 : 0.0,
+               LatencyQuantile(990), g_sStats.ui64LatencyMax * 1e-3,
+               100.0 * (psBus->ui64BusyNs - ui64BusyStart) /
+               (g_ui64Now - ui64Start), g_sStats.ui32Errors,
+               g_sI2CRecoverInst.ui32Outages, g_sI2CRecoverInst.ui32MaxMs,
+               g_sMPU9150Inst.ui32RangeChanges, g_sStats.fMaxErrorLsb);
+
+        //
+        // Every scenario keeps sampling, and valid samples decode to the
+        // truth.
+        //
+        bOk = (bOk && (g_sStats.ui32Samples > SCENARIO_S * 200) &&
+               (g_sStats.fMaxErrorLsb <= MAX_ERROR_LSB));
+    }
+    dWall = (double)(clock() - sStart) / CLOCKS_PER_SEC;
+
+    printf("\n%.0f s simulated in %.2f s, %.0f times real time\n",
+           dSimulated, dWall, dWall > 0.0 ? dSimulated / dWall : 0.0);
+    printf("%s\n", bOk ? "all passed" : "FAILED");
+    free(g_pfTrace);
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+//*****************************************************************************
+//
+// ak8975.h - Host stand-in for the AK8975 driver of the TivaWare sensor
+// library. mpu9150mod.c keeps an instance in tMPU9150 but does not call the
+// driver.
+//
+//*****************************************************************************
+
+#ifndef __SENSORLIB_AK8975_H__
+#define __SENSORLIB_AK8975_H__
+
+#include <stdint.h>
+#include "sensorlib/i2cm_drv.h"
+
+//*****************************************************************************
+//
+// The state of the AK8975 driver.
+//
+//*****************************************************************************
+typedef struct
+{
+    tI2CMInstance *psI2CInst;
+    uint8_t ui8Addr;
+    uint8_t ui8State;
+    uint8_t pui8Data[8];
+    tSensorCallback *pfnCallback;
+    void *pvCallbackData;
+}
+tAK8975;
+
+#endif // __SENSORLIB_AK8975_H__
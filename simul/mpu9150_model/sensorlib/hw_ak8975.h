@@ -0,0 +1,36 @@
+//*****************************************************************************
+//
+// hw_ak8975.h - Host stand-in for the AK8975 register definitions of the
+// TivaWare sensor library, with the registers and fields that mpu9150mod.c
+// and the device model use. The values are from the AK8975 data sheet.
+//
+//*****************************************************************************
+
+#ifndef __SENSORLIB_HW_AK8975_H__
+#define __SENSORLIB_HW_AK8975_H__
+
+//*****************************************************************************
+//
+// Register offsets.
+//
+//*****************************************************************************
+#define AK8975_O_WIA            0x00        // Device ID
+#define AK8975_O_ST1            0x02        // Status 1
+#define AK8975_O_HXL            0x03        // X-axis data, low byte
+#define AK8975_O_ST2            0x09        // Status 2
+#define AK8975_O_CNTL           0x0A        // Control
+
+//*****************************************************************************
+//
+// Register fields.
+//
+//*****************************************************************************
+#define AK8975_ST1_DRDY         0x01        // Data ready
+#define AK8975_ST2_DERR         0x04        // Data error
+#define AK8975_ST2_HOFL         0x08        // Magnetic sensor overflow
+#define AK8975_CNTL_MODE_M      0x0F        // Operating mode
+#define AK8975_CNTL_MODE_POWER_DOWN                                           \
+                                0x00
+#define AK8975_CNTL_MODE_SINGLE 0x01
+
+#endif // __SENSORLIB_HW_AK8975_H__
@@ -0,0 +1,104 @@
+//*****************************************************************************
+//
+// hw_mpu9150.h - Host stand-in for the MPU9150 register definitions of the
+// TivaWare sensor library, with the registers and fields that mpu9150mod.c,
+// main.c and the device model use. The values are from the MPU9150 register
+// map.
+//
+//*****************************************************************************
+
+#ifndef __SENSORLIB_HW_MPU9150_H__
+#define __SENSORLIB_HW_MPU9150_H__
+
+//*****************************************************************************
+//
+// Register offsets.
+//
+//*****************************************************************************
+#define MPU9150_O_SMPLRT_DIV    0x19        // Sample rate divider
+#define MPU9150_O_CONFIG        0x1A        // Configuration
+#define MPU9150_O_GYRO_CONFIG   0x1B        // Gyroscope configuration
+#define MPU9150_O_ACCEL_CONFIG  0x1C        // Accelerometer configuration
+#define MPU9150_O_I2C_MST_CTRL  0x24        // I2C master control
+#define MPU9150_O_I2C_SLV0_ADDR 0x25        // I2C slave 0 address
+#define MPU9150_O_I2C_SLV0_REG  0x26        // I2C slave 0 register
+#define MPU9150_O_I2C_SLV0_CTRL 0x27        // I2C slave 0 control
+#define MPU9150_O_I2C_SLV4_ADDR 0x31        // I2C slave 4 address
+#define MPU9150_O_I2C_SLV4_REG  0x32        // I2C slave 4 register
+#define MPU9150_O_I2C_SLV4_DO   0x33        // I2C slave 4 data out
+#define MPU9150_O_I2C_SLV4_CTRL 0x34        // I2C slave 4 control
+#define MPU9150_O_INT_PIN_CFG   0x37        // Interrupt pin configuration
+#define MPU9150_O_INT_ENABLE    0x38        // Interrupt enable
+#define MPU9150_O_INT_STATUS    0x3A        // Interrupt status
+#define MPU9150_O_ACCEL_XOUT_H  0x3B        // Accelerometer X, high byte
+#define MPU9150_O_TEMP_OUT_H    0x41        // Temperature, high byte
+#define MPU9150_O_GYRO_XOUT_H   0x43        // Gyroscope X, high byte
+#define MPU9150_O_EXT_SENS_DATA_00                                            \
+                                0x49        // External sensor data 0
+#define MPU9150_O_I2C_MST_DELAY_CTRL                                          \
+                                0x67        // I2C master delay control
+#define MPU9150_O_USER_CTRL     0x6A        // User control
+#define MPU9150_O_PWR_MGMT_1    0x6B        // Power management 1
+#define MPU9150_O_WHO_AM_I      0x75        // Device identity
+
+//*****************************************************************************
+//
+// Register fields.
+//
+//*****************************************************************************
+#define MPU9150_CONFIG_DLPF_CFG_M                                             \
+                                0x07
+#define MPU9150_CONFIG_DLPF_CFG_260_256                                       \
+                                0x00
+#define MPU9150_CONFIG_DLPF_CFG_94_98                                         \
+                                0x02
+#define MPU9150_GYRO_CONFIG_FS_SEL_M                                          \
+                                0x18
+#define MPU9150_GYRO_CONFIG_FS_SEL_S                                          \
+                                3
+#define MPU9150_GYRO_CONFIG_FS_SEL_250                                        \
+                                0x00
+#define MPU9150_ACCEL_CONFIG_AFS_SEL_M                                        \
+                                0x18
+#define MPU9150_ACCEL_CONFIG_AFS_SEL_S                                        \
+                                3
+#define MPU9150_ACCEL_CONFIG_AFS_SEL_2G                                       \
+                                0x00
+#define MPU9150_ACCEL_CONFIG_ACCEL_HPF_5HZ                                    \
+                                0x01
+#define MPU9150_I2C_MST_CTRL_I2C_MST_CLK_400                                  \
+                                0x0D
+#define MPU9150_I2C_MST_CTRL_WAIT_FOR_ES                                      \
+                                0x40
+#define MPU9150_I2C_SLV0_ADDR_RW                                              \
+                                0x80
+#define MPU9150_I2C_SLV0_CTRL_EN                                              \
+                                0x80
+#define MPU9150_I2C_SLV4_CTRL_EN                                              \
+                                0x80
+#define MPU9150_I2C_SLV4_CTRL_I2C_MST_DLY_M                                   \
+                                0x1F
+#define MPU9150_INT_PIN_CFG_INT_LEVEL                                         \
+                                0x80
+#define MPU9150_INT_PIN_CFG_LATCH_INT_EN                                      \
+                                0x20
+#define MPU9150_INT_PIN_CFG_INT_RD_CLEAR                                      \
+                                0x10
+#define MPU9150_INT_ENABLE_DATA_RDY_EN                                        \
+                                0x01
+#define MPU9150_INT_STATUS_DATA_RDY_INT                                       \
+                                0x01
+#define MPU9150_I2C_MST_DELAY_CTRL_I2C_SLV0_DLY_EN                            \
+                                0x01
+#define MPU9150_I2C_MST_DELAY_CTRL_I2C_SLV4_DLY_EN                            \
+                                0x10
+#define MPU9150_USER_CTRL_I2C_MST_EN                                          \
+                                0x20
+#define MPU9150_PWR_MGMT_1_DEVICE_RESET                                       \
+                                0x80
+#define MPU9150_PWR_MGMT_1_SLEEP                                              \
+                                0x40
+#define MPU9150_PWR_MGMT_1_CLKSEL_XG                                          \
+                                0x01
+
+#endif // __SENSORLIB_HW_MPU9150_H__
@@ -0,0 +1,240 @@
+//*****************************************************************************
+//
+// i2cm_drv.h - Host stand-in for the I2C master driver of the TivaWare
+// sensor library.
+//
+// The API that mpu9150mod.c and main.c use is kept: I2CMInit(),
+// I2CMCommand() with the I2CMRead() and I2CMWrite() macros, I2CMWrite8(),
+// I2CMReadModifyWrite8() and I2CMIntHandler(). The transactions run on a
+// simulated bus (i2cm_fake.c) in virtual time on the device models, and
+// the completion interrupt of a command is due when its bytes have been
+// clocked. The I2CMFake* functions below are the host side of the bus.
+//
+//*****************************************************************************
+
+#ifndef __SENSORLIB_I2CM_DRV_H__
+#define __SENSORLIB_I2CM_DRV_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//*****************************************************************************
+//
+// The status of a transaction, passed to its callback.
+//
+//*****************************************************************************
+#define I2CM_STATUS_SUCCESS     0
+#define I2CM_STATUS_ADDR_NACK   1
+#define I2CM_STATUS_DATA_NACK   2
+#define I2CM_STATUS_ARB_LOST    3
+#define I2CM_STATUS_ERROR       4
+
+//*****************************************************************************
+//
+// The number of commands that can be queued on the bus.
+//
+//*****************************************************************************
+#define NUM_I2CM_COMMANDS       4
+
+//*****************************************************************************
+//
+// The largest write of I2CMWrite8(), register address included.
+//
+//*****************************************************************************
+#define I2CM_WRITE8_MAX         16
+
+//*****************************************************************************
+//
+// The callback of a transaction.
+//
+//*****************************************************************************
+typedef void (tSensorCallback)(void *pvData, uint_fast8_t ui8Status);
+
+//*****************************************************************************
+//
+// A queued command.
+//
+//*****************************************************************************
+typedef struct
+{
+    uint8_t ui8Addr;
+    const uint8_t *pui8WriteData;
+    uint16_t ui16WriteCount;
+    uint8_t *pui8ReadData;
+    uint16_t ui16ReadCount;
+    tSensorCallback *pfnCallback;
+    void *pvCallbackData;
+}
+tI2CMCommand;
+
+//*****************************************************************************
+//
+// The state of the I2C master driver. The command at ui8ReadPtr is on the
+// bus; it completes at ui64Done (UINT64_MAX if it hangs) with ui8Status.
+//
+//*****************************************************************************
+typedef struct
+{
+    uint32_t ui32Base;
+    uint8_t ui8Int;
+    uint32_t ui32Clock;
+    tI2CMCommand pCommands[NUM_I2CM_COMMANDS];
+    uint8_t ui8ReadPtr;
+    uint8_t ui8WritePtr;
+    bool bBusy;
+    uint64_t ui64Done;
+    uint8_t ui8Status;
+}
+tI2CMInstance;
+
+//*****************************************************************************
+//
+// The state of a register write by I2CMWrite8(), which sends the register
+// address and the data from one buffer.
+//
+//*****************************************************************************
+typedef struct
+{
+    tI2CMInstance *psI2CInst;
+    uint8_t pui8Buffer[I2CM_WRITE8_MAX];
+    tSensorCallback *pfnCallback;
+    void *pvCallbackData;
+}
+tI2CMWrite8;
+
+//*****************************************************************************
+//
+// The state of a read-modify-write by I2CMReadModifyWrite8(). When it
+// completes, pui8Buffer holds the register address and the value written.
+//
+//*****************************************************************************
+typedef struct
+{
+    tI2CMInstance *psI2CInst;
+    uint8_t ui8Addr;
+    uint8_t ui8State;
+    uint8_t ui8Mask;
+    uint8_t ui8Value;
+    uint8_t pui8Buffer[2];
+    tSensorCallback *pfnCallback;
+    void *pvCallbackData;
+}
+tI2CMReadModifyWrite8;
+
+//*****************************************************************************
+//
+// A device on the simulated bus. pfnStart() brings the device to the time of
+// the transaction and returns false if it does not acknowledge its address,
+// pfnWrite() and pfnRead() transfer the bytes of the transaction.
+//
+//*****************************************************************************
+typedef struct
+{
+    uint8_t ui8Addr;
+    void *pvDevice;
+    bool (*pfnStart)(void *pvDevice, uint64_t ui64Now);
+    void (*pfnWrite)(void *pvDevice, const uint8_t *pui8Data,
+                     uint32_t ui32Count);
+    void (*pfnRead)(void *pvDevice, uint8_t *pui8Data, uint32_t ui32Count);
+}
+tI2CMFakeDevice;
+
+//*****************************************************************************
+//
+// Timing and faults of the simulated bus. A transaction takes
+// ui32LatencyNs plus up to ui32JitterNs, then ui32ByteNs for every byte and
+// address. Faults are drawn per transaction, in parts per million: an
+// address or data NACK, a bus error (a lost arbitration, the transaction is
+// not carried out) and a hang of an acknowledged transaction, where the
+// completion interrupt never comes until I2CMInit() is called again.
+//
+//*****************************************************************************
+typedef struct
+{
+    uint32_t ui32LatencyNs;
+    uint32_t ui32JitterNs;
+    uint32_t ui32ByteNs;
+    uint32_t ui32AddrNackPpm;
+    uint32_t ui32DataNackPpm;
+    uint32_t ui32BusErrorPpm;
+    uint32_t ui32HangPpm;
+    uint32_t ui32Seed;
+}
+tI2CMFakeConfig;
+
+//*****************************************************************************
+//
+// Statistics of the simulated bus.
+//
+//*****************************************************************************
+typedef struct
+{
+    uint32_t ui32Transactions;
+    uint32_t ui32Bytes;
+    uint32_t ui32Rejected;
+    uint32_t ui32AddrNacks;
+    uint32_t ui32DataNacks;
+    uint32_t ui32BusErrors;
+    uint32_t ui32Hangs;
+    uint64_t ui64BusyNs;
+}
+tI2CMFakeStats;
+
+//*****************************************************************************
+//
+// Prototypes of the I2C master driver.
+//
+//*****************************************************************************
+extern void I2CMInit(tI2CMInstance *psInst, uint32_t ui32Base,
+                     uint_fast8_t ui8Int, uint_fast8_t ui8TxDMA,
+                     uint_fast8_t ui8RxDMA, uint_fast32_t ui32Clock);
+extern void I2CMIntHandler(tI2CMInstance *psInst);
+extern uint_fast8_t I2CMCommand(tI2CMInstance *psInst, uint_fast8_t ui8Addr,
+                                const uint8_t *pui8WriteData,
+                                uint_fast16_t ui16WriteCount,
+                                uint_fast16_t ui16WriteBatchSize,
+                                uint8_t *pui8ReadData,
+                                uint_fast16_t ui16ReadCount,
+                                uint_fast16_t ui16ReadBatchSize,
+                                tSensorCallback *pfnCallback,
+                                void *pvCallbackData);
+extern uint_fast8_t I2CMWrite8(tI2CMWrite8 *psInst,
+                               tI2CMInstance *psI2CInst,
+                               uint_fast8_t ui8Addr, uint_fast8_t ui8Reg,
+                               const uint8_t *pui8Data,
+                               uint_fast16_t ui16Count,
+                               tSensorCallback *pfnCallback,
+                               void *pvCallbackData);
+extern uint_fast8_t I2CMReadModifyWrite8(tI2CMReadModifyWrite8 *psInst,
+                                         tI2CMInstance *psI2CInst,
+                                         uint_fast8_t ui8Addr,
+                                         uint_fast8_t ui8Reg,
+                                         uint_fast8_t ui8Mask,
+                                         uint_fast8_t ui8Value,
+                                         tSensorCallback *pfnCallback,
+                                         void *pvCallbackData);
+
+#define I2CMRead(psInst, ui8Addr, pui8WriteData, ui16WriteCount,              \
+                 pui8ReadData, ui16ReadCount, pfnCallback, pvCallbackData)    \
+        I2CMCommand(psInst, ui8Addr, pui8WriteData, ui16WriteCount,           \
+                    ui16WriteCount, pui8ReadData, ui16ReadCount,              \
+                    ui16ReadCount, pfnCallback, pvCallbackData)
+#define I2CMWrite(psInst, ui8Addr, pui8Data, ui16Count, pfnCallback,          \
+                  pvCallbackData)                                             \
+        I2CMCommand(psInst, ui8Addr, pui8Data, ui16Count, ui16Count, 0, 0,    \
+                    0, pfnCallback, pvCallbackData)
+
+//*****************************************************************************
+//
+// Prototypes of the simulated bus.
+//
+//*****************************************************************************
+extern void I2CMFakeReset(const tI2CMFakeConfig *psConfig);
+extern void I2CMFakeConfigSet(const tI2CMFakeConfig *psConfig);
+extern void I2CMFakeDeviceAdd(const tI2CMFakeDevice *psDevice);
+extern void I2CMFakeIntHookSet(void (*pfnIntEnable)(uint32_t ui32Interrupt));
+extern bool I2CMFakeAdvance(tI2CMInstance *psInst, uint64_t ui64Now);
+extern uint64_t I2CMFakeNext(const tI2CMInstance *psInst);
+extern const tI2CMFakeStats *I2CMFakeStatsGet(void);
+
+#endif // __SENSORLIB_I2CM_DRV_H__
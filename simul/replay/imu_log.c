@@ -0,0 +1,405 @@
+//*****************************************************************************
+//
+// imu_log.c - Columnar binary format of the sensor captures.
+//
+// The captures of simul/mpu6050_integration are text, one sample per line.
+// ImuLogConvert() turns such a capture into a log of imu_log.h. A capture of
+// gyroscope counts printed in deg/s is stored as the int16 counts it was
+// printed from, at a quarter of the size of the text and without loss; any
+// other capture as float32. A log is read in place, mapped by ImuLogOpen() or
+// in memory by ImuLogAttach(), without parsing.
+//
+//*****************************************************************************
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "imu_log.h"
+
+//*****************************************************************************
+//
+// The sensitivities of the MPU6050 gyroscope in LSB per deg/s, for the full
+// scale ranges of 250, 500, 1000 and 2000 deg/s, tried in this order.
+//
+//*****************************************************************************
+static const double g_pdGyroScales[] = {131.0, 65.5, 32.8, 16.4};
+
+#define LINE_LENGTH                 512
+
+//*****************************************************************************
+//
+// The values of one line, up to IMU_LOG_MAX_COLUMNS. Returns their number.
+//
+//*****************************************************************************
+static int
+ParseLine(const char *pcLine, double *pdValues)
+{
+    char *pcEnd;
+    int iCount = 0;
+
+    while (iCount < IMU_LOG_MAX_COLUMNS)
+    {
+        double dValue = strtod(pcLine, &pcEnd);
+        if (pcEnd == pcLine)
+        {
+            break;
+        }
+        pdValues[iCount++] = dValue;
+        pcLine = pcEnd;
+    }
+    return iCount;
+}
+
+//*****************************************************************************
+//
+// The scale at which every value is an int16 count, or 0.
+//
+//*****************************************************************************
+static float
+CountScale(const double *pdValues, size_t sCount)
+{
+    size_t i, j;
+
+    for (i = 0; i < sizeof(g_pdGyroScales) / sizeof(g_pdGyroScales[0]); i++)
+    {
+        double dScale = g_pdGyroScales[i];
+        for (j = 0; j < sCount; j++)
+        {
+            double dCount = floor(pdValues[j] * dScale + 0.5);
+            if ((dCount < -32768.0) || (dCount > 32767.0) ||
+                (fabs(dCount / dScale - pdValues[j]) >
+                 IMU_LOG_TEXT_RESOLUTION + 1e-9))
+            {
+                break;
+            }
+        }
+        if (j == sCount)
+        {
+            return (float)dScale;
+        }
+    }
+    return 0.0f;
+}
+
+//*****************************************************************************
+//
+// Converts the text capture psText, sampled at fRate Hz, into a log. The
+// image is allocated and returned in *ppui8Image, its size in *psSize.
+// Three columns are taken as the gyroscope in deg/s, others are named by
+// their number and have no unit.
+//
+//*****************************************************************************
+bool
+ImuLogConvert(FILE *psText, const char *pcSource, float fRate,
+              uint8_t **ppui8Image, size_t *psSize)
+{
+    static const char *ppcGyroNames[3] = {"gyro_x", "gyro_y", "gyro_z"};
+    char pcLine[LINE_LENGTH];
+    double pdLine[IMU_LOG_MAX_COLUMNS];
+    double *pdValues = NULL;
+    size_t sSamples = 0, sCapacity = 0, sOffset;
+    int iColumns = 0, iLine = 0, i;
+    tImuLogHeader *psHeader;
+    uint8_t *pui8Image;
+    const char *pcBase;
+    float fScale;
+
+    while (fgets(pcLine, sizeof(pcLine), psText))
+    {
+        int iCount = ParseLine(pcLine, pdLine);
+
+        iLine++;
+        if (iCount == 0)
+        {
+            continue;
+        }
+        if (iColumns == 0)
+        {
+            iColumns = iCount;
+        }
+        if (iCount != iColumns)
+        {
+            fprintf(stderr, "%s:%d: %d values instead of %d\n", pcSource,
+                    iLine, iCount, iColumns);
+            free(pdValues);
+            return false;
+        }
+        if (sSamples == sCapacity)
+        {
+            sCapacity = sCapacity ? 2 * sCapacity : 4096;
+            pdValues = realloc(pdValues, sCapacity * iColumns *
+                                         sizeof(double));
+            if (!pdValues)
+            {
+                perror(pcSource);
+                return false;
+            }
+        }
+        memcpy(pdValues + sSamples * iColumns, pdLine,
+               iColumns * sizeof(double));
+        sSamples++;
+    }
+    if (sSamples == 0)
+    {
+        fprintf(stderr, "%s: no samples\n", pcSource);
+        return false;
+    }
+
+    //
+    // The layout: the columns follow the header, each aligned.
+    //
+    fScale = CountScale(pdValues, sSamples * iColumns);
+    sOffset = IMU_LOG_HEADER_SIZE;
+    for (i = 0; i < iColumns; i++)
+    {
+        sOffset += (sSamples * (fScale != 0.0f ? 2 : 4) + IMU_LOG_ALIGN - 1) &
+                   ~(size_t)(IMU_LOG_ALIGN - 1);
+    }
+    pui8Image = calloc(1, sOffset);
+    if (!pui8Image)
+    {
+        perror(pcSource);
+        free(pdValues);
+        return false;
+    }
+
+    psHeader = (tImuLogHeader *)pui8Image;
+    memcpy(psHeader->pcMagic, IMU_LOG_MAGIC, 4);
+    psHeader->ui16Version = IMU_LOG_VERSION;
+    psHeader->ui16Columns = (uint16_t)iColumns;
+    psHeader->ui32Samples = (uint32_t)sSamples;
+    psHeader->fRate = fRate;
+    pcBase = strrchr(pcSource, '/');
+    strncpy(psHeader->pcSource, pcBase ? pcBase + 1 : pcSource,
+            sizeof(psHeader->pcSource) - 1);
+
+    sOffset = IMU_LOG_HEADER_SIZE;
+    for (i = 0; i < iColumns; i++)
+    {
+        tImuLogColumn *psColumn = psHeader->psColumns + i;
+        size_t j;
+
+        if (iColumns == 3)
+        {
+            strcpy(psColumn->pcName, ppcGyroNames[i]);
+            strcpy(psColumn->pcUnit, "deg/s");
+        }
+        else
+        {
+            snprintf(psColumn->pcName, sizeof(psColumn->pcName), "col%d",
+                     i % IMU_LOG_MAX_COLUMNS);
+        }
+        psColumn->ui32Offset = (uint32_t)sOffset;
+        if (fScale != 0.0f)
+        {
+            int16_t *pi16Column = (int16_t *)(pui8Image + sOffset);
+
+            psColumn->ui32Type = IMU_LOG_INT16;
+            psColumn->fScale = fScale;
+            for (j = 0; j < sSamples; j++)
+            {
+                pi16Column[j] = (int16_t)floor(pdValues[j * iColumns + i] *
+                                               fScale + 0.5);
+            }
+            sOffset += sSamples * 2;
+        }
+        else
+        {
+            float *pfColumn = (float *)(pui8Image + sOffset);
+
+            psColumn->ui32Type = IMU_LOG_FLOAT32;
+            psColumn->fScale = 1.0f;
+            for (j = 0; j < sSamples; j++)
+            {
+                pfColumn[j] = (float)pdValues[j * iColumns + i];
+            }
+            sOffset += sSamples * 4;
+        }
+        sOffset = (sOffset + IMU_LOG_ALIGN - 1) & ~(size_t)(IMU_LOG_ALIGN - 1);
+    }
+    free(pdValues);
+
+    *ppui8Image = pui8Image;
+    *psSize = sOffset;
+    return true;
+}
+
+//*****************************************************************************
+//
+// Writes an image made by ImuLogConvert() to a file.
+//
+//*****************************************************************************
+bool
+ImuLogWrite(const char *pcPath, const uint8_t *pui8Image, size_t sSize)
+{
+    FILE *psFile = fopen(pcPath, "wb");
+    bool bOk;
+
+    if (!psFile)
+    {
+        perror(pcPath);
+        return false;
+    }
+    bOk = fwrite(pui8Image, 1, sSize, psFile) == sSize;
+    if (fclose(psFile) || !bOk)
+    {
+        perror(pcPath);
+        return false;
+    }
+    return true;
+}
+
+//*****************************************************************************
+//
+// Opens a log in memory after checking that its header and columns are
+// within the image.
+//
+//*****************************************************************************
+bool
+ImuLogAttach(tImuLog *psLog, const uint8_t *pui8Image, size_t sSize)
+{
+    const tImuLogHeader *psHeader = (const tImuLogHeader *)pui8Image;
+    int i;
+
+    if ((sSize < IMU_LOG_HEADER_SIZE) ||
+        memcmp(psHeader->pcMagic, IMU_LOG_MAGIC, 4) ||
+        (psHeader->ui16Version != IMU_LOG_VERSION) ||
+        (psHeader->ui16Columns > IMU_LOG_MAX_COLUMNS) ||
+        !(psHeader->fRate > 0.0f))
+    {
+        return false;
+    }
+    for (i = 0; i < psHeader->ui16Columns; i++)
+    {
+        const tImuLogColumn *psColumn = psHeader->psColumns + i;
+        size_t sBytes;
+
+        if (psColumn->ui32Type == IMU_LOG_INT16)
+        {
+            sBytes = (size_t)psHeader->ui32Samples * 2;
+        }
+        else if (psColumn->ui32Type == IMU_LOG_FLOAT32)
+        {
+            sBytes = (size_t)psHeader->ui32Samples * 4;
+        }
+        else
+        {
+            return false;
+        }
+        if ((psColumn->ui32Offset % IMU_LOG_ALIGN) ||
+            (psColumn->ui32Offset < IMU_LOG_HEADER_SIZE) ||
+            (psColumn->ui32Offset + sBytes > sSize) ||
+            !(psColumn->fScale > 0.0f))
+        {
+            return false;
+        }
+    }
+
+    psLog->psHeader = psHeader;
+    psLog->pui8Image = pui8Image;
+    psLog->sSize = sSize;
+    psLog->bMapped = false;
+    return true;
+}
+
+//*****************************************************************************
+//
+// Maps a log file read-only.
+//
+//*****************************************************************************
+bool
+ImuLogOpen(tImuLog *psLog, const char *pcPath)
+{
+    struct stat sStat;
+    void *pvImage;
+    int iFile = open(pcPath, O_RDONLY);
+
+    if (iFile < 0)
+    {
+        perror(pcPath);
+        return false;
+    }
+    if (fstat(iFile, &sStat) || (sStat.st_size < IMU_LOG_HEADER_SIZE))
+    {
+        fprintf(stderr, "%s: not an IMU log\n", pcPath);
+        close(iFile);
+        return false;
+    }
+    pvImage = mmap(NULL, sStat.st_size, PROT_READ, MAP_PRIVATE, iFile, 0);
+    close(iFile);
+    if (pvImage == MAP_FAILED)
+    {
+        perror(pcPath);
+        return false;
+    }
+    if (!ImuLogAttach(psLog, pvImage, sStat.st_size))
+    {
+        fprintf(stderr, "%s: not an IMU log\n", pcPath);
+        munmap(pvImage, sStat.st_size);
+        return false;
+    }
+    psLog->bMapped = true;
+    return true;
+}
+
+//*****************************************************************************
+//
+// Unmaps a log opened by ImuLogOpen(). The image of an attached log stays
+// with its owner.
+//
+//*****************************************************************************
+void
+ImuLogClose(tImuLog *psLog)
+{
+    if (psLog->bMapped)
+    {
+        munmap((void *)psLog->pui8Image, psLog->sSize);
+    }
+    psLog->psHeader = NULL;
+    psLog->pui8Image = NULL;
+    psLog->sSize = 0;
+    psLog->bMapped = false;
+}
+
+//*****************************************************************************
+//
+// The index of the column of that name, or -1.
+//
+//*****************************************************************************
+int
+ImuLogColumnFind(const tImuLog *psLog, const char *pcName)
+{
+    int i;
+
+    for (i = 0; i < psLog->psHeader->ui16Columns; i++)
+    {
+        if (!strncmp(psLog->psHeader->psColumns[i].pcName, pcName,
+                     sizeof(psLog->psHeader->psColumns[i].pcName)))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//*****************************************************************************
+//
+// A value in the unit of its column.
+//
+//*****************************************************************************
+float
+ImuLogValue(const tImuLog *psLog, uint32_t ui32Column, uint32_t ui32Sample)
+{
+    const tImuLogColumn *psColumn = psLog->psHeader->psColumns + ui32Column;
+    const uint8_t *pui8Column = psLog->pui8Image + psColumn->ui32Offset;
+
+    if (psColumn->ui32Type == IMU_LOG_INT16)
+    {
+        return ((const int16_t *)pui8Column)[ui32Sample] / psColumn->fScale;
+    }
+    return ((const float *)pui8Column)[ui32Sample];
+}
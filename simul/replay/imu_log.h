@@ -0,0 +1,110 @@
+//*****************************************************************************
+//
+// imu_log.h - Columnar binary format of the sensor captures.
+//
+//*****************************************************************************
+
+#ifndef _IMU_LOG_H_
+#define _IMU_LOG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//*****************************************************************************
+//
+// A log is a header of IMU_LOG_HEADER_SIZE bytes followed by the samples of
+// every column, one column after the other. Each column starts at a multiple
+// of IMU_LOG_ALIGN bytes from the start of the file, so that a mapped file
+// gives an aligned array per column. Values are little-endian, the byte order
+// of the hosts and of the TM4C123G.
+//
+// A column is stored either as the int16 counts of the sensor, the value
+// being the count divided by the scale (131 LSB per deg/s for the gyroscope
+// of the MPU6050 at +/-250 deg/s), or as float32 with a scale of 1.
+//
+//*****************************************************************************
+#define IMU_LOG_MAGIC               "IMUC"
+#define IMU_LOG_VERSION             1
+#define IMU_LOG_MAX_COLUMNS         16
+#define IMU_LOG_ALIGN               64
+#define IMU_LOG_HEADER_SIZE         576
+
+//*****************************************************************************
+//
+// Largest difference between a value of a text capture and of its log still
+// taken as equal: half the last digit of the six decimals of the captures.
+//
+//*****************************************************************************
+#define IMU_LOG_TEXT_RESOLUTION     5e-7
+
+#define IMU_LOG_INT16               1
+#define IMU_LOG_FLOAT32             2
+
+//*****************************************************************************
+//
+// A column: its name and unit, zero terminated, the type and scale of its
+// values and the offset of its first value in the file.
+//
+//*****************************************************************************
+typedef struct
+{
+    char pcName[12];
+    char pcUnit[8];
+    uint32_t ui32Type;
+    float fScale;
+    uint32_t ui32Offset;
+}
+tImuLogColumn;
+
+//*****************************************************************************
+//
+// The header: the magic, the version, the number of columns and of samples,
+// the sample rate in Hz and the name of the capture the log was made from.
+//
+//*****************************************************************************
+typedef struct
+{
+    char pcMagic[4];
+    uint16_t ui16Version;
+    uint16_t ui16Columns;
+    uint32_t ui32Samples;
+    float fRate;
+    char pcSource[48];
+    tImuLogColumn psColumns[IMU_LOG_MAX_COLUMNS];
+}
+tImuLogHeader;
+
+//*****************************************************************************
+//
+// An open log, either a mapped file or an image in memory.
+//
+//*****************************************************************************
+typedef struct
+{
+    const tImuLogHeader *psHeader;
+    const uint8_t *pui8Image;
+    size_t sSize;
+    bool bMapped;
+}
+tImuLog;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern bool ImuLogConvert(FILE *psText, const char *pcSource, float fRate,
+                          uint8_t **ppui8Image, size_t *psSize);
+extern bool ImuLogWrite(const char *pcPath, const uint8_t *pui8Image,
+                        size_t sSize);
+extern bool ImuLogAttach(tImuLog *psLog, const uint8_t *pui8Image,
+                         size_t sSize);
+extern bool ImuLogOpen(tImuLog *psLog, const char *pcPath);
+extern void ImuLogClose(tImuLog *psLog);
+extern int ImuLogColumnFind(const tImuLog *psLog, const char *pcName);
+extern float ImuLogValue(const tImuLog *psLog, uint32_t ui32Column,
+                         uint32_t ui32Sample);
+
+#endif // _IMU_LOG_H_
@@ -0,0 +1,786 @@
+//*****************************************************************************
+//
+// replay_host.c - Converts the sensor captures to the columnar logs of
+// imu_log.h and replays them through the attitude filters of
+// flight_controller/comp_dcm.c at the full speed of the host.
+//
+// The replay is the drift study of simul/sil/attitude_drift.py on the code of
+// the flight controller. The capture without the bias of its first
+// BIAS_SAMPLES samples is taken as the true rates and integrated in double
+// into the true attitude, and each filter gets
+//
+// - the captured rates with a bias drift on every axis, after the boot
+//   calibration over the first BIAS_SAMPLES samples as fGyroBias,
+// - the accelerometer as gravity in the body frame with white noise of
+//   ACCEL_NOISE, before the correction of CompDCMAccelUpdate(),
+// - every MAG_EVERY samples the magnetometer in a field with an inclination
+//   of MAG_INCLINATION, as the AK8975 delivers it.
+//
+// The filters are the complementary filter, the Mahony filter and the EKF
+// of CompDCMUpdate(), and, as the baseline of mpu6050_integration.py, the
+// rates integrated alone. Each runs on its own over the whole log, called as
+// main.c calls it, and each update is timed, with the clock reads of about
+// 20 ns included. The report has the final, rms and largest error of roll,
+// pitch and yaw in degrees, the mean, 99th percentile and largest time of an
+// update and how much faster than real time the log was replayed.
+//
+// Build and run from this directory (the compile command is one line):
+//
+//   cc -O2 -I../sitl -I../../flight_controller -o replay_host replay_host.c
+//      imu_log.c ../../flight_controller/comp_dcm.c
+//      ../../flight_controller/att_ekf.c -lm
+//   ./replay_host -o log.imu [-r rate_hz] capture.txt
+//   ./replay_host [-d drift_deg_s] log.imu|capture.txt ...
+//   ./replay_host
+//
+// The first form converts a capture, at the 266.7 Hz of the captures unless
+// -r gives the rate. The second replays logs and captures, a capture being
+// converted in memory first, with a drift of 0.5 deg/s unless -d gives it.
+// ../sitl provides the stand-ins of the TivaWare headers comp_dcm.c includes.
+//
+// Without arguments the five captures of simul/mpu6050_integration are
+// converted, checked to give back every value of the text, written, mapped
+// and replayed. Returns 1 if a value differs, a mapped log differs from the
+// one in memory or the roll and pitch errors of the Mahony filter and the
+// EKF exceed MAX_ATT_ERROR.
+//
+//*****************************************************************************
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "comp_dcm.h"
+#include "imu_log.h"
+
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+#define RAD_TO_DEG              (180.0 / M_PI)
+#define DEFAULT_RATE            (1.0f / 0.00375f) // Hz, rate of the captures
+#define DEFAULT_DRIFT           0.5f     // deg/s
+#define BIAS_SAMPLES            500
+#define ACCEL_NOISE             0.05f    // m/s^2
+#define GRAVITY                 9.81f    // m/s^2
+#define MAG_EVERY               5
+#define MAG_INCLINATION         1.05f    // rad
+#define MAG_FIELD               50e-6f   // T
+#define MAX_ATT_ERROR           2.0      // deg, rms roll and pitch
+#define FILTERS                 4
+#define FILTER_GYRO             3
+
+#define CAPTURES                "../mpu6050_integration/"
+
+static const char *g_ppcFilters[FILTERS] =
+{
+    "complementary", "mahony", "ekf", "gyro only"
+};
+
+static const char *g_ppcCaptures[] =
+{
+    "gyro_data_static.txt", "gyro_data_mov_1.txt", "gyro_data_mov_2.txt",
+    "gyro_data_mov_3.txt", "gyro_data_mov_4.txt"
+};
+
+//*****************************************************************************
+//
+// The sensor readings of one sample and the true attitude after it.
+//
+//*****************************************************************************
+typedef struct
+{
+    float pfGyro[3];
+    float pfAccel[3];
+    float pfMagneto[3];
+    float pfEuler[3];
+}
+tStimulus;
+
+//*****************************************************************************
+//
+// What a replay found for one filter: the errors of roll, pitch and yaw in
+// degrees and the times of an update in ns.
+//
+//*****************************************************************************
+typedef struct
+{
+    double pdFinal[3];
+    double pdRms[3];
+    double pdMax[3];
+    double dMeanNs;
+    double dP99Ns;
+    double dMaxNs;
+    double dSpeed;
+}
+tResult;
+
+//*****************************************************************************
+//
+// Gaussian noise by the Box-Muller transform.
+//
+//*****************************************************************************
+static double
+Gaussian(void)
+{
+    double dU = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double dV = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2.0 * log(dU)) * cos(2.0 * M_PI * dV);
+}
+
+static double
+Wrap(double dAngle)
+{
+    return dAngle - 2.0 * M_PI * floor(dAngle / (2.0 * M_PI) + 0.5);
+}
+
+static uint64_t
+Nanoseconds(void)
+{
+    struct timespec sTime;
+
+    clock_gettime(CLOCK_MONOTONIC, &sTime);
+    return (uint64_t)sTime.tv_sec * 1000000000u + sTime.tv_nsec;
+}
+
+static int
+CompareTimes(const void *pvA, const void *pvB)
+{
+    uint32_t ui32A = *(const uint32_t *)pvA, ui32B = *(const uint32_t *)pvB;
+    return (ui32A > ui32B) - (ui32A < ui32B);
+}
+
+//*****************************************************************************
+//
+// Rotates pdDCM by the body rates pdRate over dDeltaT, the Rodrigues
+// increment of CompDCMRotate() in double, and keeps it orthonormal.
+//
+//*****************************************************************************
+static void
+Rotate(double pdDCM[3][3], const double pdRate[3], double dDeltaT)
+{
+    double pdInc[3][3], pdOut[3][3];
+    double dX = pdRate[0] * dDeltaT;
+    double dY = pdRate[1] * dDeltaT;
+    double dZ = pdRate[2] * dDeltaT;
+    double dSigma = sqrt(dX * dX + dY * dY + dZ * dZ);
+    double dA = 1.0, dB = 0.5;
+    int i, j, k;
+
+    if (dSigma > 1e-9)
+    {
+        dA = sin(dSigma) / dSigma;
+        dB = (1.0 - cos(dSigma)) / (dSigma * dSigma);
+    }
+    pdInc[0][0] = 1.0 - dB * (dY * dY + dZ * dZ);
+    pdInc[0][1] = -dA * dZ + dB * dX * dY;
+    pdInc[0][2] = dA * dY + dB * dX * dZ;
+    pdInc[1][0] = dA * dZ + dB * dX * dY;
+    pdInc[1][1] = 1.0 - dB * (dX * dX + dZ * dZ);
+    pdInc[1][2] = -dA * dX + dB * dY * dZ;
+    pdInc[2][0] = -dA * dY + dB * dX * dZ;
+    pdInc[2][1] = dA * dX + dB * dY * dZ;
+    pdInc[2][2] = 1.0 - dB * (dX * dX + dY * dY);
+
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            pdOut[i][j] = (pdDCM[i][0] * pdInc[0][j] +
+                           pdDCM[i][1] * pdInc[1][j] +
+                           pdDCM[i][2] * pdInc[2][j]);
+        }
+    }
+
+    //
+    // Gram-Schmidt of the columns, the rounding of double needs no more.
+    //
+    for (j = 0; j < 3; j++)
+    {
+        for (k = 0; k < j; k++)
+        {
+            double dDot = (pdOut[0][j] * pdOut[0][k] +
+                           pdOut[1][j] * pdOut[1][k] +
+                           pdOut[2][j] * pdOut[2][k]);
+            for (i = 0; i < 3; i++)
+            {
+                pdOut[i][j] -= dDot * pdOut[i][k];
+            }
+        }
+        double dNorm = sqrt(pdOut[0][j] * pdOut[0][j] +
+                            pdOut[1][j] * pdOut[1][j] +
+                            pdOut[2][j] * pdOut[2][j]);
+        for (i = 0; i < 3; i++)
+        {
+            pdOut[i][j] /= dNorm;
+            pdDCM[i][j] = pdOut[i][j];
+        }
+    }
+}
+
+static void
+Eulers(double pdDCM[3][3], float pfEuler[3])
+{
+    float ppfDCM[3][3];
+    int i, j;
+
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            ppfDCM[i][j] = (float)pdDCM[i][j];
+        }
+    }
+    CompDCMComputeEulers(ppfDCM, pfEuler, pfEuler + 1, pfEuler + 2);
+}
+
+//*****************************************************************************
+//
+// The readings of the sensors and the true attitude of every sample of the
+// gyroscope columns of a log, and the boot calibration of the gyroscope in
+// pfBias, the mean of the first BIAS_SAMPLES readings as CalibrateIMU() takes
+// it before the bias drifts.
+//
+//*****************************************************************************
+static tStimulus *
+Stimulate(const tImuLog *psLog, float fDrift, float pfBias[3])
+{
+    uint32_t ui32Samples = psLog->psHeader->ui32Samples;
+    double dDeltaT = 1.0 / psLog->psHeader->fRate;
+    double pdTrue[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    double pdMean[3] = {0.0, 0.0, 0.0};
+    float pfField[3] = {MAG_FIELD * cosf(MAG_INCLINATION), 0.0f,
+                        MAG_FIELD * sinf(MAG_INCLINATION)};
+    uint32_t ui32Bias = ui32Samples < BIAS_SAMPLES ? ui32Samples :
+                        BIAS_SAMPLES;
+    int piColumn[3];
+    tStimulus *psStimuli;
+    uint32_t n;
+    int i;
+
+    piColumn[0] = ImuLogColumnFind(psLog, "gyro_x");
+    piColumn[1] = ImuLogColumnFind(psLog, "gyro_y");
+    piColumn[2] = ImuLogColumnFind(psLog, "gyro_z");
+    if ((piColumn[0] < 0) || (piColumn[1] < 0) || (piColumn[2] < 0))
+    {
+        fprintf(stderr, "%s: no gyro_x, gyro_y and gyro_z columns\n",
+                psLog->psHeader->pcSource);
+        return NULL;
+    }
+    psStimuli = malloc(ui32Samples * sizeof(tStimulus));
+    if (!psStimuli)
+    {
+        return NULL;
+    }
+
+    for (n = 0; n < ui32Bias; n++)
+    {
+        for (i = 0; i < 3; i++)
+        {
+            pdMean[i] += ImuLogValue(psLog, piColumn[i], n) / ui32Bias;
+        }
+    }
+
+    for (i = 0; i < 3; i++)
+    {
+        pfBias[i] = (float)(pdMean[i] / RAD_TO_DEG);
+    }
+
+    srand(1);
+    for (n = 0; n < ui32Samples; n++)
+    {
+        tStimulus *psStimulus = psStimuli + n;
+        double pdRate[3];
+
+        for (i = 0; i < 3; i++)
+        {
+            float fRate = ImuLogValue(psLog, piColumn[i], n);
+
+            pdRate[i] = (fRate - pdMean[i]) / RAD_TO_DEG;
+            psStimulus->pfGyro[i] = (fRate + fDrift) / (float)RAD_TO_DEG;
+        }
+        Rotate(pdTrue, pdRate, dDeltaT);
+        Eulers(pdTrue, psStimulus->pfEuler);
+
+        //
+        // The inverse of the correction of CompDCMAccelUpdate().
+        //
+        for (i = 0; i < 3; i++)
+        {
+            psStimulus->pfAccel[i] = GRAVITY * pdTrue[2][i] +
+                                     ACCEL_NOISE * Gaussian();
+            psStimulus->pfMagneto[i] = (pdTrue[0][i] * pfField[0] +
+                                        pdTrue[1][i] * pfField[1] +
+                                        pdTrue[2][i] * pfField[2]);
+        }
+        psStimulus->pfAccel[0] += 0.55f;
+        psStimulus->pfAccel[1] -= 0.1f;
+        psStimulus->pfAccel[2] = psStimulus->pfAccel[2] / 0.98f - 0.55f;
+    }
+    return psStimuli;
+}
+
+//*****************************************************************************
+//
+// Runs one filter over the stimuli.
+//
+//*****************************************************************************
+static void
+RunFilter(int iFilter, const tStimulus *psStimuli, uint32_t ui32Samples,
+          float fRate, const float pfBias[3], uint32_t *pui32Times,
+          tResult *psResult)
+{
+    static tCompDCM sDCM;
+    double pdDead[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    float fDeltaT = 1.0f / fRate;
+    float pfEuler[3];
+    double dTotalNs = 0.0;
+    uint64_t ui64Start, ui64Begin;
+    uint32_t n;
+    int i;
+
+    memset(&sDCM, 0, sizeof(sDCM));
+    CompDCMInit(&sDCM, fDeltaT, 0.0f, 0.0f, 0.0f);
+    if (iFilter != FILTER_GYRO)
+    {
+        CompDCMModeSet(&sDCM, iFilter);
+    }
+    for (i = 0; i < 3; i++)
+    {
+        sDCM.fGyroBias[i] = pfBias[i];
+    }
+    CompDCMMagnetoUpdate(&sDCM, psStimuli[0].pfMagneto[0],
+                         psStimuli[0].pfMagneto[1],
+                         psStimuli[0].pfMagneto[2]);
+    CompDCMAccelUpdate(&sDCM, psStimuli[0].pfAccel[0],
+                       psStimuli[0].pfAccel[1], psStimuli[0].pfAccel[2]);
+    CompDCMGyroUpdate(&sDCM, psStimuli[0].pfGyro[0], psStimuli[0].pfGyro[1],
+                      psStimuli[0].pfGyro[2]);
+    CompDCMStart(&sDCM);
+
+    memset(psResult, 0, sizeof(*psResult));
+    ui64Begin = Nanoseconds();
+    for (n = 1; n < ui32Samples; n++)
+    {
+        const tStimulus *psStimulus = psStimuli + n;
+
+        ui64Start = Nanoseconds();
+        if (iFilter == FILTER_GYRO)
+        {
+            double pdRate[3];
+            for (i = 0; i < 3; i++)
+            {
+                pdRate[i] = psStimulus->pfGyro[i] - pfBias[i];
+            }
+            Rotate(pdDead, pdRate, fDeltaT);
+        }
+        else
+        {
+            CompDCMAccelUpdate(&sDCM, psStimulus->pfAccel[0],
+                               psStimulus->pfAccel[1],
+                               psStimulus->pfAccel[2]);
+            CompDCMGyroUpdate(&sDCM, psStimulus->pfGyro[0],
+                              psStimulus->pfGyro[1], psStimulus->pfGyro[2]);
+            CompDCMUpdate(&sDCM);
+            if ((n % MAG_EVERY) == 0)
+            {
+                CompDCMMagnetoUpdate(&sDCM, psStimulus->pfMagneto[0],
+                                     psStimulus->pfMagneto[1],
+                                     psStimulus->pfMagneto[2]);
+                CompDCMMagnetoFuse(&sDCM, MAG_EVERY * fDeltaT);
+            }
+        }
+        pui32Times[n - 1] = (uint32_t)(Nanoseconds() - ui64Start);
+        dTotalNs += pui32Times[n - 1];
+
+        if (iFilter == FILTER_GYRO)
+        {
+            Eulers(pdDead, pfEuler);
+        }
+        else
+        {
+            CompDCMComputeEulers(sDCM.ppfDCM, pfEuler, pfEuler + 1,
+                                 pfEuler + 2);
+        }
+        for (i = 0; i < 3; i++)
+        {
+            double dError = fabs(Wrap(pfEuler[i] - psStimulus->pfEuler[i])) *
+                            RAD_TO_DEG;
+            psResult->pdFinal[i] = dError;
+            psResult->pdRms[i] += dError * dError;
+            if (dError > psResult->pdMax[i])
+            {
+                psResult->pdMax[i] = dError;
+            }
+        }
+    }
+    psResult->dSpeed = ((ui32Samples - 1) / fRate /
+                        ((Nanoseconds() - ui64Begin) * 1e-9));
+
+    for (i = 0; i < 3; i++)
+    {
+        psResult->pdRms[i] = sqrt(psResult->pdRms[i] / (ui32Samples - 1));
+    }
+    qsort(pui32Times, ui32Samples - 1, sizeof(uint32_t), CompareTimes);
+    psResult->dMeanNs = dTotalNs / (ui32Samples - 1);
+    psResult->dP99Ns = pui32Times[(ui32Samples - 1) * 99 / 100];
+    psResult->dMaxNs = pui32Times[ui32Samples - 2];
+}
+
+//*****************************************************************************
+//
+// Replays a log through every filter and prints what it found. Returns the
+// largest rms error of roll and pitch of the Mahony filter and the EKF, or
+// a negative value if the log cannot be replayed.
+//
+//*****************************************************************************
+static double
+Replay(const tImuLog *psLog, float fDrift)
+{
+    const tImuLogHeader *psHeader = psLog->psHeader;
+    uint32_t ui32Samples = psHeader->ui32Samples;
+    tStimulus *psStimuli;
+    uint32_t *pui32Times;
+    float pfBias[3];
+    double dWorst = 0.0;
+    tResult sResult;
+    int iFilter, i;
+
+    if (ui32Samples < 2)
+    {
+        fprintf(stderr, "%s: too short\n", psHeader->pcSource);
+        return -1.0;
+    }
+    psStimuli = Stimulate(psLog, fDrift, pfBias);
+    pui32Times = malloc(ui32Samples * sizeof(uint32_t));
+    if (!psStimuli || !pui32Times)
+    {
+        free(psStimuli);
+        free(pui32Times);
+        return -1.0;
+    }
+
+    printf("%s: %u samples at %.1f Hz, drift %.2f deg/s\n",
+           psHeader->pcSource, ui32Samples, psHeader->fRate, fDrift);
+    printf("  %-14s %-20s %-20s %-20s %-18s %s\n", "filter",
+           "final r/p/y (deg)", "rms r/p/y (deg)", "max r/p/y (deg)",
+           "ns mean/p99/max", "x real time");
+    for (iFilter = 0; iFilter < FILTERS; iFilter++)
+    {
+        RunFilter(iFilter, psStimuli, ui32Samples, psHeader->fRate, pfBias,
+                  pui32Times, &sResult);
+        printf("  %-14s %6.2f %6.2f %6.2f  %6.2f %6.2f %6.2f  "
+               "%6.2f %6.2f %6.2f  %5.0f %5.0f %6.0f  %8.0f\n",
+               g_ppcFilters[iFilter], sResult.pdFinal[0],
+               sResult.pdFinal[1], sResult.pdFinal[2], sResult.pdRms[0],
+               sResult.pdRms[1], sResult.pdRms[2], sResult.pdMax[0],
+               sResult.pdMax[1], sResult.pdMax[2], sResult.dMeanNs,
+               sResult.dP99Ns, sResult.dMaxNs, sResult.dSpeed);
+        if ((iFilter == COMP_DCM_MODE_MAHONY) ||
+            (iFilter == COMP_DCM_MODE_EKF))
+        {
+            for (i = 0; i < 2; i++)
+            {
+                if (sResult.pdRms[i] > dWorst)
+                {
+                    dWorst = sResult.pdRms[i];
+                }
+            }
+        }
+    }
+
+    free(psStimuli);
+    free(pui32Times);
+    return dWorst;
+}
+
+//*****************************************************************************
+//
+// Converts a capture in memory.
+//
+//*****************************************************************************
+static bool
+ConvertFile(const char *pcPath, float fRate, uint8_t **ppui8Image,
+            size_t *psSize)
+{
+    FILE *psText = fopen(pcPath, "r");
+    bool bOk;
+
+    if (!psText)
+    {
+        perror(pcPath);
+        return false;
+    }
+    bOk = ImuLogConvert(psText, pcPath, fRate, ppui8Image, psSize);
+    fclose(psText);
+    return bOk;
+}
+
+//*****************************************************************************
+//
+// The largest difference between the values of a log and of the text it was
+// made from, or a negative value if their number differs.
+//
+//*****************************************************************************
+static double
+RoundTrip(const tImuLog *psLog, const char *pcPath)
+{
+    FILE *psText = fopen(pcPath, "r");
+    uint32_t ui32Columns = psLog->psHeader->ui16Columns;
+    uint32_t n = 0, i = 0;
+    double dValue, dError = 0.0;
+
+    if (!psText)
+    {
+        perror(pcPath);
+        return -1.0;
+    }
+    while (fscanf(psText, "%lf", &dValue) == 1)
+    {
+        if (n >= psLog->psHeader->ui32Samples)
+        {
+            dError = -1.0;
+            break;
+        }
+        double dLog = ImuLogValue(psLog, i, n);
+        if (psLog->psHeader->psColumns[i].ui32Type == IMU_LOG_INT16)
+        {
+            //
+            // The count in double, as the float value has only 24 bits.
+            //
+            dLog = (double)((const int16_t *)(psLog->pui8Image +
+                             psLog->psHeader->psColumns[i].ui32Offset))[n] /
+                   psLog->psHeader->psColumns[i].fScale;
+        }
+        if (fabs(dLog - dValue) > dError)
+        {
+            dError = fabs(dLog - dValue);
+        }
+        if (++i == ui32Columns)
+        {
+            i = 0;
+            n++;
+        }
+    }
+    fclose(psText);
+    if ((dError >= 0.0) && ((i != 0) || (n != psLog->psHeader->ui32Samples)))
+    {
+        dError = -1.0;
+    }
+    return dError;
+}
+
+//*****************************************************************************
+//
+// Converts, checks and replays the captures.
+//
+//*****************************************************************************
+static int
+SelfCheck(void)
+{
+    char pcPath[] = "/tmp/replay_host_XXXXXX";
+    size_t sTextBytes = 0, sLogBytes = 0;
+    bool bOk = true;
+    size_t c;
+    int iFile;
+
+    if (sizeof(tImuLogHeader) != IMU_LOG_HEADER_SIZE)
+    {
+        printf("header of %zu bytes instead of %d\n", sizeof(tImuLogHeader),
+               IMU_LOG_HEADER_SIZE);
+        return 1;
+    }
+    iFile = mkstemp(pcPath);
+    if (iFile < 0)
+    {
+        perror(pcPath);
+        return 1;
+    }
+    close(iFile);
+
+    for (c = 0; c < sizeof(g_ppcCaptures) / sizeof(g_ppcCaptures[0]); c++)
+    {
+        char pcCapture[256];
+        uint8_t *pui8Image;
+        size_t sSize;
+        tImuLog sMemory, sMapped;
+        double dError, dWorst;
+        FILE *psText;
+
+        snprintf(pcCapture, sizeof(pcCapture), "%s%s", CAPTURES,
+                 g_ppcCaptures[c]);
+        if (!ConvertFile(pcCapture, DEFAULT_RATE, &pui8Image, &sSize))
+        {
+            bOk = false;
+            continue;
+        }
+        if (!ImuLogAttach(&sMemory, pui8Image, sSize))
+        {
+            printf("%s: the converted log does not attach\n", pcCapture);
+            free(pui8Image);
+            bOk = false;
+            continue;
+        }
+
+        //
+        // Every value of the text comes back.
+        //
+        dError = RoundTrip(&sMemory, pcCapture);
+        printf("%s: %s, %u x %u, %.3g LSB/unit, %zu bytes, largest "
+               "difference %.2g\n", g_ppcCaptures[c],
+               sMemory.psHeader->psColumns[0].ui32Type == IMU_LOG_INT16 ?
+               "int16" : "float32", sMemory.psHeader->ui32Samples,
+               sMemory.psHeader->ui16Columns,
+               sMemory.psHeader->psColumns[0].fScale, sSize, dError);
+        if ((dError < 0.0) || (dError > IMU_LOG_TEXT_RESOLUTION + 1e-9))
+        {
+            printf("  the log does not match the text\n");
+            bOk = false;
+        }
+        psText = fopen(pcCapture, "r");
+        if (psText)
+        {
+            fseek(psText, 0, SEEK_END);
+            sTextBytes += ftell(psText);
+            fclose(psText);
+        }
+        sLogBytes += sSize;
+
+        //
+        // The mapped file is the image, and is what gets replayed.
+        //
+        if (!ImuLogWrite(pcPath, pui8Image, sSize) ||
+            !ImuLogOpen(&sMapped, pcPath))
+        {
+            free(pui8Image);
+            bOk = false;
+            continue;
+        }
+        if ((sMapped.sSize != sSize) ||
+            memcmp(sMapped.pui8Image, pui8Image, sSize))
+        {
+            printf("  the mapped log differs\n");
+            bOk = false;
+        }
+        dWorst = Replay(&sMapped, DEFAULT_DRIFT);
+        if ((dWorst < 0.0) || (dWorst > MAX_ATT_ERROR))
+        {
+            printf("  roll or pitch error %.2f deg above %.1f deg\n", dWorst,
+                   MAX_ATT_ERROR);
+            bOk = false;
+        }
+        ImuLogClose(&sMapped);
+        free(pui8Image);
+    }
+    unlink(pcPath);
+
+    printf("%zu bytes of text in %zu bytes of logs\n", sTextBytes, sLogBytes);
+    printf(bOk ? "replay all passed\n" : "replay FAILED\n");
+    return bOk ? 0 : 1;
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *pcOut = NULL;
+    float fRate = DEFAULT_RATE;
+    float fDrift = DEFAULT_DRIFT;
+    bool bOk = true;
+    int iOpt;
+
+    while ((iOpt = getopt(argc, argv, "o:r:d:")) != -1)
+    {
+        switch (iOpt)
+        {
+            case 'o':
+                pcOut = optarg;
+                break;
+            case 'r':
+                fRate = atof(optarg);
+                break;
+            case 'd':
+                fDrift = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s -o log.imu [-r rate_hz] "
+                        "capture.txt\n       %s [-d drift_deg_s] "
+                        "log.imu|capture.txt ...\n", argv[0], argv[0]);
+                return 2;
+        }
+    }
+    if (optind == argc)
+    {
+        return SelfCheck();
+    }
+
+    //
+    // Conversion.
+    //
+    if (pcOut)
+    {
+        uint8_t *pui8Image;
+        size_t sSize;
+
+        if ((optind + 1 != argc) || !(fRate > 0.0f))
+        {
+            fprintf(stderr, "%s: one capture and a positive rate\n", argv[0]);
+            return 2;
+        }
+        if (!ConvertFile(argv[optind], fRate, &pui8Image, &sSize))
+        {
+            return 1;
+        }
+        bOk = ImuLogWrite(pcOut, pui8Image, sSize);
+        free(pui8Image);
+        return bOk ? 0 : 1;
+    }
+
+    //
+    // Replay of logs, and of captures converted on the way.
+    //
+    for (; optind < argc; optind++)
+    {
+        tImuLog sLog;
+        uint8_t *pui8Image = NULL;
+        size_t sSize;
+        FILE *psFile = fopen(argv[optind], "rb");
+        char pcMagic[4] = {0};
+
+        if (!psFile)
+        {
+            perror(argv[optind]);
+            bOk = false;
+            continue;
+        }
+        if (fread(pcMagic, 1, 4, psFile) != 4)
+        {
+            pcMagic[0] = 0;
+        }
+        fclose(psFile);
+
+        if (!memcmp(pcMagic, IMU_LOG_MAGIC, 4))
+        {
+            if (!ImuLogOpen(&sLog, argv[optind]))
+            {
+                bOk = false;
+                continue;
+            }
+        }
+        else if (!ConvertFile(argv[optind], fRate, &pui8Image, &sSize) ||
+                 !ImuLogAttach(&sLog, pui8Image, sSize))
+        {
+            free(pui8Image);
+            bOk = false;
+            continue;
+        }
+        if (Replay(&sLog, fDrift) < 0.0)
+        {
+            bOk = false;
+        }
+        ImuLogClose(&sLog);
+        free(pui8Image);
+    }
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,337 @@
+//*****************************************************************************
+//
+// sensor_model.c - Errors of the MPU9150 accelerometer and gyroscope.
+//
+// Turns the true angular rate and specific force in the body frame into
+// readings of the sensor, in this order:
+//
+// - misalignment: each axis also senses the others, by a matrix I + E with
+//   the off-diagonal entries of E drawn per sensor,
+// - the low pass filter of DLPF_CFG as a first order filter whose group
+//   delay at low frequencies is the one of the register map,
+// - a bias drawn at power on that then walks randomly,
+// - white noise of the given density, sampled at the reading period,
+// - rounding to the LSB of FS_SEL and AFS_SEL and saturation at the full
+//   scale, unless the caller quantizes itself as the register model of
+//   simul/mpu9150_model does.
+//
+// The default noise is the one simul/allan/allan_host.c measured on
+// gyro_data_static.txt for the gyroscope and the density of the datasheet
+// for the accelerometer. The module uses no TivaWare headers.
+//
+//*****************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "sensor_model.h"
+
+//*****************************************************************************
+//
+// Fields of the CONFIG, GYRO_CONFIG and ACCEL_CONFIG registers.
+//
+//*****************************************************************************
+#define SENSOR_DLPF_CFG_M           0x07
+#define SENSOR_FS_SEL_M             0x18
+#define SENSOR_FS_SEL_S             3
+
+//*****************************************************************************
+//
+// Sensitivities of the ranges, LSB per g and LSB per deg/s, and the group
+// delay of the low pass filter per DLPF_CFG in s. DLPF_CFG 7 is reserved
+// and runs as 0.
+//
+//*****************************************************************************
+static const float g_pfAccelLsb[4] = { 16384.0f, 8192.0f, 4096.0f, 2048.0f };
+static const float g_pfGyroLsb[4] = { 131.0f, 65.5f, 32.8f, 16.4f };
+static const float g_pfGyroDelay[8] =
+{
+    0.00098f, 0.0019f, 0.0028f, 0.0048f, 0.0083f, 0.0134f, 0.0186f, 0.00098f
+};
+static const float g_pfAccelDelay[8] =
+{
+    0.0f, 0.002f, 0.003f, 0.0049f, 0.0085f, 0.0138f, 0.019f, 0.0f
+};
+#define SENSOR_G                    9.80665f
+#define SENSOR_RAD_TO_DEG           57.2957795f
+#define SENSOR_PI                   3.14159265f
+
+//*****************************************************************************
+//
+// Normal variates per step: the noise and the walk of each axis of both
+// sensors.
+//
+//*****************************************************************************
+#define SENSOR_NORMALS              12
+
+//*****************************************************************************
+//
+// One uniform in (0, 1] per lane, from the xorshift generator of the lane.
+//
+//*****************************************************************************
+static void
+SensorModelUniform(tSensorModel *psModel, float *pfOut)
+{
+    uint32_t ui32Lane;
+
+    for (ui32Lane = 0; ui32Lane < psModel->ui32Lanes; ui32Lane++)
+    {
+        uint32_t ui32X = psModel->pui32Random[ui32Lane];
+
+        ui32X ^= ui32X << 13;
+        ui32X ^= ui32X >> 17;
+        ui32X ^= ui32X << 5;
+        psModel->pui32Random[ui32Lane] = ui32X;
+        pfOut[ui32Lane] = (float)((ui32X >> 8) + 1) / 16777216.0f;
+    }
+}
+
+//*****************************************************************************
+//
+// ui32Count standard normal variates per lane, a multiple of two, by the
+// Box-Muller transform.
+//
+//*****************************************************************************
+static void
+SensorModelNormal(tSensorModel *psModel, uint32_t ui32Count,
+                  float ppfOut[][SENSOR_MODEL_MAX_LANES])
+{
+    float pfU[SENSOR_MODEL_MAX_LANES], pfV[SENSOR_MODEL_MAX_LANES];
+    uint32_t ui32Pair, ui32Lane;
+
+    for (ui32Pair = 0; ui32Pair < ui32Count; ui32Pair += 2)
+    {
+        SensorModelUniform(psModel, pfU);
+        SensorModelUniform(psModel, pfV);
+        for (ui32Lane = 0; ui32Lane < psModel->ui32Lanes; ui32Lane++)
+        {
+            float fR = sqrtf(-2.0f * logf(pfU[ui32Lane]));
+            float fTheta = 2.0f * SENSOR_PI * pfV[ui32Lane];
+
+            ppfOut[ui32Pair][ui32Lane] = fR * cosf(fTheta);
+            ppfOut[ui32Pair + 1][ui32Lane] = fR * sinf(fTheta);
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// The measured noise of the gyroscope, the noise of the accelerometer from
+// the datasheet (400 ug/sqrt(Hz)), and typical biases and cross-axis
+// sensitivity of 1 %. The walk of the accelerometer bias is an assumption,
+// the one of the gyroscope the bound that the 37.5 s capture gives.
+//
+//*****************************************************************************
+void
+SensorModelNoiseDefault(tSensorNoise *psNoise)
+{
+    static const float pfGyroNoise[3] = { 1.04e-4f, 1.14e-4f, 7.63e-4f };
+    static const float pfGyroWalk[3] = { 4.8e-5f, 2.0e-5f, 8.4e-5f };
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        psNoise->pfGyroNoise[i] = pfGyroNoise[i];
+        psNoise->pfGyroWalk[i] = pfGyroWalk[i];
+        psNoise->pfAccelNoise[i] = 400e-6f * SENSOR_G;
+        psNoise->pfAccelWalk[i] = 2e-4f;
+    }
+    psNoise->fGyroBias = 0.01f;
+    psNoise->fAccelBias = 0.1f;
+    psNoise->fMisalignment = 0.01f;
+    psNoise->bQuantize = true;
+}
+
+//*****************************************************************************
+//
+// Draws the biases and misalignments of ui32Lanes sensors from the seed and
+// configures them as the flight controller does at boot: DLPF_CFG 2 (94 Hz
+// and 98 Hz), +/-250 deg/s and +/-2 g.
+//
+//*****************************************************************************
+void
+SensorModelInit(tSensorModel *psModel, const tSensorNoise *psNoise,
+                uint32_t ui32Lanes, uint32_t ui32Seed)
+{
+    float ppfNormal[18][SENSOR_MODEL_MAX_LANES];
+    uint32_t ui32Lane;
+    int i, j;
+
+    memset(psModel, 0, sizeof(*psModel));
+    psModel->sNoise = *psNoise;
+    psModel->ui32Lanes = (ui32Lanes > SENSOR_MODEL_MAX_LANES ?
+                          SENSOR_MODEL_MAX_LANES : ui32Lanes);
+
+    //
+    // Every lane gets its own sequence, and no generator may start at 0.
+    //
+    for (ui32Lane = 0; ui32Lane < psModel->ui32Lanes; ui32Lane++)
+    {
+        uint32_t ui32X = (ui32Seed + ui32Lane) * 2654435761u;
+        psModel->pui32Random[ui32Lane] = ui32X ? ui32X : 1;
+    }
+
+    //
+    // Biases, then the six off-diagonal entries of each misalignment.
+    //
+    SensorModelNormal(psModel, 18, ppfNormal);
+    for (ui32Lane = 0; ui32Lane < psModel->ui32Lanes; ui32Lane++)
+    {
+        int iNext = 6;
+
+        for (i = 0; i < 3; i++)
+        {
+            psModel->ppfGyroBias[i][ui32Lane] = (psNoise->fGyroBias *
+                                                 ppfNormal[i][ui32Lane]);
+            psModel->ppfAccelBias[i][ui32Lane] = (psNoise->fAccelBias *
+                                                  ppfNormal[i + 3][ui32Lane]);
+            for (j = 0; j < 3; j++)
+            {
+                if (i == j)
+                {
+                    psModel->ppfGyroAlign[3 * i + j][ui32Lane] = 1.0f;
+                    psModel->ppfAccelAlign[3 * i + j][ui32Lane] = 1.0f;
+                    continue;
+                }
+                psModel->ppfGyroAlign[3 * i + j][ui32Lane] =
+                    psNoise->fMisalignment * ppfNormal[iNext][ui32Lane];
+                psModel->ppfAccelAlign[3 * i + j][ui32Lane] =
+                    psNoise->fMisalignment * ppfNormal[iNext + 6][ui32Lane];
+                iNext++;
+            }
+        }
+    }
+
+    SensorModelConfigure(psModel, 0x02, 0x00, 0x00);
+}
+
+//*****************************************************************************
+//
+// Takes the ranges and the low pass filter from the values written to the
+// CONFIG, GYRO_CONFIG and ACCEL_CONFIG registers.
+//
+//*****************************************************************************
+void
+SensorModelConfigure(tSensorModel *psModel, uint8_t ui8Config,
+                     uint8_t ui8GyroConfig, uint8_t ui8AccelConfig)
+{
+    uint8_t ui8Dlpf = ui8Config & SENSOR_DLPF_CFG_M;
+    uint8_t ui8Fs = (ui8GyroConfig & SENSOR_FS_SEL_M) >> SENSOR_FS_SEL_S;
+    uint8_t ui8Afs = (ui8AccelConfig & SENSOR_FS_SEL_M) >> SENSOR_FS_SEL_S;
+
+    psModel->fGyroLsb = g_pfGyroLsb[ui8Fs] * SENSOR_RAD_TO_DEG;
+    psModel->fAccelLsb = g_pfAccelLsb[ui8Afs] / SENSOR_G;
+    psModel->fGyroDelay = g_pfGyroDelay[ui8Dlpf];
+    psModel->fAccelDelay = g_pfAccelDelay[ui8Dlpf];
+}
+
+//*****************************************************************************
+//
+// Rounds to the LSB and saturates at the full scale of the range. Returns
+// the number of saturated readings.
+//
+//*****************************************************************************
+static uint32_t
+SensorModelQuantize(float *pfValue, uint32_t ui32Count, float fLsb)
+{
+    uint32_t ui32Saturated = 0, i;
+
+    for (i = 0; i < ui32Count; i++)
+    {
+        float fCount = floorf(pfValue[i] * fLsb + 0.5f);
+
+        ui32Saturated += (fCount > 32767.0f) | (fCount < -32768.0f);
+        fCount = fminf(fmaxf(fCount, -32768.0f), 32767.0f);
+        pfValue[i] = fCount / fLsb;
+    }
+    return ui32Saturated;
+}
+
+//*****************************************************************************
+//
+// One axis of one sensor over all lanes: misalignment, filter, bias and
+// noise.
+//
+//*****************************************************************************
+static void
+SensorModelAxis(uint32_t ui32Lanes, const float *pfIn,
+                float ppfAlign[9][SENSOR_MODEL_MAX_LANES], int iAxis,
+                float *pfFilter, float fAlpha, float *pfBias, float fWalk,
+                const float *pfWalkNormal, float fNoise,
+                const float *pfNoiseNormal, float *pfOut)
+{
+    const float *pfRow0 = ppfAlign[3 * iAxis];
+    const float *pfRow1 = ppfAlign[3 * iAxis + 1];
+    const float *pfRow2 = ppfAlign[3 * iAxis + 2];
+    uint32_t ui32Lane;
+
+    for (ui32Lane = 0; ui32Lane < ui32Lanes; ui32Lane++)
+    {
+        float fSensed = (pfRow0[ui32Lane] * pfIn[ui32Lane] +
+                         pfRow1[ui32Lane] * pfIn[ui32Lanes + ui32Lane] +
+                         pfRow2[ui32Lane] * pfIn[2 * ui32Lanes + ui32Lane]);
+
+        pfFilter[ui32Lane] += fAlpha * (fSensed - pfFilter[ui32Lane]);
+        pfBias[ui32Lane] += fWalk * pfWalkNormal[ui32Lane];
+        pfOut[ui32Lane] = (pfFilter[ui32Lane] + pfBias[ui32Lane] +
+                           fNoise * pfNoiseNormal[ui32Lane]);
+    }
+}
+
+//*****************************************************************************
+//
+// Takes a reading of every lane, fDeltaT s after the previous one. The
+// inputs and outputs are stored per axis with the lanes next to each other:
+// the x axis of all lanes, then y, then z. The rates are in rad/s, the
+// specific force in m/s^2.
+//
+//*****************************************************************************
+void
+SensorModelSample(tSensorModel *psModel, float fDeltaT, const float *pfRate,
+                  const float *pfForce, float *pfGyro, float *pfAccel)
+{
+    float ppfNormal[SENSOR_NORMALS][SENSOR_MODEL_MAX_LANES];
+    tSensorNoise *psNoise = &psModel->sNoise;
+    uint32_t ui32Lanes = psModel->ui32Lanes;
+    float fSqrtDt = sqrtf(fDeltaT);
+    float fGyroAlpha = 1.0f, fAccelAlpha = 1.0f;
+    int i;
+
+    //
+    // The filters start at the first reading. A step of the filter delays
+    // slow signals by (1 - alpha) / alpha readings, which gives its gain.
+    //
+    if (psModel->bPrimed)
+    {
+        fGyroAlpha = fDeltaT / (fDeltaT + psModel->fGyroDelay);
+        fAccelAlpha = fDeltaT / (fDeltaT + psModel->fAccelDelay);
+    }
+    psModel->bPrimed = true;
+
+    SensorModelNormal(psModel, SENSOR_NORMALS, ppfNormal);
+    for (i = 0; i < 3; i++)
+    {
+        SensorModelAxis(ui32Lanes, pfRate, psModel->ppfGyroAlign, i,
+                        psModel->ppfGyroFilter[i], fGyroAlpha,
+                        psModel->ppfGyroBias[i],
+                        psNoise->pfGyroWalk[i] * fSqrtDt, ppfNormal[i],
+                        psNoise->pfGyroNoise[i] / fSqrtDt, ppfNormal[i + 3],
+                        pfGyro + i * ui32Lanes);
+        SensorModelAxis(ui32Lanes, pfForce, psModel->ppfAccelAlign, i,
+                        psModel->ppfAccelFilter[i], fAccelAlpha,
+                        psModel->ppfAccelBias[i],
+                        psNoise->pfAccelWalk[i] * fSqrtDt, ppfNormal[i + 6],
+                        psNoise->pfAccelNoise[i] / fSqrtDt, ppfNormal[i + 9],
+                        pfAccel + i * ui32Lanes);
+    }
+
+    if (psNoise->bQuantize)
+    {
+        psModel->ui32Saturated += SensorModelQuantize(pfGyro, 3 * ui32Lanes,
+                                                      psModel->fGyroLsb);
+        psModel->ui32Saturated += SensorModelQuantize(pfAccel,
+                                                      3 * ui32Lanes,
+                                                      psModel->fAccelLsb);
+    }
+}
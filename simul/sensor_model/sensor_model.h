@@ -0,0 +1,100 @@
+//*****************************************************************************
+//
+// sensor_model.h - Errors of the MPU9150 accelerometer and gyroscope.
+//
+//*****************************************************************************
+
+#ifndef _SENSOR_MODEL_H_
+#define _SENSOR_MODEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//*****************************************************************************
+//
+// Largest number of sensors simulated side by side, for Monte Carlo runs.
+//
+//*****************************************************************************
+#define SENSOR_MODEL_MAX_LANES      256
+
+//*****************************************************************************
+//
+// The errors of the sensor, per axis where the axes differ: the white noise
+// as a density, the random walk of the bias, the standard deviation of the
+// bias at power on and of the misalignment of an axis towards another one,
+// and whether readings are rounded to the LSB of the range and saturate at
+// its full scale. The defaults of SensorModelNoiseDefault() are measured.
+//
+//*****************************************************************************
+typedef struct
+{
+    float pfGyroNoise[3];       // rad/s/sqrt(Hz)
+    float pfGyroWalk[3];        // rad/s^2/sqrt(Hz)
+    float fGyroBias;            // rad/s
+    float pfAccelNoise[3];      // m/s^2/sqrt(Hz)
+    float pfAccelWalk[3];       // m/s^3/sqrt(Hz)
+    float fAccelBias;           // m/s^2
+    float fMisalignment;        // rad
+    bool bQuantize;
+}
+tSensorNoise;
+
+//*****************************************************************************
+//
+// The model of ui32Lanes sensors. The configuration follows the registers
+// of SensorModelConfigure(); the state is stored per axis with the lanes
+// next to each other, so that each step is a loop over the lanes that the
+// compiler vectorizes.
+//
+//*****************************************************************************
+typedef struct
+{
+    tSensorNoise sNoise;
+    uint32_t ui32Lanes;
+
+    //
+    // From the registers: LSB per rad/s and per m/s^2, and the group delay
+    // of the low pass filter in s.
+    //
+    float fGyroLsb;
+    float fAccelLsb;
+    float fGyroDelay;
+    float fAccelDelay;
+
+    //
+    // Per lane: the biases, the outputs of the low pass filters, the
+    // misalignment matrices row by row and the state of the noise generator.
+    //
+    float ppfGyroBias[3][SENSOR_MODEL_MAX_LANES];
+    float ppfAccelBias[3][SENSOR_MODEL_MAX_LANES];
+    float ppfGyroFilter[3][SENSOR_MODEL_MAX_LANES];
+    float ppfAccelFilter[3][SENSOR_MODEL_MAX_LANES];
+    float ppfGyroAlign[9][SENSOR_MODEL_MAX_LANES];
+    float ppfAccelAlign[9][SENSOR_MODEL_MAX_LANES];
+    uint32_t pui32Random[SENSOR_MODEL_MAX_LANES];
+    bool bPrimed;
+
+    //
+    // Readings that saturated.
+    //
+    uint32_t ui32Saturated;
+}
+tSensorModel;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern void SensorModelNoiseDefault(tSensorNoise *psNoise);
+extern void SensorModelInit(tSensorModel *psModel,
+                            const tSensorNoise *psNoise, uint32_t ui32Lanes,
+                            uint32_t ui32Seed);
+extern void SensorModelConfigure(tSensorModel *psModel, uint8_t ui8Config,
+                                 uint8_t ui8GyroConfig,
+                                 uint8_t ui8AccelConfig);
+extern void SensorModelSample(tSensorModel *psModel, float fDeltaT,
+                              const float *pfRate, const float *pfForce,
+                              float *pfGyro, float *pfAccel);
+
+#endif // _SENSOR_MODEL_H_
@@ -0,0 +1,412 @@
+//*****************************************************************************
+//
+// sensor_model_host.c - Checks of sensor_model.c and a Monte Carlo run of
+// the gyroscope drift.
+//
+// The model is configured with the register values of ConfigureMPU6050()
+// in main.c and each error is checked alone:
+//
+// - the white noise has the standard deviation its density gives at the
+//   sample rate,
+// - the bias walks with the variance its density gives,
+// - the low pass filter delays a slow sine by the group delay of the
+//   register map,
+// - readings are multiples of the LSB and saturate at the full scale,
+// - the misalignment couples the axes by its standard deviation,
+//
+// each within a tolerance for the SENSOR_MODEL_MAX_LANES lanes. Then
+// MC_RUNS boards with the default errors rest for MC_SECONDS after a boot
+// calibration over the first MC_CALIBRATION samples, and the spread of the
+// yaw of the integrated rates is printed, with the time of a reading for
+// one lane and per lane of a full batch.
+//
+// Build and run from this directory (the compile command is one line):
+//
+//   cc -O3 -I../mpu9150_model -o sensor_model_host sensor_model_host.c
+//      sensor_model.c -lm
+//   ./sensor_model_host
+//
+//*****************************************************************************
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sensorlib/hw_mpu9150.h"
+#include "sensor_model.h"
+
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+#define LANES                   SENSOR_MODEL_MAX_LANES
+#define LOOP_RATE               250.0f   // Hz, of the flight controller
+#define NOISE_SAMPLES           2000
+#define WALK_SECONDS            10.0f
+#define DELAY_RATE              1000.0f  // Hz
+#define DELAY_HZ                2.0f
+#define DELAY_SECONDS           5.0f
+#define TOLERANCE               0.2
+#define MC_RUNS                 1024
+#define MC_SECONDS              60.0f
+#define MC_CALIBRATION          500
+#define BENCH_SAMPLES           20000
+
+//*****************************************************************************
+//
+// A model with only the errors the check sets.
+//
+//*****************************************************************************
+static void
+Quiet(tSensorNoise *psNoise)
+{
+    memset(psNoise, 0, sizeof(*psNoise));
+}
+
+static void
+Configure(tSensorModel *psModel)
+{
+    SensorModelConfigure(psModel, MPU9150_CONFIG_DLPF_CFG_94_98,
+                         MPU9150_GYRO_CONFIG_FS_SEL_250,
+                         MPU9150_ACCEL_CONFIG_AFS_SEL_2G);
+}
+
+static bool
+Within(const char *pcName, double dValue, double dExpected,
+       double dTolerance)
+{
+    bool bOk = fabs(dValue / dExpected - 1.0) <= dTolerance;
+
+    printf("  %-34s %11.4g, expected %11.4g %s\n", pcName, dValue, dExpected,
+           bOk ? "" : "FAILED");
+    return bOk;
+}
+
+static double
+Nanoseconds(void)
+{
+    struct timespec sTime;
+
+    clock_gettime(CLOCK_MONOTONIC, &sTime);
+    return sTime.tv_sec * 1e9 + sTime.tv_nsec;
+}
+
+//*****************************************************************************
+//
+// Standard deviation of the first ui32Count values.
+//
+//*****************************************************************************
+static double
+Deviation(const float *pfValues, uint32_t ui32Count)
+{
+    double dSum = 0.0, dSquares = 0.0;
+    uint32_t i;
+
+    for (i = 0; i < ui32Count; i++)
+    {
+        dSum += pfValues[i];
+        dSquares += (double)pfValues[i] * pfValues[i];
+    }
+    dSum /= ui32Count;
+    return sqrt(dSquares / ui32Count - dSum * dSum);
+}
+
+//*****************************************************************************
+//
+// White noise: the deviation of the x gyroscope and accelerometer readings
+// of all lanes over NOISE_SAMPLES.
+//
+//*****************************************************************************
+static bool
+CheckNoise(tSensorModel *psModel)
+{
+    static float pfGyroX[NOISE_SAMPLES * LANES];
+    static float pfAccelX[NOISE_SAMPLES * LANES];
+    float pfZero[3 * LANES], pfGyro[3 * LANES], pfAccel[3 * LANES];
+    tSensorNoise sNoise;
+    uint32_t n;
+    bool bOk;
+
+    Quiet(&sNoise);
+    sNoise.pfGyroNoise[0] = 1e-4f;
+    sNoise.pfAccelNoise[0] = 4e-3f;
+    SensorModelInit(psModel, &sNoise, LANES, 1);
+    Configure(psModel);
+    memset(pfZero, 0, sizeof(pfZero));
+    for (n = 0; n < NOISE_SAMPLES; n++)
+    {
+        SensorModelSample(psModel, 1.0f / LOOP_RATE, pfZero, pfZero, pfGyro,
+                          pfAccel);
+        memcpy(pfGyroX + n * LANES, pfGyro, LANES * sizeof(float));
+        memcpy(pfAccelX + n * LANES, pfAccel, LANES * sizeof(float));
+    }
+    bOk = Within("gyro noise (rad/s)", Deviation(pfGyroX, n * LANES),
+                 1e-4 * sqrt(LOOP_RATE), 0.03);
+    bOk &= Within("accel noise (m/s^2)", Deviation(pfAccelX, n * LANES),
+                  4e-3 * sqrt(LOOP_RATE), 0.03);
+    return bOk;
+}
+
+//*****************************************************************************
+//
+// Bias walk: the deviation over the lanes of the z gyroscope reading after
+// WALK_SECONDS.
+//
+//*****************************************************************************
+static bool
+CheckWalk(tSensorModel *psModel)
+{
+    float pfZero[3 * LANES], pfGyro[3 * LANES], pfAccel[3 * LANES];
+    tSensorNoise sNoise;
+    uint32_t n;
+
+    Quiet(&sNoise);
+    sNoise.pfGyroWalk[2] = 5e-5f;
+    SensorModelInit(psModel, &sNoise, LANES, 2);
+    Configure(psModel);
+    memset(pfZero, 0, sizeof(pfZero));
+    for (n = 0; n < WALK_SECONDS * LOOP_RATE; n++)
+    {
+        SensorModelSample(psModel, 1.0f / LOOP_RATE, pfZero, pfZero, pfGyro,
+                          pfAccel);
+    }
+    return Within("gyro bias walk (rad/s)", Deviation(pfGyro + 2 * LANES,
+                                                      LANES),
+                  5e-5 * sqrt(WALK_SECONDS), TOLERANCE);
+}
+
+//*****************************************************************************
+//
+// Group delay: the phase of the response to a slow sine, from its
+// correlation with the sine and the cosine over whole periods.
+//
+//*****************************************************************************
+static bool
+CheckDelay(tSensorModel *psModel)
+{
+    float pfIn[3], pfGyro[3], pfAccel[3];
+    double dGyroSin = 0.0, dGyroCos = 0.0, dAccelSin = 0.0, dAccelCos = 0.0;
+    double dOmega = 2.0 * M_PI * DELAY_HZ;
+    tSensorNoise sNoise;
+    uint32_t n;
+    bool bOk;
+
+    Quiet(&sNoise);
+    SensorModelInit(psModel, &sNoise, 1, 3);
+    Configure(psModel);
+    for (n = 0; n < DELAY_SECONDS * DELAY_RATE; n++)
+    {
+        double dTime = n / DELAY_RATE;
+
+        pfIn[0] = pfIn[1] = pfIn[2] = (float)sin(dOmega * dTime);
+        SensorModelSample(psModel, 1.0f / DELAY_RATE, pfIn, pfIn, pfGyro,
+                          pfAccel);
+
+        //
+        // The last second, after the filter settled.
+        //
+        if (dTime >= DELAY_SECONDS - 1.0f)
+        {
+            dGyroSin += pfGyro[0] * sin(dOmega * dTime);
+            dGyroCos += pfGyro[0] * cos(dOmega * dTime);
+            dAccelSin += pfAccel[0] * sin(dOmega * dTime);
+            dAccelCos += pfAccel[0] * cos(dOmega * dTime);
+        }
+    }
+
+    bOk = Within("gyro DLPF delay (s)", -atan2(dGyroCos, dGyroSin) / dOmega,
+                 0.0028, 0.05);
+    bOk &= Within("accel DLPF delay (s)",
+                  -atan2(dAccelCos, dAccelSin) / dOmega, 0.003, 0.05);
+    return bOk;
+}
+
+//*****************************************************************************
+//
+// Quantization and saturation at +/-250 deg/s and +/-2 g.
+//
+//*****************************************************************************
+static bool
+CheckQuantize(tSensorModel *psModel)
+{
+    float pfRate[3] = { 0.1f, -5.0f, 0.0f };
+    float pfForce[3] = { 1.0f, 9.81f, -30.0f };
+    float pfGyro[3], pfAccel[3];
+    double dCount;
+    tSensorNoise sNoise;
+    bool bOk;
+
+    Quiet(&sNoise);
+    sNoise.bQuantize = true;
+    SensorModelInit(psModel, &sNoise, 1, 4);
+    Configure(psModel);
+    SensorModelSample(psModel, 1.0f / LOOP_RATE, pfRate, pfForce, pfGyro,
+                      pfAccel);
+
+    dCount = pfGyro[0] * 131.0 * 180.0 / M_PI;
+    bOk = fabs(dCount - floor(dCount + 0.5)) < 1e-3;
+    dCount = pfAccel[1] * 16384.0 / 9.80665;
+    bOk &= fabs(dCount - floor(dCount + 0.5)) < 1e-3;
+    printf("  %-34s %11.4f %11.4f %s\n", "readings in LSB", pfGyro[0] * 131.0 *
+           180.0 / M_PI, pfAccel[1] * 16384.0 / 9.80665, bOk ? "" : "FAILED");
+    bOk &= Within("saturated gyro (deg/s)", pfGyro[1] * 180.0 / M_PI,
+                  -32768.0 / 131.0, 1e-5);
+    bOk &= Within("saturated accel (g)", pfAccel[2] / 9.80665,
+                  -32768.0 / 16384.0, 1e-5);
+    if (psModel->ui32Saturated != 2)
+    {
+        printf("  %u saturated readings instead of 2 FAILED\n",
+               psModel->ui32Saturated);
+        bOk = false;
+    }
+    return bOk;
+}
+
+//*****************************************************************************
+//
+// Misalignment: a rate about x shows on y and z of each lane.
+//
+//*****************************************************************************
+static bool
+CheckMisalignment(tSensorModel *psModel)
+{
+    float pfRate[3 * LANES], pfGyro[3 * LANES], pfAccel[3 * LANES];
+    tSensorNoise sNoise;
+    uint32_t n;
+
+    Quiet(&sNoise);
+    sNoise.fMisalignment = 0.01f;
+    SensorModelInit(psModel, &sNoise, LANES, 5);
+    Configure(psModel);
+    for (n = 0; n < LANES; n++)
+    {
+        pfRate[n] = 1.0f;
+        pfRate[LANES + n] = 0.0f;
+        pfRate[2 * LANES + n] = 0.0f;
+    }
+    SensorModelSample(psModel, 1.0f / LOOP_RATE, pfRate, pfRate, pfGyro,
+                      pfAccel);
+    return Within("misalignment (rad)", Deviation(pfGyro + LANES, 2 * LANES),
+                  0.01, TOLERANCE);
+}
+
+//*****************************************************************************
+//
+// MC_RUNS boards at rest with the default errors, in batches of the lanes.
+// Stores the yaw of each after MC_SECONDS in deg.
+//
+//*****************************************************************************
+static void
+MonteCarlo(tSensorModel *psModel, double *pdYaw)
+{
+    float pfRate[3 * LANES], pfForce[3 * LANES];
+    float pfGyro[3 * LANES], pfAccel[3 * LANES];
+    double pdBias[LANES];
+    tSensorNoise sNoise;
+    uint32_t ui32Batch, n, l;
+
+    SensorModelNoiseDefault(&sNoise);
+    for (l = 0; l < LANES; l++)
+    {
+        pfRate[l] = pfRate[LANES + l] = pfRate[2 * LANES + l] = 0.0f;
+        pfForce[l] = pfForce[LANES + l] = 0.0f;
+        pfForce[2 * LANES + l] = 9.81f;
+    }
+    for (ui32Batch = 0; ui32Batch < MC_RUNS / LANES; ui32Batch++)
+    {
+        double *pdBatch = pdYaw + ui32Batch * LANES;
+
+        SensorModelInit(psModel, &sNoise, LANES, 100 + ui32Batch * LANES);
+        Configure(psModel);
+        memset(pdBias, 0, sizeof(pdBias));
+        memset(pdBatch, 0, LANES * sizeof(double));
+        for (n = 0; n < MC_SECONDS * LOOP_RATE; n++)
+        {
+            SensorModelSample(psModel, 1.0f / LOOP_RATE, pfRate, pfForce,
+                              pfGyro, pfAccel);
+            for (l = 0; l < LANES; l++)
+            {
+                if (n < MC_CALIBRATION)
+                {
+                    pdBias[l] += pfGyro[2 * LANES + l] / MC_CALIBRATION;
+                }
+                else
+                {
+                    pdBatch[l] += ((pfGyro[2 * LANES + l] - pdBias[l]) /
+                                   LOOP_RATE * 180.0 / M_PI);
+                }
+            }
+        }
+    }
+}
+
+static int
+CompareAbs(const void *pvA, const void *pvB)
+{
+    double dA = fabs(*(const double *)pvA), dB = fabs(*(const double *)pvB);
+    return (dA > dB) - (dA < dB);
+}
+
+//*****************************************************************************
+//
+// The time of a reading of ui32Lanes lanes with the default errors, in ns
+// per lane.
+//
+//*****************************************************************************
+static double
+Benchmark(tSensorModel *psModel, uint32_t ui32Lanes)
+{
+    float pfIn[3 * LANES], pfGyro[3 * LANES], pfAccel[3 * LANES];
+    tSensorNoise sNoise;
+    double dStart;
+    uint32_t n;
+
+    SensorModelNoiseDefault(&sNoise);
+    SensorModelInit(psModel, &sNoise, ui32Lanes, 7);
+    Configure(psModel);
+    for (n = 0; n < 3 * LANES; n++)
+    {
+        pfIn[n] = 0.1f;
+    }
+    dStart = Nanoseconds();
+    for (n = 0; n < BENCH_SAMPLES * LANES / ui32Lanes; n++)
+    {
+        SensorModelSample(psModel, 1.0f / LOOP_RATE, pfIn, pfIn, pfGyro,
+                          pfAccel);
+    }
+    return (Nanoseconds() - dStart) / (BENCH_SAMPLES * LANES);
+}
+
+int
+main(void)
+{
+    static tSensorModel sModel;
+    static double pdYaw[MC_RUNS];
+    double dSquares = 0.0;
+    bool bOk = true;
+    int i;
+
+    printf("sensor model checks\n");
+    bOk &= CheckNoise(&sModel);
+    bOk &= CheckWalk(&sModel);
+    bOk &= CheckDelay(&sModel);
+    bOk &= CheckQuantize(&sModel);
+    bOk &= CheckMisalignment(&sModel);
+
+    MonteCarlo(&sModel, pdYaw);
+    for (i = 0; i < MC_RUNS; i++)
+    {
+        dSquares += pdYaw[i] * pdYaw[i];
+    }
+    qsort(pdYaw, MC_RUNS, sizeof(double), CompareAbs);
+    printf("yaw drift of %d boards at rest for %.0f s after the boot "
+           "calibration: rms %.2f deg, 95 %% within %.2f deg, largest "
+           "%.2f deg\n", MC_RUNS, MC_SECONDS, sqrt(dSquares / MC_RUNS),
+           fabs(pdYaw[MC_RUNS * 95 / 100]), fabs(pdYaw[MC_RUNS - 1]));
+    printf("reading: %.0f ns for one lane, %.1f ns per lane of %d\n",
+           Benchmark(&sModel, 1), Benchmark(&sModel, LANES), LANES);
+
+    printf(bOk ? "sensor model all passed\n" : "sensor model FAILED\n");
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+"""Tilt error of the attitude filters in aggressive manoeuvres.
+
+The accelerometer reads the specific force, gravity only while the body does
+not accelerate. Each profile below gives the attitude and the thrust of the
+quadrotor over time; the translation follows from them with a linear drag
+of the rotors in the horizontal plane,
+
+    dv/dt = R (0, 0, thrust) - g e3 - KD (vx, vy, 0),
+
+and the accelerometer reads R' (dv/dt + g e3) plus noise. The gyro reads the
+true rates plus noise and a 0.5 deg/s bias drift. Both filters of
+attitude.py are replayed with every reading trusted fully (fixed) and with
+the trust schedule of CompDCMAccelTrust() (adaptive).
+
+Prints the peak and the rms tilt error, the angle between the estimated and
+the true vertical, so the yaw, which the accelerometer cannot correct, does
+not count.
+"""
+import numpy as np
+
+import attitude
+from quadrotor import eulers_to_dcm
+
+DELTAT = 1.0 / 250.0  # sec, IMU period
+G = 9.81
+KD = 0.5  # 1/s, horizontal drag
+GYRO_NOISE = 0.00167  # rad/s
+DRIFT = 0.5 / 180.0 * np.pi  # rad/s
+ACCEL_NOISE = 0.3  # m/s^2, with the vibration after the 94 Hz low-pass
+
+
+def ramp(t, t0, t1):
+    """0 before t0, 1 after t1, smooth in between."""
+    x = np.clip((t - t0) / (t1 - t0), 0.0, 1.0)
+    return x * x * (3.0 - 2.0 * x)
+
+
+def hover(t):
+    return 0.0, 0.0, 0.0, G
+
+
+def punch_out(t):
+    """Full throttle climb with the nose slightly down, then a chop."""
+    pitch = np.radians(10.0) * (ramp(t, 2.0, 2.2) - ramp(t, 4.0, 4.2))
+    thrust = G + G * (ramp(t, 2.0, 2.1) - ramp(t, 4.0, 4.1)) - \
+        0.7 * G * (ramp(t, 4.0, 4.1) - ramp(t, 5.0, 5.1))
+    return 0.0, pitch, 0.0, thrust
+
+
+def dash(t):
+    """Accelerate forward at 30 deg of pitch, brake, then stop level."""
+    pitch = np.radians(30.0) * (ramp(t, 2.0, 2.3) - 2.0 * ramp(t, 6.0, 6.5) +
+                                ramp(t, 8.0, 8.3))
+    return 0.0, pitch, 0.0, G / np.cos(pitch)
+
+
+def circle(t):
+    """Banked turn at 30 deg of roll, circling once every 4 s."""
+    roll = np.radians(30.0) * (ramp(t, 2.0, 2.5) - ramp(t, 14.0, 14.5))
+    yaw = 2.0 * np.pi / 4.0 * np.clip(t - 2.25, 0.0, 12.0)
+    return roll, 0.0, yaw, G / np.cos(roll)
+
+
+def flips(t):
+    """Roll flips of 0.4 s every 3 s, with the thrust cut during each."""
+    phase = np.fmod(t, 3.0)
+    roll = 2.0 * np.pi * ramp(phase, 1.0, 1.4) if t >= 1.0 else 0.0
+    thrust = G * (1.0 - 0.8 * (ramp(phase, 0.9, 1.0) -
+                               ramp(phase, 1.4, 1.5)))
+    return roll, 0.0, 0.0, thrust
+
+
+PROFILES = [('hover', hover, 20.0), ('punch-out', punch_out, 8.0),
+            ('dash', dash, 12.0), ('circle', circle, 18.0),
+            ('flips', flips, 13.0)]
+
+
+def log_rotation(r):
+    """Rotation vector of r, the inverse of rotation_increment()."""
+    cos = np.clip((np.trace(r) - 1.0) / 2.0, -1.0, 1.0)
+    angle = np.arccos(cos)
+    v = np.array([r[2, 1] - r[1, 2], r[0, 2] - r[2, 0], r[1, 0] - r[0, 1]])
+    if angle < 1e-9:
+        return 0.5 * v
+    return angle / (2.0 * np.sin(angle)) * v
+
+
+def fly(profile, duration, rng):
+    """Returns the true DCMs, the gyro and the accelerometer readings."""
+    n = int(duration / DELTAT)
+    truth = np.zeros((n, 3, 3))
+    thrust = np.zeros(n)
+    for i in range(n):
+        roll, pitch, yaw, thrust[i] = profile(i * DELTAT)
+        truth[i] = eulers_to_dcm(roll, pitch, yaw)
+
+    rates = np.zeros((n, 3))
+    for i in range(n - 1):
+        rates[i] = log_rotation(truth[i].T.dot(truth[i + 1])) / DELTAT
+
+    accel = np.zeros((n, 3))
+    v = np.zeros(3)
+    for i in range(n):
+        v_dot = truth[i].dot([0.0, 0.0, thrust[i]]) - [0.0, 0.0, G] - \
+            KD * np.array([v[0], v[1], 0.0])
+        accel[i] = truth[i].T.dot(v_dot + [0.0, 0.0, G])
+        v += v_dot * DELTAT
+
+    gyro = rates + DRIFT + rng.normal(0.0, GYRO_NOISE, (n, 3))
+    accel += rng.normal(0.0, ACCEL_NOISE, (n, 3))
+    return truth, gyro, accel
+
+
+def replay(truth, gyro, accel, mode, adaptive):
+    """Returns the tilt errors and the mean trust of one filter."""
+    dcm = attitude.CompDCM(DELTAT, mode, adaptive=adaptive)
+    dcm.start(accel[0])
+    dcm.dcm = truth[0].copy()
+    tilt = np.zeros(len(gyro))
+    trust = np.zeros(len(gyro))
+    for i in range(len(gyro) - 1):
+        dcm.update(gyro[i], accel[i + 1])
+        tilt[i + 1] = np.arccos(np.clip(dcm.dcm[2].dot(truth[i + 1][2]),
+                                        -1.0, 1.0))
+        trust[i + 1] = dcm.trust
+    return tilt, np.mean(trust[1:])
+
+
+def main():
+    rng = np.random.default_rng(0)
+    deg = 180.0 / np.pi
+    print('%-12s%-15s%22s%22s%12s' % ('', '', 'fixed', 'adaptive',
+                                      'adaptive'))
+    print('%-12s%-15s%11s%11s%11s%11s%12s' % (
+        'profile', 'filter', 'peak', 'rms', 'peak', 'rms', 'mean trust'))
+    for name, profile, duration in PROFILES:
+        truth, gyro, accel = fly(profile, duration, rng)
+        for mode in ('complementary', 'mahony'):
+            fixed, _ = replay(truth, gyro, accel, mode, False)
+            adaptive, trust = replay(truth, gyro, accel, mode, True)
+            print('%-12s%-15s%11.2f%11.2f%11.2f%11.2f%12.2f' % (
+                name, mode, np.max(fixed) * deg,
+                np.sqrt(np.mean(fixed**2)) * deg, np.max(adaptive) * deg,
+                np.sqrt(np.mean(adaptive**2)) * deg, trust))
+    print('tilt error in deg')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,114 @@
+"""Integral action, anti-windup and the torque priority mixer.
+
+The first table hovers with a constant roll torque (CG offset) and shows the
+remaining attitude offset with and without the integrators.
+
+The second table hovers near full throttle with the same offset and commands
+large roll steps so that the mixer saturates. It compares a plain integrator
+with the old per-motor clipping mixer against anti-windup with the torque
+priority mixer.
+"""
+import sys
+
+import numpy as np
+
+import quadrotor
+
+DEG = 180.0 / np.pi
+
+
+def disturbance(t):
+    return np.array([0.01, 0.0, 0.0])  # N * m, CG offset on the roll axis
+
+
+class RollSteps:
+    """Roll setpoint of +-0.8 rad between 2 s and 4 s."""
+
+    def __init__(self, controller):
+        self.controller = controller
+        self.name = controller.name
+        self.step = -1
+        self.saturated = 0
+
+    def update(self, s):
+        self.step += 1
+        t = self.step * self.controller.p.deltat
+        if 2.0 <= t < 3.0:
+            self.controller.des[0] = 0.8
+        elif 3.0 <= t < 4.0:
+            self.controller.des[0] = -0.8
+        else:
+            self.controller.des[0] = 0.0
+        omega_sq = self.controller.update(s)
+        p = self.controller.p
+        self.saturated += np.any(omega_sq >= p.max_omega_sq * 0.999) or \
+            np.any(omega_sq <= p.min_omega_sq * 1.001)
+        return omega_sq
+
+    @property
+    def motor_omega_sq(self):
+        return self.controller.motor_omega_sq
+
+    @motor_omega_sq.setter
+    def motor_omega_sq(self, omega_sq):
+        self.controller.motor_omega_sq = omega_sq
+
+    def motor_command(self, omega_sq):
+        return self.controller.motor_command(omega_sq)
+
+
+def offsets(params):
+    runs = [
+        ('pd', quadrotor.PDController(params, ki=0.0)),
+        ('pid', quadrotor.PDController(params)),
+        ('cascade, no ki', quadrotor.CascadeController(params, rate_ki=0.0)),
+        ('cascade', quadrotor.CascadeController(params)),
+    ]
+    print('%-24s%16s' % ('', 'offset [deg]'))
+    for name, controller in runs:
+        t, eulers, _, _ = quadrotor.simulate(controller, params, 30.0,
+                                             disturbance)
+        print('%-24s%16.3f' % (name, np.mean(eulers[t >= 25.0, 0]) * DEG))
+
+
+def saturation(params):
+    runs = [
+        ('clipping, plain int', quadrotor.CascadeController(
+            params, antiwindup=False, mixer=quadrotor.legacy_mix)),
+        ('priority, anti-windup', quadrotor.CascadeController(params)),
+    ]
+    print('%-24s%12s%18s%12s%12s' % ('', 'peak [deg]', 'overshoot [deg]',
+                                     'settle [s]', 'at limit'))
+    curves = []
+    for name, controller in runs:
+        controller.thrust_z_dir = 2.3 * params.m
+        wrapped = RollSteps(controller)
+        t, eulers, _, _ = quadrotor.simulate(wrapped, params, 8.0, disturbance)
+        roll = eulers[:, 0] * DEG
+        after = t >= 4.0
+        overshoot = max(np.max(roll[after]), 0.0)
+        outside = np.nonzero(np.abs(roll[after]) > 1.0)[0]
+        settle = (outside[-1] + 1) * params.deltat if len(outside) else 0.0
+        print('%-24s%12.3f%18.3f%12.3f%12d' % (name, np.max(np.abs(roll)),
+                                              overshoot, settle,
+                                              wrapped.saturated))
+        curves.append((name, t, roll))
+    return curves
+
+
+def main():
+    params = quadrotor.Params()
+    offsets(params)
+    print('')
+    curves = saturation(params)
+
+    if '--plot' in sys.argv:
+        import matplotlib.pyplot as plt
+        for name, t, roll in curves:
+            plt.plot(t, roll, label=name)
+        plt.legend(frameon=False)
+        plt.show()
+
+
+if __name__ == "__main__":
+    main()
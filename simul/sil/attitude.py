@@ -0,0 +1,106 @@
+"""Attitude filters of flight_controller/comp_dcm.c.
+
+Mirrors CompDCMStart() and CompDCMUpdate() for the complementary and the
+Mahony filter selected by COMP_DCM_MODE_*, so they can be replayed over
+recorded gyro traces.
+"""
+import numpy as np
+
+from quadrotor import dcm_to_eulers, eulers_to_dcm, rotation_increment
+
+# constants of comp_dcm.c and comp_dcm.h
+COMP_FILTER_FACTOR = 0.02
+COMP_DCM_MAHONY_KP = 2.0
+COMP_DCM_MAHONY_KI = 0.1
+COMP_DCM_TRUST_ACCEL_LOW = 0.03
+COMP_DCM_TRUST_ACCEL_HIGH = 0.1
+COMP_DCM_TRUST_RATE_LOW = 1.0
+COMP_DCM_TRUST_RATE_HIGH = 4.0
+
+
+def normalize(r):
+    """Same as CompDCMNormalize()."""
+    error = r[0].dot(r[1])
+    rows = np.zeros((3, 3))
+    rows[0] = r[0] - 0.5 * error * r[1]
+    rows[1] = r[1] - 0.5 * error * r[0]
+    rows[2] = np.cross(rows[0], rows[1])
+    for i in range(3):
+        rows[i] *= 0.5 * (3.0 - rows[i].dot(rows[i]))
+    return rows
+
+
+class CompDCM:
+    """State of tCompDCM. gyro is in rad/s after fGyroBias, accel in m/s^2.
+
+    adaptive=False trusts every accelerometer reading fully, as comp_dcm.c did
+    before CompDCMAccelTrust().
+    """
+
+    def __init__(self, deltat, mode='complementary', kp=COMP_DCM_MAHONY_KP,
+                 ki=COMP_DCM_MAHONY_KI, adaptive=True):
+        self.deltat = deltat
+        self.mode = mode
+        self.kp = kp
+        self.ki = ki
+        self.adaptive = adaptive
+        self.dcm = np.eye(3)
+        self.bias_est = np.zeros(3)
+        self.gravity = 0.0
+        self.trust = 1.0
+
+    def start(self, accel):
+        self.gravity = np.linalg.norm(accel)
+        r = accel / np.linalg.norm(accel)
+        self.dcm = eulers_to_dcm(np.arctan2(r[1], r[2]), np.arcsin(-r[0]), 0.0)
+
+    @property
+    def eulers(self):
+        return dcm_to_eulers(self.dcm)
+
+    def update(self, gyro, accel):
+        # CompDCMGyroUpdate() removes the bias estimate
+        gyro = gyro - self.bias_est
+        if self.mode == 'mahony':
+            self.mahony(gyro, accel)
+        else:
+            self.complementary(gyro, accel)
+        return gyro
+
+    def accel_trust(self, gyro, g):
+        """Same as CompDCMAccelTrust()."""
+        if not self.adaptive:
+            self.trust = 1.0
+            return self.trust
+        deviation = 0.0
+        if self.gravity > 0.0:
+            deviation = abs(g - self.gravity) / self.gravity
+        trust_a = (COMP_DCM_TRUST_ACCEL_HIGH - deviation) / \
+            (COMP_DCM_TRUST_ACCEL_HIGH - COMP_DCM_TRUST_ACCEL_LOW)
+        trust_g = (COMP_DCM_TRUST_RATE_HIGH - np.linalg.norm(gyro)) / \
+            (COMP_DCM_TRUST_RATE_HIGH - COMP_DCM_TRUST_RATE_LOW)
+        self.trust = np.clip(trust_a, 0.0, 1.0) * np.clip(trust_g, 0.0, 1.0)
+        return self.trust
+
+    def complementary(self, gyro, accel):
+        temp = self.dcm.dot(rotation_increment(gyro, self.deltat))
+        g = np.linalg.norm(accel)
+        factor = COMP_FILTER_FACTOR * self.accel_trust(gyro, g)
+        r = accel / g
+        beta_grav = np.arcsin(-r[0])
+        gamma_grav = np.arctan2(r[1], r[2])
+        gamma, beta, alpha = dcm_to_eulers(temp)
+        beta = (1.0 - factor) * beta + factor * beta_grav
+        gamma = (1.0 - factor) * gamma + factor * gamma_grav
+        self.dcm = eulers_to_dcm(gamma, beta, alpha)
+
+    def mahony(self, gyro, accel):
+        rate = gyro.copy()
+        g = np.linalg.norm(accel)
+        if g > 0.0:
+            trust = self.accel_trust(gyro, g)
+            error = np.cross(accel / g, self.dcm[2])
+            rate += trust * self.kp * error
+            self.bias_est -= trust * self.ki * error * self.deltat
+        self.dcm = normalize(self.dcm.dot(rotation_increment(rate,
+                                                             self.deltat)))
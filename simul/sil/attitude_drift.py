@@ -0,0 +1,104 @@
+"""Drift of the complementary and the Mahony filter of comp_dcm.c.
+
+Replays the gyro captures of simul/mpu6050_integration (3.75 ms period, deg/s)
+through both filters of attitude.py. The captures have no accelerometer data,
+so it is synthesized:
+
+- static: the board rests level, the accelerometer reads 1 g. The gyro is
+  replayed as captured after the boot calibration over the first 500
+  samples, then again with a 0.5 deg/s drift of the bias on every axis, as
+  after the board warmed up.
+- moving traces: the capture without its initial bias is taken as the true
+  rates and integrated into the true attitude, from which the accelerometer
+  reading (gravity only, plus noise) follows. The filters get the rates with
+  the 0.5 deg/s bias drift.
+
+Prints the attitude error at the end of each trace and its rms, per axis.
+Without a magnetometer the yaw bias is only observable while the board is
+tilted, so the Mahony filter mainly removes the roll and pitch errors.
+"""
+import os
+
+import numpy as np
+
+import attitude
+from quadrotor import dcm_to_eulers, rotation_increment
+
+DELTAT = 0.00375  # sec, period of the captures
+N_BIAS = 500  # samples of the boot calibration
+DRIFT = 0.5 / 180.0 * np.pi  # rad/s
+ACCEL_NOISE = 0.05  # m/s^2
+G = 9.81
+
+LOGS = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..',
+                    'mpu6050_integration')
+
+
+def load(name):
+    return np.loadtxt(os.path.join(LOGS, name)) / 180.0 * np.pi
+
+
+def wrap(angle):
+    return (angle + np.pi) % (2.0 * np.pi) - np.pi
+
+
+def replay(gyro, accel, truth, mode):
+    dcm = attitude.CompDCM(DELTAT, mode)
+    dcm.start(accel[0])
+    dcm.dcm = truth[0].copy()
+    errors = np.zeros((len(gyro), 3))
+    for i in range(len(gyro)):
+        dcm.update(gyro[i], accel[i])
+        errors[i] = wrap(dcm.eulers - dcm_to_eulers(truth[i]))
+    return errors, dcm.bias_est
+
+
+def truth_of(rates):
+    truth = np.zeros((len(rates), 3, 3))
+    r = np.eye(3)
+    for i in range(len(rates)):
+        r = r.dot(rotation_increment(rates[i], DELTAT))
+        truth[i] = r
+    return truth
+
+
+def report(name, gyro, accel, truth):
+    deg = 180.0 / np.pi
+    for mode in ('complementary', 'mahony'):
+        errors, bias = replay(gyro, accel, truth, mode)
+        rms = np.sqrt(np.mean(errors**2, axis=0)) * deg
+        print('%-20s%-15s%8.2f%8.2f%8.2f%8.2f%8.2f%8.2f' % (
+            name, mode, *(np.abs(errors[-1]) * deg), *rms))
+        if mode == 'mahony':
+            print('%-20s%-15s bias estimate %.3f %.3f %.3f deg/s' % (
+                '', '', *(bias * deg)))
+
+
+def main():
+    rng = np.random.default_rng(0)
+    print('%-20s%-15s%24s%24s' % ('', '', 'final error [deg]',
+                                  'rms error [deg]'))
+    print('%-20s%-15s%8s%8s%8s%8s%8s%8s' % ('trace', 'filter', 'roll',
+                                           'pitch', 'yaw', 'roll', 'pitch',
+                                           'yaw'))
+
+    raw = load('gyro_data_static.txt')
+    gyro = raw[N_BIAS:] - raw[:N_BIAS].mean(axis=0)
+    accel = np.tile([0.0, 0.0, G], (len(gyro), 1)) + \
+        rng.normal(0.0, ACCEL_NOISE, (len(gyro), 3))
+    truth = np.tile(np.eye(3), (len(gyro), 1, 1))
+    report('static', gyro, accel, truth)
+    report('static + drift', gyro + DRIFT, accel, truth)
+
+    for i in range(1, 5):
+        raw = load('gyro_data_mov_%d.txt' % i)
+        rates = raw - raw[:N_BIAS].mean(axis=0)
+        truth = truth_of(rates)
+        accel = np.einsum('ij,ijk->ik', np.tile([0.0, 0.0, G], (len(rates), 1)),
+                          truth) + rng.normal(0.0, ACCEL_NOISE,
+                                              (len(rates), 3))
+        report('mov_%d + drift' % i, rates + DRIFT, accel, truth)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,243 @@
+"""Relay feedback auto-tune of the PD gains (autotune.c).
+
+While hovering, the tuner replaces the D term of one axis by a relay on the
+filtered body rate (AutotuneRelayUpdate()), which makes the rate oscillate
+at the frequency where the loop lags by 180 deg. The period and the
+amplitude of the oscillation fit the rate of the axis to an integrator with
+a dead time, b exp(-s theta) / s (AutotuneRelayModel()), and the gains follow
+from the model (AutotuneGains()): the D gain for a phase margin of the rate
+loop, the P gain for a critically damped angle loop. Roll and pitch are tuned
+one after the other and the gains of the axis with the smaller D gain are
+kept, since the PD gains are shared by the axes.
+
+Tunes airframes that differ from controller.c, then flies each with the
+default gains of controller.c and with the tuned ones. Prints, per airframe:
+
+- the identified model and the tuned gains,
+- settle: the time until the roll stays within 10 % of a 0.15 rad step,
+  '-' if it does not within 3 s,
+- overshoot: in % of the step,
+- offset: the mean roll error under a 0.02 N * m roll torque.
+
+With --log FILE it also writes the filtered roll rate of the first tune, one
+sample per line, for simul/autotune/autotune_host.c.
+"""
+import sys
+
+import numpy as np
+
+import quadrotor
+
+# autotune.h
+RELAY = 20.0  # rad/s^2
+HYSTERESIS = 0.05  # rad/s
+SKIP_CYCLES = 2
+CYCLES = 6
+TIMEOUT = 2.0  # s without a relay switch
+MAX_ANGLE = 0.35  # rad
+PHASE_MARGIN = np.radians(45.0)
+DAMPING = 1.0
+MAX_KP = 1000.0
+MAX_KD = 200.0
+
+MOTOR_TAU = 0.03  # s
+STEP = 0.15  # rad
+
+
+class RelayId:
+    """tRelayId: relay with hysteresis and the cycles that it causes."""
+
+    def __init__(self, relay, hysteresis, deltat):
+        self.relay = relay
+        self.hysteresis = hysteresis
+        self.deltat = deltat
+        self.output = relay
+        self.ticks = 0
+        self.cycles = 0
+        self.max = -np.inf
+        self.min = np.inf
+        self.period_sum = 0.0
+        self.amplitude_sum = 0.0
+
+    def update(self, rate):
+        """AutotuneRelayUpdate(), True once CYCLES cycles were measured."""
+        self.ticks += 1
+        self.max = max(self.max, rate)
+        self.min = min(self.min, rate)
+        if self.output > 0.0 and rate > self.hysteresis:
+            self.output = -self.relay
+        elif self.output < 0.0 and rate < -self.hysteresis:
+            # a cycle ends with every switch to a positive output
+            self.output = self.relay
+            if self.cycles >= SKIP_CYCLES:
+                self.period_sum += self.ticks * self.deltat
+                self.amplitude_sum += 0.5 * (self.max - self.min)
+            self.cycles += 1
+            self.ticks = 0
+            self.max = -np.inf
+            self.min = np.inf
+        return self.cycles >= SKIP_CYCLES + CYCLES
+
+    def model(self):
+        """AutotuneRelayModel(): the gain b and the dead time theta."""
+        n = self.cycles - SKIP_CYCLES
+        if n <= 0:
+            return None
+        period = self.period_sum / n
+        amplitude = self.amplitude_sum / n
+        if amplitude <= self.hysteresis:
+            return None
+        w = 2.0 * np.pi / period
+        # b / w = pi a / (4 d), the phase is -180 deg + asin(e / a)
+        gain = w * np.pi * amplitude / (4.0 * self.relay)
+        delay = (0.5 * np.pi - np.arcsin(self.hysteresis / amplitude)) / w
+        return gain, delay
+
+
+def gains(gain, delay):
+    """AutotuneGains()."""
+    crossover = (0.5 * np.pi - PHASE_MARGIN) / delay
+    kd = crossover / gain
+    kp = gain * kd * kd / (4.0 * DAMPING * DAMPING)
+    return min(kp, MAX_KP), min(kd, MAX_KD)
+
+
+class Autotune:
+    """tAutotune, AutotuneUpdate()."""
+
+    def __init__(self, deltat):
+        self.state = 'running'
+        self.axis = 0
+        self.relay = RelayId(RELAY, HYSTERESIS, deltat)
+        self.models = []
+        self.gains = None
+        self.rates = []
+
+    def update(self, error, rate):
+        relay = self.relay
+        if abs(error) > MAX_ANGLE or relay.ticks * relay.deltat > TIMEOUT:
+            self.state = 'failed'
+            return 0.0
+        if self.axis == 0:
+            self.rates.append(rate)
+        if not relay.update(rate):
+            return relay.output
+        model = relay.model()
+        if model is None:
+            self.state = 'failed'
+            return 0.0
+        self.models.append(model)
+        self.axis += 1
+        if self.axis < 2:
+            self.relay = RelayId(RELAY, HYSTERESIS, relay.deltat)
+            return 0.0
+        # keeps the gains of the axis that needs the smaller D gain
+        self.gains = min((gains(*m) for m in self.models),
+                         key=lambda g: g[1])
+        self.state = 'done'
+        return 0.0
+
+
+class TunedPD(quadrotor.PDController):
+    """ErrorToInput() with the relay in place of the D term of the axis
+    being tuned."""
+
+    def __init__(self, params, **kwargs):
+        quadrotor.PDController.__init__(self, params, **kwargs)
+        self.tune = Autotune(params.deltat)
+
+    def update(self, s):
+        rate = self.filter_gyro(s.gyro)
+        d_rate = self.dterm_filter(rate)
+        error = self.des - s.euler
+        self.angle_int = self.integrate(self.angle_int,
+                                        self.ki * error * self.p.deltat,
+                                        self.int_limit)
+        self.accel_cmd = np.zeros(3)
+        for i in range(3):
+            if self.tune.state == 'running' and self.tune.axis == i:
+                self.accel_cmd[i] = self.kp * error[i] + self.angle_int[i] + \
+                    self.tune.update(error[i], d_rate[i])
+            else:
+                self.accel_cmd[i] = self.kp * error[i] + self.angle_int[i] - \
+                    self.kd * d_rate[i]
+        return self.output(quadrotor.tilt_thrust(self.p, self.thrust_z_dir,
+                                                 s.euler), self.accel_cmd)
+
+
+def model_of(plant):
+    """The nominal airframe of controller.c with the motor settings of the
+    plant."""
+    model = quadrotor.Params()
+    model.motor_tau = MOTOR_TAU
+    model.motor_lead = plant.motor_lead
+    return model
+
+
+def tune(plant):
+    controller = TunedPD(model_of(plant), dyn_notch=False)
+    quadrotor.simulate(controller, plant, 10.0, seed=1)
+    return controller.tune
+
+
+def fly(plant, kp, kd):
+    def disturbance(t):
+        return np.array([0.02 if t >= 3.0 else 0.0, 0.0, 0.0])
+
+    controller = quadrotor.PDController(model_of(plant), kp=kp, kd=kd,
+                                        dyn_notch=False)
+    t, eulers, _, _ = quadrotor.simulate(controller, plant, 6.0, disturbance,
+                                         initial=(-STEP, 0.0, 0.0))
+    roll = eulers[:, 0]
+    before = t < 3.0
+    outside = np.nonzero(np.abs(roll[before]) > 0.1 * STEP)[0]
+    settle = t[outside[-1] + 1] if len(outside) else 0.0
+    if len(outside) and outside[-1] + 1 >= np.count_nonzero(before):
+        settle = None
+    overshoot = max(0.0, np.max(roll[before])) / STEP * 100.0
+    offset = np.mean(roll[t >= 5.5]) * 180.0 / np.pi
+    return settle, overshoot, offset
+
+
+def airframes():
+    for name, inertia, lead in [('nominal', 1.0, 0.5),
+                                ('inertia x 1.5', 1.5, 0.5),
+                                ('inertia x 0.6', 0.6, 0.5),
+                                ('no motor lead', 1.0, 1.0)]:
+        p = quadrotor.Params()
+        p.motor_tau = MOTOR_TAU
+        p.motor_lead = lead
+        p.i_xx *= inertia
+        p.i_yy *= inertia
+        p.i_zz *= inertia
+        yield name, p
+
+
+def main():
+    log = sys.argv[sys.argv.index('--log') + 1] if '--log' in sys.argv \
+        else None
+    print('%-16s%8s%10s%8s%8s  %-27s%-27s' % (
+        'airframe', 'b', 'theta', 'kp', 'kd', 'default', 'tuned'))
+    print('%-50s' % '' + '%9s%10s%8s' % ('settle', 'overshoot', 'offset') * 2)
+    for name, plant in airframes():
+        tuner = tune(plant)
+        if log is not None:
+            np.savetxt(log, tuner.rates, fmt='%.6f')
+            log = None
+        line = '%-16s' % name
+        if tuner.state != 'done':
+            print(line + 'tune failed')
+            continue
+        gain, delay = tuner.models[0]
+        line += '%8.2f%8.1fms%8.1f%8.1f  ' % ((gain, delay * 1e3) +
+                                             tuner.gains)
+        for kp, kd in [(5.0, 40.0), tuner.gains]:
+            settle, overshoot, offset = fly(plant, kp, kd)
+            line += ('%9s' % '-' if settle is None else '%8.2fs' % settle) + \
+                '%9.1f%%%8.2f' % (overshoot, offset)
+        print(line)
+    print('b in rad/s^2 per rad/s^2, offset in deg')
+
+
+if __name__ == '__main__':
+    main()
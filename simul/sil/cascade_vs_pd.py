@@ -0,0 +1,65 @@
+"""Disturbance rejection and cost of the cascaded controller vs the PD.
+
+Applies a roll torque step (a CG offset or a weak motor) and a short yaw
+impulse while hovering, then prints the attitude errors of both controllers.
+The time per update is the host cost of the mirrored Python code and is only
+useful as a ratio; the firmware prints the on-target cycle count of
+ControllerUpdate() on the telemetry screen.
+"""
+import sys
+
+import numpy as np
+
+import quadrotor
+
+
+def disturbance(t):
+    tau = np.zeros(3)
+    if 1.0 <= t < 4.0:
+        tau[0] = 0.02  # N * m, roll
+    if 5.0 <= t < 5.1:
+        tau[2] = 0.01  # N * m, yaw
+    return tau
+
+
+def metrics(t, eulers):
+    deg = 180.0 / np.pi
+    step = (t >= 1.0) & (t < 4.0)
+    settled = (t >= 3.0) & (t < 4.0)
+    impulse = (t >= 5.0) & (t < 7.0)
+    return {
+        'roll peak [deg]': np.max(np.abs(eulers[step, 0])) * deg,
+        'roll rms [deg]': np.sqrt(np.mean(eulers[step, 0]**2)) * deg,
+        'roll offset [deg]': np.mean(eulers[settled, 0]) * deg,
+        'yaw peak [deg]': np.max(np.abs(eulers[impulse, 2])) * deg,
+    }
+
+
+def main():
+    params = quadrotor.Params()
+    controllers = [quadrotor.PDController(params),
+                   quadrotor.CascadeController(params)]
+    results = []
+    for controller in controllers:
+        t, eulers, _, cost = quadrotor.simulate(controller, params, 8.0,
+                                                disturbance)
+        results.append((controller.name, t, eulers, metrics(t, eulers), cost))
+
+    keys = list(results[0][3].keys())
+    print('%-20s' % '' + ''.join('%12s' % r[0] for r in results))
+    for key in keys:
+        print('%-20s' % key + ''.join('%12.3f' % r[3][key] for r in results))
+    print('%-20s' % 'update [us]' + ''.join('%12.1f' % (r[4] * 1e6)
+                                            for r in results))
+
+    if '--plot' in sys.argv:
+        import matplotlib.pyplot as plt
+        for name, t, eulers, _, _ in results:
+            plt.plot(t, eulers[:, 0] * 180.0 / np.pi, label=name + ' roll')
+            plt.plot(t, eulers[:, 2] * 180.0 / np.pi, label=name + ' yaw')
+        plt.legend(frameon=False)
+        plt.show()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,104 @@
+"""Decodes the crash capture that the flight controller prints at boot.
+
+After a warm reset the firmware prints the pre-trigger ring of crash_ring.c
+on UART0 before the telemetry screen, in lines of
+
+    Crash capture: cause C, N samples, trigger at T, gyro fs G, accel afs A
+    C <22 raw bytes in hex> tick w0 w1 w2 w3
+    ...
+    Crash capture end, ...
+
+Save the terminal output to a file. The raw bytes are the MPU9150 registers
+from ACCEL_XOUT_H on, in the sensor axes (the axis map of the driver is not
+applied), the motor commands are in units of CRASH_RING_OMEGA_SQ_LSB. Writes a
+CSV with the sample relative to the trigger, the loop tick, accel in g, die
+temperature in C, gyro in deg/s, the magnetometer in uT (zero when the
+AK8975 had no new reading) and omega^2 of the motors. Without a file,
+decodes a synthetic capture as a check.
+
+    python crash_capture.py [terminal.log] > crash.csv
+"""
+import re
+import struct
+import sys
+
+OMEGA_SQ_LSB = 8.0
+CAUSES = {1: "DCM NaN", 2: "I2C error", 4: "attitude error"}
+HEADER = re.compile(r"Crash capture: cause (\d+), (\d+) samples, trigger at "
+                    r"(\d+), gyro fs (\d+), accel afs (\d+)")
+
+
+def decode_sample(raw, gyro_fs, accel_afs):
+    """Returns accel (g), temperature (C), gyro (deg/s), mag (uT)."""
+    ax, ay, az, temp, gx, gy, gz = struct.unpack(">7h", raw[:14])
+    accel = [v / (16384.0 / (1 << accel_afs)) for v in (ax, ay, az)]
+    gyro = [v / (131.072 / (1 << gyro_fs)) for v in (gx, gy, gz)]
+    st1, mx, my, mz, st2 = struct.unpack("<B3hB", raw[14:22])
+    valid = (st1 & 0x01) and not (st2 & 0x0c)
+    mag = [0.3 * v if valid else 0.0 for v in (mx, my, mz)]
+    return accel, temp / 340.0 + 35.0, gyro, mag
+
+
+def parse(lines):
+    """Returns the header fields and the sample lines of the last capture."""
+    header, samples = None, []
+    for line in lines:
+        match = HEADER.search(line)
+        if match:
+            header = [int(v) for v in match.groups()]
+            samples = []
+        elif header and line.startswith("C "):
+            fields = line.split()
+            samples.append((bytes.fromhex(fields[1]),
+                            [int(v) for v in fields[2:7]]))
+    return header, samples
+
+
+def write_csv(header, samples, out):
+    cause, count, trigger, gyro_fs, accel_afs = header
+    print("cause %d (%s), %d of %d samples, gyro fs %d, accel afs %d" %
+          (cause, CAUSES.get(cause, "?"), len(samples), count, gyro_fs,
+           accel_afs), file=sys.stderr)
+    out.write("sample,tick,ax,ay,az,temp,gx,gy,gz,mx,my,mz,"
+              "w0,w1,w2,w3\n")
+    for i, (raw, ints) in enumerate(samples):
+        accel, temp, gyro, mag = decode_sample(raw, gyro_fs, accel_afs)
+        values = accel + [temp] + gyro + mag
+        omega_sq = [v * OMEGA_SQ_LSB for v in ints[1:]]
+        out.write("%d,%d," % (i - trigger, ints[0]) +
+                  ",".join("%.4f" % v for v in values) + "," +
+                  ",".join("%.0f" % v for v in omega_sq) + "\n")
+
+
+def synthetic():
+    """A capture of a roll rate ramp that ends in an I2C error."""
+    lines = ["Crash capture: cause 2, 40 samples, trigger at 39, "
+             "gyro fs 1, accel afs 0"]
+    for k in range(40):
+        raw = struct.pack(">7h", 0, 0, 16384, -340 * 10, 0, 0, 0)
+        raw = bytearray(raw)
+        raw[8:10] = struct.pack(">h", int(65.536 * 10 * k))
+        raw += struct.pack("<B3hB", 1, 100, -50, 200, 0)
+        lines.append("C %s %d 50000 50000 50000 50000" % (raw.hex(), k))
+    lines.append("Crash capture end")
+    return lines
+
+
+def main():
+    if len(sys.argv) > 1:
+        with open(sys.argv[1], errors="replace") as f:
+            header, samples = parse(f)
+    else:
+        header, samples = parse(synthetic())
+        accel, temp, gyro, mag = decode_sample(samples[-1][0], 1, 0)
+        assert abs(gyro[0] - 390.0) < 0.1 and abs(accel[2] - 1.0) < 1e-6
+        assert abs(temp - 25.0) < 1e-6 and abs(mag[0] - 30.0) < 1e-6
+    if header is None:
+        print("no crash capture found", file=sys.stderr)
+        return 1
+    write_csv(header, samples, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,54 @@
+"""Effect of the gyro and D term filters on the motor commands.
+
+Adds a vibration tone to the sampled gyro, as the rotors leave it after the
+MPU9150 low-pass and the 250 Hz sampling, and compares the unfiltered rate
+path, the low-pass filters alone, a static notch tuned to the tone and the
+defaults of controller.c, where notches track the peaks of the gyro spectrum
+(gyro_fft.c). Motor noise is the rms of the sample to sample change of the
+motor omega^2, relative to the hover value; it is what heats the motors and
+eats into the headroom of the mixer.
+"""
+import numpy as np
+
+import quadrotor
+
+
+def disturbance(t):
+    tau = np.zeros(3)
+    if 1.0 <= t < 3.0:
+        tau[0] = 0.02  # N * m, roll
+    return tau
+
+
+def main():
+    params = quadrotor.Params()
+    params.vibration = np.array([0.3, 0.3, 0.1])  # rad/s
+    params.vibration_hz = 55.0  # rotor speed at hover
+    hover = params.m * params.g / (4.0 * params.k)
+    deg = 180.0 / np.pi
+
+    configs = [
+        ('unfiltered', dict(gyro_lpf_hz=0.0, dterm_lpf_hz=0.0,
+                            dyn_notch=False)),
+        ('low-pass only', dict(dyn_notch=False)),
+        ('static notch', dict(notch_hz=params.vibration_hz, dyn_notch=False)),
+        ('tracking notch', dict()),
+    ]
+    print('vibration %.0f Hz, %.2f rad/s' % (params.vibration_hz,
+                                             params.vibration[0]))
+    print('%-20s%-10s%16s%16s%16s' % ('', '', 'motor noise [%]',
+                                     'roll rms [deg]', 'roll peak [deg]'))
+    for cls in (quadrotor.PDController, quadrotor.CascadeController):
+        for name, kwargs in configs:
+            controller = cls(params, **kwargs)
+            t, eulers, omega_sq, _ = quadrotor.simulate(
+                controller, params, 4.0, disturbance)
+            noise = np.sqrt(np.mean(np.diff(omega_sq[t > 0.5], axis=0)**2))
+            roll = eulers[t > 0.5, 0]
+            print('%-20s%-10s%16.2f%16.3f%16.3f' % (
+                name, cls.name, 100.0 * noise / hover,
+                np.sqrt(np.mean(roll**2)) * deg, np.max(np.abs(roll)) * deg))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,83 @@
+"""Large-angle recovery of the Euler angle controllers vs the geometric one.
+
+Starts the quadrotor at rest in a large attitude error and lets each
+controller bring it back to level at hover thrust. The PD and the geometric
+controller get the same gains, with the angle gain raised to the stiffness of
+the cascaded controller so that all three settle within the run, and without
+their angle integrator: its back-calculation anti-windup is meant for short
+saturations and winds it up while the P term saturates the mixer for the
+whole recovery. Prints, per start attitude:
+
+- settle: the time until the rotation from the setpoint stays below 5 deg,
+  '-' if it does not within the run,
+- drop: the height lost, from the vertical thrust that the motors produce
+  (the SIL model has no translation, so this is integrated on the side),
+- peak thrust: the highest total thrust as a multiple of the hover thrust.
+
+The time per update is the host cost of the mirrored Python code and is only
+useful as a ratio; with PERF_BENCHMARKS the firmware prints the cycles per
+ControllerUpdate() of each controller.
+"""
+import numpy as np
+
+import quadrotor
+from quadrotor import eulers_to_dcm
+
+DURATION = 4.0  # s
+SETTLED = 5.0 / 180.0 * np.pi  # rad
+KP = 160.0  # 1/s^2, the stiffness of the cascade, 4 rad/s per rad times 40
+
+STARTS = [(30, 0, 0), (90, 0, 0), (150, 0, 0), (179, 0, 0), (60, 60, 0),
+          (0, 89, 90), (90, 0, 179), (170, 0, 170), (150, -60, -120)]  # deg
+
+
+def rotation_angle(r):
+    return np.arccos(np.clip((np.trace(r) - 1.0) / 2.0, -1.0, 1.0))
+
+
+def metrics(params, t, eulers, omega_sq):
+    angles = np.array([rotation_angle(eulers_to_dcm(*e)) for e in eulers])
+    outside = np.nonzero(angles >= SETTLED)[0]
+    settle = None
+    if len(outside) == 0:
+        settle = 0.0
+    elif outside[-1] < len(t) - 1:
+        settle = t[outside[-1] + 1]
+
+    # vertical acceleration from the thrust along the body z axis
+    thrust = params.k * omega_sq.sum(axis=1)
+    r22 = np.array([eulers_to_dcm(*e)[2, 2] for e in eulers])
+    v = np.cumsum((thrust * r22 / params.m - params.g) * params.deltat)
+    height = np.cumsum(v * params.deltat)
+    return settle, max(0.0, -height.min()), \
+        thrust.max() / (params.m * params.g)
+
+
+def main():
+    params = quadrotor.Params()
+    params.vibration = np.zeros(3)
+    kinds = [(quadrotor.PDController, {'kp': KP, 'ki': 0.0, 'antiwindup': False}),
+             (quadrotor.CascadeController, {}),
+             (quadrotor.GeometricController, {'kp': KP, 'ki': 0.0, 'antiwindup': False})]
+    names = [kind.name for kind, _ in kinds]
+    print('%-16s' % 'start [deg]' + ''.join('%-27s' % n for n in names))
+    print('%-16s' % '' + '%9s%9s%9s' % ('settle', 'drop', 'peak') * len(kinds))
+    cost = np.zeros(len(kinds))
+    for start in STARTS:
+        line = '%-16s' % ('%d %d %d' % start)
+        for i, (kind, gains) in enumerate(kinds):
+            controller = kind(params, dyn_notch=False, **gains)
+            t, eulers, omega_sq, cost_i = quadrotor.simulate(
+                controller, params, DURATION,
+                initial=np.radians(start))
+            cost[i] += cost_i / len(STARTS)
+            settle, drop, peak = metrics(params, t, eulers, omega_sq)
+            line += ('%9s' % '-' if settle is None else '%8.2fs' % settle) + \
+                '%8.1fm%8.2fg' % (drop, peak)
+        print(line)
+    print('%-16s' % 'update [us]' + ''.join('%-27.1f' % (c * 1e6)
+                                            for c in cost))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,93 @@
+"""Sensitivity of the PD, the cascaded and the INDI controller to model error.
+
+The controllers keep the nominal model of controller.c (Params) while the
+simulated airframe differs from it: heavier or lighter inertia, propellers
+with less thrust or more drag torque, slower motors. The motors of the
+simulated airframe lag the commands (Params.motor_tau), the controllers
+model them with the nominal time constant and lead them (Params.motor_lead).
+
+Each run starts 0.15 rad off in roll (a full stick step of ReadDesiredState())
+and gets a roll torque step of 0.02 N * m from 2 s to 4 s (a CG offset).
+Prints, per airframe:
+
+- settle: the time until the roll stays within 10 % of the step,
+- overshoot: in % of the step,
+- offset: the mean roll error over the last 0.5 s of the torque step.
+"""
+import numpy as np
+
+import quadrotor
+
+STEP = 0.15  # rad
+DURATION = 5.0  # s
+MOTOR_TAU = 0.03  # s, spin-up of the A2212 motors
+
+
+def disturbance(t):
+    tau = np.zeros(3)
+    if 2.0 <= t < 4.0:
+        tau[0] = 0.02  # N * m, roll
+    return tau
+
+
+def airframes():
+    nominal = quadrotor.Params()
+    nominal.motor_tau = MOTOR_TAU
+    yield 'nominal', nominal
+    for name, field, factor in [('inertia x 1.5', 'inertia', 1.5),
+                                ('inertia x 0.6', 'inertia', 0.6),
+                                ('thrust k x 0.8', 'k', 0.8),
+                                ('drag b x 1.5', 'b', 1.5),
+                                ('motor tau x 2', 'motor_tau', 2.0)]:
+        p = quadrotor.Params()
+        p.motor_tau = MOTOR_TAU
+        if field == 'inertia':
+            p.i_xx *= factor
+            p.i_yy *= factor
+            p.i_zz *= factor
+        else:
+            setattr(p, field, getattr(p, field) * factor)
+        yield name, p
+
+
+def metrics(t, eulers):
+    roll = eulers[:, 0]
+    before = t < 2.0
+    outside = np.nonzero(np.abs(roll[before]) > 0.1 * STEP)[0]
+    settle = t[outside[-1] + 1] if len(outside) else 0.0
+    overshoot = max(0.0, np.max(roll[before])) / STEP * 100.0
+    offset = np.mean(roll[(t >= 3.5) & (t < 4.0)]) * 180.0 / np.pi
+    return settle, overshoot, offset
+
+
+def main():
+    model = quadrotor.Params()
+    model.motor_tau = MOTOR_TAU
+    kinds = [quadrotor.PDController, quadrotor.CascadeController,
+             quadrotor.IndiController]
+    print('%-16s' % 'airframe' + ''.join('%-28s' % k.name for k in kinds))
+    print('%-16s' % '' + '%9s%10s%9s' % ('settle', 'overshoot', 'offset') *
+          len(kinds))
+    cost = np.zeros(len(kinds))
+    for name, plant in airframes():
+        line = '%-16s' % name
+        for i, kind in enumerate(kinds):
+            controller = kind(model)
+            t, eulers, _, cost_i = quadrotor.simulate(
+                controller, plant, DURATION, disturbance,
+                initial=(-STEP, 0.0, 0.0))
+            settle, overshoot, offset = metrics(t, eulers)
+            cost[i] += cost_i
+            if settle >= 2.0 - model.deltat:
+                line += '%9s' % '-'
+            else:
+                line += '%8.2fs' % settle
+            line += '%9.1f%%%9.2f' % (overshoot, offset)
+        print(line)
+    print('%-16s' % 'update [us]' + ''.join(
+        '%-28.1f' % (c / 6.0 * 1e6) for c in cost))
+    print('settle in s, offset in deg')
+
+
+if __name__ == '__main__':
+    main()
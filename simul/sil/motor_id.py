@@ -0,0 +1,101 @@
+"""Time constants of the motors from a thrust stand log.
+
+The log is a CSV file with one row per sample: the time in s, the command in
+omega^2 (or any unit proportional to it) and the measured rpm, with a motor
+column when several motors are in the same file:
+
+    t,cmd,rpm[,motor]
+
+The motors are fitted with the first order model of MotorModelUpdate() in
+controller.c, omega^2 following the command,
+
+    y[k + 1] = a y[k] + (1 - a) u[k],    a = exp(-dt / tau),
+
+by the least squares error of the simulated model on steps of the command.
+The rpm is turned into omega^2 and scaled to the command over the log, so the
+propeller constant does not matter.
+Prints the time constant of each motor for MOTOR_TAU_0..3. Without a log,
+fits a synthetic one with known time constants as a check.
+
+    python motor_id.py [log.csv]
+"""
+import sys
+
+import numpy as np
+
+
+def simulate(a, y0, cmd):
+    y = np.zeros(len(cmd))
+    y[0] = y0
+    for k in range(len(cmd) - 1):
+        y[k + 1] = a * y[k] + (1.0 - a) * cmd[k]
+    return y
+
+
+def fit_tau(t, cmd, rpm):
+    """Returns the time constant in s and the rms error of the fit."""
+    dt = np.mean(np.diff(t))
+    y = (2.0 * np.pi * rpm / 60.0)**2
+    # scale omega^2 to the command, the mean of both is the same in steady
+    # state
+    y = y * np.mean(cmd) / np.mean(y)
+
+    # one step predictions of y[k + 1] - u[k] = a (y[k] - u[k]) are biased
+    # toward a fast motor by the noise of y[k], so a only starts a golden
+    # section search on the error of the simulated model
+    x = y[:-1] - cmd[:-1]
+    a = np.clip(np.dot(x, y[1:] - cmd[:-1]) / np.dot(x, x), 1e-6, 1.0 - 1e-6)
+
+    def cost(log_tau):
+        model = simulate(np.exp(-dt / np.exp(log_tau)), y[0], cmd)
+        return np.mean((y - model)**2)
+
+    lo, hi = np.log(-dt / np.log(a)) - 1.0, np.log(-dt / np.log(a)) + 1.0
+    ratio = (np.sqrt(5.0) - 1.0) / 2.0
+    for _ in range(40):
+        c, d = hi - ratio * (hi - lo), lo + ratio * (hi - lo)
+        if cost(c) < cost(d):
+            hi = d
+        else:
+            lo = c
+    log_tau = 0.5 * (lo + hi)
+    return np.exp(log_tau), np.sqrt(cost(log_tau)) / np.mean(cmd)
+
+
+def synthetic(taus, dt=0.002, seed=0):
+    """Command steps between 30 % and 70 % of full throttle, rpm with 1 %
+    noise."""
+    rng = np.random.default_rng(seed)
+    full = (2.0 * np.pi * 6360 / 60.0)**2
+    n = 2000
+    t = np.arange(n) * dt
+    cmd = full * np.where(np.floor(t / 0.25) % 2, 0.7, 0.3)
+    rows = []
+    for motor, tau in enumerate(taus):
+        y = simulate(np.exp(-dt / tau), cmd[0], cmd)
+        rpm = np.sqrt(y) * 60.0 / (2.0 * np.pi) * \
+            (1.0 + rng.normal(0.0, 0.01, n))
+        rows.append((t, cmd, rpm, np.full(n, motor)))
+    return np.hstack([np.vstack(r) for r in rows]).T
+
+
+def main():
+    if len(sys.argv) > 1:
+        log = np.atleast_2d(np.genfromtxt(sys.argv[1], delimiter=',',
+                                          skip_header=1))
+        taus = None
+    else:
+        taus = [0.028, 0.030, 0.031, 0.033]
+        log = synthetic(taus)
+    motors = log[:, 3] if log.shape[1] > 3 else np.zeros(len(log))
+    print('%-8s%10s%12s%10s' % ('motor', 'tau [s]', 'fit error', 'true'))
+    for i, motor in enumerate(np.unique(motors)):
+        rows = log[motors == motor]
+        tau, error = fit_tau(rows[:, 0], rows[:, 1], rows[:, 2])
+        print('%-8d%10.4f%11.2f%%%10s' % (motor, tau, error * 100.0,
+                                         '-' if taus is None else
+                                         '%.4f' % taus[i]))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,140 @@
+"""Rate loop of the cascade with and without the motor lead of controller.c.
+
+The motors of the simulated airframe lag the commands by MOTOR_TAU. The
+controller models them with the same time constant and leads the commands of
+the mixer so that the motor model is left with a fraction MOTOR_LEAD of it
+(MotorModelUpdate()); a lead of 1 commands the motors with the output of the
+mixer as before. The outer angle loop is replaced by a roll rate setpoint.
+
+Prints, per lead:
+
+- rise: the time from 10 % to 90 % of a roll rate step of 1 rad/s,
+- overshoot: in % of the step,
+- bandwidth: the frequency where the roll rate follows a sine setpoint with
+  3 dB less amplitude,
+- noise: the rms of the motor commands around their mean in hover, in % of
+  the hover omega^2, from the gyro noise and a 55 Hz frame vibration,
+- drop: the lowest motor command, in % of MIN_MOTOR_OMEGA_SQ, when the
+  collective thrust of the mixer falls from hover to that floor in one
+  update. The lead overshoots downwards and must stop at the floor, or the
+  motors would stop in flight.
+
+Exits with 1 if a drop went below the floor.
+"""
+import copy
+import sys
+
+import numpy as np
+
+import quadrotor
+
+MOTOR_TAU = 0.03  # s, spin-up of the A2212 motors
+STEP = 1.0  # rad/s
+SWEEP = [1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 8.0, 10.0, 12.0, 15.0, 20.0]  # Hz
+LEADS = [1.0, 0.5, 0.33]
+
+
+class RateInput(quadrotor.CascadeController):
+    """Cascade with the roll rate setpoint given by rate(t)."""
+
+    def __init__(self, params, rate, **kwargs):
+        quadrotor.CascadeController.__init__(self, params, dyn_notch=False,
+                                             **kwargs)
+        self.rate = rate
+        self.step = -1
+
+    def outer_loop(self, s):
+        self.step += 1
+        self.rate_sp = np.array([self.rate(self.step * self.p.deltat),
+                                 0.0, 0.0])
+
+
+def roll_rate(t, eulers):
+    return np.gradient(eulers[:, 0], t)
+
+
+def step_response(model, plant):
+    controller = RateInput(model, lambda t: STEP if t >= 0.5 else 0.0)
+    t, eulers, _, _ = quadrotor.simulate(controller, plant, 1.5)
+    rate = roll_rate(t, eulers)[t >= 0.5] / STEP
+    rise = (np.argmax(rate >= 0.9) - np.argmax(rate >= 0.1)) * plant.deltat
+    return rise, max(0.0, np.max(rate) - 1.0) * 100.0
+
+
+def gain(model, plant, hz):
+    """Amplitude ratio of the roll rate to a sine setpoint of hz."""
+    amplitude = 0.5  # rad/s
+    controller = RateInput(model, lambda t: amplitude *
+                           np.sin(2.0 * np.pi * hz * t))
+    duration = 1.0 + 4.0 / hz
+    t, eulers, _, _ = quadrotor.simulate(controller, plant, duration)
+    rate = roll_rate(t, eulers)
+    last = t >= 1.0
+    basis = np.column_stack([np.sin(2.0 * np.pi * hz * t[last]),
+                             np.cos(2.0 * np.pi * hz * t[last])])
+    fit = np.linalg.lstsq(basis, rate[last], rcond=None)[0]
+    return np.hypot(*fit) / amplitude
+
+
+def bandwidth(model, plant):
+    gains = np.array([gain(model, plant, hz) for hz in SWEEP])
+    below = np.nonzero(gains < 10.0**(-3.0 / 20.0))[0]
+    if len(below) == 0:
+        return None
+    i = below[0]
+    if i == 0:
+        return SWEEP[0]
+    # interpolate in dB between the two neighbouring frequencies
+    db = 20.0 * np.log10(gains[i - 1:i + 1])
+    return np.interp(-3.0, db[::-1], SWEEP[i - 1:i + 1][::-1])
+
+
+def noise(model, plant):
+    """The motor commands are led again from the recorded mixer output, the
+    same as in simulate()."""
+    vibrating = copy.copy(plant)
+    vibrating.vibration = np.array([0.3, 0.3, 0.0])
+    vibrating.vibration_hz = 55.0
+    controller = RateInput(model, lambda t: 0.0)
+    _, _, omega_sq, _ = quadrotor.simulate(controller, vibrating, 2.0)
+    lead = quadrotor.Controller(model)
+    lead.motor_omega_sq = omega_sq[0].copy()
+    cmd = np.array([lead.motor_command(w) for w in omega_sq])[250:]
+    hover = plant.m * plant.g / (4.0 * plant.k)
+    return np.sqrt(np.mean((cmd - cmd.mean(axis=0))**2)) / hover * 100.0
+
+
+def drop(model, plant):
+    """The motor commands of a fall of the mixer output from hover to
+    MIN_MOTOR_OMEGA_SQ, held for 0.2 s."""
+    hover = plant.m * plant.g / (4.0 * plant.k)
+    lead = quadrotor.Controller(model)
+    lead.motor_omega_sq = np.full(4, hover)
+    steps = int(round(0.2 / plant.deltat))
+    cmd = np.array([lead.motor_command(np.full(4, plant.min_omega_sq))
+                    for _ in range(steps)])
+    return np.min(cmd) / plant.min_omega_sq * 100.0
+
+
+def main():
+    plant = quadrotor.Params()
+    plant.motor_tau = MOTOR_TAU
+    ok = True
+    print('%-12s%12s%14s%16s%12s%12s' % ('lead', 'rise [s]', 'overshoot',
+                                         'bandwidth [Hz]', 'noise', 'drop'))
+    for lead in LEADS:
+        model = copy.copy(plant)
+        model.motor_lead = lead
+        rise, overshoot = step_response(model, plant)
+        hz = bandwidth(model, plant)
+        floor = drop(model, plant)
+        ok = ok and floor >= 100.0 - 1e-3
+        print('%-12.2f%12.3f%13.1f%%%16s%11.1f%%%11.1f%%' % (
+            lead, rise, overshoot, '-' if hz is None else '%.1f' % hz,
+            noise(model, plant), floor))
+    print('motor floor held' if ok else 'motor floor FAILED')
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
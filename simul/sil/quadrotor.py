@@ -0,0 +1,555 @@
+"""Software-in-the-loop model of the quadrotor and of the flight controller.
+
+The controllers mirror flight_controller/controller.c line by line so that
+gains and structural changes can be compared here before they are flown.
+"""
+import numpy as np
+
+
+class Params:
+    def __init__(self):
+        # constants of controller.c
+        self.g = 9.81  # m * s^-2
+        self.m = 0.66  # kg
+        self.b = 5.4e-6  # N * m * Hz^-2
+        self.l = 0.25  # m
+        self.i_xx = 0.00884  # kg * m^2
+        self.i_yy = 0.00884  # kg * m^2
+        self.i_zz = 0.0165  # kg * m^2
+        self.k = (0.62 * 9.81) / (2 * np.pi * 6360 / 60)**2  # N * Hz^-2
+        self.full_omega_sq = (2.0 * np.pi * 6360 / 60.0)**2
+        self.max_omega_sq = self.full_omega_sq * 0.7
+        self.min_omega_sq = 0.1 / self.k
+
+        # timing
+        self.deltat = 1.0 / 250.0  # controller and IMU period, sec
+        self.substeps = 4  # physics steps per controller step
+
+        # time constant of the motor spin-up, sec, one for all motors or one
+        # per motor, 0 for motors that follow the commands at once
+        self.motor_tau = 0.0
+
+        # motor lead, the fraction of the motor time constant that is left
+        self.motor_lead = 0.5
+
+        # gyro noise, rad/s
+        self.gyro_noise = 0.00167
+
+        # frame vibration seen by the gyro after sampling (aliased), rad/s
+        # amplitude per axis and Hz
+        self.vibration = np.zeros(3)
+        self.vibration_hz = 0.0
+
+    @property
+    def inertia(self):
+        return np.array([self.i_xx, self.i_yy, self.i_zz])
+
+
+def dcm_to_eulers(r):
+    """Same as CompDCMComputeEulers(), returns [roll, pitch, yaw]."""
+    if r[2, 0] < 1.0:
+        if r[2, 0] > -1.0:
+            pitch = np.arcsin(-r[2, 0])
+            yaw = np.arctan2(r[1, 0], r[0, 0])
+            roll = np.arctan2(r[2, 1], r[2, 2])
+        else:
+            pitch = np.pi / 2.0
+            yaw = -np.arctan2(-r[1, 2], r[1, 1])
+            roll = 0.0
+    else:
+        pitch = -np.pi / 2.0
+        yaw = np.arctan2(-r[1, 2], r[1, 1])
+        roll = 0.0
+    return np.array([roll, pitch, yaw])
+
+
+def eulers_to_dcm(roll, pitch, yaw):
+    """Same as ComputeDCMFromEulers()."""
+    ca, sa = np.cos(yaw), np.sin(yaw)
+    cb, sb = np.cos(pitch), np.sin(pitch)
+    cg, sg = np.cos(roll), np.sin(roll)
+    return np.array([[ca * cb, ca * sb * sg - sa * cg, ca * sb * cg + sa * sg],
+                     [sa * cb, sa * sb * sg + ca * cg, sa * sb * cg - ca * sg],
+                     [-sb, cb * sg, cb * cg]])
+
+
+def rotation_increment(w, dt):
+    """Rodrigues increment used by CompDCMUpdate()."""
+    sigma = np.linalg.norm(w) * dt
+    b = np.array([[0.0, -w[2], w[1]],
+                  [w[2], 0.0, -w[0]],
+                  [-w[1], w[0], 0.0]]) * dt
+    if sigma < 1e-9:
+        return np.eye(3) + b
+    return np.eye(3) + np.sin(sigma) / sigma * b + \
+        (1.0 - np.cos(sigma)) / sigma**2 * b.dot(b)
+
+
+class Quadrotor:
+    """Rigid body attitude dynamics driven by the four omega^2 commands."""
+
+    def __init__(self, params, roll=0.0, pitch=0.0, yaw=0.0):
+        self.p = params
+        self.dcm = eulers_to_dcm(roll, pitch, yaw)
+        self.w = np.zeros(3)
+        self.omega_sq = np.full(4, params.m * params.g / (4.0 * params.k))
+        self.disturbance = np.zeros(3)
+
+    def torques(self, omega_sq):
+        p = self.p
+        arm = p.k * p.l / np.sqrt(2.0)
+        return np.array([
+            arm * (omega_sq[0] - omega_sq[1] - omega_sq[2] + omega_sq[3]),
+            arm * (-omega_sq[0] - omega_sq[1] + omega_sq[2] + omega_sq[3]),
+            p.b * (-omega_sq[0] + omega_sq[1] - omega_sq[2] + omega_sq[3])])
+
+    def step(self, omega_sq_cmd, dt):
+        self.omega_sq = self.omega_sq + (np.asarray(omega_sq_cmd) -
+                                         self.omega_sq) * \
+            dt / (np.asarray(self.p.motor_tau) + dt)
+        inertia = self.p.inertia
+        tau = self.torques(self.omega_sq) + self.disturbance
+        w_dot = (tau - np.cross(self.w, inertia * self.w)) / inertia
+        self.w = self.w + dt * w_dot
+        self.dcm = self.dcm.dot(rotation_increment(self.w, dt))
+
+    @property
+    def eulers(self):
+        return dcm_to_eulers(self.dcm)
+
+
+class ControllerState:
+    """What the controller sees: the tCompDCM fields it reads."""
+
+    def __init__(self):
+        self.euler = np.zeros(3)
+        self.gyro = np.zeros(3)
+        self.dcm = np.eye(3)
+
+
+MIXER_SAT_THRUST = 0x01
+MIXER_SAT_TORQUE = 0x02
+
+
+def tilt_thrust(p, thrust_z_dir, euler):
+    """TiltCompensatedThrust(): total omega^2 that holds the world z thrust."""
+    return thrust_z_dir * p.g / (p.k * np.cos(euler[0]) * np.cos(euler[1]))
+
+
+def mix(p, total_thrust, e):
+    """MixAngularAccel(): angular accelerations to omega^2 with torque priority.
+
+    Returns omega^2, the produced angular accelerations and the saturation
+    flags.
+    """
+    torq_gamma = p.i_xx * e[0] * 1.41421356237 / (p.l * p.k)
+    torq_beta = p.i_yy * e[1] * 1.41421356237 / (p.l * p.k)
+    torq_alpha = p.i_zz * e[2] / p.b
+    diff = np.array([torq_gamma - torq_beta - torq_alpha,
+                     -torq_gamma - torq_beta + torq_alpha,
+                     -torq_gamma + torq_beta - torq_alpha,
+                     torq_gamma + torq_beta + torq_alpha]) / 4.0
+    sat = 0
+    scale = 1.0
+    spread = diff.max() - diff.min()
+    if spread > p.max_omega_sq - p.min_omega_sq:
+        scale = (p.max_omega_sq - p.min_omega_sq) / spread
+        diff = diff * scale
+        sat |= MIXER_SAT_TORQUE
+    collective = total_thrust / 4.0
+    if collective + diff.max() > p.max_omega_sq:
+        collective = p.max_omega_sq - diff.max()
+        sat |= MIXER_SAT_THRUST
+    if collective + diff.min() < p.min_omega_sq:
+        collective = p.min_omega_sq - diff.min()
+        sat |= MIXER_SAT_THRUST
+    return collective + diff, scale * np.asarray(e, dtype=float), sat
+
+
+def legacy_mix(p, total_thrust, e):
+    """The mixer before torque priority: every motor clipped on its own."""
+    torq_gamma = p.i_xx * e[0] * 1.41421356237 / (p.l * p.k)
+    torq_beta = p.i_yy * e[1] * 1.41421356237 / (p.l * p.k)
+    torq_alpha = p.i_zz * e[2] / p.b
+    omega_sq = np.array([
+        total_thrust + torq_gamma - torq_beta - torq_alpha,
+        total_thrust - torq_gamma - torq_beta + torq_alpha,
+        total_thrust - torq_gamma + torq_beta - torq_alpha,
+        total_thrust + torq_gamma + torq_beta + torq_alpha]) / 4.0
+    return np.clip(omega_sq, p.min_omega_sq, p.max_omega_sq), \
+        np.asarray(e, dtype=float), 0
+
+
+class Biquad:
+    """Cascade of second order sections, mirrors biquad.c.
+
+    Every section is (b0, b1, b2, a1, a2) and filters all three axes.
+    """
+
+    def __init__(self, sections):
+        self.sections = [s for s in sections if s is not None]
+        self.z = np.zeros((len(self.sections), 2, 3))
+
+    @staticmethod
+    def low_pass(cutoff, rate):
+        """BiquadLowPassInit(), None for a disabled section."""
+        if not 0.0 < cutoff < 0.5 * rate:
+            return None
+        w = 2.0 * np.pi * cutoff / rate
+        alpha = np.sin(w) / (2.0 * np.sqrt(0.5))
+        a0 = 1.0 + alpha
+        return ((1.0 - np.cos(w)) / 2.0 / a0, (1.0 - np.cos(w)) / a0,
+                (1.0 - np.cos(w)) / 2.0 / a0, -2.0 * np.cos(w) / a0,
+                (1.0 - alpha) / a0)
+
+    @staticmethod
+    def notch(center, q, rate):
+        """BiquadNotchInit(), None for a disabled section."""
+        if not (0.0 < center < 0.5 * rate and q > 0.0):
+            return None
+        w = 2.0 * np.pi * center / rate
+        alpha = np.sin(w) / (2.0 * q)
+        a0 = 1.0 + alpha
+        return (1.0 / a0, -2.0 * np.cos(w) / a0, 1.0 / a0,
+                -2.0 * np.cos(w) / a0, (1.0 - alpha) / a0)
+
+    def __call__(self, x):
+        x = np.array(x, dtype=float)
+        for (b0, b1, b2, a1, a2), z in zip(self.sections, self.z):
+            y = b0 * x + z[0]
+            z[0] = b1 * x - a1 * y + z[1]
+            z[1] = b2 * x - a2 * y
+            x = y
+        return x
+
+
+class GyroFFT:
+    """Vibration peak tracking, mirrors gyro_fft.c.
+
+    The transform is done at once with numpy but only every `steps` samples,
+    the number of loop iterations the firmware spreads it over.
+    """
+
+    size = 128
+    steps = 20
+    threshold = 4.0
+    averaging = 0.25
+    smoothing = 0.5
+
+    def __init__(self, rate, min_hz=20.0, max_hz=125.0, peaks=2):
+        self.rate = rate
+        self.min_hz = min_hz
+        self.max_hz = max_hz
+        self.ring = []
+        self.counter = 0
+        self.spectrum = None
+        self.peak_hz = np.zeros(peaks)
+        self.window = 0.5 - 0.5 * np.cos(2.0 * np.pi * np.arange(self.size) /
+                                          self.size)
+
+    def add_sample(self, gyro):
+        """GyroFFTAddSample() and GyroFFTUpdate(), True on a new analysis."""
+        self.ring = (self.ring + [gyro[:2]])[-self.size:]
+        if len(self.ring) < self.size:
+            return False
+        self.counter += 1
+        if self.counter < self.steps:
+            return False
+        self.counter = 0
+
+        x = np.array(self.ring)
+        x = (x - x.mean(axis=0)) * self.window[:, None]
+        power = np.sum(np.abs(np.fft.fft(x, axis=0)[:self.size // 2])**2,
+                       axis=1)
+        if self.spectrum is None:
+            self.spectrum = power
+        else:
+            self.spectrum += self.averaging * (power - self.spectrum)
+        self.peaks()
+        return True
+
+    def peaks(self):
+        p = self.spectrum
+        bin_hz = self.rate / self.size
+        lo = max(int(np.ceil(self.min_hz / bin_hz)), 1)
+        hi = min(int(self.max_hz / bin_hz), self.size // 2 - 2)
+        if hi < lo:
+            return
+        mean = np.mean(p[lo:hi + 1])
+        found = [k for k in range(lo, hi + 1)
+                 if p[k] > self.threshold * mean and p[k] > p[k - 1] and
+                 p[k] >= p[k + 1]]
+        found = sorted(found, key=lambda k: -p[k])[:len(self.peak_hz)]
+        for k in found:
+            den = p[k - 1] - 2.0 * p[k] + p[k + 1]
+            offset = 0.5 * (p[k - 1] - p[k + 1]) / den if den < 0.0 else 0.0
+            hz = (k + offset) * bin_hz
+            dist = np.where(self.peak_hz > 0.0, np.abs(self.peak_hz - hz),
+                            self.max_hz - self.min_hz)
+            slot = int(np.argmin(dist))
+            if self.peak_hz[slot] > 0.0:
+                self.peak_hz[slot] += self.smoothing * (hz - self.peak_hz[slot])
+            else:
+                self.peak_hz[slot] = hz
+        nonzero = np.sort(self.peak_hz[self.peak_hz > 0.0])
+        self.peak_hz = np.concatenate([nonzero, np.zeros(len(self.peak_hz) -
+                                                         len(nonzero))])
+
+
+class Controller:
+    """Integrator and filter handling shared by the controllers
+    (IntegrateAntiWindup(), ControllerFiltersUpdate())."""
+
+    int_limit = 50.0  # rad/s^2
+    antiwindup_gain = 10.0  # 1/s
+
+    def __init__(self, params, antiwindup=True, mixer=mix, gyro_lpf_hz=80.0,
+                 dterm_lpf_hz=40.0, notch_hz=0.0, notch_q=2.0,
+                 dyn_notch=True):
+        self.p = params
+        self.antiwindup = antiwindup
+        self.mixer = mixer
+        rate = 1.0 / params.deltat
+        self.notch_q = notch_q
+        self.gyro_filter = Biquad([Biquad.notch(notch_hz, notch_q, rate),
+                                   Biquad.low_pass(gyro_lpf_hz, rate)])
+        self.dterm_filter = Biquad([Biquad.low_pass(dterm_lpf_hz, rate)])
+        self.gyro_fft = GyroFFT(rate) if dyn_notch else None
+        self.dyn_notch = Biquad([])
+        self.des = np.zeros(3)
+        self.thrust_z_dir = params.m
+        self.accel_cmd = np.zeros(3)
+        self.accel_out = np.zeros(3)
+        self.mixer_sat = 0
+        self.motor_tau = np.broadcast_to(params.motor_tau, 4).astype(float)
+        self.motor_omega_sq = np.zeros(4)
+
+    def filter_gyro(self, gyro):
+        """The gyro chain, with the tracking notches of
+        ControllerNotchTrack() in front of it."""
+        if self.gyro_fft is not None and self.gyro_fft.add_sample(gyro):
+            rate = 1.0 / self.p.deltat
+            sections = [Biquad.notch(hz, self.notch_q, rate)
+                        for hz in self.gyro_fft.peak_hz]
+            z = self.dyn_notch.z
+            self.dyn_notch = Biquad(sections)
+            if z.shape == self.dyn_notch.z.shape:
+                self.dyn_notch.z = z
+        return self.gyro_filter(self.dyn_notch(gyro))
+
+    def integrate(self, integral, increment, limit):
+        if self.antiwindup:
+            unproduced = self.accel_cmd - self.accel_out
+            increment = np.where(unproduced * increment > 0.0, 0.0, increment)
+            integral = integral + increment - \
+                self.antiwindup_gain * unproduced * self.p.deltat
+        else:
+            integral = integral + increment
+        return np.clip(integral, -limit, limit)
+
+    def motor_command(self, omega_sq):
+        """MotorModelUpdate(): leads the mixer output and advances the
+        motor model."""
+        p = self.p
+        tau = self.motor_tau
+        cmd = self.motor_omega_sq + (omega_sq - self.motor_omega_sq) * \
+            (tau + p.deltat) / (p.motor_lead * tau + p.deltat)
+        cmd = np.clip(cmd, np.minimum(p.min_omega_sq, omega_sq),
+                      p.full_omega_sq)
+        self.motor_omega_sq += (cmd - self.motor_omega_sq) * p.deltat / \
+            (tau + p.deltat)
+        return cmd
+
+    def output(self, total_thrust, accel):
+        omega_sq, self.accel_out, self.mixer_sat = \
+            self.mixer(self.p, total_thrust, accel)
+        return omega_sq
+
+
+class PDController(Controller):
+    """ErrorToInput()."""
+
+    name = 'pd'
+
+    def __init__(self, params, kp=5.0, kd=40.0, ki=2.0, **kwargs):
+        Controller.__init__(self, params, **kwargs)
+        self.kp = kp
+        self.kd = kd
+        self.ki = ki
+        self.angle_int = np.zeros(3)
+
+    def update(self, s):
+        rate = self.filter_gyro(s.gyro)
+        d_rate = self.dterm_filter(rate)
+        error = self.des - s.euler
+        self.angle_int = self.integrate(self.angle_int,
+                                        self.ki * error * self.p.deltat,
+                                        self.int_limit)
+        self.accel_cmd = self.kp * error + self.angle_int + \
+            self.kd * (0.0 - d_rate)
+        return self.output(tilt_thrust(self.p, self.thrust_z_dir, s.euler),
+                           self.accel_cmd)
+
+
+class CascadeController(Controller):
+    """CascadeErrorToInput()."""
+
+    name = 'cascade'
+
+    def __init__(self, params, angle_kp=(4.0, 4.0, 2.0), rate_limit=3.5,
+                 rate_kp=40.0, rate_ki=10.0, rate_kd=0.0, accel_limit=200.0,
+                 outer_divider=2, **kwargs):
+        Controller.__init__(self, params, **kwargs)
+        self.angle_kp = np.array(angle_kp, dtype=float)
+        self.rate_limit = rate_limit
+        self.rate_kp = rate_kp
+        self.rate_ki = rate_ki
+        self.rate_kd = rate_kd
+        self.accel_limit = accel_limit
+        self.outer_divider = outer_divider
+        self.outer_counter = outer_divider - 1
+        self.rate_sp = np.zeros(3)
+        self.rate_int = np.zeros(3)
+        self.last_rate = np.zeros(3)
+
+    def outer_loop(self, s):
+        """CascadeOuterLoop()."""
+        self.outer_counter += 1
+        if self.outer_counter >= self.outer_divider:
+            self.outer_counter = 0
+            self.rate_sp = np.clip(self.angle_kp * (self.des - s.euler),
+                                   -self.rate_limit, self.rate_limit)
+
+    def update(self, s):
+        dt = self.p.deltat
+        rate = self.filter_gyro(s.gyro)
+        self.outer_loop(s)
+        d_rate = self.dterm_filter((rate - self.last_rate) / dt)
+        self.last_rate = rate
+        error = self.rate_sp - rate
+        self.rate_int = self.integrate(self.rate_int,
+                                       self.rate_ki * error * dt,
+                                       self.accel_limit)
+        self.accel_cmd = self.rate_kp * error + self.rate_int - \
+            self.rate_kd * d_rate
+        return self.output(tilt_thrust(self.p, self.thrust_z_dir, s.euler),
+                           np.clip(self.accel_cmd, -self.accel_limit,
+                                   self.accel_limit))
+
+
+class IndiController(CascadeController):
+    """IndiErrorToInput(). The model of the motors and of the airframe comes
+    from the params given to the controller, which may differ from the ones
+    of the simulated quadrotor. The motor omega^2 is that of the motor model
+    of motor_command()."""
+
+    name = 'indi'
+
+    def __init__(self, params, lpf_hz=30.0, rate_kp=25.0, **kwargs):
+        CascadeController.__init__(self, params, rate_kp=rate_kp, **kwargs)
+        rate = 1.0 / params.deltat
+        self.last_rate = np.zeros(3)
+        self.rate_dot_filter = Biquad([Biquad.low_pass(lpf_hz, rate)])
+        self.accel_filter = Biquad([Biquad.low_pass(lpf_hz, rate)])
+
+    def update(self, s):
+        p = self.p
+        dt = p.deltat
+        rate = self.filter_gyro(s.gyro)
+        self.outer_loop(s)
+        rate_dot = self.rate_dot_filter((rate - self.last_rate) / dt)
+        self.last_rate = rate
+
+        w = self.motor_omega_sq
+        produced = np.array([
+            (w[0] - w[1] - w[2] + w[3]) * p.l * p.k / (1.41421356237 * p.i_xx),
+            (-w[0] - w[1] + w[2] + w[3]) * p.l * p.k /
+            (1.41421356237 * p.i_yy),
+            (-w[0] + w[1] - w[2] + w[3]) * p.b / p.i_zz])
+        produced = self.accel_filter(produced)
+
+        nu = np.clip(self.rate_kp * (self.rate_sp - rate), -self.accel_limit,
+                     self.accel_limit)
+        self.accel_cmd = produced + nu - rate_dot
+        return self.output(tilt_thrust(p, self.thrust_z_dir, s.euler),
+                           np.clip(self.accel_cmd, -self.accel_limit,
+                                   self.accel_limit))
+
+
+class GeometricController(Controller):
+    """GeometricErrorToInput()."""
+
+    name = 'geometric'
+    tilt_cos = 0.5  # GEOMETRIC_TILT_COS
+
+    def __init__(self, params, kp=5.0, kd=40.0, ki=2.0, **kwargs):
+        Controller.__init__(self, params, **kwargs)
+        self.kp = kp
+        self.kd = kd
+        self.ki = ki
+        self.angle_int = np.zeros(3)
+
+    def update(self, s):
+        p = self.p
+        rate = self.filter_gyro(s.gyro)
+        d_rate = self.dterm_filter(rate)
+        des = eulers_to_dcm(*self.des)
+        e = des.T.dot(s.dcm)
+        error = np.array([e[2, 1] - e[1, 2], e[0, 2] - e[2, 0],
+                          e[1, 0] - e[0, 1]]) / \
+            np.sqrt(max(1.0 + np.trace(e), 1e-4))
+        self.angle_int = self.integrate(self.angle_int,
+                                        -self.ki * error * p.deltat,
+                                        self.int_limit)
+        inertia = p.inertia
+        self.accel_cmd = -self.kp * error + self.angle_int - \
+            self.kd * d_rate + np.cross(rate, inertia * rate) / inertia
+        tilt = s.dcm[2, 2]
+        if tilt >= self.tilt_cos:
+            thrust = self.thrust_z_dir * p.g / (p.k * tilt)
+        else:
+            thrust = max(tilt, 0.0) * self.thrust_z_dir * p.g / \
+                (p.k * self.tilt_cos**2)
+        return self.output(thrust, self.accel_cmd)
+
+
+def simulate(controller, params, duration, disturbance=None, initial=(0, 0, 0),
+             seed=0, setpoint=None):
+    """Closed loop run with an ideal attitude estimate and a noisy gyro.
+
+    disturbance(t) returns the external body torque in N * m, setpoint(t) the
+    desired Euler angles. The motors get the commands of the mixer through
+    the motor model and lead of PDContUpdatePWM(), which starts in hover.
+    Returns the time, the true Euler angles, the omega^2 of the mixer and the
+    time spent in the controller update per call.
+    """
+    import time
+
+    rng = np.random.default_rng(seed)
+    quad = Quadrotor(params, *initial)
+    state = ControllerState()
+    steps = int(round(duration / params.deltat))
+    t = np.arange(steps) * params.deltat
+    eulers = np.zeros((steps, 3))
+    omega_sq = np.zeros((steps, 4))
+    cost = 0.0
+    cmd = quad.omega_sq
+    controller.motor_omega_sq = quad.omega_sq.copy()
+    for i in range(steps):
+        if disturbance is not None:
+            quad.disturbance = np.asarray(disturbance(t[i]), dtype=float)
+        if setpoint is not None:
+            controller.des = np.asarray(setpoint(t[i]), dtype=float)
+        for _ in range(params.substeps):
+            quad.step(cmd, params.deltat / params.substeps)
+        state.euler = quad.eulers
+        state.dcm = quad.dcm.copy()
+        state.gyro = quad.w + rng.normal(0.0, params.gyro_noise, 3) + \
+            params.vibration * np.sin(2.0 * np.pi * params.vibration_hz * t[i])
+        start = time.perf_counter()
+        mixed = controller.update(state)
+        cost += time.perf_counter() - start
+        cmd = controller.motor_command(mixed)
+        eulers[i] = state.euler
+        omega_sq[i] = mixed
+    return t, eulers, omega_sq, cost / steps
@@ -0,0 +1,7 @@
+//*****************************************************************************
+//
+// debug.h - SITL stand-in for the TivaWare header, see sitl_tivaware.h.
+//
+//*****************************************************************************
+
+#include "sitl_tivaware.h"
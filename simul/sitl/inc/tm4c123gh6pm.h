@@ -0,0 +1,7 @@
+//*****************************************************************************
+//
+// tm4c123gh6pm.h - SITL stand-in for the TivaWare header, see sitl_tivaware.h.
+//
+//*****************************************************************************
+
+#include "sitl_tivaware.h"
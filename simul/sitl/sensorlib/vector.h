@@ -0,0 +1,6 @@
+//*****************************************************************************
+//
+// vector.h - SITL stand-in for the vector functions of the TivaWare sensor
+// library. comp_dcm.c includes it but does its own vector math.
+//
+//*****************************************************************************
@@ -0,0 +1,95 @@
+//*****************************************************************************
+//
+// sitl.h - The simulated microcontroller and board of the SITL target, as
+// seen from the host program.
+//
+//*****************************************************************************
+
+#ifndef _SITL_H_
+#define _SITL_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sensorlib/i2cm_drv.h"
+#include "mpu9150_model.h"
+
+//*****************************************************************************
+//
+// The system clock of the firmware, the radio link and the console. A byte
+// on a UART takes 10 bits.
+//
+//*****************************************************************************
+#define SITL_CLOCK_HZ           40000000
+#define SITL_NS_PER_CYCLE       (1000000000 / SITL_CLOCK_HZ)
+#define SITL_RADIO_BAUD         9600
+#define SITL_RADIO_BYTE_NS      (10ULL * 1000000000ULL / SITL_RADIO_BAUD)
+#define SITL_CONSOLE_BAUD       115200
+#define SITL_CONSOLE_BYTE_NS    (10ULL * 1000000000ULL / SITL_CONSOLE_BAUD)
+
+//*****************************************************************************
+//
+// The I2C address of the MPU9150, as main.c uses it.
+//
+//*****************************************************************************
+#define SITL_MPU9150_ADDR       0x68
+
+//*****************************************************************************
+//
+// Statistics of a run.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // Interrupts taken, and the quanta of virtual time given to a CPU that
+    // spun on a flag.
+    //
+    uint32_t ui32Interrupts;
+    uint32_t ui32SpinQuanta;
+
+    //
+    // Radio bytes lost: received while the UART was not set up, or with a
+    // full receive FIFO, and bytes sent to the ground.
+    //
+    uint32_t ui32RadioDropped;
+    uint32_t ui32RadioOverruns;
+    uint32_t ui32RadioSent;
+
+    //
+    // Console bytes discarded by UARTprintf() with a full transmit buffer,
+    // and bytes sent.
+    //
+    uint32_t ui32ConsoleDropped;
+    uint32_t ui32ConsoleSent;
+}
+tSitlStats;
+
+//*****************************************************************************
+//
+// Provided by the host program: the time of its next event, and running its
+// events that are due at ui64Now. The physics and the pilot are such events.
+//
+//*****************************************************************************
+extern uint64_t SitlHostNext(void);
+extern void SitlHostRun(uint64_t ui64Now);
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern bool SitlInit(tMPU9150TruthGet *pfnTruth, void *pvTruthData,
+                     const tI2CMFakeConfig *psBus);
+extern void SitlConsoleSet(FILE *psConsole);
+extern bool SitlFlashLoad(const char *pcFile);
+extern bool SitlFlashSave(const char *pcFile);
+extern void SitlRun(int (*pfnFirmware)(void), uint64_t ui64End);
+extern uint64_t SitlNow(void);
+extern void SitlRadioSend(const uint8_t *pui8Data, uint32_t ui32Count);
+extern uint32_t SitlRadioReceive(uint8_t *pui8Data, uint32_t ui32Max);
+extern float SitlMotorPulse(uint32_t ui32Motor);
+extern const tMPU9150Model *SitlSensorGet(void);
+extern const tSitlStats *SitlStatsGet(void);
+
+#endif // _SITL_H_
@@ -0,0 +1,864 @@
+//*****************************************************************************
+//
+// sitl_host.c - Flies the unmodified flight controller firmware in a
+// software-in-the-loop simulation, faster than real time.
+//
+// main() of flight_controller/main.c runs from reset on the simulated
+// microcontroller of sitl_hw.c, renamed to FirmwareMain() by the build. Its
+// interrupt handlers, IntGPIOb(), MPU9150I2CIntHandler(), UART2IntHandler()
+// and SysTickIntHandler(), are taken as the events of the board come due on
+// a virtual clock, and the PWM outputs drive the ESCs and motors of the
+// airframe in sitl_quad.c. The MPU9150 is the register level model of
+// simul/mpu9150_model on its simulated I2C bus, sampling the motion of the
+// airframe.
+//
+// A pilot on the ground flies the flight script over the radio, with the
+// packets of the firmware at 50 Hz and 9600 baud. The thrust stick holds
+// the altitude of the script, the attitude sticks move the setpoints of the
+// firmware to the ones of the script, and parameter requests are sent until
+// they are acknowledged. The script has one command per line, after its
+// time in s:
+//
+//   <t> alt <m>                           altitude to hold, 0 lands
+//   <t> att <roll> <pitch> <yaw>          setpoints in degrees, up to 8.6
+//   <t> param <id> <value>                parameter request of params.h, nan
+//                                         reads the parameter
+//   <t> bus <addr> <data> <error> <hang>  I2C faults in parts per million
+//   <t> end                               end of the flight
+//
+// with # starting a comment. At the end the flight is checked: the firmware
+// booted, the quadrotor took off, held the altitude and stayed upright, its
+// attitude estimate followed the truth, it landed without a crash, the
+// flight recorder dropped no record in the air and every parameter request
+// was acknowledged.
+//
+// Build and run from this directory (the compile command is one line):
+//
+//   cc -O2 -funsigned-char -Dmain=FirmwareMain -I. -I../mpu9150_model
+//      -I../sensor_model -I../../flight_controller -o sitl_host sitl_host.c
+//      sitl_hw.c sitl_quad.c ../sensor_model/sensor_model.c
+//      ../mpu9150_model/mpu9150_model.c
+//      ../mpu9150_model/i2cm_fake.c ../../flight_controller/main.c
+//      ../../flight_controller/mpu9150mod.c
+//      ../../flight_controller/comp_dcm.c ../../flight_controller/att_ekf.c
+//      ../../flight_controller/controller.c
+//      ../../flight_controller/autotune.c ../../flight_controller/biquad.c
+//      ../../flight_controller/buffer.c ../../flight_controller/escpwm.c
+//      ../../flight_controller/hc12.c ../../flight_controller/params.c
+//      ../../flight_controller/perf.c ../../flight_controller/gyro_fft.c
+//      ../../flight_controller/gyro_temp.c
+//      ../../flight_controller/mag_cal.c
+//      ../../flight_controller/blackbox.c
+//      ../../flight_controller/flight_log.c
+//      ../../flight_controller/crash_ring.c
+//      ../../flight_controller/i2c_recover.c -lm
+//   ./sitl_host [-c console.txt] [-f flash.bin] [-r ring.bin] [-s seed]
+//      [-t trace.csv] [flight.txt]
+//
+// -funsigned-char keeps the char of the ARM compiler, which the radio
+// packet code relies on. The console of UART0 goes to -c as the board sends
+// it, CR LF and at 115200 baud from the 1 kB buffer of UARTStdio, the LOG
+// region of the flash is loaded from and saved to -f so that the flights add
+// up as on the board, the crash ring is loaded from and saved to -r like the
+// RAM that survives a warm reset, so that the next run prints the capture
+// that the last one froze for simul/sil/crash_capture.py, and -t writes the truth, the estimate and the setpoints at
+// 50 Hz. The script defaults to flight.txt, a 10 minute flight. Adding
+// -DCONTROLLER_DEFAULT_MODE=CONTROLLER_MODE_INDI (or _CASCADE, _GEOMETRIC)
+// to the build flies the same script with another controller.
+//
+//*****************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "blackbox.h"
+#include "buffer.h"
+#include "comp_dcm.h"
+#include "controller.h"
+#include "crash_ring.h"
+#include "params.h"
+#include "i2c_recover.h"
+#include "sitl.h"
+#include "sitl_quad.h"
+
+//*****************************************************************************
+//
+// The firmware's main(), see the build command, and the state of the
+// firmware the checks and the pilot look at.
+//
+//*****************************************************************************
+#undef main
+extern int FirmwareMain(void);
+extern tPDController g_sPDControllerInst;
+extern tCompDCM g_sCompDCMInst;
+extern tI2CRecover g_sI2CRecoverInst;
+extern tBlackBox g_sBlackBoxInst;
+extern tCrashRing g_sCrashRing;
+extern uint32_t g_ui32CyclesPerMs;
+
+//*****************************************************************************
+//
+// Time steps in ns: the physics and the radio packets of the pilot.
+//
+//*****************************************************************************
+#define NS_PER_S                1000000000ULL
+#define PHYSICS_NS              250000ULL
+#define PACKET_NS               20000000ULL
+
+//*****************************************************************************
+//
+// The pilot: the gain from the altitude error to the climb rate in 1/s, the
+// largest climb rate in m/s, the weight of the vertical acceleration in s
+// and the dead band of the thrust stick in m/s. Landing aims below the
+// ground so that the descent does not slow down on the way. The attitude
+// sticks move a setpoint by 0.05 rad per packet and stop within half of it,
+// the board limits the setpoints to 0.15 rad.
+//
+//*****************************************************************************
+#define PILOT_ALT_GAIN          1.0f
+#define PILOT_CLIMB             0.5f
+#define PILOT_ACCEL_GAIN        0.3f
+#define PILOT_DEAD_BAND         0.05f
+#define PILOT_LAND_M            0.5f
+#define PILOT_ANGLE_BAND        0.025f
+#define PILOT_ANGLE_MAX         0.15f
+#define STICK_LOW               0
+#define STICK_CENTER            128
+#define STICK_HIGH              255
+
+//*****************************************************************************
+//
+// The checks: the altitude that counts as airborne, the time after an
+// altitude command before the error counts, and the limits of a good flight.
+//
+//*****************************************************************************
+#define AIRBORNE_M              0.1f
+#define SETTLE_S                5.0f
+#define MAX_TILT_DEG            30.0f
+#define MAX_ALT_RMS_M           0.5f
+#define MAX_EST_RMS_DEG         3.0f
+
+#define RAD_TO_DEG              57.2957795f
+
+//*****************************************************************************
+//
+// The commands of the flight script.
+//
+//*****************************************************************************
+#define COMMAND_ALT             0
+#define COMMAND_ATT             1
+#define COMMAND_PARAM           2
+#define COMMAND_BUS             3
+#define COMMAND_END             4
+#define MAX_COMMANDS            256
+
+typedef struct
+{
+    uint64_t ui64Time;
+    uint32_t ui32Command;
+    float pfArgs[4];
+}
+tCommand;
+
+static tCommand g_psCommands[MAX_COMMANDS];
+static uint32_t g_ui32Commands;
+
+//*****************************************************************************
+//
+// The host side of the simulation: the airframe, the seed, the next events,
+// the pilot and the checks.
+//
+//*****************************************************************************
+static struct
+{
+    tSitlQuad sQuad;
+    uint32_t ui32Seed;
+    uint64_t ui64NextPhysics;
+    uint64_t ui64NextPacket;
+    uint32_t ui32NextCommand;
+    FILE *psTrace;
+
+    //
+    // The pilot: the altitude and attitude of the script, the parameter
+    // request in flight with its sequence number, the packet counter, the
+    // attitude sticks of the last packet and the last bytes from the board.
+    //
+    float fAltitude;
+    uint64_t ui64AltitudeTime;
+    float pfAttitude[3];
+    uint32_t ui32Request;
+    uint8_t ui8Seq;
+    uint8_t ui8Counter;
+    uint8_t pui8Stick[3];
+    uint8_t pui8Ack[PARAM_ACK_LENGTH];
+
+    //
+    // The checks.
+    //
+    uint32_t ui32Requests;
+    uint32_t ui32Acked;
+    uint32_t ui32Rejected;
+    uint64_t ui64Boot;
+    uint64_t ui64Airborne;
+    float fMaxTarget;
+    float fMaxAltitude;
+    float fMaxTilt;
+    double dAltErrorSq;
+    uint32_t ui32AltSamples;
+    double dEstErrorSq;
+    uint32_t ui32EstSamples;
+    uint32_t ui32LogDropped;
+    uint32_t ui32AirDropped;
+}
+g_sHost;
+
+//*****************************************************************************
+//
+// Reads the flight script. Returns false with a message on an error.
+//
+//*****************************************************************************
+static bool
+ScriptRead(const char *pcFile)
+{
+    static const char * const ppcNames[] =
+    {
+        "alt", "att", "param", "bus", "end"
+    };
+    static const int piArgs[] = { 1, 3, 2, 4, 0 };
+    char pcLine[256], pcName[16];
+    float fTime, pfArgs[4];
+    uint32_t ui32Line = 0, ui32Command;
+    int iFields;
+    FILE *psFile = fopen(pcFile, "r");
+
+    if (!psFile)
+    {
+        fprintf(stderr, "cannot read %s\n", pcFile);
+        return false;
+    }
+
+    while (fgets(pcLine, sizeof(pcLine), psFile))
+    {
+        ui32Line++;
+        if (strchr(pcLine, '#'))
+        {
+            *strchr(pcLine, '#') = 0;
+        }
+        iFields = sscanf(pcLine, "%f %15s %f %f %f %f", &fTime, pcName,
+                         &pfArgs[0], &pfArgs[1], &pfArgs[2], &pfArgs[3]);
+        if (iFields <= 0)
+        {
+            continue;
+        }
+        for (ui32Command = 0; ui32Command <= COMMAND_END; ui32Command++)
+        {
+            if ((iFields >= 2) && !strcmp(pcName, ppcNames[ui32Command]))
+            {
+                break;
+            }
+        }
+        if ((ui32Command > COMMAND_END) ||
+            (iFields != 2 + piArgs[ui32Command]) || (fTime < 0.0f) ||
+            (g_ui32Commands &&
+             (fTime * NS_PER_S < g_psCommands[g_ui32Commands - 1].ui64Time)) ||
+            (g_ui32Commands == MAX_COMMANDS))
+        {
+            fprintf(stderr, "%s:%u: bad command\n", pcFile, ui32Line);
+            fclose(psFile);
+            return false;
+        }
+        g_psCommands[g_ui32Commands].ui64Time = (uint64_t)(fTime * NS_PER_S);
+        g_psCommands[g_ui32Commands].ui32Command = ui32Command;
+        memcpy(g_psCommands[g_ui32Commands].pfArgs, pfArgs, sizeof(pfArgs));
+        g_ui32Commands++;
+    }
+    fclose(psFile);
+
+    if (!g_ui32Commands ||
+        (g_psCommands[g_ui32Commands - 1].ui32Command != COMMAND_END))
+    {
+        fprintf(stderr, "%s: no end\n", pcFile);
+        return false;
+    }
+    return true;
+}
+
+//*****************************************************************************
+//
+// Carries out a command of the script.
+//
+//*****************************************************************************
+static void
+ScriptRun(const tCommand *psCommand)
+{
+    tI2CMFakeConfig sBus = { 0 };
+    int i;
+
+    switch (psCommand->ui32Command)
+    {
+    case COMMAND_ALT:
+        g_sHost.fAltitude = psCommand->pfArgs[0];
+        g_sHost.ui64AltitudeTime = psCommand->ui64Time;
+        if (g_sHost.fAltitude > g_sHost.fMaxTarget)
+        {
+            g_sHost.fMaxTarget = g_sHost.fAltitude;
+        }
+        break;
+    case COMMAND_ATT:
+        //
+        // The board stops the setpoints at PILOT_ANGLE_MAX, and so does the
+        // pilot.
+        //
+        for (i = 0; i < 3; i++)
+        {
+            g_sHost.pfAttitude[i] = psCommand->pfArgs[i] / RAD_TO_DEG;
+            if (g_sHost.pfAttitude[i] > PILOT_ANGLE_MAX)
+            {
+                g_sHost.pfAttitude[i] = PILOT_ANGLE_MAX;
+            }
+            if (g_sHost.pfAttitude[i] < -PILOT_ANGLE_MAX)
+            {
+                g_sHost.pfAttitude[i] = -PILOT_ANGLE_MAX;
+            }
+        }
+        break;
+    case COMMAND_PARAM:
+        g_sHost.ui32Requests++;
+        break;
+    case COMMAND_BUS:
+        sBus.ui32LatencyNs = 20000;
+        sBus.ui32JitterNs = 10000;
+        sBus.ui32ByteNs = 22500;
+        sBus.ui32AddrNackPpm = (uint32_t)psCommand->pfArgs[0];
+        sBus.ui32DataNackPpm = (uint32_t)psCommand->pfArgs[1];
+        sBus.ui32BusErrorPpm = (uint32_t)psCommand->pfArgs[2];
+        sBus.ui32HangPpm = (uint32_t)psCommand->pfArgs[3];
+        sBus.ui32Seed = g_sHost.ui32Seed + (uint32_t)psCommand->ui64Time;
+        I2CMFakeConfigSet(&sBus);
+        break;
+    }
+}
+
+//*****************************************************************************
+//
+// The truth of the MPU9150 model.
+//
+//*****************************************************************************
+static void
+HostTruth(void *pvData, uint64_t ui64Now, tMPU9150Truth *psTruth)
+{
+    SitlQuadTruth(&g_sHost.sQuad, ui64Now * 1e-9f, psTruth);
+}
+
+//*****************************************************************************
+//
+// Returns the stick position that moves toward fError.
+//
+//*****************************************************************************
+static uint8_t
+PilotStick(float fError, float fBand)
+{
+    if (fError > fBand)
+    {
+        return STICK_HIGH;
+    }
+    if (fError < -fBand)
+    {
+        return STICK_LOW;
+    }
+    return STICK_CENTER;
+}
+
+//*****************************************************************************
+//
+// Takes the acknowledgements the board sent. The request in flight is done
+// with the one of its sequence number.
+//
+//*****************************************************************************
+static void
+PilotReceive(void)
+{
+    uint8_t ui8Byte;
+    const tCommand *psRequest;
+
+    while (SitlRadioReceive(&ui8Byte, 1))
+    {
+        memmove(g_sHost.pui8Ack, g_sHost.pui8Ack + 1, PARAM_ACK_LENGTH - 1);
+        g_sHost.pui8Ack[PARAM_ACK_LENGTH - 1] = ui8Byte;
+        if (!g_sHost.ui32Request || (g_sHost.pui8Ack[7] != 'e') ||
+            (g_sHost.pui8Ack[2] != g_sHost.ui8Seq))
+        {
+            continue;
+        }
+        psRequest = &g_psCommands[g_sHost.ui32Request - 1];
+        if (g_sHost.pui8Ack[1] != (uint8_t)psRequest->pfArgs[0])
+        {
+            continue;
+        }
+        if (g_sHost.pui8Ack[0] == PARAM_ACK_APPLIED)
+        {
+            g_sHost.ui32Acked++;
+        }
+        else if (g_sHost.pui8Ack[0] == PARAM_ACK_REJECTED)
+        {
+            g_sHost.ui32Rejected++;
+        }
+        else
+        {
+            continue;
+        }
+        g_sHost.ui32Request = 0;
+    }
+}
+
+//*****************************************************************************
+//
+// Sends the packet of the sticks and of the parameter request in flight.
+//
+//*****************************************************************************
+static void
+PilotSend(void)
+{
+    tSitlQuad *psQuad = &g_sHost.sQuad;
+    uint8_t pui8Packet[PACKET_LENGTH];
+    float fTarget, fClimb, fError, fValue;
+    uint32_t i;
+
+    memset(pui8Packet, 0, sizeof(pui8Packet));
+    pui8Packet[0] = 's';
+    pui8Packet[PACKET_LENGTH - 1] = 'e';
+
+    //
+    // Thrust: a climb rate toward the altitude, and the stick that corrects
+    // the vertical speed with its acceleration.
+    //
+    fTarget = g_sHost.fAltitude;
+    if (fTarget <= 0.0f)
+    {
+        fTarget = -PILOT_LAND_M;
+    }
+    fClimb = PILOT_ALT_GAIN * (fTarget - psQuad->pfPos[2]);
+    fClimb = (fClimb > PILOT_CLIMB) ? PILOT_CLIMB :
+             ((fClimb < -PILOT_CLIMB) ? -PILOT_CLIMB : fClimb);
+    fError = fClimb - psQuad->pfVel[2] - PILOT_ACCEL_GAIN * psQuad->pfAccel[2];
+    pui8Packet[1] = PilotStick(fError, PILOT_DEAD_BAND);
+    if (psQuad->bOnGround && (g_sHost.fAltitude <= 0.0f))
+    {
+        pui8Packet[1] = STICK_LOW;
+    }
+
+    //
+    // Yaw, pitch and roll, toward the setpoints of the script. The board
+    // acts on a packet while the next one is on the way, so a stick that
+    // moved goes back to the center for a packet before the setpoint of the
+    // board is looked at again.
+    //
+    for (i = 0; i < 3; i++)
+    {
+        pui8Packet[4 - i] = STICK_CENTER;
+        if (g_sHost.pui8Stick[i] == STICK_CENTER)
+        {
+            pui8Packet[4 - i] =
+                PilotStick(g_sHost.pfAttitude[i] -
+                           g_sPDControllerInst.fDesState[i],
+                           PILOT_ANGLE_BAND);
+        }
+        g_sHost.pui8Stick[i] = pui8Packet[4 - i];
+    }
+
+    //
+    // The parameter request in flight, repeated until it is acknowledged.
+    //
+    if (g_sHost.ui32Request)
+    {
+        fValue = g_psCommands[g_sHost.ui32Request - 1].pfArgs[1];
+        pui8Packet[PARAM_PACKET_SEQ] = g_sHost.ui8Seq;
+        pui8Packet[PARAM_PACKET_ID] =
+            (uint8_t)g_psCommands[g_sHost.ui32Request - 1].pfArgs[0];
+        memcpy(pui8Packet + PARAM_PACKET_VALUE, &fValue, sizeof(float));
+        for (i = PARAM_PACKET_SEQ; i < PARAM_PACKET_CHECKSUM; i++)
+        {
+            pui8Packet[PARAM_PACKET_CHECKSUM] ^= pui8Packet[i];
+        }
+    }
+    pui8Packet[PARAM_PACKET_COUNTER] = ++g_sHost.ui8Counter;
+
+    SitlRadioSend(pui8Packet, PACKET_LENGTH);
+}
+
+//*****************************************************************************
+//
+// Writes a row of the trace.
+//
+//*****************************************************************************
+static void
+TraceWrite(uint64_t ui64Now)
+{
+    tSitlQuad *psQuad = &g_sHost.sQuad;
+    float pfEulers[3];
+
+    SitlQuadEulers(psQuad, pfEulers);
+    fprintf(g_sHost.psTrace, "%.3f,%.3f,%.3f,%.3f,%.2f,%.2f,%.2f,%.2f,%.2f,"
+            "%.2f,%.2f,%.2f,%.2f,%.3f,%.0f,%.0f,%.0f,%.0f\n", ui64Now * 1e-9,
+            psQuad->pfPos[0], psQuad->pfPos[1], psQuad->pfPos[2],
+            pfEulers[0] * RAD_TO_DEG, pfEulers[1] * RAD_TO_DEG,
+            pfEulers[2] * RAD_TO_DEG,
+            g_sCompDCMInst.fEuler[0] * RAD_TO_DEG,
+            g_sCompDCMInst.fEuler[1] * RAD_TO_DEG,
+            g_sCompDCMInst.fEuler[2] * RAD_TO_DEG,
+            g_sPDControllerInst.fDesState[0] * RAD_TO_DEG,
+            g_sPDControllerInst.fDesState[1] * RAD_TO_DEG,
+            g_sPDControllerInst.fDesState[2] * RAD_TO_DEG,
+            g_sPDControllerInst.fThrustZDir, psQuad->pfOmega[0],
+            psQuad->pfOmega[1], psQuad->pfOmega[2], psQuad->pfOmega[3]);
+}
+
+//*****************************************************************************
+//
+// Updates the checks after a physics step.
+//
+//*****************************************************************************
+static void
+CheckUpdate(uint64_t ui64Now)
+{
+    tSitlQuad *psQuad = &g_sHost.sQuad;
+    float pfEulers[3], fError;
+    int i;
+
+    if (!g_sHost.ui64Boot && g_ui32CyclesPerMs)
+    {
+        g_sHost.ui64Boot = ui64Now;
+    }
+    if (psQuad->pfPos[2] < AIRBORNE_M)
+    {
+        g_sHost.ui32LogDropped = g_sBlackBoxInst.ui32Dropped;
+        return;
+    }
+
+    g_sHost.ui64Airborne += PHYSICS_NS;
+    g_sHost.ui32AirDropped += g_sBlackBoxInst.ui32Dropped -
+                              g_sHost.ui32LogDropped;
+    g_sHost.ui32LogDropped = g_sBlackBoxInst.ui32Dropped;
+    if (psQuad->pfPos[2] > g_sHost.fMaxAltitude)
+    {
+        g_sHost.fMaxAltitude = psQuad->pfPos[2];
+    }
+    if (SitlQuadTilt(psQuad) > g_sHost.fMaxTilt)
+    {
+        g_sHost.fMaxTilt = SitlQuadTilt(psQuad);
+    }
+
+    if ((g_sHost.fAltitude > 0.0f) &&
+        (ui64Now > g_sHost.ui64AltitudeTime + SETTLE_S * NS_PER_S))
+    {
+        fError = psQuad->pfPos[2] - g_sHost.fAltitude;
+        g_sHost.dAltErrorSq += fError * fError;
+        g_sHost.ui32AltSamples++;
+    }
+
+    SitlQuadEulers(psQuad, pfEulers);
+    for (i = 0; i < 2; i++)
+    {
+        fError = g_sCompDCMInst.fEuler[i] - pfEulers[i];
+        g_sHost.dEstErrorSq += fError * fError;
+    }
+    g_sHost.ui32EstSamples += 2;
+}
+
+//*****************************************************************************
+//
+// The events of the host: the physics, the commands of the script and the
+// packets of the pilot.
+//
+//*****************************************************************************
+uint64_t
+SitlHostNext(void)
+{
+    uint64_t ui64Next = g_sHost.ui64NextPhysics;
+
+    if (g_sHost.ui64NextPacket < ui64Next)
+    {
+        ui64Next = g_sHost.ui64NextPacket;
+    }
+    if ((g_sHost.ui32NextCommand < g_ui32Commands) &&
+        (g_psCommands[g_sHost.ui32NextCommand].ui64Time < ui64Next))
+    {
+        ui64Next = g_psCommands[g_sHost.ui32NextCommand].ui64Time;
+    }
+    return ui64Next;
+}
+
+void
+SitlHostRun(uint64_t ui64Now)
+{
+    float pfPulse[4];
+    uint32_t i;
+
+    while (g_sHost.ui64NextPhysics <= ui64Now)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            pfPulse[i] = SitlMotorPulse(i);
+        }
+        SitlQuadStep(&g_sHost.sQuad, pfPulse, PHYSICS_NS * 1e-9f);
+        CheckUpdate(g_sHost.ui64NextPhysics);
+        g_sHost.ui64NextPhysics += PHYSICS_NS;
+    }
+
+    while ((g_sHost.ui32NextCommand < g_ui32Commands) &&
+           (g_psCommands[g_sHost.ui32NextCommand].ui64Time <= ui64Now))
+    {
+        ScriptRun(&g_psCommands[g_sHost.ui32NextCommand++]);
+    }
+
+    if (g_sHost.ui64NextPacket <= ui64Now)
+    {
+        PilotReceive();
+
+        //
+        // The next request of the script goes out once the one before it
+        // was acknowledged.
+        //
+        while (!g_sHost.ui32Request &&
+               (g_sHost.ui32Requests > g_sHost.ui32Acked +
+                                      g_sHost.ui32Rejected))
+        {
+            for (i = 0; i < g_sHost.ui32NextCommand; i++)
+            {
+                if ((g_psCommands[i].ui32Command == COMMAND_PARAM) &&
+                    (g_psCommands[i].pfArgs[2] == 0.0f))
+                {
+                    g_psCommands[i].pfArgs[2] = 1.0f;
+                    g_sHost.ui32Request = i + 1;
+                    g_sHost.ui8Seq = (g_sHost.ui8Seq == 255) ? 1 :
+                                     g_sHost.ui8Seq + 1;
+                    break;
+                }
+            }
+            break;
+        }
+
+        PilotSend();
+        if (g_sHost.psTrace)
+        {
+            TraceWrite(ui64Now);
+        }
+        g_sHost.ui64NextPacket += PACKET_NS;
+    }
+}
+
+//*****************************************************************************
+//
+// Loads and saves the crash ring of the firmware, the RAM that survives a
+// warm reset.
+//
+//*****************************************************************************
+static bool
+RingLoad(const char *pcFile)
+{
+    FILE *psFile = fopen(pcFile, "rb");
+    size_t szRead;
+
+    if (!psFile)
+    {
+        return false;
+    }
+    szRead = fread(&g_sCrashRing, 1, sizeof(g_sCrashRing), psFile);
+    fclose(psFile);
+    return szRead == sizeof(g_sCrashRing);
+}
+
+static bool
+RingSave(const char *pcFile)
+{
+    FILE *psFile = fopen(pcFile, "wb");
+    size_t szWritten;
+
+    if (!psFile)
+    {
+        return false;
+    }
+    szWritten = fwrite(&g_sCrashRing, 1, sizeof(g_sCrashRing), psFile);
+    return (fclose(psFile) == 0) && (szWritten == sizeof(g_sCrashRing));
+}
+
+//*****************************************************************************
+//
+// Flies the script and prints the result of the checks.
+//
+//*****************************************************************************
+int
+main(int argc, char **argv)
+{
+    const char *pcScript = "flight.txt", *pcConsole = NULL;
+    const char *pcFlash = NULL, *pcRing = NULL, *pcTrace = NULL;
+    const tSitlStats *psStats;
+    tI2CMFakeConfig sBus = { 20000, 10000, 22500, 0, 0, 0, 0, 1 };
+    uint32_t ui32Seed = 1;
+    uint64_t ui64End;
+    double dSimulated, dWall, dAltRms, dEstRms;
+    clock_t sStart;
+    FILE *psConsole = NULL;
+    bool bOk, bLanded;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if ((argv[i][0] == '-') && (i + 1 < argc))
+        {
+            switch (argv[i][1])
+            {
+            case 'c':
+                pcConsole = argv[++i];
+                continue;
+            case 'f':
+                pcFlash = argv[++i];
+                continue;
+            case 'r':
+                pcRing = argv[++i];
+                continue;
+            case 's':
+                ui32Seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+                continue;
+            case 't':
+                pcTrace = argv[++i];
+                continue;
+            }
+        }
+        if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "usage: %s [-c console.txt] [-f flash.bin] "
+                    "[-r ring.bin] [-s seed] [-t trace.csv] [flight.txt]\n",
+                    argv[0]);
+            return 2;
+        }
+        pcScript = argv[i];
+    }
+
+    if (!ScriptRead(pcScript))
+    {
+        return 2;
+    }
+    ui64End = g_psCommands[g_ui32Commands - 1].ui64Time;
+
+    g_sHost.ui32Seed = ui32Seed;
+    SitlQuadInit(&g_sHost.sQuad, ui32Seed);
+    sBus.ui32Seed = ui32Seed;
+    if (!SitlInit(HostTruth, NULL, &sBus))
+    {
+        fprintf(stderr, "cannot map the flash\n");
+        return 2;
+    }
+    if (pcFlash)
+    {
+        SitlFlashLoad(pcFlash);
+    }
+    if (pcRing)
+    {
+        RingLoad(pcRing);
+    }
+    if (pcConsole)
+    {
+        psConsole = fopen(pcConsole, "w");
+        SitlConsoleSet(psConsole);
+    }
+    if (pcTrace)
+    {
+        g_sHost.psTrace = fopen(pcTrace, "w");
+        if (g_sHost.psTrace)
+        {
+            fprintf(g_sHost.psTrace, "t,x,y,z,roll,pitch,yaw,est_roll,"
+                    "est_pitch,est_yaw,des_roll,des_pitch,des_yaw,thrust,"
+                    "w0,w1,w2,w3\n");
+        }
+    }
+    g_sHost.ui64NextPhysics = PHYSICS_NS;
+    g_sHost.ui64NextPacket = PACKET_NS;
+
+    sStart = clock();
+    SitlRun(FirmwareMain, ui64End);
+    dWall = (double)(clock() - sStart) / CLOCKS_PER_SEC;
+    dSimulated = SitlNow() * 1e-9;
+
+    if (pcFlash && !SitlFlashSave(pcFlash))
+    {
+        fprintf(stderr, "cannot write %s\n", pcFlash);
+    }
+    if (pcRing && !RingSave(pcRing))
+    {
+        fprintf(stderr, "cannot write %s\n", pcRing);
+    }
+    if (psConsole)
+    {
+        fclose(psConsole);
+    }
+    if (g_sHost.psTrace)
+    {
+        fclose(g_sHost.psTrace);
+    }
+
+    //
+    // The checks.
+    //
+    psStats = SitlStatsGet();
+    dAltRms = g_sHost.ui32AltSamples ?
+              sqrt(g_sHost.dAltErrorSq / g_sHost.ui32AltSamples) : 0.0;
+    dEstRms = g_sHost.ui32EstSamples ?
+              sqrt(g_sHost.dEstErrorSq / g_sHost.ui32EstSamples) *
+              RAD_TO_DEG : 0.0;
+    bLanded = (g_sHost.fAltitude > 0.0f) || g_sHost.sQuad.bOnGround;
+
+    printf("%s: seed %u\n\n", pcScript, ui32Seed);
+    if (g_sHost.ui64Boot)
+    {
+        printf("boot                 %8.2f s\n", g_sHost.ui64Boot * 1e-9);
+    }
+    else
+    {
+        printf("boot                   failed\n");
+    }
+    printf("airborne             %8.1f s\n", g_sHost.ui64Airborne * 1e-9);
+    printf("max. altitude        %8.2f m\n", g_sHost.fMaxAltitude);
+    printf("altitude error rms   %8.3f m\n", dAltRms);
+    printf("max. tilt            %8.1f deg\n",
+           g_sHost.fMaxTilt * RAD_TO_DEG);
+    printf("attitude est. rms    %8.2f deg\n", dEstRms);
+    if (g_sHost.sQuad.bCrashed)
+    {
+        printf("crash                %8.2f m/s %.0f deg\n",
+               g_sHost.sQuad.fCrashSpeed,
+               g_sHost.sQuad.fCrashTilt * RAD_TO_DEG);
+    }
+    printf("landed               %8s\n", bLanded ? "yes" : "no");
+    printf("parameters           %4u/%u acknowledged, %u rejected\n",
+           g_sHost.ui32Acked + g_sHost.ui32Rejected, g_sHost.ui32Requests,
+           g_sHost.ui32Rejected);
+    printf("I2C outages          %8u, longest %u ms\n",
+           g_sI2CRecoverInst.ui32Outages, g_sI2CRecoverInst.ui32MaxMs);
+    printf("MPU9150 overruns     %8u\n", SitlSensorGet()->ui32Overruns);
+    printf("interrupts           %8u\n", psStats->ui32Interrupts);
+    printf("spin quanta          %8u\n", psStats->ui32SpinQuanta);
+    printf("radio bytes lost     %8u\n",
+           psStats->ui32RadioDropped + psStats->ui32RadioOverruns);
+    printf("console bytes lost   %8u of %u\n", psStats->ui32ConsoleDropped,
+           psStats->ui32ConsoleDropped + psStats->ui32ConsoleSent);
+    printf("log records          %8u, %u dropped in the air\n",
+           g_sBlackBoxInst.ui32Records, g_sHost.ui32AirDropped);
+
+    bOk = (g_sHost.ui64Boot != 0) && !g_sHost.sQuad.bCrashed && bLanded &&
+          ((g_sHost.fMaxTarget == 0.0f) ||
+           (g_sHost.fMaxAltitude > 0.5f * g_sHost.fMaxTarget)) &&
+          (g_sHost.fMaxTilt * RAD_TO_DEG <= MAX_TILT_DEG) &&
+          (dAltRms <= MAX_ALT_RMS_M) && (dEstRms <= MAX_EST_RMS_DEG) &&
+          (g_sHost.ui32AirDropped == 0) &&
+          (g_sHost.ui32Acked + g_sHost.ui32Rejected == g_sHost.ui32Requests);
+
+    printf("\n%.0f s simulated in %.2f s, %.0f times real time\n",
+           dSimulated, dWall, dWall > 0.0 ? dSimulated / dWall : 0.0);
+    printf("%s\n", bOk ? "passed" : "FAILED");
+    return bOk ? 0 : 1;
+}
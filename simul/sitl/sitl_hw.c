@@ -0,0 +1,1475 @@
+//*****************************************************************************
+//
+// sitl_hw.c - The simulated microcontroller and board of the SITL target.
+//
+// The firmware runs unmodified on the host against the TivaWare functions
+// of sitl_tivaware.h. Time is virtual and kept in ns: code takes no time,
+// only SysCtlDelay() and waiting for an interrupt in SysCtlSleep() move the
+// clock, to the next event of the board. The events are the samples of the
+// MPU9150 model, the completions of the simulated I2C bus, SysTick, the
+// bytes of the radio UART and the events of the host program (the physics
+// and the pilot). The console bytes leave UART0 at its baud rate as the
+// clock moves past them. As an event comes due its interrupt is pended, and the
+// pending interrupts whose vectors are enabled run as the NVIC would, in the
+// order of their vector numbers and without nesting.
+//
+// A CPU that spins on a flag, like MPU9150AppI2CWait() does, calls nothing
+// that moves the clock. An interval timer of the host watches for it: when
+// the firmware made no call into this file for SITL_SPIN_TICKS ticks, the
+// timer signal runs the board for a quantum of virtual time, up to the first
+// interrupt that comes due. The quantum doubles while no interrupt comes, so
+// that the loop of the error handler ends the run quickly.
+//
+//*****************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include "sitl_tivaware.h"
+#include "perf.h"
+#include "blackbox.h"
+#include "sitl.h"
+
+//*****************************************************************************
+//
+// The vectors of startup_ccs.c the firmware uses, and the number of
+// vectors modelled.
+//
+//*****************************************************************************
+extern void SysTickIntHandler(void);
+extern void IntGPIOb(void);
+extern void UART2IntHandler(void);
+extern void MPU9150I2CIntHandler(void);
+
+#define SITL_VECTORS            64
+
+static void (* const g_ppfnVectors[SITL_VECTORS])(void) =
+{
+    [FAULT_SYSTICK] = SysTickIntHandler,
+    [INT_GPIOB] = IntGPIOb,
+    [INT_UART2] = UART2IntHandler,
+    [INT_I2C1] = MPU9150I2CIntHandler,
+};
+
+//*****************************************************************************
+//
+// The I2C master driver instance of main.c, the bus runs its commands.
+//
+//*****************************************************************************
+extern tI2CMInstance g_sI2CInst;
+
+//*****************************************************************************
+//
+// The UART FIFOs, the receive level of UART_FIFO_RX7_8 and the radio bytes
+// on their way to the board.
+//
+//*****************************************************************************
+#define SITL_UART_FIFO          16
+#define SITL_UART_RX_LEVEL      14
+#define SITL_RADIO_LINE         1024
+
+//*****************************************************************************
+//
+// The transmit buffer of UARTStdio (UART_TX_BUFFER_SIZE, one byte of it
+// stays free) and the longest UARTprintf() output.
+//
+//*****************************************************************************
+#define SITL_CONSOLE_BUFFER     1024
+#define SITL_CONSOLE_BYTES      (SITL_CONSOLE_BUFFER - 1 + SITL_UART_FIFO)
+#define SITL_CONSOLE_LINE       512
+
+//*****************************************************************************
+//
+// Registers that HWREG() reads and writes as memory.
+//
+//*****************************************************************************
+#define SITL_REGS               8
+
+//*****************************************************************************
+//
+// The spin watch: the tick of the interval timer in us, the ticks without a
+// call before the CPU counts as spinning, and the first and largest quantum
+// of virtual time in ns.
+//
+//*****************************************************************************
+#define SITL_SPIN_TICK_US       250
+#define SITL_SPIN_TICKS         4
+#define SITL_SPIN_QUANTUM_NS    1000000ULL
+#define SITL_SPIN_QUANTUM_MAX   1000000000ULL
+
+//*****************************************************************************
+//
+// A flash page, the unit of FlashErase().
+//
+//*****************************************************************************
+#define SITL_FLASH_PAGE         1024
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE     0
+#endif
+
+//*****************************************************************************
+//
+// The state of the microcontroller and the board.
+//
+//*****************************************************************************
+static struct
+{
+    //
+    // Virtual time in ns, the end of the run and the cycle count at which
+    // the DWT cycle counter was 0.
+    //
+    uint64_t ui64Now;
+    uint64_t ui64End;
+    uint32_t ui32CycleBase;
+
+    //
+    // NVIC: enabled and pending vectors, PRIMASK and whether a handler runs.
+    //
+    bool pbEnabled[SITL_VECTORS];
+    bool pbPending[SITL_VECTORS];
+    bool bMasked;
+    bool bHandler;
+
+    //
+    // SysTick.
+    //
+    uint32_t ui32TickPeriod;
+    bool bTickInt;
+    bool bTickEnabled;
+    uint64_t ui64NextTick;
+
+    //
+    // The interrupt of GPIO port B: mask, raw status and the level of the
+    // MPU9150 interrupt line (true when asserted, the pin is low).
+    //
+    uint32_t ui32GPIOBMask;
+    uint32_t ui32GPIOBStatus;
+    bool bIntLine;
+
+    //
+    // The radio on UART2: the bytes on the air to the board and the end of
+    // the next one, the receive FIFO, the interrupt mask and raw status, and
+    // the transmit FIFO with the end of its next byte.
+    //
+    bool bRadioEnabled;
+    uint8_t pui8Line[SITL_RADIO_LINE];
+    uint32_t ui32LineRead;
+    uint32_t ui32LineCount;
+    uint64_t ui64LineNext;
+    uint8_t pui8RxFifo[SITL_UART_FIFO];
+    uint32_t ui32RxRead;
+    uint32_t ui32RxCount;
+    uint32_t ui32UARTMask;
+    uint32_t ui32UARTStatus;
+    uint8_t pui8TxFifo[SITL_UART_FIFO];
+    uint32_t ui32TxRead;
+    uint32_t ui32TxCount;
+    uint64_t ui64TxNext;
+    uint8_t pui8Ground[SITL_RADIO_LINE];
+    uint32_t ui32GroundRead;
+    uint32_t ui32GroundCount;
+
+    //
+    // The console on UART0: the file it goes to, and the bytes in the
+    // buffer of UARTStdio and the FIFO with the end of the next one.
+    //
+    FILE *psConsole;
+    uint8_t pui8Console[SITL_CONSOLE_BYTES];
+    uint32_t ui32ConsoleRead;
+    uint32_t ui32ConsoleCount;
+    uint64_t ui64ConsoleNext;
+
+    //
+    // PWM module 1: the periods of generators 0 and 1, the pulse widths and
+    // the enabled outputs and generators.
+    //
+    uint32_t pui32Period[2];
+    uint32_t pui32Width[4];
+    bool pbOutput[4];
+    bool pbGenEnabled[2];
+
+    //
+    // HWREG() registers, the data register of UART2 and the DWT cycle
+    // counter as last returned.
+    //
+    uint32_t pui32RegAddr[SITL_REGS];
+    uint32_t pui32RegValue[SITL_REGS];
+    uint32_t ui32Regs;
+    uint32_t ui32UARTData;
+    uint32_t ui32CycleCount;
+    uint32_t ui32CycleReturned;
+
+    //
+    // The LOG region of the flash, mapped at its address on the board.
+    //
+    uint8_t *pui8Flash;
+
+    //
+    // The MPU9150.
+    //
+    tMPU9150Model sMPU9150;
+
+    //
+    // The end of the run, and the spin watch.
+    //
+    sigjmp_buf sEnd;
+    bool bRunning;
+    uint32_t ui32SpinCalls;
+    uint32_t ui32SpinTicks;
+    uint64_t ui64Quantum;
+
+    tSitlStats sStats;
+}
+g_sSitl;
+
+//*****************************************************************************
+//
+// Calls into this file from the firmware, and the depth of the calls. The
+// spin watch does not run the board during a call.
+//
+//*****************************************************************************
+static volatile uint32_t g_vui32Calls;
+static volatile sig_atomic_t g_viDepth;
+
+static void
+SitlEnter(void)
+{
+    g_viDepth++;
+    g_vui32Calls++;
+    atomic_signal_fence(memory_order_seq_cst);
+}
+
+static void
+SitlLeave(void)
+{
+    atomic_signal_fence(memory_order_seq_cst);
+    g_viDepth--;
+}
+
+//*****************************************************************************
+//
+// Pends an interrupt.
+//
+//*****************************************************************************
+static void
+SitlPend(uint32_t ui32Vector)
+{
+    g_sSitl.pbPending[ui32Vector] = true;
+}
+
+//*****************************************************************************
+//
+// Returns the pending and enabled vector with the lowest number, 0 if none.
+// SysTick is an exception and cannot be disabled in the NVIC.
+//
+//*****************************************************************************
+static uint32_t
+SitlReady(void)
+{
+    uint32_t ui32Vector;
+
+    for (ui32Vector = 1; ui32Vector < SITL_VECTORS; ui32Vector++)
+    {
+        if (g_sSitl.pbPending[ui32Vector] &&
+            (g_sSitl.pbEnabled[ui32Vector] || (ui32Vector == FAULT_SYSTICK)))
+        {
+            return ui32Vector;
+        }
+    }
+    return 0;
+}
+
+//*****************************************************************************
+//
+// Runs the handlers of the pending interrupts unless PRIMASK is set or a
+// handler runs already. Returns true if a handler ran.
+//
+//*****************************************************************************
+static bool
+SitlDispatch(void)
+{
+    uint32_t ui32Vector;
+    bool bRan = false;
+
+    while (!g_sSitl.bMasked && !g_sSitl.bHandler &&
+           ((ui32Vector = SitlReady()) != 0))
+    {
+        g_sSitl.pbPending[ui32Vector] = false;
+        g_sSitl.bHandler = true;
+        if (g_ppfnVectors[ui32Vector])
+        {
+            g_ppfnVectors[ui32Vector]();
+        }
+        g_sSitl.bHandler = false;
+        g_sSitl.sStats.ui32Interrupts++;
+        bRan = true;
+    }
+    return bRan;
+}
+
+//*****************************************************************************
+//
+// The interrupt of GPIO port B follows its masked status.
+//
+//*****************************************************************************
+static void
+SitlGPIOBUpdate(void)
+{
+    if (g_sSitl.ui32GPIOBStatus & g_sSitl.ui32GPIOBMask)
+    {
+        SitlPend(INT_GPIOB);
+    }
+    else
+    {
+        g_sSitl.pbPending[INT_GPIOB] = false;
+    }
+}
+
+//*****************************************************************************
+//
+// The receive interrupt of UART2 follows its masked status.
+//
+//*****************************************************************************
+static void
+SitlUARTUpdate(void)
+{
+    if (g_sSitl.ui32UARTStatus & g_sSitl.ui32UARTMask)
+    {
+        SitlPend(INT_UART2);
+    }
+}
+
+//*****************************************************************************
+//
+// A radio byte reaches the receive FIFO of UART2.
+//
+//*****************************************************************************
+static void
+SitlRadioByte(uint8_t ui8Byte)
+{
+    if (!g_sSitl.bRadioEnabled)
+    {
+        g_sSitl.sStats.ui32RadioDropped++;
+        return;
+    }
+    if (g_sSitl.ui32RxCount == SITL_UART_FIFO)
+    {
+        g_sSitl.sStats.ui32RadioOverruns++;
+        return;
+    }
+    g_sSitl.pui8RxFifo[(g_sSitl.ui32RxRead + g_sSitl.ui32RxCount) %
+                       SITL_UART_FIFO] = ui8Byte;
+    g_sSitl.ui32RxCount++;
+    if (g_sSitl.ui32RxCount >= SITL_UART_RX_LEVEL)
+    {
+        g_sSitl.ui32UARTStatus |= UART_INT_RX;
+        SitlUARTUpdate();
+    }
+}
+
+//*****************************************************************************
+//
+// Returns the time of the next event after the current time.
+//
+//*****************************************************************************
+static uint64_t
+SitlNext(void)
+{
+    uint64_t pui64Next[6];
+    uint64_t ui64Next = g_sSitl.ui64End;
+    uint32_t i;
+
+    pui64Next[0] = SitlHostNext();
+    pui64Next[1] = MPU9150ModelNext(&g_sSitl.sMPU9150);
+    pui64Next[2] = I2CMFakeNext(&g_sI2CInst);
+    pui64Next[3] = g_sSitl.bTickEnabled ? g_sSitl.ui64NextTick : UINT64_MAX;
+    pui64Next[4] = g_sSitl.ui32LineCount ? g_sSitl.ui64LineNext : UINT64_MAX;
+    pui64Next[5] = g_sSitl.ui32TxCount ? g_sSitl.ui64TxNext : UINT64_MAX;
+
+    for (i = 0; i < 6; i++)
+    {
+        if ((pui64Next[i] > g_sSitl.ui64Now) && (pui64Next[i] < ui64Next))
+        {
+            ui64Next = pui64Next[i];
+        }
+    }
+    return ui64Next;
+}
+
+//*****************************************************************************
+//
+// Moves the board to ui64Now and pends the interrupts of the events that
+// are due. The run ends at its end time.
+//
+//*****************************************************************************
+static void
+SitlAdvance(uint64_t ui64Now)
+{
+    bool bIntLine;
+
+    if (ui64Now >= g_sSitl.ui64End)
+    {
+        g_sSitl.ui64Now = g_sSitl.ui64End;
+        siglongjmp(g_sSitl.sEnd, 1);
+    }
+    g_sSitl.ui64Now = ui64Now;
+
+    //
+    // The host first, so that the sensor samples the motion up to now.
+    //
+    SitlHostRun(ui64Now);
+
+    //
+    // The MPU9150 and the bus. The interrupt line is active low and the GPIO
+    // interrupts on its falling edge; the edge is latched in the raw status
+    // also while the interrupt is masked, like on the part.
+    //
+    MPU9150ModelAdvance(&g_sSitl.sMPU9150, ui64Now);
+    if (I2CMFakeAdvance(&g_sI2CInst, ui64Now))
+    {
+        SitlPend(INT_I2C1);
+    }
+    bIntLine = MPU9150ModelIntGet(&g_sSitl.sMPU9150);
+    if (bIntLine && !g_sSitl.bIntLine)
+    {
+        g_sSitl.ui32GPIOBStatus |= GPIO_PIN_2;
+        SitlGPIOBUpdate();
+    }
+    g_sSitl.bIntLine = bIntLine;
+
+    //
+    // SysTick.
+    //
+    if (g_sSitl.bTickEnabled && (ui64Now >= g_sSitl.ui64NextTick))
+    {
+        g_sSitl.ui64NextTick += (uint64_t)g_sSitl.ui32TickPeriod *
+                                SITL_NS_PER_CYCLE;
+        if (g_sSitl.bTickInt)
+        {
+            SitlPend(FAULT_SYSTICK);
+        }
+    }
+
+    //
+    // The radio bytes to and from the board.
+    //
+    while (g_sSitl.ui32LineCount && (ui64Now >= g_sSitl.ui64LineNext))
+    {
+        SitlRadioByte(g_sSitl.pui8Line[g_sSitl.ui32LineRead]);
+        g_sSitl.ui32LineRead = (g_sSitl.ui32LineRead + 1) % SITL_RADIO_LINE;
+        g_sSitl.ui32LineCount--;
+        g_sSitl.ui64LineNext += SITL_RADIO_BYTE_NS;
+    }
+    while (g_sSitl.ui32TxCount && (ui64Now >= g_sSitl.ui64TxNext))
+    {
+        if (g_sSitl.ui32GroundCount < SITL_RADIO_LINE)
+        {
+            g_sSitl.pui8Ground[(g_sSitl.ui32GroundRead +
+                                g_sSitl.ui32GroundCount) % SITL_RADIO_LINE] =
+                    g_sSitl.pui8TxFifo[g_sSitl.ui32TxRead];
+            g_sSitl.ui32GroundCount++;
+        }
+        g_sSitl.ui32TxRead = (g_sSitl.ui32TxRead + 1) % SITL_UART_FIFO;
+        g_sSitl.ui32TxCount--;
+        g_sSitl.ui64TxNext += SITL_RADIO_BYTE_NS;
+        g_sSitl.sStats.ui32RadioSent++;
+    }
+
+    //
+    // The console bytes.
+    //
+    while (g_sSitl.ui32ConsoleCount && (ui64Now >= g_sSitl.ui64ConsoleNext))
+    {
+        if (g_sSitl.psConsole)
+        {
+            fputc(g_sSitl.pui8Console[g_sSitl.ui32ConsoleRead],
+                  g_sSitl.psConsole);
+        }
+        g_sSitl.ui32ConsoleRead = (g_sSitl.ui32ConsoleRead + 1) %
+                                  SITL_CONSOLE_BYTES;
+        g_sSitl.ui32ConsoleCount--;
+        g_sSitl.ui64ConsoleNext += SITL_CONSOLE_BYTE_NS;
+        g_sSitl.sStats.ui32ConsoleSent++;
+    }
+}
+
+//*****************************************************************************
+//
+// Adds a byte to the console buffer. Returns false if it is full.
+//
+//*****************************************************************************
+static bool
+SitlConsoleByte(uint8_t ui8Byte)
+{
+    if (g_sSitl.ui32ConsoleCount == SITL_CONSOLE_BYTES)
+    {
+        return false;
+    }
+    if (g_sSitl.ui32ConsoleCount == 0)
+    {
+        g_sSitl.ui64ConsoleNext = g_sSitl.ui64Now + SITL_CONSOLE_BYTE_NS;
+    }
+    g_sSitl.pui8Console[(g_sSitl.ui32ConsoleRead + g_sSitl.ui32ConsoleCount) %
+                        SITL_CONSOLE_BYTES] = ui8Byte;
+    g_sSitl.ui32ConsoleCount++;
+    return true;
+}
+
+//*****************************************************************************
+//
+// Runs the board until ui64End, taking the interrupts as they come due.
+//
+//*****************************************************************************
+static void
+SitlRunUntil(uint64_t ui64End)
+{
+    uint64_t ui64Next;
+
+    SitlDispatch();
+    while (g_sSitl.ui64Now < ui64End)
+    {
+        ui64Next = SitlNext();
+        SitlAdvance((ui64Next < ui64End) ? ui64Next : ui64End);
+        SitlDispatch();
+    }
+}
+
+//*****************************************************************************
+//
+// The spin watch, the handler of the interval timer. A quantum ends with the
+// first interrupt taken, which may be the one the CPU waits for; the CPU then
+// runs for a tick before the next quantum, even if this one took longer than
+// a tick and the next signal is pending already. Without an interrupt
+// nothing changed for the CPU and the next tick goes on with a quantum twice
+// as long.
+//
+//*****************************************************************************
+static void
+SitlSpinTick(int iSignal)
+{
+    uint64_t ui64End, ui64Next;
+    bool bTaken = false;
+
+    if (!g_sSitl.bRunning || g_viDepth || g_sSitl.bMasked ||
+        g_sSitl.bHandler)
+    {
+        return;
+    }
+    if (g_vui32Calls != g_sSitl.ui32SpinCalls)
+    {
+        g_sSitl.ui32SpinCalls = g_vui32Calls;
+        g_sSitl.ui32SpinTicks = 0;
+        g_sSitl.ui64Quantum = SITL_SPIN_QUANTUM_NS;
+        return;
+    }
+    if (++g_sSitl.ui32SpinTicks < SITL_SPIN_TICKS)
+    {
+        return;
+    }
+
+    g_viDepth++;
+    ui64End = g_sSitl.ui64Now + g_sSitl.ui64Quantum;
+    bTaken = SitlDispatch();
+    while (!bTaken && (g_sSitl.ui64Now < ui64End))
+    {
+        ui64Next = SitlNext();
+        SitlAdvance((ui64Next < ui64End) ? ui64Next : ui64End);
+        bTaken = SitlDispatch();
+    }
+    g_viDepth--;
+    g_sSitl.sStats.ui32SpinQuanta++;
+
+    if (bTaken)
+    {
+        g_sSitl.ui32SpinTicks = SITL_SPIN_TICKS - 2;
+        g_sSitl.ui64Quantum = SITL_SPIN_QUANTUM_NS;
+    }
+    else if (g_sSitl.ui64Quantum < SITL_SPIN_QUANTUM_MAX)
+    {
+        g_sSitl.ui64Quantum *= 2;
+    }
+
+    //
+    // Calls of the handlers that ran are not progress of the spinning code.
+    //
+    g_sSitl.ui32SpinCalls = g_vui32Calls;
+}
+
+//*****************************************************************************
+//
+// Sets up the board at time 0, with the MPU9150 on the bus with the given
+// timing and faults. The LOG region of the flash is mapped at its address
+// and erased. Returns false if the flash cannot be mapped.
+//
+//*****************************************************************************
+bool
+SitlInit(tMPU9150TruthGet *pfnTruth, void *pvTruthData,
+         const tI2CMFakeConfig *psBus)
+{
+    tI2CMFakeDevice sDevice;
+    void *pvFlash;
+
+    memset(&g_sSitl, 0, sizeof(g_sSitl));
+    g_sSitl.ui64End = UINT64_MAX;
+    g_sSitl.bMasked = false;
+
+    I2CMFakeReset(psBus);
+    I2CMFakeIntHookSet(IntEnable);
+    MPU9150ModelInit(&g_sSitl.sMPU9150, pfnTruth, pvTruthData);
+    MPU9150ModelDevice(&g_sSitl.sMPU9150, SITL_MPU9150_ADDR, &sDevice);
+    I2CMFakeDeviceAdd(&sDevice);
+
+    pvFlash = mmap((void *)(uintptr_t)BLACKBOX_BASE, BLACKBOX_SIZE,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (pvFlash != (void *)(uintptr_t)BLACKBOX_BASE)
+    {
+        return false;
+    }
+    g_sSitl.pui8Flash = pvFlash;
+    memset(g_sSitl.pui8Flash, 0xff, BLACKBOX_SIZE);
+    return true;
+}
+
+//*****************************************************************************
+//
+// Sets the file UART0 prints to, NULL to discard the console.
+//
+//*****************************************************************************
+void
+SitlConsoleSet(FILE *psConsole)
+{
+    g_sSitl.psConsole = psConsole;
+}
+
+//*****************************************************************************
+//
+// Loads and saves the LOG region of the flash as a file, the image that
+// simul/flight_log/flight_log_host.c decodes.
+//
+//*****************************************************************************
+bool
+SitlFlashLoad(const char *pcFile)
+{
+    FILE *psFile = fopen(pcFile, "rb");
+    size_t szRead;
+
+    if (!psFile)
+    {
+        return false;
+    }
+    szRead = fread(g_sSitl.pui8Flash, 1, BLACKBOX_SIZE, psFile);
+    fclose(psFile);
+    return szRead == BLACKBOX_SIZE;
+}
+
+bool
+SitlFlashSave(const char *pcFile)
+{
+    FILE *psFile = fopen(pcFile, "wb");
+    size_t szWritten;
+
+    if (!psFile)
+    {
+        return false;
+    }
+    szWritten = fwrite(g_sSitl.pui8Flash, 1, BLACKBOX_SIZE, psFile);
+    return (fclose(psFile) == 0) && (szWritten == BLACKBOX_SIZE);
+}
+
+//*****************************************************************************
+//
+// Runs the firmware from reset until ui64End ns of virtual time.
+//
+//*****************************************************************************
+void
+SitlRun(int (*pfnFirmware)(void), uint64_t ui64End)
+{
+    struct sigaction sAction;
+    struct itimerval sTimer;
+
+    g_sSitl.ui64End = ui64End;
+
+    memset(&sAction, 0, sizeof(sAction));
+    sAction.sa_handler = SitlSpinTick;
+    sAction.sa_flags = SA_RESTART;
+    sigemptyset(&sAction.sa_mask);
+    sigaction(SIGALRM, &sAction, NULL);
+
+    memset(&sTimer, 0, sizeof(sTimer));
+    sTimer.it_interval.tv_usec = SITL_SPIN_TICK_US;
+    sTimer.it_value.tv_usec = SITL_SPIN_TICK_US;
+
+    if (sigsetjmp(g_sSitl.sEnd, 1) == 0)
+    {
+        g_sSitl.bRunning = true;
+        setitimer(ITIMER_REAL, &sTimer, NULL);
+        pfnFirmware();
+    }
+
+    g_sSitl.bRunning = false;
+    memset(&sTimer, 0, sizeof(sTimer));
+    setitimer(ITIMER_REAL, &sTimer, NULL);
+}
+
+//*****************************************************************************
+//
+// Returns the virtual time in ns.
+//
+//*****************************************************************************
+uint64_t
+SitlNow(void)
+{
+    return g_sSitl.ui64Now;
+}
+
+//*****************************************************************************
+//
+// Sends bytes over the radio to the board, they arrive one by one at the
+// baud rate. Bytes that do not fit the line are dropped.
+//
+//*****************************************************************************
+void
+SitlRadioSend(const uint8_t *pui8Data, uint32_t ui32Count)
+{
+    uint32_t i;
+
+    for (i = 0; i < ui32Count; i++)
+    {
+        if (g_sSitl.ui32LineCount == SITL_RADIO_LINE)
+        {
+            g_sSitl.sStats.ui32RadioDropped++;
+            continue;
+        }
+        if (g_sSitl.ui32LineCount == 0)
+        {
+            g_sSitl.ui64LineNext = g_sSitl.ui64Now + SITL_RADIO_BYTE_NS;
+        }
+        g_sSitl.pui8Line[(g_sSitl.ui32LineRead + g_sSitl.ui32LineCount) %
+                         SITL_RADIO_LINE] = pui8Data[i];
+        g_sSitl.ui32LineCount++;
+    }
+}
+
+//*****************************************************************************
+//
+// Returns up to ui32Max bytes the board sent over the radio.
+//
+//*****************************************************************************
+uint32_t
+SitlRadioReceive(uint8_t *pui8Data, uint32_t ui32Max)
+{
+    uint32_t ui32Count = 0;
+
+    while (g_sSitl.ui32GroundCount && (ui32Count < ui32Max))
+    {
+        pui8Data[ui32Count++] = g_sSitl.pui8Ground[g_sSitl.ui32GroundRead];
+        g_sSitl.ui32GroundRead = (g_sSitl.ui32GroundRead + 1) %
+                                 SITL_RADIO_LINE;
+        g_sSitl.ui32GroundCount--;
+    }
+    return ui32Count;
+}
+
+//*****************************************************************************
+//
+// Returns the pulse an ESC sees as a fraction of the PWM period. The board
+// inverts the PWM outputs on their way to the ESCs, which is why the
+// firmware sets the width of 1 - duty cycle. A disabled output gives no
+// pulse.
+//
+//*****************************************************************************
+float
+SitlMotorPulse(uint32_t ui32Motor)
+{
+    uint32_t ui32Gen = ui32Motor / 2;
+
+    if (!g_sSitl.pbOutput[ui32Motor] || !g_sSitl.pbGenEnabled[ui32Gen] ||
+        !g_sSitl.pui32Period[ui32Gen])
+    {
+        return 0.0f;
+    }
+    return 1.0f - ((float)g_sSitl.pui32Width[ui32Motor] /
+                   (float)g_sSitl.pui32Period[ui32Gen]);
+}
+
+//*****************************************************************************
+//
+// Returns the MPU9150 model and the statistics of the run.
+//
+//*****************************************************************************
+const tMPU9150Model *
+SitlSensorGet(void)
+{
+    return &g_sSitl.sMPU9150;
+}
+
+const tSitlStats *
+SitlStatsGet(void)
+{
+    return &g_sSitl.sStats;
+}
+
+//*****************************************************************************
+//
+// HWREG(). Reading the data register of UART2 takes a byte from the
+// receive FIFO. The DWT cycle counter counts the virtual cycles; a value
+// written to it is noticed on the next access, which restarts the count
+// from it.
+//
+//*****************************************************************************
+volatile uint32_t *
+SitlReg(uint32_t ui32Addr)
+{
+    uint32_t ui32Cycles, i;
+
+    SitlEnter();
+
+    if (ui32Addr == UART2_BASE)
+    {
+        g_sSitl.ui32UARTData = 0;
+        if (g_sSitl.ui32RxCount)
+        {
+            g_sSitl.ui32UARTData = g_sSitl.pui8RxFifo[g_sSitl.ui32RxRead];
+            g_sSitl.ui32RxRead = (g_sSitl.ui32RxRead + 1) % SITL_UART_FIFO;
+            g_sSitl.ui32RxCount--;
+        }
+        SitlLeave();
+        return &g_sSitl.ui32UARTData;
+    }
+
+    if (ui32Addr == PERF_DWT_CYCCNT)
+    {
+        ui32Cycles = (uint32_t)(g_sSitl.ui64Now / SITL_NS_PER_CYCLE);
+        if (g_sSitl.ui32CycleCount != g_sSitl.ui32CycleReturned)
+        {
+            g_sSitl.ui32CycleBase = ui32Cycles - g_sSitl.ui32CycleCount;
+        }
+        g_sSitl.ui32CycleCount = ui32Cycles - g_sSitl.ui32CycleBase;
+        g_sSitl.ui32CycleReturned = g_sSitl.ui32CycleCount;
+        SitlLeave();
+        return &g_sSitl.ui32CycleCount;
+    }
+
+    for (i = 0; i < g_sSitl.ui32Regs; i++)
+    {
+        if (g_sSitl.pui32RegAddr[i] == ui32Addr)
+        {
+            break;
+        }
+    }
+    if (i == g_sSitl.ui32Regs)
+    {
+        if (g_sSitl.ui32Regs == SITL_REGS)
+        {
+            i = SITL_REGS - 1;
+        }
+        else
+        {
+            g_sSitl.ui32Regs++;
+        }
+        g_sSitl.pui32RegAddr[i] = ui32Addr;
+        g_sSitl.pui32RegValue[i] = 0;
+    }
+    SitlLeave();
+    return &g_sSitl.pui32RegValue[i];
+}
+
+//*****************************************************************************
+//
+// driverlib/interrupt.h. IntMasterEnable() and IntMasterDisable() return
+// whether the interrupts were disabled.
+//
+//*****************************************************************************
+bool
+IntMasterEnable(void)
+{
+    bool bMasked;
+
+    SitlEnter();
+    bMasked = g_sSitl.bMasked;
+    g_sSitl.bMasked = false;
+    SitlDispatch();
+    SitlLeave();
+    return bMasked;
+}
+
+bool
+IntMasterDisable(void)
+{
+    bool bMasked = g_sSitl.bMasked;
+
+    SitlEnter();
+    g_sSitl.bMasked = true;
+    SitlLeave();
+    return bMasked;
+}
+
+void
+IntEnable(uint32_t ui32Interrupt)
+{
+    SitlEnter();
+    if (ui32Interrupt < SITL_VECTORS)
+    {
+        g_sSitl.pbEnabled[ui32Interrupt] = true;
+        SitlDispatch();
+    }
+    SitlLeave();
+}
+
+void
+IntDisable(uint32_t ui32Interrupt)
+{
+    SitlEnter();
+    if (ui32Interrupt < SITL_VECTORS)
+    {
+        g_sSitl.pbEnabled[ui32Interrupt] = false;
+    }
+    SitlLeave();
+}
+
+//*****************************************************************************
+//
+// driverlib/sysctl.h. The clock is 40 MHz whatever the configuration.
+// SysCtlDelay() takes 3 cycles per count, SysCtlSleep() waits for an
+// interrupt and returns after its handler ran.
+//
+//*****************************************************************************
+void
+SysCtlClockSet(uint32_t ui32Config)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+uint32_t
+SysCtlClockGet(void)
+{
+    SitlEnter();
+    SitlLeave();
+    return SITL_CLOCK_HZ;
+}
+
+void
+SysCtlPWMClockSet(uint32_t ui32Config)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+SysCtlPeripheralEnable(uint32_t ui32Peripheral)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+SysCtlPeripheralReset(uint32_t ui32Peripheral)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+SysCtlPeripheralSleepEnable(uint32_t ui32Peripheral)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+SysCtlPeripheralClockGating(bool bEnable)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+SysCtlDelay(uint32_t ui32Count)
+{
+    SitlEnter();
+    SitlRunUntil(g_sSitl.ui64Now +
+                 (uint64_t)ui32Count * 3 * SITL_NS_PER_CYCLE);
+    SitlLeave();
+}
+
+void
+SysCtlSleep(void)
+{
+    SitlEnter();
+    while (!SitlReady())
+    {
+        SitlAdvance(SitlNext());
+    }
+    SitlDispatch();
+    SitlLeave();
+}
+
+//*****************************************************************************
+//
+// driverlib/systick.h. The first tick comes a period after the enable.
+//
+//*****************************************************************************
+void
+SysTickPeriodSet(uint32_t ui32Period)
+{
+    SitlEnter();
+    g_sSitl.ui32TickPeriod = ui32Period;
+    SitlLeave();
+}
+
+void
+SysTickIntEnable(void)
+{
+    SitlEnter();
+    g_sSitl.bTickInt = true;
+    SitlLeave();
+}
+
+void
+SysTickEnable(void)
+{
+    SitlEnter();
+    g_sSitl.bTickEnabled = true;
+    g_sSitl.ui64NextTick = g_sSitl.ui64Now +
+                           (uint64_t)g_sSitl.ui32TickPeriod *
+                           SITL_NS_PER_CYCLE;
+    SitlLeave();
+}
+
+//*****************************************************************************
+//
+// driverlib/gpio.h. Only the interrupt of port B is modelled; inputs read
+// high, as the pull-ups of the I2C bus keep them.
+//
+//*****************************************************************************
+void
+GPIOPinConfigure(uint32_t ui32PinConfig)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+GPIOPinTypeGPIOInput(uint32_t ui32Port, uint8_t ui8Pins)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+GPIOPinTypeGPIOOutput(uint32_t ui32Port, uint8_t ui8Pins)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+GPIOPinTypeGPIOOutputOD(uint32_t ui32Port, uint8_t ui8Pins)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+GPIOPinTypeI2C(uint32_t ui32Port, uint8_t ui8Pins)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+GPIOPinTypeI2CSCL(uint32_t ui32Port, uint8_t ui8Pins)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+GPIOPinTypePWM(uint32_t ui32Port, uint8_t ui8Pins)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+GPIOPinTypeUART(uint32_t ui32Port, uint8_t ui8Pins)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+int32_t
+GPIOPinRead(uint32_t ui32Port, uint8_t ui8Pins)
+{
+    SitlEnter();
+    SitlLeave();
+    return ui8Pins;
+}
+
+void
+GPIOPinWrite(uint32_t ui32Port, uint8_t ui8Pins, uint8_t ui8Val)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+GPIOIntTypeSet(uint32_t ui32Port, uint8_t ui8Pins, uint32_t ui32IntType)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+GPIOIntEnable(uint32_t ui32Port, uint32_t ui32IntFlags)
+{
+    SitlEnter();
+    if (ui32Port == GPIO_PORTB_BASE)
+    {
+        g_sSitl.ui32GPIOBMask |= ui32IntFlags;
+        SitlGPIOBUpdate();
+        SitlDispatch();
+    }
+    SitlLeave();
+}
+
+void
+GPIOIntDisable(uint32_t ui32Port, uint32_t ui32IntFlags)
+{
+    SitlEnter();
+    if (ui32Port == GPIO_PORTB_BASE)
+    {
+        g_sSitl.ui32GPIOBMask &= ~ui32IntFlags;
+        SitlGPIOBUpdate();
+    }
+    SitlLeave();
+}
+
+uint32_t
+GPIOIntStatus(uint32_t ui32Port, bool bMasked)
+{
+    uint32_t ui32Status = 0;
+
+    SitlEnter();
+    if (ui32Port == GPIO_PORTB_BASE)
+    {
+        ui32Status = g_sSitl.ui32GPIOBStatus;
+        if (bMasked)
+        {
+            ui32Status &= g_sSitl.ui32GPIOBMask;
+        }
+    }
+    SitlLeave();
+    return ui32Status;
+}
+
+void
+GPIOIntClear(uint32_t ui32Port, uint32_t ui32IntFlags)
+{
+    SitlEnter();
+    if (ui32Port == GPIO_PORTB_BASE)
+    {
+        g_sSitl.ui32GPIOBStatus &= ~ui32IntFlags;
+        SitlGPIOBUpdate();
+    }
+    SitlLeave();
+}
+
+//*****************************************************************************
+//
+// driverlib/uart.h and utils/uartstdio.h. UART2 is the radio, UART0 the
+// console. UARTprintf() writes like UARTwrite() of the buffered UARTStdio: a
+// newline goes out as CR LF, and once the buffer is full the rest of the
+// output is discarded. UARTFlushTx() runs the board until it is sent.
+//
+//*****************************************************************************
+void
+UARTClockSourceSet(uint32_t ui32Base, uint32_t ui32Source)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+UARTConfigSetExpClk(uint32_t ui32Base, uint32_t ui32UARTClk,
+                    uint32_t ui32Baud, uint32_t ui32Config)
+{
+    SitlEnter();
+    if (ui32Base == UART2_BASE)
+    {
+        g_sSitl.bRadioEnabled = true;
+    }
+    SitlLeave();
+}
+
+void
+UARTFIFOLevelSet(uint32_t ui32Base, uint32_t ui32TxLevel,
+                 uint32_t ui32RxLevel)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+UARTIntEnable(uint32_t ui32Base, uint32_t ui32IntFlags)
+{
+    SitlEnter();
+    if (ui32Base == UART2_BASE)
+    {
+        g_sSitl.ui32UARTMask |= ui32IntFlags;
+        SitlUARTUpdate();
+        SitlDispatch();
+    }
+    SitlLeave();
+}
+
+void
+UARTIntClear(uint32_t ui32Base, uint32_t ui32IntFlags)
+{
+    SitlEnter();
+    if (ui32Base == UART2_BASE)
+    {
+        g_sSitl.ui32UARTStatus &= ~ui32IntFlags;
+    }
+    SitlLeave();
+}
+
+bool
+UARTCharPutNonBlocking(uint32_t ui32Base, unsigned char ucData)
+{
+    bool bPut = true;
+
+    SitlEnter();
+    if (ui32Base == UART2_BASE)
+    {
+        if (g_sSitl.ui32TxCount == SITL_UART_FIFO)
+        {
+            bPut = false;
+        }
+        else
+        {
+            if (g_sSitl.ui32TxCount == 0)
+            {
+                g_sSitl.ui64TxNext = g_sSitl.ui64Now + SITL_RADIO_BYTE_NS;
+            }
+            g_sSitl.pui8TxFifo[(g_sSitl.ui32TxRead + g_sSitl.ui32TxCount) %
+                               SITL_UART_FIFO] = ucData;
+            g_sSitl.ui32TxCount++;
+        }
+    }
+    else
+    {
+        bPut = SitlConsoleByte(ucData);
+    }
+    SitlLeave();
+    return bPut;
+}
+
+void
+UARTStdioConfig(uint32_t ui32PortNum, uint32_t ui32Baud,
+                uint32_t ui32SrcClock)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+int
+UARTprintf(const char *pcString, ...)
+{
+    va_list vaArgP;
+    char pcLine[SITL_CONSOLE_LINE];
+    int iCount, i;
+
+    SitlEnter();
+    va_start(vaArgP, pcString);
+    iCount = vsnprintf(pcLine, sizeof(pcLine), pcString, vaArgP);
+    va_end(vaArgP);
+    if (iCount >= (int)sizeof(pcLine))
+    {
+        iCount = sizeof(pcLine) - 1;
+    }
+    for (i = 0; i < iCount; i++)
+    {
+        if (((pcLine[i] == '\n') && !SitlConsoleByte('\r')) ||
+            !SitlConsoleByte(pcLine[i]))
+        {
+            g_sSitl.sStats.ui32ConsoleDropped += iCount - i;
+            break;
+        }
+    }
+    SitlLeave();
+    return i;
+}
+
+void
+UARTFlushTx(bool bDiscard)
+{
+    SitlEnter();
+    if (bDiscard)
+    {
+        g_sSitl.ui32ConsoleCount = 0;
+    }
+    while (g_sSitl.ui32ConsoleCount)
+    {
+        SitlRunUntil(g_sSitl.ui64ConsoleNext);
+    }
+    SitlLeave();
+}
+
+int
+UARTTxBytesFree(void)
+{
+    int iFree;
+
+    SitlEnter();
+    iFree = SITL_CONSOLE_BYTES - g_sSitl.ui32ConsoleCount;
+    SitlLeave();
+    return iFree;
+}
+
+//*****************************************************************************
+//
+// driverlib/pwm.h. Generator 0 drives outputs 0 and 1, generator 1 outputs
+// 2 and 3.
+//
+//*****************************************************************************
+void
+PWMGenConfigure(uint32_t ui32Base, uint32_t ui32Gen, uint32_t ui32Config)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+PWMGenPeriodSet(uint32_t ui32Base, uint32_t ui32Gen, uint32_t ui32Period)
+{
+    SitlEnter();
+    g_sSitl.pui32Period[(ui32Gen == PWM_GEN_1) ? 1 : 0] = ui32Period;
+    SitlLeave();
+}
+
+void
+PWMGenEnable(uint32_t ui32Base, uint32_t ui32Gen)
+{
+    SitlEnter();
+    g_sSitl.pbGenEnabled[(ui32Gen == PWM_GEN_1) ? 1 : 0] = true;
+    SitlLeave();
+}
+
+void
+PWMPulseWidthSet(uint32_t ui32Base, uint32_t ui32PWMOut, uint32_t ui32Width)
+{
+    SitlEnter();
+    g_sSitl.pui32Width[ui32PWMOut & 3] = ui32Width;
+    SitlLeave();
+}
+
+void
+PWMOutputState(uint32_t ui32Base, uint32_t ui32PWMOutBits, bool bEnable)
+{
+    uint32_t i;
+
+    SitlEnter();
+    for (i = 0; i < 4; i++)
+    {
+        if (ui32PWMOutBits & (1 << i))
+        {
+            g_sSitl.pbOutput[i] = bEnable;
+        }
+    }
+    SitlLeave();
+}
+
+//*****************************************************************************
+//
+// driverlib/flash.h. Programming only clears bits, an erase sets the bits
+// of a page.
+//
+//*****************************************************************************
+int32_t
+FlashErase(uint32_t ui32Address)
+{
+    int32_t i32Status = -1;
+
+    SitlEnter();
+    if ((ui32Address >= BLACKBOX_BASE) &&
+        (ui32Address < BLACKBOX_BASE + BLACKBOX_SIZE) &&
+        !(ui32Address % SITL_FLASH_PAGE))
+    {
+        memset((void *)(uintptr_t)ui32Address, 0xff, SITL_FLASH_PAGE);
+        i32Status = 0;
+    }
+    SitlLeave();
+    return i32Status;
+}
+
+int32_t
+FlashProgram(uint32_t *pui32Data, uint32_t ui32Address, uint32_t ui32Count)
+{
+    uint32_t *pui32Flash = (uint32_t *)(uintptr_t)ui32Address;
+    int32_t i32Status = -1;
+    uint32_t i;
+
+    SitlEnter();
+    if ((ui32Address >= BLACKBOX_BASE) &&
+        (ui32Address + ui32Count <= BLACKBOX_BASE + BLACKBOX_SIZE) &&
+        !(ui32Address & 3) && !(ui32Count & 3))
+    {
+        for (i = 0; i < ui32Count / 4; i++)
+        {
+            pui32Flash[i] &= pui32Data[i];
+        }
+        i32Status = 0;
+    }
+    SitlLeave();
+    return i32Status;
+}
+
+//*****************************************************************************
+//
+// drivers/rgb.h.
+//
+//*****************************************************************************
+void
+RGBInit(uint32_t ui32Enable)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+RGBColorSet(volatile uint32_t *pui32RGBColor)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+RGBIntensitySet(float fIntensity)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+RGBEnable(void)
+{
+    SitlEnter();
+    SitlLeave();
+}
+
+void
+RGBBlinkRateSet(float fRate)
+{
+    SitlEnter();
+    SitlLeave();
+}
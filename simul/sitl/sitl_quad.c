@@ -0,0 +1,495 @@
+//*****************************************************************************
+//
+// sitl_quad.c - The airframe, motors and sensor errors of the SITL target.
+//
+// A rigid body with the constants of controller.c and simul/sil/quadrotor.py,
+// driven by four motors that follow the speed their ESC maps the pulse to
+// with a first order lag. The ESC map is the inverse of CalcDutyCycle() in
+// controller.c, and an ESC only runs the motor once it went through the
+// throttle calibration of CalibrateThrottle(): a full throttle pulse, then a
+// low one for SITL_ESC_ARM_S.
+//
+// The quadrotor rests on the ground until the thrust lifts it. A touchdown
+// faster than SITL_CRASH_SPEED or more tilted than SITL_CRASH_TILT is a
+// crash, and the frame stays on the ground. The sensor truth adds white
+// noise, and a gyroscope bias that drifts with the die temperature as the
+// board warms up.
+//
+//*****************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "sitl_quad.h"
+
+//*****************************************************************************
+//
+// The airframe, the constants of controller.c, and the drag of the frame in
+// N per m/s and N m per rad/s.
+//
+//*****************************************************************************
+#define SITL_PI                 3.14159265358979323846f
+#define SITL_G                  9.81f
+#define SITL_MASS               0.66f
+#define SITL_ARM                0.25f
+#define SITL_I_XX               0.00884f
+#define SITL_I_YY               0.00884f
+#define SITL_I_ZZ               0.0165f
+#define SITL_K                  (0.62f * 9.81f /                              \
+                                 ((2.0f * SITL_PI * 6360.0f / 60.0f) *        \
+                                  (2.0f * SITL_PI * 6360.0f / 60.0f)))
+#define SITL_B                  5.4e-6f
+#define SITL_DRAG               0.2f
+#define SITL_ROT_DRAG           0.0005f
+
+//*****************************************************************************
+//
+// The motors and ESCs: the time constant of a motor in s, the ESC map from
+// rpm to pulse and the arming of the throttle calibration.
+//
+//*****************************************************************************
+#define SITL_MOTOR_TAU          0.03f
+#define SITL_ESC_A              4.82229155e-09f
+#define SITL_ESC_B              3.85170924e-05f
+#define SITL_ESC_C              4.92630283e-01f
+#define SITL_ESC_HIGH           0.9f
+#define SITL_ESC_LOW            0.55f
+#define SITL_ESC_ARM_S          1.0f
+
+//*****************************************************************************
+//
+// A touchdown that is a crash, in m/s and rad.
+//
+//*****************************************************************************
+#define SITL_CRASH_SPEED        3.0f
+#define SITL_CRASH_TILT         1.047f
+
+//*****************************************************************************
+//
+// Sensor errors: white noise of the magnetometer in T, the largest initial
+// gyroscope bias in rad/s and its drift in rad/s per degree C. The die warms
+// from 25 C by SITL_WARM_C with the time constant SITL_WARM_S. The noise of
+// the accelerometer and gyroscope is the measured one of sensor_model.c, and
+// SITL_SENSOR_PERIOD the period in s assumed for their first sample.
+//
+//*****************************************************************************
+#define SITL_SENSOR_PERIOD      0.001f
+#define SITL_MAG_NOISE          0.3e-6f
+#define SITL_GYRO_BIAS          0.02f
+#define SITL_GYRO_DRIFT         0.0002f
+#define SITL_WARM_C             10.0f
+#define SITL_WARM_S             300.0f
+
+//*****************************************************************************
+//
+// The earth field in the world frame, in T.
+//
+//*****************************************************************************
+static const float g_pfField[3] = { 22e-6f, 0.0f, -42e-6f };
+
+//*****************************************************************************
+//
+// The offsets in m/s^2 and scale of the accelerometer of the board, the ones
+// CompDCMAccelUpdate() corrects.
+//
+//*****************************************************************************
+static const float g_pfAccelOffset[3] = { 0.55f, -0.1f, -0.55f };
+static const float g_pfAccelScale[3] = { 1.0f, 1.0f, 1.0f / 0.98f };
+
+//*****************************************************************************
+//
+// Noise: uniform in [0, 1) and standard normal.
+//
+//*****************************************************************************
+static float
+SitlQuadUniform(tSitlQuad *psQuad)
+{
+    psQuad->ui32Random ^= psQuad->ui32Random << 13;
+    psQuad->ui32Random ^= psQuad->ui32Random >> 17;
+    psQuad->ui32Random ^= psQuad->ui32Random << 5;
+    return (float)(psQuad->ui32Random >> 8) / 16777216.0f;
+}
+
+static float
+SitlQuadNormal(tSitlQuad *psQuad)
+{
+    float fU = SitlQuadUniform(psQuad);
+    float fV = SitlQuadUniform(psQuad);
+
+    return sqrtf(-2.0f * logf(1.0f - fU)) * cosf(2.0f * SITL_PI * fV);
+}
+
+//*****************************************************************************
+//
+// Returns the motor speed in rad/s the ESC runs at for a pulse.
+//
+//*****************************************************************************
+static float
+SitlQuadEscOmega(float fPulse)
+{
+    float fRpm;
+
+    if (fPulse <= SITL_ESC_C)
+    {
+        return 0.0f;
+    }
+    if (fPulse > 1.0f)
+    {
+        fPulse = 1.0f;
+    }
+    fRpm = (sqrtf(SITL_ESC_B * SITL_ESC_B -
+                  4.0f * SITL_ESC_A * (SITL_ESC_C - fPulse)) - SITL_ESC_B) /
+           (2.0f * SITL_ESC_A);
+    return fRpm * 2.0f * SITL_PI / 60.0f;
+}
+
+//*****************************************************************************
+//
+// Sets the attitude to level, with the heading kept.
+//
+//*****************************************************************************
+static void
+SitlQuadLevel(tSitlQuad *psQuad)
+{
+    float fYaw = atan2f(psQuad->ppfDCM[1][0], psQuad->ppfDCM[0][0]);
+
+    memset(psQuad->ppfDCM, 0, sizeof(psQuad->ppfDCM));
+    psQuad->ppfDCM[0][0] = cosf(fYaw);
+    psQuad->ppfDCM[0][1] = -sinf(fYaw);
+    psQuad->ppfDCM[1][0] = sinf(fYaw);
+    psQuad->ppfDCM[1][1] = cosf(fYaw);
+    psQuad->ppfDCM[2][2] = 1.0f;
+}
+
+//*****************************************************************************
+//
+// Turns the DCM by the angular velocity over fDt with the Rodrigues formula
+// and makes it orthonormal again.
+//
+//*****************************************************************************
+static void
+SitlQuadRotate(tSitlQuad *psQuad, float fDt)
+{
+    float ppfB[3][3], ppfInc[3][3], ppfNew[3][3];
+    float fSigma, fA, fC, fNorm, fDot;
+    int i, j, k;
+
+    ppfB[0][0] = 0.0f;
+    ppfB[0][1] = -psQuad->pfRate[2] * fDt;
+    ppfB[0][2] = psQuad->pfRate[1] * fDt;
+    ppfB[1][0] = psQuad->pfRate[2] * fDt;
+    ppfB[1][1] = 0.0f;
+    ppfB[1][2] = -psQuad->pfRate[0] * fDt;
+    ppfB[2][0] = -psQuad->pfRate[1] * fDt;
+    ppfB[2][1] = psQuad->pfRate[0] * fDt;
+    ppfB[2][2] = 0.0f;
+
+    fSigma = fDt * sqrtf(psQuad->pfRate[0] * psQuad->pfRate[0] +
+                         psQuad->pfRate[1] * psQuad->pfRate[1] +
+                         psQuad->pfRate[2] * psQuad->pfRate[2]);
+    if (fSigma < 1e-6f)
+    {
+        fA = 1.0f;
+        fC = 0.5f;
+    }
+    else
+    {
+        fA = sinf(fSigma) / fSigma;
+        fC = (1.0f - cosf(fSigma)) / (fSigma * fSigma);
+    }
+
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            ppfInc[i][j] = ((i == j) ? 1.0f : 0.0f) + fA * ppfB[i][j];
+            for (k = 0; k < 3; k++)
+            {
+                ppfInc[i][j] += fC * ppfB[i][k] * ppfB[k][j];
+            }
+        }
+    }
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            ppfNew[i][j] = 0.0f;
+            for (k = 0; k < 3; k++)
+            {
+                ppfNew[i][j] += psQuad->ppfDCM[i][k] * ppfInc[k][j];
+            }
+        }
+    }
+
+    //
+    // Gram-Schmidt on the columns.
+    //
+    for (j = 0; j < 3; j++)
+    {
+        for (k = 0; k < j; k++)
+        {
+            fDot = 0.0f;
+            for (i = 0; i < 3; i++)
+            {
+                fDot += ppfNew[i][j] * ppfNew[i][k];
+            }
+            for (i = 0; i < 3; i++)
+            {
+                ppfNew[i][j] -= fDot * ppfNew[i][k];
+            }
+        }
+        fNorm = sqrtf(ppfNew[0][j] * ppfNew[0][j] +
+                      ppfNew[1][j] * ppfNew[1][j] +
+                      ppfNew[2][j] * ppfNew[2][j]);
+        for (i = 0; i < 3; i++)
+        {
+            ppfNew[i][j] /= fNorm;
+        }
+    }
+    memcpy(psQuad->ppfDCM, ppfNew, sizeof(ppfNew));
+}
+
+//*****************************************************************************
+//
+// Puts the quadrotor level on the ground facing north, with the motors
+// stopped and the ESCs not armed. The seed draws the gyroscope bias and the
+// noise.
+//
+//*****************************************************************************
+void
+SitlQuadInit(tSitlQuad *psQuad, uint32_t ui32Seed)
+{
+    tSensorNoise sNoise;
+    int i;
+
+    memset(psQuad, 0, sizeof(*psQuad));
+    psQuad->ppfDCM[0][0] = 1.0f;
+    psQuad->ppfDCM[1][1] = 1.0f;
+    psQuad->ppfDCM[2][2] = 1.0f;
+    psQuad->bOnGround = true;
+    psQuad->ui32Random = ui32Seed ? ui32Seed : 1;
+
+    for (i = 0; i < 3; i++)
+    {
+        psQuad->pfGyroBias[i] = SITL_GYRO_BIAS *
+                                (2.0f * SitlQuadUniform(psQuad) - 1.0f);
+    }
+
+    //
+    // The gyroscope bias and the accelerometer calibration errors are the
+    // ones above, and the MPU9150 model rounds the readings itself.
+    //
+    SensorModelNoiseDefault(&sNoise);
+    sNoise.fGyroBias = 0.0f;
+    sNoise.fAccelBias = 0.0f;
+    sNoise.bQuantize = false;
+    SensorModelInit(&psQuad->sSensor, &sNoise, 1, psQuad->ui32Random);
+}
+
+//*****************************************************************************
+//
+// Advances the quadrotor by fDt s with the ESC pulses pfPulse, as fractions
+// of the PWM period.
+//
+//*****************************************************************************
+void
+SitlQuadStep(tSitlQuad *psQuad, const float pfPulse[4], float fDt)
+{
+    static const float pfInertia[3] = { SITL_I_XX, SITL_I_YY, SITL_I_ZZ };
+    float pfOmegaSq[4], pfTorque[3], pfMoment[3];
+    float fThrust, fArm, fTarget, fTilt, fSpeed;
+    int i;
+
+    //
+    // The ESCs and the motors.
+    //
+    for (i = 0; i < 4; i++)
+    {
+        if (pfPulse[i] >= SITL_ESC_HIGH)
+        {
+            psQuad->pbEscHigh[i] = true;
+            psQuad->pfEscLow[i] = 0.0f;
+        }
+        else if (psQuad->pbEscHigh[i] && (pfPulse[i] <= SITL_ESC_LOW))
+        {
+            psQuad->pfEscLow[i] += fDt;
+            if (psQuad->pfEscLow[i] >= SITL_ESC_ARM_S)
+            {
+                psQuad->pbEscArmed[i] = true;
+            }
+        }
+
+        fTarget = psQuad->pbEscArmed[i] ? SitlQuadEscOmega(pfPulse[i]) : 0.0f;
+        psQuad->pfOmega[i] += (fTarget - psQuad->pfOmega[i]) * fDt /
+                              (SITL_MOTOR_TAU + fDt);
+        pfOmegaSq[i] = psQuad->pfOmega[i] * psQuad->pfOmega[i];
+    }
+
+    fThrust = SITL_K * (pfOmegaSq[0] + pfOmegaSq[1] + pfOmegaSq[2] +
+                        pfOmegaSq[3]);
+    fArm = SITL_K * SITL_ARM / sqrtf(2.0f);
+    pfTorque[0] = fArm * (pfOmegaSq[0] - pfOmegaSq[1] - pfOmegaSq[2] +
+                          pfOmegaSq[3]);
+    pfTorque[1] = fArm * (-pfOmegaSq[0] - pfOmegaSq[1] + pfOmegaSq[2] +
+                          pfOmegaSq[3]);
+    pfTorque[2] = SITL_B * (-pfOmegaSq[0] + pfOmegaSq[1] - pfOmegaSq[2] +
+                            pfOmegaSq[3]);
+
+    //
+    // The thrust along the body z axis, gravity and the drag of the frame.
+    //
+    for (i = 0; i < 3; i++)
+    {
+        psQuad->pfAccel[i] = (psQuad->ppfDCM[i][2] * fThrust -
+                              SITL_DRAG * psQuad->pfVel[i]) / SITL_MASS;
+    }
+    psQuad->pfAccel[2] -= SITL_G;
+
+    //
+    // On the ground until the thrust lifts the frame, a crashed one stays.
+    //
+    if (psQuad->bOnGround)
+    {
+        if (psQuad->bCrashed || (psQuad->pfAccel[2] <= 0.0f))
+        {
+            memset(psQuad->pfVel, 0, sizeof(psQuad->pfVel));
+            memset(psQuad->pfAccel, 0, sizeof(psQuad->pfAccel));
+            memset(psQuad->pfRate, 0, sizeof(psQuad->pfRate));
+            return;
+        }
+        psQuad->bOnGround = false;
+    }
+
+    //
+    // The rigid body.
+    //
+    pfMoment[0] = pfInertia[0] * psQuad->pfRate[0];
+    pfMoment[1] = pfInertia[1] * psQuad->pfRate[1];
+    pfMoment[2] = pfInertia[2] * psQuad->pfRate[2];
+    pfTorque[0] -= psQuad->pfRate[1] * pfMoment[2] -
+                   psQuad->pfRate[2] * pfMoment[1];
+    pfTorque[1] -= psQuad->pfRate[2] * pfMoment[0] -
+                   psQuad->pfRate[0] * pfMoment[2];
+    pfTorque[2] -= psQuad->pfRate[0] * pfMoment[1] -
+                   psQuad->pfRate[1] * pfMoment[0];
+    for (i = 0; i < 3; i++)
+    {
+        pfTorque[i] -= SITL_ROT_DRAG * psQuad->pfRate[i];
+        psQuad->pfRate[i] += fDt * pfTorque[i] / pfInertia[i];
+    }
+    SitlQuadRotate(psQuad, fDt);
+
+    for (i = 0; i < 3; i++)
+    {
+        psQuad->pfVel[i] += fDt * psQuad->pfAccel[i];
+        psQuad->pfPos[i] += fDt * psQuad->pfVel[i];
+    }
+
+    //
+    // Touchdown.
+    //
+    if (psQuad->pfPos[2] <= 0.0f)
+    {
+        fSpeed = -psQuad->pfVel[2];
+        fTilt = SitlQuadTilt(psQuad);
+        if ((fSpeed > SITL_CRASH_SPEED) || (fTilt > SITL_CRASH_TILT))
+        {
+            psQuad->bCrashed = true;
+            psQuad->fCrashSpeed = fSpeed;
+            psQuad->fCrashTilt = fTilt;
+        }
+        psQuad->bOnGround = true;
+        psQuad->pfPos[2] = 0.0f;
+        memset(psQuad->pfVel, 0, sizeof(psQuad->pfVel));
+        memset(psQuad->pfAccel, 0, sizeof(psQuad->pfAccel));
+        memset(psQuad->pfRate, 0, sizeof(psQuad->pfRate));
+        SitlQuadLevel(psQuad);
+    }
+}
+
+//*****************************************************************************
+//
+// Fills the truth the MPU9150 samples at fTime s: the specific force and the
+// earth field in the body frame and the angular velocity, with the errors
+// of the sensor.
+//
+//*****************************************************************************
+void
+SitlQuadTruth(tSitlQuad *psQuad, float fTime, tMPU9150Truth *psTruth)
+{
+    float pfForce[3], pfBody[3], pfGyro[3], pfAccel[3];
+    float fTemp, fDeltaT;
+    int i;
+
+    fTemp = 25.0f + SITL_WARM_C * (1.0f - expf(-fTime / SITL_WARM_S));
+
+    fDeltaT = fTime - psQuad->fSensorTime;
+    if (!(fDeltaT > 0.0f))
+    {
+        fDeltaT = SITL_SENSOR_PERIOD;
+    }
+    psQuad->fSensorTime = fTime;
+
+    pfForce[0] = psQuad->pfAccel[0];
+    pfForce[1] = psQuad->pfAccel[1];
+    pfForce[2] = psQuad->pfAccel[2] + SITL_G;
+
+    for (i = 0; i < 3; i++)
+    {
+        pfBody[i] = (psQuad->ppfDCM[0][i] * pfForce[0] +
+                     psQuad->ppfDCM[1][i] * pfForce[1] +
+                     psQuad->ppfDCM[2][i] * pfForce[2]);
+    }
+    SensorModelSample(&psQuad->sSensor, fDeltaT, psQuad->pfRate, pfBody,
+                      pfGyro, pfAccel);
+
+    for (i = 0; i < 3; i++)
+    {
+        psTruth->pfAccel[i] = pfAccel[i] * g_pfAccelScale[i] +
+                              g_pfAccelOffset[i];
+        psTruth->pfGyro[i] = pfGyro[i] + psQuad->pfGyroBias[i] +
+                             SITL_GYRO_DRIFT * (fTemp - 25.0f);
+        psTruth->pfMagneto[i] = psQuad->ppfDCM[0][i] * g_pfField[0] +
+                                psQuad->ppfDCM[1][i] * g_pfField[1] +
+                                psQuad->ppfDCM[2][i] * g_pfField[2] +
+                                SITL_MAG_NOISE * SitlQuadNormal(psQuad);
+    }
+    psTruth->fTemperature = fTemp;
+}
+
+//*****************************************************************************
+//
+// Returns roll, pitch and yaw in rad as CompDCMComputeEulers() does.
+//
+//*****************************************************************************
+void
+SitlQuadEulers(const tSitlQuad *psQuad, float pfEulers[3])
+{
+    float fR20 = psQuad->ppfDCM[2][0];
+
+    if (fR20 > 1.0f)
+    {
+        fR20 = 1.0f;
+    }
+    if (fR20 < -1.0f)
+    {
+        fR20 = -1.0f;
+    }
+    pfEulers[0] = atan2f(psQuad->ppfDCM[2][1], psQuad->ppfDCM[2][2]);
+    pfEulers[1] = asinf(-fR20);
+    pfEulers[2] = atan2f(psQuad->ppfDCM[1][0], psQuad->ppfDCM[0][0]);
+}
+
+//*****************************************************************************
+//
+// Returns the angle between the body z axis and the vertical, in rad.
+//
+//*****************************************************************************
+float
+SitlQuadTilt(const tSitlQuad *psQuad)
+{
+    float fCos = psQuad->ppfDCM[2][2];
+
+    return acosf((fCos > 1.0f) ? 1.0f : ((fCos < -1.0f) ? -1.0f : fCos));
+}
@@ -0,0 +1,81 @@
+//*****************************************************************************
+//
+// sitl_quad.h - The airframe, motors and sensor errors of the SITL target.
+//
+//*****************************************************************************
+
+#ifndef _SITL_QUAD_H_
+#define _SITL_QUAD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mpu9150_model.h"
+#include "sensor_model.h"
+
+//*****************************************************************************
+//
+// The state of the quadrotor. The world frame has x to the north and z up,
+// the body frame is the one of the accelerometer and gyroscope.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // Position in m, velocity in m/s and acceleration in m/s^2 in the world
+    // frame, the attitude as the body to world DCM and the angular velocity
+    // in rad/s in the body frame.
+    //
+    float pfPos[3];
+    float pfVel[3];
+    float pfAccel[3];
+    float ppfDCM[3][3];
+    float pfRate[3];
+
+    //
+    // Motor speeds in rad/s, and the arming of the ESCs: the full throttle
+    // pulse of the calibration was seen, and the time the pulse has been low
+    // since.
+    //
+    float pfOmega[4];
+    bool pbEscHigh[4];
+    float pfEscLow[4];
+    bool pbEscArmed[4];
+
+    //
+    // Ground contact, and the speed in m/s and tilt in rad of a touchdown
+    // that was a crash.
+    //
+    bool bOnGround;
+    bool bCrashed;
+    float fCrashSpeed;
+    float fCrashTilt;
+
+    //
+    // Gyroscope bias in rad/s at 25 C and the state of the noise generator.
+    //
+    float pfGyroBias[3];
+    uint32_t ui32Random;
+
+    //
+    // The noise, bias walk, misalignment and low pass filter of the
+    // accelerometer and gyroscope, and the time in s of their last sample.
+    //
+    tSensorModel sSensor;
+    float fSensorTime;
+}
+tSitlQuad;
+
+//*****************************************************************************
+//
+// Prototypes.
+//
+//*****************************************************************************
+extern void SitlQuadInit(tSitlQuad *psQuad, uint32_t ui32Seed);
+extern void SitlQuadStep(tSitlQuad *psQuad, const float pfPulse[4],
+                         float fDt);
+extern void SitlQuadTruth(tSitlQuad *psQuad, float fTime,
+                          tMPU9150Truth *psTruth);
+extern void SitlQuadEulers(const tSitlQuad *psQuad, float pfEulers[3]);
+extern float SitlQuadTilt(const tSitlQuad *psQuad);
+
+#endif // _SITL_QUAD_H_
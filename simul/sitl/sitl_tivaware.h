@@ -0,0 +1,265 @@
+//*****************************************************************************
+//
+// sitl_tivaware.h - The part of TivaWare the flight controller uses, on the
+// simulated microcontroller of sitl_hw.c.
+//
+// The headers of inc/, driverlib/, drivers/ and utils/ in this directory
+// stand in for the ones of TivaWare and all include this file. The
+// constants have their TivaWare values. ROM_ functions are the plain ones
+// and HWREG() goes through SitlReg(), which models the registers the
+// firmware touches directly: the DWT cycle counter and the UART2 data
+// register.
+//
+//*****************************************************************************
+
+#ifndef _SITL_TIVAWARE_H_
+#define _SITL_TIVAWARE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//*****************************************************************************
+//
+// inc/hw_memmap.h and inc/hw_types.h.
+//
+//*****************************************************************************
+#define GPIO_PORTA_BASE         0x40004000
+#define GPIO_PORTB_BASE         0x40005000
+#define GPIO_PORTC_BASE         0x40006000
+#define GPIO_PORTD_BASE         0x40007000
+#define GPIO_PORTE_BASE         0x40024000
+#define UART0_BASE              0x4000C000
+#define UART2_BASE              0x4000E000
+#define I2C1_BASE               0x40021000
+#define PWM1_BASE               0x40029000
+
+extern volatile uint32_t *SitlReg(uint32_t ui32Addr);
+
+#define HWREG(x)                (*SitlReg(x))
+
+//*****************************************************************************
+//
+// inc/tm4c123gh6pm.h.
+//
+//*****************************************************************************
+#define UART2_DR_R              HWREG(UART2_BASE)
+
+//*****************************************************************************
+//
+// driverlib/debug.h.
+//
+//*****************************************************************************
+#define ASSERT(expr)
+
+//*****************************************************************************
+//
+// driverlib/interrupt.h. The interrupt numbers are the vector numbers of
+// startup_ccs.c.
+//
+//*****************************************************************************
+#define FAULT_SYSTICK           15
+#define INT_GPIOB               17
+#define INT_UART0               21
+#define INT_UART2               49
+#define INT_I2C1                53
+
+extern bool IntMasterEnable(void);
+extern bool IntMasterDisable(void);
+extern void IntEnable(uint32_t ui32Interrupt);
+extern void IntDisable(uint32_t ui32Interrupt);
+
+//*****************************************************************************
+//
+// driverlib/sysctl.h.
+//
+//*****************************************************************************
+#define SYSCTL_PERIPH_GPIOA     0xf0000800
+#define SYSCTL_PERIPH_GPIOB     0xf0000801
+#define SYSCTL_PERIPH_GPIOC     0xf0000802
+#define SYSCTL_PERIPH_GPIOD     0xf0000803
+#define SYSCTL_PERIPH_GPIOE     0xf0000804
+#define SYSCTL_PERIPH_TIMER0    0xf0000400
+#define SYSCTL_PERIPH_TIMER1    0xf0000401
+#define SYSCTL_PERIPH_UART0     0xf0001800
+#define SYSCTL_PERIPH_UART2     0xf0001802
+#define SYSCTL_PERIPH_I2C1      0xf0002001
+#define SYSCTL_PERIPH_PWM1      0xf0004001
+#define SYSCTL_PERIPH_WTIMER5   0xf0005c05
+
+#define SYSCTL_SYSDIV_5         0xC2000000
+#define SYSCTL_USE_PLL          0x00000000
+#define SYSCTL_XTAL_16MHZ       0x00000540
+#define SYSCTL_OSC_MAIN         0x00000000
+#define SYSCTL_PWMDIV_64        0x001A0000
+
+extern void SysCtlClockSet(uint32_t ui32Config);
+extern uint32_t SysCtlClockGet(void);
+extern void SysCtlPWMClockSet(uint32_t ui32Config);
+extern void SysCtlPeripheralEnable(uint32_t ui32Peripheral);
+extern void SysCtlPeripheralReset(uint32_t ui32Peripheral);
+extern void SysCtlPeripheralSleepEnable(uint32_t ui32Peripheral);
+extern void SysCtlPeripheralClockGating(bool bEnable);
+extern void SysCtlDelay(uint32_t ui32Count);
+extern void SysCtlSleep(void);
+
+//*****************************************************************************
+//
+// driverlib/systick.h.
+//
+//*****************************************************************************
+extern void SysTickPeriodSet(uint32_t ui32Period);
+extern void SysTickIntEnable(void);
+extern void SysTickEnable(void);
+
+//*****************************************************************************
+//
+// driverlib/gpio.h and driverlib/pin_map.h.
+//
+//*****************************************************************************
+#define GPIO_PIN_0              0x00000001
+#define GPIO_PIN_1              0x00000002
+#define GPIO_PIN_2              0x00000004
+#define GPIO_PIN_3              0x00000008
+#define GPIO_PIN_4              0x00000010
+#define GPIO_PIN_5              0x00000020
+#define GPIO_PIN_6              0x00000040
+#define GPIO_PIN_7              0x00000080
+
+#define GPIO_FALLING_EDGE       0x00000000
+
+#define GPIO_PA0_U0RX           0x00000001
+#define GPIO_PA1_U0TX           0x00000401
+#define GPIO_PA6_I2C1SCL        0x00001803
+#define GPIO_PA7_I2C1SDA        0x00001C03
+#define GPIO_PD0_M1PWM0         0x00030005
+#define GPIO_PD1_M1PWM1         0x00030405
+#define GPIO_PD6_U2RX           0x00031801
+#define GPIO_PD7_U2TX           0x00031C01
+#define GPIO_PE4_M1PWM2         0x00041005
+#define GPIO_PE5_M1PWM3         0x00041405
+
+extern void GPIOPinConfigure(uint32_t ui32PinConfig);
+extern void GPIOPinTypeGPIOInput(uint32_t ui32Port, uint8_t ui8Pins);
+extern void GPIOPinTypeGPIOOutput(uint32_t ui32Port, uint8_t ui8Pins);
+extern void GPIOPinTypeGPIOOutputOD(uint32_t ui32Port, uint8_t ui8Pins);
+extern void GPIOPinTypeI2C(uint32_t ui32Port, uint8_t ui8Pins);
+extern void GPIOPinTypeI2CSCL(uint32_t ui32Port, uint8_t ui8Pins);
+extern void GPIOPinTypePWM(uint32_t ui32Port, uint8_t ui8Pins);
+extern void GPIOPinTypeUART(uint32_t ui32Port, uint8_t ui8Pins);
+extern int32_t GPIOPinRead(uint32_t ui32Port, uint8_t ui8Pins);
+extern void GPIOPinWrite(uint32_t ui32Port, uint8_t ui8Pins, uint8_t ui8Val);
+extern void GPIOIntTypeSet(uint32_t ui32Port, uint8_t ui8Pins,
+                           uint32_t ui32IntType);
+extern void GPIOIntEnable(uint32_t ui32Port, uint32_t ui32IntFlags);
+extern void GPIOIntDisable(uint32_t ui32Port, uint32_t ui32IntFlags);
+extern uint32_t GPIOIntStatus(uint32_t ui32Port, bool bMasked);
+extern void GPIOIntClear(uint32_t ui32Port, uint32_t ui32IntFlags);
+
+//*****************************************************************************
+//
+// driverlib/uart.h and utils/uartstdio.h, the buffered UARTStdio of the
+// board build (UART_BUFFERED).
+//
+//*****************************************************************************
+#define UART_CLOCK_PIOSC        0x00000005
+#define UART_CONFIG_WLEN_8      0x00000060
+#define UART_CONFIG_STOP_ONE    0x00000000
+#define UART_CONFIG_PAR_NONE    0x00000000
+#define UART_FIFO_TX7_8         0x00000004
+#define UART_FIFO_RX7_8         0x00000020
+#define UART_INT_RX             0x00000010
+
+extern void UARTClockSourceSet(uint32_t ui32Base, uint32_t ui32Source);
+extern void UARTConfigSetExpClk(uint32_t ui32Base, uint32_t ui32UARTClk,
+                                uint32_t ui32Baud, uint32_t ui32Config);
+extern void UARTFIFOLevelSet(uint32_t ui32Base, uint32_t ui32TxLevel,
+                             uint32_t ui32RxLevel);
+extern void UARTIntEnable(uint32_t ui32Base, uint32_t ui32IntFlags);
+extern void UARTIntClear(uint32_t ui32Base, uint32_t ui32IntFlags);
+extern bool UARTCharPutNonBlocking(uint32_t ui32Base, unsigned char ucData);
+extern void UARTStdioConfig(uint32_t ui32PortNum, uint32_t ui32Baud,
+                            uint32_t ui32SrcClock);
+extern int UARTprintf(const char *pcString, ...);
+extern void UARTFlushTx(bool bDiscard);
+extern int UARTTxBytesFree(void);
+
+//*****************************************************************************
+//
+// driverlib/pwm.h.
+//
+//*****************************************************************************
+#define PWM_GEN_0               0x00000040
+#define PWM_GEN_1               0x00000080
+#define PWM_GEN_MODE_DOWN       0x00000000
+#define PWM_OUT_0               0x00000040
+#define PWM_OUT_1               0x00000041
+#define PWM_OUT_2               0x00000082
+#define PWM_OUT_3               0x00000083
+#define PWM_OUT_0_BIT           0x00000001
+#define PWM_OUT_1_BIT           0x00000002
+#define PWM_OUT_2_BIT           0x00000004
+#define PWM_OUT_3_BIT           0x00000008
+
+extern void PWMGenConfigure(uint32_t ui32Base, uint32_t ui32Gen,
+                            uint32_t ui32Config);
+extern void PWMGenPeriodSet(uint32_t ui32Base, uint32_t ui32Gen,
+                            uint32_t ui32Period);
+extern void PWMGenEnable(uint32_t ui32Base, uint32_t ui32Gen);
+extern void PWMPulseWidthSet(uint32_t ui32Base, uint32_t ui32PWMOut,
+                             uint32_t ui32Width);
+extern void PWMOutputState(uint32_t ui32Base, uint32_t ui32PWMOutBits,
+                           bool bEnable);
+
+//*****************************************************************************
+//
+// driverlib/flash.h. The LOG region of the flash is mapped at its address.
+//
+//*****************************************************************************
+extern int32_t FlashErase(uint32_t ui32Address);
+extern int32_t FlashProgram(uint32_t *pui32Data, uint32_t ui32Address,
+                            uint32_t ui32Count);
+
+//*****************************************************************************
+//
+// drivers/rgb.h. The LED is not modelled.
+//
+//*****************************************************************************
+#define RED                     0
+#define GREEN                   1
+#define BLUE                    2
+
+extern void RGBInit(uint32_t ui32Enable);
+extern void RGBColorSet(volatile uint32_t *pui32RGBColor);
+extern void RGBIntensitySet(float fIntensity);
+extern void RGBEnable(void);
+extern void RGBBlinkRateSet(float fRate);
+
+//*****************************************************************************
+//
+// driverlib/rom.h.
+//
+//*****************************************************************************
+#define ROM_GPIOIntTypeSet              GPIOIntTypeSet
+#define ROM_GPIOPinConfigure            GPIOPinConfigure
+#define ROM_GPIOPinTypeGPIOInput        GPIOPinTypeGPIOInput
+#define ROM_GPIOPinTypeI2C              GPIOPinTypeI2C
+#define ROM_GPIOPinTypePWM              GPIOPinTypePWM
+#define ROM_GPIOPinTypeUART             GPIOPinTypeUART
+#define ROM_IntEnable                   IntEnable
+#define ROM_IntMasterEnable             IntMasterEnable
+#define ROM_PWMGenEnable                PWMGenEnable
+#define ROM_PWMOutputState              PWMOutputState
+#define ROM_PWMPulseWidthSet            PWMPulseWidthSet
+#define ROM_SysCtlClockGet              SysCtlClockGet
+#define ROM_SysCtlClockSet              SysCtlClockSet
+#define ROM_SysCtlDelay                 SysCtlDelay
+#define ROM_SysCtlPWMClockSet           SysCtlPWMClockSet
+#define ROM_SysCtlPeripheralClockGating SysCtlPeripheralClockGating
+#define ROM_SysCtlPeripheralEnable      SysCtlPeripheralEnable
+#define ROM_SysCtlPeripheralSleepEnable SysCtlPeripheralSleepEnable
+#define ROM_SysCtlSleep                 SysCtlSleep
+#define ROM_SysTickEnable               SysTickEnable
+#define ROM_SysTickIntEnable            SysTickIntEnable
+#define ROM_SysTickPeriodSet            SysTickPeriodSet
+
+#endif // _SITL_TIVAWARE_H_